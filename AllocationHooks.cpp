@@ -0,0 +1,109 @@
+// Replacements of the global operator new and delete that feed the
+// allocation counters declared in FrontEnd.h. Linked into pyc; libpyc.a
+// carries them only when built with ALLOCATION_HOOKS=1, since they take
+// over the allocator of the whole program.
+#include "FrontEnd.h"
+#ifdef __linux__
+#include <malloc.h>
+#endif
+
+namespace pyc::detail
+{
+static int64_t usableSize(void *p) noexcept
+{
+#ifdef __linux__
+	return int64_t(malloc_usable_size(p));
+#else
+	(void)p;
+	return 0;
+#endif
+}
+
+// Out of line so that the compiler never pairs an inlined malloc with a free
+#if defined(__GNUC__)
+#define PYC_NOINLINE __attribute__((noinline))
+#else
+#define PYC_NOINLINE
+#endif
+
+static PYC_NOINLINE void profileAllocation(void *p, size_t size) noexcept
+{
+	SiteCounters &site = allocationSites[size_t(allocationSite)];
+	site.allocations.fetch_add(1, memory_order_relaxed);
+	site.bytes.fetch_add(size, memory_order_relaxed);
+	int64_t usable = usableSize(p);
+	int64_t live = liveBytes.fetch_add(usable, memory_order_relaxed) + usable;
+	if (allocationPeak && live > *allocationPeak)
+		*allocationPeak = live;
+}
+
+static PYC_NOINLINE void *countedMalloc(size_t size) noexcept
+{
+	allocationCounters.allocations++;
+	allocationCounters.bytes += size;
+	void *p = malloc(size ? size : 1);
+	if (allocationProfiling && p)
+		profileAllocation(p, size);
+	return p;
+}
+
+// Runs before main(), so every allocation counter and the checks that
+// rely on one see the hooks as soon as this file is linked in
+static const bool installed = allocationHooks = true;
+} // namespace pyc::detail
+
+// All the plain and array forms are replaced together so that every
+// pointer from one of them is released by the matching free below
+void *operator new(std::size_t size)
+{
+	if (void *p = pyc::detail::countedMalloc(size))
+		return p;
+	throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size)
+{
+	return operator new(size);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+	return pyc::detail::countedMalloc(size);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept
+{
+	return pyc::detail::countedMalloc(size);
+}
+
+PYC_NOINLINE void operator delete(void *p) noexcept
+{
+	if (pyc::detail::allocationProfiling && p)
+		pyc::detail::liveBytes.fetch_sub(pyc::detail::usableSize(p), std::memory_order_relaxed);
+	free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+	operator delete(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+	operator delete(p);
+}
+
+void operator delete[](void *p, std::size_t) noexcept
+{
+	operator delete(p);
+}
+
+void operator delete(void *p, const std::nothrow_t &) noexcept
+{
+	operator delete(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t &) noexcept
+{
+	operator delete(p);
+}
@@ -0,0 +1,1448 @@
+#include "Engines.h"
+#ifdef __unix__
+#include <unistd.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#endif
+
+namespace pyc::detail
+{
+// ----------------------------------------------
+// Ahead-of-time executables
+// ----------------------------------------------
+// --aot compiles a whole program to x86-64 assembly (GNU as, Intel syntax)
+// and links it with a small C runtime into a standalone executable using
+// the system compiler driver ($CC, or cc). Values are tagged 64-bit words:
+// an odd word is an integer n stored as n << 1 | 1, anything else points to
+// a heap or static object whose first word is its kind. Integers outside
+// that 62-bit range are boxed, floats are always boxed.
+//
+// The runtime has no collector: objects come from a bump allocator that is
+// released when the process exits, which suits the batch scripts this mode
+// is meant for. Output and error messages match the bytecode VM.
+
+// Object kinds and operator codes; the runtime below uses the same numbers
+enum AotKind
+{
+	AotNone,
+	AotBool,
+	AotInt,
+	AotFloat,
+	AotStr,
+	AotList,
+	AotTuple,
+	AotRange,
+	AotFunction
+};
+
+static const char *const aotOperators[] = {"+", "-", "*", "/", "%", "&", "|", "^", "<<", ">>", "==", "!=", "<", "<=", ">", ">=", "in", "not in", "is", "is not"};
+
+static const char *const aotBuiltins[] = {"print", "range", "len", "str", "repr", "int", "float", "bool", "abs", "min", "max", "sum", "list", "tuple"};
+
+static const char *const aotMethods[] = {"append", "pop"};
+
+// AotRuntime.c, linked with the generated assembly into every executable
+static const char *aotRuntime =
+#include "AotRuntime.c.inc"
+	;
+
+// Translates a whole module to assembly. Every expression leaves its value
+// in rax. Locals live at [rbp - 8 * (k + 1)]; temporaries are frame slots
+// at [rsp + 8 * k] numbered by nesting depth, so rsp stays 16-byte aligned
+// and the arguments of a call are already a contiguous array. Small
+// integer and float arithmetic and comparisons are inline, with the
+// runtime as the slow path. Module-level functions are called directly;
+// classes, dictionaries, exceptions, imports, attribute access and
+// functions used as values throw CompileError.
+class AotCompiler
+{
+public:
+	explicit AotCompiler(const string &scriptPath) : scriptPath(scriptPath) {}
+
+	string compile(ParseTreeNode *root)
+	{
+		for (const char *name : aotBuiltins)
+			builtins.insert(name);
+		vector<ParseTreeNode *> defs;
+		for (ParseTreeNode *child : root->children)
+		{
+			ParseTreeNode *statement = unwrap(child);
+			if (isLeaf(statement))
+				continue;
+			unordered_set<string> bound;
+			collectBoundNames(statement, bound);
+			for (const string &name : bound)
+				moduleBindings[name]++;
+			if (statement->label == "function")
+				defs.push_back(statement);
+			else if (statement->label == "class_def")
+				throw CompileError("class '" + statement->children[1]->label + "' is not supported by --aot");
+		}
+		for (ParseTreeNode *def : defs)
+		{
+			const string &name = def->children[1]->label;
+			if (moduleBindings[name] > 1)
+				throw CompileError("'" + name + "' is rebound at module level, which --aot does not support");
+			Function &f = functions[name];
+			f.node = def;
+			for (ParseTreeNode *param : def->children[3]->children)
+			{
+				if (param->label != "parameter")
+					continue;
+				f.params.push_back(param->children[0]->label);
+				if (param->children.size() == 3)
+					f.defaults.push_back(param->children[2]);
+				else if (!f.defaults.empty())
+					throw CompileError("non-default parameter follows default parameter in '" + name + "'");
+			}
+		}
+
+		for (ParseTreeNode *def : defs)
+			compileFunction(def->children[1]->label);
+		compileModule(root);
+
+		string out = ".intel_syntax noprefix\n\t.text\n" + text + "\t.data\n" + data + "\t.section .rodata\n\t.globl pyc_script\npyc_script:\n\t.asciz \"" + asmString(scriptPath) + "\"\n" + strings + "\t.bss\n\t.balign 8\n";
+		sort(bssSymbols.begin(), bssSymbols.end());
+		for (const string &symbol : bssSymbols)
+			out += symbol + ":\n\t.zero 8\n";
+		return out + "\t.section .note.GNU-stack,\"\",@progbits\n";
+	}
+
+private:
+	struct Function
+	{
+		ParseTreeNode *node = nullptr;
+		vector<string> params;
+		vector<ParseTreeNode *> defaults;
+	};
+	struct Loop
+	{
+		string next, end;
+	};
+	struct Scope
+	{
+		bool isModule = true;
+		unordered_map<string, int> locals;
+		int depth = 0, maxDepth = 0;
+		vector<Loop> loops;
+		string returnLabel, unboundLabel;
+		vector<pair<string, string>> nameErrors; // name, stub label
+	};
+
+	string scriptPath;
+	unordered_map<string, Function> functions; // module-level defs
+	unordered_map<string, int> moduleBindings;
+	unordered_set<string> builtins, globals;
+	vector<string> bssSymbols;
+	unordered_map<string, string> constants, nameStrings;
+	string text, data, strings;
+	ostringstream code; // body of the function being compiled
+	Scope *scope = nullptr;
+	int labels = 0;
+
+	static bool isLeaf(const ParseTreeNode *node) { return node->children.empty(); }
+
+	static ParseTreeNode *unwrap(ParseTreeNode *node)
+	{
+		while (node->label == "statement" && !node->children.empty())
+			node = node->children[0];
+		return node;
+	}
+
+	static string asmString(const string &s)
+	{
+		string out;
+		char escape[8];
+		for (unsigned char c : s)
+		{
+			if (c == '"' || c == '\\')
+				out += '\\', out += static_cast<char>(c);
+			else if (c < 32 || c >= 127)
+			{
+				snprintf(escape, sizeof(escape), "\\%03o", c);
+				out += escape;
+			}
+			else
+				out += static_cast<char>(c);
+		}
+		return out;
+	}
+
+	static int operatorIndex(const string &op)
+	{
+		for (size_t k = 0; k < size(aotOperators); k++)
+			if (op == aotOperators[k])
+				return static_cast<int>(k);
+		throw CompileError("operator '" + op + "' is not supported by --aot");
+	}
+
+	static bool isComparison(int op) { return op >= 10; }
+
+	// --- emission -------------------------------------------------------
+
+	void emit(const string &line) { code << '\t' << line << '\n'; }
+	void place(const string &label) { code << label << ":\n"; }
+	string newLabel() { return ".L" + to_string(labels++); }
+
+	int temp(int count = 1)
+	{
+		int first = scope->depth;
+		scope->depth += count;
+		scope->maxDepth = max(scope->maxDepth, scope->depth);
+		return first;
+	}
+
+	static string slot(int t) { return "qword ptr [rsp + " + to_string(8 * t) + "]"; }
+	static string local(int k) { return "qword ptr [rbp - " + to_string(8 * (k + 1)) + "]"; }
+	static string global(const string &name) { return "qword ptr [rip + pyg_" + name + "]"; }
+
+	void useGlobal(const string &name)
+	{
+		if (globals.insert(name).second)
+			bssSymbols.push_back("pyg_" + name);
+	}
+
+	// Label of a NUL-terminated copy of 'name' for error messages
+	string nameString(const string &name)
+	{
+		auto it = nameStrings.find(name);
+		if (it != nameStrings.end())
+			return it->second;
+		string label = newLabel();
+		strings += label + ":\n\t.asciz \"" + asmString(name) + "\"\n";
+		return nameStrings[name] = label;
+	}
+
+	string nameError(const string &name)
+	{
+		for (auto &[known, label] : scope->nameErrors)
+			if (known == name)
+				return label;
+		scope->nameErrors.push_back({name, newLabel()});
+		return scope->nameErrors.back().second;
+	}
+
+	// --- constants ------------------------------------------------------
+
+	static bool isSmall(long long n) { return n >= -(1LL << 62) && n <= (1LL << 62) - 1; }
+
+	static string tagged(long long n) { return to_string(static_cast<long long>(static_cast<unsigned long long>(n) << 1 | 1)); }
+
+	// A .quad operand for 'v': a tagged integer, or the label of a static object
+	string constantWord(const ConstValue &v)
+	{
+		switch (v.kind)
+		{
+		case ConstValue::Kind::None:
+			return "pyc_none";
+		case ConstValue::Kind::Bool:
+			return v.i ? "pyc_true" : "pyc_false";
+		case ConstValue::Kind::Int:
+			if (isSmall(v.i))
+				return tagged(v.i);
+			break;
+		default:
+			break;
+		}
+
+		string key;
+		uint64_t bits = 0;
+		vector<string> items;
+		switch (v.kind)
+		{
+		case ConstValue::Kind::Int:
+			key = "i" + to_string(v.i);
+			break;
+		case ConstValue::Kind::Float:
+			memcpy(&bits, &v.f, sizeof(bits));
+			key = "f" + to_string(bits);
+			break;
+		case ConstValue::Kind::Str:
+			key = "s" + v.s;
+			break;
+		default:
+			key = "t";
+			for (const ConstValue &item : v.items)
+			{
+				items.push_back(constantWord(item));
+				key += items.back() + ",";
+			}
+			break;
+		}
+		auto it = constants.find(key);
+		if (it != constants.end())
+			return it->second;
+
+		string object, length = to_string(v.kind == ConstValue::Kind::Str ? v.s.size() : v.items.size());
+		if (v.kind == ConstValue::Kind::Int)
+			object = to_string(AotInt) + ", " + to_string(v.i);
+		else if (v.kind == ConstValue::Kind::Float)
+			object = to_string(AotFloat) + ", " + to_string(bits);
+		else if (v.kind == ConstValue::Kind::Str)
+		{
+			string buffer = newLabel();
+			data += "\t.balign 8\n" + buffer + ":\n\t.quad " + length + ", " + length + "\n\t.ascii \"" + asmString(v.s) + "\"\n";
+			object = to_string(AotStr) + ", " + length + ", " + buffer;
+		}
+		else
+		{
+			string array = "0";
+			if (!items.empty())
+			{
+				array = newLabel();
+				data += "\t.balign 8\n" + array + ":\n\t.quad ";
+				for (size_t k = 0; k < items.size(); k++)
+					data += (k ? ", " : "") + items[k];
+				data += "\n";
+			}
+			object = to_string(AotTuple) + ", " + length + ", " + length + ", " + array;
+		}
+		string label = newLabel();
+		data += "\t.balign 8\n" + label + ":\n\t.quad " + object + "\n";
+		return constants[key] = label;
+	}
+
+	void loadConstant(const ConstValue &v)
+	{
+		string word = constantWord(v);
+		if (word[0] == '-' || isdigit(static_cast<unsigned char>(word[0])))
+			emit("mov rax, " + word);
+		else
+			emit("lea rax, [rip + " + word + "]");
+	}
+
+	// --- names ----------------------------------------------------------
+
+	void loadName(const string &name)
+	{
+		auto it = scope->locals.find(name);
+		if (it != scope->locals.end())
+		{
+			emit("mov rax, " + local(it->second));
+			emit("test rax, rax");
+			emit("jz " + scope->unboundLabel);
+			return;
+		}
+		if (functions.count(name))
+			throw CompileError("function '" + name + "' is used as a value, which --aot does not support");
+		if (builtins.count(name) && !moduleBindings.count(name))
+			throw CompileError("builtin '" + name + "' is used as a value, which --aot does not support");
+		useGlobal(name);
+		emit("mov rax, " + global(name));
+		emit("test rax, rax");
+		emit("jz " + nameError(name));
+	}
+
+	void storeName(const string &name)
+	{
+		auto it = scope->locals.find(name);
+		if (it != scope->locals.end())
+			emit("mov " + local(it->second) + ", rax");
+		else
+		{
+			useGlobal(name);
+			emit("mov " + global(name) + ", rax");
+		}
+	}
+
+	// --- functions ------------------------------------------------------
+
+	// Frame, stubs and epilogue around the body in 'code'
+	void finishFunction(const string &symbol, const string &checks, const string &exit)
+	{
+		int slots = static_cast<int>(scope->locals.size()) + scope->maxDepth;
+		slots += slots & 1;
+		text += "\t.balign 16\n" + symbol + ":\n\tpush rbp\n\tmov rbp, rsp\n";
+		if (slots)
+			text += "\tsub rsp, " + to_string(8 * slots) + "\n";
+		text += checks + code.str() + exit;
+		if (!scope->unboundLabel.empty())
+			text += scope->unboundLabel + ":\n\tcall pyc_unbound_error\n";
+		for (auto &[name, label] : scope->nameErrors)
+			text += label + ":\n\tlea rdi, [rip + " + nameString(name) + "]\n\tcall pyc_name_error\n";
+		code.str("");
+	}
+
+	// pyf_NAME(const pv *args, long count): checks the argument count and
+	// the recursion depth, copies arguments and defaults into the frame
+	void compileFunction(const string &name)
+	{
+		const Function &f = functions.at(name);
+		Scope state;
+		state.isModule = false;
+		for (const string &param : f.params)
+		{
+			if (state.locals.count(param))
+				throw CompileError("duplicate argument '" + param + "' in function '" + name + "'");
+			int index = static_cast<int>(state.locals.size());
+			state.locals[param] = index;
+		}
+		unordered_set<string> bound;
+		collectBoundNames(f.node->children.back(), bound);
+		vector<string> sortedNames(bound.begin(), bound.end());
+		sort(sortedNames.begin(), sortedNames.end());
+		for (const string &local : sortedNames)
+			state.locals.emplace(local, static_cast<int>(state.locals.size()));
+		state.returnLabel = newLabel();
+		state.unboundLabel = newLabel();
+		scope = &state;
+
+		size_t total = f.params.size(), required = total - f.defaults.size();
+		string arity = newLabel(), recursion = newLabel(), checks;
+		checks += "\tcmp rsi, " + to_string(total) + "\n\tja " + arity + "\n";
+		if (required)
+			checks += "\tcmp rsi, " + to_string(required) + "\n\tjb " + arity + "\n";
+		checks += "\tmov rax, qword ptr [rip + pyc_depth]\n\tcmp rax, 2000\n\tjge " + recursion +
+				  "\n\tinc rax\n\tmov qword ptr [rip + pyc_depth], rax\n";
+		for (size_t k = 0; k < total; k++)
+		{
+			if (k < required)
+				checks += "\tmov rax, qword ptr [rdi + " + to_string(8 * k) + "]\n";
+			else
+			{
+				string given = newLabel(), store = newLabel();
+				checks += "\tcmp rsi, " + to_string(k) + "\n\tja " + given + "\n\tmov rax, qword ptr [rip + pyd_" + name + "_" +
+						  to_string(k - required) + "]\n\tjmp " + store + "\n" + given + ":\n\tmov rax, qword ptr [rdi + " +
+						  to_string(8 * k) + "]\n" + store + ":\n";
+			}
+			checks += "\tmov " + local(static_cast<int>(k)) + ", rax\n";
+		}
+		for (size_t k = total; k < state.locals.size(); k++)
+			checks += "\tmov " + local(static_cast<int>(k)) + ", 0\n";
+
+		statements(f.node->children.back());
+		emit("lea rax, [rip + pyc_none]");
+		string exit = state.returnLabel + ":\n\tdec qword ptr [rip + pyc_depth]\n\tleave\n\tret\n" + arity + ":\n\tmov rdx, rsi\n\tmov esi, " +
+					  to_string(total) + "\n\tlea rdi, [rip + " + nameString(name) + "]\n\tcall pyc_arity_error\n" + recursion +
+					  ":\n\tcall pyc_recursion_error\n";
+		finishFunction("pyf_" + name, checks, exit);
+		scope = nullptr;
+	}
+
+	void compileModule(ParseTreeNode *root)
+	{
+		Scope state;
+		scope = &state;
+		statements(root);
+		finishFunction("pyc_module", "", "\tleave\n\tret\n");
+		text = "\t.globl pyc_module\n" + text;
+		scope = nullptr;
+	}
+
+	// A def statement binds the function and evaluates its defaults
+	void define(ParseTreeNode *node)
+	{
+		const string &name = node->children[1]->label;
+		auto f = functions.find(name);
+		if (!scope->isModule || f == functions.end() || f->second.node != node)
+			throw CompileError("function '" + name + "' is not defined at the top level of the module, which --aot does not support");
+		for (size_t k = 0; k < f->second.defaults.size(); k++)
+		{
+			string symbol = "pyd_" + name + "_" + to_string(k);
+			bssSymbols.push_back(symbol);
+			expr(f->second.defaults[k]);
+			emit("mov qword ptr [rip + " + symbol + "], rax");
+		}
+		emit("lea rax, [rip + pyc_function]");
+		storeName(name);
+	}
+
+	// --- statements -----------------------------------------------------
+
+	void statements(ParseTreeNode *list)
+	{
+		for (ParseTreeNode *child : list->children)
+			statement(child);
+	}
+
+	void statement(ParseTreeNode *node)
+	{
+		int mark = scope->depth;
+		const string &label = node->label;
+		if (isLeaf(node))
+			return; // INDENT / DEDENT markers
+		if (label == "statement")
+			statement(node->children[0]);
+		else if (label == "assignment")
+			assignment(node);
+		else if (label == "conditional_statement")
+			conditional(node);
+		else if (label == "while_statement")
+			whileLoop(node);
+		else if (label == "for_statement")
+			forLoop(node);
+		else if (label == "function")
+			define(node);
+		else if (label == "return_statement")
+		{
+			if (scope->isModule)
+				throw CompileError("'return' outside function");
+			if (node->children.size() > 1)
+				expr(node->children[1]);
+			else
+				emit("lea rax, [rip + pyc_none]");
+			emit("jmp " + scope->returnLabel);
+		}
+		else if (label == "pass_statement")
+		{
+		}
+		else if (label == "break_statement" || label == "continue_statement")
+		{
+			if (scope->loops.empty())
+				throw CompileError("'" + node->children[0]->label + "' outside loop");
+			emit("jmp " + (label == "break_statement" ? scope->loops.back().end : scope->loops.back().next));
+		}
+		else if (label == "function_call")
+		{
+			ParseTreeNode *arguments = nullptr;
+			for (ParseTreeNode *part : node->children)
+				if (part->label == "arguments")
+					arguments = part;
+			call(node->children[0], arguments);
+		}
+		else if (label == "factor")
+			expr(node); // docstring or bare literal
+		else
+			throw CompileError("'" + label + "' is not supported by --aot");
+		scope->depth = mark;
+	}
+
+	void assignment(ParseTreeNode *node)
+	{
+		auto [targets, values, op] = splitAssignment(node);
+		for (ParseTreeNode *target : targets)
+			if (!isLeaf(target))
+				throw CompileError("attribute assignment is not supported by --aot");
+
+		if (op != "=")
+		{
+			if (targets.size() != 1)
+				throw CompileError("augmented assignment needs exactly one target");
+			if (op != "+=" && op != "-=" && op != "*=" && op != "/=" && op != "%=")
+				throw CompileError("unsupported operator '" + op + "'");
+			int left = temp();
+			loadName(targets[0]->label);
+			emit("mov " + slot(left) + ", rax");
+			bool fresh = expr(values[0]);
+			emit("mov rdx, rax");
+			emit("mov rsi, " + slot(left));
+			binary(operatorIndex(op.substr(0, op.size() - 1)), false, fresh);
+			storeName(targets[0]->label);
+			return;
+		}
+		if (targets.size() == 1)
+		{
+			expr(values[0]);
+			storeName(targets[0]->label);
+			return;
+		}
+		if (values.size() != targets.size())
+			throw CompileError("unpacking is not supported by --aot");
+		int base = temp(static_cast<int>(values.size()));
+		for (size_t k = 0; k < values.size(); k++)
+		{
+			expr(values[k]);
+			emit("mov " + slot(base + static_cast<int>(k)) + ", rax");
+		}
+		for (size_t k = 0; k < targets.size(); k++)
+		{
+			emit("mov rax, " + slot(base + static_cast<int>(k)));
+			storeName(targets[k]->label);
+		}
+	}
+
+	void conditional(ParseTreeNode *node)
+	{
+		string end = newLabel();
+		auto clause = [&](ParseTreeNode *cond, ParseTreeNode *block) -> bool
+		{
+			bool truth;
+			if (cond && foldedTruth(cond, truth))
+			{
+				if (!truth)
+					return false; // branch can never run
+				statements(block);
+				return true; // later clauses are unreachable
+			}
+			string next = newLabel();
+			if (cond)
+				jumpIf(cond, false, next);
+			statements(block);
+			if (cond)
+			{
+				emit("jmp " + end);
+				place(next);
+			}
+			return !cond;
+		};
+
+		bool done = clause(node->children[1], node->children[3]);
+		for (size_t k = 4; k < node->children.size() && !done; k++)
+		{
+			ParseTreeNode *part = node->children[k];
+			if (part->label == "elif_clause")
+				done = clause(part->children[1], part->children[3]);
+			else if (part->label == "else_clause")
+				done = clause(nullptr, part->children[2]);
+		}
+		place(end);
+	}
+
+	void whileLoop(ParseTreeNode *node)
+	{
+		bool truth;
+		bool constant = foldedTruth(node->children[1], truth);
+		if (constant && !truth)
+			return;
+		string top = newLabel(), end = newLabel();
+		place(top);
+		if (!constant)
+			jumpIf(node->children[1], false, end);
+		scope->loops.push_back({top, end});
+		statements(node->children[3]);
+		scope->loops.pop_back();
+		emit("jmp " + top);
+		place(end);
+	}
+
+	// The call node of "range(...)" when 'iterable' is exactly that
+	ParseTreeNode *rangeCall(ParseTreeNode *iterable)
+	{
+		if (!iterable->folded.empty())
+			return nullptr;
+		while (iterable->children.size() == 1 && iterable->label != "factor")
+			iterable = iterable->children[0];
+		const auto &c = iterable->children;
+		if (iterable->label != "factor" || c.size() < 3 || !isLeaf(c[0]) || c[0]->label != "range" || c[1]->label != "(")
+			return nullptr;
+		if (scope->locals.count("range") || moduleBindings.count("range"))
+			return nullptr;
+		return iterable;
+	}
+
+	// for over range() counts in raw integers; anything else goes through pyc_next
+	void forLoop(ParseTreeNode *node)
+	{
+		const string &name = node->children[1]->label;
+		ParseTreeNode *iterable = node->children[3];
+		string top = newLabel(), next = newLabel(), end = newLabel();
+		if (ParseTreeNode *range = rangeCall(iterable))
+		{
+			vector<ParseTreeNode *> args = callArguments(range->children.size() > 3 ? range->children[2] : nullptr);
+			int bounds = temp(3); // next value, stop, step
+			int base = temp(max(1, static_cast<int>(args.size())));
+			for (size_t k = 0; k < args.size(); k++)
+			{
+				expr(args[k]);
+				emit("mov " + slot(base + static_cast<int>(k)) + ", rax");
+			}
+			emit("lea rdi, [rsp + " + to_string(8 * base) + "]");
+			emit("mov esi, " + to_string(args.size()));
+			emit("lea rdx, [rsp + " + to_string(8 * bounds) + "]");
+			emit("call pyc_range_bounds");
+			scope->depth = base;
+
+			int sign = 1;
+			ConstValue step;
+			if (args.size() == 3)
+				sign = !args[2]->folded.empty() && parseLiteral(args[2]->folded, step) && step.kind == ConstValue::Kind::Int ? (step.i > 0 ? 1 : -1) : 0;
+			place(top);
+			emit("mov rax, " + slot(bounds));
+			if (sign == 0)
+			{
+				string negative = newLabel(), body = newLabel();
+				emit("cmp " + slot(bounds + 2) + ", 0");
+				emit("jl " + negative);
+				emit("cmp rax, " + slot(bounds + 1));
+				emit("jge " + end);
+				emit("jmp " + body);
+				place(negative);
+				emit("cmp rax, " + slot(bounds + 1));
+				emit("jle " + end);
+				place(body);
+			}
+			else
+			{
+				emit("cmp rax, " + slot(bounds + 1));
+				emit((sign > 0 ? "jge " : "jle ") + end);
+			}
+			string big = newLabel(), store = newLabel();
+			emit("mov rcx, rax");
+			emit("add rcx, rcx");
+			emit("jo " + big);
+			emit("lea rax, [rcx + 1]");
+			emit("jmp " + store);
+			place(big);
+			emit("mov rdi, rax");
+			emit("call pyc_int");
+			place(store);
+			storeName(name);
+			scope->loops.push_back({next, end});
+			statements(node->children[5]);
+			scope->loops.pop_back();
+			place(next);
+			emit("mov rax, " + slot(bounds));
+			emit("add rax, " + slot(bounds + 2));
+			emit("jo " + end);
+			emit("mov " + slot(bounds) + ", rax");
+			emit("jmp " + top);
+			place(end);
+			return;
+		}
+
+		int iterator = temp(2); // iterable, position
+		expr(iterable);
+		emit("mov " + slot(iterator) + ", rax");
+		emit("mov " + slot(iterator + 1) + ", 0");
+		place(top);
+		emit("mov rdi, " + slot(iterator));
+		emit("lea rsi, [rsp + " + to_string(8 * (iterator + 1)) + "]");
+		emit("call pyc_next");
+		emit("test rax, rax");
+		emit("jz " + end);
+		storeName(name);
+		scope->loops.push_back({top, end});
+		statements(node->children[5]);
+		scope->loops.pop_back();
+		emit("jmp " + top);
+		place(end);
+	}
+
+	// --- conditions -----------------------------------------------------
+
+	// Jumps to 'target' when the truth of the value in rax is 'sense'
+	void truthJump(bool sense, const string &target)
+	{
+		string done = newLabel(), slow = newLabel();
+		emit("lea rcx, [rip + pyc_true]");
+		emit("cmp rax, rcx");
+		emit("je " + (sense ? target : done));
+		emit("lea rcx, [rip + pyc_false]");
+		emit("cmp rax, rcx");
+		emit("je " + (sense ? done : target));
+		emit("test al, 1");
+		emit("jz " + slow);
+		emit("cmp rax, 1");
+		emit((sense ? "jne " : "je ") + target);
+		emit("jmp " + done);
+		place(slow);
+		emit("mov rdi, rax");
+		emit("call pyc_truthy");
+		emit("test eax, eax");
+		emit((sense ? "jnz " : "jz ") + target);
+		place(done);
+	}
+
+	// Jumps to 'target' when the truth of 'node' is 'sense'; comparisons
+	// and boolean operators branch without building bool objects
+	void jumpIf(ParseTreeNode *node, bool sense, const string &target)
+	{
+		const string &label = node->label;
+		const auto &c = node->children;
+		bool truth;
+		if (label == "expression")
+		{
+			if (foldedTruth(node, truth))
+			{
+				if (truth == sense)
+					emit("jmp " + target);
+				return;
+			}
+			return jumpIf(c[0], sense, target);
+		}
+		if ((label == "or_expression" || label == "and_expression") && c.size() > 1)
+		{
+			bool decisive = label == "or_expression"; // the operand value that settles the result
+			if (sense == decisive)
+			{
+				for (size_t k = 0; k < c.size(); k += 2)
+					jumpIf(c[k], sense, target);
+				return;
+			}
+			string settled = newLabel();
+			for (size_t k = 0; k + 1 < c.size(); k += 2)
+				jumpIf(c[k], decisive, settled);
+			jumpIf(c.back(), sense, target);
+			place(settled);
+			return;
+		}
+		if (label == "not_expression" && c.size() == 2)
+			return jumpIf(c[1], !sense, target);
+		if (label == "factor" && c.size() == 2 && c[0]->label == "not")
+			return jumpIf(c[1], !sense, target);
+		if (c.size() == 1 && label != "factor")
+			return jumpIf(c[0], sense, target);
+		if (label == "comparison" && c.size() == 3 && isComparison(operatorIndex(comparisonOperator(c[1]))))
+		{
+			int left = temp();
+			expr(c[0]);
+			emit("mov " + slot(left) + ", rax");
+			expr(c[2]);
+			emit("mov rdx, rax");
+			emit("mov rsi, " + slot(left));
+			compareJump(operatorIndex(comparisonOperator(c[1])), target, sense);
+			scope->depth = left;
+			return;
+		}
+		expr(node);
+		truthJump(sense, target);
+	}
+
+	// Loads rsi and rdx into xmm0 and xmm1 when each is a small int or a
+	// float; jumps to 'slow' otherwise
+	void floatOperands(const string &slow)
+	{
+		const char *regs[] = {"rsi", "rdx"};
+		for (int k = 0; k < 2; k++)
+		{
+			string reg = regs[k], xmm = "xmm" + to_string(k), object = newLabel(), done = newLabel();
+			emit("test " + string(k ? "dl" : "sil") + ", 1");
+			emit("jz " + object);
+			emit("mov rax, " + reg);
+			emit("sar rax, 1");
+			emit("cvtsi2sd " + xmm + ", rax");
+			emit("jmp " + done);
+			place(object);
+			emit("cmp qword ptr [" + reg + "], " + to_string(AotFloat));
+			emit("jne " + slow);
+			emit("movsd " + xmm + ", qword ptr [" + reg + " + 8]");
+			place(done);
+		}
+	}
+
+	// Boxes xmm0 from the allocator's current chunk, or through the runtime
+	// when the chunk is full; then jumps to 'done'
+	void boxFloat(const string &done)
+	{
+		string refill = newLabel();
+		emit("mov rax, qword ptr [rip + pyc_heap]");
+		emit("lea rcx, [rax + 16]");
+		emit("cmp rcx, qword ptr [rip + pyc_heap_end]");
+		emit("ja " + refill);
+		emit("mov qword ptr [rip + pyc_heap], rcx");
+		emit("mov qword ptr [rax], " + to_string(AotFloat));
+		emit("movsd qword ptr [rax + 8], xmm0");
+		emit("jmp " + done);
+		place(refill);
+		emit("call pyc_float");
+		emit("jmp " + done);
+	}
+
+	// Compares rsi with rdx and jumps to 'target' when the result is 'sense'
+	void compareJump(int op, const string &target, bool sense)
+	{
+		static const char *const conditions[] = {"e", "ne", "l", "le", "g", "ge"};
+		static const char *const inverses[] = {"ne", "e", "ge", "g", "le", "l"};
+		string done = newLabel(), slow = newLabel();
+		int index = op - operatorIndex("==");
+		if (index < 6)
+		{
+			bool ordered = index >= 2;
+			string notInt = ordered ? newLabel() : slow;
+			emit("mov eax, esi");
+			emit("and eax, edx");
+			emit("test al, 1");
+			emit("jz " + notInt);
+			emit("cmp rsi, rdx"); // tagging preserves the order
+			emit(string("j") + (sense ? conditions[index] : inverses[index]) + " " + target);
+			emit("jmp " + done);
+			if (ordered)
+			{
+				// ucomisd is "above" only for ordered operands, so NaN compares false
+				place(notInt);
+				floatOperands(slow);
+				bool swap = index == 2 || index == 3; // a < b is b > a
+				emit(swap ? "ucomisd xmm1, xmm0" : "ucomisd xmm0, xmm1");
+				bool strict = index == 2 || index == 4;
+				emit(string(sense ? (strict ? "ja " : "jae ") : (strict ? "jbe " : "jb ")) + target);
+				emit("jmp " + done);
+			}
+		}
+		place(slow);
+		emit("mov edi, " + to_string(op));
+		emit("call pyc_compare");
+		emit("test eax, eax");
+		emit((sense ? "jnz " : "jz ") + target);
+		place(done);
+	}
+
+	// --- expressions ----------------------------------------------------
+
+	// rax = rsi op rdx for an arithmetic operator. An operand marked as
+	// reusable is an intermediate float box that nothing else refers to, so
+	// a float result may overwrite it instead of allocating
+	void binary(int op, bool reuseLeft = false, bool reuseRight = false)
+	{
+		string done = newLabel(), slow = newLabel();
+		const string &symbol = aotOperators[op];
+		bool floats = symbol == "+" || symbol == "-" || symbol == "*" || symbol == "/";
+		bool ints = symbol != "/" && symbol != "<<" && symbol != ">>";
+		if (ints)
+		{
+			string notInt = floats ? newLabel() : slow;
+			emit("mov eax, esi");
+			emit("and eax, edx");
+			emit("test al, 1");
+			emit("jz " + notInt);
+			if (symbol == "+")
+			{
+				emit("lea rax, [rsi - 1]");
+				emit("add rax, rdx");
+				emit("jo " + slow);
+			}
+			else if (symbol == "-")
+			{
+				emit("mov rax, rsi");
+				emit("sub rax, rdx");
+				emit("jo " + slow);
+				emit("or rax, 1");
+			}
+			else if (symbol == "*")
+			{
+				emit("mov rax, rsi");
+				emit("sar rax, 1");
+				emit("lea rcx, [rdx - 1]");
+				emit("imul rax, rcx");
+				emit("jo " + slow);
+				emit("or rax, 1");
+			}
+			else if (symbol == "%")
+			{
+				// Python's sign rule; the runtime handles zero and -1 divisors
+				string positive = newLabel();
+				emit("mov rcx, rdx");
+				emit("sar rcx, 1");
+				emit("lea rax, [rcx + 1]");
+				emit("cmp rax, 1");
+				emit("jbe " + slow);
+				emit("mov rax, rsi");
+				emit("sar rax, 1");
+				emit("cqo");
+				emit("idiv rcx");
+				emit("test rdx, rdx");
+				emit("jz " + positive);
+				emit("mov rax, rdx");
+				emit("xor rax, rcx");
+				emit("jns " + positive);
+				emit("add rdx, rcx");
+				place(positive);
+				emit("lea rax, [rdx + rdx + 1]");
+			}
+			else if (symbol == "&")
+			{
+				emit("mov rax, rsi");
+				emit("and rax, rdx");
+			}
+			else if (symbol == "|")
+			{
+				emit("mov rax, rsi");
+				emit("or rax, rdx");
+			}
+			else
+			{
+				emit("mov rax, rsi");
+				emit("xor rax, rdx");
+				emit("or rax, 1");
+			}
+			emit("jmp " + done);
+			if (floats)
+				place(notInt);
+		}
+		if (floats)
+		{
+			floatOperands(slow);
+			if (symbol == "/")
+			{
+				emit("xorpd xmm2, xmm2");
+				emit("ucomisd xmm1, xmm2");
+				emit("je " + slow); // zero (or NaN) divisor
+			}
+			emit((symbol == "+" ? "addsd" : symbol == "-" ? "subsd" : symbol == "*" ? "mulsd" : "divsd") + string(" xmm0, xmm1"));
+			for (int k = 0; k < 2; k++)
+			{
+				if (!(k ? reuseRight : reuseLeft))
+					continue;
+				string reg = k ? "rdx" : "rsi", next = newLabel();
+				emit("test " + string(k ? "dl" : "sil") + ", 1");
+				emit("jnz " + next);
+				emit("movsd qword ptr [" + reg + " + 8], xmm0");
+				emit("mov rax, " + reg);
+				emit("jmp " + done);
+				place(next);
+			}
+			boxFloat(done);
+		}
+		place(slow);
+		emit("mov edi, " + to_string(op));
+		emit("call pyc_binary");
+		place(done);
+	}
+
+	// rax = True or False from the truth of rax, inverted
+	void notValue()
+	{
+		string truthy = newLabel(), done = newLabel();
+		truthJump(true, truthy);
+		emit("lea rax, [rip + pyc_true]");
+		emit("jmp " + done);
+		place(truthy);
+		emit("lea rax, [rip + pyc_false]");
+		place(done);
+	}
+
+	// Returns whether rax is the fresh result of an arithmetic operator
+	bool expr(ParseTreeNode *node)
+	{
+		const string &label = node->label;
+		const auto &c = node->children;
+		int mark = scope->depth;
+		bool fresh = false;
+
+		if (label == "expression")
+		{
+			ConstValue folded;
+			if (!node->folded.empty() && parseLiteral(node->folded, folded))
+				loadConstant(folded);
+			else
+				fresh = expr(c[0]);
+		}
+		else if ((label == "or_expression" || label == "and_expression") && c.size() > 1)
+		{
+			// The result is the operand that settled it
+			int result = temp();
+			string end = newLabel();
+			for (size_t k = 0; k < c.size(); k += 2)
+			{
+				expr(c[k]);
+				emit("mov " + slot(result) + ", rax");
+				if (k + 1 < c.size())
+					truthJump(label == "or_expression", end);
+			}
+			place(end);
+			emit("mov rax, " + slot(result));
+		}
+		else if (label == "not_expression" && c.size() == 2)
+		{
+			expr(c[1]);
+			notValue();
+		}
+		else if (label == "comparison")
+			comparison(node);
+		else if (label == "arithmetic" || label == "term")
+		{
+			int left = temp();
+			fresh = expr(c[0]);
+			for (size_t k = 1; k + 1 < c.size(); k += 2)
+			{
+				emit("mov " + slot(left) + ", rax");
+				bool freshRight = expr(c[k + 1]);
+				emit("mov rdx, rax");
+				emit("mov rsi, " + slot(left));
+				binary(operatorIndex(c[k]->label), fresh, freshRight);
+				fresh = true;
+			}
+		}
+		else if (label == "factor")
+			fresh = factor(node);
+		else if (c.size() == 1)
+			fresh = expr(c[0]);
+		else
+			throw CompileError("unsupported expression '" + label + "'");
+		scope->depth = mark;
+		return fresh;
+	}
+
+	void comparison(ParseTreeNode *node)
+	{
+		const auto &c = node->children;
+		expr(c[0]);
+		if (c.size() == 1)
+			return;
+		int left = temp(), right = temp(), result = temp();
+		bool compared = false;
+		string end = newLabel();
+		emit("mov " + slot(left) + ", rax");
+		for (size_t k = 1; k + 1 < c.size(); k += 2)
+		{
+			int op = operatorIndex(comparisonOperator(c[k]));
+			if (isComparison(op) && compared)
+			{
+				emit("cmp " + slot(result) + ", 0");
+				emit("je " + end);
+			}
+			expr(c[k + 1]);
+			emit("mov rdx, rax");
+			emit("mov rsi, " + slot(left));
+			if (!isComparison(op))
+			{
+				binary(op);
+				emit("mov " + slot(left) + ", rax");
+				continue;
+			}
+			compared = true;
+			emit("mov " + slot(right) + ", rdx");
+			string yes = newLabel(), next = newLabel();
+			compareJump(op, yes, true);
+			emit("mov " + slot(result) + ", 0");
+			emit("jmp " + next);
+			place(yes);
+			emit("mov " + slot(result) + ", 1");
+			place(next);
+			emit("mov rax, " + slot(right));
+			emit("mov " + slot(left) + ", rax");
+		}
+		if (!compared)
+		{
+			emit("mov rax, " + slot(left));
+			return;
+		}
+		place(end);
+		emit("lea rax, [rip + pyc_true]");
+		emit("lea rcx, [rip + pyc_false]");
+		emit("cmp " + slot(result) + ", 0");
+		emit("cmove rax, rcx");
+	}
+
+	vector<ParseTreeNode *> callArguments(ParseTreeNode *arguments)
+	{
+		vector<ParseTreeNode *> args;
+		if (arguments)
+			for (ParseTreeNode *arg : arguments->children)
+			{
+				if (arg->label == "expression")
+					args.push_back(arg);
+				else if (arg->label != ",")
+					throw CompileError("keyword arguments are not supported by --aot");
+			}
+		return args;
+	}
+
+	// Evaluates 'args' into consecutive slots from 'base'
+	void argumentArray(const vector<ParseTreeNode *> &args, int base)
+	{
+		for (size_t k = 0; k < args.size(); k++)
+		{
+			expr(args[k]);
+			emit("mov " + slot(base + static_cast<int>(k)) + ", rax");
+		}
+	}
+
+	void call(ParseTreeNode *callee, ParseTreeNode *arguments)
+	{
+		vector<ParseTreeNode *> args = callArguments(arguments);
+		int count = static_cast<int>(args.size());
+		if (!isLeaf(callee))
+		{
+			const auto &parts = callee->children;
+			if (parts.size() != 3)
+				throw CompileError("attribute access is not supported by --aot");
+			const string &method = parts[2]->label;
+			auto known = find(begin(aotMethods), end(aotMethods), method);
+			if (known == end(aotMethods))
+				throw CompileError("method '" + method + "' is not supported by --aot");
+			int base = temp(count + 1);
+			loadName(parts[0]->label);
+			emit("mov " + slot(base) + ", rax");
+			argumentArray(args, base + 1);
+			emit("mov edi, " + to_string(known - begin(aotMethods)));
+			emit("mov rsi, " + slot(base));
+			emit("lea rdx, [rsp + " + to_string(8 * (base + 1)) + "]");
+			emit("mov ecx, " + to_string(count));
+			emit("call pyc_method");
+			return;
+		}
+
+		const string &name = callee->label;
+		string target;
+		if (functions.count(name) && !scope->locals.count(name))
+		{
+			// The def must have run, as in the VM
+			useGlobal(name);
+			emit("cmp " + global(name) + ", 0");
+			emit("je " + nameError(name));
+			target = "pyf_" + name;
+		}
+		else if (scope->locals.count(name) || moduleBindings.count(name))
+			throw CompileError("cannot call '" + name + "': --aot only calls module-level functions and builtins");
+		else if (builtins.count(name))
+			target = "pyc_b_" + name;
+		else
+		{
+			emit("jmp " + nameError(name));
+			return;
+		}
+		int base = temp(max(1, count));
+		argumentArray(args, base);
+		emit("lea rdi, [rsp + " + to_string(8 * base) + "]");
+		emit("mov esi, " + to_string(count));
+		emit("call " + target);
+	}
+
+	void sequence(const char *constructor, const vector<ParseTreeNode *> &items)
+	{
+		int count = static_cast<int>(items.size());
+		int base = temp(max(1, count));
+		argumentArray(items, base);
+		emit("lea rdi, [rsp + " + to_string(8 * base) + "]");
+		emit("mov esi, " + to_string(count));
+		emit(string("call ") + constructor);
+	}
+
+	bool factor(ParseTreeNode *node)
+	{
+		const auto &c = node->children;
+		ParseTreeNode *first = c[0];
+
+		if (isLeaf(first) && c.size() == 1)
+		{
+			const string &lexeme = first->label;
+			ConstValue literal;
+			if (classifyLeaf(lexeme) == LeafKind::Name)
+				loadName(lexeme);
+			else if (!parseLiteral(lexeme, literal))
+				throw CompileError("integer literal too large: " + lexeme);
+			else
+				loadConstant(literal);
+			return false;
+		}
+		if (isLeaf(first) && c.size() == 2 && c[1]->label == "factor")
+		{
+			expr(c[1]);
+			if (first->label == "not")
+			{
+				notValue();
+				return false;
+			}
+			string done = newLabel(), slow = newLabel();
+			emit("mov rsi, rax");
+			if (first->label == "-")
+			{
+				emit("test al, 1");
+				emit("jz " + slow);
+				emit("mov rax, 2");
+				emit("sub rax, rsi");
+				emit("jo " + slow);
+				emit("jmp " + done);
+			}
+			place(slow);
+			emit(string("mov edi, ") + (first->label == "-" ? "0" : first->label == "+" ? "1" : "2"));
+			emit("call pyc_unary");
+			place(done);
+			return false;
+		}
+		if (c.size() > 1 && c[1]->label == "(")
+		{
+			call(first, c.size() > 3 ? c[2] : nullptr);
+			return false;
+		}
+		if (first->label == "dotted_name")
+			throw CompileError("attribute access is not supported by --aot");
+
+		vector<ParseTreeNode *> items;
+		bool hasComma = false;
+		for (ParseTreeNode *part : first->children)
+		{
+			if (part->label == "expression")
+				items.push_back(part);
+			hasComma = hasComma || part->label == ",";
+		}
+		if (first->label == "tuple_or_group")
+		{
+			if (items.size() == 1 && !hasComma)
+				return expr(items[0]);
+			sequence("pyc_tuple", items);
+			return false;
+		}
+		if (first->label == "list_literal")
+		{
+			sequence("pyc_list", items);
+			return false;
+		}
+		throw CompileError("'" + first->label + "' is not supported by --aot");
+	}
+};
+
+AotBuild buildAotExecutable(const string &path, const string &output)
+{
+	using Clock = chrono::steady_clock;
+	AotBuild build;
+	auto start = Clock::now();
+	SymbolTable symTable;
+	ParseTreeNode *root = parseForExecution(readFile(path), symTable);
+	if (!root)
+		throw CompileError("syntax errors in " + path);
+	string assembly;
+	try
+	{
+		assembly = AotCompiler(path).compile(root);
+	}
+	catch (...)
+	{
+		deleteTree(root);
+		throw;
+	}
+	deleteTree(root);
+	build.assemblyBytes = assembly.size();
+	auto generated = Clock::now();
+	build.codegenMs = chrono::duration<double, milli>(generated - start).count();
+#ifdef __unix__
+	TempDirectory scratch("pyc_aot_");
+	string module = scratch.path + "/module.s", runtime = scratch.path + "/runtime.c";
+	ofstream(module) << assembly;
+	ofstream(runtime) << aotRuntime;
+	// An output name starting with '-' would be read as an option
+	string target = !output.empty() && output[0] == '-' ? "./" + output : output;
+	vector<string> command = compilerCommand();
+	command.insert(command.end(), {"-O2", "-o", target, module, runtime, "-lm"});
+	if (runProgram(command) != 0)
+		throw CompileError("assembling or linking failed for " + path);
+	build.linkMs = chrono::duration<double, milli>(Clock::now() - generated).count();
+	build.binaryBytes = filesystem::file_size(output);
+	return build;
+#else
+	(void)output;
+	throw CompileError("--aot needs a POSIX system with a C compiler driver");
+#endif
+}
+
+int emitAsmFile(const string &path)
+{
+	SymbolTable symTable;
+	ParseTreeNode *root = parseForExecution(readFile(path), symTable);
+	if (!root)
+		return 1;
+	try
+	{
+		cout << AotCompiler(path).compile(root);
+	}
+	catch (const CompileError &e)
+	{
+		cerr << "Compile error: " << e.what() << endl;
+		return 1;
+	}
+	return 0;
+}
+
+int compileAotFile(const string &path, string output)
+{
+	if (output.empty())
+		output = filesystem::path(path).stem().string();
+	try
+	{
+		AotBuild build = buildAotExecutable(path, output);
+		cout << fixed << setprecision(1) << "Built " << output << ": " << build.binaryBytes / 1024.0 << " KiB (assembly "
+			 << build.assemblyBytes / 1024.0 << " KiB), code generation " << build.codegenMs << " ms, assemble and link "
+			 << build.linkMs << " ms\n"
+			 << defaultfloat << setprecision(6);
+	}
+	catch (const CompileError &e)
+	{
+		cerr << "Compile error: " << e.what() << endl;
+		return 1;
+	}
+	return 0;
+}
+
+#ifdef __unix__
+// Wall time of one run of 'executable' with its output discarded; negative if it failed
+double timeExecutable(const string &executable)
+{
+	auto start = chrono::steady_clock::now();
+	pid_t child = fork();
+	if (child == 0)
+	{
+		int null = open("/dev/null", O_WRONLY);
+		dup2(null, STDOUT_FILENO);
+		execl(executable.c_str(), executable.c_str(), static_cast<char *>(nullptr));
+		_exit(127);
+	}
+	int status = 0;
+	if (child < 0 || waitpid(child, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+		return -1;
+	return chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+}
+#endif
+
+void benchmarkAot(const string &dir, int reps)
+{
+#ifdef __unix__
+	using Clock = chrono::steady_clock;
+	cout << fixed << setprecision(1);
+	cout << "AOT benchmarks (" << dir << ", best of " << reps << ")\n";
+	for (const string &file : listPythonFiles(dir))
+	{
+		string name = filesystem::path(file).filename().string();
+		SymbolTable symTable;
+		ParseTreeNode *root = parseForExecution(readFile(file), symTable);
+		if (!root)
+		{
+			cout << "  " << name << ": parse failed\n";
+			continue;
+		}
+		try
+		{
+			// 'run' executes once and returns the program's OPS
+			auto best = [&](const function<Value()> &run, long long &ops)
+			{
+				double fastest = 1e300;
+				for (int rep = 0; rep < reps; rep++)
+				{
+					auto start = Clock::now();
+					Value count = run();
+					fastest = min(fastest, chrono::duration<double, nano>(Clock::now() - start).count());
+					ops = count.isIntLike() && count.i > 0 ? count.i : 1;
+				}
+				return fastest;
+			};
+			long long ops = 1;
+			TreeInterpreter interpreter(root);
+			double treeTime = best([&]
+								   {
+				ClosureRuntime rt(interpreter.names);
+				rt.captureOutput = true;
+				interpreter.run(rt);
+				return rt.global("OPS"); }, ops);
+			Program bytecode = BytecodeCompiler().compile(root);
+			double vmTime = best([&]
+								 {
+				VirtualMachine vm(bytecode);
+				vm.captureOutput = true;
+				vm.run();
+				return vm.global("OPS"); }, ops);
+
+			TempDirectory scratch("pyc_aot_bench_");
+			string executable = scratch.path + "/program";
+			AotBuild build = buildAotExecutable(file, executable);
+			double aotTime = 1e300;
+			for (int rep = 0; rep < reps && aotTime >= 0; rep++)
+			{
+				double time = timeExecutable(executable);
+				aotTime = time < 0 ? time : min(aotTime, time);
+			}
+			if (aotTime < 0)
+			{
+				cout << "  " << name << ": executable failed\n";
+				continue;
+			}
+			cout << "  " << name << ": tree " << treeTime / ops << " ns/op, vm " << vmTime / ops << " ns/op, aot "
+				 << aotTime / ops << " ns/op (" << setprecision(2) << treeTime / aotTime << "x tree, " << vmTime / aotTime
+				 << "x vm" << setprecision(1) << "), build " << build.codegenMs + build.linkMs << " ms (code generation "
+				 << build.codegenMs << " ms), binary " << build.binaryBytes / 1024.0 << " KiB\n";
+		}
+		catch (const CompileError &e)
+		{
+			cout << "  " << name << ": compile error: " << e.what() << "\n";
+		}
+		catch (PyException &)
+		{
+			cout << "  " << name << ": raised an exception\n";
+		}
+	}
+	cout << defaultfloat << setprecision(6);
+#else
+	(void)dir;
+	(void)reps;
+	cout << "AOT benchmarks need a POSIX system\n";
+#endif
+}
+} // namespace pyc::detail
@@ -0,0 +1,958 @@
+/* Runtime for executables built by --aot */
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef uint64_t pv; /* odd: small int (n << 1 | 1); even: object pointer */
+
+enum { K_NONE, K_BOOL, K_INT, K_FLOAT, K_STR, K_LIST, K_TUPLE, K_RANGE, K_FUNCTION };
+enum { OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_MOD, OP_AND, OP_OR, OP_XOR, OP_SHL, OP_SHR,
+	   OP_EQ, OP_NE, OP_LT, OP_LE, OP_GT, OP_GE, OP_IN, OP_NOTIN, OP_IS, OP_ISNOT };
+static const char *const op_symbols[] = {"+", "-", "*", "/", "%", "&", "|", "^", "<<", ">>",
+										 "==", "!=", "<", "<=", ">", ">=", "in", "not in", "is", "is not"};
+
+typedef struct { long kind; long long i; } pv_int; /* None, bool, function, boxed int */
+typedef struct { long kind; double f; } pv_float;
+typedef struct { long used, capacity; char bytes[]; } pv_buffer;
+typedef struct { long kind; long length; pv_buffer *buffer; } pv_str;
+typedef struct { long kind; long length, capacity; pv *items; } pv_list; /* list and tuple */
+typedef struct { long kind; long long start, stop, step; } pv_range;
+
+pv_int pyc_none = {K_NONE, 0}, pyc_true = {K_BOOL, 1}, pyc_false = {K_BOOL, 0}, pyc_function = {K_FUNCTION, 0};
+long pyc_depth = 1; /* frames, counting the module like the VM does */
+char *pyc_heap, *pyc_heap_end; /* the generated code boxes floats inline */
+extern const char pyc_script[];
+void pyc_module(void);
+
+#define NONE ((pv)&pyc_none)
+#define SMALL_MIN (-(1LL << 62))
+#define SMALL_MAX ((1LL << 62) - 1)
+#define STR(v) ((pv_str *)(v))
+#define LIST(v) ((pv_list *)(v))
+
+__attribute__((noreturn)) void pyc_raise(const char *type, const char *format, ...)
+{
+	va_list args;
+	fflush(stdout);
+	fprintf(stderr, "Traceback (most recent call last):\n  File \"%s\"\n%s: ", pyc_script, type);
+	va_start(args, format);
+	vfprintf(stderr, format, args);
+	va_end(args);
+	fputc('\n', stderr);
+	exit(1);
+}
+
+__attribute__((noreturn)) void pyc_name_error(const char *name) { pyc_raise("NameError", "name '%s' is not defined", name); }
+__attribute__((noreturn)) void pyc_unbound_error(void) { pyc_raise("NameError", "local variable referenced before assignment"); }
+__attribute__((noreturn)) void pyc_recursion_error(void) { pyc_raise("RecursionError", "maximum recursion depth exceeded"); }
+__attribute__((noreturn)) void pyc_arity_error(const char *name, long expected, long given)
+{
+	pyc_raise("TypeError", "%s() takes %ld positional argument(s) but %ld were given", name, expected, given);
+}
+__attribute__((noreturn)) static void overflow(void) { pyc_raise("OverflowError", "integer result too large"); }
+
+void *pyc_alloc(size_t size)
+{
+	size = (size + 15) & ~(size_t)15;
+	if ((size_t)(pyc_heap_end - pyc_heap) < size)
+	{
+		size_t chunk = size > (1 << 20) ? size : (1 << 20);
+		if (!(pyc_heap = malloc(chunk)))
+			pyc_raise("MemoryError", "out of memory");
+		pyc_heap_end = pyc_heap + chunk;
+	}
+	void *p = pyc_heap;
+	pyc_heap += size;
+	return p;
+}
+
+static inline long kind_of(pv v) { return v & 1 ? K_INT : *(long *)v; }
+static inline int is_int(pv v) { long k = kind_of(v); return k == K_INT || k == K_BOOL; }
+static inline int is_number(pv v) { long k = kind_of(v); return k == K_INT || k == K_BOOL || k == K_FLOAT; }
+static inline long long int_of(pv v) { return v & 1 ? (long long)v >> 1 : ((pv_int *)v)->i; }
+static inline double double_of(pv v) { return kind_of(v) == K_FLOAT ? ((pv_float *)v)->f : (double)int_of(v); }
+
+static const char *type_name(pv v)
+{
+	static const char *const names[] = {"NoneType", "bool", "int", "float", "str", "list", "tuple", "iterator", "function"};
+	return names[kind_of(v)];
+}
+
+pv pyc_int(long long n)
+{
+	if (n >= SMALL_MIN && n <= SMALL_MAX)
+		return (pv)n << 1 | 1;
+	pv_int *o = pyc_alloc(sizeof *o);
+	o->kind = K_INT;
+	o->i = n;
+	return (pv)o;
+}
+
+pv pyc_float(double f)
+{
+	pv_float *o = pyc_alloc(sizeof *o);
+	o->kind = K_FLOAT;
+	o->f = f;
+	return (pv)o;
+}
+
+static pv boolean(int b) { return b ? (pv)&pyc_true : (pv)&pyc_false; }
+
+static pv make_str(const char *bytes, long length, long capacity)
+{
+	pv_buffer *b = pyc_alloc(sizeof *b + capacity);
+	b->used = length;
+	b->capacity = capacity;
+	memcpy(b->bytes, bytes, length);
+	pv_str *s = pyc_alloc(sizeof *s);
+	s->kind = K_STR;
+	s->length = length;
+	s->buffer = b;
+	return (pv)s;
+}
+
+/* A string that ends where its buffer's contents end can be extended in
+   place: no other string sees the bytes past its length */
+static pv concat(pv a, pv b)
+{
+	pv_str *x = STR(a), *y = STR(b);
+	long length = x->length + y->length;
+	if (x->length == x->buffer->used && length <= x->buffer->capacity)
+	{
+		memcpy(x->buffer->bytes + x->length, y->buffer->bytes, y->length);
+		x->buffer->used = length;
+		pv_str *s = pyc_alloc(sizeof *s);
+		s->kind = K_STR;
+		s->length = length;
+		s->buffer = x->buffer;
+		return (pv)s;
+	}
+	pv r = make_str(x->buffer->bytes, x->length, length < 16 ? 16 : 2 * length);
+	memcpy(STR(r)->buffer->bytes + x->length, y->buffer->bytes, y->length);
+	STR(r)->buffer->used = STR(r)->length = length;
+	return r;
+}
+
+static pv make_list(long kind, const pv *items, long length)
+{
+	pv_list *l = pyc_alloc(sizeof *l);
+	l->kind = kind;
+	l->length = l->capacity = length;
+	l->items = length ? malloc(length * sizeof(pv)) : NULL;
+	if (length)
+		memcpy(l->items, items, length * sizeof(pv));
+	return (pv)l;
+}
+
+pv pyc_list(const pv *items, long length) { return make_list(K_LIST, items, length); }
+pv pyc_tuple(const pv *items, long length) { return make_list(K_TUPLE, items, length); }
+
+static void append(pv list, pv item)
+{
+	pv_list *l = LIST(list);
+	if (l->length == l->capacity)
+	{
+		l->capacity = l->capacity ? 2 * l->capacity : 4;
+		l->items = realloc(l->items, l->capacity * sizeof(pv));
+	}
+	l->items[l->length++] = item;
+}
+
+/* --- str() and repr() ---------------------------------------------- */
+
+typedef struct { char *bytes; long length, capacity; } pv_text;
+
+static void text_add(pv_text *t, const char *s, long n)
+{
+	if (t->length + n > t->capacity)
+	{
+		t->capacity = 2 * (t->length + n) + 64;
+		t->bytes = realloc(t->bytes, t->capacity);
+	}
+	memcpy(t->bytes + t->length, s, n);
+	t->length += n;
+}
+
+static void format_float(pv_text *t, double d)
+{
+	char buffer[40];
+	if (isinf(d))
+	{
+		text_add(t, d > 0 ? "inf" : "-inf", d > 0 ? 3 : 4);
+		return;
+	}
+	if (d != d)
+	{
+		text_add(t, "nan", 3);
+		return;
+	}
+	/* Shortest digits that read back to d, placed like Python's repr() */
+	for (int precision = 0; precision <= 16; precision++)
+	{
+		snprintf(buffer, sizeof buffer, "%.*e", precision, d);
+		if (strtod(buffer, NULL) == d)
+			break;
+	}
+	char digits[24];
+	int n = 0, negative = buffer[0] == '-';
+	char *e = strchr(buffer, 'e');
+	for (char *p = buffer + negative; p < e; p++)
+		if (*p != '.')
+			digits[n++] = *p;
+	while (n > 1 && digits[n - 1] == '0')
+		n--;
+	int exponent = atoi(e + 1), point = exponent + 1;
+	if (negative)
+		text_add(t, "-", 1);
+	if (exponent >= -4 && exponent < 16)
+	{
+		if (point <= 0)
+		{
+			text_add(t, "0.", 2);
+			for (int k = point; k < 0; k++)
+				text_add(t, "0", 1);
+			text_add(t, digits, n);
+		}
+		else if (point >= n)
+		{
+			text_add(t, digits, n);
+			for (int k = n; k < point; k++)
+				text_add(t, "0", 1);
+			text_add(t, ".0", 2);
+		}
+		else
+		{
+			text_add(t, digits, point);
+			text_add(t, ".", 1);
+			text_add(t, digits + point, n - point);
+		}
+		return;
+	}
+	text_add(t, digits, 1);
+	if (n > 1)
+	{
+		text_add(t, ".", 1);
+		text_add(t, digits + 1, n - 1);
+	}
+	snprintf(buffer, sizeof buffer, "e%c%02d", exponent < 0 ? '-' : '+', abs(exponent));
+	text_add(t, buffer, strlen(buffer));
+}
+
+static void format_quoted(pv_text *t, const char *s, long n)
+{
+	char quote = memchr(s, '\'', n) && !memchr(s, '"', n) ? '"' : '\'';
+	text_add(t, &quote, 1);
+	for (long k = 0; k < n; k++)
+	{
+		if (s[k] == quote || s[k] == '\\')
+			text_add(t, "\\", 1);
+		if (s[k] == '\n')
+			text_add(t, "\\n", 2);
+		else if (s[k] == '\t')
+			text_add(t, "\\t", 2);
+		else
+			text_add(t, s + k, 1);
+	}
+	text_add(t, &quote, 1);
+}
+
+static void format_value(pv_text *t, pv v, int quote)
+{
+	char number[32];
+	switch (kind_of(v))
+	{
+	case K_NONE:
+		text_add(t, "None", 4);
+		return;
+	case K_BOOL:
+		text_add(t, int_of(v) ? "True" : "False", int_of(v) ? 4 : 5);
+		return;
+	case K_INT:
+		text_add(t, number, snprintf(number, sizeof number, "%lld", int_of(v)));
+		return;
+	case K_FLOAT:
+		format_float(t, ((pv_float *)v)->f);
+		return;
+	case K_STR:
+		if (quote)
+			format_quoted(t, STR(v)->buffer->bytes, STR(v)->length);
+		else
+			text_add(t, STR(v)->buffer->bytes, STR(v)->length);
+		return;
+	case K_LIST:
+	case K_TUPLE:
+	{
+		pv_list *l = LIST(v);
+		text_add(t, l->kind == K_LIST ? "[" : "(", 1);
+		for (long k = 0; k < l->length; k++)
+		{
+			if (k)
+				text_add(t, ", ", 2);
+			format_value(t, l->items[k], 1);
+		}
+		if (l->kind == K_TUPLE && l->length == 1)
+			text_add(t, ",", 1);
+		text_add(t, l->kind == K_LIST ? "]" : ")", 1);
+		return;
+	}
+	default:
+		text_add(t, "<", 1);
+		text_add(t, type_name(v), strlen(type_name(v)));
+		text_add(t, " object>", 8);
+	}
+}
+
+static pv to_str(pv v, int quote)
+{
+	if (!quote && kind_of(v) == K_STR)
+		return v;
+	pv_text t = {0};
+	format_value(&t, v, quote);
+	pv s = make_str(t.bytes, t.length, t.length);
+	free(t.bytes);
+	return s;
+}
+
+/* --- operators ------------------------------------------------------ */
+
+static int equal(pv a, pv b)
+{
+	if (is_number(a) && is_number(b))
+	{
+		if (is_int(a) && is_int(b))
+			return int_of(a) == int_of(b);
+		return double_of(a) == double_of(b);
+	}
+	if (a == b)
+		return 1;
+	long kind = kind_of(a);
+	if (kind != kind_of(b))
+		return 0;
+	if (kind == K_STR)
+		return STR(a)->length == STR(b)->length && !memcmp(STR(a)->buffer->bytes, STR(b)->buffer->bytes, STR(a)->length);
+	if (kind == K_LIST || kind == K_TUPLE)
+	{
+		if (LIST(a)->length != LIST(b)->length)
+			return 0;
+		for (long k = 0; k < LIST(a)->length; k++)
+			if (!equal(LIST(a)->items[k], LIST(b)->items[k]))
+				return 0;
+		return 1;
+	}
+	return kind == K_NONE;
+}
+
+static int compare_str(pv a, pv b)
+{
+	long n = STR(a)->length < STR(b)->length ? STR(a)->length : STR(b)->length;
+	int cmp = memcmp(STR(a)->buffer->bytes, STR(b)->buffer->bytes, n);
+	return cmp ? cmp : (STR(a)->length > STR(b)->length) - (STR(a)->length < STR(b)->length);
+}
+
+static int contains(pv container, pv item)
+{
+	switch (kind_of(container))
+	{
+	case K_STR:
+	{
+		if (kind_of(item) != K_STR)
+			pyc_raise("TypeError", "'in <string>' requires string as left operand");
+		long n = STR(item)->length, limit = STR(container)->length - n;
+		for (long k = 0; k <= limit; k++)
+			if (!memcmp(STR(container)->buffer->bytes + k, STR(item)->buffer->bytes, n))
+				return 1;
+		return 0;
+	}
+	case K_LIST:
+	case K_TUPLE:
+		for (long k = 0; k < LIST(container)->length; k++)
+			if (equal(LIST(container)->items[k], item))
+				return 1;
+		return 0;
+	case K_RANGE:
+	{
+		pv_range *r = (pv_range *)container;
+		if (!is_int(item))
+			return 0;
+		long long i = int_of(item);
+		if (r->step > 0 ? i < r->start || i >= r->stop : i > r->start || i <= r->stop)
+			return 0;
+		return (i - r->start) % r->step == 0;
+	}
+	default:
+		pyc_raise("TypeError", "argument of type '%s' is not iterable", type_name(container));
+	}
+}
+
+__attribute__((noreturn)) static void unsupported(long op, pv x, pv y)
+{
+	pyc_raise("TypeError", "unsupported operand type(s) for %s: '%s' and '%s'", op_symbols[op], type_name(x), type_name(y));
+}
+
+static long long shift(long long x, long long n, int left)
+{
+	if (n < 0)
+		pyc_raise("ValueError", "negative shift count");
+	if (!left)
+		return n >= 64 ? (x < 0 ? -1 : 0) : x >> n;
+	if (n >= 63 || (x != 0 && (long long)((unsigned long long)x << n) >> n != x))
+		overflow();
+	return (long long)((unsigned long long)x << n);
+}
+
+static pv numeric(long op, pv x, pv y)
+{
+	if (is_int(x) && is_int(y))
+	{
+		long long a = int_of(x), b = int_of(y), r;
+		int both_bool = kind_of(x) == K_BOOL && kind_of(y) == K_BOOL;
+		switch (op)
+		{
+		case OP_ADD:
+			if (__builtin_add_overflow(a, b, &r))
+				overflow();
+			return pyc_int(r);
+		case OP_SUB:
+			if (__builtin_sub_overflow(a, b, &r))
+				overflow();
+			return pyc_int(r);
+		case OP_MUL:
+			if (__builtin_mul_overflow(a, b, &r))
+				overflow();
+			return pyc_int(r);
+		case OP_DIV:
+			if (b == 0)
+				pyc_raise("ZeroDivisionError", "division by zero");
+			return pyc_float((double)a / (double)b);
+		case OP_MOD:
+			if (b == 0)
+				pyc_raise("ZeroDivisionError", "integer modulo by zero");
+			r = b == -1 ? 0 : a % b;
+			return pyc_int(r != 0 && (r < 0) != (b < 0) ? r + b : r);
+		case OP_AND:
+			return both_bool ? boolean(a & b) : pyc_int(a & b);
+		case OP_OR:
+			return both_bool ? boolean(a | b) : pyc_int(a | b);
+		case OP_XOR:
+			return both_bool ? boolean(a ^ b) : pyc_int(a ^ b);
+		case OP_SHL:
+		case OP_SHR:
+			return pyc_int(shift(a, b, op == OP_SHL));
+		}
+	}
+	else
+	{
+		double a = double_of(x), b = double_of(y), r;
+		switch (op)
+		{
+		case OP_ADD:
+			return pyc_float(a + b);
+		case OP_SUB:
+			return pyc_float(a - b);
+		case OP_MUL:
+			return pyc_float(a * b);
+		case OP_DIV:
+			if (b == 0.0)
+				pyc_raise("ZeroDivisionError", "float division by zero");
+			return pyc_float(a / b);
+		case OP_MOD:
+			if (b == 0.0)
+				pyc_raise("ZeroDivisionError", "float modulo");
+			r = fmod(a, b);
+			return pyc_float(r != 0 && (r < 0) != (b < 0) ? r + b : r);
+		}
+	}
+	pyc_raise("TypeError", "unsupported operand type(s) for '%s' and '%s'", type_name(x), type_name(y));
+}
+
+static pv repeat(pv seq, long long count)
+{
+	if (kind_of(seq) == K_STR)
+	{
+		long n = STR(seq)->length, total = count > 0 ? n * count : 0;
+		pv r = make_str("", 0, total);
+		for (long long k = 0; k < count; k++)
+			memcpy(STR(r)->buffer->bytes + k * n, STR(seq)->buffer->bytes, n);
+		STR(r)->buffer->used = STR(r)->length = total;
+		return r;
+	}
+	pv r = make_list(kind_of(seq), NULL, 0);
+	for (long long k = 0; k < count; k++)
+		for (long j = 0; j < LIST(seq)->length; j++)
+			append(r, LIST(seq)->items[j]);
+	return r;
+}
+
+/* Arithmetic operators off the inline fast paths */
+pv pyc_binary(long op, pv x, pv y)
+{
+	if (is_number(x) && is_number(y))
+		return numeric(op, x, y);
+	long kx = kind_of(x), ky = kind_of(y);
+	if (op == OP_ADD && kx == K_STR && ky == K_STR)
+		return concat(x, y);
+	if (op == OP_ADD && (kx == K_LIST || kx == K_TUPLE) && kx == ky)
+	{
+		pv r = make_list(kx, LIST(x)->items, LIST(x)->length);
+		for (long k = 0; k < LIST(y)->length; k++)
+			append(r, LIST(y)->items[k]);
+		return r;
+	}
+	if (op == OP_MUL && (kx == K_STR || kx == K_LIST || kx == K_TUPLE) && is_int(y))
+		return repeat(x, int_of(y));
+	if (op == OP_MUL && is_int(x) && (ky == K_STR || ky == K_LIST || ky == K_TUPLE))
+		return repeat(y, int_of(x));
+	unsupported(op, x, y);
+}
+
+/* Comparison operators; 1 or 0 */
+long pyc_compare(long op, pv x, pv y)
+{
+	switch (op)
+	{
+	case OP_EQ:
+		return equal(x, y);
+	case OP_NE:
+		return !equal(x, y);
+	case OP_IS:
+	case OP_ISNOT:
+	{
+		/* numbers are compared by value, like the VM's unboxed values */
+		long kind = kind_of(x);
+		int same = x == y;
+		if (kind == K_INT && kind_of(y) == K_INT)
+			same = int_of(x) == int_of(y);
+		else if (kind == K_FLOAT && kind_of(y) == K_FLOAT)
+			same = !memcmp(&((pv_float *)x)->f, &((pv_float *)y)->f, sizeof(double));
+		return op == OP_IS ? same : !same;
+	}
+	case OP_IN:
+		return contains(y, x);
+	case OP_NOTIN:
+		return !contains(y, x);
+	}
+	int cmp;
+	if (is_int(x) && is_int(y))
+	{
+		long long a = int_of(x), b = int_of(y);
+		cmp = (a > b) - (a < b);
+	}
+	else if (is_number(x) && is_number(y))
+	{
+		double a = double_of(x), b = double_of(y);
+		if (a != a || b != b)
+			return 0;
+		cmp = (a > b) - (a < b);
+	}
+	else if (kind_of(x) == K_STR && kind_of(y) == K_STR)
+		cmp = compare_str(x, y);
+	else if ((kind_of(x) == K_LIST || kind_of(x) == K_TUPLE) && kind_of(y) == kind_of(x))
+	{
+		/* lexicographic: the first items that differ decide, else the lengths */
+		long k = 0, n = LIST(x)->length, m = LIST(y)->length;
+		while (k < n && k < m && equal(LIST(x)->items[k], LIST(y)->items[k]))
+			k++;
+		if (k < n && k < m)
+			return pyc_compare(op, LIST(x)->items[k], LIST(y)->items[k]);
+		cmp = (n > m) - (n < m);
+	}
+	else
+		unsupported(op, x, y);
+	return op == OP_LT ? cmp < 0 : op == OP_LE ? cmp <= 0 : op == OP_GT ? cmp > 0 : cmp >= 0;
+}
+
+long pyc_truthy(pv v)
+{
+	switch (kind_of(v))
+	{
+	case K_NONE:
+		return 0;
+	case K_BOOL:
+	case K_INT:
+		return int_of(v) != 0;
+	case K_FLOAT:
+		return ((pv_float *)v)->f != 0.0;
+	case K_STR:
+		return STR(v)->length != 0;
+	case K_LIST:
+	case K_TUPLE:
+		return LIST(v)->length != 0;
+	default:
+		return 1;
+	}
+}
+
+/* -x, +x and ~x */
+pv pyc_unary(long op, pv x)
+{
+	if (kind_of(x) == K_FLOAT)
+	{
+		if (op == 0)
+			return pyc_float(-((pv_float *)x)->f);
+		if (op == 1)
+			return x;
+		pyc_raise("TypeError", "bad operand type for unary ~: 'float'");
+	}
+	if (!is_int(x))
+		pyc_raise("TypeError", "bad operand type for unary operator: '%s'", type_name(x));
+	long long i = int_of(x);
+	if (op == 0)
+	{
+		if (i == LLONG_MIN)
+			overflow();
+		return pyc_int(-i);
+	}
+	return pyc_int(op == 1 ? i : ~i);
+}
+
+/* --- iteration ------------------------------------------------------ */
+
+/* Item 'index' of an iterable, advancing the index; 0 after the last */
+pv pyc_next(pv seq, long *index)
+{
+	switch (kind_of(seq))
+	{
+	case K_LIST:
+	case K_TUPLE:
+		return *index < LIST(seq)->length ? LIST(seq)->items[(*index)++] : 0;
+	case K_STR:
+		if (*index >= STR(seq)->length)
+			return 0;
+		return make_str(STR(seq)->buffer->bytes + (*index)++, 1, 1);
+	case K_RANGE:
+	{
+		pv_range *r = (pv_range *)seq;
+		long long i = r->start + *index * r->step;
+		if (r->step > 0 ? i >= r->stop : i <= r->stop)
+			return 0;
+		(*index)++;
+		return pyc_int(i);
+	}
+	default:
+		pyc_raise("TypeError", "'%s' object is not iterable", type_name(seq));
+	}
+}
+
+static pv *collect(pv seq, long *length)
+{
+	long capacity = 16, index = 0;
+	pv *items = malloc(capacity * sizeof(pv)), item;
+	*length = 0;
+	while ((item = pyc_next(seq, &index)))
+	{
+		if (*length == capacity)
+			items = realloc(items, (capacity *= 2) * sizeof(pv));
+		items[(*length)++] = item;
+	}
+	return items;
+}
+
+/* --- builtins ------------------------------------------------------- */
+
+static void expect_args(const char *name, long given, long least, long most)
+{
+	if (given < least || given > most)
+	{
+		if (least == most)
+			pyc_raise("TypeError", "%s() takes %ld argument(s), got %ld", name, least, given);
+		pyc_raise("TypeError", "%s() takes %ld to %ld argument(s), got %ld", name, least, most, given);
+	}
+}
+
+static long long expect_int(pv v, const char *what)
+{
+	if (!is_int(v))
+		pyc_raise("TypeError", "%s must be an integer, not '%s'", what, type_name(v));
+	return int_of(v);
+}
+
+/* Start, stop and step of range(args) into bounds[0..2] */
+void pyc_range_bounds(const pv *args, long n, long long *bounds)
+{
+	expect_args("range", n, 1, 3);
+	bounds[0] = 0;
+	bounds[2] = 1;
+	if (n == 1)
+		bounds[1] = expect_int(args[0], "range() argument");
+	else
+	{
+		bounds[0] = expect_int(args[0], "range() argument");
+		bounds[1] = expect_int(args[1], "range() argument");
+		if (n == 3)
+			bounds[2] = expect_int(args[2], "range() argument");
+	}
+	if (bounds[2] == 0)
+		pyc_raise("ValueError", "range() arg 3 must not be zero");
+}
+
+pv pyc_b_range(const pv *args, long n)
+{
+	pv_range *r = pyc_alloc(sizeof *r);
+	long long bounds[3];
+	pyc_range_bounds(args, n, bounds);
+	r->kind = K_RANGE;
+	r->start = bounds[0];
+	r->stop = bounds[1];
+	r->step = bounds[2];
+	return (pv)r;
+}
+
+pv pyc_b_print(const pv *args, long n)
+{
+	static pv_text line;
+	line.length = 0;
+	for (long k = 0; k < n; k++)
+	{
+		if (k)
+			text_add(&line, " ", 1);
+		format_value(&line, args[k], 0);
+	}
+	text_add(&line, "\n", 1);
+	fwrite(line.bytes, 1, line.length, stdout);
+	return NONE;
+}
+
+pv pyc_b_len(const pv *args, long n)
+{
+	expect_args("len", n, 1, 1);
+	switch (kind_of(args[0]))
+	{
+	case K_STR:
+		return pyc_int(STR(args[0])->length);
+	case K_LIST:
+	case K_TUPLE:
+		return pyc_int(LIST(args[0])->length);
+	case K_RANGE:
+	{
+		pv_range *r = (pv_range *)args[0];
+		long long count = r->step > 0 ? (r->stop - r->start + r->step - 1) / r->step : (r->start - r->stop - r->step - 1) / -r->step;
+		return pyc_int(count > 0 ? count : 0);
+	}
+	default:
+		pyc_raise("TypeError", "object of type '%s' has no len()", type_name(args[0]));
+	}
+}
+
+pv pyc_b_str(const pv *args, long n)
+{
+	expect_args("str", n, 0, 1);
+	return n ? to_str(args[0], 0) : make_str("", 0, 0);
+}
+
+pv pyc_b_repr(const pv *args, long n)
+{
+	expect_args("repr", n, 1, 1);
+	return to_str(args[0], 1);
+}
+
+pv pyc_b_int(const pv *args, long n)
+{
+	expect_args("int", n, 0, 1);
+	if (n == 0)
+		return pyc_int(0);
+	pv v = args[0];
+	if (is_int(v))
+		return pyc_int(int_of(v));
+	if (kind_of(v) == K_FLOAT)
+	{
+		double d = ((pv_float *)v)->f;
+		if (!isfinite(d) || fabs(d) >= 9.2e18)
+			pyc_raise("OverflowError", "cannot convert float to integer");
+		return pyc_int((long long)d);
+	}
+	if (kind_of(v) == K_STR)
+	{
+		pv_text t = {0};
+		text_add(&t, STR(v)->buffer->bytes, STR(v)->length);
+		text_add(&t, "", 1);
+		char *end;
+		errno = 0;
+		long long i = strtoll(t.bytes, &end, 10);
+		int ok = end != t.bytes && errno == 0;
+		while (ok && (*end == ' ' || (*end >= '\t' && *end <= '\r')))
+			end++;
+		if (ok && end == t.bytes + STR(v)->length)
+		{
+			free(t.bytes);
+			return pyc_int(i);
+		}
+		t.length = 0;
+		format_quoted(&t, STR(v)->buffer->bytes, STR(v)->length);
+		text_add(&t, "", 1);
+		pyc_raise("ValueError", "invalid literal for int() with base 10: %s", t.bytes);
+	}
+	pyc_raise("TypeError", "int() argument must be a string or a number, not '%s'", type_name(v));
+}
+
+pv pyc_b_float(const pv *args, long n)
+{
+	expect_args("float", n, 0, 1);
+	if (n == 0)
+		return pyc_float(0.0);
+	pv v = args[0];
+	if (is_number(v))
+		return pyc_float(double_of(v));
+	if (kind_of(v) == K_STR)
+	{
+		pv_text t = {0};
+		text_add(&t, STR(v)->buffer->bytes, STR(v)->length);
+		text_add(&t, "", 1);
+		char *end;
+		double d = strtod(t.bytes, &end);
+		if (STR(v)->length && end == t.bytes + STR(v)->length)
+		{
+			free(t.bytes);
+			return pyc_float(d);
+		}
+		t.length = 0;
+		format_quoted(&t, STR(v)->buffer->bytes, STR(v)->length);
+		text_add(&t, "", 1);
+		pyc_raise("ValueError", "could not convert string to float: %s", t.bytes);
+	}
+	pyc_raise("TypeError", "float() argument must be a string or a number, not '%s'", type_name(v));
+}
+
+pv pyc_b_bool(const pv *args, long n)
+{
+	expect_args("bool", n, 0, 1);
+	return boolean(n && pyc_truthy(args[0]));
+}
+
+pv pyc_b_abs(const pv *args, long n)
+{
+	expect_args("abs", n, 1, 1);
+	pv v = args[0];
+	if (is_int(v))
+	{
+		if (int_of(v) == LLONG_MIN)
+			overflow();
+		return pyc_int(int_of(v) < 0 ? -int_of(v) : int_of(v));
+	}
+	if (kind_of(v) == K_FLOAT)
+		return pyc_float(fabs(((pv_float *)v)->f));
+	pyc_raise("TypeError", "bad operand type for abs(): '%s'", type_name(v));
+}
+
+static pv min_max(const pv *args, long n, int want_max)
+{
+	long length = n;
+	const pv *items = args;
+	pv *owned = NULL;
+	if (n == 1)
+		items = owned = collect(args[0], &length);
+	if (length == 0)
+		pyc_raise("ValueError", "%s() arg is an empty sequence", want_max ? "max" : "min");
+	pv best = items[0];
+	for (long k = 1; k < length; k++)
+	{
+		pv v = items[k];
+		int better;
+		if (is_number(v) && is_number(best))
+			better = want_max ? double_of(v) > double_of(best) : double_of(v) < double_of(best);
+		else if (kind_of(v) == K_STR && kind_of(best) == K_STR)
+			better = want_max ? compare_str(v, best) > 0 : compare_str(v, best) < 0;
+		else
+			pyc_raise("TypeError", "'<' not supported between '%s' and '%s'", type_name(v), type_name(best));
+		if (better)
+			best = v;
+	}
+	free(owned);
+	return best;
+}
+
+pv pyc_b_min(const pv *args, long n)
+{
+	expect_args("min", n, 1, 1 << 15);
+	return min_max(args, n, 0);
+}
+
+pv pyc_b_max(const pv *args, long n)
+{
+	expect_args("max", n, 1, 1 << 15);
+	return min_max(args, n, 1);
+}
+
+pv pyc_b_sum(const pv *args, long n)
+{
+	expect_args("sum", n, 1, 2);
+	long long int_total = n == 2 ? expect_int(args[1], "sum() start") : 0;
+	double float_total = 0;
+	int is_float = 0;
+	long length;
+	pv *items = collect(args[0], &length);
+	for (long k = 0; k < length; k++)
+	{
+		pv v = items[k];
+		if (is_int(v) && !is_float)
+		{
+			if (__builtin_add_overflow(int_total, int_of(v), &int_total))
+				overflow();
+		}
+		else if (is_number(v))
+		{
+			if (!is_float)
+				float_total = (double)int_total;
+			is_float = 1;
+			float_total += double_of(v);
+		}
+		else
+			pyc_raise("TypeError", "unsupported operand type(s) for +: 'int' and '%s'", type_name(v));
+	}
+	free(items);
+	return is_float ? pyc_float(float_total) : pyc_int(int_total);
+}
+
+static pv sequence(const char *name, long kind, const pv *args, long n)
+{
+	expect_args(name, n, 0, 1);
+	if (n == 0)
+		return make_list(kind, NULL, 0);
+	long length;
+	pv *items = collect(args[0], &length);
+	pv r = make_list(kind, items, length);
+	free(items);
+	return r;
+}
+
+pv pyc_b_list(const pv *args, long n) { return sequence("list", K_LIST, args, n); }
+pv pyc_b_tuple(const pv *args, long n) { return sequence("tuple", K_TUPLE, args, n); }
+
+/* list.append and list.pop, numbered like the generator's method table */
+pv pyc_method(long method, pv receiver, const pv *args, long n)
+{
+	static const char *const names[] = {"append", "pop"};
+	if (kind_of(receiver) != K_LIST)
+		pyc_raise("AttributeError", "'%s' object has no attribute '%s'", type_name(receiver), names[method]);
+	pv_list *l = LIST(receiver);
+	if (method == 0)
+	{
+		expect_args("append", n, 1, 1);
+		append(receiver, args[0]);
+		return NONE;
+	}
+	expect_args("pop", n, 0, 1);
+	if (l->length == 0)
+		pyc_raise("IndexError", "pop from empty list");
+	long long at = n ? expect_int(args[0], "index") : l->length - 1;
+	if (at < 0)
+		at += l->length;
+	if (at < 0 || at >= l->length)
+		pyc_raise("IndexError", "pop index out of range");
+	pv v = l->items[at];
+	memmove(l->items + at, l->items + at + 1, (l->length - at - 1) * sizeof(pv));
+	l->length--;
+	return v;
+}
+
+int main(void)
+{
+	static char buffer[1 << 16];
+	setvbuf(stdout, buffer, _IOFBF, sizeof buffer);
+	pyc_module();
+	return 0;
+}
@@ -0,0 +1,272 @@
+#include "Tools.h"
+#ifdef __unix__
+#include <unistd.h>
+#endif
+
+namespace pyc::detail
+{
+// ----------------------------------------------
+// Differential check against CPython
+// ----------------------------------------------
+// --diff-ast=PATH[,PATH...] parses every .py file under the given files
+// and directories twice: with Lexer + Syntax_Analyzer, and with ast.parse
+// of the local python3 ($PYTHON overrides). One python3 process handles
+// every file, so its start-up time is not counted. Each side keeps its
+// best of three parse times. For every file the CSV gives whether each
+// side accepts it, the times, the speed ratio (CPython time / ours, so
+// above 1 means we are faster), and the first mismatch. A file whose
+// acceptance agrees is then compared by statement structure. That is the
+// sequence of module-level statement kinds, plus the bodies of defs and
+// classes, spelled with ast class names: "Import FunctionDef(Assign
+// Return) Expr". The last row totals the files.
+
+// AstDiff.py, run by python3 -c
+const char *astDiffScript =
+#include "AstDiff.py.inc"
+	;
+
+// Statement structure of a parse tree, in the notation of astDiffScript
+void appendStatementShape(const ParseTreeNode *parent, string &out)
+{
+	for (const ParseTreeNode *child : parent->children)
+	{
+		if (!child || child->label == "INDENT" || child->label == "DEDENT")
+			continue;
+		const ParseTreeNode *stmt = child;
+		if (stmt->label == "statement")
+		{
+			if (stmt->children.empty() || !stmt->children[0])
+				continue;
+			stmt = stmt->children[0];
+		}
+		if (!out.empty() && out.back() != '(')
+			out += ' ';
+		const string &label = stmt->label;
+		if (label == "function" || label == "class_def")
+		{
+			out += label == "function" ? "FunctionDef(" : "ClassDef(";
+			if (!stmt->children.empty() && stmt->children.back())
+				appendStatementShape(stmt->children.back(), out);
+			out += ')';
+		}
+		else if (label == "assignment")
+		{
+			bool plain = true;
+			for (const ParseTreeNode *part : stmt->children)
+				if (part && part->label == "Assign_OP" && !part->children.empty())
+					plain = part->children[0]->label == "=";
+			out += plain ? "Assign" : "AugAssign";
+		}
+		else if (label == "import_statement")
+			out += !stmt->children.empty() && stmt->children[0]->label == "from" ? "ImportFrom" : "Import";
+		else
+		{
+			static const unordered_map<string, const char *> names = {
+				{"conditional_statement", "If"}, {"for_statement", "For"}, {"while_statement", "While"},
+				{"try_statement", "Try"}, {"return_statement", "Return"}, {"break_statement", "Break"},
+				{"continue_statement", "Continue"}, {"pass_statement", "Pass"}, {"raise_statement", "Raise"},
+				{"function_call", "Expr"}, {"expression", "Expr"}, {"factor", "Expr"}};
+			auto it = names.find(label);
+			out += it == names.end() ? label : string(it->second);
+		}
+	}
+}
+
+struct AstDiffRow
+{
+	string path;
+	uintmax_t bytes = 0;
+	bool oursAccepts = false, cpythonAccepts = false;
+	double oursMs = 0, cpythonMs = 0;
+	string oursShape, cpythonShape;
+};
+
+void appendCsvField(string &out, const string &field)
+{
+	if (field.find_first_of(",\"\n") == string::npos)
+	{
+		out += field;
+		return;
+	}
+	out += '"';
+	for (char c : field)
+	{
+		if (c == '"')
+			out += '"';
+		out += c;
+	}
+	out += '"';
+}
+
+int diffAgainstCPython(const string &paths, const string &csvPath)
+{
+	vector<AstDiffRow> rows;
+	error_code ec;
+	for (size_t begin = 0; begin < paths.size();)
+	{
+		size_t end = paths.find(',', begin);
+		if (end == string::npos)
+			end = paths.size();
+		filesystem::path root = paths.substr(begin, end - begin);
+		begin = end + 1;
+		if (filesystem::is_regular_file(root, ec))
+		{
+			rows.emplace_back().path = root.string();
+			continue;
+		}
+		vector<string> found;
+		for (filesystem::recursive_directory_iterator it(root, filesystem::directory_options::skip_permission_denied, ec), last;
+			 it != last; it.increment(ec))
+			if (it->is_regular_file(ec) && it->path().extension() == ".py")
+				found.push_back(it->path().string());
+		if (ec)
+		{
+			cerr << "Error: cannot read " << root.string() << ": " << ec.message() << endl;
+			return 1;
+		}
+		sort(found.begin(), found.end());
+		for (string &path : found)
+			rows.emplace_back().path = move(path);
+	}
+	if (rows.empty())
+	{
+		cerr << "Error: no .py files in " << paths << endl;
+		return 1;
+	}
+
+	for (AstDiffRow &row : rows)
+	{
+		string source;
+		try
+		{
+			source = readFile(row.path);
+		}
+		catch (const exception &e)
+		{
+			cerr << "Error: " << e.what() << endl;
+			return 1;
+		}
+		row.bytes = source.size();
+		row.oursMs = 1e300;
+		for (int rep = 0; rep < 3; rep++)
+		{
+			auto start = chrono::steady_clock::now();
+			vector<Error> errors;
+			Syntax_Analyzer analyzer;
+			ostringstream diagnostics;
+			analyzer.diagnostics = &diagnostics;
+			analyzer.appendErrorLog = false;
+			analyzer.tokens = Lexer().tokenize(source, errors);
+			ParseTreeNode *root = analyzer.parseProgram();
+			row.oursMs = min(row.oursMs, chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+			row.oursAccepts = errors.empty() && analyzer.errorCount == 0;
+			row.oursShape.clear();
+			if (row.oursAccepts)
+				appendStatementShape(root, row.oursShape);
+			deleteTree(root);
+		}
+	}
+
+#ifdef __unix__
+	size_t matched = 0;
+	try
+	{
+		TempDirectory scratch("pyc_ast_");
+		string listPath = scratch.path + "/files.list", resultPath = scratch.path + "/results.tsv";
+		{
+			ofstream list(listPath);
+			for (const AstDiffRow &row : rows)
+				list << filesystem::absolute(row.path).string() << '\n';
+		}
+		// $PYTHON may carry options, as $CC may
+		vector<string> command;
+		const char *python = getenv("PYTHON");
+		istringstream words(python && *python ? python : "python3");
+		for (string word; words >> word;)
+			command.push_back(word);
+		command.insert(command.end(), {"-c", astDiffScript, listPath, resultPath});
+		int status = runProgram(command);
+		ifstream results(resultPath);
+		string line;
+		for (; status == 0 && matched < rows.size() && getline(results, line); matched++)
+		{
+			size_t tab1 = line.find('\t'), tab2 = line.find('\t', tab1 + 1);
+			if (tab2 == string::npos)
+				break;
+			rows[matched].cpythonAccepts = line[0] == '1';
+			rows[matched].cpythonMs = stod(line.substr(tab1 + 1, tab2 - tab1 - 1)) * 1000;
+			rows[matched].cpythonShape = line.substr(tab2 + 1);
+		}
+	}
+	catch (const exception &e)
+	{
+		cerr << "Error: " << e.what() << endl;
+		return 1;
+	}
+	if (matched != rows.size())
+	{
+		cerr << "Error: python3 with the ast module did not check the corpus" << endl;
+		return 1;
+	}
+#else
+	cerr << "Error: --diff-ast needs a POSIX system" << endl;
+	return 1;
+#endif
+
+	string csv = "file,bytes,ours_accepts,cpython_accepts,ours_ms,cpython_ms,speed_ratio,mismatch,ours_shape,cpython_shape\n";
+	double oursTotal = 0, cpythonTotal = 0;
+	uintmax_t bytesTotal = 0;
+	size_t acceptanceMismatches = 0, structureMismatches = 0;
+	auto number = [](double value)
+	{
+		ostringstream text;
+		text << fixed << setprecision(4) << value;
+		return text.str();
+	};
+	for (const AstDiffRow &row : rows)
+	{
+		const char *mismatch = "none";
+		if (row.oursAccepts != row.cpythonAccepts)
+		{
+			mismatch = "acceptance";
+			acceptanceMismatches++;
+		}
+		else if (row.oursShape != row.cpythonShape)
+		{
+			mismatch = "structure";
+			structureMismatches++;
+		}
+		oursTotal += row.oursMs;
+		cpythonTotal += row.cpythonMs;
+		bytesTotal += row.bytes;
+		appendCsvField(csv, row.path);
+		csv += ',' + to_string(row.bytes) + ',' + to_string(row.oursAccepts) + ',' + to_string(row.cpythonAccepts) + ',' +
+			   number(row.oursMs) + ',' + number(row.cpythonMs) + ',' + number(row.cpythonMs / max(row.oursMs, 1e-6)) + ',' +
+			   mismatch + ',';
+		// Shapes only say something when they were compared and differ
+		if (strcmp(mismatch, "structure") == 0)
+		{
+			appendCsvField(csv, row.oursShape);
+			csv += ',';
+			appendCsvField(csv, row.cpythonShape);
+		}
+		else
+			csv += ',';
+		csv += '\n';
+	}
+	csv += "TOTAL," + to_string(bytesTotal) + ",,," + number(oursTotal) + ',' + number(cpythonTotal) + ',' +
+		   number(cpythonTotal / max(oursTotal, 1e-6)) + ',' + to_string(acceptanceMismatches + structureMismatches) + ",,\n";
+
+	if (csvPath.empty())
+		cout << csv;
+	else if (!(ofstream(csvPath) << csv))
+	{
+		cerr << "Error: could not write " << csvPath << endl;
+		return 1;
+	}
+	cerr << rows.size() << " files: " << acceptanceMismatches << " acceptance and " << structureMismatches
+		 << " structure mismatches; " << fixed << setprecision(2) << oursTotal << " ms here, " << cpythonTotal
+		 << " ms in CPython (" << cpythonTotal / max(oursTotal, 1e-6) << "x)" << defaultfloat << setprecision(6) << endl;
+	return 0;
+}
+} // namespace pyc::detail
@@ -0,0 +1,23 @@
+import ast, sys, time
+def shape(body):
+    out = []
+    for s in body:
+        n = type(s).__name__
+        if n in ("FunctionDef", "ClassDef"):
+            n += "(" + shape(s.body) + ")"
+        out.append(n)
+    return " ".join(out)
+paths = open(sys.argv[1], encoding="utf-8").read().splitlines()
+with open(sys.argv[2], "w", encoding="utf-8") as out:
+    for path in paths:
+        source = open(path, "rb").read()
+        best, tree = None, None
+        for _ in range(3):
+            start = time.perf_counter()
+            try:
+                tree = ast.parse(source)
+            except Exception:
+                tree = None
+            elapsed = time.perf_counter() - start
+            best = elapsed if best is None else min(best, elapsed)
+        out.write("%d\t%.9f\t%s\n" % (tree is not None, best, shape(tree.body) if tree else ""))
@@ -0,0 +1,1310 @@
+#include "Tools.h"
+#ifdef __unix__
+#include <unistd.h>
+#endif
+
+namespace pyc::detail
+{
+// ----------------------------------------------
+// Semantic pass benchmark
+// ----------------------------------------------
+
+string generateSemanticBenchModule(size_t lines)
+{
+	string out;
+	out.reserve(lines * 24);
+	size_t written = 0;
+	for (size_t n = 0; written < lines; n++)
+	{
+		string id = to_string(n);
+		out += "g_" + id + " = " + id + "\n";
+		out += "def func_" + id + "(a, b=2):\n";
+		out += "    x = a + " + id + "\n";
+		out += "    y = x * 2.5\n";
+		out += "    s, t = \"abc\", True\n";
+		out += "    if x > 10:\n";
+		out += "        y = y - 1\n";
+		out += "    for i in items:\n";
+		out += "        print(i)\n";
+		out += "    return y\n";
+		out += "class Cls_" + id + ":\n";
+		out += "    count = 0\n";
+		out += "    def method(self, v):\n";
+		out += "        self.count = v\n";
+		written += 14;
+	}
+	return out;
+}
+
+void benchmarkSemanticPass(size_t lines)
+{
+	string source = generateSemanticBenchModule(lines);
+	vector<Error> errors;
+	Lexer lexer;
+	vector<Token> tokens = lexer.tokenize(source, errors);
+	cout << "Semantic pass benchmark: " << lines << " lines, " << tokens.size() << " tokens\n";
+
+	auto timeRun = [&](unsigned jobs, SymbolTable &table)
+	{
+		auto start = chrono::steady_clock::now();
+		if (jobs == 0)
+		{
+			Parser parser(tokens, table);
+			parser.parse();
+		}
+		else
+		{
+			parallelParse(tokens, table, jobs);
+		}
+		return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+	};
+
+	SymbolTable reference;
+	double baseline = timeRun(0, reference);
+	cout << "  sequential: " << baseline << " ms, " << reference.table.size() << " symbols\n";
+
+	for (unsigned jobs = 1; jobs <= 16; jobs *= 2)
+	{
+		SymbolTable table;
+		double ms = timeRun(jobs, table);
+		bool same = table.table.size() == reference.table.size();
+		for (auto it = table.table.begin(); same && it != table.table.end(); ++it)
+		{
+			auto ref = reference.table.find(it->first);
+			same = ref != reference.table.end() &&
+				   ref->second.entry == it->second.entry &&
+				   ref->second.type == it->second.type &&
+				   ref->second.usageCount == it->second.usageCount;
+		}
+		cout << "  jobs=" << jobs << ": " << ms << " ms, speedup " << baseline / ms
+			 << (same ? "" : "  [MISMATCH]") << "\n";
+	}
+}
+
+// ----------------------------------------------
+// Session benchmark
+// ----------------------------------------------
+
+int benchmarkSession(size_t calls)
+{
+	vector<string> sources;
+	for (size_t k = 0; k < 16; k++)
+		sources.push_back(generateSemanticBenchModule(100 + (k * 53) % 400));
+	cout << "Compiler session benchmark: " << calls << " calls over " << sources.size() << " sources\n";
+	cout << fixed << setprecision(1);
+
+	auto runSession = [&](CompilerSession &session, bool table)
+	{
+		if (table)
+			cout << "  " << left << setw(16) << "calls" << right << setw(14) << "allocs/call" << setw(12)
+				 << "KiB/call" << setw(12) << "us/call" << "\n";
+		size_t windowStart = 1;
+		uint64_t steadyAllocations = 0;
+		AllocationCounters before = allocationCounters;
+		auto start = chrono::steady_clock::now();
+		for (size_t n = 1; n <= calls; n++)
+		{
+			session.compile(sources[(n - 1) % sources.size()]);
+			// Windows 1, 2, 3-10, 11-100, ... and the final partial one
+			bool windowEnd = n == 1 || n == 2 || n == calls;
+			for (size_t edge = 10; edge <= n && !windowEnd; edge *= 10)
+				windowEnd = n == edge;
+			if (!windowEnd)
+				continue;
+			size_t count = n - windowStart + 1;
+			double us = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+			if (windowStart > sessionWarmUpCalls)
+				steadyAllocations += allocationCounters.allocations - before.allocations;
+			double allocs = double(allocationCounters.allocations - before.allocations) / count;
+			double kib = (allocationCounters.bytes - before.bytes) / 1024.0 / count;
+			if (table)
+			{
+				string range = windowStart == n ? to_string(n) : to_string(windowStart) + "-" + to_string(n);
+				cout << "  " << left << setw(16) << range << right << setw(14) << allocs << setw(12) << kib
+					 << setw(12) << us / count << "\n";
+			}
+			else if (n == calls)
+				cout << "  with folding, calls " << windowStart << "-" << n << ": " << allocs << " allocs/call, "
+					 << us / count << " us/call\n";
+			windowStart = n + 1;
+			before = allocationCounters;
+			start = chrono::steady_clock::now();
+		}
+		return steadyAllocations;
+	};
+
+	uint64_t steadyAllocations;
+	{
+		CompilerSession session;
+		steadyAllocations = runSession(session, true);
+	}
+	{
+		CompilerSession session(true);
+		runSession(session, false);
+	}
+
+	AllocationCounters before = allocationCounters;
+	auto start = chrono::steady_clock::now();
+	size_t freshCalls = min<size_t>(calls, 1000);
+	for (size_t n = 0; n < freshCalls; n++)
+	{
+		const string &source = sources[n % sources.size()];
+		vector<Error> errors;
+		Lexer lexer;
+		vector<Token> tokens = lexer.tokenize(source, errors);
+		SymbolTable symTable;
+		Parser parser(tokens, symTable);
+		parser.parse();
+		ostringstream diagnostics;
+		Syntax_Analyzer sa = Syntax_Analyzer();
+		sa.tokens = tokens;
+		sa.diagnostics = &diagnostics;
+		sa.appendErrorLog = false;
+		deleteTree(sa.parseProgram());
+	}
+	double us = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+	cout << "  fresh front end per call: " << double(allocationCounters.allocations - before.allocations) / freshCalls
+		 << " allocs/call, " << us / freshCalls << " us/call\n";
+	cout << defaultfloat << setprecision(6);
+	if (steadyAllocations == 0)
+		return 0;
+	cout << "FAIL: " << steadyAllocations << " allocations after the first " << sessionWarmUpCalls << " calls\n";
+	return 1;
+}
+
+// ----------------------------------------------
+// Synthetic corpus
+// ----------------------------------------------
+// Deterministic Python in the subset of grammar.txt, for measuring the
+// front end on inputs from a few KB to a few GB. The text depends only on
+// the shape, the seed and the size: draws come from a private splitmix64
+// stream rather than <random>, whose distributions differ between standard
+// libraries. Sources grow one top-level unit at a time and always end on a
+// unit boundary, so they overshoot the requested size by up to one unit.
+
+enum class CorpusShape
+{
+	Mixed,		 // a bit of everything, in the proportions of hand-written modules
+	Nested,		 // control flow nested up to 19 blocks deep
+	Docstrings,	 // long triple-quoted strings on the module, every def and every class
+	WideClasses, // classes with dozens of attributes and methods
+	Expressions, // long arithmetic, boolean, comparison and literal expressions
+	Errors		 // mixed code with a lexical or syntax error every few lines
+};
+
+const char *const corpusShapeNames[] = {"mixed", "nested", "docstrings", "classes", "expressions", "errors"};
+
+bool parseCorpusShape(const string &name, CorpusShape &shape)
+{
+	for (size_t k = 0; k < size(corpusShapeNames); k++)
+		if (name == corpusShapeNames[k])
+		{
+			shape = CorpusShape(k);
+			return true;
+		}
+	return false;
+}
+
+uint64_t parseByteSize(const string &text)
+{
+	size_t used = 0;
+	uint64_t value = stoull(text, &used);
+	string suffix = text.substr(used);
+	if (suffix == "K" || suffix == "k" || suffix == "KB")
+		return value << 10;
+	if (suffix == "M" || suffix == "m" || suffix == "MB")
+		return value << 20;
+	if (suffix == "G" || suffix == "g" || suffix == "GB")
+		return value << 30;
+	if (!suffix.empty())
+		throw invalid_argument("bad size '" + text + "'");
+	return value;
+}
+
+class CorpusGenerator
+{
+public:
+	CorpusGenerator(CorpusShape shape, uint64_t seed) : shape(shape), state(seed) {}
+
+	// Appends units to 'out' until it has grown by at least 'bytes'
+	void generate(string &out, uint64_t bytes)
+	{
+		size_t start = out.size();
+		out.reserve(start + bytes + 4096);
+		while (out.size() - start < bytes)
+			unit(out);
+	}
+
+	// Streams at least 'bytes' bytes to 'out' through a buffer of about 1 MiB
+	void write(ostream &out, uint64_t bytes)
+	{
+		string buffer;
+		uint64_t written = 0;
+		while (written < bytes)
+		{
+			buffer.clear();
+			generate(buffer, min<uint64_t>(bytes - written, 1 << 20));
+			out.write(buffer.data(), buffer.size());
+			written += buffer.size();
+		}
+	}
+
+private:
+	CorpusShape shape;
+	uint64_t state;
+	size_t units = 0;
+	int loops = 0;	   // enclosing loops of the statement being written
+	bool inFunction = false, inMethod = false;
+	string scratch;	   // one unit of the error-dense shape before corruption
+
+	uint64_t next()
+	{
+		uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+		return z ^ (z >> 31);
+	}
+	size_t below(size_t n) { return next() % n; }
+	bool chance(unsigned percent) { return below(100) < percent; }
+	template <size_t N>
+	const char *pick(const char *const (&options)[N]) { return options[below(N)]; }
+
+	static void indent(string &out, int depth) { out.append(size_t(depth) * 4, ' '); }
+
+	void name(string &out)
+	{
+		static const char *const words[] = {"value", "count", "total", "items", "result", "node", "index", "buffer",
+											"left", "right", "offset", "limit", "label", "data", "key", "size",
+											"state", "acc", "flag", "width", "height", "score", "token", "entry"};
+		out += pick(words);
+		if (chance(40))
+			out += '_' + to_string(below(32));
+	}
+
+	void text(string &out, size_t words)
+	{
+		static const char *const vocabulary[] = {"the", "parser", "returns", "a", "list", "of", "nodes", "for",
+												 "each", "input", "line", "and", "raises", "an", "error", "when",
+												 "value", "is", "missing", "from", "table", "cache", "entries", "are"};
+		for (size_t k = 0; k < words; k++)
+		{
+			if (k)
+				out += ' ';
+			out += pick(vocabulary);
+		}
+	}
+
+	void atom(string &out)
+	{
+		switch (below(10))
+		{
+		case 0:
+		case 1:
+			out += to_string(below(100000));
+			break;
+		case 2:
+			out += to_string(below(1000)) + '.' + to_string(below(100));
+			break;
+		case 3:
+			out += '"';
+			text(out, 1 + below(4));
+			out += chance(20) ? "\\n\"" : "\"";
+			break;
+		case 4:
+			out += pick({"True", "False", "None"});
+			break;
+		case 5:
+			out += inMethod ? "self." : "config.";
+			name(out);
+			break;
+		default:
+			name(out);
+		}
+	}
+
+	// 'budget' bounds the depth of the expression tree
+	void expression(string &out, int budget)
+	{
+		if (budget <= 0 || chance(30))
+		{
+			atom(out);
+			return;
+		}
+		switch (below(12))
+		{
+		case 0:
+		case 1:
+		case 2:
+			expression(out, budget - 1);
+			out += pick({" + ", " - ", " * ", " / ", " % "});
+			expression(out, budget - 1);
+			break;
+		case 3:
+			expression(out, budget - 1);
+			out += pick({" == ", " != ", " < ", " > ", " <= ", " >= ", " in ", " not in "});
+			expression(out, budget - 1);
+			break;
+		case 4:
+			name(out);
+			out += pick({" is None", " is not None"});
+			break;
+		case 5:
+			expression(out, budget - 1);
+			out += pick({" and ", " or "});
+			expression(out, budget - 1);
+			break;
+		case 6:
+			// 'not' binds looser than arithmetic in Python, so it only appears parenthesised
+			if (chance(40))
+			{
+				out += "(not ";
+				expression(out, budget - 1);
+				out += ')';
+				break;
+			}
+			out += pick({"-", "+", "~"});
+			atom(out);
+			break;
+		case 7:
+			out += '(';
+			expression(out, budget - 1);
+			out += ')';
+			break;
+		case 8:
+			call(out, budget - 1);
+			break;
+		case 9:
+		{
+			bool isList = chance(60);
+			out += isList ? '[' : '(';
+			size_t count = 1 + below(5);
+			for (size_t k = 0; k < count; k++)
+			{
+				if (k)
+					out += ", ";
+				expression(out, budget - 2);
+			}
+			out += isList ? "]" : count == 1 ? ",)" : ")";
+			break;
+		}
+		case 10:
+		{
+			out += '{';
+			size_t count = 1 + below(4);
+			for (size_t k = 0; k < count; k++)
+			{
+				out += k ? ", \"" : "\"";
+				name(out);
+				out += "\": ";
+				expression(out, budget - 2);
+			}
+			out += '}';
+			break;
+		}
+		default:
+			out += '{';
+			for (size_t k = 0, count = 1 + below(4); k < count; k++)
+			{
+				if (k)
+					out += ", ";
+				out += to_string(below(1000));
+			}
+			out += '}';
+		}
+	}
+
+	void call(string &out, int budget)
+	{
+		if (chance(30))
+			out += pick({"len", "print", "range", "str", "int", "max", "min"});
+		else
+		{
+			if (chance(40))
+				out += inMethod ? "self." : "helpers.";
+			name(out);
+		}
+		out += '(';
+		for (size_t k = 0, count = below(4); k < count; k++)
+		{
+			if (k)
+				out += ", ";
+			expression(out, budget);
+		}
+		out += ')';
+	}
+
+	void header(string &out, int depth, const char *keyword, int budget)
+	{
+		indent(out, depth);
+		out += keyword;
+		expression(out, budget);
+		out += ":\n";
+	}
+
+	// One simple statement; break and continue only inside loops, return only inside defs
+	void simple(string &out, int depth, int budget)
+	{
+		indent(out, depth);
+		switch (below(loops ? 12 : 10))
+		{
+		case 0:
+		case 1:
+		case 2:
+		case 3:
+			// Syntax_Analyzer only takes '=' after a dotted target
+			if (inMethod && chance(40))
+			{
+				out += "self.";
+				name(out);
+				out += " = ";
+			}
+			else
+			{
+				name(out);
+				out += pick({" = ", " = ", " = ", " += ", " -= ", " *= "});
+			}
+			expression(out, budget);
+			break;
+		case 4:
+			name(out);
+			out += ", ";
+			name(out);
+			out += " = ";
+			expression(out, budget - 1);
+			out += ", ";
+			expression(out, budget - 1);
+			break;
+		case 5:
+		case 6:
+			call(out, budget - 1);
+			break;
+		case 7:
+			out += "raise ";
+			out += pick({"ValueError", "KeyError", "RuntimeError"});
+			out += "(\"";
+			text(out, 3);
+			out += "\")";
+			break;
+		case 8:
+			out += "pass";
+			break;
+		case 9:
+			out += inFunction ? "return " : "result = ";
+			expression(out, budget);
+			break;
+		default:
+			out += pick({"break", "continue"});
+		}
+		out += '\n';
+	}
+
+	// A statement list at 'depth'; 'nest' is how many more blocks may open
+	// inside it. The nested shape opens exactly one block per list and passes
+	// the allowance down a single path, so depth grows without the size of a
+	// unit growing exponentially with it.
+	void block(string &out, int depth, int nest, size_t count, int budget)
+	{
+		size_t deep = below(count);
+		for (size_t k = 0; k < count; k++)
+		{
+			if (nest > 0 && (shape == CorpusShape::Nested ? k == deep : chance(25)))
+				compound(out, depth, nest - 1, budget);
+			else
+				simple(out, depth, budget);
+		}
+	}
+
+	size_t bodyLength() { return shape == CorpusShape::Nested ? 1 + below(2) : 1 + below(4); }
+
+	void compound(string &out, int depth, int nest, int budget)
+	{
+		int side = shape == CorpusShape::Nested ? 0 : nest; // allowance of every body but the first
+		switch (below(5))
+		{
+		case 0:
+			header(out, depth, "if ", budget);
+			block(out, depth + 1, nest, bodyLength(), budget);
+			for (size_t k = 0, count = below(3); k < count; k++)
+			{
+				header(out, depth, "elif ", budget);
+				block(out, depth + 1, side, bodyLength(), budget);
+			}
+			if (chance(50))
+			{
+				indent(out, depth);
+				out += "else:\n";
+				block(out, depth + 1, side, bodyLength(), budget);
+			}
+			break;
+		case 1:
+			loops++;
+			header(out, depth, "while ", budget);
+			block(out, depth + 1, nest, bodyLength(), budget);
+			loops--;
+			break;
+		case 2:
+			loops++;
+			indent(out, depth);
+			out += "for ";
+			name(out);
+			out += " in ";
+			call(out, budget - 1);
+			out += ":\n";
+			block(out, depth + 1, nest, bodyLength(), budget);
+			loops--;
+			break;
+		case 3:
+		{
+			indent(out, depth);
+			out += "try:\n";
+			size_t handlers = chance(20) ? 0 : 1 + below(2);
+			bool cleanup = !handlers || chance(30);
+			// With both handlers and a finally clause CPython counts the body two blocks deep
+			block(out, depth + 1, handlers && cleanup ? nest - 1 : nest, bodyLength(), budget);
+			for (size_t k = 0; k < handlers; k++)
+			{
+				indent(out, depth);
+				if (k + 1 == handlers && chance(30))
+					out += "except:\n";
+				else
+				{
+					out += "except ";
+					out += pick({"ValueError", "KeyError", "Exception"});
+					out += chance(50) ? " as error:\n" : ":\n";
+				}
+				block(out, depth + 1, side, bodyLength(), budget);
+			}
+			if (handlers && chance(30))
+			{
+				indent(out, depth);
+				out += "else:\n";
+				block(out, depth + 1, side, bodyLength(), budget);
+			}
+			if (cleanup)
+			{
+				indent(out, depth);
+				out += "finally:\n";
+				block(out, depth + 1, side, bodyLength(), budget);
+			}
+			break;
+		}
+		default:
+			header(out, depth, "if ", budget);
+			block(out, depth + 1, nest, bodyLength(), budget);
+		}
+	}
+
+	void docstring(string &out, int depth, bool assigned)
+	{
+		indent(out, depth);
+		out += assigned ? "__doc__ = \"\"\"" : "\"\"\"";
+		text(out, 4 + below(8));
+		size_t lines = shape == CorpusShape::Docstrings ? 8 + below(48) : 1 + below(4);
+		for (size_t k = 0; k < lines; k++)
+		{
+			out += '\n';
+			indent(out, depth);
+			text(out, 6 + below(10));
+		}
+		out += "\n";
+		indent(out, depth);
+		out += "\"\"\"\n";
+	}
+
+	void function(string &out, int depth, bool method)
+	{
+		static const char *const verbs[] = {"load", "parse", "update", "compute", "render", "check", "merge", "build"};
+		bool outerFunction = inFunction, outer = inMethod;
+		inFunction = true;
+		inMethod = method;
+		indent(out, depth);
+		out += "def ";
+		out += pick(verbs);
+		out += '_';
+		name(out);
+		out += '_' + to_string(units) + '(';
+		if (method)
+			out += "self";
+		for (size_t k = 0, count = below(4); k < count; k++)
+		{
+			out += k || method ? ", " : "";
+			out += "arg_" + to_string(k);
+			if (k + 1 == count && chance(40))
+			{
+				out += '=';
+				atom(out);
+			}
+		}
+		out += "):\n";
+		if (shape == CorpusShape::Docstrings || chance(15))
+			docstring(out, depth + 1, false);
+		// CPython refuses 20 or more statically nested blocks in one function
+		int nest = shape == CorpusShape::Nested ? 16 + int(below(4)) : 2;
+		int budget = shape == CorpusShape::Expressions ? 8 + int(below(4)) : 3;
+		block(out, depth + 1, nest, shape == CorpusShape::Expressions ? 6 + below(10) : 2 + below(6), budget);
+		indent(out, depth + 1);
+		out += "return ";
+		expression(out, budget);
+		out += '\n';
+		inFunction = outerFunction;
+		inMethod = outer;
+	}
+
+	void classDef(string &out)
+	{
+		out += "class ";
+		name(out);
+		out += "_Type" + to_string(units);
+		if (chance(40))
+			out += "(Base)";
+		out += ":\n";
+		if (shape == CorpusShape::Docstrings || chance(15))
+			docstring(out, 1, true);
+		size_t members = shape == CorpusShape::WideClasses ? 24 + below(96) : 2 + below(5);
+		for (size_t k = 0; k < members; k++)
+		{
+			if (chance(shape == CorpusShape::WideClasses ? 55 : 30))
+			{
+				indent(out, 1);
+				out += "field_" + to_string(k) + " = ";
+				atom(out);
+				out += '\n';
+			}
+			else
+				function(out, 1, true);
+		}
+	}
+
+	void moduleStatement(string &out)
+	{
+		switch (below(4))
+		{
+		case 0:
+			out += "import ";
+			out += pick({"os", "sys", "json", "collections.abc", "os.path"});
+			if (chance(30))
+				out += " as mod_" + to_string(units);
+			break;
+		case 1:
+			out += "from ";
+			out += pick({"typing", "pathlib", "helpers", "config.defaults"});
+			out += " import ";
+			name(out);
+			break;
+		default:
+			out += "CONSTANT_" + to_string(units) + " = ";
+			expression(out, shape == CorpusShape::Expressions ? 10 : 2);
+		}
+		out += '\n';
+	}
+
+	void unit(string &out)
+	{
+		units++;
+		if (shape == CorpusShape::Errors)
+		{
+			scratch.clear();
+			validUnit(scratch);
+			corrupt(scratch, out);
+		}
+		else
+			validUnit(out);
+	}
+
+	void validUnit(string &out)
+	{
+		size_t kind = below(10);
+		switch (shape)
+		{
+		case CorpusShape::Nested:
+			kind = kind < 8 ? 9 : kind;
+			break;
+		case CorpusShape::WideClasses:
+			kind = kind < 6 ? 0 : kind;
+			break;
+		case CorpusShape::Docstrings:
+			if (kind == 9)
+			{
+				docstring(out, 0, false);
+				return;
+			}
+			break;
+		default:
+			break;
+		}
+		if (kind < 2)
+			classDef(out);
+		else if (kind < 5)
+			moduleStatement(out);
+		else if (kind < 8 && shape != CorpusShape::Nested)
+			block(out, 0, 1, 1, shape == CorpusShape::Expressions ? 10 : 3);
+		else
+			function(out, 0, false);
+	}
+
+	// Copies 'unit' line by line, breaking about one line in six outside docstrings
+	void corrupt(const string &unit, string &out)
+	{
+		bool inDocstring = false;
+		for (size_t begin = 0; begin < unit.size();)
+		{
+			size_t end = unit.find('\n', begin);
+			string_view line(unit.data() + begin, end - begin);
+			begin = end + 1;
+			bool quoted = inDocstring || line.find("\"\"\"") != string_view::npos;
+			for (size_t at = line.find("\"\"\""); at != string_view::npos; at = line.find("\"\"\"", at + 3))
+				inDocstring = !inDocstring;
+			if (quoted || line.find_first_not_of(' ') == string_view::npos || !chance(17))
+			{
+				out.append(line.data(), line.size());
+				out += '\n';
+				continue;
+			}
+			size_t at;
+			switch (below(5))
+			{
+			case 0: // missing colon or missing operand
+				if (line.back() == ':')
+					out.append(line.data(), line.size() - 1);
+				else
+					out.append(line.data(), line.size()).append(" +");
+				break;
+			case 1: // unbalanced parenthesis
+				at = line.rfind(')');
+				out.append(line.data(), line.size());
+				if (at != string_view::npos)
+					out.erase(out.size() - (line.size() - at), 1);
+				else
+					out += " (";
+				break;
+			case 2: // doubled operator
+				at = line.find(" = ");
+				out.append(line.data(), line.size());
+				if (at != string_view::npos)
+					out.insert(out.size() - line.size() + at, " =");
+				else
+					out += " * *";
+				break;
+			case 3: // character outside the language
+				out.append(line.data(), line.size()).append(" $ ?");
+				break;
+			default: // unexpected indent
+				out += "  ";
+				out.append(line.data(), line.size());
+			}
+			out += '\n';
+		}
+	}
+};
+
+int writeCorpus(const string &spec, const string &path)
+{
+	CorpusShape shape;
+	size_t first = spec.find(':'), second = spec.find(':', first + 1);
+	if (first == string::npos || !parseCorpusShape(spec.substr(0, first), shape))
+	{
+		cerr << "Expected --gen-corpus=SHAPE:SIZE[:SEED] with SHAPE one of mixed, nested, docstrings, classes, expressions, errors" << endl;
+		return 1;
+	}
+	try
+	{
+		uint64_t bytes = parseByteSize(spec.substr(first + 1, second - first - 1));
+		uint64_t seed = second == string::npos ? 1 : stoull(spec.substr(second + 1));
+		CorpusGenerator generator(shape, seed);
+		if (path.empty())
+		{
+			generator.write(cout, bytes);
+			return cout ? 0 : 1;
+		}
+		ofstream out(path, ios::binary);
+		generator.write(out, bytes);
+		if (!out.flush())
+			throw runtime_error("Could not write " + path);
+	}
+	catch (const exception &e)
+	{
+		cerr << "Error: " << e.what() << endl;
+		return 1;
+	}
+	return 0;
+}
+
+// ----------------------------------------------
+// Front-end stage benchmark
+// ----------------------------------------------
+// Times Lexer::tokenize, Parser::parse, Syntax_Analyzer::parseProgram and
+// saveTreeToDot separately on generated corpora. Every stage is run three
+// times on the output of the previous stage and the fastest run is kept;
+// allocation counts come from the calling thread's counters and are the
+// same on every run. Rates are per second of that stage alone: MB/s of
+// source text, tokens/s, and tree nodes/s for the two stages that see the
+// tree.
+
+struct StageTiming
+{
+	const char *stage;
+	double ms;
+	uint64_t allocations, bytes;
+};
+
+struct CorpusBenchResult
+{
+	string shape;
+	uint64_t seed, sourceBytes, lines;
+	size_t tokens, nodes, lexErrors;
+	int syntaxErrors;
+	vector<StageTiming> stages;
+};
+
+size_t countTreeNodes(const ParseTreeNode *root)
+{
+	size_t count = 0;
+	vector<const ParseTreeNode *> stack = {root};
+	while (!stack.empty())
+	{
+		const ParseTreeNode *node = stack.back();
+		stack.pop_back();
+		count++;
+		stack.insert(stack.end(), node->children.begin(), node->children.end());
+	}
+	return count;
+}
+
+CorpusBenchResult benchmarkCorpus(CorpusShape shape, uint64_t bytes, uint64_t seed)
+{
+	CorpusBenchResult result{corpusShapeNames[int(shape)], seed, 0, 0, 0, 0, 0, 0, {}};
+	string source;
+	CorpusGenerator(shape, seed).generate(source, bytes);
+	result.sourceBytes = source.size();
+	result.lines = count(source.begin(), source.end(), '\n');
+
+	// Runs 'body' three times with 'reset' untimed before each run
+	auto measure = [&](const char *stage, auto reset, auto body)
+	{
+		StageTiming timing{stage, 1e300, 0, 0};
+		for (int rep = 0; rep < 3; rep++)
+		{
+			reset();
+			AllocationCounters before = allocationCounters;
+			auto start = chrono::steady_clock::now();
+			body();
+			timing.ms = min(timing.ms, chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+			timing.allocations = allocationCounters.allocations - before.allocations;
+			timing.bytes = allocationCounters.bytes - before.bytes;
+		}
+		result.stages.push_back(timing);
+	};
+
+	vector<Token> tokens;
+	vector<Error> errors;
+	measure("tokenize", [&]
+			{ tokens = vector<Token>(); errors.clear(); },
+			[&]
+			{ tokens = Lexer().tokenize(source, errors); });
+	result.tokens = tokens.size();
+	result.lexErrors = errors.size();
+
+	unique_ptr<SymbolTable> symbols;
+	measure("parse", [&]
+			{ symbols = make_unique<SymbolTable>(); },
+			[&]
+			{ Parser(tokens, *symbols).parse(); });
+	symbols.reset();
+
+	Syntax_Analyzer analyzer;
+	ostringstream diagnostics;
+	analyzer.diagnostics = &diagnostics;
+	analyzer.appendErrorLog = false;
+	ParseTreeNode *root = nullptr;
+	measure("parseProgram", [&]
+			{
+				deleteTree(root);
+				root = nullptr;
+				diagnostics.str("");
+				analyzer.tokens = tokens;
+			},
+			[&]
+			{ root = analyzer.parseProgram(); });
+	result.nodes = countTreeNodes(root);
+	result.syntaxErrors = analyzer.errorCount;
+
+	TempDirectory scratch("pyc_stages_");
+	string dotPath = scratch.path + "/tree.dot";
+	measure("saveTreeToDot", [] {}, [&]
+			{ saveTreeToDot(root, dotPath); });
+	deleteTree(root);
+	return result;
+}
+
+void appendCorpusBenchJson(string &out, const CorpusBenchResult &result)
+{
+	out += "{\"shape\":";
+	appendJsonString(out, result.shape);
+	out += ",\"seed\":" + to_string(result.seed) + ",\"bytes\":" + to_string(result.sourceBytes) +
+		   ",\"lines\":" + to_string(result.lines) + ",\"tokens\":" + to_string(result.tokens) +
+		   ",\"nodes\":" + to_string(result.nodes) + ",\"lexErrors\":" + to_string(result.lexErrors) +
+		   ",\"syntaxErrors\":" + to_string(result.syntaxErrors) + ",\"stages\":[";
+	for (size_t k = 0; k < result.stages.size(); k++)
+	{
+		const StageTiming &s = result.stages[k];
+		double seconds = s.ms / 1000;
+		ostringstream rates;
+		rates << setprecision(6) << ",\"ms\":" << s.ms << ",\"mbPerSecond\":" << result.sourceBytes / 1048576.0 / seconds
+			  << ",\"tokensPerSecond\":" << result.tokens / seconds;
+		if (k >= 2)
+			rates << ",\"nodesPerSecond\":" << result.nodes / seconds;
+		out += k ? ",{\"stage\":" : "{\"stage\":";
+		appendJsonString(out, s.stage);
+		out += rates.str() + ",\"allocations\":" + to_string(s.allocations) + ",\"allocatedBytes\":" + to_string(s.bytes) + '}';
+	}
+	out += "]}";
+}
+
+// 'specs' is a comma-separated list of SHAPE:SIZE[:SEED]; empty means
+// every shape at 'defaultBytes'. Throws invalid_argument on a malformed spec.
+vector<tuple<CorpusShape, uint64_t, uint64_t>> parseCorpusSpecs(const string &specs, uint64_t defaultBytes = 8 << 20)
+{
+	vector<tuple<CorpusShape, uint64_t, uint64_t>> runs;
+	if (specs.empty())
+		for (size_t k = 0; k < size(corpusShapeNames); k++)
+			runs.push_back({CorpusShape(k), defaultBytes, 1});
+	for (size_t begin = 0; begin < specs.size();)
+	{
+		size_t end = specs.find(',', begin);
+		if (end == string::npos)
+			end = specs.size();
+		string spec = specs.substr(begin, end - begin);
+		begin = end + 1;
+		size_t first = spec.find(':'), second = spec.find(':', first + 1);
+		CorpusShape shape;
+		if (!parseCorpusShape(spec.substr(0, first), shape))
+			throw invalid_argument("unknown corpus shape '" + spec.substr(0, first) + "'");
+		uint64_t bytes = first == string::npos ? 8 << 20 : parseByteSize(spec.substr(first + 1, second - first - 1));
+		uint64_t seed = second == string::npos ? 1 : stoull(spec.substr(second + 1));
+		runs.push_back({shape, bytes, seed});
+	}
+	return runs;
+}
+
+int benchmarkStages(const string &specs, const string &jsonPath)
+{
+	vector<tuple<CorpusShape, uint64_t, uint64_t>> runs;
+	try
+	{
+		runs = parseCorpusSpecs(specs);
+	}
+	catch (const exception &e)
+	{
+		cerr << "Error: " << e.what() << endl;
+		return 1;
+	}
+
+	cout << "Front-end stage benchmark (best of 3)\n" << fixed;
+	string json = "{\"corpora\":[";
+	for (size_t r = 0; r < runs.size(); r++)
+	{
+		auto [shape, bytes, seed] = runs[r];
+		CorpusBenchResult result = benchmarkCorpus(shape, bytes, seed);
+		cout << setprecision(2) << "  " << result.shape << " (seed " << seed << "): " << result.sourceBytes / 1048576.0
+			 << " MB, " << result.lines << " lines, " << result.tokens << " tokens, " << result.nodes << " nodes, "
+			 << result.lexErrors << " lexical / " << result.syntaxErrors << " syntax errors\n";
+		for (size_t k = 0; k < result.stages.size(); k++)
+		{
+			const StageTiming &s = result.stages[k];
+			double seconds = s.ms / 1000;
+			cout << "    " << left << setw(14) << s.stage << right << setprecision(1) << setw(9) << s.ms << " ms "
+				 << setw(8) << result.sourceBytes / 1048576.0 / seconds << " MB/s " << setprecision(2)
+				 << setw(7) << result.tokens / seconds / 1e6 << " Mtok/s ";
+			if (k >= 2)
+				cout << setw(7) << result.nodes / seconds / 1e6 << " Mnode/s ";
+			else
+				cout << string(16, ' ');
+			cout << setw(10) << s.allocations << " allocs " << setprecision(1) << s.bytes / 1048576.0 << " MB\n";
+		}
+		if (r)
+			json += ',';
+		appendCorpusBenchJson(json, result);
+	}
+	json += "]}\n";
+	cout << defaultfloat << setprecision(6);
+	if (!jsonPath.empty())
+	{
+		ofstream out(jsonPath);
+		if (!(out << json))
+		{
+			cerr << "Error: could not write " << jsonPath << endl;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// ----------------------------------------------
+// Subtree sharing benchmark
+// ----------------------------------------------
+// Parses and folds each generated corpus the way the default mode does,
+// then reports what shareSubtrees saves and how long it takes.
+
+int benchmarkSharing(const string &specs)
+{
+	try
+	{
+		vector<tuple<CorpusShape, uint64_t, uint64_t>> runs = parseCorpusSpecs(specs);
+		cout << "Subtree sharing on generated corpora\n";
+		for (auto [shape, bytes, seed] : runs)
+		{
+			string source;
+			CorpusGenerator(shape, seed).generate(source, bytes);
+			vector<Error> errors;
+			vector<Token> tokens = Lexer().tokenize(source, errors);
+			SymbolTable symbols;
+			Parser(tokens, symbols).parse();
+			Syntax_Analyzer analyzer;
+			ostringstream diagnostics;
+			analyzer.diagnostics = &diagnostics;
+			analyzer.appendErrorLog = false;
+			analyzer.tokens = move(tokens);
+			ParseTreeNode *root = analyzer.parseProgram();
+			ConstantFolder(symbols).run(root);
+
+			SharingReport report;
+			auto start = chrono::steady_clock::now();
+			root = shareSubtrees(root, &report);
+			double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+			deleteSharedTree(root);
+			cout << "  " << corpusShapeNames[int(shape)] << " (seed " << seed << "), " << fixed << setprecision(2)
+				 << source.size() / 1048576.0 << " MB in " << setprecision(1) << ms << " ms: " << defaultfloat
+				 << setprecision(6);
+			printSharingReport(report, cout);
+		}
+	}
+	catch (const exception &e)
+	{
+		cerr << "Error: " << e.what() << endl;
+		return 1;
+	}
+	return 0;
+}
+
+// ----------------------------------------------
+// Budget overhead benchmark
+// ----------------------------------------------
+// Lexes, runs the symbol pass and parses each generated corpus with no
+// BudgetMonitor and with one whose limits are all set but never reached,
+// in 21 back-to-back pairs whose order alternates. The overhead reported is
+// the median of the per-pair ratios with a 95% interval for that median
+// from order statistics, so a claim like "under 1%" can be checked against
+// the upper bound. Without specs every shape runs at 256 KB.
+
+double timeFrontEnd(const string &source, BudgetMonitor *monitor)
+{
+	auto start = chrono::steady_clock::now();
+	if (monitor)
+	{
+		ResourceBudget limits;
+		limits.maxTokens = limits.maxNodes = SIZE_MAX / 2;
+		limits.maxDepth = INT_MAX / 2;
+		limits.maxMemory = UINT64_MAX / 2;
+		limits.deadlineMs = 1000LL * 3600 * 24;
+		monitor->start(limits);
+	}
+	vector<Error> errors;
+	Lexer lexer;
+	lexer.budget = monitor;
+	vector<Token> tokens = lexer.tokenize(source, errors);
+	SymbolTable symbols;
+	Parser parser(tokens, symbols);
+	parser.budget = monitor;
+	parser.parse();
+	Syntax_Analyzer analyzer;
+	ostringstream diagnostics;
+	analyzer.diagnostics = &diagnostics;
+	analyzer.appendErrorLog = false;
+	analyzer.budget = monitor;
+	analyzer.tokens = move(tokens);
+	ParseTreeNode *root = analyzer.parseProgram();
+	double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+	deleteTree(root);
+	if (monitor && monitor->exceeded())
+		throw runtime_error("budget benchmark hit a limit: " + monitor->why());
+	return ms;
+}
+
+int benchmarkBudget(const string &specs)
+{
+	try
+	{
+		const int pairs = 21;
+		// Ranks [low, pairs - 1 - low] of the sorted ratios cover the median
+		// with at least 95% probability: P(Binomial(pairs, 1/2) < low + 1) <= 2.5%
+		int low = 0;
+		for (double tail = 0, term = pow(0.5, pairs); tail + term <= 0.025; low++)
+		{
+			tail += term;
+			term = term * (pairs - low) / (low + 1);
+		}
+		low = max(low - 1, 0);
+		vector<tuple<CorpusShape, uint64_t, uint64_t>> runs = parseCorpusSpecs(specs, 256 << 10);
+		cout << "Budget check overhead on lex + symbol pass + parse (median of " << pairs << " interleaved pairs, 95% interval)\n"
+			 << fixed;
+		for (auto [shape, bytes, seed] : runs)
+		{
+			string source;
+			CorpusGenerator(shape, seed).generate(source, bytes);
+			BudgetMonitor monitor;
+			vector<double> plain, checked, ratios;
+			for (int rep = 0; rep < pairs; rep++)
+			{
+				if (rep % 2)
+					checked.push_back(timeFrontEnd(source, &monitor));
+				plain.push_back(timeFrontEnd(source, nullptr));
+				if (rep % 2 == 0)
+					checked.push_back(timeFrontEnd(source, &monitor));
+				ratios.push_back(checked.back() / plain.back());
+			}
+			sort(plain.begin(), plain.end());
+			sort(checked.begin(), checked.end());
+			sort(ratios.begin(), ratios.end());
+			auto percent = [](double ratio) { return (ratio - 1) * 100; };
+			cout << "  " << left << setw(12) << corpusShapeNames[int(shape)] << right << setprecision(1) << setw(9)
+				 << plain[pairs / 2] << " ms unchecked " << setw(9) << checked[pairs / 2] << " ms checked " << showpos
+				 << setprecision(2) << setw(7) << percent(ratios[pairs / 2]) << "% [" << percent(ratios[low]) << "%, "
+				 << percent(ratios[pairs - 1 - low]) << "%]" << noshowpos << "\n";
+		}
+		cout << defaultfloat << setprecision(6);
+	}
+	catch (const exception &e)
+	{
+		cout << defaultfloat << setprecision(6);
+		cerr << "Error: " << e.what() << endl;
+		return 1;
+	}
+	return 0;
+}
+
+// ----------------------------------------------
+// Tree pass benchmark
+// ----------------------------------------------
+// Runs the six --tree-stats passes over the tree of each generated corpus
+// once one after the other (six walks) and once fused by runTreePasses (one
+// walk), best of 5 each, and checks that both give the same results.
+
+struct PassBenchResult
+{
+	string shape;
+	uint64_t seed, sourceBytes;
+	size_t nodes;
+	double sequentialMs, fusedMs;
+};
+
+PassBenchResult benchmarkTreePasses(CorpusShape shape, uint64_t bytes, uint64_t seed)
+{
+	PassBenchResult result{corpusShapeNames[int(shape)], seed, 0, 0, 1e300, 1e300};
+	string source;
+	CorpusGenerator(shape, seed).generate(source, bytes);
+	result.sourceBytes = source.size();
+	vector<Error> errors;
+	Syntax_Analyzer analyzer;
+	ostringstream diagnostics;
+	analyzer.diagnostics = &diagnostics;
+	analyzer.appendErrorLog = false;
+	analyzer.tokens = Lexer().tokenize(source, errors);
+	ParseTreeNode *root = analyzer.parseProgram();
+
+	string sequentialText, fusedText;
+	for (int rep = 0; rep < 5; rep++)
+	{
+		TreeShapePass treeShape;
+		KindHistogramPass kinds;
+		DefinitionPass definitions;
+		CallSitePass calls;
+		LoopPass loops;
+		ConstantPass constants;
+		auto start = chrono::steady_clock::now();
+		treeShape.run(root);
+		kinds.run(root);
+		definitions.run(root);
+		calls.run(root);
+		loops.run(root);
+		constants.run(root);
+		result.sequentialMs = min(result.sequentialMs, chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+		result.nodes = treeShape.nodes;
+		sequentialText.clear();
+		treeShape.describe(sequentialText);
+		kinds.describe(sequentialText);
+		definitions.describe(sequentialText);
+		calls.describe(sequentialText);
+		loops.describe(sequentialText);
+		constants.describe(sequentialText);
+	}
+	for (int rep = 0; rep < 5; rep++)
+	{
+		TreeShapePass treeShape;
+		KindHistogramPass kinds;
+		DefinitionPass definitions;
+		CallSitePass calls;
+		LoopPass loops;
+		ConstantPass constants;
+		auto start = chrono::steady_clock::now();
+		runTreePasses(root, treeShape, kinds, definitions, calls, loops, constants);
+		result.fusedMs = min(result.fusedMs, chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+		fusedText.clear();
+		treeShape.describe(fusedText);
+		kinds.describe(fusedText);
+		definitions.describe(fusedText);
+		calls.describe(fusedText);
+		loops.describe(fusedText);
+		constants.describe(fusedText);
+	}
+	deleteTree(root);
+	if (sequentialText != fusedText)
+		throw runtime_error("fused tree passes disagree with sequential ones on " + result.shape);
+	return result;
+}
+
+int benchmarkPasses(const string &specs, const string &jsonPath)
+{
+	string json = "{\"corpora\":[";
+	try
+	{
+		vector<tuple<CorpusShape, uint64_t, uint64_t>> runs = parseCorpusSpecs(specs);
+		cout << "Tree pass benchmark, 6 passes (best of 5)\n" << fixed;
+		for (size_t r = 0; r < runs.size(); r++)
+		{
+			auto [shape, bytes, seed] = runs[r];
+			PassBenchResult result = benchmarkTreePasses(shape, bytes, seed);
+			cout << setprecision(2) << "  " << result.shape << " (seed " << seed << "): " << result.sourceBytes / 1048576.0
+				 << " MB, " << result.nodes << " nodes\n"
+				 << setprecision(1) << "    sequential " << setw(9) << result.sequentialMs << " ms " << setprecision(2)
+				 << setw(7) << result.nodes / result.sequentialMs / 1e3 << " Mnode/s\n"
+				 << setprecision(1) << "    fused      " << setw(9) << result.fusedMs << " ms " << setprecision(2)
+				 << setw(7) << result.nodes / result.fusedMs / 1e3 << " Mnode/s  " << result.sequentialMs / result.fusedMs
+				 << "x\n";
+			ostringstream entry;
+			entry << setprecision(6) << ",\"seed\":" << seed << ",\"bytes\":" << result.sourceBytes << ",\"nodes\":" << result.nodes
+				  << ",\"passes\":6,\"sequentialMs\":" << result.sequentialMs << ",\"fusedMs\":" << result.fusedMs << '}';
+			json += r ? ",{\"shape\":" : "{\"shape\":";
+			appendJsonString(json, result.shape);
+			json += entry.str();
+		}
+		cout << defaultfloat << setprecision(6);
+	}
+	catch (const exception &e)
+	{
+		cout << defaultfloat << setprecision(6);
+		cerr << "Error: " << e.what() << endl;
+		return 1;
+	}
+	json += "]}\n";
+	if (!jsonPath.empty())
+	{
+		ofstream out(jsonPath);
+		if (!(out << json))
+		{
+			cerr << "Error: could not write " << jsonPath << endl;
+			return 1;
+		}
+	}
+	return 0;
+}
+} // namespace pyc::detail
@@ -0,0 +1,1083 @@
+#include "Tools.h"
+#ifdef __unix__
+#include <unistd.h>
+#endif
+
+namespace pyc::detail
+{
+// ----------------------------------------------
+// Batch compilation
+// ----------------------------------------------
+// Runs the front end (lexer, symbol pass, syntax analysis and folding) over
+// many files on the work-stealing pool. Each file writes the same report as
+// the single-file mode to <out>/<relative path>.txt, and the batch ends with
+// an aggregate report.txt (tab-separated, one line per file) and a summary.
+
+vector<BatchInput> collectBatchInputs(const string &spec)
+{
+	vector<BatchInput> inputs;
+	filesystem::path root(spec);
+	if (filesystem::is_directory(root))
+	{
+		error_code ec;
+		for (filesystem::recursive_directory_iterator it(root, filesystem::directory_options::skip_permission_denied, ec), end;
+			 it != end; it.increment(ec))
+			if (it->is_regular_file(ec) && it->path().extension() == ".py")
+				inputs.push_back({it->path().string(), filesystem::relative(it->path(), root, ec).string()});
+	}
+	else if (root.extension() == ".py")
+		inputs.push_back({spec, root.filename().string()});
+	else
+	{
+		istringstream list(readFile(spec));
+		string line;
+		while (getline(list, line))
+		{
+			line.erase(0, line.find_first_not_of(" \t"));
+			line.erase(line.find_last_not_of(" \t\r") + 1);
+			if (line.empty() || line[0] == '#')
+				continue;
+			filesystem::path name = filesystem::path(line).lexically_normal();
+			if (name.has_root_path())
+				name = name.relative_path();
+			if (name.empty() || name == "." || *name.begin() == "..")
+				throw runtime_error("'" + line + "' in " + spec + " has no report name under the output directory");
+			inputs.push_back({line, name.string()});
+		}
+	}
+	sort(inputs.begin(), inputs.end(), [](const BatchInput &a, const BatchInput &b)
+		 { return a.path < b.path; });
+	inputs.erase(unique(inputs.begin(), inputs.end(), [](const BatchInput &a, const BatchInput &b)
+						{ return a.path == b.path; }),
+				 inputs.end());
+	unordered_map<string, const BatchInput *> byReport;
+	for (const BatchInput &input : inputs)
+	{
+		auto [it, added] = byReport.emplace(input.relative, &input);
+		if (!added)
+			throw runtime_error("'" + it->second->path + "' and '" + input.path + "' would both be reported in " +
+								input.relative + ".txt");
+	}
+	return inputs;
+}
+
+bool writeCompileReport(const CompileResult &result, const string &outputPath)
+{
+	error_code ec;
+	filesystem::create_directories(filesystem::path(outputPath).parent_path(), ec);
+	ofstream out(outputPath);
+	if (!out)
+		return false;
+	result.symbols.printSymbols(out);
+	printTokens(result.tokens, result.symbols, out);
+	printErrors(result.lexErrors, out, out);
+	out << result.diagnostics << "\n\n\n\n";
+	printParseTree(result.tree, 0, out);
+	return true;
+}
+
+// Lexes, analyzes and folds one source, filling in the counts of 'result';
+// a source that runs out of 'budget' fails with the limit it hit
+void compileBatchSource(const string &source, const string &outputPath, BatchFileResult &result, FrontEndCache *cache,
+						const ResourceBudget &budget = {})
+{
+	static thread_local CompilerSession session(true);
+	session.setBudget(budget);
+	uint64_t hash = cache ? contentHash(source) : 0;
+	MappedFile image;
+	bool hit = cache && cache->find(hash, source.size(), image);
+	if (hit && outputPath.empty())
+	{
+		// Counts only: the image header is enough
+		const CacheImageHeader *header = cacheImageHeader(image.view());
+		result.tokens = header->tokens;
+		result.symbols = header->symbols;
+		result.nodes = header->nodes;
+		result.lexErrors = header->lexErrors;
+		result.syntaxErrors = int(header->syntaxErrors);
+		return;
+	}
+	CompileResult compiled = [&]
+	{
+		if (hit)
+		{
+			try
+			{
+				return session.restore(image.view());
+			}
+			catch (const exception &)
+			{
+				cache->discard(hash); // a damaged image is a miss
+				hit = false;
+			}
+		}
+		return session.compile(source);
+	}();
+	if (cache && !hit && !compiled.aborted)
+		cache->store(hash, source.size(), compiled);
+	if (compiled.aborted)
+		result.failure = session.abortReason();
+	result.tokens = compiled.tokens.size();
+	result.symbols = compiled.symbols.table.size();
+	result.nodes = countNodes(compiled.tree);
+	result.lexErrors = compiled.lexErrors.size();
+	result.syntaxErrors = compiled.syntaxErrors;
+	if (!outputPath.empty() && !writeCompileReport(compiled, outputPath))
+		result.failure = result.failure.empty() ? "cannot write " + outputPath : result.failure;
+}
+
+// Front end for one file; writes its report to 'outputPath' unless that is empty
+BatchFileResult compileBatchFile(const BatchInput &input, const string &outputPath, FrontEndCache *cache,
+								 const ResourceBudget &budget)
+{
+	BatchFileResult result;
+	result.path = input.path;
+	auto start = chrono::steady_clock::now();
+	string source;
+	try
+	{
+		source = readFile(input.path);
+	}
+	catch (const exception &e)
+	{
+		result.failure = e.what();
+		return result;
+	}
+	result.bytes = source.size();
+	try
+	{
+		compileBatchSource(source, outputPath, result, cache, budget);
+	}
+	catch (const exception &e)
+	{
+		result.failure = string("internal error: ") + e.what();
+	}
+	result.ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+	return result;
+}
+
+vector<BatchFileResult> runBatch(const vector<BatchInput> &inputs, const string &outputDir, unsigned jobs,
+								 FrontEndCache *cache, const ResourceBudget &budget)
+{
+	vector<BatchFileResult> results(inputs.size());
+	vector<uintmax_t> sizes(inputs.size());
+	vector<size_t> order(inputs.size());
+	for (size_t k = 0; k < inputs.size(); k++)
+	{
+		error_code ec;
+		sizes[k] = filesystem::file_size(inputs[k].path, ec);
+		order[k] = k;
+	}
+	stable_sort(order.begin(), order.end(), [&](size_t a, size_t b)
+				{ return sizes[a] > sizes[b]; });
+
+	// Each task claims the largest file nobody has started, so big files go
+	// first whichever deque the pool runs the task from
+	atomic<size_t> next{0};
+	WorkStealingPool pool(jobs);
+	for (size_t n = 0; n < inputs.size(); n++)
+	{
+		pool.submit([&]
+					{
+			size_t k = order[next++];
+			string outputPath = outputDir.empty() ? "" : (filesystem::path(outputDir) / (inputs[k].relative + ".txt")).string();
+			results[k] = compileBatchFile(inputs[k], outputPath, cache, budget); });
+	}
+	pool.wait();
+	return results;
+}
+
+// Writes report.txt and prints the totals; returns the process exit code
+int reportBatch(const vector<BatchFileResult> &results, const string &outputDir, double seconds, unsigned jobs)
+{
+	BatchFileResult total;
+	size_t failed = 0, withErrors = 0;
+	for (const BatchFileResult &r : results)
+	{
+		total.bytes += r.bytes;
+		total.tokens += r.tokens;
+		total.symbols += r.symbols;
+		total.nodes += r.nodes;
+		failed += !r.failure.empty();
+		withErrors += r.lexErrors > 0 || r.syntaxErrors > 0;
+	}
+
+	if (!outputDir.empty())
+	{
+		error_code ec;
+		filesystem::create_directories(outputDir, ec);
+		ofstream report(filesystem::path(outputDir) / "report.txt");
+		report << "file\tbytes\ttokens\tsymbols\tnodes\tlex_errors\tsyntax_errors\tms\tstatus\n";
+		for (const BatchFileResult &r : results)
+			report << r.path << "\t" << r.bytes << "\t" << r.tokens << "\t" << r.symbols << "\t" << r.nodes << "\t"
+				   << r.lexErrors << "\t" << r.syntaxErrors << "\t" << fixed << setprecision(3) << r.ms << "\t"
+				   << (r.failure.empty() ? "ok" : r.failure) << "\n";
+	}
+
+	vector<const BatchFileResult *> slowest;
+	for (const BatchFileResult &r : results)
+		slowest.push_back(&r);
+	size_t shown = min<size_t>(5, slowest.size());
+	partial_sort(slowest.begin(), slowest.begin() + shown, slowest.end(), [](const BatchFileResult *a, const BatchFileResult *b)
+				 { return a->ms > b->ms; });
+
+	cout << fixed << setprecision(1);
+	cout << "Batch: " << results.size() << " files, " << total.bytes / 1024.0 << " KiB, " << jobs << " jobs\n";
+	cout << "  tokens " << total.tokens << ", symbols " << total.symbols << ", tree nodes " << total.nodes << "\n";
+	cout << "  files with errors " << withErrors << ", failed " << failed << "\n";
+	cout << "  " << seconds * 1000 << " ms, " << results.size() / max(seconds, 1e-9) << " files/s, "
+		 << total.bytes / 1048576.0 / max(seconds, 1e-9) << " MiB/s\n";
+	for (size_t k = 0; k < shown; k++)
+		cout << "  slowest: " << slowest[k]->path << " (" << slowest[k]->ms << " ms)\n";
+	if (!outputDir.empty())
+		cout << "  report: " << (filesystem::path(outputDir) / "report.txt").string() << "\n";
+	cout << defaultfloat << setprecision(6);
+	return failed ? 1 : 0;
+}
+
+int batchCompile(const string &spec, const string &outputDir, unsigned jobs, FrontEndCache *cache,
+				 const ResourceBudget &budget)
+{
+	vector<BatchInput> inputs;
+	try
+	{
+		inputs = collectBatchInputs(spec);
+	}
+	catch (const exception &e)
+	{
+		cerr << "Error: " << e.what() << endl;
+		return 1;
+	}
+	auto start = chrono::steady_clock::now();
+	vector<BatchFileResult> results = runBatch(inputs, outputDir, jobs, cache, budget);
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	int status = reportBatch(results, outputDir, seconds, jobs);
+	if (cache)
+		cache->printStats();
+	return status;
+}
+
+// Writes 'files' modules with skewed sizes to the directory 'corpus'
+void generateBatchCorpus(const string &corpus, size_t files)
+{
+	filesystem::create_directories(corpus);
+	for (size_t k = 0; k < files; k++)
+	{
+		// Mostly small modules with an occasional large one, like real repositories
+		size_t lines = k % 100 == 0 ? 5000 : 30 + (k * 37) % 400;
+		ofstream(filesystem::path(corpus) / ("module_" + to_string(k) + ".py"))
+			<< "# module " << k << "\n" << generateSemanticBenchModule(lines);
+	}
+}
+
+void benchmarkBatch(const string &dir, unsigned maxJobs, size_t files)
+{
+	TempDirectory scratch("pyc_batch_");
+	string corpus = dir.empty() ? scratch.path : dir;
+	if (dir.empty())
+		generateBatchCorpus(corpus, files);
+	vector<BatchInput> inputs = collectBatchInputs(corpus);
+	cout << "Batch scaling benchmark: " << inputs.size() << " files in " << corpus << "\n";
+	cout << fixed << setprecision(1);
+	double baseline = 0;
+	vector<unsigned> counts;
+	for (unsigned jobs = 1; jobs < maxJobs; jobs *= 2)
+		counts.push_back(jobs);
+	counts.push_back(maxJobs);
+	for (unsigned jobs : counts)
+	{
+		auto start = chrono::steady_clock::now();
+		runBatch(inputs, "", jobs);
+		double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		double rate = inputs.size() / seconds;
+		if (baseline == 0)
+			baseline = rate;
+		cout << "  jobs=" << jobs << ": " << seconds * 1000 << " ms, " << rate << " files/s, speedup "
+			 << setprecision(2) << rate / baseline << setprecision(1) << "\n";
+	}
+	cout << defaultfloat << setprecision(6);
+}
+
+void benchmarkCache(const string &dir, unsigned jobs, size_t files)
+{
+	TempDirectory scratch("pyc_cache_bench_");
+	string corpus = dir.empty() ? scratch.path + "/corpus" : dir;
+	if (dir.empty())
+		generateBatchCorpus(corpus, files);
+	vector<BatchInput> inputs = collectBatchInputs(corpus);
+	string cacheDir = scratch.path + "/cache", reports = scratch.path + "/reports";
+	cout << "Front-end cache benchmark: " << inputs.size() << " files in " << corpus << ", " << jobs << " jobs\n";
+	cout << fixed << setprecision(1);
+	auto timed = [&](const char *what, auto &&body)
+	{
+		auto start = chrono::steady_clock::now();
+		body();
+		cout << "  " << left << setw(28) << what << right << setw(9)
+			 << chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() << " ms\n";
+	};
+	{
+		FrontEndCache cache(cacheDir, uintmax_t(16) << 30);
+		timed("no cache", [&]
+			  { runBatch(inputs, "", jobs); });
+		timed("cold cache", [&]
+			  { runBatch(inputs, "", jobs, &cache); });
+	}
+	uintmax_t cacheBytes = 0;
+	{
+		FrontEndCache cache(cacheDir, uintmax_t(16) << 30); // reopened, as by the next run
+		timed("warm cache", [&]
+			  { runBatch(inputs, "", jobs, &cache); });
+		timed("read and hash only", [&]
+			  {
+			WorkStealingPool pool(jobs);
+			atomic<uint64_t> sink{0};
+			for (const BatchInput &input : inputs)
+				pool.submit([&]
+							{ sink += contentHash(readFile(input.path)); });
+			pool.wait(); });
+		timed("no cache, reports", [&]
+			  { runBatch(inputs, reports, jobs); });
+		timed("warm cache, reports", [&]
+			  { runBatch(inputs, reports, jobs, &cache); });
+		cache.printStats();
+		for (const auto &entry : filesystem::directory_iterator(cacheDir))
+			cacheBytes += entry.file_size();
+	}
+	{
+		FrontEndCache cache(cacheDir, cacheBytes / 4);
+		timed("warm cache, 1/4 capacity", [&]
+			  { runBatch(inputs, "", jobs, &cache); });
+		cache.printStats();
+	}
+	cout << defaultfloat << setprecision(6);
+}
+
+// ----------------------------------------------
+// Module loader
+// ----------------------------------------------
+// Resolves imports against local search paths and loads the transitive
+// module graph. A module is parsed on the pool as soon as an importer
+// names it, so discovery and parsing overlap; a name is claimed under the
+// loader's lock before its task is submitted, so each module is parsed
+// exactly once however many modules import it. Only the search paths are
+// read - there is no site-packages or network lookup.
+//
+// Imports are read from the token stream rather than the tree: the grammar
+// accepts neither relative imports nor "from x import a, b", and a module
+// that fails to parse still has dependencies.
+struct ImportRef
+{
+	string module; // absolute dotted name
+	bool optional; // "from x import y" tries x.y, which may be a plain name
+};
+
+// Import statements in 'tokens' of module 'moduleName'; relative imports are
+// made absolute against its package
+vector<ImportRef> scanImports(const vector<Token> &tokens, const string &moduleName, bool isPackage)
+{
+	vector<ImportRef> refs;
+	auto addWithParents = [&](const string &name, bool optional)
+	{
+		// "import a.b.c" also imports a and a.b
+		for (size_t dot = name.find('.'); dot != string::npos; dot = name.find('.', dot + 1))
+			refs.push_back({name.substr(0, dot), optional});
+		refs.push_back({name, optional});
+	};
+	auto dottedName = [&](size_t &k)
+	{
+		string name;
+		while (k < tokens.size() && tokens[k].type == TokenType::IDENTIFIER)
+		{
+			name += tokens[k++].lexeme;
+			if (k + 1 < tokens.size() && tokens[k].type == TokenType::Dot && tokens[k + 1].type == TokenType::IDENTIFIER)
+				name += tokens[k++].lexeme;
+			else
+				break;
+		}
+		return name;
+	};
+	auto skipAlias = [&](size_t &k)
+	{
+		if (k + 1 < tokens.size() && tokens[k].type == TokenType::AsKeyword)
+			k += 2;
+	};
+
+	int depth = 0;
+	for (size_t k = 0; k < tokens.size(); k++)
+	{
+		const Token &tk = tokens[k];
+		bool statementStart = depth == 0 &&
+							  (k == 0 || tokens[k - 1].lineNumber < tk.lineNumber || tokens[k - 1].type == TokenType::INDENT ||
+							   tokens[k - 1].type == TokenType::DEDENT || tokens[k - 1].type == TokenType::Semicolon);
+		if (tk.type == TokenType::LeftParenthesis || tk.type == TokenType::LeftBracket || tk.type == TokenType::LeftBrace)
+			depth++;
+		else if ((tk.type == TokenType::RightParenthesis || tk.type == TokenType::RightBracket || tk.type == TokenType::RightBrace) && depth > 0)
+			depth--;
+		if (!statementStart)
+			continue;
+
+		if (tk.type == TokenType::ImportKeyword)
+		{
+			size_t j = k + 1;
+			while (true)
+			{
+				string name = dottedName(j);
+				if (name.empty())
+					break;
+				addWithParents(name, false);
+				skipAlias(j);
+				if (j < tokens.size() && tokens[j].type == TokenType::Comma)
+					j++;
+				else
+					break;
+			}
+		}
+		else if (tk.type == TokenType::FromKeyword)
+		{
+			size_t j = k + 1;
+			size_t level = 0;
+			while (j < tokens.size() && tokens[j].type == TokenType::Dot)
+				level++, j++;
+			string name = dottedName(j);
+			if (j >= tokens.size() || tokens[j].type != TokenType::ImportKeyword)
+				continue;
+			j++;
+			string base = name;
+			if (level > 0)
+			{
+				// The importer's package, then one level up per extra dot
+				auto parentOf = [](const string &dotted)
+				{
+					size_t dot = dotted.rfind('.');
+					return dot == string::npos ? string() : dotted.substr(0, dot);
+				};
+				string package = isPackage ? moduleName : parentOf(moduleName);
+				for (size_t up = 1; up < level && !package.empty(); up++)
+					package = parentOf(package);
+				if (package.empty())
+					continue; // beyond the top-level package
+				base = name.empty() ? package : package + "." + name;
+			}
+			if (base.empty())
+				continue;
+			addWithParents(base, false);
+			if (j < tokens.size() && tokens[j].type == TokenType::LeftParenthesis)
+				j++;
+			while (j < tokens.size() && tokens[j].type == TokenType::IDENTIFIER)
+			{
+				refs.push_back({base + "." + tokens[j++].lexeme, true});
+				skipAlias(j);
+				if (j < tokens.size() && tokens[j].type == TokenType::Comma)
+					j++;
+				else
+					break;
+			}
+		}
+	}
+	return refs;
+}
+
+vector<LoadedModule> ModuleLoader::load(const string &entryPath)
+{
+	size_t entry;
+	{
+		lock_guard<mutex> guard(lock);
+		entry = addModule("__main__", entryPath, false);
+	}
+	pool.submit([this, entry]
+				{ loadModule(entry); });
+	pool.wait();
+	vector<LoadedModule> result(make_move_iterator(modules.begin()), make_move_iterator(modules.end()));
+	sort(result.begin(), result.end(), [](const LoadedModule &a, const LoadedModule &b)
+		 { return a.name < b.name; });
+	modules.clear();
+	known.clear();
+	return result;
+}
+
+pair<string, bool> ModuleLoader::resolve(const string &name) const
+{
+	string relative = name;
+	replace(relative.begin(), relative.end(), '.', '/');
+	error_code ec;
+	for (const string &root : searchPaths)
+	{
+		filesystem::path package = filesystem::path(root) / relative / "__init__.py";
+		if (filesystem::is_regular_file(package, ec))
+			return {package.string(), true};
+		filesystem::path module = filesystem::path(root) / (relative + ".py");
+		if (filesystem::is_regular_file(module, ec))
+			return {module.string(), false};
+	}
+	return {"", false};
+}
+
+size_t ModuleLoader::addModule(const string &name, const string &path, bool package)
+{
+	modules.push_back({});
+	LoadedModule &module = modules.back();
+	module.name = name;
+	module.path = path;
+	module.package = package;
+	return known[name] = modules.size() - 1;
+}
+
+void ModuleLoader::loadModule(size_t index)
+{
+	LoadedModule *module;
+	{
+		lock_guard<mutex> guard(lock);
+		module = &modules[index];
+	}
+	string source;
+	try
+	{
+		source = readFile(module->path);
+	}
+	catch (const exception &e)
+	{
+		module->failure = e.what();
+		return;
+	}
+	static thread_local CompilerSession session;
+	session.setBudget(budget);
+	CompileResult result = session.compile(source);
+	parses++;
+	module->tokens = result.tokens.size();
+	module->nodes = countNodes(result.tree);
+	module->syntaxErrors = result.syntaxErrors;
+	if (result.aborted)
+	{
+		module->failure = session.abortReason();
+		return;
+	}
+
+	unordered_set<string> seen;
+	for (const ImportRef &ref : scanImports(result.tokens, module->name, module->package))
+	{
+		if (ref.module == module->name || !seen.insert(ref.module).second)
+			continue;
+		bool found = follow(ref.module);
+		if (found)
+			module->imports.push_back(ref.module);
+		else if (!ref.optional)
+			module->unresolved.push_back(ref.module);
+	}
+}
+
+bool ModuleLoader::follow(const string &name)
+{
+	{
+		lock_guard<mutex> guard(lock);
+		auto it = known.find(name);
+		if (it != known.end())
+			return it->second != notFound;
+	}
+	auto [path, package] = resolve(name);
+	size_t index;
+	{
+		lock_guard<mutex> guard(lock);
+		auto it = known.find(name);
+		if (it != known.end()) // another worker resolved it meanwhile
+			return it->second != notFound;
+		if (path.empty())
+		{
+			known[name] = notFound;
+			return false;
+		}
+		index = addModule(name, path, package);
+	}
+	pool.submit([this, index]
+				{ loadModule(index); });
+	return true;
+}
+
+int printImportGraph(const string &entryPath, vector<string> searchPaths, unsigned jobs, const ResourceBudget &budget)
+{
+	if (!filesystem::is_regular_file(entryPath))
+	{
+		cerr << "Error: Could not open file: " << entryPath << endl;
+		return 1;
+	}
+	searchPaths.insert(searchPaths.begin(), filesystem::absolute(entryPath).parent_path().string());
+	ModuleLoader loader(searchPaths, jobs, budget);
+	auto start = chrono::steady_clock::now();
+	vector<LoadedModule> modules = loader.load(entryPath);
+	double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+	size_t edges = 0, unresolved = 0, failed = 0;
+	for (const LoadedModule &m : modules)
+	{
+		edges += m.imports.size();
+		unresolved += m.unresolved.size();
+		failed += !m.failure.empty();
+		cout << m.name << " (" << m.path << ")";
+		if (!m.failure.empty())
+			cout << " failed: " << m.failure;
+		else if (m.syntaxErrors > 0)
+			cout << " [" << m.syntaxErrors << " syntax errors]";
+		cout << "\n";
+		auto list = [](const char *what, const vector<string> &names)
+		{
+			if (names.empty())
+				return;
+			cout << "  " << what;
+			for (size_t k = 0; k < names.size(); k++)
+				cout << (k ? ", " : " ") << names[k];
+			cout << "\n";
+		};
+		list("->", m.imports);
+		list("unresolved:", m.unresolved);
+	}
+	cout << fixed << setprecision(1);
+	cout << "Import graph: " << modules.size() << " modules, " << edges << " imports, " << unresolved
+		 << " unresolved, " << ms << " ms with " << jobs << " jobs\n";
+	cout << defaultfloat << setprecision(6);
+	return failed ? 1 : 0;
+}
+
+void benchmarkImports(const string &dir, unsigned maxJobs)
+{
+	TempDirectory scratch("pyc_import_corpus_");
+	string root = dir;
+	string entry = scratch.path + "/entry.py";
+	ofstream main(entry);
+	if (root.empty())
+	{
+		root = scratch.path + "/tree";
+		const size_t packages = 50, perPackage = 40;
+		uint64_t seed = 42;
+		auto next = [&seed](size_t bound)
+		{
+			seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+			return static_cast<size_t>(seed >> 33) % bound;
+		};
+		for (size_t p = 0; p < packages; p++)
+		{
+			filesystem::path package = filesystem::path(root) / ("pkg_" + to_string(p));
+			filesystem::create_directories(package);
+			ofstream(package / "__init__.py") << "from . import mod_0\n";
+			for (size_t m = 0; m < perPackage; m++)
+			{
+				ofstream out(package / ("mod_" + to_string(m) + ".py"));
+				out << "from . import mod_" << next(perPackage) << "\n";
+				for (int k = 0; k < 3; k++)
+					out << "import pkg_" << next(packages) << ".mod_" << next(perPackage) << "\n";
+				out << "from pkg_" << next(packages) << " import mod_" << next(perPackage) << "\n";
+				out << generateSemanticBenchModule(60 + (p * 31 + m * 17) % 240);
+			}
+			main << "import pkg_" << p << "\n";
+		}
+	}
+	else
+	{
+		error_code ec;
+		for (const auto &item : filesystem::directory_iterator(root, ec))
+		{
+			string stem = item.path().stem().string();
+			bool module = item.path().extension() == ".py" && stem.find('-') == string::npos;
+			bool package = item.is_directory() && filesystem::is_regular_file(item.path() / "__init__.py");
+			if (module || package)
+				main << "import " << stem << "\n";
+		}
+	}
+	main.close();
+
+	cout << "Import loader benchmark: " << root << "\n";
+	cout << fixed << setprecision(1);
+	vector<unsigned> counts;
+	for (unsigned jobs = 1; jobs < maxJobs; jobs *= 2)
+		counts.push_back(jobs);
+	counts.push_back(maxJobs);
+	for (unsigned jobs : counts)
+	{
+		ModuleLoader loader({root}, jobs);
+		auto start = chrono::steady_clock::now();
+		vector<LoadedModule> modules = loader.load(entry);
+		double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+		size_t edges = 0, tokens = 0, parsed = 0;
+		for (const LoadedModule &m : modules)
+		{
+			edges += m.imports.size();
+			tokens += m.tokens;
+			parsed += m.failure.empty();
+		}
+		cout << "  jobs=" << jobs << ": " << modules.size() << " modules, " << edges << " imports, " << tokens
+			 << " tokens, " << ms << " ms, " << modules.size() / (ms / 1000) << " modules/s, parsed once: "
+			 << (loader.parseCount() == parsed ? "yes" : "no") << "\n";
+	}
+	cout << defaultfloat << setprecision(6);
+}
+
+// ----------------------------------------------
+// Incremental builds
+// ----------------------------------------------
+// --build=ROOT compiles every module under ROOT like --batch and keeps a
+// build graph in <out>/build.graph: for each module its size, mtime,
+// content hash, imports and export summary (its global-scope symbols). A
+// rerun stats every file, hashes only those whose size or mtime moved, and
+// re-parses only those whose content changed. The link step - checking
+// "from x import y" against x's exports - is redone for a module only when
+// it was re-parsed or when a module it imports from changed its exports.
+
+struct BuildModule
+{
+	string path; // relative to the root, '/'-separated
+	uintmax_t size = 0;
+	int64_t mtime = 0; // file clock ticks
+	uint64_t hash = 0;
+	uint64_t exportHash = 0;
+	size_t tokens = 0;
+	size_t lexErrors = 0;
+	int syntaxErrors = 0;
+	vector<ImportRef> imports;
+	vector<pair<string, string>> exports; // global name and type, sorted by name
+	vector<string> linkErrors;
+};
+
+const char *const buildGraphHeader = "pyc-build-graph 1";
+
+// "pkg/mod.py" -> "pkg.mod", "pkg/__init__.py" -> "pkg"
+string moduleNameOf(const string &relativePath)
+{
+	string name = relativePath.substr(0, relativePath.size() - 3);
+	if (name == "__init__")
+		return "";
+	if (name.size() > 9 && name.compare(name.size() - 9, 9, "/__init__") == 0)
+		name.resize(name.size() - 9);
+	replace(name.begin(), name.end(), '/', '.');
+	return name;
+}
+
+bool isPackageInit(const string &relativePath)
+{
+	return filesystem::path(relativePath).filename() == "__init__.py";
+}
+
+// Graph file: one "M" line per module, followed by its "I" (import),
+// "E" (export) and "L" (link error) lines; fields are tab-separated
+void saveBuildGraph(const string &file, const vector<BuildModule> &modules)
+{
+	string temporary = file + ".tmp";
+	{
+		ofstream out(temporary);
+		out << buildGraphHeader << "\n";
+		for (const BuildModule &m : modules)
+		{
+			out << "M\t" << m.path << "\t" << m.size << "\t" << m.mtime << "\t" << m.hash << "\t" << m.exportHash
+				<< "\t" << m.tokens << "\t" << m.lexErrors << "\t" << m.syntaxErrors << "\n";
+			for (const ImportRef &ref : m.imports)
+				out << "I\t" << ref.module << "\t" << ref.optional << "\n";
+			for (const auto &[name, type] : m.exports)
+				out << "E\t" << name << "\t" << type << "\n";
+			for (const string &message : m.linkErrors)
+				out << "L\t" << message << "\n";
+		}
+		if (!out)
+			throw runtime_error("cannot write " + temporary);
+	}
+	filesystem::rename(temporary, file);
+}
+
+// Modules by path; empty when the file is missing, damaged or from another
+// version, so that everything is rebuilt
+unordered_map<string, BuildModule> loadBuildGraph(const string &file)
+{
+	auto number = [](const string &text, auto &value)
+	{
+		const char *end = text.data() + text.size();
+		auto [stop, error] = from_chars(text.data(), end, value);
+		return !text.empty() && error == errc() && stop == end;
+	};
+	unordered_map<string, BuildModule> modules;
+	ifstream in(file);
+	string line;
+	if (!getline(in, line) || line != buildGraphHeader)
+		return modules;
+	vector<string> fields;
+	BuildModule *current = nullptr;
+	while (getline(in, line))
+	{
+		fields.clear();
+		for (size_t begin = 0;;)
+		{
+			size_t tab = line.find('\t', begin);
+			fields.push_back(line.substr(begin, tab - begin));
+			if (tab == string::npos)
+				break;
+			begin = tab + 1;
+		}
+		if (fields[0] == "M" && fields.size() == 9)
+		{
+			current = &modules[fields[1]];
+			current->path = fields[1];
+			if (!number(fields[2], current->size) || !number(fields[3], current->mtime) ||
+				!number(fields[4], current->hash) || !number(fields[5], current->exportHash) ||
+				!number(fields[6], current->tokens) || !number(fields[7], current->lexErrors) ||
+				!number(fields[8], current->syntaxErrors))
+				return {};
+		}
+		else if (!current)
+			return {}; // damaged; rebuild everything
+		else if (fields[0] == "I" && fields.size() == 3)
+			current->imports.push_back({fields[1], fields[2] == "1"});
+		else if (fields[0] == "E" && fields.size() == 3)
+			current->exports.push_back({fields[1], fields[2]});
+		else if (fields[0] == "L" && fields.size() == 2)
+			current->linkErrors.push_back(fields[1]);
+		else
+			return {};
+	}
+	return modules;
+}
+
+// Re-parses one module's source (module.hash is its hash); imports, exports
+// and counts come from the new tree
+void analyzeBuildModule(BuildModule &module, const string &source, const string &reportPath, FrontEndCache *cache)
+{
+	static thread_local CompilerSession session(true);
+	CompileResult result = compileCached(session, source, module.hash, cache);
+	module.tokens = result.tokens.size();
+	module.lexErrors = result.lexErrors.size();
+	module.syntaxErrors = result.syntaxErrors;
+	module.imports = scanImports(result.tokens, moduleNameOf(module.path), isPackageInit(module.path));
+	module.exports.clear();
+	for (const auto &[key, info] : result.symbols.table)
+	{
+		// A top-level def or class is recorded in its own scope
+		string_view name = string_view(key).substr(0, key.find('@'));
+		if (info.scope == "global" || ((info.type == "function" || info.type == "class") && info.scope == name))
+			module.exports.push_back({string(name), string(info.type)});
+	}
+	// After "from x import *" any name may be defined; "*" sorts first
+	for (size_t k = 0; k + 1 < result.tokens.size(); k++)
+		if (result.tokens[k].type == TokenType::ImportKeyword && result.tokens[k + 1].lexeme == "*")
+		{
+			module.exports.push_back({"*", "star"});
+			break;
+		}
+	sort(module.exports.begin(), module.exports.end());
+	string summary;
+	for (const auto &[name, type] : module.exports)
+		summary += name + "\t" + type + "\n";
+	module.exportHash = contentHash(summary);
+	if (!reportPath.empty())
+		writeCompileReport(result, reportPath);
+}
+
+// "from x import y" must name an export of x or a submodule x.y; modules
+// outside the build are not checked
+void linkBuildModule(BuildModule &module, const unordered_map<string, const BuildModule *> &byName)
+{
+	module.linkErrors.clear();
+	for (const ImportRef &ref : module.imports)
+	{
+		if (!ref.optional || byName.count(ref.module))
+			continue;
+		size_t dot = ref.module.rfind('.');
+		auto from = byName.find(ref.module.substr(0, dot));
+		if (from == byName.end())
+			continue;
+		string name = ref.module.substr(dot + 1);
+		const auto &exports = from->second->exports;
+		if (!exports.empty() && exports[0].first == "*")
+			continue;
+		auto it = lower_bound(exports.begin(), exports.end(), make_pair(name, string()));
+		if (it == exports.end() || it->first != name)
+			module.linkErrors.push_back("cannot import name '" + name + "' from '" + from->first + "'");
+	}
+}
+
+BuildStats buildProject(const string &root, const string &outputDir, unsigned jobs, bool writeReports,
+						FrontEndCache *cache)
+{
+	auto start = chrono::steady_clock::now();
+	BuildStats stats;
+	filesystem::create_directories(outputDir);
+	string graphFile = (filesystem::path(outputDir) / "build.graph").string();
+	unordered_map<string, BuildModule> previous = loadBuildGraph(graphFile);
+
+	// Stat everything; keep last build's record where size and mtime agree
+	vector<BuildModule> modules;
+	vector<char> fresh;		// not in the last build
+	vector<size_t> suspect; // indices whose content must be hashed
+	error_code ec;
+	for (filesystem::recursive_directory_iterator it(root, filesystem::directory_options::skip_permission_denied, ec), end;
+		 it != end; it.increment(ec))
+	{
+		if (!it->is_regular_file(ec) || it->path().extension() != ".py")
+			continue;
+		string relative = it->path().lexically_relative(root).generic_string();
+		uintmax_t size = it->file_size(ec);
+		int64_t mtime = it->last_write_time(ec).time_since_epoch().count();
+		auto old = previous.find(relative);
+		fresh.push_back(old == previous.end());
+		if (!fresh.back())
+		{
+			modules.push_back(move(old->second));
+			previous.erase(old);
+			if (modules.back().size == size && modules.back().mtime == mtime)
+				continue;
+		}
+		else
+		{
+			modules.push_back({});
+			modules.back().path = relative;
+		}
+		modules.back().size = size;
+		modules.back().mtime = mtime;
+		suspect.push_back(modules.size() - 1);
+	}
+	stats.removed = previous.size();
+	stats.hashed = suspect.size();
+
+	// Hash the suspects and re-parse those whose content really changed
+	vector<char> reparsed(modules.size(), 0), exportsChanged(modules.size(), 0);
+	{
+		WorkStealingPool pool(jobs);
+		for (size_t index : suspect)
+			pool.submit([&, index]
+						{
+				BuildModule &m = modules[index];
+				string source;
+				try
+				{
+					source = readFile((filesystem::path(root) / m.path).string());
+				}
+				catch (const exception &)
+				{
+					return; // vanished since the scan; the next build drops it
+				}
+				uint64_t hash = contentHash(source);
+				if (hash == m.hash && !fresh[index])
+					return;
+				m.hash = hash;
+				uint64_t oldExports = m.exportHash;
+				string report = writeReports ? (filesystem::path(outputDir) / (m.path + ".txt")).string() : "";
+				analyzeBuildModule(m, source, report, cache);
+				reparsed[index] = 1;
+				exportsChanged[index] = fresh[index] || m.exportHash != oldExports; });
+		pool.wait();
+	}
+
+	// Names whose exports changed, appeared or disappeared
+	unordered_set<string> changedNames;
+	for (auto &[path, gone] : previous)
+	{
+		changedNames.insert(moduleNameOf(path));
+		filesystem::remove(filesystem::path(outputDir) / (path + ".txt"), ec);
+	}
+	unordered_map<string, const BuildModule *> byName;
+	for (size_t k = 0; k < modules.size(); k++)
+	{
+		byName[moduleNameOf(modules[k].path)] = &modules[k];
+		stats.parsed += reparsed[k];
+		if (exportsChanged[k])
+			changedNames.insert(moduleNameOf(modules[k].path));
+	}
+	for (size_t k = 0; k < modules.size(); k++)
+	{
+		BuildModule &m = modules[k];
+		bool relink = reparsed[k];
+		for (size_t r = 0; r < m.imports.size() && !relink && !changedNames.empty(); r++)
+		{
+			const string &name = m.imports[r].module;
+			relink = changedNames.count(name) ||
+					 (m.imports[r].optional && changedNames.count(name.substr(0, name.rfind('.'))));
+		}
+		if (relink)
+		{
+			linkBuildModule(m, byName);
+			stats.relinked++;
+		}
+		for (const string &message : m.linkErrors)
+			stats.linkErrors.push_back(m.path + ": " + message);
+	}
+
+	sort(modules.begin(), modules.end(), [](const BuildModule &a, const BuildModule &b)
+		 { return a.path < b.path; });
+	if (stats.hashed > 0 || stats.removed > 0)
+		saveBuildGraph(graphFile, modules);
+	stats.modules = modules.size();
+	stats.ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+	return stats;
+}
+
+int runBuild(const string &root, const string &outputDir, unsigned jobs, FrontEndCache *cache)
+{
+	if (!filesystem::is_directory(root))
+	{
+		cerr << "Error: not a directory: " << root << endl;
+		return 1;
+	}
+	BuildStats stats;
+	try
+	{
+		stats = buildProject(root, outputDir, jobs, true, cache);
+	}
+	catch (const exception &e)
+	{
+		cerr << "Error: " << e.what() << endl;
+		return 1;
+	}
+	cout << fixed << setprecision(1);
+	cout << "Build: " << stats.modules << " modules, " << stats.parsed << " re-parsed, " << stats.relinked
+		 << " relinked, " << stats.removed << " removed, " << stats.linkErrors.size() << " link errors, "
+		 << stats.ms << " ms\n";
+	cout << defaultfloat << setprecision(6);
+	sort(stats.linkErrors.begin(), stats.linkErrors.end());
+	for (const string &message : stats.linkErrors)
+		cout << "  " << message << "\n";
+	if (cache)
+		cache->printStats();
+	return 0;
+}
+
+void benchmarkBuild(size_t files, unsigned jobs)
+{
+	TempDirectory scratch("pyc_build_corpus_");
+	filesystem::path root = filesystem::path(scratch.path) / "src";
+	string state = scratch.path + "/state";
+	const size_t perPackage = 100;
+	size_t packages = (files + perPackage - 1) / perPackage;
+	vector<filesystem::path> modules;
+	for (size_t p = 0; p < packages; p++)
+	{
+		filesystem::path package = root / ("pkg_" + to_string(p));
+		filesystem::create_directories(package);
+		ofstream(package / "__init__.py") << "VERSION = " << p << "\n";
+		for (size_t m = 0; m + 1 < perPackage && p * perPackage + m < files; m++)
+		{
+			modules.push_back(package / ("mod_" + to_string(m) + ".py"));
+			ofstream out(modules.back());
+			// Each module imports from the one before it, in its package and the previous one
+			if (m > 0)
+				out << "from pkg_" << p << ".mod_" << m - 1 << " import func_0\n";
+			if (p > 0)
+				out << "from pkg_" << p - 1 << ".mod_" << m << " import g_0\n";
+			out << generateSemanticBenchModule(28);
+		}
+	}
+	auto run = [&](const char *what)
+	{
+		BuildStats s = buildProject(root.string(), state, jobs, false);
+		cout << "  " << left << setw(24) << what << right << setw(9) << s.ms << " ms  (" << s.modules
+			 << " modules, " << s.hashed << " hashed, " << s.parsed << " re-parsed, " << s.relinked << " relinked)\n";
+	};
+	cout << "Incremental build benchmark: " << files << " files, " << jobs << " jobs\n";
+	cout << fixed << setprecision(1);
+	run("full build");
+	run("no-op rebuild");
+	// A module in the middle has importers in its own package and the next
+	filesystem::path target = modules[modules.size() / 2];
+	filesystem::last_write_time(target, filesystem::file_time_type::clock::now());
+	run("touch one file");
+	string source = readFile(target.string());
+	ofstream(target) << source << "    # edited\n";
+	run("edit keeping exports");
+	ofstream(target, ios::app) << "added_global = 1\n";
+	run("edit changing exports");
+	run("no-op rebuild");
+	cout << defaultfloat << setprecision(6);
+}
+} // namespace pyc::detail
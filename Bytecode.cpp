@@ -0,0 +1,1039 @@
+#include "Engines.h"
+
+namespace pyc::detail
+{
+// ----------------------------------------------
+// Bytecode compiler
+// ----------------------------------------------
+// Register-based instructions. Operands marked RK are a register, or a
+// constant-pool index when the top bit (RK_CONSTANT) is set. Instructions
+// that need a fourth operand are followed by an EXTRA word.
+
+const char *opName(Op op)
+{
+	static const char *names[] = {
+#define BYTECODE_NAME(name) #name,
+		BYTECODE_OPS(BYTECODE_NAME)
+#undef BYTECODE_NAME
+	};
+	return names[static_cast<size_t>(op)];
+}
+
+Op binaryOpFor(const string &op)
+{
+	static const unordered_map<string, Op> ops = {
+		{"+", Op::ADD}, {"-", Op::SUB}, {"*", Op::MUL}, {"/", Op::DIV}, {"%", Op::MOD}, {"//", Op::FLOORDIV}, {"**", Op::POW}, {"&", Op::BITAND}, {"|", Op::BITOR}, {"^", Op::BITXOR}, {"<<", Op::SHL}, {">>", Op::SHR}, {"==", Op::EQ}, {"!=", Op::NE}, {"<", Op::LT}, {"<=", Op::LE}, {">", Op::GT}, {">=", Op::GE}, {"in", Op::IN}, {"not in", Op::NOTIN}, {"is", Op::IS}, {"is not", Op::ISNOT}};
+	auto it = ops.find(op);
+	if (it == ops.end())
+		throw CompileError("unsupported operator '" + op + "'");
+	return it->second;
+}
+
+bool isComparisonOp(Op op) { return op >= Op::EQ && op <= Op::ISNOT; }
+
+Value constToValue(const ConstValue &v)
+{
+	switch (v.kind)
+	{
+	case ConstValue::Kind::Bool:
+		return Value::boolean(v.i != 0);
+	case ConstValue::Kind::Int:
+		return Value::integer(v.i);
+	case ConstValue::Kind::Float:
+		return Value::number(v.f);
+	case ConstValue::Kind::Str:
+		return makeString(v.s);
+	case ConstValue::Kind::Tuple:
+	{
+		auto *tuple = new ListObject(ObjKind::Tuple);
+		Value result(tuple);
+		for (const ConstValue &item : v.items)
+			tuple->items.push_back(constToValue(item));
+		return result;
+	}
+	default:
+		return Value();
+	}
+}
+
+Program BytecodeCompiler::compile(ParseTreeNode *root)
+{
+	program = Program();
+	program.codes.push_back(make_unique<CodeObject>());
+	CodeObject *module = program.codes[0].get();
+	module->name = "<module>";
+
+	FunctionState state;
+	state.code = module;
+	state.isModule = true;
+	fn = &state;
+	compileStatements(root);
+	emit(Op::LOADNONE, 0);
+	emit(Op::RETURN, 0);
+	finish(state);
+	fn = nullptr;
+	return move(program);
+}
+
+size_t BytecodeCompiler::emit(Op op, uint16_t a, uint16_t b, uint16_t c)
+{
+	Instr in;
+	in.op = op;
+	in.a = a;
+	in.b = b;
+	in.c = c;
+	fn->code->code.push_back(in);
+	return fn->code->code.size() - 1;
+}
+
+size_t BytecodeCompiler::emitBx(Op op, uint16_t a, uint32_t bx)
+{
+	size_t at = emit(op, a);
+	fn->code->code[at].setBx(bx);
+	return at;
+}
+
+uint32_t BytecodeCompiler::markLabel()
+{
+	fn->lastLabel = here();
+	return here();
+}
+
+uint16_t BytecodeCompiler::allocTemp(uint16_t count)
+{
+	uint16_t r = fn->tempTop;
+	if (static_cast<uint32_t>(fn->tempTop) + count >= RK_CONSTANT)
+		throw CompileError("function '" + fn->code->name + "' needs too many registers");
+	fn->tempTop += count;
+	fn->maxRegisters = max(fn->maxRegisters, fn->tempTop);
+	return r;
+}
+
+uint16_t BytecodeCompiler::addConstant(const Value &v)
+{
+	auto &pool = fn->code->constants;
+	if (v.tag == Value::Tag::Int)
+	{
+		auto it = fn->intConstants.find(v.i);
+		if (it != fn->intConstants.end())
+			return it->second;
+	}
+	else if (v.isObject(ObjKind::Str))
+	{
+		auto it = fn->stringConstants.find(static_cast<StrObject *>(v.obj)->s);
+		if (it != fn->stringConstants.end())
+			return it->second;
+	}
+	if (pool.size() >= 0xFFFF)
+		throw CompileError("too many constants in '" + fn->code->name + "'");
+	uint16_t k = static_cast<uint16_t>(pool.size());
+	pool.push_back(v);
+	if (v.tag == Value::Tag::Int)
+		fn->intConstants[v.i] = k;
+	else if (v.isObject(ObjKind::Str))
+		fn->stringConstants[static_cast<StrObject *>(v.obj)->s] = k;
+	return k;
+}
+
+uint16_t BytecodeCompiler::constantOperand(const Value &v)
+{
+	uint16_t k = addConstant(v);
+	if (k < RK_CONSTANT)
+		return RK_CONSTANT | k;
+	uint16_t r = allocTemp();
+	emitBx(Op::LOADK, r, k);
+	return r;
+}
+
+uint16_t BytecodeCompiler::toRegister(uint16_t operand)
+{
+	if (!(operand & RK_CONSTANT))
+		return operand;
+	uint16_t r = allocTemp();
+	emitBx(Op::LOADK, r, operand & ~RK_CONSTANT);
+	return r;
+}
+
+bool BytecodeCompiler::writesRegisterA(Op op)
+{
+	switch (op)
+	{
+	case Op::STOREGLOBAL:
+	case Op::CHECKLOCAL:
+	case Op::JMP:
+	case Op::JMPIF:
+	case Op::JMPIFNOT:
+	case Op::LTJMPIFNOT:
+	case Op::SETATTR:
+	case Op::RETURN:
+	case Op::RAISE:
+	case Op::RERAISE:
+	case Op::EXTRA:
+	case Op::CALLMETHOD:
+	case Op::FORITER:
+	case Op::MAKENATIVE:
+		return false;
+	default:
+		return true;
+	}
+}
+
+void BytecodeCompiler::compileInto(ParseTreeNode *node, uint16_t dest)
+{
+	uint16_t mark = fn->tempTop;
+	uint16_t r = compileExpr(node);
+	moveInto(r, dest);
+	fn->tempTop = mark;
+	if (isTemp(dest) && dest >= mark)
+		fn->tempTop = dest + 1;
+}
+
+void BytecodeCompiler::moveInto(uint16_t r, uint16_t dest)
+{
+	if (r == dest)
+		return;
+	if (r & RK_CONSTANT)
+	{
+		emitBx(Op::LOADK, dest, r & ~RK_CONSTANT);
+		return;
+	}
+	auto &code = fn->code->code;
+	if (isTemp(r) && !code.empty() && fn->lastLabel != here() &&
+		writesRegisterA(code.back().op) && code.back().a == r)
+	{
+		code.back().a = dest;
+		return;
+	}
+	emit(Op::MOVE, dest, r);
+}
+
+void BytecodeCompiler::finish(FunctionState &state)
+{
+	state.code->numRegisters = max<uint16_t>(state.maxRegisters, state.numLocals);
+}
+
+bool BytecodeCompiler::isLocal(const string &name, uint16_t &reg) const
+{
+	auto it = fn->locals.find(name);
+	if (it == fn->locals.end())
+		return false;
+	reg = it->second;
+	return true;
+}
+
+uint16_t BytecodeCompiler::loadName(const string &name)
+{
+	uint16_t reg;
+	if (isLocal(name, reg))
+	{
+		if (!fn->assigned.count(name))
+			emitBx(Op::CHECKLOCAL, reg, addConstant(makeString(name)));
+		return reg;
+	}
+	uint16_t r = allocTemp();
+	emitBx(Op::LOADGLOBAL, r, program.globalSlot(name));
+	return r;
+}
+
+void BytecodeCompiler::storeName(const string &name, uint16_t src)
+{
+	uint16_t reg;
+	if (isLocal(name, reg))
+	{
+		moveInto(src, reg);
+		fn->assigned.insert(name);
+	}
+	else
+		emitBx(Op::STOREGLOBAL, toRegister(src), program.globalSlot(name));
+}
+
+void BytecodeCompiler::assignExpr(const string &name, ParseTreeNode *expr)
+{
+	uint16_t reg;
+	uint16_t mark = fn->tempTop;
+	if (isLocal(name, reg))
+	{
+		compileInto(expr, reg);
+		fn->assigned.insert(name);
+	}
+	else
+		storeName(name, compileExpr(expr));
+	fn->tempTop = mark;
+}
+
+void BytecodeCompiler::compileStatements(ParseTreeNode *list)
+{
+	for (ParseTreeNode *child : list->children)
+		compileStatement(child);
+}
+
+void BytecodeCompiler::compileBranch(ParseTreeNode *list)
+{
+	unordered_set<string> before = fn->assigned;
+	compileStatements(list);
+	fn->assigned = move(before);
+}
+
+void BytecodeCompiler::compileStatement(ParseTreeNode *node)
+{
+	uint16_t mark = fn->tempTop;
+	const string &label = node->label;
+	if (isLeaf(node))
+		return; // INDENT / DEDENT markers
+	if (label == "statement")
+		compileStatement(node->children[0]);
+	else if (label == "assignment")
+		compileAssignment(node);
+	else if (label == "conditional_statement")
+		compileConditional(node);
+	else if (label == "while_statement")
+		compileWhile(node);
+	else if (label == "for_statement")
+		compileFor(node);
+	else if (label == "try_statement")
+		compileTry(node);
+	else if (label == "function")
+	{
+		const string &name = node->children[1]->label;
+		uint16_t f = compileFunction(node);
+		auto native = fn->isModule ? natives.find(name) : natives.end();
+		if (native != natives.end())
+			emit(Op::MAKENATIVE, f, addConstant(native->second));
+		storeName(name, f);
+	}
+	else if (label == "class_def")
+		compileClass(node);
+	else if (label == "import_statement")
+		compileImport(node);
+	else if (label == "return_statement")
+	{
+		if (fn->isModule)
+			throw CompileError("'return' outside function");
+		uint16_t r = compileExpr(node->children[1]);
+		if (!fn->regions.empty())
+		{
+			// finally blocks run after the value is computed
+			uint16_t keep = toRegister(r);
+			if (!isTemp(keep))
+			{
+				uint16_t t = allocTemp();
+				emit(Op::MOVE, t, keep);
+				keep = t;
+			}
+			exitRegions(0);
+			emit(Op::RETURN, keep);
+			reopenRegions(0);
+		}
+		else
+		{
+			emit(Op::RETURN, r);
+		}
+	}
+	else if (label == "pass_statement")
+	{
+	}
+	else if (label == "break_statement" || label == "continue_statement")
+	{
+		if (fn->loops.empty())
+			throw CompileError("'" + node->children[0]->label + "' outside loop");
+		LoopInfo &loop = fn->loops.back();
+		exitRegions(loop.regionDepth);
+		if (label == "break_statement")
+			loop.breakJumps.push_back(emitBx(Op::JMP, 0, 0));
+		else
+			emitBx(Op::JMP, 0, loop.continueTarget);
+		reopenRegions(loop.regionDepth);
+	}
+	else if (label == "raise_statement")
+		emit(Op::RAISE, toRegister(compileExpr(node->children[1])));
+	else if (label == "function_call")
+		compileCall(node);
+	else if (label == "factor")
+		compileExpr(node); // docstring or bare literal
+	else
+		throw CompileError("unsupported statement '" + label + "'");
+	fn->tempTop = mark;
+}
+
+void BytecodeCompiler::compileAssignment(ParseTreeNode *node)
+{
+	auto [targets, values, op] = splitAssignment(node);
+
+	if (op != "=")
+	{
+		if (targets.size() != 1)
+			throw CompileError("augmented assignment needs exactly one target");
+		static const unordered_map<string, Op> augmented = {
+			{"+=", Op::ADD}, {"-=", Op::SUB}, {"*=", Op::MUL}, {"/=", Op::DIV}, {"%=", Op::MOD}, {"//=", Op::FLOORDIV}, {"**=", Op::POW}};
+		auto it = augmented.find(op);
+		if (it == augmented.end())
+			throw CompileError("unsupported operator '" + op + "'");
+		ParseTreeNode *target = targets[0];
+		if (isLeaf(target))
+		{
+			uint16_t current = loadName(target->label);
+			uint16_t rhs = compileExpr(values[0]);
+			uint16_t reg;
+			uint16_t dest = isLocal(target->label, reg) ? reg : (isTemp(current) ? current : allocTemp());
+			emit(it->second, dest, current, rhs);
+			if (!isLocal(target->label, reg))
+				storeName(target->label, dest);
+		}
+		else
+		{
+			uint16_t object = compileAttributeOwner(target);
+			uint32_t attr = program.attrId(target->children.back()->label);
+			uint16_t current = allocTemp();
+			emit(Op::GETATTR, current, object, static_cast<uint16_t>(attr));
+			uint16_t rhs = compileExpr(values[0]);
+			emit(it->second, current, current, rhs);
+			emit(Op::SETATTR, object, static_cast<uint16_t>(attr), current);
+		}
+		return;
+	}
+
+	if (targets.size() == 1)
+	{
+		storeTarget(targets[0], values[0], nullptr);
+		return;
+	}
+	vector<uint16_t> temps;
+	for (ParseTreeNode *value : values)
+	{
+		uint16_t t = allocTemp();
+		compileInto(value, t);
+		temps.push_back(t);
+	}
+	for (size_t k = 0; k < targets.size(); k++)
+		storeTarget(targets[k], nullptr, &temps[k]);
+}
+
+void BytecodeCompiler::storeTarget(ParseTreeNode *target, ParseTreeNode *value, const uint16_t *reg)
+{
+	if (isLeaf(target))
+	{
+		if (value)
+			assignExpr(target->label, value);
+		else
+			storeName(target->label, *reg);
+		return;
+	}
+	uint16_t object = compileAttributeOwner(target);
+	uint16_t src = value ? compileExpr(value) : *reg;
+	emit(Op::SETATTR, object, static_cast<uint16_t>(program.attrId(target->children.back()->label)), src);
+}
+
+uint16_t BytecodeCompiler::compileAttributeOwner(ParseTreeNode *dotted)
+{
+	const auto &parts = dotted->children;
+	uint16_t r = loadName(parts[0]->label);
+	for (size_t k = 2; k + 2 < parts.size(); k += 2)
+	{
+		uint16_t t = isTemp(r) ? r : allocTemp();
+		emit(Op::GETATTR, t, r, static_cast<uint16_t>(program.attrId(parts[k]->label)));
+		r = t;
+	}
+	return r;
+}
+
+size_t BytecodeCompiler::compileBranchIfFalse(ParseTreeNode *cond)
+{
+	// "a < b" feeds straight into a fused compare-and-branch
+	ParseTreeNode *comparison = cond;
+	while (comparison->children.size() == 1 && comparison->label != "comparison")
+		comparison = comparison->children[0];
+	if (cond->folded.empty() && comparison->label == "comparison" && comparison->children.size() == 3 &&
+		comparison->children[1]->children.size() == 1 && comparison->children[1]->children[0]->label == "<")
+	{
+		uint16_t left = compileExpr(comparison->children[0]);
+		uint16_t right = compileExpr(comparison->children[2]);
+		emit(Op::LTJMPIFNOT, 0, left, right);
+		return emitBx(Op::EXTRA, 0, 0);
+	}
+	uint16_t r = toRegister(compileExpr(cond));
+	return emitBx(Op::JMPIFNOT, r, 0);
+}
+
+void BytecodeCompiler::compileConditional(ParseTreeNode *node)
+{
+	vector<size_t> endJumps;
+	auto clause = [&](ParseTreeNode *cond, ParseTreeNode *block) -> bool
+	{
+		bool truth;
+		if (cond && foldedTruth(cond, truth))
+		{
+			if (!truth)
+				return false; // branch can never run
+			compileStatements(block);
+			return true; // later clauses are unreachable
+		}
+		size_t skip = cond ? compileBranchIfFalse(cond) : SIZE_MAX;
+		compileBranch(block);
+		if (skip != SIZE_MAX)
+		{
+			endJumps.push_back(emitBx(Op::JMP, 0, 0));
+			patchHere(skip);
+		}
+		return !cond;
+	};
+
+	bool done = clause(node->children[1], node->children[3]);
+	for (size_t k = 4; k < node->children.size() && !done; k++)
+	{
+		ParseTreeNode *part = node->children[k];
+		if (part->label == "elif_clause")
+			done = clause(part->children[1], part->children[3]);
+		else if (part->label == "else_clause")
+			done = clause(nullptr, part->children[2]);
+	}
+	uint32_t end = markLabel();
+	for (size_t jump : endJumps)
+		patch(jump, end);
+}
+
+void BytecodeCompiler::compileWhile(ParseTreeNode *node)
+{
+	bool truth;
+	bool constant = foldedTruth(node->children[1], truth);
+	if (constant && !truth)
+		return;
+	uint32_t top = markLabel();
+	size_t exitJump = constant ? SIZE_MAX : compileBranchIfFalse(node->children[1]);
+	fn->loops.push_back({top, {}, fn->regions.size()});
+	compileBranch(node->children[3]);
+	emitBx(Op::JMP, 0, top);
+	uint32_t end = markLabel();
+	if (exitJump != SIZE_MAX)
+		patch(exitJump, end);
+	for (size_t jump : fn->loops.back().breakJumps)
+		patch(jump, end);
+	fn->loops.pop_back();
+}
+
+void BytecodeCompiler::compileFor(ParseTreeNode *node)
+{
+	uint16_t iterable = toRegister(compileExpr(node->children[3]));
+	uint16_t iter = allocTemp();
+	emit(Op::ITER, iter, iterable);
+	const string &name = node->children[1]->label;
+	uint16_t reg;
+	bool local = isLocal(name, reg);
+	uint16_t target = local ? reg : allocTemp();
+
+	uint32_t top = markLabel();
+	emit(Op::FORITER, target, iter);
+	size_t exitJump = emitBx(Op::EXTRA, 0, 0);
+	unordered_set<string> before = fn->assigned;
+	if (local)
+		fn->assigned.insert(name);
+	else
+		storeName(name, target);
+	fn->loops.push_back({top, {}, fn->regions.size()});
+	compileStatements(node->children[5]);
+	fn->assigned = move(before);
+	emitBx(Op::JMP, 0, top);
+	uint32_t end = markLabel();
+	patch(exitJump, end);
+	for (size_t jump : fn->loops.back().breakJumps)
+		patch(jump, end);
+	fn->loops.pop_back();
+}
+
+void BytecodeCompiler::pushRegion(ParseTreeNode *finallyBlock)
+{
+	Region region;
+	region.reg = allocTemp();
+	region.openStart = here();
+	region.finallyBlock = finallyBlock;
+	fn->regions.push_back(move(region));
+}
+
+void BytecodeCompiler::closeSegment(Region &region)
+{
+	if (region.open && region.openStart < here())
+		region.segments.push_back({region.openStart, here()});
+	region.open = false;
+}
+
+BytecodeCompiler::Region BytecodeCompiler::popRegion(uint32_t handlerTarget)
+{
+	Region region = move(fn->regions.back());
+	fn->regions.pop_back();
+	closeSegment(region);
+	for (auto &[start, end] : region.segments)
+		fn->code->handlers.push_back({start, end, handlerTarget, region.reg});
+	return region;
+}
+
+void BytecodeCompiler::exitRegions(size_t depth)
+{
+	vector<Region> saved;
+	for (size_t k = fn->regions.size(); k > depth; k--)
+	{
+		closeSegment(fn->regions[k - 1]);
+		if (fn->regions[k - 1].finallyBlock)
+		{
+			// Compile the finally body as if the inner regions were gone
+			vector<Region> inner(make_move_iterator(fn->regions.begin() + k),
+								 make_move_iterator(fn->regions.end()));
+			fn->regions.resize(k);
+			Region self = move(fn->regions.back());
+			fn->regions.pop_back();
+			compileStatements(self.finallyBlock);
+			fn->regions.push_back(move(self));
+			for (Region &r : inner)
+				fn->regions.push_back(move(r));
+		}
+	}
+}
+
+void BytecodeCompiler::reopenRegions(size_t depth)
+{
+	for (size_t k = depth; k < fn->regions.size(); k++)
+	{
+		fn->regions[k].open = true;
+		fn->regions[k].openStart = here();
+	}
+}
+
+void BytecodeCompiler::compileTry(ParseTreeNode *node)
+{
+	ParseTreeNode *body = node->children[2];
+	vector<ParseTreeNode *> excepts, elses;
+	ParseTreeNode *finallyClause = nullptr;
+	for (size_t k = 3; k < node->children.size(); k++)
+	{
+		ParseTreeNode *part = node->children[k];
+		if (part->label == "except_clause")
+			excepts.push_back(part);
+		else if (part->label == "else_clause")
+			elses.push_back(part);
+		else if (part->label == "finally_clause")
+			finallyClause = part;
+	}
+	ParseTreeNode *finallyBlock = finallyClause ? finallyClause->children[2] : nullptr;
+
+	if (finallyBlock)
+		pushRegion(finallyBlock);
+	if (!excepts.empty())
+	{
+		pushRegion(nullptr);
+		compileBranch(body);
+		Region handlers = popRegion(0);
+		size_t handlerStart = fn->code->handlers.size() - handlers.segments.size();
+
+		for (ParseTreeNode *clause : elses)
+			compileBranch(clause->children[2]);
+		vector<size_t> doneJumps = {emitBx(Op::JMP, 0, 0)};
+
+		uint32_t target = markLabel();
+		for (size_t h = handlerStart; h < fn->code->handlers.size(); h++)
+			fn->code->handlers[h].target = target;
+		for (ParseTreeNode *clause : excepts)
+		{
+			const auto &c = clause->children;
+			size_t nextClause = SIZE_MAX;
+			if (c.size() > 3)
+			{
+				// except Name [as alias]:
+				uint16_t mark = fn->tempTop;
+				uint16_t cls = loadName(c[1]->label);
+				uint16_t matched = allocTemp();
+				emit(Op::EXCMATCH, matched, handlers.reg, cls);
+				nextClause = emitBx(Op::JMPIFNOT, matched, 0);
+				fn->tempTop = mark;
+				if (c.size() > 4 && c[2]->label == "as")
+					storeName(c[3]->label, handlers.reg);
+			}
+			compileBranch(c.back());
+			doneJumps.push_back(emitBx(Op::JMP, 0, 0));
+			if (nextClause != SIZE_MAX)
+				patchHere(nextClause);
+		}
+		emit(Op::RERAISE, handlers.reg);
+		uint32_t done = markLabel();
+		for (size_t jump : doneJumps)
+			patch(jump, done);
+	}
+	else
+	{
+		compileStatements(body);
+	}
+
+	if (finallyBlock)
+	{
+		Region region = popRegion(0);
+		size_t handlerStart = fn->code->handlers.size() - region.segments.size();
+		compileStatements(finallyBlock);
+		size_t skip = emitBx(Op::JMP, 0, 0);
+		uint32_t target = markLabel();
+		for (size_t h = handlerStart; h < fn->code->handlers.size(); h++)
+			fn->code->handlers[h].target = target;
+		compileBranch(finallyBlock);
+		emit(Op::RERAISE, region.reg);
+		patchHere(skip);
+	}
+}
+
+uint16_t BytecodeCompiler::compileFunction(ParseTreeNode *node)
+{
+	const string &name = node->children[1]->label;
+	ParseTreeNode *params = node->children[3];
+	ParseTreeNode *body = node->children.back();
+
+	vector<ParseTreeNode *> paramNodes;
+	for (ParseTreeNode *param : params->children)
+		if (param->label == "parameter")
+			paramNodes.push_back(param);
+
+	// Defaults are evaluated in the defining scope, into consecutive registers
+	uint16_t numDefaults = 0;
+	uint16_t firstDefault = fn->tempTop;
+	for (ParseTreeNode *param : paramNodes)
+	{
+		if (param->children.size() == 3)
+		{
+			compileInto(param->children[2], allocTemp());
+			numDefaults++;
+		}
+		else if (numDefaults > 0)
+			throw CompileError("non-default parameter follows default parameter in '" + name + "'");
+	}
+
+	auto code = make_unique<CodeObject>();
+	code->name = name;
+	code->numParams = static_cast<uint16_t>(paramNodes.size());
+	code->numDefaults = numDefaults;
+	CodeObject *codePtr = code.get();
+	uint16_t codeIndex = static_cast<uint16_t>(program.codes.size());
+	program.codes.push_back(move(code));
+
+	FunctionState state;
+	state.code = codePtr;
+	for (ParseTreeNode *param : paramNodes)
+	{
+		const string &paramName = param->children[0]->label;
+		if (state.locals.count(paramName))
+			throw CompileError("duplicate argument '" + paramName + "' in function '" + name + "'");
+		state.locals[paramName] = state.numLocals++;
+		state.assigned.insert(paramName);
+	}
+	unordered_set<string> bound;
+	collectBoundNames(body, bound);
+	vector<string> sortedNames(bound.begin(), bound.end());
+	sort(sortedNames.begin(), sortedNames.end());
+	for (const string &local : sortedNames)
+		if (state.locals.emplace(local, state.numLocals).second)
+			state.numLocals++;
+	state.tempTop = state.maxRegisters = state.numLocals;
+
+	FunctionState *outer = fn;
+	fn = &state;
+	compileStatements(body);
+	emit(Op::LOADNONE, 0);
+	emit(Op::RETURN, 0);
+	finish(state);
+	fn = outer;
+
+	uint16_t dest = allocTemp();
+	emit(Op::MAKEFUNC, dest, codeIndex, numDefaults ? firstDefault : NO_REG);
+	return dest;
+}
+
+void BytecodeCompiler::compileClass(ParseTreeNode *node)
+{
+	const auto &c = node->children;
+	const string &name = c[1]->label;
+	uint16_t base = NO_REG;
+	if (c.size() > 4 && c[2]->label == "(")
+		base = toRegister(loadName(c[3]->label));
+	uint16_t cls = allocTemp();
+	emit(Op::MAKECLASS, cls, addConstant(makeString(name)), base);
+
+	for (ParseTreeNode *member : c.back()->children)
+	{
+		uint16_t mark = fn->tempTop;
+		if (member->label == "function")
+		{
+			uint16_t f = compileFunction(member);
+			emit(Op::SETATTR, cls, static_cast<uint16_t>(program.attrId(member->children[1]->label)), f);
+		}
+		else if (member->label == "assignment")
+		{
+			ParseTreeNode *lhs = member->children[0];
+			ParseTreeNode *rhs = member->children[2];
+			vector<ParseTreeNode *> targets, values;
+			for (ParseTreeNode *t : lhs->children)
+				if (t->label != ",")
+					targets.push_back(t);
+			for (ParseTreeNode *v : rhs->children)
+				if (v->label == "expression")
+					values.push_back(v);
+			for (size_t k = 0; k < targets.size() && k < values.size(); k++)
+			{
+				if (!isLeaf(targets[k]))
+					throw CompileError("attribute assignment in class body of '" + name + "'");
+				uint16_t v = compileExpr(values[k]);
+				emit(Op::SETATTR, cls, static_cast<uint16_t>(program.attrId(targets[k]->label)), v);
+			}
+		}
+		fn->tempTop = mark;
+	}
+	storeName(name, cls);
+}
+
+void BytecodeCompiler::compileImport(ParseTreeNode *node)
+{
+	ImportParts imported = splitImport(node);
+	if (imported.star)
+		throw CompileError("'from ... import *' is not supported");
+	uint16_t module = 0;
+	if (!imported.from.empty())
+	{
+		module = allocTemp();
+		emitBx(Op::IMPORT, module, addConstant(makeString(imported.from)));
+	}
+	for (const auto &[source, bound] : imported.bindings)
+	{
+		uint16_t r = allocTemp();
+		if (imported.from.empty())
+			emitBx(Op::IMPORT, r, addConstant(makeString(source)));
+		else
+			emit(Op::GETATTR, r, module, static_cast<uint16_t>(program.attrId(source)));
+		storeName(bound, r);
+	}
+}
+
+uint16_t BytecodeCompiler::compileCallParts(ParseTreeNode *callee, ParseTreeNode *arguments)
+{
+	vector<ParseTreeNode *> args;
+	if (arguments)
+		for (ParseTreeNode *arg : arguments->children)
+			if (arg->label == "expression")
+				args.push_back(arg);
+
+	bool method = !isLeaf(callee);
+	uint16_t base = allocTemp(static_cast<uint16_t>(args.size() + 1));
+	if (method)
+		moveInto(compileAttributeOwner(callee), base);
+	else
+		moveInto(loadName(callee->label), base);
+	fn->tempTop = base + 1;
+	for (size_t k = 0; k < args.size(); k++)
+	{
+		compileInto(args[k], static_cast<uint16_t>(base + 1 + k));
+		fn->tempTop = static_cast<uint16_t>(base + 2 + k);
+	}
+	if (method)
+	{
+		emit(Op::CALLMETHOD, base, base, static_cast<uint16_t>(args.size()));
+		emitBx(Op::EXTRA, 0, program.attrId(callee->children.back()->label));
+	}
+	else
+	{
+		emit(Op::CALL, base, base, static_cast<uint16_t>(args.size()));
+	}
+	fn->tempTop = base + 1;
+	return base;
+}
+
+uint16_t BytecodeCompiler::compileCall(ParseTreeNode *node)
+{
+	ParseTreeNode *arguments = nullptr;
+	for (ParseTreeNode *part : node->children)
+		if (part->label == "arguments")
+			arguments = part;
+	return compileCallParts(node->children[0], arguments);
+}
+
+uint16_t BytecodeCompiler::resultRegister(uint16_t left)
+{
+	return isTemp(left) ? left : allocTemp();
+}
+
+uint16_t BytecodeCompiler::compileExpr(ParseTreeNode *node)
+{
+	const string &label = node->label;
+	const auto &c = node->children;
+
+	if (label == "expression")
+	{
+		ConstValue folded;
+		if (!node->folded.empty() && parseLiteral(node->folded, folded))
+			return constantOperand(constToValue(folded));
+		return compileExpr(c[0]);
+	}
+	if (label == "or_expression" || label == "and_expression")
+	{
+		if (c.size() == 1)
+			return compileExpr(c[0]);
+		uint16_t result = allocTemp();
+		compileInto(c[0], result);
+		vector<size_t> jumps;
+		for (size_t k = 2; k < c.size(); k += 2)
+		{
+			jumps.push_back(emitBx(label == "or_expression" ? Op::JMPIF : Op::JMPIFNOT, result, 0));
+			compileInto(c[k], result);
+		}
+		uint32_t end = markLabel();
+		for (size_t jump : jumps)
+			patch(jump, end);
+		return result;
+	}
+	if (label == "not_expression")
+	{
+		if (c.size() == 1)
+			return compileExpr(c[0]);
+		uint16_t operand = compileExpr(c[1]);
+		uint16_t dest = resultRegister(operand);
+		emit(Op::NOT, dest, operand);
+		return dest;
+	}
+	if (label == "comparison")
+		return compileComparison(node);
+	if (label == "arithmetic" || label == "term")
+	{
+		uint16_t acc = compileExpr(c[0]);
+		for (size_t k = 1; k + 1 < c.size(); k += 2)
+		{
+			uint16_t right = compileExpr(c[k + 1]);
+			uint16_t dest = isTemp(acc) ? acc : (isTemp(right) ? right : allocTemp());
+			emit(binaryOpFor(c[k]->label), dest, acc, right);
+			acc = dest;
+		}
+		return acc;
+	}
+	if (label == "factor")
+		return compileFactor(node);
+	throw CompileError("unsupported expression '" + label + "'");
+}
+
+uint16_t BytecodeCompiler::compileComparison(ParseTreeNode *node)
+{
+	const auto &c = node->children;
+	uint16_t left = compileExpr(c[0]);
+	if (c.size() == 1)
+		return left;
+	// a < b < c evaluates b once and stops at the first false link
+	uint16_t result = NO_REG;
+	vector<size_t> shortCircuits;
+	for (size_t k = 1; k + 1 < c.size(); k += 2)
+	{
+		string opText = comparisonOperator(c[k]);
+		if (opText.empty())
+			throw CompileError("unsupported operator in comparison");
+		Op op = binaryOpFor(opText);
+		uint16_t right = compileExpr(c[k + 1]);
+		if (!isComparisonOp(op))
+		{
+			uint16_t dest = isTemp(left) ? left : allocTemp();
+			emit(op, dest, left, right);
+			left = dest;
+			continue;
+		}
+		if (result == NO_REG)
+			result = allocTemp();
+		else
+			shortCircuits.push_back(emitBx(Op::JMPIFNOT, result, 0));
+		emit(op, result, left, right);
+		left = right;
+	}
+	if (result == NO_REG)
+		return left;
+	uint32_t end = markLabel();
+	for (size_t jump : shortCircuits)
+		patch(jump, end);
+	return result;
+}
+
+uint16_t BytecodeCompiler::buildSequence(Op op, const vector<ParseTreeNode *> &items)
+{
+	uint16_t base = allocTemp(static_cast<uint16_t>(max<size_t>(items.size(), 1)));
+	for (size_t k = 0; k < items.size(); k++)
+	{
+		fn->tempTop = static_cast<uint16_t>(base + k);
+		compileInto(items[k], static_cast<uint16_t>(base + k));
+	}
+	fn->tempTop = base + 1;
+	emit(op, base, base, static_cast<uint16_t>(op == Op::BUILDDICT ? items.size() / 2 : items.size()));
+	return base;
+}
+
+uint16_t BytecodeCompiler::compileFactor(ParseTreeNode *node)
+{
+	const auto &c = node->children;
+	ParseTreeNode *first = c[0];
+
+	if (isLeaf(first) && c.size() == 1)
+	{
+		const string &lexeme = first->label;
+		ConstValue literal;
+		if (classifyLeaf(lexeme) == LeafKind::Name)
+			return loadName(lexeme);
+		if (!parseLiteral(lexeme, literal))
+			throw CompileError("integer literal too large: " + lexeme);
+		return constantOperand(constToValue(literal));
+	}
+	if (isLeaf(first) && c.size() == 2 && c[1]->label == "factor")
+	{
+		static const unordered_map<string, Op> unary = {
+			{"-", Op::NEG}, {"+", Op::POS}, {"~", Op::INVERT}, {"not", Op::NOT}};
+		uint16_t operand = compileExpr(c[1]);
+		uint16_t dest = resultRegister(operand);
+		emit(unary.at(first->label), dest, operand);
+		return dest;
+	}
+	if (c.size() > 1 && c[1]->label == "(")
+	{
+		ParseTreeNode *arguments = c.size() > 3 ? c[2] : nullptr;
+		return compileCallParts(first, arguments);
+	}
+	if (first->label == "dotted_name")
+	{
+		uint16_t owner = compileAttributeOwner(first);
+		uint16_t dest = resultRegister(owner);
+		emit(Op::GETATTR, dest, owner, static_cast<uint16_t>(program.attrId(first->children.back()->label)));
+		return dest;
+	}
+
+	vector<ParseTreeNode *> items;
+	bool hasComma = false;
+	for (ParseTreeNode *part : first->children)
+	{
+		if (part->label == "expression")
+			items.push_back(part);
+		hasComma = hasComma || part->label == ",";
+	}
+	if (first->label == "tuple_or_group")
+	{
+		if (items.size() == 1 && !hasComma)
+			return compileExpr(items[0]);
+		return buildSequence(Op::BUILDTUPLE, items);
+	}
+	if (first->label == "list_literal")
+		return buildSequence(Op::BUILDLIST, items);
+	if (first->label == "set_literal")
+		return buildSequence(Op::BUILDSET, items);
+	if (first->label == "dict_literal")
+		return buildSequence(Op::BUILDDICT, items);
+	throw CompileError("unsupported factor '" + first->label + "'");
+}
+
+void disassemble(const Program &program, ostream &out)
+{
+	for (const auto &code : program.codes)
+	{
+		out << "code " << code->name << " (params " << code->numParams << ", registers "
+			<< code->numRegisters << ", constants " << code->constants.size() << ")\n";
+		for (size_t k = 0; k < code->constants.size(); k++)
+			out << "    K" << k << " = " << valueToString(code->constants[k], true) << "\n";
+		for (const ExceptionHandler &h : code->handlers)
+			out << "    handler [" << h.start << ", " << h.end << ") -> " << h.target << " in R" << h.reg << "\n";
+		for (size_t pc = 0; pc < code->code.size(); pc++)
+		{
+			const Instr &in = code->code[pc];
+			out << "    " << pc << "\t" << opName(in.op) << "\t" << in.a << " " << in.b << " " << in.c << "\n";
+		}
+	}
+}
+} // namespace pyc::detail
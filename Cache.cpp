@@ -0,0 +1,727 @@
+#include "Tools.h"
+#ifdef __unix__
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#endif
+
+namespace pyc::detail
+{
+// ----------------------------------------------
+// Front-end cache
+// ----------------------------------------------
+// --cache=DIR keeps the output of the front end - tokens, lexer errors,
+// symbol table, folded tree and syntax diagnostics - in one binary image
+// per source, named after the source's content hash and the front-end
+// version. A hit maps the image instead of lexing and parsing; when only
+// the counts are needed (batch without reports) the header alone answers.
+// The directory is bounded by --cache-size: the least recently used images
+// are deleted first, with recency kept in the files' mtimes so that it
+// survives between runs and is shared by processes using the same directory.
+
+uint64_t contentHash(const string &s)
+{
+	uint64_t h = 14695981039346656037ull;
+	for (unsigned char c : s)
+	{
+		h ^= c;
+		h *= 1099511628211ull;
+	}
+	return h;
+}
+
+// Change whenever tokens, symbols, trees or diagnostics come out differently
+const char *const frontEndVersion = "pyc front end 2";
+
+const char cacheImageMagic[8] = {'P', 'Y', 'C', 'C', 'A', 'C', 'H', 'E'};
+
+// FNV-1a over 8-byte words, with the high half folded back in after each
+// step. Each step is a bijection, so any single damaged word changes the
+// result; a word at a time keeps it cheap next to decoding the image.
+uint64_t imageChecksum(string_view bytes)
+{
+	uint64_t h = 14695981039346656037ull;
+	size_t k = 0;
+	for (; k + 8 <= bytes.size(); k += 8)
+	{
+		uint64_t word;
+		memcpy(&word, bytes.data() + k, 8);
+		h = (h ^ word) * 1099511628211ull;
+		h ^= h >> 32;
+	}
+	for (; k < bytes.size(); k++)
+		h = (h ^ (unsigned char)bytes[k]) * 1099511628211ull;
+	return h;
+}
+
+void appendVarint(string &out, uint64_t value)
+{
+	while (value >= 0x80)
+	{
+		out += char(value | 0x80);
+		value >>= 7;
+	}
+	out += char(value);
+}
+
+// Sequential reader over the records of an image
+class CacheImageReader
+{
+public:
+	CacheImageReader(const char *begin, const char *end, const char *damaged = "damaged front-end cache image")
+		: p(begin), limit(end), damaged(damaged) {}
+
+	uint64_t varint()
+	{
+		uint64_t value = 0;
+		for (int shift = 0; shift < 64; shift += 7)
+		{
+			if (p == limit)
+				break;
+			unsigned char byte = *p++;
+			value |= uint64_t(byte & 0x7f) << shift;
+			if (!(byte & 0x80))
+				return value;
+		}
+		throw runtime_error(damaged);
+	}
+
+	string_view bytes(size_t size)
+	{
+		if (size_t(limit - p) < size)
+			throw runtime_error(damaged);
+		string_view view(p, size);
+		p += size;
+		return view;
+	}
+
+	bool atEnd() const { return p == limit; }
+
+private:
+	const char *p;
+	const char *limit;
+	const char *damaged;
+};
+
+// Numbers distinct strings in order of first appearance. Open addressing
+// over indices: a tree repeats a few dozen labels tens of thousands of
+// times, and node-based maps made interning cost as much as parsing.
+class CacheStringPool
+{
+public:
+	// Index of 's'; a new one is also appended to 'table'. The pool keeps a view of 's'.
+	uint32_t intern(string_view s, string &table)
+	{
+		if (strings.size() * 2 >= slots.size())
+			grow();
+		size_t mask = slots.size() - 1;
+		for (size_t slot = hash<string_view>()(s) & mask;; slot = (slot + 1) & mask)
+		{
+			uint32_t entry = slots[slot];
+			if (entry == 0)
+			{
+				strings.push_back(s);
+				slots[slot] = uint32_t(strings.size());
+				appendVarint(table, s.size());
+				table.append(s.data(), s.size());
+				return uint32_t(strings.size() - 1);
+			}
+			if (strings[entry - 1] == s)
+				return entry - 1;
+		}
+	}
+
+	void clear()
+	{
+		strings.clear();
+		fill(slots.begin(), slots.end(), 0);
+	}
+
+	size_t size() const { return strings.size(); }
+
+private:
+	void grow()
+	{
+		slots.assign(max<size_t>(1024, slots.size() * 2), 0);
+		size_t mask = slots.size() - 1;
+		for (size_t k = 0; k < strings.size(); k++)
+		{
+			size_t slot = hash<string_view>()(strings[k]) & mask;
+			while (slots[slot] != 0)
+				slot = (slot + 1) & mask;
+			slots[slot] = uint32_t(k + 1);
+		}
+	}
+
+	vector<string_view> strings;
+	vector<uint32_t> slots; // index + 1, or 0 when free
+};
+
+void encodeCacheImage(const CompileResult &result, uint64_t sourceHash, size_t sourceSize, string &image)
+{
+	// The pool views the strings of 'result', which outlive the encoding
+	static thread_local string table, records;
+	static thread_local CacheStringPool pooled;
+	table.clear();
+	records.clear();
+	pooled.clear();
+	auto reference = [&](string_view s)
+	{ appendVarint(records, pooled.intern(s, table)); };
+
+	for (const Token &t : result.tokens)
+	{
+		appendVarint(records, uint32_t(t.type));
+		appendVarint(records, uint32_t(t.lineNumber));
+		reference(t.lexeme);
+		reference(t.scope);
+	}
+	for (const Error &e : result.lexErrors)
+	{
+		reference(e.message);
+		appendVarint(records, uint32_t(e.line));
+		appendVarint(records, e.position);
+	}
+	for (const auto &[key, info] : result.symbols.table)
+	{
+		reference(key);
+		reference(info.type);
+		reference(info.scope);
+		reference(info.value);
+		appendVarint(records, uint32_t(info.entry));
+		appendVarint(records, uint32_t(info.firstAppearance + 1)); // -1 when never seen
+		appendVarint(records, uint32_t(info.usageCount));
+	}
+	size_t nodes = 0;
+	vector<const ParseTreeNode *> stack;
+	if (result.tree)
+		stack.push_back(result.tree);
+	while (!stack.empty())
+	{
+		const ParseTreeNode *node = stack.back();
+		stack.pop_back();
+		reference(node->label);
+		reference(node->folded);
+		appendVarint(records, node->children.size());
+		stack.insert(stack.end(), node->children.rbegin(), node->children.rend());
+		nodes++;
+	}
+
+	CacheImageHeader header{};
+	memcpy(header.magic, cacheImageMagic, sizeof(header.magic));
+	header.version = contentHash(frontEndVersion);
+	header.sourceHash = sourceHash;
+	header.sourceSize = sourceSize;
+	header.imageSize = sizeof(header) + table.size() + records.size() + result.diagnostics.size();
+	header.tokens = uint32_t(result.tokens.size());
+	header.lexErrors = uint32_t(result.lexErrors.size());
+	header.symbols = uint32_t(result.symbols.table.size());
+	header.nodes = uint32_t(nodes);
+	header.syntaxErrors = uint32_t(result.syntaxErrors);
+	header.strings = uint32_t(pooled.size());
+	header.diagnosticsSize = result.diagnostics.size();
+
+	image.clear();
+	image.reserve(header.imageSize);
+	image.append(reinterpret_cast<const char *>(&header), sizeof(header));
+	image += table;
+	image += records;
+	image += result.diagnostics;
+	uint64_t checksum = imageChecksum(string_view(image).substr(sizeof(header)));
+	memcpy(&image[offsetof(CacheImageHeader, checksum)], &checksum, sizeof(checksum));
+}
+
+const CacheImageHeader *cacheImageHeader(string_view image)
+{
+	if (image.size() < sizeof(CacheImageHeader))
+		return nullptr;
+	const CacheImageHeader *header = reinterpret_cast<const CacheImageHeader *>(image.data());
+	if (memcmp(header->magic, cacheImageMagic, sizeof(header->magic)) != 0 ||
+		header->version != contentHash(frontEndVersion) || header->imageSize != image.size())
+		return nullptr;
+	return header;
+}
+
+CompileResult CompilerSession::restore(string_view image)
+{
+	reset();
+	source.clear();
+	const CacheImageHeader *found = cacheImageHeader(image);
+	if (!found)
+		throw runtime_error("damaged front-end cache image");
+	const CacheImageHeader &header = *found;
+	// Every record takes at least a byte per field, so counts the payload
+	// cannot hold are damage, caught before anything is allocated for them
+	string_view payload = image.substr(sizeof(header));
+	if (header.diagnosticsSize > payload.size() || imageChecksum(payload) != header.checksum)
+		throw runtime_error("damaged front-end cache image");
+	uint64_t records = payload.size() - header.diagnosticsSize;
+	uint64_t smallest = uint64_t(header.strings) + 4 * uint64_t(header.tokens) + 3 * uint64_t(header.lexErrors) +
+						7 * uint64_t(header.symbols) + 3 * uint64_t(header.nodes);
+	if (smallest > records)
+		throw runtime_error("damaged front-end cache image");
+	CacheImageReader in(payload.data(), payload.data() + records);
+	static thread_local vector<string_view> table;
+	table.clear();
+	for (uint32_t k = 0; k < header.strings; k++)
+		table.push_back(in.bytes(in.varint()));
+	auto text = [&in]
+	{
+		uint64_t index = in.varint();
+		if (index >= table.size())
+			throw runtime_error("damaged front-end cache image");
+		return table[index];
+	};
+
+	vector<Token> &tokens = analyzer.tokens;
+	tokens.resize(header.tokens);
+	for (Token &t : tokens)
+	{
+		t.type = TokenType(in.varint());
+		t.lineNumber = int(in.varint());
+		t.lexeme.assign(text());
+		t.scope.assign(text());
+	}
+	for (uint32_t k = 0; k < header.lexErrors; k++)
+	{
+		string message(text());
+		int line = int(in.varint());
+		errors.push_back({move(message), line, size_t(in.varint())});
+	}
+	for (uint32_t k = 0; k < header.symbols; k++)
+	{
+		string_view key = text();
+		SymbolTable::SymbolInfo info;
+		info.type.assign(text());
+		info.scope.assign(text());
+		info.value.assign(text());
+		info.entry = int(in.varint());
+		info.firstAppearance = int(in.varint()) - 1;
+		info.usageCount = int(in.varint());
+		symbols.nextEntry = max(symbols.nextEntry, info.entry + 1);
+		symbols.table.emplace(key, move(info));
+	}
+
+	// A node is complete once it has as many children as its record says
+	vector<pair<ParseTreeNode *, uint64_t>> open;
+	for (uint32_t k = 0; k < header.nodes; k++)
+	{
+		ParseTreeNode *node = arena.make(text());
+		node->folded.assign(text());
+		uint64_t children = in.varint();
+		if (open.empty())
+			root = node;
+		else
+		{
+			open.back().first->addChild(node);
+			if (--open.back().second == 0)
+				open.pop_back();
+		}
+		if (children > 0)
+			open.push_back({node, children});
+	}
+	if (!open.empty() || !in.atEnd())
+		throw runtime_error("damaged front-end cache image");
+	diagnosticsText.assign(image.data() + image.size() - header.diagnosticsSize, header.diagnosticsSize);
+	return {analyzer.tokens, errors, symbols, root, int(header.syntaxErrors), diagnosticsText};
+}
+
+bool MappedFile::open(const string &path)
+{
+	unmap();
+#ifdef __unix__
+	int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return false;
+	struct stat info;
+	if (fstat(fd, &info) == 0 && info.st_size > 0)
+	{
+		void *address = mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+		if (address != MAP_FAILED)
+		{
+			mapped = static_cast<const char *>(address);
+			length = size_t(info.st_size);
+		}
+	}
+	close(fd);
+	return mapped != nullptr;
+#else
+	ifstream in(path, ios::binary);
+	copy.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+	mapped = copy.data();
+	length = copy.size();
+	return bool(in) || in.eof();
+#endif
+}
+
+void MappedFile::unmap()
+{
+#ifdef __unix__
+	if (mapped)
+		munmap(const_cast<char *>(mapped), length);
+#endif
+	mapped = nullptr;
+	length = 0;
+}
+
+FrontEndCache::FrontEndCache(const string &directory, uintmax_t capacityBytes) : dir(directory), capacity(capacityBytes)
+{
+	filesystem::create_directories(dir);
+	// Oldest first, so that pushing each to the front leaves the newest there
+	vector<tuple<filesystem::file_time_type, uint64_t, uintmax_t>> found;
+	error_code ec;
+	for (const auto &entry : filesystem::directory_iterator(dir, ec))
+	{
+		string name = entry.path().filename().string();
+		if (entry.path().extension() != ".pyc" || name.size() != 20)
+			continue;
+		if (name.find_first_not_of("0123456789abcdef") != 16)
+			continue;
+		found.emplace_back(entry.last_write_time(ec), stoull(name.substr(0, 16), nullptr, 16), entry.file_size(ec));
+	}
+	sort(found.begin(), found.end());
+	for (const auto &[time, key, size] : found)
+		insertEntry(key, size);
+	evict();
+}
+
+bool FrontEndCache::find(uint64_t sourceHash, size_t sourceSize, MappedFile &image)
+{
+	uint64_t key = keyOf(sourceHash);
+	{
+		lock_guard<mutex> guard(lock);
+		auto it = entries.find(key);
+		if (it == entries.end())
+		{
+			misses++;
+			return false;
+		}
+		order.splice(order.begin(), order, it->second);
+	}
+	const CacheImageHeader *header = image.open(pathOf(key)) ? cacheImageHeader(image.view()) : nullptr;
+	if (!header || header->sourceHash != sourceHash || header->sourceSize != sourceSize)
+	{
+		// Damaged, or removed by another process; forget it
+		lock_guard<mutex> guard(lock);
+		removeEntry(key);
+		misses++;
+		return false;
+	}
+	error_code ec;
+	filesystem::last_write_time(pathOf(key), filesystem::file_time_type::clock::now(), ec);
+	hits++;
+	return true;
+}
+
+void FrontEndCache::store(uint64_t sourceHash, size_t sourceSize, const CompileResult &result)
+{
+	static thread_local string image;
+	encodeCacheImage(result, sourceHash, sourceSize, image);
+	if (image.size() > capacity)
+		return;
+	uint64_t key = keyOf(sourceHash);
+	string path = pathOf(key);
+	ostringstream suffix;
+	suffix << ".tmp." << this_thread::get_id();
+	string temporary = path + suffix.str();
+	{
+		ofstream out(temporary, ios::binary);
+		out.write(image.data(), image.size());
+		if (!out)
+			return; // a full disk only costs the cache
+	}
+	error_code ec;
+	filesystem::rename(temporary, path, ec);
+	if (ec)
+		return;
+	lock_guard<mutex> guard(lock);
+	removeEntry(key);
+	insertEntry(key, image.size());
+	stores++;
+	evict();
+}
+
+void FrontEndCache::printStats(ostream &out) const
+{
+	ostringstream line;
+	line << "  cache: " << hits << " hits, " << misses << " misses, " << stores << " stored, " << evictions
+		 << " evicted, " << fixed << setprecision(1) << used / 1048576.0 << " of " << capacity / 1048576.0
+		 << " MiB in " << dir << "\n";
+	out << line.str();
+}
+
+void FrontEndCache::discard(uint64_t sourceHash)
+{
+	uint64_t key = keyOf(sourceHash);
+	error_code ec;
+	filesystem::remove(pathOf(key), ec);
+	lock_guard<mutex> guard(lock);
+	removeEntry(key);
+	hits--;
+	misses++;
+}
+
+uint64_t FrontEndCache::keyOf(uint64_t sourceHash)
+{
+	return sourceHash ^ (contentHash(frontEndVersion) * 0x9E3779B97F4A7C15ull);
+}
+
+string FrontEndCache::pathOf(uint64_t key) const
+{
+	char name[24];
+	snprintf(name, sizeof(name), "%016llx.pyc", (unsigned long long)key);
+	return (filesystem::path(dir) / name).string();
+}
+
+void FrontEndCache::insertEntry(uint64_t key, uintmax_t size)
+{
+	order.push_front({key, size});
+	entries[key] = order.begin();
+	used += size;
+}
+
+void FrontEndCache::removeEntry(uint64_t key)
+{
+	auto it = entries.find(key);
+	if (it == entries.end())
+		return;
+	used -= it->second->size;
+	order.erase(it->second);
+	entries.erase(it);
+}
+
+void FrontEndCache::evict()
+{
+	while (used > capacity && !order.empty())
+	{
+		Entry last = order.back();
+		error_code ec;
+		filesystem::remove(pathOf(last.key), ec);
+		removeEntry(last.key);
+		evictions++;
+	}
+}
+
+CompileResult compileCached(CompilerSession &session, const string &source, uint64_t hash, FrontEndCache *cache)
+{
+	if (cache)
+	{
+		MappedFile image;
+		if (cache->find(hash, source.size(), image))
+		{
+			try
+			{
+				return session.restore(image.view());
+			}
+			catch (const exception &)
+			{
+				cache->discard(hash); // recompiled and stored again below
+			}
+		}
+	}
+	CompileResult result = session.compile(source);
+	if (cache && !result.aborted)
+		cache->store(hash, source.size(), result);
+	return result;
+}
+
+// ----------------------------------------------
+// Tree images
+// ----------------------------------------------
+// --save-tree=FILE stores the folded parse tree in a compact binary form
+// that --load-tree=FILE (or loadTreeImage) maps and rebuilds without
+// lexing or parsing anything. After a fixed header come three regions:
+//   strings: every distinct label and folded value once, as a varint
+//            length and the bytes; strings are named by their offset here
+//   kinds:   one varint string offset per distinct label, most frequent
+//            first, so the common node kinds get one-byte numbers
+//   nodes:   in preorder, varint kind, varint child count, and varint
+//            folded value (0 for none, else its string offset + 1)
+// Because names are offsets, a reader of the mapped file can look at any
+// string without decoding the table before it. Like the cache images,
+// the header is written in host byte order.
+struct TreeImageHeader
+{
+	char magic[8];
+	uint64_t nodes;
+	uint64_t kinds;
+	uint64_t stringsSize;
+	uint64_t kindsSize;
+	uint64_t nodesSize;
+};
+
+const char treeImageMagic[8] = {'P', 'Y', 'C', 'T', 'R', 'E', 'E', '1'};
+
+void encodeTreeImage(const ParseTreeNode *root, string &image)
+{
+	string strings, kinds, records;
+	CacheStringPool pooled;
+	vector<uint32_t> offsets; // of each pooled string in 'strings'
+	auto intern = [&](const string &s)
+	{
+		size_t before = strings.size();
+		uint32_t index = pooled.intern(s, strings);
+		if (index == offsets.size())
+			offsets.push_back(uint32_t(before));
+		return index;
+	};
+
+	// First pass: pool the strings and count how often each label occurs
+	vector<const ParseTreeNode *> preorder;
+	vector<uint32_t> labels, uses;
+	vector<const ParseTreeNode *> stack;
+	if (root)
+		stack.push_back(root);
+	while (!stack.empty())
+	{
+		const ParseTreeNode *node = stack.back();
+		stack.pop_back();
+		preorder.push_back(node);
+		uint32_t label = intern(node->label);
+		if (!node->folded.empty())
+			intern(node->folded);
+		labels.push_back(label);
+		if (uses.size() <= label)
+			uses.resize(label + 1, 0);
+		uses[label]++;
+		stack.insert(stack.end(), node->children.rbegin(), node->children.rend());
+	}
+
+	vector<uint32_t> byUse;
+	for (uint32_t k = 0; k < uses.size(); k++)
+		if (uses[k])
+			byUse.push_back(k);
+	stable_sort(byUse.begin(), byUse.end(), [&](uint32_t a, uint32_t b)
+				{ return uses[a] > uses[b]; });
+	vector<uint32_t> kindOf(uses.size());
+	for (uint32_t k = 0; k < byUse.size(); k++)
+	{
+		kindOf[byUse[k]] = k;
+		appendVarint(kinds, offsets[byUse[k]]);
+	}
+
+	for (size_t k = 0; k < preorder.size(); k++)
+	{
+		const ParseTreeNode *node = preorder[k];
+		appendVarint(records, kindOf[labels[k]]);
+		appendVarint(records, node->children.size());
+		appendVarint(records, node->folded.empty() ? 0 : uint64_t(offsets[intern(node->folded)]) + 1);
+	}
+
+	TreeImageHeader header{};
+	memcpy(header.magic, treeImageMagic, sizeof(header.magic));
+	header.nodes = preorder.size();
+	header.kinds = byUse.size();
+	header.stringsSize = strings.size();
+	header.kindsSize = kinds.size();
+	header.nodesSize = records.size();
+	image.clear();
+	image.reserve(sizeof(header) + strings.size() + kinds.size() + records.size());
+	image.append(reinterpret_cast<const char *>(&header), sizeof(header));
+	image += strings;
+	image += kinds;
+	image += records;
+}
+
+bool saveTreeImage(const ParseTreeNode *root, const string &path)
+{
+	PYC_TRACE_SCOPE("tree image save");
+	string image;
+	encodeTreeImage(root, image);
+	ofstream out(path, ios::binary);
+	return bool(out.write(image.data(), image.size()));
+}
+
+// Rebuilds the tree stored in 'image'; the caller frees it with deleteTree.
+// Throws runtime_error when 'image' is not a complete tree image.
+ParseTreeNode *decodeTreeImage(string_view image)
+{
+	const char *damaged = "damaged tree image";
+	TreeImageHeader header;
+	if (image.size() < sizeof(header))
+		throw runtime_error(damaged);
+	memcpy(&header, image.data(), sizeof(header));
+	if (memcmp(header.magic, treeImageMagic, sizeof(header.magic)) != 0 ||
+		image.size() - sizeof(header) != header.stringsSize + header.kindsSize + header.nodesSize)
+		throw runtime_error(damaged);
+	const char *strings = image.data() + sizeof(header);
+	auto text = [&](uint64_t offset)
+	{
+		if (offset >= header.stringsSize)
+			throw runtime_error(damaged);
+		CacheImageReader in(strings + offset, strings + header.stringsSize, damaged);
+		return in.bytes(in.varint());
+	};
+
+	CacheImageReader kinds(strings + header.stringsSize, strings + header.stringsSize + header.kindsSize, damaged);
+	vector<string_view> labels;
+	for (uint64_t k = 0; k < header.kinds; k++)
+		labels.push_back(text(kinds.varint()));
+
+	CacheImageReader in(strings + header.stringsSize + header.kindsSize, image.data() + image.size(), damaged);
+	ParseTreeNode *root = nullptr;
+	// A node is complete once it has as many children as its record says
+	vector<pair<ParseTreeNode *, uint64_t>> open;
+	try
+	{
+		for (uint64_t k = 0; k < header.nodes; k++)
+		{
+			uint64_t kind = in.varint();
+			uint64_t children = in.varint();
+			uint64_t folded = in.varint();
+			if (kind >= labels.size() || (k > 0 && open.empty()))
+				throw runtime_error(damaged);
+			ParseTreeNode *node = new ParseTreeNode(string(labels[kind]));
+			if (folded)
+				node->folded.assign(text(folded - 1));
+			if (!root)
+				root = node;
+			else
+			{
+				open.back().first->addChild(node);
+				if (--open.back().second == 0)
+					open.pop_back();
+			}
+			if (children > 0)
+			{
+				node->children.reserve(min<uint64_t>(children, header.nodes));
+				open.push_back({node, children});
+			}
+		}
+		if (!open.empty() || !in.atEnd())
+			throw runtime_error(damaged);
+	}
+	catch (...)
+	{
+		if (root)
+			deleteTree(root);
+		throw;
+	}
+	return root;
+}
+
+ParseTreeNode *loadTreeImage(const string &path)
+{
+	PYC_TRACE_SCOPE("tree image load");
+	MappedFile file;
+	if (!file.open(path))
+		throw runtime_error("Could not open file: " + path);
+	return decodeTreeImage(file.view());
+}
+
+int printTreeImage(const string &path, bool showFolded)
+{
+	try
+	{
+		ParseTreeNode *root = loadTreeImage(path);
+		printParseTree(root, 0, cout, showFolded);
+		deleteTree(root);
+	}
+	catch (const exception &e)
+	{
+		cerr << "Error: " << e.what() << endl;
+		return 1;
+	}
+	return 0;
+}
+} // namespace pyc::detail
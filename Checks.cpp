@@ -0,0 +1,446 @@
+#include "Tools.h"
+#ifdef __unix__
+#include <unistd.h>
+#include <sys/socket.h>
+#endif
+
+namespace pyc::detail
+{
+// ----------------------------------------------
+// Front-end checks
+// ----------------------------------------------
+// --self-check also runs these. Each one exercises a front-end feature
+// through the same functions its command-line mode uses and returns an empty
+// string when it behaves, or what went wrong.
+struct FrontEndCheck
+{
+	const char *name;
+	string (*run)();
+};
+
+// The symbol table of 'source' from the sequential pass, or from
+// parallelParse with 'jobs' workers
+SymbolTable symbolPassFor(const string &source, unsigned jobs)
+{
+	vector<Error> errors;
+	Lexer lexer;
+	vector<Token> tokens = lexer.tokenize(source, errors);
+	SymbolTable table;
+	if (jobs == 0)
+	{
+		Parser parser(tokens, table);
+		parser.parse();
+	}
+	else
+		parallelParse(tokens, table, jobs);
+	return table;
+}
+
+string checkParallelSymbolPass()
+{
+	string source = generateSemanticBenchModule(200);
+	SymbolTable reference = symbolPassFor(source, 0);
+	for (unsigned jobs : {1u, 4u})
+	{
+		SymbolTable table = symbolPassFor(source, jobs);
+		if (table.table.size() != reference.table.size())
+			return "jobs=" + to_string(jobs) + " found " + to_string(table.table.size()) + " symbols, not " +
+				   to_string(reference.table.size());
+		for (const auto &[key, info] : table.table)
+		{
+			auto ref = reference.table.find(key);
+			if (ref == reference.table.end() || ref->second.entry != info.entry || ref->second.type != info.type ||
+				ref->second.usageCount != info.usageCount)
+				return "jobs=" + to_string(jobs) + " differs from the sequential pass at " + string(key);
+		}
+	}
+	return "";
+}
+
+// Each case names the module-level symbol to look at after folding, and
+// the value and type the symbol table should give it
+string checkConstantFolding()
+{
+	struct Case
+	{
+		const char *source, *name, *value, *type;
+	};
+	static const Case cases[] = {
+		{"x = 1 + 2\ny = x * 2\n", "y", "6", "int"},
+		{"x = 7 / 2\n", "x", "3.5", "float"},
+		{"x = 2\nx **= 10\ny = x\n", "y", "1024", "int"},
+		{"u = 1\nu = u + 1\n", "u", "", "int"},
+		{"w = 10\nw += 5\n", "w", "", "int"},
+		{"x = 1\nif c:\n    x = 2\n", "x", "", "int"},
+		{"x = 1\nif c:\n    x = 'a'\n", "x", "", "unknown"},
+		{"x = 3\nif c:\n    x = 1 + 2\n", "x", "3", "int"},
+		{"x = 2\nx **= -1\ny = x\n", "y", "0.5", "float"},
+		{"x = -7\nx //= 2\ny = x\n", "y", "-4", "int"},
+		{"x = 7.5\nx //= 2\ny = x\n", "y", "3.0", "float"},
+		{"x = 2\nx **= 64\ny = x\n", "y", "", "unknown"}, // overflows at run time
+		{"x = 5\nx = x % 0\n", "x", "", "unknown"},
+		{"t = (1, 2) < (1, 3)\n", "t", "True", "bool"},
+	};
+	CompilerSession session(true);
+	for (const Case &test : cases)
+	{
+		CompileResult result = session.compile(test.source);
+		auto it = result.symbols.table.find(pmr::string(test.name) + "@global");
+		if (it == result.symbols.table.end())
+			return string("no symbol ") + test.name + " in " + test.source;
+		if (it->second.value != test.value || it->second.type != test.type)
+			return string(test.source) + " gives " + test.name + ": " + string(it->second.type) + " = " + string(it->second.value) +
+				   ", not " + test.type + " = " + test.value;
+	}
+	// The values only show in the tree with --show-folded
+	CompileResult result = session.compile("x = 1 + 2\n");
+	ostringstream plain, annotated;
+	printParseTree(result.tree, 0, plain);
+	printParseTree(result.tree, 0, annotated, true);
+	if (plain.str().find(" = ") != string::npos || annotated.str().find("|- expression = 3\n") == string::npos)
+		return "folded values are not printed with --show-folded only";
+	return "";
+}
+
+string checkReplSession()
+{
+	istringstream in("x = 1\ny = x\nq = 1 +\nz = x ** 2\nw = max(\n  3,\n      4)\nv = 2\n:symbols\n");
+	ostringstream out;
+	ReplSession(out).run(in);
+	string text = out.str();
+	if (text.find("y: int = 1\n") == string::npos)
+		return "y = x after x = 1 does not report y: int = 1";
+	if (text.find("Name: q,") != string::npos || text.find("Name: z,") != string::npos)
+		return "a rejected input left a symbol in the table";
+	if (text.find("Name: x, Scope: global, Type: int") == string::npos)
+		return "x lost its type in a later input";
+	if (text.find("Name: w,") == string::npos || text.find("Name: v,") == string::npos)
+		return "an indented line inside brackets kept the input open past its end";
+	return "";
+}
+
+string checkDotExport()
+{
+	CompilerSession session(true);
+	CompileResult result = session.compile("x = 1\nprint(x)\n");
+	TempDirectory scratch("pyc_check_");
+	string path = scratch.path + "/tree.dot";
+	ofstream(path) << "previous export\n";
+	DotRange past;
+	past.root = 999999;
+	try
+	{
+		saveTreeToDot(result.tree, path, past);
+		return "--dot-root past the last node did not fail";
+	}
+	catch (const runtime_error &e)
+	{
+		if (string(e.what()).find("--dot-root=999999 selects") != 0)
+			return string("the error names the wrong flags: ") + e.what();
+	}
+	ostringstream kept;
+	kept << ifstream(path).rdbuf();
+	if (kept.str() != "previous export\n")
+		return "an empty range replaced the previous export";
+	DotRange top;
+	top.maxDepth = 1;
+	saveTreeToDot(result.tree, path, top);
+	ostringstream written;
+	written << ifstream(path).rdbuf();
+	if (written.str().find("node0 -> node1;") == string::npos || written.str().find("node2 ") != string::npos)
+		return "--dot-depth=1 did not write the root and its children only";
+	return "";
+}
+
+// A saved tree loads back node for node, folded values included
+string checkTreeImages()
+{
+	TempDirectory scratch("pyc_check_");
+	string path = scratch.path + "/tree.bin";
+	CompilerSession session(true);
+	const ParseTreeNode *tree = session.compile("x = 2 * 3\nwhile x:\n    x = x - 1\nprint(x, 'done')\n").tree;
+	if (!saveTreeImage(tree, path))
+		return "could not write " + path;
+	ostringstream saved, loaded;
+	printParseTree(tree, 0, saved, true);
+	ParseTreeNode *root = loadTreeImage(path);
+	printParseTree(root, 0, loaded, true);
+	deleteTree(root);
+	if (loaded.str() != saved.str())
+		return "the loaded tree differs from the saved one";
+	filesystem::resize_file(path, filesystem::file_size(path) - 1);
+	try
+	{
+		deleteTree(loadTreeImage(path));
+		return "a truncated image loaded";
+	}
+	catch (const runtime_error &)
+	{
+	}
+	return "";
+}
+
+// The message collectBatchInputs rejects a file list with, or "" if it takes it
+string batchListError(const string &listPath, const string &entries)
+{
+	ofstream(listPath) << entries;
+	try
+	{
+		collectBatchInputs(listPath);
+	}
+	catch (const runtime_error &e)
+	{
+		return e.what();
+	}
+	return "";
+}
+
+string checkBatchInputs()
+{
+	TempDirectory scratch("pyc_check_");
+	filesystem::path root(scratch.path);
+	filesystem::create_directories(root / "src" / "pkg");
+	ofstream(root / "src" / "a.py") << "x = 1\n";
+	ofstream(root / "src" / "pkg" / "b.py") << "y = 2\n";
+	string list = (root / "files.txt").string();
+	string absolute = (root / "src" / "a.py").string();
+	if (batchListError(list, "../esc.py\n").find("'../esc.py'") != 0)
+		return "a path climbing out of the output directory was accepted";
+	if (batchListError(list, absolute + "\n" + filesystem::path(absolute).relative_path().string() + "\n").find("both") ==
+		string::npos)
+		return "two paths with the same report were accepted";
+	ofstream(list) << absolute << "\n" << absolute << "\n" << (root / "src" / "pkg" / ".." / "pkg" / "b.py").string() << "\n";
+	vector<BatchInput> inputs = collectBatchInputs(list);
+	if (inputs.size() != 2)
+		return "a path listed twice is compiled " + to_string(inputs.size() - 1) + " times";
+	string out = (root / "out").string();
+	runBatch(inputs, out, 2);
+	filesystem::path report = filesystem::path(out) / filesystem::path(absolute).relative_path();
+	report += ".txt";
+	if (!filesystem::exists(report))
+		return "no report at " + report.string();
+	if (!filesystem::exists(filesystem::path(out) / filesystem::path(absolute).relative_path().parent_path() / "pkg" / "b.py.txt"))
+		return "the report of a path with '..' inside it is not under the output directory";
+	return "";
+}
+
+// A rebuild parses only what changed and relinks what imports it
+string checkIncrementalBuild()
+{
+	TempDirectory scratch("pyc_check_");
+	string src = scratch.path + "/src", out = scratch.path + "/out";
+	filesystem::create_directories(src);
+	ofstream(src + "/a.py") << "def f():\n    return 1\n";
+	ofstream(src + "/b.py") << "from a import f\n";
+	ofstream(src + "/c.py") << "z = 3\n";
+	BuildStats first = buildProject(src, out, 2, false);
+	if (first.modules != 3 || first.parsed != 3 || !first.linkErrors.empty())
+		return "the first build parsed " + to_string(first.parsed) + " of " + to_string(first.modules) + " modules";
+	if (buildProject(src, out, 2, false).parsed != 0)
+		return "a build with nothing changed parsed again";
+	ofstream(src + "/a.py") << "def g():\n    return 10\n"; // a new size, whatever the mtime resolution
+	BuildStats edited = buildProject(src, out, 2, false);
+	if (edited.parsed != 1 || edited.linkErrors.size() != 1 || edited.linkErrors[0].find("'f'") == string::npos)
+		return "renaming an export did not break exactly the module importing it";
+	return "";
+}
+
+// Input nested far beyond any stack stops at the depth limit in every mode
+// that takes one
+string checkBudgets()
+{
+	string deep = "x = " + string(5000, '(') + "1" + string(5000, ')') + "\n";
+	ResourceBudget limits;
+	limits.maxDepth = 100;
+	CompilerSession session(true);
+	session.setBudget(limits);
+	if (!session.compile(deep).aborted || session.abortReason().find("deeper than 100") == string::npos)
+		return "a session ran past --max-depth";
+	if (session.compile("y = (1)\n").aborted || !session.abortReason().empty())
+		return "a shallow source after an aborted one was aborted too";
+
+	TempDirectory scratch("pyc_check_");
+	string path = scratch.path + "/deep.py";
+	ofstream(path) << deep;
+	vector<BatchFileResult> results = runBatch({{path, "deep.py"}}, "", 1, nullptr, limits);
+	if (results[0].failure.find("deeper than 100") == string::npos)
+		return "a batch ran past --max-depth";
+	ModuleLoader loader({scratch.path}, 1, limits);
+	vector<LoadedModule> modules = loader.load(path);
+	if (modules.size() != 1 || modules[0].failure.find("deeper than 100") == string::npos)
+		return "the import graph ran past --max-depth";
+	return "";
+}
+
+// A cached image restores to the result it was made from; a damaged one is
+// recompiled, never restored
+string checkCacheImages()
+{
+	TempDirectory scratch("pyc_check_");
+	FrontEndCache cache(scratch.path, 1 << 20);
+	string source = "x = 1 + 2\ndef f(a):\n    return a * x\ny = (\n";
+	uint64_t hash = contentHash(source);
+	string compiled, restored;
+	CompilerSession session(true), other(true);
+	compileToJson(compileCached(session, source, hash, &cache), compiled);
+	compileToJson(compileCached(other, source, hash, &cache), restored);
+	if (cache.hitCount() != 1)
+		return "a stored image was not found again";
+	if (restored != compiled)
+		return "a restored result differs from the compiled one";
+	for (const auto &entry : filesystem::directory_iterator(scratch.path))
+	{
+		fstream image(entry.path(), ios::in | ios::out | ios::binary);
+		image.seekp(-1, ios::end);
+		image.put('\x7f');
+	}
+	compileToJson(compileCached(other, source, hash, &cache), restored);
+	if (cache.hitCount() != 1 || restored != compiled)
+		return "a damaged image was restored";
+	return "";
+}
+
+// What a program linked against libpyc.a sees of a compile
+string checkLibraryApi()
+{
+	pyc::Session session(true);
+	pyc::Result result = session.compile("x = 1 + 2\nif x:\n    y = x\n");
+	if (result.tokens < 13 || result.symbols != 2 || result.nodes == 0 || result.syntaxErrors != 0 || result.aborted)
+		return "unexpected counts for a valid source";
+	string json;
+	session.toJson(json);
+	if (json.rfind("{\"ok\":true", 0) != 0 || json.find("\"name\":\"y\"") == string::npos)
+		return "the JSON of the last result is incomplete";
+	pyc::Budget limits;
+	limits.maxDepth = 10;
+	session.setBudget(limits);
+	result = session.compile("x = " + string(50, '(') + "1" + string(50, ')') + "\n");
+	if (!result.aborted || result.abortReason.find("deeper than 10") == string::npos)
+		return "the budget was not applied";
+	limits = {};
+	limits.maxMemory = 1 << 20;
+	bool refused = false;
+	try
+	{
+		session.setBudget(limits);
+	}
+	catch (const runtime_error &)
+	{
+		refused = true;
+	}
+	if (refused == allocationHooks)
+		return refused ? "a memory limit was refused with the hooks linked in" : "a memory limit was accepted without the hooks";
+	return "";
+}
+
+// Once a session has seen a set of sources, compiling them again allocates
+// nothing: not the tokens, the tree, nor the names in the symbol table
+string checkSessionAllocations()
+{
+	if (!allocationHooks)
+		return "";
+	vector<string> sources;
+	for (size_t k = 0; k < 4; k++)
+		sources.push_back(generateSemanticBenchModule(100 + k * 97));
+	CompilerSession session;
+	for (size_t n = 0; n < sessionWarmUpCalls; n++)
+		session.compile(sources[n % sources.size()]);
+	uint64_t before = allocationCounters.allocations;
+	for (size_t n = 0; n < 2 * sources.size(); n++)
+		session.compile(sources[n % sources.size()]);
+	uint64_t allocations = allocationCounters.allocations - before;
+	if (allocations != 0)
+		return to_string(allocations) + " allocations after the warm-up calls";
+	return "";
+}
+
+#ifdef __unix__
+string checkCompileServer()
+{
+	TempDirectory scratch("pyc_check_");
+	string socketPath = scratch.path + "/server.sock";
+	ofstream(socketPath) << "not a socket\n";
+	try
+	{
+		CompileServer refused(socketPath, 1);
+		return "the server replaced a regular file";
+	}
+	catch (const runtime_error &)
+	{
+	}
+	if (readFile(socketPath) != "not a socket\n")
+		return "the server touched the regular file at its path";
+	filesystem::remove(socketPath);
+
+	CompileServer server(socketPath, 1);
+	thread loop([&]
+				{ server.run(); });
+	string problem;
+	int idle = connectToServer(socketPath), active = connectToServer(socketPath);
+	timeval timeout{5, 0};
+	setsockopt(active, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout);
+	string reply;
+	// With one worker the idle connection must not hold it
+	if (!writeFrame(active, "Sx = 1\n") || !readFrame(active, reply) || reply.rfind("{\"ok\":true", 0) != 0)
+		problem = "a request behind an idle connection got no reply";
+	// A frame split across writes, followed at once by a second one
+	string body = "Sy = 2\n", frames;
+	for (int k = 0; k < 2; k++)
+		frames += string{char(body.size()), 0, 0, 0} + body;
+	if (problem.empty() && (!writeAll(active, frames.data(), 3) || !writeAll(active, frames.data() + 3, frames.size() - 3) ||
+							!readFrame(active, reply) || !readFrame(active, reply) || reply.find("\"y\"") == string::npos))
+		problem = "split or pipelined requests were not answered";
+	// Nesting that would overflow a worker's stack is refused without --max-depth
+	string deep = "Sx = " + string(5000, '(') + "1" + string(5000, ')') + "\n";
+	if (problem.empty() && (!writeFrame(active, deep) || !readFrame(active, reply) || reply.find("\"aborted\":true") == string::npos))
+		problem = "deeply nested input was not refused";
+	// 'Q' stops the server although the idle connection is still open
+	if (!writeFrame(active, "Q") || !readFrame(active, reply) || reply != "{\"ok\":true}")
+		problem = problem.empty() ? "'Q' was not acknowledged" : problem;
+	loop.join();
+	close(idle);
+	close(active);
+	return problem;
+}
+#endif
+
+const FrontEndCheck frontEndChecks[] = {
+	{"parallel symbol pass", checkParallelSymbolPass},
+	{"constant folding", checkConstantFolding},
+	{"repl session", checkReplSession},
+	{"DOT export", checkDotExport},
+	{"tree images", checkTreeImages},
+	{"batch inputs", checkBatchInputs},
+	{"incremental build", checkIncrementalBuild},
+	{"cache images", checkCacheImages},
+	{"budgets", checkBudgets},
+	{"library API", checkLibraryApi},
+	{"session allocations", checkSessionAllocations},
+#ifdef __unix__
+	{"compile server", checkCompileServer},
+#endif
+};
+
+int runFrontEndChecks()
+{
+	int failures = 0;
+	for (const FrontEndCheck &check : frontEndChecks)
+	{
+		string problem;
+		try
+		{
+			problem = check.run();
+		}
+		catch (const exception &e)
+		{
+			problem = string("threw ") + e.what();
+		}
+		if (problem.empty())
+			continue;
+		failures++;
+		cout << "FAIL " << check.name << ": " << problem << "\n";
+	}
+	cout << (failures ? to_string(failures) + " front-end check failures" : string("All front-end checks passed")) << "\n";
+	return failures ? 1 : 0;
+}
+} // namespace pyc::detail
@@ -0,0 +1,1038 @@
+#include "Engines.h"
+#ifdef __unix__
+#include <sys/socket.h>
+#endif
+
+namespace pyc::detail
+{
+// ----------------------------------------------
+// Closure engine
+// ----------------------------------------------
+// Each statement and expression subtree is converted once into a C++
+// closure, specialized on its node kind and on literal operands, with local
+// variables already resolved to frame slots. Running the program is a walk
+// over that closure tree, so there is no separate code generation step to
+// pay for before the first result.
+
+// Value of a folded expression or literal, looking through single-child wrappers
+bool literalValue(const ParseTreeNode *node, Value &out)
+{
+	while (true)
+	{
+		ConstValue v;
+		if (!node->folded.empty() && parseLiteral(node->folded, v))
+		{
+			out = constToValue(v);
+			return true;
+		}
+		if (node->children.size() != 1)
+			return false;
+		const ParseTreeNode *child = node->children[0];
+		if (child->children.empty())
+		{
+			if (node->label != "factor" || classifyLeaf(child->label) == LeafKind::Name || !parseLiteral(child->label, v))
+				return false;
+			out = constToValue(v);
+			return true;
+		}
+		node = child;
+	}
+}
+
+const string *variableName(const ParseTreeNode *node)
+{
+	while (node->children.size() == 1 && !node->children[0]->children.empty())
+		node = node->children[0];
+	if (node->label != "factor" || node->children.size() != 1)
+		return nullptr;
+	const string &lexeme = node->children[0]->label;
+	return classifyLeaf(lexeme) == LeafKind::Name ? &lexeme : nullptr;
+}
+
+ClosureProgram ClosureCompiler::compile(ParseTreeNode *root)
+{
+	program = ClosureProgram();
+	scopeSymbols.clear();
+	for (auto &[key, info] : symTable.table)
+		scopeSymbols[string(info.scope)].push_back({info.entry, string(key, 0, key.find('@'))});
+	for (auto &[scopeName, symbols] : scopeSymbols)
+		sort(symbols.begin(), symbols.end());
+
+	program.functions.push_back(make_unique<ClosureFunction>());
+	ClosureFunction *module = program.functions[0].get();
+	module->name = "<module>";
+	Scope moduleScope;
+	moduleScope.symbolScope = "global";
+	scope = &moduleScope;
+	module->body = compileBlock(root);
+	scope = nullptr;
+	return move(program);
+}
+
+string ClosureCompiler::childScope(const string &name) const
+{
+	return scope->symbolScope == "global" ? name : name + "@" + scope->symbolScope;
+}
+
+const uint16_t *ClosureCompiler::localSlot(const string &name) const
+{
+	if (!scope->isFunction)
+		return nullptr;
+	auto it = scope->slots.find(name);
+	return it == scope->slots.end() ? nullptr : &it->second;
+}
+
+ExprFn ClosureCompiler::loadName(const string &name)
+{
+	if (const uint16_t *slot = localSlot(name))
+	{
+		uint16_t k = *slot;
+		string quoted = name;
+		return [k, quoted](ClosureEnv &e) -> Value
+		{
+			const Value &v = e.slots[k];
+			if (v.tag == Value::Tag::Undefined)
+				e.rt->raise("NameError", "local variable '" + quoted + "' referenced before assignment");
+			return v;
+		};
+	}
+	uint32_t g = program.globalSlot(name);
+	return [g](ClosureEnv &e) { return e.rt->loadGlobal(g); };
+}
+
+StoreFn ClosureCompiler::storeName(const string &name)
+{
+	if (const uint16_t *slot = localSlot(name))
+	{
+		uint16_t k = *slot;
+		return [k](ClosureEnv &e, const Value &v) { e.slots[k] = v; };
+	}
+	uint32_t g = program.globalSlot(name);
+	return [g](ClosureEnv &e, const Value &v) { e.rt->storeGlobal(g, v); };
+}
+
+ExprFn ClosureCompiler::attributeOwner(ParseTreeNode *dotted)
+{
+	const auto &parts = dotted->children;
+	ExprFn owner = loadName(parts[0]->label);
+	for (size_t k = 2; k + 2 < parts.size(); k += 2)
+	{
+		uint32_t attr = program.attrId(parts[k]->label);
+		owner = [owner, attr](ClosureEnv &e) { return e.rt->getAttr(owner(e), attr); };
+	}
+	return owner;
+}
+
+StoreFn ClosureCompiler::storeTarget(ParseTreeNode *target)
+{
+	if (isLeaf(target))
+		return storeName(target->label);
+	ExprFn owner = attributeOwner(target);
+	uint32_t attr = program.attrId(target->children.back()->label);
+	return [owner, attr](ClosureEnv &e, const Value &v) { e.rt->setAttr(owner(e), attr, v); };
+}
+
+StmtFn ClosureCompiler::compileBlock(ParseTreeNode *list)
+{
+	vector<StmtFn> statements;
+	for (ParseTreeNode *child : list->children)
+		if (StmtFn s = compileStatement(child))
+			statements.push_back(move(s));
+	if (statements.empty())
+		return [](ClosureEnv &) { return Flow::Normal; };
+	if (statements.size() == 1)
+		return statements[0];
+	return [statements](ClosureEnv &e)
+	{
+		for (const StmtFn &s : statements)
+		{
+			Flow flow = s(e);
+			if (flow != Flow::Normal)
+				return flow;
+		}
+		return Flow::Normal;
+	};
+}
+
+StmtFn ClosureCompiler::compileStatement(ParseTreeNode *node)
+{
+	const string &label = node->label;
+	if (isLeaf(node) || label == "pass_statement")
+		return nullptr;
+	if (label == "statement")
+		return compileStatement(node->children[0]);
+	if (label == "assignment")
+		return compileAssignment(node);
+	if (label == "conditional_statement")
+		return compileConditional(node);
+	if (label == "while_statement")
+		return compileWhile(node);
+	if (label == "for_statement")
+		return compileFor(node);
+	if (label == "try_statement")
+		return compileTry(node);
+	if (label == "function")
+	{
+		ExprFn make = compileFunction(node);
+		StoreFn store = storeName(node->children[1]->label);
+		return [make, store](ClosureEnv &e)
+		{
+			store(e, make(e));
+			return Flow::Normal;
+		};
+	}
+	if (label == "class_def")
+		return compileClass(node);
+	if (label == "import_statement")
+		return compileImport(node);
+	if (label == "return_statement")
+	{
+		if (!scope->isFunction)
+			throw CompileError("'return' outside function");
+		ExprFn value = compileExpr(node->children[1]);
+		return [value](ClosureEnv &e)
+		{
+			e.result = value(e);
+			return Flow::Return;
+		};
+	}
+	if (label == "break_statement")
+		return [](ClosureEnv &) { return Flow::Break; };
+	if (label == "continue_statement")
+		return [](ClosureEnv &) { return Flow::Continue; };
+	if (label == "raise_statement")
+	{
+		ExprFn exc = compileExpr(node->children[1]);
+		return [exc](ClosureEnv &e) -> Flow { e.rt->raiseValue(exc(e)); };
+	}
+	if (label == "function_call" || label == "factor")
+	{
+		ExprFn value = label == "function_call" ? compileCall(node) : compileExpr(node);
+		return [value](ClosureEnv &e)
+		{
+			value(e);
+			return Flow::Normal;
+		};
+	}
+	throw CompileError("unsupported statement '" + label + "'");
+}
+
+StmtFn ClosureCompiler::compileAssignment(ParseTreeNode *node)
+{
+	auto [targets, values, op] = splitAssignment(node);
+
+	if (op != "=")
+	{
+		if (targets.size() != 1)
+			throw CompileError("augmented assignment needs exactly one target");
+		Op binary = binaryOpFor(op.substr(0, op.size() - 1));
+		ParseTreeNode *target = targets[0];
+		ExprFn rhs = compileExpr(values[0]);
+		if (isLeaf(target))
+		{
+			if (const uint16_t *slot = localSlot(target->label); slot && binary == Op::ADD)
+				return appendInPlace(*slot, rhs);
+			ExprFn updated = binaryExpr(binary, loadName(target->label), rhs, nullptr);
+			StoreFn store = storeName(target->label);
+			return [updated, store](ClosureEnv &e)
+			{
+				store(e, updated(e));
+				return Flow::Normal;
+			};
+		}
+		ExprFn owner = attributeOwner(target);
+		uint32_t attr = program.attrId(target->children.back()->label);
+		return [owner, attr, binary, rhs](ClosureEnv &e)
+		{
+			Value object = owner(e);
+			Value current = e.rt->getAttr(object, attr);
+			e.rt->setAttr(object, attr, e.rt->binarySlow(binary, current, rhs(e)));
+			return Flow::Normal;
+		};
+	}
+
+	if (targets.size() == 1)
+	{
+		ParseTreeNode *target = targets[0];
+		// x = x + y on a local reuses the string buffer when nothing else shares it
+		if (isLeaf(target))
+		{
+			const uint16_t *slot = localSlot(target->label);
+			ParseTreeNode *sum = values[0];
+			while (sum->children.size() == 1 && sum->folded.empty())
+				sum = sum->children[0];
+			if (slot && sum->label == "arithmetic" && sum->children.size() == 3 && sum->children[1]->label == "+")
+			{
+				const string *left = variableName(sum->children[0]);
+				if (left && *left == target->label)
+					return appendInPlace(*slot, compileExpr(sum->children[2]));
+			}
+			if (slot)
+			{
+				uint16_t k = *slot;
+				ExprFn rhs = compileExpr(values[0]);
+				return [k, rhs](ClosureEnv &e)
+				{
+					e.slots[k] = rhs(e);
+					return Flow::Normal;
+				};
+			}
+		}
+		ExprFn rhs = compileExpr(values[0]);
+		StoreFn store = storeTarget(target);
+		return [rhs, store](ClosureEnv &e)
+		{
+			store(e, rhs(e));
+			return Flow::Normal;
+		};
+	}
+
+	vector<ExprFn> rhs;
+	vector<StoreFn> stores;
+	for (ParseTreeNode *value : values)
+		rhs.push_back(compileExpr(value));
+	for (ParseTreeNode *target : targets)
+		stores.push_back(storeTarget(target));
+	if (rhs.size() != stores.size())
+		throw CompileError("cannot unpack " + to_string(rhs.size()) + " values into " + to_string(stores.size()) + " targets");
+	return [rhs, stores](ClosureEnv &e)
+	{
+		vector<Value> values;
+		values.reserve(rhs.size());
+		for (const ExprFn &value : rhs)
+			values.push_back(value(e));
+		for (size_t k = 0; k < stores.size(); k++)
+			stores[k](e, values[k]);
+		return Flow::Normal;
+	};
+}
+
+StmtFn ClosureCompiler::appendInPlace(uint16_t k, ExprFn rhs)
+{
+	return [k, rhs](ClosureEnv &e)
+	{
+		Value y = rhs(e);
+		Value &x = e.slots[k];
+		long long r;
+		if (x.tag == Value::Tag::Int && y.tag == Value::Tag::Int && !__builtin_add_overflow(x.i, y.i, &r))
+			x.setInt(r);
+		else if (x.isObject(ObjKind::Str) && y.isObject(ObjKind::Str) && x.obj->refs == 1)
+			static_cast<StrObject *>(x.obj)->s += static_cast<StrObject *>(y.obj)->s;
+		else
+			x = e.rt->binarySlow(Op::ADD, x, y);
+		return Flow::Normal;
+	};
+}
+
+function<bool(ClosureEnv &)> ClosureCompiler::compileCondition(ParseTreeNode *cond)
+{
+	ParseTreeNode *comparison = cond;
+	while (comparison->children.size() == 1 && comparison->label != "comparison")
+		comparison = comparison->children[0];
+	if (cond->folded.empty() && comparison->label == "comparison" && comparison->children.size() == 3 &&
+		comparison->children[1]->children.size() == 1)
+	{
+		Op op = binaryOpFor(comparison->children[1]->children[0]->label);
+		if (op >= Op::LT && op <= Op::GE)
+		{
+			ExprFn left = compileExpr(comparison->children[0]);
+			Value constant;
+			if (literalValue(comparison->children[2], constant) && constant.tag == Value::Tag::Int)
+			{
+				long long k = constant.i;
+				return [left, op, k, constant](ClosureEnv &e)
+				{
+					Value x = left(e);
+					if (x.tag == Value::Tag::Int)
+						return op == Op::LT ? x.i < k : op == Op::LE ? x.i <= k : op == Op::GT ? x.i > k : x.i >= k;
+					return isTruthy(e.rt->binarySlow(op, x, constant));
+				};
+			}
+			ExprFn right = compileExpr(comparison->children[2]);
+			return [left, right, op](ClosureEnv &e)
+			{
+				Value x = left(e);
+				Value y = right(e);
+				if (x.tag == Value::Tag::Int && y.tag == Value::Tag::Int)
+					return op == Op::LT ? x.i < y.i : op == Op::LE ? x.i <= y.i : op == Op::GT ? x.i > y.i : x.i >= y.i;
+				return isTruthy(e.rt->binarySlow(op, x, y));
+			};
+		}
+	}
+	ExprFn value = compileExpr(cond);
+	return [value](ClosureEnv &e) { return isTruthy(value(e)); };
+}
+
+StmtFn ClosureCompiler::compileConditional(ParseTreeNode *node)
+{
+	vector<pair<function<bool(ClosureEnv &)>, StmtFn>> clauses;
+	StmtFn otherwise;
+	auto clause = [&](ParseTreeNode *cond, ParseTreeNode *block) -> bool
+	{
+		bool truth;
+		if (cond && !foldedTruth(cond, truth))
+		{
+			clauses.push_back({compileCondition(cond), compileBlock(block)});
+			return false;
+		}
+		if (cond && !truth)
+			return false; // branch can never run
+		otherwise = compileBlock(block);
+		return true; // later clauses are unreachable
+	};
+	bool done = clause(node->children[1], node->children[3]);
+	for (size_t k = 4; k < node->children.size() && !done; k++)
+	{
+		ParseTreeNode *part = node->children[k];
+		if (part->label == "elif_clause")
+			done = clause(part->children[1], part->children[3]);
+		else if (part->label == "else_clause")
+			done = clause(nullptr, part->children[2]);
+	}
+	if (clauses.size() == 1)
+	{
+		auto cond = clauses[0].first;
+		StmtFn then = clauses[0].second;
+		return [cond, then, otherwise](ClosureEnv &e)
+		{
+			if (cond(e))
+				return then(e);
+			return otherwise ? otherwise(e) : Flow::Normal;
+		};
+	}
+	return [clauses, otherwise](ClosureEnv &e)
+	{
+		for (const auto &[cond, block] : clauses)
+			if (cond(e))
+				return block(e);
+		return otherwise ? otherwise(e) : Flow::Normal;
+	};
+}
+
+StmtFn ClosureCompiler::compileWhile(ParseTreeNode *node)
+{
+	bool truth;
+	if (foldedTruth(node->children[1], truth) && !truth)
+		return nullptr;
+	auto cond = compileCondition(node->children[1]);
+	StmtFn body = compileBlock(node->children[3]);
+	return [cond, body](ClosureEnv &e)
+	{
+		while (cond(e))
+		{
+			Flow flow = body(e);
+			if (flow == Flow::Break)
+				break;
+			if (flow == Flow::Return)
+				return flow;
+		}
+		return Flow::Normal;
+	};
+}
+
+StmtFn ClosureCompiler::compileFor(ParseTreeNode *node)
+{
+	ExprFn iterable = compileExpr(node->children[3]);
+	const string &name = node->children[1]->label;
+	const uint16_t *slot = localSlot(name);
+	int local = slot ? *slot : -1;
+	StoreFn store = storeName(name);
+	StmtFn body = compileBlock(node->children[5]);
+	return [iterable, local, store, body](ClosureEnv &e)
+	{
+		Value it = e.rt->makeIterator(iterable(e));
+		if (it.isObject(ObjKind::RangeIter))
+		{
+			// Counts directly instead of going through the iterator object
+			auto *range = static_cast<RangeIterObject *>(it.obj);
+			for (long long i = range->next; range->step > 0 ? i < range->stop : i > range->stop; i += range->step)
+			{
+				if (local >= 0)
+					e.slots[local].setInt(i);
+				else
+					store(e, Value::integer(i));
+				Flow flow = body(e);
+				if (flow == Flow::Break)
+					break;
+				if (flow == Flow::Return)
+					return flow;
+			}
+			return Flow::Normal;
+		}
+		Value item;
+		while (e.rt->iteratorNext(it, item))
+		{
+			store(e, item);
+			Flow flow = body(e);
+			if (flow == Flow::Break)
+				break;
+			if (flow == Flow::Return)
+				return flow;
+		}
+		return Flow::Normal;
+	};
+}
+
+StmtFn ClosureCompiler::compileTry(ParseTreeNode *node)
+{
+	struct Handler
+	{
+		ExprFn cls; // empty for a bare except
+		StoreFn bind;
+		StmtFn body;
+	};
+	StmtFn body = compileBlock(node->children[2]);
+	vector<Handler> handlers;
+	StmtFn elseBlock, finallyBlock;
+	for (size_t k = 3; k < node->children.size(); k++)
+	{
+		ParseTreeNode *part = node->children[k];
+		const auto &c = part->children;
+		if (part->label == "except_clause")
+		{
+			Handler h;
+			if (c.size() > 3)
+				h.cls = loadName(c[1]->label);
+			if (c.size() > 4 && c[2]->label == "as")
+				h.bind = storeName(c[3]->label);
+			h.body = compileBlock(c.back());
+			handlers.push_back(move(h));
+		}
+		else if (part->label == "else_clause")
+			elseBlock = compileBlock(c[2]);
+		else if (part->label == "finally_clause")
+			finallyBlock = compileBlock(c[2]);
+	}
+
+	StmtFn guarded = body;
+	if (!handlers.empty())
+	{
+		guarded = [body, handlers, elseBlock](ClosureEnv &e)
+		{
+			Value exc;
+			try
+			{
+				Flow flow = body(e);
+				if (flow != Flow::Normal || !elseBlock)
+					return flow;
+			}
+			catch (PyException &raised)
+			{
+				exc = raised.exc;
+			}
+			if (exc.tag == Value::Tag::None)
+				return elseBlock(e);
+			// Handlers run outside the try so that they can raise freely
+			for (const Handler &h : handlers)
+			{
+				if (h.cls && !e.rt->exceptionMatches(exc, h.cls(e)))
+					continue;
+				if (h.bind)
+					h.bind(e, exc);
+				return h.body(e);
+			}
+			throw PyException{exc};
+		};
+	}
+	if (!finallyBlock)
+		return guarded;
+	return [guarded, finallyBlock](ClosureEnv &e)
+	{
+		Flow flow;
+		try
+		{
+			flow = guarded(e);
+		}
+		catch (PyException &)
+		{
+			Flow override = finallyBlock(e);
+			if (override != Flow::Normal)
+				return override;
+			throw;
+		}
+		Value result = move(e.result);
+		Flow override = finallyBlock(e);
+		if (override != Flow::Normal)
+			return override;
+		e.result = move(result);
+		return flow;
+	};
+}
+
+ExprFn ClosureCompiler::compileFunction(ParseTreeNode *node)
+{
+	const string &name = node->children[1]->label;
+	ParseTreeNode *body = node->children.back();
+	vector<ParseTreeNode *> params;
+	for (ParseTreeNode *param : node->children[3]->children)
+		if (param->label == "parameter")
+			params.push_back(param);
+
+	// Defaults are evaluated in the defining scope
+	vector<ExprFn> defaults;
+	for (ParseTreeNode *param : params)
+	{
+		if (param->children.size() == 3)
+			defaults.push_back(compileExpr(param->children[2]));
+		else if (!defaults.empty())
+			throw CompileError("non-default parameter follows default parameter in '" + name + "'");
+	}
+
+	program.functions.push_back(make_unique<ClosureFunction>());
+	ClosureFunction *f = program.functions.back().get();
+	f->name = name;
+	f->numParams = static_cast<uint16_t>(params.size());
+	f->numDefaults = static_cast<uint16_t>(defaults.size());
+
+	Scope inner;
+	inner.symbolScope = childScope(name);
+	inner.isFunction = true;
+	for (ParseTreeNode *param : params)
+	{
+		const string &paramName = param->children[0]->label;
+		if (!inner.slots.emplace(paramName, static_cast<uint16_t>(inner.slots.size())).second)
+			throw CompileError("duplicate argument '" + paramName + "' in function '" + name + "'");
+	}
+	unordered_set<string> bound;
+	collectBoundNames(body, bound);
+	auto addLocal = [&](const string &local)
+	{
+		if (bound.erase(local))
+			inner.slots.emplace(local, static_cast<uint16_t>(inner.slots.size()));
+	};
+	for (auto &[entry, symbol] : scopeSymbols[inner.symbolScope])
+		addLocal(symbol);
+	vector<string> rest(bound.begin(), bound.end()); // bound names the symbol pass did not record
+	sort(rest.begin(), rest.end());
+	for (const string &local : rest)
+		addLocal(local);
+	f->numSlots = static_cast<uint16_t>(inner.slots.size());
+
+	Scope *outer = scope;
+	scope = &inner;
+	f->body = compileBlock(body);
+	scope = outer;
+
+	return [f, defaults](ClosureEnv &e)
+	{
+		auto *function = new FunctionObject(f);
+		Value v(function);
+		for (const ExprFn &d : defaults)
+			function->defaults.push_back(d(e));
+		return v;
+	};
+}
+
+StmtFn ClosureCompiler::compileClass(ParseTreeNode *node)
+{
+	const auto &c = node->children;
+	const string &name = c[1]->label;
+	ExprFn base;
+	if (c.size() > 4 && c[2]->label == "(")
+		base = loadName(c[3]->label);
+
+	// Methods resolve their scope under the class, but names in the class body itself are module-level
+	Scope classScope;
+	classScope.symbolScope = childScope(name);
+	Scope *outer = scope;
+	vector<pair<uint32_t, ExprFn>> members;
+	for (ParseTreeNode *member : c.back()->children)
+	{
+		if (member->label == "function")
+		{
+			scope = &classScope;
+			ExprFn make = compileFunction(member);
+			scope = outer;
+			members.push_back({program.attrId(member->children[1]->label), make});
+		}
+		else if (member->label == "assignment")
+		{
+			vector<ParseTreeNode *> targets, values;
+			for (ParseTreeNode *t : member->children[0]->children)
+				if (t->label != ",")
+					targets.push_back(t);
+			for (ParseTreeNode *v : member->children[2]->children)
+				if (v->label == "expression")
+					values.push_back(v);
+			for (size_t k = 0; k < targets.size() && k < values.size(); k++)
+			{
+				if (!isLeaf(targets[k]))
+					throw CompileError("attribute assignment in class body of '" + name + "'");
+				members.push_back({program.attrId(targets[k]->label), compileExpr(values[k])});
+			}
+		}
+	}
+	StoreFn store = storeName(name);
+	return [name, base, members, store](ClosureEnv &e)
+	{
+		auto *cls = new ClassObject(name);
+		Value v(cls);
+		if (base)
+		{
+			cls->base = base(e);
+			if (!cls->base.isObject(ObjKind::Class))
+				e.rt->raise("TypeError", "base of class '" + name + "' is not a class");
+		}
+		for (const auto &[attr, value] : members)
+			cls->attrs[attr] = value(e);
+		store(e, v);
+		return Flow::Normal;
+	};
+}
+
+StmtFn ClosureCompiler::compileImport(ParseTreeNode *node)
+{
+	ImportParts imported = splitImport(node);
+	if (imported.star)
+		throw CompileError("'from ... import *' is not supported");
+	// (module, attribute or UINT32_MAX for the module itself, target)
+	vector<tuple<string, uint32_t, StoreFn>> bindings;
+	for (const auto &[source, bound] : imported.bindings)
+	{
+		if (imported.from.empty())
+			bindings.emplace_back(source, UINT32_MAX, storeName(bound));
+		else
+			bindings.emplace_back(imported.from, program.attrId(source), storeName(bound));
+	}
+	return [bindings](ClosureEnv &e)
+	{
+		for (const auto &[path, attr, store] : bindings)
+		{
+			Value module = e.rt->importModule(path);
+			store(e, attr == UINT32_MAX ? module : e.rt->getAttr(module, attr));
+		}
+		return Flow::Normal;
+	};
+}
+
+ExprFn ClosureCompiler::compileExpr(ParseTreeNode *node)
+{
+	const string &label = node->label;
+	const auto &c = node->children;
+
+	Value constant;
+	if (label == "expression" && literalValue(node, constant))
+		return [constant](ClosureEnv &) { return constant; };
+	if (c.size() == 1 && label != "factor")
+		return compileExpr(c[0]);
+	if (label == "or_expression" || label == "and_expression")
+	{
+		bool isOr = label == "or_expression";
+		vector<ExprFn> parts;
+		for (size_t k = 0; k < c.size(); k += 2)
+			parts.push_back(compileExpr(c[k]));
+		return [parts, isOr](ClosureEnv &e)
+		{
+			Value v;
+			for (const ExprFn &part : parts)
+			{
+				v = part(e);
+				if (isTruthy(v) == isOr)
+					break;
+			}
+			return v;
+		};
+	}
+	if (label == "not_expression")
+	{
+		ExprFn operand = compileExpr(c[1]);
+		return [operand](ClosureEnv &e) { return Value::boolean(!isTruthy(operand(e))); };
+	}
+	if (label == "comparison")
+		return compileComparison(node);
+	if (label == "arithmetic" || label == "term")
+	{
+		ExprFn acc = compileExpr(c[0]);
+		for (size_t k = 1; k + 1 < c.size(); k += 2)
+			acc = binaryExpr(binaryOpFor(c[k]->label), acc, compileExpr(c[k + 1]), c[k + 1]);
+		return acc;
+	}
+	if (label == "factor")
+		return compileFactor(node);
+	throw CompileError("unsupported expression '" + label + "'");
+}
+
+ExprFn ClosureCompiler::binaryExpr(Op op, ExprFn left, ExprFn right, ParseTreeNode *rightNode)
+{
+	Value constant;
+	if (rightNode && literalValue(rightNode, constant) && constant.tag == Value::Tag::Int)
+	{
+		long long k = constant.i;
+		switch (op)
+		{
+		case Op::ADD:
+			return [left, k, constant](ClosureEnv &e)
+			{
+				Value x = left(e);
+				long long r;
+				if (x.tag == Value::Tag::Int && !__builtin_add_overflow(x.i, k, &r))
+					return Value::integer(r);
+				return e.rt->binarySlow(Op::ADD, x, constant);
+			};
+		case Op::SUB:
+			return [left, k, constant](ClosureEnv &e)
+			{
+				Value x = left(e);
+				long long r;
+				if (x.tag == Value::Tag::Int && !__builtin_sub_overflow(x.i, k, &r))
+					return Value::integer(r);
+				return e.rt->binarySlow(Op::SUB, x, constant);
+			};
+		case Op::MOD:
+			if (k > 0)
+				return [left, k, constant](ClosureEnv &e)
+				{
+					Value x = left(e);
+					if (x.tag == Value::Tag::Int)
+					{
+						long long r = x.i % k;
+						return Value::integer(r < 0 ? r + k : r);
+					}
+					return e.rt->binarySlow(Op::MOD, x, constant);
+				};
+			break;
+		case Op::LT:
+		case Op::LE:
+		case Op::GT:
+		case Op::GE:
+		case Op::EQ:
+		case Op::NE:
+			return [left, k, op, constant](ClosureEnv &e)
+			{
+				Value x = left(e);
+				if (x.tag == Value::Tag::Int)
+				{
+					bool r = op == Op::LT ? x.i < k : op == Op::LE ? x.i <= k : op == Op::GT ? x.i > k : op == Op::GE ? x.i >= k : op == Op::EQ ? x.i == k : x.i != k;
+					return Value::boolean(r);
+				}
+				return e.rt->binarySlow(op, x, constant);
+			};
+		default:
+			break;
+		}
+	}
+	switch (op)
+	{
+	case Op::ADD:
+		return [left, right](ClosureEnv &e)
+		{
+			Value x = left(e);
+			Value y = right(e);
+			long long r;
+			if (x.tag == Value::Tag::Int && y.tag == Value::Tag::Int && !__builtin_add_overflow(x.i, y.i, &r))
+				return Value::integer(r);
+			if (x.tag == Value::Tag::Float && y.tag == Value::Tag::Float)
+				return Value::number(x.f + y.f);
+			return e.rt->binarySlow(Op::ADD, x, y);
+		};
+	case Op::SUB:
+		return [left, right](ClosureEnv &e)
+		{
+			Value x = left(e);
+			Value y = right(e);
+			long long r;
+			if (x.tag == Value::Tag::Int && y.tag == Value::Tag::Int && !__builtin_sub_overflow(x.i, y.i, &r))
+				return Value::integer(r);
+			return e.rt->binarySlow(Op::SUB, x, y);
+		};
+	case Op::MUL:
+		return [left, right](ClosureEnv &e)
+		{
+			Value x = left(e);
+			Value y = right(e);
+			long long r;
+			if (x.tag == Value::Tag::Int && y.tag == Value::Tag::Int && !__builtin_mul_overflow(x.i, y.i, &r))
+				return Value::integer(r);
+			return e.rt->binarySlow(Op::MUL, x, y);
+		};
+	case Op::LT:
+	case Op::LE:
+	case Op::GT:
+	case Op::GE:
+		return [left, right, op](ClosureEnv &e)
+		{
+			Value x = left(e);
+			Value y = right(e);
+			if (x.tag == Value::Tag::Int && y.tag == Value::Tag::Int)
+				return Value::boolean(op == Op::LT ? x.i < y.i : op == Op::LE ? x.i <= y.i : op == Op::GT ? x.i > y.i : x.i >= y.i);
+			return e.rt->binarySlow(op, x, y);
+		};
+	default:
+		return [left, right, op](ClosureEnv &e)
+		{
+			Value x = left(e);
+			return e.rt->binarySlow(op, x, right(e));
+		};
+	}
+}
+
+ExprFn ClosureCompiler::compileComparison(ParseTreeNode *node)
+{
+	const auto &c = node->children;
+	vector<ExprFn> operands = {compileExpr(c[0])};
+	vector<ParseTreeNode *> operandNodes = {c[0]};
+	vector<Op> comparisons;
+	for (size_t k = 1; k + 1 < c.size(); k += 2)
+	{
+		string opText = comparisonOperator(c[k]);
+		if (opText.empty())
+			throw CompileError("unsupported operator in comparison");
+		Op op = binaryOpFor(opText);
+		ExprFn right = compileExpr(c[k + 1]);
+		if (!isComparisonOp(op))
+		{
+			operands.back() = binaryExpr(op, operands.back(), right, c[k + 1]);
+			operandNodes.back() = nullptr;
+			continue;
+		}
+		comparisons.push_back(op);
+		operands.push_back(right);
+		operandNodes.push_back(c[k + 1]);
+	}
+	if (comparisons.empty())
+		return operands[0];
+	if (comparisons.size() == 1)
+		return binaryExpr(comparisons[0], operands[0], operands[1], operandNodes[1]);
+	return [operands, comparisons](ClosureEnv &e)
+	{
+		Value left = operands[0](e);
+		Value result;
+		for (size_t k = 0; k < comparisons.size(); k++)
+		{
+			Value right = operands[k + 1](e);
+			result = e.rt->binarySlow(comparisons[k], left, right);
+			if (!isTruthy(result))
+				break;
+			left = move(right);
+		}
+		return result;
+	};
+}
+
+ExprFn ClosureCompiler::compileCall(ParseTreeNode *node)
+{
+	ParseTreeNode *arguments = nullptr;
+	for (ParseTreeNode *part : node->children)
+		if (part->label == "arguments")
+			arguments = part;
+	return compileCallParts(node->children[0], arguments);
+}
+
+ExprFn ClosureCompiler::compileCallParts(ParseTreeNode *callee, ParseTreeNode *arguments)
+{
+	vector<ExprFn> args;
+	if (arguments)
+		for (ParseTreeNode *arg : arguments->children)
+			if (arg->label == "expression")
+				args.push_back(compileExpr(arg));
+	if (isLeaf(callee))
+	{
+		ExprFn function = loadName(callee->label);
+		return [function, args](ClosureEnv &e)
+		{
+			Value f = function(e);
+			ClosureRuntime &rt = *e.rt;
+			Value *base = rt.reserve(args.size());
+			ClosureRuntime::StackMark mark{rt, base};
+			for (size_t k = 0; k < args.size(); k++)
+				base[k] = args[k](e);
+			return rt.call(f, base, static_cast<int>(args.size()));
+		};
+	}
+	ExprFn owner = attributeOwner(callee);
+	uint32_t name = program.attrId(callee->children.back()->label);
+	return [owner, name, args](ClosureEnv &e)
+	{
+		Value receiver = owner(e);
+		ClosureRuntime &rt = *e.rt;
+		Value *base = rt.reserve(args.size());
+		ClosureRuntime::StackMark mark{rt, base};
+		for (size_t k = 0; k < args.size(); k++)
+			base[k] = args[k](e);
+		return rt.callMethod(receiver, name, base, static_cast<int>(args.size()));
+	};
+}
+
+ExprFn ClosureCompiler::buildSequence(ObjKind kind, const vector<ParseTreeNode *> &items)
+{
+	vector<ExprFn> parts;
+	for (ParseTreeNode *item : items)
+		parts.push_back(compileExpr(item));
+	return [kind, parts](ClosureEnv &e)
+	{
+		if (kind == ObjKind::List || kind == ObjKind::Tuple)
+		{
+			auto *list = new ListObject(kind);
+			Value v(list);
+			list->items.reserve(parts.size());
+			for (const ExprFn &part : parts)
+				list->items.push_back(part(e));
+			return v;
+		}
+		auto *dict = new DictObject(kind);
+		Value v(dict);
+		for (size_t k = 0; k < parts.size(); k += kind == ObjKind::Dict ? 2 : 1)
+		{
+			Value key = parts[k](e);
+			dict->set(key, kind == ObjKind::Dict ? parts[k + 1](e) : Value());
+		}
+		return v;
+	};
+}
+
+ExprFn ClosureCompiler::compileFactor(ParseTreeNode *node)
+{
+	const auto &c = node->children;
+	ParseTreeNode *first = c[0];
+
+	if (isLeaf(first) && c.size() == 1)
+	{
+		const string &lexeme = first->label;
+		if (classifyLeaf(lexeme) == LeafKind::Name)
+			return loadName(lexeme);
+		ConstValue literal;
+		if (!parseLiteral(lexeme, literal))
+			throw CompileError("integer literal too large: " + lexeme);
+		Value constant = constToValue(literal);
+		return [constant](ClosureEnv &) { return constant; };
+	}
+	if (isLeaf(first) && c.size() == 2 && c[1]->label == "factor")
+	{
+		static const unordered_map<string, Op> unary = {
+			{"-", Op::NEG}, {"+", Op::POS}, {"~", Op::INVERT}, {"not", Op::NOT}};
+		Op op = unary.at(first->label);
+		ExprFn operand = compileExpr(c[1]);
+		return [op, operand](ClosureEnv &e) { return e.rt->unarySlow(op, operand(e)); };
+	}
+	if (c.size() > 1 && c[1]->label == "(")
+		return compileCallParts(first, c.size() > 3 ? c[2] : nullptr);
+	if (first->label == "dotted_name")
+	{
+		ExprFn owner = attributeOwner(first);
+		uint32_t attr = program.attrId(first->children.back()->label);
+		return [owner, attr](ClosureEnv &e) { return e.rt->getAttr(owner(e), attr); };
+	}
+
+	vector<ParseTreeNode *> items;
+	bool hasComma = false;
+	for (ParseTreeNode *part : first->children)
+	{
+		if (part->label == "expression")
+			items.push_back(part);
+		hasComma = hasComma || part->label == ",";
+	}
+	if (first->label == "tuple_or_group")
+	{
+		if (items.size() == 1 && !hasComma)
+			return compileExpr(items[0]);
+		return buildSequence(ObjKind::Tuple, items);
+	}
+	if (first->label == "list_literal")
+		return buildSequence(ObjKind::List, items);
+	if (first->label == "set_literal")
+		return buildSequence(ObjKind::Set, items);
+	if (first->label == "dict_literal")
+		return buildSequence(ObjKind::Dict, items);
+	throw CompileError("unsupported factor '" + first->label + "'");
+}
+} // namespace pyc::detail
@@ -0,0 +1,83 @@
+#ifndef PYC_COMPILER_H
+#define PYC_COMPILER_H
+
+// ----------------------------------------------
+// The front end as a library
+// ----------------------------------------------
+// libpyc.a (make libpyc.a) holds the front end only: no main(), none of
+// the execution engines, and no replacement of the global operator new
+// unless built with make ALLOCATION_HOOKS=1, so it leaves the allocator
+// of the program it is linked into alone. Everything else it defines is
+// in namespace pyc. Link it with -pthread.
+//
+// A Session lexes, builds the symbol table and parses one source per
+// compile() without printing anything or touching files, and keeps its
+// buffers for the next call, so a long-lived session allocates almost
+// nothing once it has seen inputs of a given size. One session must not be
+// used by two threads at once; use one per thread.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace pyc
+{
+	// Limits for compiling untrusted input; zero means no limit. The same
+	// limits as --max-tokens, --max-depth, --max-nodes, --max-memory and
+	// --deadline-ms.
+	struct Budget
+	{
+		std::size_t maxTokens = 0;
+		int maxDepth = 0; // blocks plus expressions open at once
+		std::size_t maxNodes = 0;
+		std::uint64_t maxMemory = 0; // bytes allocated in all, not bytes live; needs ALLOCATION_HOOKS=1
+		std::int64_t deadlineMs = 0;
+	};
+
+	// Counts for one compile(); the views stay valid until the next
+	// compile() or reset() of the session
+	struct Result
+	{
+		std::size_t tokens = 0;
+		std::size_t lexErrors = 0;
+		std::size_t symbols = 0;
+		std::size_t nodes = 0;
+		int syntaxErrors = 0;
+		std::string_view diagnostics; // syntax error lines, as printed by the CLI
+		bool aborted = false;		  // the budget ran out; the rest is partial
+		std::string_view abortReason;
+	};
+
+	class Session
+	{
+	public:
+		explicit Session(bool foldConstants = false);
+		~Session();
+
+		Session(const Session &) = delete;
+		Session &operator=(const Session &) = delete;
+
+		// Limits every later compile(); 'cancel' may stop one from another
+		// thread. Throws std::runtime_error for a memory limit when the
+		// allocation hooks were not built in.
+		void setBudget(const Budget &limits, const std::atomic<bool> *cancel = nullptr);
+
+		Result compile(std::string_view source);
+
+		// The last result in full - tokens, symbols, folded tree and
+		// diagnostics - as the JSON object --serve replies with
+		void toJson(std::string &out) const;
+
+		// Drops the last result but keeps the storage behind it
+		void reset();
+
+	private:
+		struct State;
+		std::unique_ptr<State> state;
+	};
+}
+
+#endif
@@ -0,0 +1,163 @@
+#include "Tools.h"
+
+namespace pyc::detail
+{
+// ----------------------------------------------
+// Token and tree dumps
+// ----------------------------------------------
+// --tokens=FILE and --tree=FILE write the front end's view of one file for
+// other tools, without the layout of the default report: --format=tsv (the
+// default) gives a header row and one tab-separated row per token or node,
+// --format=jsonl one JSON object per line. Tree rows come in preorder and
+// name their parent's id; "folded" is the constant an expression folds to.
+// Diagnostics go to stderr and make the exit status 1.
+
+// Escapes the characters that would end a TSV field or row
+void appendTsvField(string &out, string_view s)
+{
+	for (char c : s)
+	{
+		switch (c)
+		{
+		case '\t':
+			out += "\\t";
+			break;
+		case '\n':
+			out += "\\n";
+			break;
+		case '\r':
+			out += "\\r";
+			break;
+		case '\\':
+			out += "\\\\";
+			break;
+		default:
+			out += c;
+		}
+	}
+}
+
+void dumpTokens(const CompileResult &result, bool jsonl, OutputBuffer &buffer)
+{
+	pmr::string key;
+	if (!jsonl)
+		buffer << "kind\tlexeme\tline\tscope\tentry\n";
+	for (const Token &tk : result.tokens)
+	{
+		int entry = 0;
+		if (tk.type == TokenType::IDENTIFIER)
+		{
+			key.assign(tk.lexeme).append(1, '@').append(tk.scope);
+			auto symbol = result.symbols.table.find(key);
+			if (symbol != result.symbols.table.end())
+				entry = symbol->second.entry;
+		}
+		string &out = buffer.raw();
+		if (jsonl)
+		{
+			out += "{\"kind\":\"";
+			out += tokenKindNames[size_t(tk.type)];
+			out += "\",\"lexeme\":";
+			appendJsonString(out, tk.lexeme);
+			buffer << ",\"line\":" << tk.lineNumber;
+			if (!tk.scope.empty())
+			{
+				out += ",\"scope\":";
+				appendJsonString(out, tk.scope);
+			}
+			if (entry)
+				buffer << ",\"entry\":" << entry;
+			buffer << "}\n";
+		}
+		else
+		{
+			out += tokenKindNames[size_t(tk.type)];
+			out += '\t';
+			appendTsvField(out, tk.lexeme);
+			buffer << '\t' << tk.lineNumber << '\t';
+			appendTsvField(out, tk.scope);
+			out += '\t';
+			if (entry)
+				buffer << entry;
+			buffer << '\n';
+		}
+	}
+}
+
+void dumpTree(const CompileResult &result, bool jsonl, OutputBuffer &buffer)
+{
+	if (!jsonl)
+		buffer << "id\tparent\tdepth\tlabel\tfolded\n";
+	struct Pending
+	{
+		const ParseTreeNode *node;
+		long long parent;
+		int depth;
+	};
+	vector<Pending> stack;
+	if (result.tree)
+		stack.push_back({result.tree, -1, 0});
+	for (long long id = 0; !stack.empty(); id++)
+	{
+		Pending at = stack.back();
+		stack.pop_back();
+		string &out = buffer.raw();
+		if (jsonl)
+		{
+			buffer << "{\"id\":" << id << ",\"parent\":" << at.parent << ",\"depth\":" << at.depth << ",\"label\":";
+			appendJsonString(out, at.node->label);
+			if (!at.node->folded.empty())
+			{
+				out += ",\"folded\":";
+				appendJsonString(out, at.node->folded);
+			}
+			buffer << "}\n";
+		}
+		else
+		{
+			buffer << id << '\t' << at.parent << '\t' << at.depth << '\t';
+			appendTsvField(out, at.node->label);
+			out += '\t';
+			appendTsvField(out, at.node->folded);
+			buffer << '\n';
+		}
+		const vector<ParseTreeNode *> &children = at.node->children;
+		for (auto child = children.rbegin(); child != children.rend(); ++child)
+			if (*child)
+				stack.push_back({*child, id, at.depth + 1});
+	}
+}
+
+int dumpFile(const string &path, bool tree, const string &format)
+{
+	if (format != "tsv" && format != "jsonl")
+	{
+		cerr << "Unknown format '" << format << "' (expected tsv or jsonl)" << endl;
+		return 1;
+	}
+	string source;
+	try
+	{
+		source = readFile(path);
+	}
+	catch (const exception &e)
+	{
+		cerr << "Error: " << e.what() << endl;
+		return 1;
+	}
+	CompilerSession session(true);
+	CompileResult result = session.compile(source);
+	for (const Error &e : result.lexErrors)
+		e.print(cerr);
+	cerr << result.diagnostics;
+	{
+		PYC_TRACE_SCOPE("dump");
+		OutputBuffer buffer(cout);
+		if (tree)
+			dumpTree(result, format == "jsonl", buffer);
+		else
+			dumpTokens(result, format == "jsonl", buffer);
+	}
+	return result.lexErrors.empty() && result.syntaxErrors == 0 ? 0 : 1;
+}
+} // namespace pyc::detail
@@ -0,0 +1,2033 @@
+#ifndef PYC_ENGINES_H
+#define PYC_ENGINES_H
+
+// Execution: the object model and runtime shared by the bytecode VM, the
+// closure engine and the tree interpreter, the C transpiler and the JIT
+// built on it, ahead-of-time executables and the SSA IR.
+
+#include "FrontEnd.h"
+
+namespace pyc::detail
+{
+// ----------------------------------------------
+// Bytecode runtime values
+// ----------------------------------------------
+enum class ObjKind : uint8_t
+{
+	Str,
+	List,
+	Tuple,
+	Dict,
+	Set,
+	Function,
+	Builtin,
+	Native,
+	Class,
+	Instance,
+	BoundMethod,
+	Module,
+	RangeIter,
+	SeqIter
+};
+
+struct HeapObject
+{
+	uint32_t refs = 0;
+	ObjKind kind;
+
+	explicit HeapObject(ObjKind k) : kind(k) {}
+	virtual ~HeapObject() = default;
+};
+
+// Tagged value with intrusive reference counting for heap objects. Cycles
+// (an instance holding itself) are not collected.
+struct Value
+{
+	enum class Tag : uint8_t
+	{
+		Undefined, // unbound variable
+		None,
+		Bool,
+		Int,
+		Float,
+		Object
+	};
+
+	Tag tag = Tag::None;
+	union
+	{
+		long long i;
+		double f;
+		HeapObject *obj;
+	};
+
+	Value() : i(0) {}
+	explicit Value(HeapObject *o) : tag(Tag::Object), obj(o) { o->refs++; }
+	Value(const Value &other) : tag(other.tag), i(other.i)
+	{
+		if (tag == Tag::Object)
+			obj->refs++;
+	}
+	Value(Value &&other) noexcept : tag(other.tag), i(other.i) { other.tag = Tag::None; }
+	~Value() { release(); }
+
+	Value &operator=(const Value &other)
+	{
+		if (other.tag == Tag::Object)
+			other.obj->refs++;
+		release();
+		tag = other.tag;
+		i = other.i;
+		return *this;
+	}
+	Value &operator=(Value &&other) noexcept
+	{
+		if (this != &other)
+		{
+			release();
+			tag = other.tag;
+			i = other.i;
+			other.tag = Tag::None;
+		}
+		return *this;
+	}
+
+	static Value undefined()
+	{
+		Value v;
+		v.tag = Tag::Undefined;
+		return v;
+	}
+	static Value boolean(bool b)
+	{
+		Value v;
+		v.tag = Tag::Bool;
+		v.i = b;
+		return v;
+	}
+	static Value integer(long long n)
+	{
+		Value v;
+		v.tag = Tag::Int;
+		v.i = n;
+		return v;
+	}
+	static Value number(double d)
+	{
+		Value v;
+		v.tag = Tag::Float;
+		v.f = d;
+		return v;
+	}
+
+	bool isObject(ObjKind k) const { return tag == Tag::Object && obj->kind == k; }
+	bool isIntLike() const { return tag == Tag::Int || tag == Tag::Bool; }
+	bool isNumber() const { return isIntLike() || tag == Tag::Float; }
+	double asDouble() const { return tag == Tag::Float ? f : static_cast<double>(i); }
+
+	void setInt(long long n)
+	{
+		release();
+		tag = Tag::Int;
+		i = n;
+	}
+
+private:
+	void release()
+	{
+		if (tag == Tag::Object && --obj->refs == 0)
+			delete obj;
+	}
+};
+
+struct StrObject : HeapObject
+{
+	string s;
+	explicit StrObject(string str) : HeapObject(ObjKind::Str), s(move(str)) {}
+};
+
+struct ListObject : HeapObject
+{
+	vector<Value> items;
+	explicit ListObject(ObjKind k = ObjKind::List) : HeapObject(k) {}
+};
+
+struct ValueHash
+{
+	size_t operator()(const Value &v) const;
+};
+
+struct ValueEqual
+{
+	bool operator()(const Value &a, const Value &b) const;
+};
+
+// Insertion-ordered like Python dicts; sets use the same layout without values
+struct DictObject : HeapObject
+{
+	vector<pair<Value, Value>> entries;
+	unordered_map<Value, size_t, ValueHash, ValueEqual> index;
+	explicit DictObject(ObjKind k = ObjKind::Dict) : HeapObject(k) {}
+
+	void set(const Value &key, const Value &value)
+	{
+		auto it = index.find(key);
+		if (it != index.end())
+		{
+			entries[it->second].second = value;
+			return;
+		}
+		index.emplace(key, entries.size());
+		entries.push_back({key, value});
+	}
+
+	const Value *get(const Value &key) const
+	{
+		auto it = index.find(key);
+		return it == index.end() ? nullptr : &entries[it->second].second;
+	}
+};
+
+struct CodeObject;
+struct ClosureFunction;
+
+// A def compiled by either the bytecode compiler (code) or the closure engine (closure)
+struct FunctionObject : HeapObject
+{
+	const CodeObject *code = nullptr;
+	const ClosureFunction *closure = nullptr;
+	vector<Value> defaults;
+	explicit FunctionObject(const CodeObject *c) : HeapObject(ObjKind::Function), code(c) {}
+	explicit FunctionObject(const ClosureFunction *f) : HeapObject(ObjKind::Function), closure(f) {}
+};
+
+class Runtime;
+using BuiltinFn = Value (*)(Runtime &, Value *args, int argc);
+
+struct BuiltinObject : HeapObject
+{
+	string name;
+	BuiltinFn fn;
+	BuiltinObject(string n, BuiltinFn f) : HeapObject(ObjKind::Builtin), name(move(n)), fn(f) {}
+};
+
+// Argument and result cells of transpiled C functions (see CTranspiler)
+union NativeSlot
+{
+	long long i;
+	double f;
+};
+
+// Returns a NativeStatus; on failure 'message' is the exception text
+using NativeEntry = int (*)(const NativeSlot *args, NativeSlot *result, const char **message);
+
+enum NativeStatus
+{
+	NativeOk,
+	NativeZeroDivision,
+	NativeOverflow,
+	NativeValueError,
+	NativeRecursion
+};
+
+// A def compiled to machine code. The signature has one type code per
+// parameter, '>' and the result code: i = int, f = float, b = bool
+// ("ii>i"). Calls whose argument types differ go to 'fallback', the same
+// function compiled to bytecode.
+struct NativeObject : HeapObject
+{
+	static const size_t maxParams = 16;
+
+	string name;
+	string signature;
+	NativeEntry entry;
+	Value fallback;
+	NativeObject(string n, string sig, NativeEntry e, Value f)
+		: HeapObject(ObjKind::Native), name(move(n)), signature(move(sig)), entry(e), fallback(move(f))
+	{
+	}
+
+	int arity() const { return static_cast<int>(signature.size()) - 2; }
+
+	bool accepts(const Value *args, int argc) const
+	{
+		if (argc != arity())
+			return false;
+		for (int k = 0; k < argc; k++)
+		{
+			char code = signature[k];
+			Value::Tag want = code == 'i' ? Value::Tag::Int : code == 'f' ? Value::Tag::Float : Value::Tag::Bool;
+			if (args[k].tag != want)
+				return false;
+		}
+		return true;
+	}
+};
+
+// Attributes are keyed by interned name ids (see NameTable::attrIds)
+struct ClassObject : HeapObject
+{
+	string name;
+	Value base;
+	unordered_map<uint32_t, Value> attrs;
+	explicit ClassObject(string n) : HeapObject(ObjKind::Class), name(move(n)) {}
+
+	const Value *lookup(uint32_t id) const
+	{
+		for (const ClassObject *cls = this; cls;
+			 cls = cls->base.isObject(ObjKind::Class) ? static_cast<ClassObject *>(cls->base.obj) : nullptr)
+		{
+			auto it = cls->attrs.find(id);
+			if (it != cls->attrs.end())
+				return &it->second;
+		}
+		return nullptr;
+	}
+
+	bool derivesFrom(const ClassObject *other) const
+	{
+		for (const ClassObject *cls = this; cls;
+			 cls = cls->base.isObject(ObjKind::Class) ? static_cast<ClassObject *>(cls->base.obj) : nullptr)
+			if (cls == other)
+				return true;
+		return false;
+	}
+};
+
+// Instances keep a short flat attribute list; linear search beats hashing
+// for the handful of fields a typical object has.
+struct InstanceObject : HeapObject
+{
+	Value cls;
+	vector<pair<uint32_t, Value>> attrs;
+	explicit InstanceObject(const Value &c) : HeapObject(ObjKind::Instance), cls(c) {}
+
+	Value *find(uint32_t id)
+	{
+		for (auto &attr : attrs)
+			if (attr.first == id)
+				return &attr.second;
+		return nullptr;
+	}
+
+	void set(uint32_t id, const Value &v)
+	{
+		if (Value *slot = find(id))
+			*slot = v;
+		else
+			attrs.push_back({id, v});
+	}
+
+	ClassObject *classObject() const { return static_cast<ClassObject *>(cls.obj); }
+};
+
+struct BoundMethodObject : HeapObject
+{
+	Value self;
+	Value function;
+	BoundMethodObject(const Value &s, const Value &f) : HeapObject(ObjKind::BoundMethod), self(s), function(f) {}
+};
+
+struct ModuleObject : HeapObject
+{
+	string name;
+	unordered_map<uint32_t, Value> attrs;
+	explicit ModuleObject(string n) : HeapObject(ObjKind::Module), name(move(n)) {}
+};
+
+struct RangeIterObject : HeapObject
+{
+	long long next, stop, step;
+	RangeIterObject(long long start, long long end, long long by)
+		: HeapObject(ObjKind::RangeIter), next(start), stop(end), step(by) {}
+};
+
+struct SeqIterObject : HeapObject
+{
+	Value seq; // list, tuple or str
+	size_t index = 0;
+	explicit SeqIterObject(const Value &s) : HeapObject(ObjKind::SeqIter), seq(s) {}
+};
+
+// Raised Python exceptions travel through the VM as C++ exceptions
+struct PyException
+{
+	Value exc;
+};
+
+bool valuesEqual(const Value &a, const Value &b);
+
+Value makeString(string s);
+
+bool isTruthy(const Value &v);
+
+string typeNameOf(const Value &v);
+
+string valueToString(const Value &v, bool quoteStrings = false);
+
+// ----------------------------------------------
+// Bytecode compiler
+// ----------------------------------------------
+#define BYTECODE_OPS(X)                                                     \
+	X(LOADK)		/* R[a] = K[bx] */                                      \
+	X(LOADNONE)		/* R[a] = None */                                       \
+	X(MOVE)			/* R[a] = R[b] */                                       \
+	X(LOADGLOBAL)	/* R[a] = G[bx] */                                      \
+	X(STOREGLOBAL)	/* G[bx] = R[a] */                                      \
+	X(CHECKLOCAL)	/* NameError unless local R[a] is bound, name = K[bx] */ \
+	X(ADD)			/* R[a] = RK[b] + RK[c], likewise up to GE */           \
+	X(SUB)                                                                  \
+	X(MUL)                                                                  \
+	X(DIV)                                                                  \
+	X(MOD)                                                                  \
+	X(FLOORDIV)                                                             \
+	X(POW)                                                                  \
+	X(BITAND)                                                               \
+	X(BITOR)                                                                \
+	X(BITXOR)                                                               \
+	X(SHL)                                                                  \
+	X(SHR)                                                                  \
+	X(EQ)                                                                   \
+	X(NE)                                                                   \
+	X(LT)                                                                   \
+	X(LE)                                                                   \
+	X(GT)                                                                   \
+	X(GE)                                                                   \
+	X(IN)                                                                   \
+	X(NOTIN)                                                                \
+	X(IS)                                                                   \
+	X(ISNOT)                                                                \
+	X(NEG)			/* R[a] = -RK[b], likewise POS, INVERT, NOT */          \
+	X(POS)                                                                  \
+	X(INVERT)                                                               \
+	X(NOT)                                                                  \
+	X(JMP)			/* pc = bx */                                           \
+	X(JMPIF)		/* if R[a]: pc = bx */                                  \
+	X(JMPIFNOT)		/* if not R[a]: pc = bx */                              \
+	X(LTJMPIFNOT)	/* if not RK[b] < RK[c]: pc = EXTRA */                  \
+	X(CALL)			/* R[a] = R[b](R[b+1] .. R[b+c]) */                     \
+	X(CALLMETHOD)	/* R[a] = R[b].name(R[b+1] .. R[b+c]), name = EXTRA */  \
+	X(GETATTR)		/* R[a] = R[b].name[c] */                               \
+	X(SETATTR)		/* R[a].name[b] = RK[c] */                              \
+	X(BUILDLIST)	/* R[a] = [R[b] .. R[b+c-1]] */                         \
+	X(BUILDTUPLE)                                                           \
+	X(BUILDSET)                                                             \
+	X(BUILDDICT)	/* R[a] = {R[b]: R[b+1], ...} with c pairs */           \
+	X(ITER)			/* R[a] = iter(R[b]) */                                 \
+	X(FORITER)		/* R[a] = next(R[b]) or pc = EXTRA when exhausted */    \
+	X(MAKEFUNC)		/* R[a] = function(code b, defaults R[c] ..) */         \
+	X(MAKENATIVE)	/* R[a] = native K[b] falling back to R[a] */           \
+	X(MAKECLASS)	/* R[a] = class(name K[b], base R[c] or NO_REG) */      \
+	X(RETURN)		/* return RK[a] */                                      \
+	X(RAISE)		/* raise R[a] */                                        \
+	X(RERAISE)		/* re-raise the exception in R[a] */                    \
+	X(EXCMATCH)		/* R[a] = R[b] is an instance of class R[c] */          \
+	X(IMPORT)		/* R[a] = module K[bx] */                               \
+	X(EXTRA)		/* operand word of the previous instruction */
+
+enum class Op : uint8_t
+{
+#define BYTECODE_ENUM(name) name,
+	BYTECODE_OPS(BYTECODE_ENUM)
+#undef BYTECODE_ENUM
+};
+
+const uint16_t RK_CONSTANT = 0x8000;
+const uint16_t NO_REG = 0xFFFF;
+
+struct Instr
+{
+	Op op;
+	uint16_t a = 0;
+	uint16_t b = 0;
+	uint16_t c = 0;
+
+	uint32_t bx() const { return b | (static_cast<uint32_t>(c) << 16); }
+	void setBx(uint32_t v)
+	{
+		b = static_cast<uint16_t>(v & 0xFFFF);
+		c = static_cast<uint16_t>(v >> 16);
+	}
+};
+
+// Instructions in [start, end) jump to 'target' on an exception, which is
+// stored in register 'reg'. Inner handlers come first.
+struct ExceptionHandler
+{
+	uint32_t start;
+	uint32_t end;
+	uint32_t target;
+	uint16_t reg;
+};
+
+struct CodeObject
+{
+	string name;
+	vector<Instr> code;
+	vector<Value> constants;
+	vector<ExceptionHandler> handlers;
+	uint16_t numParams = 0;
+	uint16_t numDefaults = 0;
+	uint16_t numRegisters = 0;
+};
+
+// Interned global and attribute names, shared by compiled code and the runtime
+struct NameTable
+{
+	vector<string> globalNames;
+	unordered_map<string, uint32_t> globalSlots;
+	vector<string> attrNames;
+	unordered_map<string, uint32_t> attrIds;
+
+	uint32_t globalSlot(const string &name)
+	{
+		auto [it, inserted] = globalSlots.emplace(name, globalNames.size());
+		if (inserted)
+			globalNames.push_back(name);
+		return it->second;
+	}
+
+	uint32_t attrId(const string &name)
+	{
+		auto [it, inserted] = attrIds.emplace(name, attrNames.size());
+		if (inserted)
+			attrNames.push_back(name);
+		return it->second;
+	}
+};
+
+struct Program : NameTable
+{
+	vector<unique_ptr<CodeObject>> codes; // codes[0] is the module body
+};
+
+class CompileError : public runtime_error
+{
+public:
+	using runtime_error::runtime_error;
+};
+
+// Operator spelling as found in the parse tree -> opcode
+Op binaryOpFor(const string &op);
+
+bool isComparisonOp(Op op);
+
+// Runtime value of a folded or literal constant
+Value constToValue(const ConstValue &v);
+
+// Lowers the Syntax_Analyzer tree. Module-level names live in global slots;
+// inside a function, parameters and every name the body binds get fixed
+// registers, and temporaries are allocated stack-wise above them. Nested
+// functions see their own locals and module globals, but not the locals of
+// the enclosing function.
+class BytecodeCompiler
+{
+public:
+	// Prototype NativeObjects for module-level defs that were transpiled to C
+	unordered_map<string, Value> natives;
+
+	Program compile(ParseTreeNode *root);
+
+private:
+	struct LoopInfo
+	{
+		uint32_t continueTarget;
+		vector<size_t> breakJumps;
+		size_t regionDepth;
+	};
+
+	struct Region
+	{
+		uint16_t reg;
+		vector<pair<uint32_t, uint32_t>> segments;
+		uint32_t openStart;
+		bool open = true;
+		ParseTreeNode *finallyBlock = nullptr;
+	};
+
+	struct FunctionState
+	{
+		CodeObject *code;
+		bool isModule = false;
+		unordered_map<string, uint16_t> locals;
+		unordered_set<string> assigned; // locals bound on every path to this point
+		uint16_t numLocals = 0;
+		uint16_t tempTop = 0;
+		uint16_t maxRegisters = 0;
+		vector<LoopInfo> loops;
+		vector<Region> regions;
+		uint32_t lastLabel = UINT32_MAX;
+		unordered_map<string, uint16_t> stringConstants;
+		unordered_map<long long, uint16_t> intConstants;
+	};
+
+	Program program;
+	FunctionState *fn = nullptr;
+
+	// --- emission helpers ---------------------------------------------
+
+	uint32_t here() const { return static_cast<uint32_t>(fn->code->code.size()); }
+
+	size_t emit(Op op, uint16_t a = 0, uint16_t b = 0, uint16_t c = 0);
+
+	size_t emitBx(Op op, uint16_t a, uint32_t bx);
+
+	void patch(size_t at, uint32_t target) { fn->code->code[at].setBx(target); }
+
+	uint32_t markLabel();
+
+	void patchHere(size_t at) { patch(at, markLabel()); }
+
+	uint16_t allocTemp(uint16_t count = 1);
+
+	bool isTemp(uint16_t r) const { return r < RK_CONSTANT && r >= fn->numLocals; }
+
+	uint16_t addConstant(const Value &v);
+
+	// RK operand for a constant, or a register loaded with it if the index is too big
+	uint16_t constantOperand(const Value &v);
+
+	uint16_t toRegister(uint16_t operand);
+
+	static bool writesRegisterA(Op op);
+
+	// Puts the value of 'node' into register 'dest'. When the value was
+	// just computed into a temporary by a single instruction that no jump
+	// lands after, that instruction is retargeted instead of adding a MOVE.
+	void compileInto(ParseTreeNode *node, uint16_t dest);
+
+	void moveInto(uint16_t r, uint16_t dest);
+
+	void finish(FunctionState &state);
+
+	// --- names ----------------------------------------------------------
+
+	bool isLocal(const string &name, uint16_t &reg) const;
+
+	uint16_t loadName(const string &name);
+
+	void storeName(const string &name, uint16_t src);
+
+	void assignExpr(const string &name, ParseTreeNode *expr);
+
+	// --- statements -----------------------------------------------------
+
+	static bool isLeaf(const ParseTreeNode *node) { return node->children.empty(); }
+
+	void compileStatements(ParseTreeNode *list);
+
+	// Compiles a block that may not run, or may stop part way through:
+	// the locals it binds are still unknown after it
+	void compileBranch(ParseTreeNode *list);
+
+	void compileStatement(ParseTreeNode *node);
+
+	void compileAssignment(ParseTreeNode *node);
+
+	// Stores either the expression 'value' or the register '*reg' into a name or attribute
+	void storeTarget(ParseTreeNode *target, ParseTreeNode *value, const uint16_t *reg);
+
+	// For a.b.c, evaluates a.b and returns its register
+	uint16_t compileAttributeOwner(ParseTreeNode *dotted);
+
+	// Emits a conditional jump taken when 'cond' is false and returns its index
+	size_t compileBranchIfFalse(ParseTreeNode *cond);
+
+	void compileConditional(ParseTreeNode *node);
+
+	void compileWhile(ParseTreeNode *node);
+
+	void compileFor(ParseTreeNode *node);
+
+	// --- try / except / finally ----------------------------------------
+
+	void pushRegion(ParseTreeNode *finallyBlock);
+
+	void closeSegment(Region &region);
+
+	// Registers the region's handlers and returns its exception register
+	Region popRegion(uint32_t handlerTarget);
+
+	// Leaving regions [depth, top) by a jump: their finally blocks run
+	// first, each outside the protection of the regions being left.
+	void exitRegions(size_t depth);
+
+	void reopenRegions(size_t depth);
+
+	void compileTry(ParseTreeNode *node);
+
+	// --- definitions ----------------------------------------------------
+
+	// Compiles a def into its own code object and returns a register holding the function
+	uint16_t compileFunction(ParseTreeNode *node);
+
+	void compileClass(ParseTreeNode *node);
+
+	void compileImport(ParseTreeNode *node);
+
+	// --- expressions ----------------------------------------------------
+
+	// Calls put the callee (or receiver) and the arguments in consecutive registers
+	uint16_t compileCallParts(ParseTreeNode *callee, ParseTreeNode *arguments);
+
+	uint16_t compileCall(ParseTreeNode *node);
+
+	uint16_t resultRegister(uint16_t left);
+
+	// Returns an RK operand holding the value of 'node'
+	uint16_t compileExpr(ParseTreeNode *node);
+
+	uint16_t compileComparison(ParseTreeNode *node);
+
+	uint16_t buildSequence(Op op, const vector<ParseTreeNode *> &items);
+
+	uint16_t compileFactor(ParseTreeNode *node);
+};
+
+void disassemble(const Program &program, ostream &out);
+
+// ----------------------------------------------
+// Runtime
+// ----------------------------------------------
+// Object model shared by the execution engines: globals, builtins, the
+// exception hierarchy and the semantics of every operator.
+class Runtime
+{
+public:
+	// Output of print(); flushed to stdout unless captureOutput is set
+	string output;
+	bool captureOutput = false;
+
+	// Every global name the program uses must be interned before construction
+	explicit Runtime(NameTable &nameTable) : names(nameTable)
+	{
+		globals.assign(names.globalNames.size(), Value::undefined());
+		initBuiltins();
+	}
+
+	virtual ~Runtime() { flushOutput(); }
+
+	Value global(const string &name) const
+	{
+		auto it = names.globalSlots.find(name);
+		return it == names.globalSlots.end() ? Value::undefined() : globals[it->second];
+	}
+
+	void flushOutput()
+	{
+		if (!captureOutput && !output.empty())
+		{
+			cout << output;
+			cout.flush();
+			output.clear();
+		}
+	}
+
+	[[noreturn]] void raise(const string &className, const string &message)
+	{
+		Value cls = exceptionClasses.at(className);
+		auto *exc = new InstanceObject(cls);
+		Value instance(exc);
+		auto *args = new ListObject(ObjKind::Tuple);
+		exc->set(argsId, Value(args));
+		args->items.push_back(makeString(message));
+		throw PyException{instance};
+	}
+
+	// str() that also knows how to print exception instances
+	string str(const Value &v)
+	{
+		if (v.isObject(ObjKind::Instance) && isException(v))
+		{
+			Value *args = static_cast<InstanceObject *>(v.obj)->find(argsId);
+			if (!args || !args->isObject(ObjKind::Tuple))
+				return "";
+			auto &items = static_cast<ListObject *>(args->obj)->items;
+			if (items.empty())
+				return "";
+			return items.size() == 1 ? str(items[0]) : valueToString(*args, true);
+		}
+		return valueToString(v, false);
+	}
+
+	string describeException(const Value &exc)
+	{
+		string message = str(exc);
+		return typeNameOf(exc) + (message.empty() ? "" : ": " + message);
+	}
+
+	bool isException(const Value &v) const
+	{
+		if (!v.isObject(ObjKind::Instance))
+			return false;
+		return static_cast<InstanceObject *>(v.obj)->classObject()->derivesFrom(
+			static_cast<ClassObject *>(exceptionClasses.at("BaseException").obj));
+	}
+
+	// Materializes any iterable into a vector (list(), sum(), min() ...)
+	vector<Value> iterate(const Value &v)
+	{
+		vector<Value> out;
+		Value it = makeIterator(v);
+		Value item;
+		while (iteratorNext(it, item))
+			out.push_back(item);
+		return out;
+	}
+
+	NameTable &names;
+
+protected:
+	static const size_t maxDepth = 2000;
+
+	vector<Value> globals;
+	unordered_map<string, Value> exceptionClasses;
+	unordered_map<string, Value> modules;
+	uint32_t argsId = 0, initId = 0;
+
+	enum class Method
+	{
+		Append,
+		Pop,
+		Extend,
+		Insert,
+		Index,
+		Count,
+		Upper,
+		Lower,
+		Strip,
+		Split,
+		Join,
+		Replace,
+		StartsWith,
+		EndsWith,
+		Find,
+		Get,
+		Keys,
+		Values,
+		Items,
+		Add
+	};
+	unordered_map<uint32_t, Method> builtinMethods;
+
+	void initBuiltins();
+
+public:
+	Value callBuiltinMethod(const Value &receiver, uint32_t name, Value *args, int argc);
+
+	Value loadGlobal(uint32_t slot)
+	{
+		const Value &v = globals[slot];
+		if (v.tag == Value::Tag::Undefined)
+			raise("NameError", "name '" + names.globalNames[slot] + "' is not defined");
+		return v;
+	}
+
+	void storeGlobal(uint32_t slot, const Value &v) { globals[slot] = v; }
+
+	Value importModule(const string &name)
+	{
+		auto it = modules.find(name);
+		if (it == modules.end())
+			raise("ImportError", "No module named '" + name + "'");
+		return it->second;
+	}
+
+	// Runs transpiled C code; the arguments must satisfy native.accepts()
+	Value callNative(const NativeObject &native, const Value *args)
+	{
+		NativeSlot slots[NativeObject::maxParams], result;
+		for (int k = 0; k < native.arity(); k++)
+		{
+			if (native.signature[k] == 'f')
+				slots[k].f = args[k].f;
+			else
+				slots[k].i = args[k].i;
+		}
+		const char *message = "";
+		switch (native.entry(slots, &result, &message))
+		{
+		case NativeOk:
+			break;
+		case NativeZeroDivision:
+			raise("ZeroDivisionError", message);
+		case NativeOverflow:
+			raise("OverflowError", message);
+		case NativeValueError:
+			raise("ValueError", message);
+		default:
+			raise("RecursionError", message);
+		}
+		char type = native.signature.back();
+		return type == 'f' ? Value::number(result.f) : type == 'b' ? Value::boolean(result.i != 0) : Value::integer(result.i);
+	}
+
+	// raise statement: a class is instantiated without arguments
+	[[noreturn]] void raiseValue(Value exc)
+	{
+		if (exc.isObject(ObjKind::Class))
+		{
+			auto *instance = new InstanceObject(exc);
+			exc = Value(instance);
+			instance->set(argsId, Value(new ListObject(ObjKind::Tuple)));
+		}
+		if (!isException(exc))
+			raise("TypeError", "exceptions must derive from BaseException");
+		throw PyException{exc};
+	}
+
+	// except clause test
+	bool exceptionMatches(const Value &exc, const Value &cls)
+	{
+		if (!cls.isObject(ObjKind::Class))
+			raise("TypeError", "catching classes that do not inherit from BaseException is not allowed");
+		return exc.isObject(ObjKind::Instance) &&
+			   static_cast<InstanceObject *>(exc.obj)->classObject()->derivesFrom(static_cast<ClassObject *>(cls.obj));
+	}
+
+	Value makeIterator(const Value &v)
+	{
+		if (v.tag == Value::Tag::Object)
+		{
+			switch (v.obj->kind)
+			{
+			case ObjKind::RangeIter:
+			{
+				auto *r = static_cast<RangeIterObject *>(v.obj);
+				return Value(new RangeIterObject(r->next, r->stop, r->step));
+			}
+			case ObjKind::List:
+			case ObjKind::Tuple:
+			case ObjKind::Str:
+				return Value(new SeqIterObject(v));
+			case ObjKind::Dict:
+			case ObjKind::Set:
+			{
+				auto *keys = new ListObject();
+				Value list(keys);
+				for (auto &entry : static_cast<DictObject *>(v.obj)->entries)
+					keys->items.push_back(entry.first);
+				return Value(new SeqIterObject(list));
+			}
+			case ObjKind::SeqIter:
+				return v;
+			default:
+				break;
+			}
+		}
+		raise("TypeError", "'" + typeNameOf(v) + "' object is not iterable");
+	}
+
+	bool iteratorNext(Value &it, Value &out)
+	{
+		if (it.isObject(ObjKind::RangeIter))
+		{
+			auto *r = static_cast<RangeIterObject *>(it.obj);
+			if (r->step > 0 ? r->next >= r->stop : r->next <= r->stop)
+				return false;
+			out.setInt(r->next);
+			r->next += r->step;
+			return true;
+		}
+		auto *s = static_cast<SeqIterObject *>(it.obj);
+		if (s->seq.isObject(ObjKind::Str))
+		{
+			const string &str = static_cast<StrObject *>(s->seq.obj)->s;
+			if (s->index >= str.size())
+				return false;
+			out = makeString(string(1, str[s->index++]));
+			return true;
+		}
+		auto &items = static_cast<ListObject *>(s->seq.obj)->items;
+		if (s->index >= items.size())
+			return false;
+		out = items[s->index++];
+		return true;
+	}
+
+	static long long checkedShift(Runtime &rt, long long x, long long n, bool left)
+	{
+		if (n < 0)
+			rt.raise("ValueError", "negative shift count");
+		if (!left)
+			return n >= 64 ? (x < 0 ? -1 : 0) : x >> n;
+		if (n >= 63 || (x != 0 && ((x << n) >> n) != x))
+			rt.raise("OverflowError", "integer result too large");
+		return x << n;
+	}
+
+	// Every binary operator on the non-fast paths, with Python semantics.
+	// Integers are 64-bit; overflow raises OverflowError instead of promoting.
+	Value binarySlow(Op op, const Value &x, const Value &y)
+	{
+		if (x.tag == Value::Tag::Undefined || y.tag == Value::Tag::Undefined)
+			raise("NameError", "local variable referenced before assignment");
+		switch (op)
+		{
+		case Op::EQ:
+			return Value::boolean(valuesEqual(x, y));
+		case Op::NE:
+			return Value::boolean(!valuesEqual(x, y));
+		case Op::IS:
+		case Op::ISNOT:
+		{
+			bool same = x.tag == y.tag && (x.tag != Value::Tag::Object ? x.i == y.i || x.tag == Value::Tag::None : x.obj == y.obj);
+			return Value::boolean(op == Op::IS ? same : !same);
+		}
+		case Op::IN:
+		case Op::NOTIN:
+			return Value::boolean(contains(y, x) == (op == Op::IN));
+		default:
+			break;
+		}
+
+		if (x.isNumber() && y.isNumber())
+			return numericSlow(op, x, y);
+
+		bool xStr = x.isObject(ObjKind::Str), yStr = y.isObject(ObjKind::Str);
+		if (op >= Op::LT && op <= Op::GE && xStr && yStr)
+		{
+			int cmp = static_cast<StrObject *>(x.obj)->s.compare(static_cast<StrObject *>(y.obj)->s);
+			return Value::boolean(op == Op::LT ? cmp < 0 : op == Op::LE ? cmp <= 0 : op == Op::GT ? cmp > 0 : cmp >= 0);
+		}
+		if (op == Op::ADD && xStr && yStr)
+			return makeString(static_cast<StrObject *>(x.obj)->s + static_cast<StrObject *>(y.obj)->s);
+		bool xSeq = x.isObject(ObjKind::List) || x.isObject(ObjKind::Tuple);
+		if (op >= Op::LT && op <= Op::GE && xSeq && y.tag == Value::Tag::Object && y.obj->kind == x.obj->kind)
+		{
+			// Lexicographic: the first items that differ decide, else the lengths
+			auto &a = static_cast<ListObject *>(x.obj)->items, &b = static_cast<ListObject *>(y.obj)->items;
+			size_t k = 0;
+			while (k < a.size() && k < b.size() && valuesEqual(a[k], b[k]))
+				k++;
+			if (k < a.size() && k < b.size())
+				return binarySlow(op, a[k], b[k]);
+			int cmp = (a.size() > b.size()) - (a.size() < b.size());
+			return Value::boolean(op == Op::LT ? cmp < 0 : op == Op::LE ? cmp <= 0 : op == Op::GT ? cmp > 0 : cmp >= 0);
+		}
+		if (op == Op::ADD && xSeq && y.tag == Value::Tag::Object && y.obj->kind == x.obj->kind)
+		{
+			auto *result = new ListObject(x.obj->kind);
+			Value v(result);
+			result->items = static_cast<ListObject *>(x.obj)->items;
+			auto &more = static_cast<ListObject *>(y.obj)->items;
+			result->items.insert(result->items.end(), more.begin(), more.end());
+			return v;
+		}
+		if (op == Op::MUL && (xStr || xSeq) && y.isIntLike())
+			return repeat(x, y.i);
+		if (op == Op::MUL && x.isIntLike() && (yStr || y.isObject(ObjKind::List) || y.isObject(ObjKind::Tuple)))
+			return repeat(y, x.i);
+
+		static const char *symbols[] = {"+", "-", "*", "/", "%", "//", "**", "&", "|", "^", "<<", ">>", "==", "!=", "<", "<=", ">", ">="};
+		size_t index = static_cast<size_t>(op) - static_cast<size_t>(Op::ADD);
+		raise("TypeError", string("unsupported operand type(s) for ") + (index < 18 ? symbols[index] : "?") +
+							   ": '" + typeNameOf(x) + "' and '" + typeNameOf(y) + "'");
+	}
+
+	Value repeat(const Value &seq, long long count)
+	{
+		if (seq.isObject(ObjKind::Str))
+		{
+			const string &s = static_cast<StrObject *>(seq.obj)->s;
+			string out;
+			if (count > 0)
+			{
+				out.reserve(s.size() * count);
+				for (long long k = 0; k < count; k++)
+					out += s;
+			}
+			return makeString(move(out));
+		}
+		auto *result = new ListObject(seq.obj->kind);
+		Value v(result);
+		auto &items = static_cast<ListObject *>(seq.obj)->items;
+		for (long long k = 0; k < count; k++)
+			result->items.insert(result->items.end(), items.begin(), items.end());
+		return v;
+	}
+
+	Value numericSlow(Op op, const Value &x, const Value &y)
+	{
+		if (x.isIntLike() && y.isIntLike())
+		{
+			long long a = x.i, b = y.i, r = 0;
+			bool bothBool = x.tag == Value::Tag::Bool && y.tag == Value::Tag::Bool;
+			switch (op)
+			{
+			case Op::ADD:
+				if (__builtin_add_overflow(a, b, &r))
+					raise("OverflowError", "integer result too large");
+				return Value::integer(r);
+			case Op::SUB:
+				if (__builtin_sub_overflow(a, b, &r))
+					raise("OverflowError", "integer result too large");
+				return Value::integer(r);
+			case Op::MUL:
+				if (__builtin_mul_overflow(a, b, &r))
+					raise("OverflowError", "integer result too large");
+				return Value::integer(r);
+			case Op::DIV:
+				if (b == 0)
+					raise("ZeroDivisionError", "division by zero");
+				return Value::number(static_cast<double>(a) / static_cast<double>(b));
+			case Op::MOD:
+				if (b == 0)
+					raise("ZeroDivisionError", "integer modulo by zero");
+				r = b == -1 ? 0 : a % b;
+				if (r != 0 && ((r < 0) != (b < 0)))
+					r += b;
+				return Value::integer(r);
+			case Op::FLOORDIV:
+				if (b == 0)
+					raise("ZeroDivisionError", "integer division or modulo by zero");
+				if (a == LLONG_MIN && b == -1)
+					raise("OverflowError", "integer result too large");
+				r = a / b;
+				if ((a % b != 0) && ((a < 0) != (b < 0)))
+					r--;
+				return Value::integer(r);
+			case Op::POW:
+			{
+				if (b < 0)
+					return Value::number(pow(static_cast<double>(a), static_cast<double>(b)));
+				long long result = 1;
+				for (long long base = a; b > 0; b >>= 1)
+				{
+					if ((b & 1) && __builtin_mul_overflow(result, base, &result))
+						raise("OverflowError", "integer result too large");
+					if (b > 1 && __builtin_mul_overflow(base, base, &base))
+						raise("OverflowError", "integer result too large");
+				}
+				return Value::integer(result);
+			}
+			case Op::BITAND:
+				return bothBool ? Value::boolean(a & b) : Value::integer(a & b);
+			case Op::BITOR:
+				return bothBool ? Value::boolean(a | b) : Value::integer(a | b);
+			case Op::BITXOR:
+				return bothBool ? Value::boolean(a ^ b) : Value::integer(a ^ b);
+			case Op::SHL:
+				return Value::integer(checkedShift(*this, a, b, true));
+			case Op::SHR:
+				return Value::integer(checkedShift(*this, a, b, false));
+			case Op::LT:
+				return Value::boolean(a < b);
+			case Op::LE:
+				return Value::boolean(a <= b);
+			case Op::GT:
+				return Value::boolean(a > b);
+			case Op::GE:
+				return Value::boolean(a >= b);
+			default:
+				break;
+			}
+		}
+		else
+		{
+			double a = x.asDouble(), b = y.asDouble(), r;
+			switch (op)
+			{
+			case Op::ADD:
+				return Value::number(a + b);
+			case Op::SUB:
+				return Value::number(a - b);
+			case Op::MUL:
+				return Value::number(a * b);
+			case Op::DIV:
+				if (b == 0.0)
+					raise("ZeroDivisionError", "float division by zero");
+				return Value::number(a / b);
+			case Op::MOD:
+				if (b == 0.0)
+					raise("ZeroDivisionError", "float modulo");
+				r = fmod(a, b);
+				if (r != 0 && ((r < 0) != (b < 0)))
+					r += b;
+				return Value::number(r);
+			case Op::FLOORDIV:
+				if (b == 0.0)
+					raise("ZeroDivisionError", "float floor division by zero");
+				return Value::number(floor(a / b));
+			case Op::POW:
+				if (a == 0.0 && b < 0)
+					raise("ZeroDivisionError", "0.0 cannot be raised to a negative power");
+				return Value::number(pow(a, b));
+			case Op::LT:
+				return Value::boolean(a < b);
+			case Op::LE:
+				return Value::boolean(a <= b);
+			case Op::GT:
+				return Value::boolean(a > b);
+			case Op::GE:
+				return Value::boolean(a >= b);
+			default:
+				break;
+			}
+		}
+		raise("TypeError", "unsupported operand type(s) for '" + typeNameOf(x) + "' and '" + typeNameOf(y) + "'");
+	}
+
+	bool contains(const Value &container, const Value &item)
+	{
+		if (container.isObject(ObjKind::Str))
+		{
+			if (!item.isObject(ObjKind::Str))
+				raise("TypeError", "'in <string>' requires string as left operand");
+			return static_cast<StrObject *>(container.obj)->s.find(static_cast<StrObject *>(item.obj)->s) != string::npos;
+		}
+		if (container.isObject(ObjKind::List) || container.isObject(ObjKind::Tuple))
+		{
+			for (const Value &v : static_cast<ListObject *>(container.obj)->items)
+				if (valuesEqual(v, item))
+					return true;
+			return false;
+		}
+		if (container.isObject(ObjKind::Dict) || container.isObject(ObjKind::Set))
+			return static_cast<DictObject *>(container.obj)->get(item) != nullptr;
+		if (container.isObject(ObjKind::RangeIter))
+		{
+			auto *r = static_cast<RangeIterObject *>(container.obj);
+			if (!item.isIntLike())
+				return false;
+			if (r->step > 0 ? item.i < r->next || item.i >= r->stop : item.i > r->next || item.i <= r->stop)
+				return false;
+			return (item.i - r->next) % r->step == 0;
+		}
+		raise("TypeError", "argument of type '" + typeNameOf(container) + "' is not iterable");
+	}
+
+	Value unarySlow(Op op, const Value &x)
+	{
+		if (op == Op::NOT)
+			return Value::boolean(!isTruthy(x));
+		if (x.tag == Value::Tag::Float)
+		{
+			if (op == Op::NEG)
+				return Value::number(-x.f);
+			if (op == Op::POS)
+				return x;
+			raise("TypeError", "bad operand type for unary ~: 'float'");
+		}
+		if (!x.isIntLike())
+			raise("TypeError", "bad operand type for unary operator: '" + typeNameOf(x) + "'");
+		if (op == Op::NEG)
+		{
+			if (x.i == LLONG_MIN)
+				raise("OverflowError", "integer result too large");
+			return Value::integer(-x.i);
+		}
+		return Value::integer(op == Op::POS ? x.i : ~x.i);
+	}
+
+	Value getAttr(const Value &object, uint32_t name)
+	{
+		if (object.isObject(ObjKind::Instance))
+		{
+			auto *inst = static_cast<InstanceObject *>(object.obj);
+			if (Value *v = inst->find(name))
+				return *v;
+			if (const Value *v = inst->classObject()->lookup(name))
+			{
+				if (v->isObject(ObjKind::Function))
+					return Value(new BoundMethodObject(object, *v));
+				return *v;
+			}
+		}
+		else if (object.isObject(ObjKind::Class))
+		{
+			if (const Value *v = static_cast<ClassObject *>(object.obj)->lookup(name))
+				return *v;
+		}
+		else if (object.isObject(ObjKind::Module))
+		{
+			auto &attrs = static_cast<ModuleObject *>(object.obj)->attrs;
+			auto it = attrs.find(name);
+			if (it != attrs.end())
+				return it->second;
+			raise("AttributeError", "module '" + static_cast<ModuleObject *>(object.obj)->name +
+										"' has no attribute '" + names.attrNames[name] + "'");
+		}
+		raise("AttributeError", "'" + typeNameOf(object) + "' object has no attribute '" + names.attrNames[name] + "'");
+	}
+
+	void setAttr(const Value &object, uint32_t name, const Value &value)
+	{
+		if (object.isObject(ObjKind::Instance))
+			static_cast<InstanceObject *>(object.obj)->set(name, value);
+		else if (object.isObject(ObjKind::Class))
+			static_cast<ClassObject *>(object.obj)->attrs[name] = value;
+		else if (object.isObject(ObjKind::Module))
+			static_cast<ModuleObject *>(object.obj)->attrs[name] = value;
+		else
+			raise("AttributeError", "'" + typeNameOf(object) + "' object has no attribute '" + names.attrNames[name] + "'");
+	}
+
+	// Calling a class without __init__: exceptions keep their arguments
+	Value newInstance(const Value &cls, Value *args, int argc)
+	{
+		Value instance(new InstanceObject(cls));
+		if (isException(instance))
+		{
+			auto *tuple = new ListObject(ObjKind::Tuple);
+			static_cast<InstanceObject *>(instance.obj)->set(argsId, Value(tuple));
+			tuple->items.assign(args, args + argc);
+		}
+		else if (argc > 0)
+			raise("TypeError", static_cast<ClassObject *>(cls.obj)->name + "() takes no arguments");
+		return instance;
+	}
+};
+
+// ----------------------------------------------
+// Virtual machine
+// ----------------------------------------------
+
+class VirtualMachine : public Runtime
+{
+public:
+	size_t instructionCount = 0; // only maintained when countInstructions is set
+	bool countInstructions = false;
+	Program &program;
+
+	explicit VirtualMachine(Program &prog, size_t registerCapacity = 1 << 20)
+		: Runtime(prog), program(prog), capacity(registerCapacity), registers(new Value[registerCapacity])
+	{
+	}
+
+	// Runs the module body. Uncaught Python exceptions propagate as PyException.
+	void run()
+	{
+		FunctionObject module(program.codes[0].get());
+		module.refs = 1; // lives on the stack
+		execute(&module);
+		flushOutput();
+	}
+
+private:
+	struct Frame
+	{
+		const CodeObject *code;
+		Value *regs;
+		const Instr *pc;	// resume point while a callee runs
+		uint16_t resultReg; // caller register receiving the return value
+		Value constructed;	// instance returned by an __init__ frame
+	};
+
+	size_t capacity;
+	unique_ptr<Value[]> registers;
+	vector<Frame> frames;
+
+	// Pushes a frame whose registers start at 'base', where the arguments already are
+	void pushFrame(FunctionObject *f, Value *base, int argc, uint16_t resultReg, Value constructed = Value())
+	{
+		const CodeObject *code = f->code;
+		int required = code->numParams - code->numDefaults;
+		if (argc > code->numParams || argc < required)
+			raise("TypeError", code->name + "() takes " + to_string(code->numParams) + " positional argument(s) but " +
+								   to_string(argc) + " were given");
+		if (frames.size() >= maxDepth || base + code->numRegisters > registers.get() + capacity)
+			raise("RecursionError", "maximum recursion depth exceeded");
+		for (int k = argc; k < code->numParams; k++)
+			base[k] = f->defaults[k - required];
+		for (int k = code->numParams; k < code->numRegisters; k++)
+			base[k] = Value::undefined();
+		frames.push_back({code, base, nullptr, resultReg, move(constructed)});
+	}
+
+	// Starts a call. Returns true when a new frame was pushed; otherwise
+	// the call already finished and 'result' holds its value. args[-1] is
+	// the callee's own register and may be reused for 'self'.
+	bool beginCall(const Value &callee, Value *args, int argc, uint16_t resultReg, Value &result)
+	{
+		if (callee.tag == Value::Tag::Object)
+		{
+			switch (callee.obj->kind)
+			{
+			case ObjKind::Function:
+				pushFrame(static_cast<FunctionObject *>(callee.obj), args, argc, resultReg);
+				return true;
+			case ObjKind::Builtin:
+				result = static_cast<BuiltinObject *>(callee.obj)->fn(*this, args, argc);
+				return false;
+			case ObjKind::Native:
+			{
+				auto *native = static_cast<NativeObject *>(callee.obj);
+				if (!native->accepts(args, argc))
+					return beginCall(native->fallback, args, argc, resultReg, result);
+				result = callNative(*native, args);
+				return false;
+			}
+			case ObjKind::BoundMethod:
+			{
+				Value function = static_cast<BoundMethodObject *>(callee.obj)->function;
+				args[-1] = static_cast<BoundMethodObject *>(callee.obj)->self;
+				pushFrame(static_cast<FunctionObject *>(function.obj), args - 1, argc + 1, resultReg);
+				return true;
+			}
+			case ObjKind::Class:
+			{
+				const Value *init = static_cast<ClassObject *>(callee.obj)->lookup(initId);
+				if (init && init->isObject(ObjKind::Function))
+				{
+					Value instance(new InstanceObject(callee));
+					Value function = *init;
+					args[-1] = instance;
+					pushFrame(static_cast<FunctionObject *>(function.obj), args - 1, argc + 1, resultReg, instance);
+					return true;
+				}
+				result = newInstance(callee, args, argc);
+				return false;
+			}
+			default:
+				break;
+			}
+		}
+		raise("TypeError", "'" + typeNameOf(callee) + "' object is not callable");
+	}
+
+	void execute(FunctionObject *entry);
+};
+
+// ----------------------------------------------
+// Closure engine
+// ----------------------------------------------
+class ClosureRuntime;
+
+struct ClosureEnv
+{
+	ClosureRuntime *rt;
+	Value *slots;									// locals of the running function
+	Value result = {};								// set when a statement returns Flow::Return
+	unordered_map<string, Value> *locals = nullptr; // TreeInterpreter frames keep locals by name
+};
+
+enum class Flow : uint8_t
+{
+	Normal,
+	Break,
+	Continue,
+	Return
+};
+
+using ExprFn = function<Value(ClosureEnv &)>;
+using StmtFn = function<Flow(ClosureEnv &)>;
+using StoreFn = function<void(ClosureEnv &, const Value &)>;
+
+struct ClosureFunction
+{
+	string name;
+	uint16_t numParams = 0;
+	uint16_t numDefaults = 0;
+	uint16_t numSlots = 0; // parameters first, then the other locals
+	StmtFn body;
+};
+
+struct ClosureProgram : NameTable
+{
+	vector<unique_ptr<ClosureFunction>> functions; // functions[0] is the module body
+};
+
+// Runtime with a value stack for call frames. Calls reserve their argument
+// slots on the stack with one free slot in front, so a method call can put
+// self there and the callee's frame starts in place.
+class ClosureRuntime : public Runtime
+{
+public:
+	explicit ClosureRuntime(NameTable &nameTable, size_t stackCapacity = 1 << 18)
+		: Runtime(nameTable), capacity(stackCapacity), stack(new Value[stackCapacity]), top(stack.get())
+	{
+	}
+
+	size_t recursionLimit = maxDepth;
+
+	void run(const ClosureFunction &module)
+	{
+		ClosureEnv env{this, top};
+		module.body(env);
+		flushOutput();
+	}
+
+	Value *reserve(size_t count)
+	{
+		if (top + count + 1 > stack.get() + capacity)
+			raise("RecursionError", "maximum recursion depth exceeded");
+		Value *base = top + 1;
+		top += count + 1;
+		return base;
+	}
+
+	// Frees everything reserved since 'base' was handed out
+	void release(Value *base)
+	{
+		for (Value *p = base - 1; p < top; p++)
+			*p = Value();
+		top = base - 1;
+	}
+
+	// Releases a reservation on every exit path, exceptions included
+	struct StackMark
+	{
+		ClosureRuntime &rt;
+		Value *base;
+		~StackMark() { rt.release(base); }
+	};
+
+	// Calls 'callee' with the arguments at args[0 .. argc); args[-1] is free
+	Value call(const Value &callee, Value *args, int argc)
+	{
+		if (callee.tag == Value::Tag::Object)
+		{
+			switch (callee.obj->kind)
+			{
+			case ObjKind::Function:
+				return invoke(static_cast<FunctionObject *>(callee.obj), args, argc);
+			case ObjKind::Builtin:
+				return static_cast<BuiltinObject *>(callee.obj)->fn(*this, args, argc);
+			case ObjKind::Native:
+			{
+				auto *native = static_cast<NativeObject *>(callee.obj);
+				if (!native->accepts(args, argc))
+					return call(native->fallback, args, argc);
+				return callNative(*native, args);
+			}
+			case ObjKind::BoundMethod:
+			{
+				auto *bound = static_cast<BoundMethodObject *>(callee.obj);
+				args[-1] = bound->self;
+				return invoke(static_cast<FunctionObject *>(bound->function.obj), args - 1, argc + 1);
+			}
+			case ObjKind::Class:
+			{
+				const Value *init = static_cast<ClassObject *>(callee.obj)->lookup(initId);
+				if (init && init->isObject(ObjKind::Function))
+				{
+					Value function = *init;
+					Value instance(new InstanceObject(callee));
+					args[-1] = instance;
+					invoke(static_cast<FunctionObject *>(function.obj), args - 1, argc + 1);
+					return instance;
+				}
+				return newInstance(callee, args, argc);
+			}
+			default:
+				break;
+			}
+		}
+		raise("TypeError", "'" + typeNameOf(callee) + "' object is not callable");
+	}
+
+	Value callMethod(const Value &receiver, uint32_t name, Value *args, int argc)
+	{
+		if (receiver.isObject(ObjKind::Instance))
+		{
+			auto *inst = static_cast<InstanceObject *>(receiver.obj);
+			if (Value *own = inst->find(name))
+			{
+				Value callee = *own;
+				return call(callee, args, argc);
+			}
+			const Value *method = inst->classObject()->lookup(name);
+			if (!method)
+				raise("AttributeError", "'" + typeNameOf(receiver) + "' object has no attribute '" + names.attrNames[name] + "'");
+			Value callee = *method;
+			if (!callee.isObject(ObjKind::Function))
+				return call(callee, args, argc);
+			args[-1] = receiver;
+			return invoke(static_cast<FunctionObject *>(callee.obj), args - 1, argc + 1);
+		}
+		if (receiver.isObject(ObjKind::Class) || receiver.isObject(ObjKind::Module))
+			return call(getAttr(receiver, name), args, argc);
+		return callBuiltinMethod(receiver, name, args, argc);
+	}
+
+private:
+	size_t capacity;
+	unique_ptr<Value[]> stack;
+	Value *top;
+	size_t depth = 0;
+
+	// Runs a closure-compiled function whose frame starts at 'frame', where the arguments already are
+	Value invoke(FunctionObject *function, Value *frame, int argc)
+	{
+		const ClosureFunction *f = function->closure;
+		if (!f)
+			raise("TypeError", "function was not compiled by the closure engine");
+		int required = f->numParams - f->numDefaults;
+		if (argc > f->numParams || argc < required)
+			raise("TypeError", f->name + "() takes " + to_string(f->numParams) + " positional argument(s) but " +
+								   to_string(argc) + " were given");
+		if (depth >= recursionLimit || frame + f->numSlots > stack.get() + capacity)
+			raise("RecursionError", "maximum recursion depth exceeded");
+		top = max(top, frame + f->numSlots);
+		for (int k = argc; k < f->numParams; k++)
+			frame[k] = function->defaults[k - required];
+		for (int k = f->numParams; k < f->numSlots; k++)
+			frame[k] = Value::undefined();
+
+		struct DepthGuard
+		{
+			size_t &depth;
+			~DepthGuard() { depth--; }
+		} guard{++depth};
+		ClosureEnv env{this, frame};
+		if (f->body(env) == Flow::Return)
+			return move(env.result);
+		return Value();
+	}
+};
+
+// The leaf name when 'node' is just a variable reference
+const string *variableName(const ParseTreeNode *node);
+
+// Builds the closure tree. Local slots of each function come from the
+// SymbolTable entries of its scope (declaration order), restricted to the
+// parameters and the names the body binds; every other name is a global.
+class ClosureCompiler
+{
+public:
+	explicit ClosureCompiler(SymbolTable &table) : symTable(table) {}
+
+	ClosureProgram compile(ParseTreeNode *root);
+
+private:
+	struct Scope
+	{
+		string symbolScope; // scope name used by the SymbolTable
+		bool isFunction = false;
+		unordered_map<string, uint16_t> slots;
+	};
+
+	SymbolTable &symTable;
+	ClosureProgram program;
+	Scope *scope = nullptr;
+	unordered_map<string, vector<pair<int, string>>> scopeSymbols;
+
+	static bool isLeaf(const ParseTreeNode *node) { return node->children.empty(); }
+
+	string childScope(const string &name) const;
+
+	// --- names ----------------------------------------------------------
+
+	const uint16_t *localSlot(const string &name) const;
+
+	ExprFn loadName(const string &name);
+
+	StoreFn storeName(const string &name);
+
+	// For a.b.c, a closure evaluating a.b
+	ExprFn attributeOwner(ParseTreeNode *dotted);
+
+	StoreFn storeTarget(ParseTreeNode *target);
+
+	// --- statements -----------------------------------------------------
+
+	StmtFn compileBlock(ParseTreeNode *list);
+
+	// Returns an empty function for statements with no run-time effect
+	StmtFn compileStatement(ParseTreeNode *node);
+
+	StmtFn compileAssignment(ParseTreeNode *node);
+
+	// slot = slot + rhs for a local, with int and in-place string fast paths
+	static StmtFn appendInPlace(uint16_t k, ExprFn rhs);
+
+	// Conditions are compiled to bool-returning closures so comparisons need not box their result
+	function<bool(ClosureEnv &)> compileCondition(ParseTreeNode *cond);
+
+	StmtFn compileConditional(ParseTreeNode *node);
+
+	StmtFn compileWhile(ParseTreeNode *node);
+
+	StmtFn compileFor(ParseTreeNode *node);
+
+	StmtFn compileTry(ParseTreeNode *node);
+
+	// --- definitions ----------------------------------------------------
+
+	// Compiles a def and returns a closure creating the function object
+	ExprFn compileFunction(ParseTreeNode *node);
+
+	StmtFn compileClass(ParseTreeNode *node);
+
+	StmtFn compileImport(ParseTreeNode *node);
+
+	// --- expressions ----------------------------------------------------
+
+	ExprFn compileExpr(ParseTreeNode *node);
+
+	// Specializes on an int literal right operand and on int operands at run time
+	ExprFn binaryExpr(Op op, ExprFn left, ExprFn right, ParseTreeNode *rightNode);
+
+	// Bit operators share the comparison node; they bind tighter than the
+	// comparisons, and a < b < c evaluates b once and stops at the first false link
+	ExprFn compileComparison(ParseTreeNode *node);
+
+	ExprFn compileCall(ParseTreeNode *node);
+
+	ExprFn compileCallParts(ParseTreeNode *callee, ParseTreeNode *arguments);
+
+	ExprFn buildSequence(ObjKind kind, const vector<ParseTreeNode *> &items);
+
+	ExprFn compileFactor(ParseTreeNode *node);
+};
+
+// ----------------------------------------------
+// Tree interpreter
+// ----------------------------------------------
+class TreeInterpreter
+{
+public:
+	NameTable names;
+
+	explicit TreeInterpreter(ParseTreeNode *programRoot);
+
+	void run(ClosureRuntime &rt);
+
+private:
+	ParseTreeNode *root;
+	unordered_map<const ParseTreeNode *, unique_ptr<ClosureFunction>> functions;
+
+	// Every name may end up global, so all of them get a slot up front
+	void internNames(const ParseTreeNode *node);
+
+	Value load(ClosureEnv &e, const string &name);
+
+	void store(ClosureEnv &e, const string &name, const Value &v);
+
+	Value owner(ClosureEnv &e, const ParseTreeNode *dotted);
+
+	void assign(ClosureEnv &e, const ParseTreeNode *target, const Value &v);
+
+	Flow execBlock(const ParseTreeNode *list, ClosureEnv &e);
+
+	Flow exec(const ParseTreeNode *node, ClosureEnv &e);
+
+	Flow execTry(const ParseTreeNode *node, ClosureEnv &e);
+
+	// Functions share the closure engine's calling convention; the body
+	// copies its argument slots into a by-name locals map.
+	Value makeFunction(const ParseTreeNode *node, ClosureEnv &e);
+
+	Value eval(const ParseTreeNode *node, ClosureEnv &e);
+
+	Value call(const ParseTreeNode *callee, const ParseTreeNode *arguments, ClosureEnv &e);
+};
+
+// ----------------------------------------------
+// C transpiler
+// ----------------------------------------------
+enum class CType : uint8_t
+{
+	Unknown, // not inferred yet
+	Int,
+	Float,
+	Bool
+};
+
+// A translated function with the types the transpiler settled on
+struct TypedFunction
+{
+	string name;
+	ParseTreeNode *node;
+	vector<string> params;
+	unordered_map<string, CType> types; // parameters and locals
+	CType result;
+};
+
+struct TranspileResult
+{
+	string source;
+	vector<pair<string, string>> functions; // name, signature
+	vector<pair<string, string>> skipped;	// name, reason
+	vector<TypedFunction> typed;			// the translated functions, for the JIT
+};
+
+class CTranspiler
+{
+public:
+	explicit CTranspiler(SymbolTable &table) : symTable(table) {}
+
+	TranspileResult transpile(ParseTreeNode *root);
+
+	// Tree shapes shared with the JIT, which lowers the same functions
+
+	static bool isLeaf(const ParseTreeNode *node) { return node->children.empty(); }
+
+	static ParseTreeNode *unwrapStatement(ParseTreeNode *node);
+
+	static ParseTreeNode *argumentsOf(ParseTreeNode *call);
+
+	static string signatureOf(const vector<string> &params, const unordered_map<string, CType> &types, CType result);
+
+private:
+	struct Function
+	{
+		ParseTreeNode *node;
+		string name;
+		vector<string> params;
+		unordered_set<string> bound;
+		unordered_map<string, CType> types; // parameters and locals
+		vector<string> localOrder;			// non-parameter locals in first-assignment order
+		vector<CType> sequenced;			// temporaries s0, s1, ... that order operand evaluation
+		CType result = CType::Unknown;
+		bool eligible = true;
+		bool pending = false; // some expression could not be typed in the last pass
+		string reason;
+		string code; // body from the last pass
+	};
+
+	struct CExpr
+	{
+		CType type = CType::Unknown;
+		string code;
+	};
+
+	SymbolTable &symTable;
+	vector<Function> functions;
+	unordered_map<string, size_t> index;
+	unordered_map<string, int> moduleBindings; // times each name is bound at module level
+	bool changed = false;
+
+	Function *fn = nullptr;
+	string out;
+	int depth = 0;
+	int temps = 0;
+	unordered_set<string> assigned; // locals bound on every path to this point
+
+	void reject(Function &f, const string &reason);
+
+	[[noreturn]] static void unsupported(const string &what) { throw CompileError(what); }
+
+	void line(const string &text);
+
+	// --- candidates -----------------------------------------------------
+
+	void collectCandidates(ParseTreeNode *root);
+
+	static CType typeFromSymbol(string_view type);
+
+	static CType typeOfLiteral(const ConstValue &v);
+
+	void seedFromCalls(ParseTreeNode *node);
+
+	// --- functions ------------------------------------------------------
+
+	void generate(Function &f);
+
+	// Records the type of a local; one variable may only ever hold one type
+	void assignType(const string &name, CType type);
+
+	static bool blockReturns(ParseTreeNode *block);
+
+	static bool alwaysReturns(ParseTreeNode *node);
+
+	// --- statements -----------------------------------------------------
+
+	void compileBlock(ParseTreeNode *block);
+
+	void compileStatement(ParseTreeNode *node);
+
+	// Locals bound in a body that may not run are still unbound after it
+	void compileBody(ParseTreeNode *block);
+
+	void compileAssignment(ParseTreeNode *node);
+
+	void compileConditional(ParseTreeNode *node);
+
+	// Only 'for name in range(...)' is translated
+	void compileFor(ParseTreeNode *node);
+
+	// --- expressions ----------------------------------------------------
+
+	// True when 'name' still refers to the builtin of that name
+	bool isBuiltin(const string &name) const;
+
+	CExpr load(const string &name);
+
+	static CExpr literal(const ConstValue &v);
+
+	static string asDouble(const CExpr &e);
+
+	// C truth value of any typed expression
+	static string truth(const CExpr &e);
+
+	string condition(ParseTreeNode *node);
+
+	CExpr expr(ParseTreeNode *node);
+
+	CExpr compileComparison(ParseTreeNode *node);
+
+	// True when evaluating 'code' calls a checked helper or a translated
+	// function, either of which may raise
+	static bool mayRaise(const string &code);
+
+	// Python evaluates operands left to right, but C leaves the order of the
+	// arguments of a call and of the operands of most operators unspecified.
+	// When more than one operand may raise, every such operand before the
+	// last one is stored to a temporary first; the comma operator sequences
+	// the stores, so the error Python would raise first is the one raised.
+	// Rewrites the operands to read their temporaries and returns the stores
+	// to put in front of the expression, each followed by ", ".
+	string sequence(const vector<CExpr *> &operands);
+
+	CExpr binary(const string &op, CExpr a, CExpr b, ParseTreeNode *rightNode);
+
+	CExpr combine(const string &op, const CExpr &a, const CExpr &b, ParseTreeNode *rightNode);
+
+	CExpr compileFactor(ParseTreeNode *node);
+
+	CExpr compileCall(ParseTreeNode *callee, ParseTreeNode *arguments);
+
+	// --- module ---------------------------------------------------------
+
+	string parameterList(Function &f);
+
+	TranspileResult emitModule();
+};
+
+// ----------------------------------------------
+// x86-64 JIT
+// ----------------------------------------------
+
+// Functions compiled for --engine=jit
+struct JitModule
+{
+	unordered_map<string, Value> natives; // for BytecodeCompiler::natives
+	vector<string> compiled;
+	vector<pair<string, string>> skipped; // name, reason
+	double compileMicros = 0;
+	size_t codeBytes = 0;
+};
+
+// Compiles the transpiler's typed functions to machine code. The code
+// stays mapped for the rest of the process, like a loaded native module.
+JitModule buildJitModule(const TranspileResult &module);
+
+// ----------------------------------------------
+// Execution drivers and benchmarks
+// ----------------------------------------------
+ParseTreeNode *parseForExecution(const string &source, SymbolTable &symTable);
+
+#ifdef __unix__
+// Runs a program without a shell and waits for it. args[0] is looked up in
+// PATH. Returns the exit status, or -1 if it did not start or was killed.
+int runProgram(const vector<string> &args);
+
+// The C compiler driver: the words of $CC, or cc
+vector<string> compilerCommand();
+#endif
+
+// A new directory under the system temp directory that no other process
+// uses, removed with its contents when the object goes away. It is made by
+// mkdtemp where POSIX is available, so only this user can write to it.
+struct TempDirectory
+{
+	string path;
+
+	explicit TempDirectory(const string &prefix)
+	{
+#ifdef __unix__
+		string pattern = (filesystem::temp_directory_path() / (prefix + "XXXXXX")).string();
+		if (!mkdtemp(pattern.data()))
+			throw CompileError("cannot create a temporary directory: " + string(strerror(errno)));
+		path = pattern;
+#else
+		// create_directory fails on a name that is taken, so a clash just retries
+		random_device random;
+		for (int attempt = 0; path.empty(); attempt++)
+		{
+			filesystem::path candidate = filesystem::temp_directory_path() / (prefix + to_string(random()));
+			error_code ec;
+			if (filesystem::create_directory(candidate, ec))
+				path = candidate.string();
+			else if (attempt == 100)
+				throw CompileError("cannot create a temporary directory: " + ec.message());
+		}
+#endif
+	}
+	~TempDirectory()
+	{
+		error_code ec;
+		filesystem::remove_all(path, ec);
+	}
+	TempDirectory(const TempDirectory &) = delete;
+	TempDirectory &operator=(const TempDirectory &) = delete;
+};
+
+// Prints the C translation of a file, with the functions left to the VM
+int emitCFile(const string &path);
+
+// Compiles and runs a file with the bytecode VM, optionally with the typed
+// functions transpiled to C ("native") or compiled by the JIT ("jit");
+// returns the process exit code
+int runBytecodeFile(const string &path, bool disassembleOnly, const string &engine = "vm");
+
+// The .py files in 'dir', sorted; none, after reporting why, if it cannot be read
+vector<string> listPythonFiles(const string &dir);
+
+// Runs every .py file in 'dir'. Each benchmark sets a global OPS to the
+// number of operations it performs; the report is the best of 'reps' runs.
+void benchmarkBytecode(const string &dir, int reps = 5);
+
+// Runs a file with the closure engine, or with the plain tree interpreter
+int runTreeFile(const string &path, bool compileClosures);
+
+// Compares the execution engines on every .py file in 'dir'. "setup" is
+// the time to lower the folded tree, "first result" adds one complete run
+// (runtime start-up included), and "steady" is the best of 'reps' more runs.
+void benchmarkEngines(const string &dir, int reps = 5);
+
+// VM against VM plus transpiled C on every .py file in 'dir'. "build" is
+// the time to translate and run the C compiler.
+void benchmarkNative(const string &dir, int reps = 5);
+
+// VM against VM plus JIT on every .py file in 'dir'. "compile" is the time
+// to translate, lower, allocate registers and emit the machine code.
+void benchmarkJit(const string &dir, int reps = 5);
+
+// ----------------------------------------------
+// Ahead-of-time executables
+// ----------------------------------------------
+
+struct AotBuild
+{
+	double codegenMs = 0; // front end and assembly generation
+	double linkMs = 0;	  // system assembler, runtime compilation and linking
+	uintmax_t assemblyBytes = 0;
+	uintmax_t binaryBytes = 0;
+};
+
+// Compiles 'path' to the executable 'output': the generated assembly and
+// the runtime go through the system compiler driver ($CC, or cc)
+AotBuild buildAotExecutable(const string &path, const string &output);
+
+// Prints the generated assembly for a file
+int emitAsmFile(const string &path);
+
+int compileAotFile(const string &path, string output);
+
+// Tree interpreter and VM against AOT executables on every .py file in
+// 'dir'. The executable's time is the whole process, start-up included.
+void benchmarkAot(const string &dir, int reps = 5);
+
+// ----------------------------------------------
+// Self check
+// ----------------------------------------------
+
+int runSelfCheck();
+
+// ----------------------------------------------
+// IR optimization passes
+// ----------------------------------------------
+
+// Prints the optimized IR of every function in a file, then the size and
+// time of construction and of each pass
+int printIrFile(const string &path, const string &pipeline);
+
+// SSA construction time per instruction on one def of growing size;
+// linear construction keeps the per-instruction time flat
+void benchmarkIr(size_t maxGroups);
+} // namespace pyc::detail
+
+#endif
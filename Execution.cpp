@@ -0,0 +1,644 @@
+#include "Engines.h"
+#ifdef __unix__
+#include <dlfcn.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#endif
+
+namespace pyc::detail
+{
+// ----------------------------------------------
+// Execution drivers and benchmarks
+// ----------------------------------------------
+// Front end shared by every execution mode: lex, parse and fold a source
+// text. Returns nullptr if the syntax analyzer reported errors.
+ParseTreeNode *parseForExecution(const string &source, SymbolTable &symTable)
+{
+	vector<Error> errors;
+	Lexer lexer;
+	vector<Token> tokens = lexer.tokenize(source, errors);
+	if (!errors.empty())
+	{
+		printErrors(errors);
+		return nullptr;
+	}
+	Parser parser(tokens, symTable);
+	parser.parse();
+	Syntax_Analyzer sa = Syntax_Analyzer();
+	{
+		PYC_ALLOC_SITE(TokenCopies);
+		sa.tokens = tokens;
+	}
+	ParseTreeNode *root = sa.parseProgram();
+	if (sa.errorCount > 0)
+		return nullptr;
+	ConstantFolder folder(symTable);
+	folder.run(root);
+	return root;
+}
+
+// Layout of the pyc_exports table in a transpiled module
+struct NativeExport
+{
+	const char *name;
+	const char *signature;
+	NativeEntry entry;
+};
+
+#ifdef __unix__
+int runProgram(const vector<string> &args)
+{
+	vector<char *> argv;
+	for (const string &arg : args)
+		argv.push_back(const_cast<char *>(arg.c_str()));
+	argv.push_back(nullptr);
+	pid_t child = fork();
+	if (child == 0)
+	{
+		execvp(argv[0], argv.data());
+		_exit(127);
+	}
+	int status = 0;
+	if (child < 0 || waitpid(child, &status, 0) < 0 || !WIFEXITED(status))
+		return -1;
+	return WEXITSTATUS(status);
+}
+
+vector<string> compilerCommand()
+{
+	vector<string> words;
+	const char *cc = getenv("CC");
+	istringstream in(cc && *cc ? cc : "cc");
+	for (string word; in >> word;)
+		words.push_back(word);
+	return words;
+}
+
+#endif
+
+// Builds transpiled C with the system compiler ($CC, or cc) and loads it.
+// Returns prototypes for BytecodeCompiler::natives keyed by function name.
+// The library stays loaded for the rest of the process.
+unordered_map<string, Value> buildNativeModule(const TranspileResult &module, const string &stem)
+{
+	unordered_map<string, Value> natives;
+	if (module.functions.empty())
+		return natives;
+#ifdef __unix__
+	TempDirectory scratch("pyc_native_");
+	string source = scratch.path + "/module.c", library = scratch.path + "/module.so";
+	ofstream(source) << module.source;
+	vector<string> command = compilerCommand();
+	command.insert(command.end(), {"-O2", "-shared", "-fPIC", "-o", library, source, "-lm"});
+	if (runProgram(command) != 0)
+		throw CompileError("C compiler failed on the translation of " + stem);
+	void *handle = dlopen(library.c_str(), RTLD_NOW | RTLD_LOCAL);
+	if (!handle)
+		throw CompileError(string("cannot load native module: ") + dlerror());
+	auto *exports = static_cast<const NativeExport *>(dlsym(handle, "pyc_exports"));
+	if (!exports)
+		throw CompileError("native module has no export table");
+	for (; exports->name; exports++)
+		natives[exports->name] = Value(new NativeObject(exports->name, exports->signature, exports->entry, Value()));
+	return natives;
+#else
+	(void)stem;
+	throw CompileError("native code needs a POSIX system with dlopen");
+#endif
+}
+
+int emitCFile(const string &path)
+{
+	SymbolTable symTable;
+	ParseTreeNode *root = parseForExecution(readFile(path), symTable);
+	if (!root)
+		return 1;
+	TranspileResult module = CTranspiler(symTable).transpile(root);
+	cout << module.source;
+	for (auto &[name, reason] : module.skipped)
+		cout << "/* not translated: '" << name << "' " << reason << " */\n";
+	return 0;
+}
+
+int runBytecodeFile(const string &path, bool disassembleOnly, const string &engine)
+{
+	SymbolTable symTable;
+	ParseTreeNode *root = parseForExecution(readFile(path), symTable);
+	if (!root)
+		return 1;
+	try
+	{
+		BytecodeCompiler compiler;
+		if (engine == "native")
+			compiler.natives = buildNativeModule(CTranspiler(symTable).transpile(root), filesystem::path(path).stem().string());
+		else if (engine == "jit")
+			compiler.natives = buildJitModule(CTranspiler(symTable).transpile(root)).natives;
+		Program program = compiler.compile(root);
+		if (disassembleOnly)
+		{
+			disassemble(program, cout);
+			return 0;
+		}
+		VirtualMachine vm(program);
+		try
+		{
+			vm.run();
+		}
+		catch (PyException &e)
+		{
+			vm.flushOutput();
+			cerr << "Traceback (most recent call last):\n  File \"" << path << "\"\n"
+				 << vm.describeException(e.exc) << endl;
+			return 1;
+		}
+	}
+	catch (const CompileError &e)
+	{
+		cerr << "Compile error: " << e.what() << endl;
+		return 1;
+	}
+	return 0;
+}
+
+vector<string> listPythonFiles(const string &dir)
+{
+	vector<string> files;
+	error_code ec;
+	for (filesystem::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec))
+		if (it->path().extension() == ".py")
+			files.push_back(it->path().string());
+	if (ec)
+	{
+		cerr << "Error: cannot read " << dir << ": " << ec.message() << endl;
+		return {};
+	}
+	sort(files.begin(), files.end());
+	return files;
+}
+
+void benchmarkBytecode(const string &dir, int reps)
+{
+	vector<string> files = listPythonFiles(dir);
+	cout << "Bytecode VM benchmarks (" << dir << ", best of " << reps << ")\n";
+	for (const string &file : files)
+	{
+		SymbolTable symTable;
+		ParseTreeNode *root = parseForExecution(readFile(file), symTable);
+		if (!root)
+		{
+			cout << "  " << file << ": parse failed\n";
+			continue;
+		}
+		try
+		{
+			BytecodeCompiler compiler;
+			Program program = compiler.compile(root);
+			double best = 1e300;
+			long long ops = 1;
+			for (int rep = 0; rep < reps; rep++)
+			{
+				VirtualMachine vm(program);
+				vm.captureOutput = true;
+				auto start = chrono::steady_clock::now();
+				vm.run();
+				double ns = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+				best = min(best, ns);
+				Value count = vm.global("OPS");
+				ops = count.isIntLike() && count.i > 0 ? count.i : 1;
+			}
+			cout << "  " << filesystem::path(file).filename().string() << ": " << ops << " ops, "
+				 << best / 1e6 << " ms, " << best / ops << " ns/op\n";
+		}
+		catch (const CompileError &e)
+		{
+			cout << "  " << file << ": compile error: " << e.what() << "\n";
+		}
+		catch (PyException &)
+		{
+			cout << "  " << file << ": raised an exception\n";
+		}
+	}
+}
+
+int runTreeFile(const string &path, bool compileClosures)
+{
+	SymbolTable symTable;
+	ParseTreeNode *root = parseForExecution(readFile(path), symTable);
+	if (!root)
+		return 1;
+	try
+	{
+		ClosureProgram program;
+		unique_ptr<TreeInterpreter> interpreter;
+		if (compileClosures)
+			program = ClosureCompiler(symTable).compile(root);
+		else
+			interpreter = make_unique<TreeInterpreter>(root);
+		ClosureRuntime rt(compileClosures ? static_cast<NameTable &>(program) : interpreter->names);
+		try
+		{
+			if (compileClosures)
+				rt.run(*program.functions[0]);
+			else
+				interpreter->run(rt);
+		}
+		catch (PyException &e)
+		{
+			rt.flushOutput();
+			cerr << "Traceback (most recent call last):\n  File \"" << path << "\"\n"
+				 << rt.describeException(e.exc) << endl;
+			return 1;
+		}
+	}
+	catch (const CompileError &e)
+	{
+		cerr << "Compile error: " << e.what() << endl;
+		return 1;
+	}
+	return 0;
+}
+
+void benchmarkEngines(const string &dir, int reps)
+{
+	using Clock = chrono::steady_clock;
+	auto micros = [](Clock::duration d)
+	{ return chrono::duration<double, micro>(d).count(); };
+
+	cout << fixed << setprecision(1);
+	cout << "Execution engine benchmarks (" << dir << ", steady state best of " << reps << ")\n";
+	for (const string &file : listPythonFiles(dir))
+	{
+		string name = filesystem::path(file).filename().string();
+		SymbolTable symTable;
+		auto frontStart = Clock::now();
+		ParseTreeNode *root = parseForExecution(readFile(file), symTable);
+		if (!root)
+		{
+			cout << "  " << name << ": parse failed\n";
+			continue;
+		}
+		cout << "  " << name << " (front end " << micros(Clock::now() - frontStart) << " us)\n";
+
+		// 'setup' lowers the tree; 'run' executes once and returns the program's OPS
+		auto measure = [&](const char *engine, const function<void()> &setup, const function<Value()> &run)
+		{
+			try
+			{
+				auto start = Clock::now();
+				setup();
+				auto prepared = Clock::now();
+				Value ops = run();
+				auto firstResult = Clock::now();
+				double best = 1e300;
+				for (int rep = 0; rep < reps; rep++)
+				{
+					auto runStart = Clock::now();
+					run();
+					best = min(best, chrono::duration<double, nano>(Clock::now() - runStart).count());
+				}
+				long long count = ops.isIntLike() && ops.i > 0 ? ops.i : 1;
+				cout << "    " << left << setw(9) << engine << right << " setup " << micros(prepared - start)
+					 << " us, first result " << micros(firstResult - start) << " us, steady "
+					 << best / count << " ns/op\n";
+			}
+			catch (const CompileError &e)
+			{
+				cout << "    " << engine << ": compile error: " << e.what() << "\n";
+			}
+			catch (PyException &)
+			{
+				cout << "    " << engine << ": raised an exception\n";
+			}
+		};
+
+		unique_ptr<TreeInterpreter> interpreter;
+		measure(
+			"tree", [&]
+			{ interpreter = make_unique<TreeInterpreter>(root); },
+			[&]
+			{
+				ClosureRuntime rt(interpreter->names);
+				rt.captureOutput = true;
+				interpreter->run(rt);
+				return rt.global("OPS");
+			});
+
+		ClosureProgram closures;
+		measure(
+			"closures", [&]
+			{ closures = ClosureCompiler(symTable).compile(root); },
+			[&]
+			{
+				ClosureRuntime rt(closures);
+				rt.captureOutput = true;
+				rt.run(*closures.functions[0]);
+				return rt.global("OPS");
+			});
+
+		Program bytecode;
+		measure(
+			"bytecode", [&]
+			{ bytecode = BytecodeCompiler().compile(root); },
+			[&]
+			{
+				VirtualMachine vm(bytecode);
+				vm.captureOutput = true;
+				vm.run();
+				return vm.global("OPS");
+			});
+	}
+	cout << defaultfloat << setprecision(6);
+}
+
+void benchmarkNative(const string &dir, int reps)
+{
+	using Clock = chrono::steady_clock;
+	auto best = [&](Program &program)
+	{
+		double fastest = 1e300;
+		long long ops = 1;
+		for (int rep = 0; rep < reps; rep++)
+		{
+			VirtualMachine vm(program);
+			vm.captureOutput = true;
+			auto start = Clock::now();
+			vm.run();
+			fastest = min(fastest, chrono::duration<double, nano>(Clock::now() - start).count());
+			Value count = vm.global("OPS");
+			ops = count.isIntLike() && count.i > 0 ? count.i : 1;
+		}
+		return fastest / ops;
+	};
+
+	cout << fixed << setprecision(1);
+	cout << "Native code benchmarks (" << dir << ", best of " << reps << ")\n";
+	for (const string &file : listPythonFiles(dir))
+	{
+		string name = filesystem::path(file).filename().string();
+		SymbolTable symTable;
+		ParseTreeNode *root = parseForExecution(readFile(file), symTable);
+		if (!root)
+		{
+			cout << "  " << name << ": parse failed\n";
+			continue;
+		}
+		try
+		{
+			Program plain = BytecodeCompiler().compile(root);
+			double vmTime = best(plain);
+
+			auto buildStart = Clock::now();
+			TranspileResult module = CTranspiler(symTable).transpile(root);
+			BytecodeCompiler compiler;
+			compiler.natives = buildNativeModule(module, filesystem::path(file).stem().string());
+			Program native = compiler.compile(root);
+			double build = chrono::duration<double, milli>(Clock::now() - buildStart).count();
+			double nativeTime = best(native);
+
+			string translated;
+			for (auto &[function, signature] : module.functions)
+				translated += (translated.empty() ? "" : ", ") + function;
+			cout << "  " << name << ": vm " << vmTime << " ns/op, native " << nativeTime << " ns/op ("
+				 << vmTime / nativeTime << "x), build " << build << " ms, translated: "
+				 << (translated.empty() ? "none" : translated) << "\n";
+		}
+		catch (const CompileError &e)
+		{
+			cout << "  " << name << ": compile error: " << e.what() << "\n";
+		}
+		catch (PyException &)
+		{
+			cout << "  " << name << ": raised an exception\n";
+		}
+	}
+	cout << defaultfloat << setprecision(6);
+}
+
+void benchmarkJit(const string &dir, int reps)
+{
+	using Clock = chrono::steady_clock;
+	auto best = [&](Program &program)
+	{
+		double fastest = 1e300;
+		long long ops = 1;
+		for (int rep = 0; rep < reps; rep++)
+		{
+			VirtualMachine vm(program);
+			vm.captureOutput = true;
+			auto start = Clock::now();
+			vm.run();
+			fastest = min(fastest, chrono::duration<double, nano>(Clock::now() - start).count());
+			Value count = vm.global("OPS");
+			ops = count.isIntLike() && count.i > 0 ? count.i : 1;
+		}
+		return fastest / ops;
+	};
+
+	cout << fixed << setprecision(1);
+	cout << "JIT benchmarks (" << dir << ", best of " << reps << ")\n";
+	for (const string &file : listPythonFiles(dir))
+	{
+		string name = filesystem::path(file).filename().string();
+		SymbolTable symTable;
+		ParseTreeNode *root = parseForExecution(readFile(file), symTable);
+		if (!root)
+		{
+			cout << "  " << name << ": parse failed\n";
+			continue;
+		}
+		try
+		{
+			Program plain = BytecodeCompiler().compile(root);
+			double vmTime = best(plain);
+
+			auto compileStart = Clock::now();
+			JitModule jit = buildJitModule(CTranspiler(symTable).transpile(root));
+			double compile = chrono::duration<double, micro>(Clock::now() - compileStart).count();
+			BytecodeCompiler compiler;
+			compiler.natives = jit.natives;
+			Program compiled = compiler.compile(root);
+			double jitTime = best(compiled);
+
+			string functions;
+			for (const string &function : jit.compiled)
+				functions += (functions.empty() ? "" : ", ") + function;
+			cout << "  " << name << ": vm " << vmTime << " ns/op, jit " << jitTime << " ns/op (" << vmTime / jitTime
+				 << "x), compile " << compile << " us (lowering and codegen " << jit.compileMicros << " us, " << jit.codeBytes
+				 << " bytes), compiled: " << (functions.empty() ? "none" : functions) << "\n";
+			for (auto &[function, reason] : jit.skipped)
+				cout << "      not compiled: '" << function << "' " << reason << "\n";
+		}
+		catch (const CompileError &e)
+		{
+			cout << "  " << name << ": compile error: " << e.what() << "\n";
+		}
+		catch (PyException &)
+		{
+			cout << "  " << name << ": raised an exception\n";
+		}
+	}
+	cout << defaultfloat << setprecision(6);
+}
+
+// ----------------------------------------------
+// Self check
+// ----------------------------------------------
+// --self-check runs small programs with known output through every engine.
+// Each case pins down a bug that once made an engine print the wrong thing.
+struct SelfCheckCase
+{
+	const char *name;
+	const char *source;
+	const char *expected;
+	bool aot; // uses nothing --aot rejects
+};
+
+const SelfCheckCase selfCheckCases[] = {
+	{"float repr",
+	 "x = 10.0 * 2.0\nprint(x)\nprint(20.0)\nprint(700.0)\nprint(1234567890.0)\nprint(1.0 / 100000)\n"
+	 "print(10000000000000000.0 * 1.0)\n",
+	 "20.0\n20.0\n700.0\n1234567890.0\n1e-05\n1e+16\n", true},
+	{"operand order",
+	 "def f(a, c):\n    return a * 4611686018427387904 - 100 % c\n"
+	 "def g(a, c):\n    return min(a * 4611686018427387904, 100 % c)\n"
+	 "def h(a, c):\n    return 100 % c < a * 4611686018427387904\n"
+	 "def k(a, c):\n    return f(a, 1) + 100 % c\n"
+	 "try:\n    print(f(3, 0))\nexcept OverflowError:\n    print('OverflowError')\n"
+	 "try:\n    print(g(3, 0))\nexcept OverflowError:\n    print('OverflowError')\n"
+	 "try:\n    print(h(3, 0))\nexcept ZeroDivisionError:\n    print('ZeroDivisionError')\n"
+	 "try:\n    print(k(3, 0))\nexcept OverflowError:\n    print('OverflowError')\n",
+	 "OverflowError\nOverflowError\nZeroDivisionError\nOverflowError\n", false},
+	{"unbound local",
+	 "def b(f):\n    if f:\n        w = 1\n    return w\n"
+	 "print(b(True))\ntry:\n    print(b(False))\nexcept NameError:\n    print('NameError')\n",
+	 "1\nNameError\n", false},
+};
+
+#ifdef __unix__
+// Standard output of an AOT executable built from 'source'
+string runAotSelfCheckCase(const string &source)
+{
+	TempDirectory scratch("pyc_check_");
+	string script = scratch.path + "/case.py", executable = scratch.path + "/case";
+	ofstream(script) << source;
+	buildAotExecutable(script, executable);
+	int pipeEnds[2];
+	if (pipe(pipeEnds) != 0)
+		throw CompileError("cannot create a pipe");
+	pid_t child = fork();
+	if (child == 0)
+	{
+		dup2(pipeEnds[1], STDOUT_FILENO);
+		close(pipeEnds[0]);
+		close(pipeEnds[1]);
+		execl(executable.c_str(), executable.c_str(), static_cast<char *>(nullptr));
+		_exit(127);
+	}
+	close(pipeEnds[1]);
+	string output;
+	char buffer[4096];
+	for (ssize_t n; (n = read(pipeEnds[0], buffer, sizeof buffer)) > 0;)
+		output.append(buffer, n);
+	close(pipeEnds[0]);
+	int status = 0;
+	if (child > 0)
+		waitpid(child, &status, 0);
+	return output;
+}
+#endif
+
+// Output of 'source' on one engine. An uncaught exception ends the output
+// with its description, as the last line of a traceback would.
+string runSelfCheckCase(const string &source, const string &engine)
+{
+#ifdef __unix__
+	if (engine == "aot")
+	{
+		try
+		{
+			return runAotSelfCheckCase(source);
+		}
+		catch (const CompileError &e)
+		{
+			return string("<compile error: ") + e.what() + ">\n";
+		}
+	}
+#endif
+	SymbolTable symTable;
+	ParseTreeNode *root = parseForExecution(source, symTable);
+	if (!root)
+		return "<syntax error>\n";
+	string output;
+	try
+	{
+		if (engine == "tree" || engine == "closures")
+		{
+			ClosureProgram program;
+			unique_ptr<TreeInterpreter> interpreter;
+			if (engine == "closures")
+				program = ClosureCompiler(symTable).compile(root);
+			else
+				interpreter = make_unique<TreeInterpreter>(root);
+			ClosureRuntime rt(engine == "closures" ? static_cast<NameTable &>(program) : interpreter->names);
+			rt.captureOutput = true;
+			try
+			{
+				if (engine == "closures")
+					rt.run(*program.functions[0]);
+				else
+					interpreter->run(rt);
+			}
+			catch (PyException &e)
+			{
+				rt.output += rt.describeException(e.exc) + "\n";
+			}
+			output = rt.output;
+		}
+		else
+		{
+			BytecodeCompiler compiler;
+			if (engine == "native")
+				compiler.natives = buildNativeModule(CTranspiler(symTable).transpile(root), "self_check");
+			else if (engine == "jit")
+				compiler.natives = buildJitModule(CTranspiler(symTable).transpile(root)).natives;
+			Program program = compiler.compile(root);
+			VirtualMachine vm(program);
+			vm.captureOutput = true;
+			try
+			{
+				vm.run();
+			}
+			catch (PyException &e)
+			{
+				vm.output += vm.describeException(e.exc) + "\n";
+			}
+			output = vm.output;
+		}
+	}
+	catch (const CompileError &e)
+	{
+		output = string("<compile error: ") + e.what() + ">\n";
+	}
+	return output;
+}
+
+int runSelfCheck()
+{
+	int failures = 0;
+	for (const SelfCheckCase &test : selfCheckCases)
+		for (const char *engine : {"tree", "closures", "vm", "jit", "native", "aot"})
+		{
+			if (string(engine) == "aot" && !test.aot)
+				continue;
+			string output = runSelfCheckCase(test.source, engine);
+			if (output == test.expected)
+				continue;
+			failures++;
+			cout << "FAIL " << test.name << " (" << engine << ")\n  expected:\n"
+				 << test.expected << "  got:\n"
+				 << output;
+		}
+	cout << (failures ? to_string(failures) + " self-check failures" : string("All self checks passed")) << "\n";
+	return failures ? 1 : 0;
+}
+} // namespace pyc::detail
@@ -0,0 +1,3896 @@
+#include "FrontEnd.h"
+
+namespace pyc::detail
+{
+// ----------------------------------------------
+// Allocation counting
+// ----------------------------------------------
+thread_local AllocationCounters allocationCounters;
+bool allocationHooks = false;
+bool allocationProfiling = false;
+SiteCounters allocationSites[size_t(AllocationSite::Count)];
+atomic<int64_t> liveBytes{0};
+thread_local AllocationSite allocationSite = AllocationSite::Other;
+thread_local int64_t *allocationPeak = nullptr;
+
+// ----------------------------------------------
+// Phase tracing
+// ----------------------------------------------
+Tracer tracer;
+
+// ----------------------------------------------
+// 3. Error Structure
+// ----------------------------------------------
+
+void printErrors(const vector<Error> &errors, ostream &out, ostream &err)
+{
+	if (errors.empty())
+	{
+		out << "\nNo errors found during tokenization." << endl;
+		return;
+	}
+
+	err << "\nTokenization errors (" << errors.size() << "):" << endl;
+	for (const auto &error : errors)
+	{
+		error.print(err);
+	}
+}
+
+// Exception for string handling
+class UnterminatedStringError : public std::exception
+{
+public:
+	int line_number;
+	size_t index;
+	// Constructor that takes line number and index
+	UnterminatedStringError(int line, int idx)
+		: line_number(line), index(idx) {}
+};
+
+class consumeError : public std::exception
+{
+};
+
+// ----------------------------------------------
+// 6. Lexer (purely lexical analysis)
+// ----------------------------------------------
+
+vector<Token> Lexer::tokenize(const string &source, vector<Error> &errors)
+{
+	vector<Token> tokens;
+	tokenize(source, errors, tokens);
+	return tokens;
+}
+
+void Lexer::tokenize(const string &source, vector<Error> &errors, vector<Token> &tokens)
+{
+	PYC_TRACE_SCOPE("lex");
+	emitted = 0;
+	int lineNumber = 1;
+	size_t i = 0;
+	resetState();
+
+	try
+	{
+		scan(source, i, lineNumber, errors, tokens);
+
+		// Add DEDENT tokens for remaining indentation levels at EOF
+		while (indentStack.size() > 1)
+		{
+			indentStack.pop_back();
+			emit(tokens, TokenType::DEDENT, "", lineNumber);
+		}
+	}
+	catch (const BudgetExceeded &e)
+	{
+		errors.push_back({e.what(), lineNumber, i});
+	}
+	tokens.erase(tokens.begin() + emitted, tokens.end());
+}
+
+void Lexer::resetState()
+{
+	indentStack = {0};
+	scopeStack.clear();
+	updateScope();
+	atLineStart = true;
+	lineContinuation = false;
+	openBrackets = 0;
+}
+
+void Lexer::tokenizeMore(const string &lines, int firstLine, vector<Error> &errors, vector<Token> &tokens)
+{
+	emitted = tokens.size();
+	size_t i = 0;
+	scan(lines, i, firstLine, errors, tokens);
+}
+
+void Lexer::closeBlocks(int lineNumber, vector<Token> &tokens)
+{
+	emitted = tokens.size();
+	while (indentStack.size() > 1)
+	{
+		indentStack.pop_back();
+		emit(tokens, TokenType::DEDENT, "", lineNumber);
+	}
+	while (!scopeStack.empty() && indentStack.back() <= scopeStack.back().indentLevel)
+		scopeStack.pop_back();
+	updateScope();
+}
+
+void Lexer::scan(const string &source, size_t &i, int &lineNumber, vector<Error> &errors, vector<Token> &tokens)
+{
+	while (i < source.size())
+	{
+		// Handle indentation at the start of a line (if not a continuation)
+		if (atLineStart && !lineContinuation && openBrackets == 0)
+		{
+			processIndentation(source, i, lineNumber, tokens, errors);
+			atLineStart = false;
+		}
+
+		skipNonLeadingWhitespace(source, i);
+
+		if (i >= source.size())
+			break;
+
+		char c = source[i];
+
+		// Handle newlines and reset flags
+		if (c == '\n')
+		{
+			lineNumber++;
+			i++;
+			atLineStart = true;
+			lineContinuation = false; // Reset continuation
+			continue;
+		}
+
+		// Check for line continuation (backslash before newline)
+		if (c == '\\' && i + 1 < source.size() && source[i + 1] == '\n')
+		{
+			lineContinuation = true;
+			i += 2; // Skip both '\' and '\n'
+			lineNumber++;
+			atLineStart = true;
+			continue;
+		}
+
+		// Handle single-line comments (# ...)
+		if (c == '#')
+		{
+			while (i < source.size() && source[i] != '\n')
+			{
+				i++;
+			}
+			continue;
+		}
+
+		int startlineNumber = lineNumber;
+		size_t literalStart = i;
+		try
+		{
+			// Handle triple-quoted strings
+			if (handleTripleQuotedString(source, i, lineNumber))
+			{
+				emit(tokens, TokenType::STRING_LITERAL, source, literalStart, i - literalStart, startlineNumber);
+				continue;
+			}
+		}
+		catch (const UnterminatedStringError &e)
+		{
+			errors.push_back({"Unterminated triple-quoted string", e.line_number, e.index});
+			continue;
+		}
+
+		// Identify keywords and identifiers
+		if (isalpha(static_cast<unsigned char>(c)) || c == '_')
+		{
+			size_t start = i;
+			while (i < source.size() &&
+				   (isalnum(static_cast<unsigned char>(source[i])) || source[i] == '_'))
+			{
+				i++;
+			}
+			word.assign(source, start, i - start);
+			if (pythonKeywords.find(word) != pythonKeywords.end())
+			{
+				// change the scope if it is a function or class
+				if (word == "def" || word == "class")
+				{
+					emit(tokens, pythonKeywords[word], word, lineNumber);
+					skipNonLeadingWhitespace(source, i);
+					size_t identifierStart = i;
+					while (i < source.size() && (isalnum(static_cast<unsigned char>(source[i])) || source[i] == '_'))
+					{
+						i++;
+					}
+					if (identifierStart < i)
+					{
+						scopeStack.push_back({source.substr(identifierStart, i - identifierStart), indentStack.back()});
+						updateScope();
+						emit(tokens, TokenType::IDENTIFIER, scopeStack.back().name, lineNumber, currentScope);
+					}
+				}
+				else
+				{
+					emit(tokens, pythonKeywords[word], word, lineNumber);
+				}
+			}
+			else
+			{
+				emit(tokens, TokenType::IDENTIFIER, word, lineNumber, currentScope);
+				// cout<< "scope of " << word << " is " << scopeStack << endl;
+			}
+			continue;
+		}
+
+		if (isOperatorStart(c))
+		{
+			if ((i + 2) < source.size())
+			{
+				string threeChars = source.substr(i, 3);
+				if (operators.find(threeChars) != operators.end())
+				{
+					emit(tokens, TokenType::OPERATOR, threeChars, lineNumber);
+					i += 3;
+					continue;
+				}
+			}
+			if ((i + 1) < source.size())
+			{
+				string twoChars = source.substr(i, 2);
+				if (operators.find(twoChars) != operators.end())
+				{
+					emit(tokens, TokenType::OPERATOR, twoChars, lineNumber);
+					i += 2;
+					continue;
+				}
+			}
+			string oneChar(1, c);
+			if (operators.find(oneChar) != operators.end())
+			{
+				emit(tokens, TokenType::OPERATOR, oneChar, lineNumber);
+				i++;
+				continue;
+			}
+		}
+
+		// Handle string literals with error checking
+		if (c == '"' || c == '\'')
+		{
+			try
+			{
+				handleDoubleQuotedString(source, i, lineNumber);
+				emit(tokens, TokenType::STRING_LITERAL, source, literalStart, i - literalStart, lineNumber);
+			}
+			catch (const UnterminatedStringError &e)
+			{
+				errors.push_back({"Unterminated string literal", e.line_number, e.index});
+			}
+			continue;
+		}
+
+		// Handle numeric literals
+		if (isdigit(static_cast<unsigned char>(c)))
+		{
+			size_t start = i;
+			bool hasDot = false;
+			while (i < source.size() && (isdigit(source[i]) || source[i] == '.'))
+			{
+				if (source[i] == '.' && hasDot)
+					break;
+				else if (source[i] == '.')
+					hasDot = true;
+				i++;
+			}
+			word.assign(source, start, i - start);
+			if (word[0] == '0' && std::stoi(word) != 0 && !hasDot)
+			{
+				errors.push_back({"leading zeros in decimal integer literals are not permitted", lineNumber, start});
+				continue;
+			}
+			emit(tokens, TokenType::NUMBER, word, lineNumber);
+			continue;
+		}
+
+		// Handle punctuation symbols
+		if (punctuationSymbols.find(c) != punctuationSymbols.end())
+		{
+			if (c == '(' || c == '[' || c == '{')
+				openBrackets++;
+			else if ((c == ')' || c == ']' || c == '}') && openBrackets > 0)
+				openBrackets--;
+			emit(tokens, punctuationSymbols[c], string(1, c), lineNumber);
+			i++;
+			continue;
+		}
+
+		// Unknown character - add error but keep going
+		errors.push_back({"Invalid character '" + string(1, c) + "'", lineNumber, i});
+		i++;
+		atLineStart = false;
+	}
+}
+
+void Lexer::emit(vector<Token> &tokens, TokenType type, const string &lexeme, int line, const string &scope)
+{
+	emit(tokens, type, lexeme, 0, lexeme.size(), line, scope);
+}
+
+void Lexer::emit(vector<Token> &tokens, TokenType type, const string &source, size_t start, size_t length,
+		  int line, const string &scope)
+{
+	PYC_ALLOC_SITE(TokenText);
+	if (budget)
+		budget->onToken(emitted + 1);
+	if (emitted == tokens.size())
+		tokens.emplace_back();
+	Token &tk = tokens[emitted++];
+	tk.type = type;
+	tk.lexeme.assign(source, start, length);
+	tk.lineNumber = line;
+	tk.scope = scope;
+}
+
+void Lexer::skipNonLeadingWhitespace(const string &source, size_t &idx)
+{
+	// Plain scan instead of regex: copying the remaining source on every
+	// call made tokenizing quadratic in the file size.
+	while (idx < source.size() &&
+		   (source[idx] == ' ' || source[idx] == '\t' || source[idx] == '\r'))
+	{
+		idx++;
+	}
+}
+
+bool Lexer::handleTripleQuotedString(const string &source, size_t &idx, int &lineNumber)
+{
+	int start_line = lineNumber;
+	if (idx + 2 < source.size())
+	{
+		char c = source[idx];
+		if ((c == '"' || c == '\'') &&
+			source[idx + 1] == c &&
+			source[idx + 2] == c)
+		{
+			char quoteChar = c;
+			size_t start = idx;
+			idx += 3; // skip opening triple quotes
+			while (idx + 2 < source.size())
+			{
+				if (source[idx] == '\\')
+				{
+					idx++; // Skip the escape character (actual handling depends on your needs)
+				}
+				else if (source[idx] == '\n')
+				{
+					lineNumber++;
+					idx++;
+				}
+				else if (source[idx] == '\r' && idx + 1 < source.size() && source[idx + 1] == '\n')
+				{
+					lineNumber++;
+					idx++; // Skip \r\n
+				}
+				if (source[idx] == quoteChar &&
+					source[idx + 1] == quoteChar &&
+					source[idx + 2] == quoteChar)
+				{
+					idx += 3; // skip closing triple quotes
+					return true;
+				}
+				idx++;
+			}
+			// If we get here, the string was never closed
+			idx = source.size();
+			throw UnterminatedStringError(start_line, start);
+		}
+	}
+	return false;
+}
+
+bool Lexer::isOperatorStart(char c)
+{
+	// A plain lookup: regex_match allocated on every character
+	return c != '\0' && strchr("~+-*/%=!<>&|^", c) != nullptr;
+}
+
+void Lexer::handleDoubleQuotedString(const string &source, size_t &idx, int &lineNumber)
+{
+	int start_line = lineNumber;
+	if (idx < source.size())
+	{
+		char quoteChar = source[idx];
+		size_t start = idx;
+		idx++; // skip opening quote
+		while (idx < source.size())
+		{
+			if (source[idx] == '\\')
+			{
+				idx++; // Skip the escape character (actual handling depends on your needs)
+			}
+			else if (source[idx] == '\n')
+			{
+				idx++;
+				throw UnterminatedStringError(start_line, start);
+			}
+			else if (source[idx] == quoteChar)
+			{
+				idx++;
+				return;
+			}
+			idx++;
+		}
+		// If we get here, the string was never closed
+		throw UnterminatedStringError(start_line, start);
+	}
+	throw UnterminatedStringError(start_line, idx);
+}
+
+void Lexer::processIndentation(const string &source, size_t &i, int lineNumber,
+						vector<Token> &tokens, vector<Error> &errors)
+{
+	size_t start = i;
+	int spaces = 0, tabs = 0;
+
+	// Count leading spaces/tabs
+	while (i < source.size() && (source[i] == ' ' || source[i] == '\t'))
+	{
+		if (source[i] == ' ')
+			spaces++;
+		else
+			tabs++;
+		i++;
+	}
+
+	// Error: Mixed tabs and spaces
+	if (spaces > 0 && tabs > 0)
+	{
+		errors.push_back({"Mixed tabs and spaces in indentation", lineNumber, start});
+	}
+	if (source[i] == '\n')
+	{
+		return;
+	}
+	// Calculate indentation level (1 tab = 4 spaces, adjust as needed)
+	int newIndent = tabs * 4 + spaces;
+
+	// Compare with current indentation
+	if (newIndent > indentStack.back())
+	{
+		indentStack.push_back(newIndent);
+		emit(tokens, TokenType::INDENT, "", lineNumber);
+	}
+	else if (newIndent < indentStack.back())
+	{
+		// Pop until matching indentation level
+		while (indentStack.back() > newIndent)
+		{
+			indentStack.pop_back();
+			emit(tokens, TokenType::DEDENT, "", lineNumber);
+			// Pop scope ONLY if dedenting past its original indentation level
+			while (!scopeStack.empty() && indentStack.back() <= scopeStack.back().indentLevel)
+			{
+				scopeStack.pop_back();
+				updateScope();
+			}
+			if (indentStack.empty())
+			{
+				errors.push_back({"Dedent exceeds indentation level", lineNumber, start});
+				indentStack.push_back(0); // Recover
+				break;
+			}
+		}
+		// Error: No matching indentation level
+		if (indentStack.back() != newIndent)
+		{
+			errors.push_back({"Unindent does not match outer level", lineNumber, start});
+		}
+	}
+	// Equal indentation: Do nothing
+}
+
+void Lexer::updateScope()
+{
+	if (scopeStack.empty())
+	{
+		currentScope = "global";
+		return;
+	}
+	currentScope = scopeStack.back().name;
+	for (auto it = scopeStack.rbegin() + 1; it != scopeStack.rend(); ++it)
+	{
+		currentScope += '@';
+		currentScope += it->name;
+	}
+}
+
+// ----------------------------------------------
+// 7. Parser for basic type inference
+// ----------------------------------------------
+
+void Parser::parse()
+{
+	PYC_TRACE_SCOPE("symbol pass");
+	lastKeyword.clear();
+	try
+	{
+		parse(0, tokens.size());
+	}
+	catch (const BudgetExceeded &)
+	{
+		// The monitor keeps the reason; parseProgram reports it
+	}
+}
+
+void Parser::parse(size_t begin, size_t end)
+{
+	size_t i = begin;
+	while (i < end)
+	{
+		const Token &tk = tokens[i];
+
+		if (tk.type == TokenType::DefKeyword || tk.type == TokenType::ClassKeyword)
+		{
+			lastKeyword = tk.lexeme;
+			i++;
+		}
+		else if (tk.type == TokenType::IDENTIFIER)
+		{
+			// If last keyword was 'def' or 'class', then this is a new function/class name
+			if (lastKeyword == "def")
+			{
+				symbolTable.addSymbol(tk.lexeme, "function", tk.lineNumber, tk.scope);
+				lastKeyword.clear();
+				i++;
+			}
+			else if (lastKeyword == "class")
+			{
+				symbolTable.addSymbol(tk.lexeme, "class", tk.lineNumber, tk.scope);
+				lastKeyword.clear();
+				i++;
+			}
+			else
+			{
+				// handle multiple assignment like x,y = 2,3 -> assigns x = 2 and y = 3
+				size_t temp = i;
+				lhsIdentifiers.clear();
+				while (temp < tokens.size())
+				{
+					if (tokens[temp].type == TokenType::IDENTIFIER)
+					{
+						lhsIdentifiers.push_back(&tokens[temp]);
+						temp++;
+						if (temp < tokens.size() && tokens[temp].type == TokenType::Comma)
+						{
+							temp++;
+						}
+						else
+						{
+							break;
+						}
+					}
+					else
+					{
+						break;
+					}
+				}
+
+				if (temp < tokens.size() && tokens[temp].type == TokenType::OPERATOR && tokens[temp].lexeme == "=")
+				{
+					temp++;
+					rhsValues.clear();
+					while (temp < tokens.size())
+					{
+						auto [type, value] = parseExpression(temp);
+						rhsValues.push_back({type, value});
+						if (temp < tokens.size() && tokens[temp].type == TokenType::Comma)
+						{
+							temp++;
+						}
+						else
+						{
+							break;
+						}
+					}
+
+					for (size_t j = 0; j < lhsIdentifiers.size(); ++j)
+					{
+						const Token &var = *lhsIdentifiers[j];
+						if (!symbolTable.exist(var.lexeme, var.scope))
+						{
+							symbolTable.addSymbol(var.lexeme, "unknown", var.lineNumber, var.scope);
+						}
+						else
+						{
+							symbolTable.table[symbolTable.keyFor(var.lexeme, var.scope)].usageCount++;
+						}
+						if (j < rhsValues.size())
+						{
+							if (rhsValues[j].first != "unknown")
+							{
+								symbolTable.updateType(var.lexeme, var.scope, rhsValues[j].first);
+							}
+							if (!rhsValues[j].second.empty())
+							{
+								symbolTable.updateValue(var.lexeme, var.scope, rhsValues[j].second);
+							}
+						}
+					}
+					i = temp;
+					continue;
+				}
+				// Check if next token is '=' (assignment)
+				if ((i + 1) < tokens.size() &&
+					tokens[i + 1].type == TokenType::OPERATOR &&
+					tokens[i + 1].lexeme == "=")
+				{
+					// We have "identifier = ..."
+					const string &lhsName = tk.lexeme;
+					int lineNumber = tk.lineNumber;
+					// Add symbol if not exist
+					fullName.assign(lhsName).append(1, '@').append(tk.scope);
+					if (!symbolTable.exist(fullName, tk.scope))
+					{
+						symbolTable.addSymbol(lhsName, "unknown", lineNumber, tk.scope);
+					}
+					else
+					{
+						// If it exists, usage count will increment
+						symbolTable.table[symbolTable.keyFor(lhsName, tk.scope)].usageCount++;
+					}
+					i += 2; // skip past "identifier" and "="
+					auto [rhsType, rhsValue] = parseExpression(i);
+
+					// Update the LHS symbol with the inferred type/value
+					if (rhsType != "unknown")
+					{
+						symbolTable.updateType(lhsName, tk.scope, rhsType);
+					}
+					if (!rhsValue.empty())
+					{
+						symbolTable.updateValue(lhsName, tk.scope, rhsValue);
+					}
+				}
+				else
+				{
+
+					if (symbolTable.exist(tk.lexeme, tk.scope))
+					{
+						symbolTable.table[symbolTable.keyFor(tk.lexeme, tk.scope)].usageCount++;
+					}
+
+					else
+					{
+						symbolTable.addSymbol(tk.lexeme, "unknown", tk.lineNumber, tk.scope);
+					}
+					i++;
+				}
+			}
+		}
+		else
+		{
+			// We ignore other tokens (operators, delimiters, etc.) for now
+			i++;
+		}
+	}
+}
+
+pair<string, string> Parser::parseExpression(size_t &i)
+{
+	// Parenthesised operands come back here, so this is where it nests
+	struct Nesting
+	{
+		int &depth;
+		~Nesting() { depth--; }
+	} nesting{++depth};
+	if (budget)
+		budget->onDepth(depth);
+
+	// Parse the first operand
+	auto [accumType, accumValue] = parseOperand(i);
+	while (i < tokens.size())
+	{
+		if (tokens[i].type == TokenType::OPERATOR)
+		{
+			string op = tokens[i].lexeme;
+			if (op == "+" || op == "-" || op == "*" || op == "/")
+			{
+				i++;
+				auto [nextType, nextValue] = parseOperand(i);
+				accumType = unifyTypes(accumType, nextType);
+				accumValue = "";
+			}
+			else
+			{
+				break;
+			}
+		}
+		else
+		{
+			break;
+		}
+	}
+	return {accumType, accumValue};
+}
+
+pair<string, string> Parser::parseOperand(size_t &i)
+{
+	if (i >= tokens.size())
+	{
+		return {"unknown", ""};
+	}
+
+	const Token &tk = tokens[i];
+
+	// If it's a numeric literal
+	if (tk.type == TokenType::NUMBER)
+	{
+		// check if there's a '.' => float
+		if (tk.lexeme.find('.') != string::npos)
+		{
+			i++;
+			return {"float", tk.lexeme};
+		}
+		else
+		{
+			i++;
+			return {"int", tk.lexeme};
+		}
+	}
+
+	// If it's a string literal
+	if (tk.type == TokenType::STRING_LITERAL)
+	{
+		i++;
+		return {"string", tk.lexeme};
+	}
+
+	// If it's a keyword => might be True/False
+	if (tk.type == TokenType::FalseKeyword || tk.type == TokenType::TrueKeyword)
+	{
+		if (tk.lexeme == "True" || tk.lexeme == "False")
+		{
+			i++;
+			return {"bool", tk.lexeme};
+		}
+		i++;
+		return {"unknown", ""};
+	}
+
+	// If it's an identifier
+	if (tk.type == TokenType::IDENTIFIER)
+	{
+		const string &name = tk.lexeme;
+		string knownType = symbolTable.getType(name, tk.scope);
+		string knownValue = symbolTable.getValue(name, tk.scope);
+		fullName.assign(name).append(1, '@').append(tk.scope);
+		if (!symbolTable.exist(fullName, tk.scope))
+		{
+			symbolTable.addSymbol(name, "unknown", tk.lineNumber, tk.scope);
+		}
+		else
+		{
+			symbolTable.table[fullName].usageCount++;
+		}
+		i++;
+		return {knownType, knownType == "unknown" ? "" : knownValue};
+	}
+
+	// if it's a tuple
+	if (tk.lexeme == "(")
+	{
+		string value = "(";
+		i++;
+		vector<string> elementTypes;
+		vector<string> elementValues;
+
+		while (i < tokens.size() && tokens[i].lexeme != ")")
+		{
+			auto [innerType, innerValue] = parseExpression(i);
+			elementTypes.push_back(innerType);
+			elementValues.push_back(innerValue);
+
+			if (i < tokens.size() && tokens[i].lexeme == ",")
+			{
+				value += innerValue + ",";
+				i++; // Skip the comma
+			}
+			else
+			{
+				value += innerValue;
+				break;
+			}
+		}
+
+		if (i < tokens.size() && tokens[i].lexeme == ")")
+		{
+			i++;
+			value += ")";
+			if (elementTypes.size() == 1)
+			{
+				// Single element in parentheses, treat as the element itself
+				return {elementTypes[0], value};
+			}
+			else
+			{
+				// Multiple elements, treat as a tuple
+				return {"tuple", value};
+			}
+		}
+		else
+		{
+			// If no closing parenthesis, return unknown
+			return {"unknown", value};
+		}
+	}
+
+	// if it's a list
+	if (tk.lexeme == "[")
+	{
+		string value = "[";
+		i++;
+		while (i < tokens.size() && tokens[i].lexeme != "]")
+		{
+			value = value + tokens[i].lexeme;
+			i++;
+		}
+		if (i < tokens.size() && tokens[i].lexeme == "]")
+		{
+			i++;
+		}
+		value = value + "]";
+		return {"list", value};
+	}
+
+	// if it's a dictionary or set
+	if (tk.lexeme == "{")
+	{
+		string value = "{";
+		i++;
+		bool isSet = true;
+		while (i < tokens.size() && tokens[i].lexeme != "}")
+		{
+			if (tokens[i].lexeme == ":")
+			{
+				isSet = false;
+			}
+			value = value + tokens[i].lexeme;
+			i++;
+		}
+		if (i < tokens.size() && tokens[i].lexeme == "}")
+		{
+			i++;
+		}
+		value = value + "}";
+		return {isSet ? "set" : "dictionary", value};
+	}
+
+	// Otherwise unknown
+	i++;
+	return {"unknown", ""};
+}
+
+string Parser::unifyTypes(const string &t1, const string &t2)
+{
+	if (t1 == "unknown" && t2 == "unknown")
+		return "unknown";
+	if (t1 == "unknown")
+		return t2;
+	if (t2 == "unknown")
+		return t1;
+
+	// If either is float => float
+	if (t1 == "float" || t2 == "float")
+	{
+		// If one is string and other is float => unknown, or you can define a rule
+		if (t1 == "string" || t2 == "string" ||
+			t1 == "bool" || t2 == "bool")
+		{
+			return "unknown";
+		}
+		return "float";
+	}
+
+	// If both are int => int
+	if (t1 == "int" && t2 == "int")
+	{
+		return "int";
+	}
+
+	// If both are bool => bool (some languages let you do bool+bool => int, but we'll keep it simple)
+	if (t1 == "bool" && t2 == "bool")
+	{
+		return "bool";
+	}
+
+	if (t1 == "string" && t2 != "string")
+	{
+		return "unknown";
+	}
+
+	if (t2 == "string" && t1 != "string")
+	{
+		return "unknown";
+	}
+
+	// If they're the same, return it
+	if (t1 == t2)
+	{
+		return t1;
+	}
+
+	// Anything else => unknown
+	return "unknown";
+}
+
+// ----------------------------------------------
+// Parallel semantic pass
+// ----------------------------------------------
+// The token stream is cut into units: every top-level def/class with an
+// indented body is one unit, and the module-level code between them forms
+// the rest. Units whose identifiers share a root scope (the outermost name
+// in "inner@outer") are grouped together so that no two groups ever touch
+// the same "name@scope" key. Each group is analyzed by its own Parser into a
+// thread-local SymbolTable, and the tables are merged in the order the
+// sequential pass would have created the entries, so entry numbers are the
+// same for any number of threads.
+struct SemanticUnit
+{
+	size_t begin;
+	size_t end;
+};
+
+static string rootScope(const string &scope)
+{
+	size_t at = scope.rfind('@');
+	return at == string::npos ? scope : scope.substr(at + 1);
+}
+
+vector<SemanticUnit> splitSemanticUnits(const vector<Token> &tokens)
+{
+	vector<SemanticUnit> units;
+	size_t segmentStart = 0;
+	int depth = 0;
+	size_t i = 0;
+	while (i < tokens.size())
+	{
+		const Token &tk = tokens[i];
+		if (depth == 0 && (tk.type == TokenType::DefKeyword || tk.type == TokenType::ClassKeyword))
+		{
+			// The body must start with an INDENT on the line after the header
+			size_t k = i;
+			while (k < tokens.size() && tokens[k].lineNumber == tk.lineNumber)
+				k++;
+			if (k < tokens.size() && tokens[k].type == TokenType::INDENT)
+			{
+				int bodyDepth = 0;
+				size_t end = k;
+				while (end < tokens.size())
+				{
+					if (tokens[end].type == TokenType::INDENT)
+						bodyDepth++;
+					else if (tokens[end].type == TokenType::DEDENT && --bodyDepth == 0)
+					{
+						end++;
+						break;
+					}
+					end++;
+				}
+				if (segmentStart < i)
+					units.push_back({segmentStart, i});
+				units.push_back({i, end});
+				segmentStart = end;
+				i = end;
+				continue;
+			}
+		}
+		if (tk.type == TokenType::INDENT)
+			depth++;
+		else if (tk.type == TokenType::DEDENT && depth > 0)
+			depth--;
+		i++;
+	}
+	if (segmentStart < tokens.size())
+		units.push_back({segmentStart, tokens.size()});
+	return units;
+}
+
+// Groups unit indices so that groups have disjoint root scopes; groups and
+// the units inside them are returned in source order.
+vector<vector<size_t>> groupSemanticUnits(const vector<Token> &tokens, const vector<SemanticUnit> &units)
+{
+	vector<size_t> parent(units.size());
+	for (size_t u = 0; u < units.size(); u++)
+		parent[u] = u;
+	function<size_t(size_t)> find = [&](size_t u)
+	{
+		while (parent[u] != u)
+			u = parent[u] = parent[parent[u]];
+		return u;
+	};
+	auto unite = [&](size_t a, size_t b)
+	{
+		a = find(a);
+		b = find(b);
+		if (a != b)
+			parent[max(a, b)] = min(a, b);
+	};
+
+	unordered_map<string, size_t> ownerOfRoot;
+	for (size_t u = 0; u < units.size(); u++)
+	{
+		for (size_t i = units[u].begin; i < units[u].end; i++)
+		{
+			if (tokens[i].type != TokenType::IDENTIFIER)
+				continue;
+			auto [it, inserted] = ownerOfRoot.emplace(rootScope(tokens[i].scope), u);
+			if (!inserted)
+				unite(it->second, u);
+		}
+	}
+
+	vector<vector<size_t>> groups;
+	unordered_map<size_t, size_t> groupOfRoot;
+	for (size_t u = 0; u < units.size(); u++)
+	{
+		size_t r = find(u);
+		auto [it, inserted] = groupOfRoot.emplace(r, groups.size());
+		if (inserted)
+			groups.emplace_back();
+		groups[it->second].push_back(u);
+	}
+	return groups;
+}
+
+void parallelParse(const vector<Token> &tokens, SymbolTable &symTable, unsigned jobs)
+{
+	PYC_TRACE_SCOPE("symbol pass");
+	// One worker gains nothing from splitting, grouping and merging
+	if (jobs <= 1)
+	{
+		Parser parser(tokens, symTable);
+		parser.parse();
+		return;
+	}
+	vector<SemanticUnit> units = splitSemanticUnits(tokens);
+	vector<vector<size_t>> groups = groupSemanticUnits(tokens, units);
+
+	struct GroupResult
+	{
+		SymbolTable table;
+		vector<pair<int, size_t>> unitStarts; // first local entry created in each unit
+	};
+	vector<GroupResult> results(groups.size());
+
+	{
+		WorkStealingPool pool(jobs);
+		// Largest groups first so one big class does not start last
+		vector<size_t> order(groups.size());
+		vector<size_t> weight(groups.size(), 0);
+		for (size_t g = 0; g < groups.size(); g++)
+		{
+			order[g] = g;
+			for (size_t u : groups[g])
+				weight[g] += units[u].end - units[u].begin;
+		}
+		stable_sort(order.begin(), order.end(), [&](size_t a, size_t b)
+					{ return weight[a] > weight[b]; });
+
+		for (size_t g : order)
+		{
+			pool.submit([&, g]
+						{
+				GroupResult &result = results[g];
+				Parser parser(tokens, result.table);
+				for (size_t u : groups[g])
+				{
+					PYC_TRACE_STATEMENT("symbol pass unit", tokens[units[u].begin].lineNumber);
+					result.unitStarts.push_back({result.table.nextEntry, u});
+					parser.parse(units[u].begin, units[u].end);
+				} });
+		}
+		pool.wait();
+	}
+
+	// Deterministic merge: order by (unit, local entry), which is the order
+	// addSymbol would have been called in a single sequential pass.
+	struct PendingSymbol
+	{
+		size_t unit;
+		int localEntry;
+		const pmr::string *key;
+		SymbolTable::SymbolInfo *info;
+	};
+	vector<PendingSymbol> pendingSymbols;
+	for (GroupResult &result : results)
+	{
+		for (auto &[key, info] : result.table.table)
+		{
+			auto it = upper_bound(result.unitStarts.begin(), result.unitStarts.end(), info.entry,
+								  [](int entry, const pair<int, size_t> &start)
+								  { return entry < start.first; });
+			pendingSymbols.push_back({prev(it)->second, info.entry, &key, &info});
+		}
+	}
+	sort(pendingSymbols.begin(), pendingSymbols.end(), [](const PendingSymbol &a, const PendingSymbol &b)
+		 { return a.unit != b.unit ? a.unit < b.unit : a.localEntry < b.localEntry; });
+
+	for (const PendingSymbol &symbol : pendingSymbols)
+	{
+		auto it = symTable.table.find(*symbol.key);
+		if (it == symTable.table.end())
+		{
+			SymbolTable::SymbolInfo info = *symbol.info;
+			info.entry = symTable.nextEntry++;
+			symTable.table.emplace(*symbol.key, move(info));
+		}
+		else
+		{
+			// Only possible if the caller's table was not empty
+			it->second.usageCount += symbol.info->usageCount;
+			if (symbol.info->type != "unknown")
+				it->second.type = symbol.info->type;
+			if (!symbol.info->value.empty())
+				it->second.value = symbol.info->value;
+		}
+	}
+}
+
+// ----------------------------------------------
+// Syntax_Analyzer
+// ----------------------------------------------
+
+std::string tokenTypeToString(TokenType type)
+{
+	static const std::unordered_map<TokenType, std::string> typeStrings = {
+		// Keywords
+		{TokenType::FalseKeyword, "False"},
+		{TokenType::NoneKeyword, "None"},
+		{TokenType::TrueKeyword, "True"},
+		{TokenType::AndKeyword, "and"},
+		{TokenType::AsKeyword, "as"},
+		{TokenType::AssertKeyword, "assert"},
+		{TokenType::AsyncKeyword, "async"},
+		{TokenType::AwaitKeyword, "await"},
+		{TokenType::BreakKeyword, "break"},
+		{TokenType::ClassKeyword, "class"},
+		{TokenType::ContinueKeyword, "continue"},
+		{TokenType::DefKeyword, "def"},
+		{TokenType::DelKeyword, "del"},
+		{TokenType::ElifKeyword, "elif"},
+		{TokenType::ElseKeyword, "else"},
+		{TokenType::ExceptKeyword, "except"},
+		{TokenType::FinallyKeyword, "finally"},
+		{TokenType::ForKeyword, "for"},
+		{TokenType::FromKeyword, "from"},
+		{TokenType::GlobalKeyword, "global"},
+		{TokenType::IfKeyword, "if"},
+		{TokenType::ImportKeyword, "import"},
+		{TokenType::InKeyword, "in"},
+		{TokenType::IsKeyword, "is"},
+		{TokenType::LambdaKeyword, "lambda"},
+		{TokenType::NonlocalKeyword, "nonlocal"},
+		{TokenType::NotKeyword, "not"},
+		{TokenType::OrKeyword, "or"},
+		{TokenType::PassKeyword, "pass"},
+		{TokenType::RaiseKeyword, "raise"},
+		{TokenType::ReturnKeyword, "return"},
+		{TokenType::TryKeyword, "try"},
+		{TokenType::WhileKeyword, "while"},
+		{TokenType::WithKeyword, "with"},
+		{TokenType::YieldKeyword, "yield"},
+
+		// Literals and identifiers
+		{TokenType::IDENTIFIER, "identifier"},
+		{TokenType::NUMBER, "number"},
+		{TokenType::STRING_LITERAL, "string literal"},
+		{TokenType::UNKNOWN, "unknown"},
+
+		// Operators and punctuation
+		{TokenType::OPERATOR, "operator"},
+		{TokenType::LeftParenthesis, "("},
+		{TokenType::RightParenthesis, ")"},
+		{TokenType::LeftBracket, "["},
+		{TokenType::RightBracket, "]"},
+		{TokenType::LeftBrace, "{"},
+		{TokenType::RightBrace, "}"},
+		{TokenType::Colon, ":"},
+		{TokenType::Comma, ","},
+		{TokenType::Dot, "."},
+		{TokenType::Semicolon, ";"},
+
+		// Indentation
+		{TokenType::INDENT, "indent"},
+		{TokenType::DEDENT, "dedent"}};
+
+	auto it = typeStrings.find(type);
+	if (it != typeStrings.end())
+	{
+		return it->second;
+	}
+	return "unknown token"; // Fallback for any unhandled types
+}
+
+ParseTreeNode *Syntax_Analyzer::makeNode(string_view label)
+{
+	PYC_ALLOC_SITE(TreeNodes);
+	if (budget)
+		budget->onNode(++nodesMade);
+	return arena ? arena->make(label) : new ParseTreeNode(string(label));
+}
+
+void Syntax_Analyzer::error(const string &message)
+{
+	errorCount++;
+	if (current >= tokens.size())
+	{
+		current = tokens.size() - 1;
+	}
+	*diagnostics << "Syntax Error at line " << currentToken().lineNumber
+				 << ": " << message << endl;
+	if (!appendErrorLog)
+		return;
+	// Also write to a file
+	std::ofstream out("syntax_errors.txt", std::ios::app);
+	if (out.is_open())
+	{
+		out << "Syntax Error at line " << currentToken().lineNumber
+			<< ": " << message << std::endl;
+		out.close();
+	}
+}
+
+const Token &Syntax_Analyzer::consume(TokenType expected)
+{
+	if (current >= tokens.size())
+	{
+		static const Token missing(TokenType::UNKNOWN, "Error", -1, "Error");
+		return missing;
+	}
+	if (currentToken().type == expected)
+	{
+		return tokens[current++]; // Match: return token and advance
+	}
+	error("Expected " + tokenTypeToString(expected) +
+		  " but found " + tokenTypeToString(currentToken().type));
+	throw consumeError();
+}
+
+void Syntax_Analyzer::synchronize(int lineNumber)
+{
+	// Error recovery - skip until synchronization point
+	while (current < tokens.size() &&
+		   currentToken().lineNumber <= lineNumber)
+	{
+		current++;
+	}
+}
+
+Token &Syntax_Analyzer::peekToken()
+{
+	static Token dummy(TokenType::UNKNOWN, "", -1, "");
+	return (current + 1 < tokens.size()) ? tokens[current + 1] : dummy;
+}
+
+ParseTreeNode *Syntax_Analyzer::parseProgram()
+{
+	PYC_TRACE_SCOPE("syntax analysis");
+	current = 0;
+	errorCount = 0;
+	nodesMade = 0;
+	depth = 0;
+	ParseTreeNode *programNode = makeNode("program");
+	while (current < tokens.size())
+	{
+		PYC_TRACE_STATEMENT("top-level statement", currentToken().lineNumber);
+		try
+		{
+			if (budget)
+				budget->poll();
+			if (current != 0 &&
+				currentToken().lineNumber <= tokens[current - 1].lineNumber &&
+				tokens[current - 1].type != TokenType::DEDENT)
+			{
+				error("Statements must be separated by NEWLINE");
+				synchronize(currentToken().lineNumber);
+				continue;
+			}
+			if (currentToken().type == TokenType::DEDENT)
+			{
+				consume(TokenType::DEDENT);
+				if (current >= tokens.size())
+				{
+					continue;
+				}
+			}
+			programNode->addChild(parseStatement());
+		}
+		catch (const consumeError &)
+		{
+			synchronize(currentToken().lineNumber);
+		}
+		catch (const BudgetExceeded &e)
+		{
+			// Nodes of the unfinished statement are dropped, as after syntax errors
+			pending.clear();
+			error(e.what());
+			break;
+		}
+	}
+
+	return programNode;
+}
+
+ParseTreeNode *Syntax_Analyzer::parseFunction()
+{
+	ParseTreeNode *funcNode = makeNode("function");
+	try
+	{
+		funcNode->addChild(makeNode(consume(TokenType::DefKeyword).lexeme));
+		funcNode->addChild(makeNode(consume(TokenType::IDENTIFIER).lexeme));
+		funcNode->addChild(makeNode(consume(TokenType::LeftParenthesis).lexeme));
+		funcNode->addChild(parseParameters());
+		funcNode->addChild(makeNode(consume(TokenType::RightParenthesis).lexeme));
+		funcNode->addChild(makeNode(consume(TokenType::Colon).lexeme));
+		funcNode->addChild(parseBlock());
+	}
+	catch (const consumeError &)
+	{
+		error("Could not parse function");
+		throw consumeError();
+	}
+	return funcNode;
+}
+
+ParseTreeNode *Syntax_Analyzer::parseParameters()
+{
+	ParseTreeNode *paramsNode = makeNode("parameters");
+	try
+	{
+		if (current < tokens.size() && currentToken().type != TokenType::RightParenthesis)
+		{
+			paramsNode->addChild(parseParameter());
+
+			while (current < tokens.size() && currentToken().type == TokenType::Comma)
+			{
+				paramsNode->addChild(makeNode(consume(TokenType::Comma).lexeme));
+				paramsNode->addChild(parseParameter());
+			}
+		}
+	}
+	catch (const consumeError &)
+	{
+		error("Could not parse paramters");
+		throw consumeError();
+	}
+	return paramsNode;
+}
+
+ParseTreeNode *Syntax_Analyzer::parseParameter()
+{
+	ParseTreeNode *paramNode = makeNode("parameter");
+	try
+	{
+		paramNode->addChild(makeNode(consume(TokenType::IDENTIFIER).lexeme));
+		if (current < tokens.size() && currentToken().type == TokenType::OPERATOR && currentToken().lexeme == "=")
+		{
+			paramNode->addChild(makeNode(consume(TokenType::OPERATOR).lexeme));
+			paramNode->addChild(parseExpression());
+		}
+	}
+	catch (const consumeError &)
+	{
+		error("Could not parse parameter");
+		throw consumeError();
+	}
+	return paramNode;
+}
+
+ParseTreeNode *Syntax_Analyzer::parseStatement()
+{
+	if (current >= tokens.size())
+	{
+		throw consumeError();
+		error("Could not parse statement");
+	}
+	ParseTreeNode *stmtNode = makeNode("statement");
+	try
+	{
+		switch (currentToken().type)
+		{
+		case TokenType::IDENTIFIER:
+		{
+			// Look ahead to decide: dotted name or function call or assignment
+			Token next = peekToken();
+			if (next.type == TokenType::LeftParenthesis)
+			{
+				// Simple function call
+				stmtNode->addChild(parseFunctionCall());
+			}
+			else if (next.type == TokenType::Dot)
+			{
+				// Look further: after dotted name, is it '(' → function call, or '=' → assignment?
+				size_t temp = current;
+				ParseTreeNode *dotted = parseDottedName();
+				if (current < tokens.size())
+				{
+					if (currentToken().type == TokenType::LeftParenthesis)
+					{
+						// Reset and parse as function call
+						current = temp;
+						stmtNode->addChild(parseFunctionCall());
+					}
+					else if (currentToken().type == TokenType::OPERATOR && currentToken().lexeme == "=")
+					{
+						// Reset and parse as assignment
+						current = temp;
+						stmtNode->addChild(parseAssignmentStmt());
+					}
+					else
+					{
+						error("Expected '(' or '=' after dotted name");
+						throw consumeError();
+					}
+				}
+				else
+				{
+					error("Unexpected end after dotted name");
+					throw consumeError();
+				}
+			}
+			else
+			{
+				stmtNode->addChild(parseAssignmentStmt());
+			}
+			break;
+		}
+
+		case TokenType::WhileKeyword:
+			stmtNode->addChild(parseWhileStmt());
+			break;
+		case TokenType::ForKeyword:
+			stmtNode->addChild(parseForStmt());
+			break;
+		case TokenType::IfKeyword:
+			stmtNode->addChild(parseConditionalStmt());
+			break;
+		case TokenType::ClassKeyword:
+			stmtNode->addChild(parseClassDef());
+			break;
+		case TokenType::ImportKeyword:
+		case TokenType::FromKeyword:
+			stmtNode->addChild(parseImport());
+			break;
+		case TokenType::ReturnKeyword:
+			stmtNode->addChild(parseReturn());
+			break;
+		case TokenType::PassKeyword:
+			stmtNode->addChild(parsePass());
+			break;
+		case TokenType::BreakKeyword:
+			stmtNode->addChild(parseBreak());
+			break;
+		case TokenType::ContinueKeyword:
+			stmtNode->addChild(parseContinue());
+			break;
+		case TokenType::RaiseKeyword:
+			stmtNode->addChild(parseRaise());
+			break;
+		case TokenType::TryKeyword:
+			stmtNode->addChild(parseTryStmt());
+			break;
+		case TokenType::STRING_LITERAL:
+			stmtNode->addChild(parseFactor());
+			break;
+		case TokenType::DefKeyword:
+			stmtNode->addChild(parseFunction());
+			break;
+		default:
+			error("Cannot Parse Statement!");
+			throw consumeError();
+		}
+	}
+	catch (const consumeError &)
+	{
+		error("Could not parse statement");
+		throw consumeError();
+	}
+	return stmtNode;
+}
+
+ParseTreeNode *Syntax_Analyzer::parseReturn()
+{
+	ParseTreeNode *returnNode = makeNode("return_statement");
+	returnNode->addChild(makeNode(consume(TokenType::ReturnKeyword).lexeme));
+	try
+	{
+		returnNode->addChild(parseExpression());
+	}
+	catch (const consumeError &)
+	{
+		error("Could not parse return statement");
+		throw consumeError();
+	}
+	return returnNode;
+}
+
+ParseTreeNode *Syntax_Analyzer::parsePass()
+{
+	ParseTreeNode *passNode = makeNode("pass_statement");
+	try
+	{
+		passNode->addChild(makeNode(consume(TokenType::PassKeyword).lexeme));
+	}
+	catch (const consumeError &)
+	{
+		error("Could not parse pass statement");
+		throw consumeError();
+	}
+	return passNode;
+}
+
+ParseTreeNode *Syntax_Analyzer::parseBreak()
+{
+	ParseTreeNode *breakNode = makeNode("break_statement");
+	try
+	{
+		breakNode->addChild(makeNode(consume(TokenType::BreakKeyword).lexeme));
+	}
+	catch (const consumeError &)
+	{
+		error("Could not parse break");
+		throw consumeError();
+	}
+	return breakNode;
+}
+
+ParseTreeNode *Syntax_Analyzer::parseContinue()
+{
+	ParseTreeNode *continueNode = makeNode("continue_statement");
+	try
+	{
+		continueNode->addChild(makeNode(consume(TokenType::ContinueKeyword).lexeme));
+	}
+	catch (const consumeError &)
+	{
+		error("Could not continue statement");
+		throw consumeError();
+	}
+	return continueNode;
+}
+
+ParseTreeNode *Syntax_Analyzer::parseClassBlock()
+{
+	NestingScope nesting(*this);
+	ParseTreeNode *classBlockNode = makeNode("class_block");
+	int prevLine = currentToken().lineNumber;
+
+	try
+	{
+		consume(TokenType::INDENT);
+		classBlockNode->addChild(makeNode("INDENT"));
+
+		while (current < tokens.size() && currentToken().type != TokenType::DEDENT)
+		{
+			if (currentToken().type == TokenType::DefKeyword)
+			{
+				classBlockNode->addChild(parseFunction());
+			}
+			else
+			{
+				classBlockNode->addChild(parseAssignmentStmt());
+			}
+
+			// Prevent same-line statements
+			if (currentToken().lineNumber <= prevLine)
+			{
+				error("Class members must be on separate lines");
+				synchronize(currentToken().lineNumber);
+				continue;
+			}
+			prevLine = currentToken().lineNumber;
+		}
+
+		classBlockNode->addChild(makeNode("DEDENT"));
+		consume(TokenType::DEDENT);
+	}
+	catch (const consumeError &)
+	{
+		error("Could not parse class block");
+		throw consumeError();
+	}
+
+	return classBlockNode;
+}
+
+ParseTreeNode *Syntax_Analyzer::parseBlock()
+{
+	NestingScope nesting(*this);
+	ParseTreeNode *blockNode = makeNode("block");
+	if (current >= tokens.size())
+	{
+		error("Could not parse block");
+		throw consumeError();
+	}
+	bool isSingleLine = (currentToken().type != TokenType::INDENT && currentToken().lineNumber == tokens[current - 1].lineNumber);
+	int prevLine = currentToken().lineNumber;
+	try
+	{
+		if (!isSingleLine)
+		{
+			consume(TokenType::INDENT);
+			blockNode->addChild(makeNode("INDENT"));
+			if (current < tokens.size() && currentToken().type == TokenType::DefKeyword)
+			{
+				blockNode->addChild(parseFunction());
+			}
+			else
+				blockNode->addChild(parseStatement());
+			while (current < tokens.size() && currentToken().type != TokenType::DEDENT)
+			{
+				if (currentToken().lineNumber <= prevLine)
+				{
+					error("Statements must be separated by NEWLINE");
+					synchronize(currentToken().lineNumber);
+					continue;
+				}
+				prevLine = currentToken().lineNumber;
+				blockNode->addChild(parseStatement());
+			}
+			try
+			{
+				blockNode->addChild(makeNode("DEDENT"));
+				consume(TokenType::DEDENT);
+			}
+			catch (const consumeError &)
+			{
+				return blockNode;
+			}
+		}
+		else
+		{
+			blockNode->addChild(parseStatement());
+		}
+	}
+	catch (const consumeError &)
+	{
+		error("Could not parse block");
+		throw consumeError();
+	}
+	return blockNode;
+}
+
+ParseTreeNode *Syntax_Analyzer::parseWhileStmt()
+{
+	ParseTreeNode *whileNode = makeNode("while_statement");
+	try
+	{
+		whileNode->addChild(makeNode(consume(TokenType::WhileKeyword).lexeme));
+		whileNode->addChild(parseExpression());
+		whileNode->addChild(makeNode(consume(TokenType::Colon).lexeme));
+		whileNode->addChild(parseBlock());
+	}
+	catch (const consumeError &)
+	{
+		error("Could not parse while statement");
+		throw consumeError();
+	}
+	return whileNode;
+}
+
+ParseTreeNode *Syntax_Analyzer::parseForStmt()
+{
+	ParseTreeNode *forNode = makeNode("for_statement");
+	try
+	{
+		forNode->addChild(makeNode(consume(TokenType::ForKeyword).lexeme));
+		forNode->addChild(makeNode(consume(TokenType::IDENTIFIER).lexeme));
+		forNode->addChild(makeNode(consume(TokenType::InKeyword).lexeme));
+		forNode->addChild(parseExpression());
+		forNode->addChild(makeNode(consume(TokenType::Colon).lexeme));
+		forNode->addChild(parseBlock());
+	}
+	catch (const consumeError &)
+	{
+		error("Could not parse for statement");
+		throw consumeError();
+	}
+	return forNode;
+}
+
+ParseTreeNode *Syntax_Analyzer::parseImport()
+{
+	ParseTreeNode *importNode = makeNode("import_statement");
+	try
+	{
+		if (current < tokens.size() && currentToken().type == TokenType::ImportKeyword)
+		{
+			importNode->addChild(makeNode(consume(TokenType::ImportKeyword).lexeme));
+			importNode->addChild(parseDottedName());
+			if (current < tokens.size() && currentToken().type == TokenType::AsKeyword)
+			{
+				importNode->addChild(makeNode(consume(TokenType::AsKeyword).lexeme));
+				importNode->addChild(makeNode(consume(TokenType::IDENTIFIER).lexeme));
+			}
+			while (current < tokens.size() && currentToken().type == TokenType::Comma)
+			{
+				importNode->addChild(makeNode(consume(TokenType::Comma).lexeme));
+				importNode->addChild(parseDottedName());
+				if (current < tokens.size() && currentToken().type == TokenType::AsKeyword)
+				{
+					importNode->addChild(makeNode(consume(TokenType::AsKeyword).lexeme));
+					importNode->addChild(makeNode(consume(TokenType::IDENTIFIER).lexeme));
+				}
+			}
+		}
+		else
+		{
+			importNode->addChild(makeNode(consume(TokenType::FromKeyword).lexeme));
+			importNode->addChild(parseDottedName());
+			importNode->addChild(makeNode(consume(TokenType::ImportKeyword).lexeme));
+			if (current < tokens.size() && currentToken().type == TokenType::IDENTIFIER)
+			{
+				importNode->addChild(makeNode(consume(TokenType::IDENTIFIER).lexeme));
+				if (current < tokens.size() && currentToken().type == TokenType::AsKeyword)
+				{
+					importNode->addChild(makeNode(consume(TokenType::AsKeyword).lexeme));
+					importNode->addChild(makeNode(consume(TokenType::IDENTIFIER).lexeme));
+				}
+			}
+			else if (current < tokens.size() && currentToken().lexeme == "*")
+				importNode->addChild(makeNode(consume(TokenType::OPERATOR).lexeme));
+			else
+				throw consumeError();
+		}
+	}
+	catch (const consumeError &)
+	{
+		error("Could not parse import");
+		throw consumeError();
+	}
+	return importNode;
+}
+
+ParseTreeNode *Syntax_Analyzer::parseDottedName()
+{
+	ParseTreeNode *dottedNode = makeNode("dotted_name");
+	try
+	{
+		dottedNode->addChild(makeNode(consume(TokenType::IDENTIFIER).lexeme));
+		while (current < tokens.size() && currentToken().type == TokenType::Dot)
+		{
+			dottedNode->addChild(makeNode(consume(TokenType::Dot).lexeme));
+			dottedNode->addChild(makeNode(consume(TokenType::IDENTIFIER).lexeme));
+		}
+	}
+	catch (const consumeError &)
+	{
+		error("Could not parse dotted name");
+		throw consumeError();
+	}
+	return dottedNode;
+}
+
+ParseTreeNode *Syntax_Analyzer::parseRaise()
+{
+	ParseTreeNode *raiseNode = makeNode("raise_statement");
+	try
+	{
+		raiseNode->addChild(makeNode(consume(TokenType::RaiseKeyword).lexeme));
+		raiseNode->addChild(parseExpression());
+	}
+	catch (const consumeError &)
+	{
+		error("Could not parse raise statement");
+		throw consumeError();
+	}
+	return raiseNode;
+}
+
+ParseTreeNode *Syntax_Analyzer::parseTryStmt()
+{
+	ParseTreeNode *tryNode = makeNode("try_statement");
+	try
+	{
+		tryNode->addChild(makeNode(consume(TokenType::TryKeyword).lexeme));
+		tryNode->addChild(makeNode(consume(TokenType::Colon).lexeme));
+		tryNode->addChild(parseBlock());
+		bool hasExcept = false; 
+		bool hasFinally = false;
+
+		while (current < tokens.size() && currentToken().type == TokenType::ExceptKeyword)
+		{
+			hasExcept = true;
+			auto *exceptNode = makeNode("except_clause");
+			exceptNode->addChild(makeNode(consume(TokenType::ExceptKeyword).lexeme));
+			if (current < tokens.size() && currentToken().type == TokenType::IDENTIFIER)
+			{
+				exceptNode->addChild(makeNode(consume(TokenType::IDENTIFIER).lexeme));
+				if (current < tokens.size() && currentToken().type == TokenType::AsKeyword)
+				{
+					exceptNode->addChild(makeNode(consume(TokenType::AsKeyword).lexeme));
+					exceptNode->addChild(makeNode(consume(TokenType::IDENTIFIER).lexeme));
+				}
+			}
+			exceptNode->addChild(makeNode(consume(TokenType::Colon).lexeme));
+			exceptNode->addChild(parseBlock());
+			tryNode->addChild(exceptNode);
+			
+			if (current < tokens.size() && currentToken().type == TokenType::ElseKeyword)
+			{
+				auto *elseNode = makeNode("else_clause");
+				elseNode->addChild(makeNode(consume(TokenType::ElseKeyword).lexeme));
+				elseNode->addChild(makeNode(consume(TokenType::Colon).lexeme));
+				elseNode->addChild(parseBlock());
+				tryNode->addChild(elseNode);
+			}
+		}
+
+		if (current < tokens.size() && currentToken().type == TokenType::FinallyKeyword)
+		{
+			hasFinally = true;
+			auto *finallyNode = makeNode("finally_clause");
+			finallyNode->addChild(makeNode(consume(TokenType::FinallyKeyword).lexeme));
+			finallyNode->addChild(makeNode(consume(TokenType::Colon).lexeme));
+			finallyNode->addChild(parseBlock());
+			tryNode->addChild(finallyNode);
+		}
+
+		if (!hasExcept && !hasFinally)
+		{
+			error("Try statement must have at least one except or finally clause");
+			throw consumeError();
+		}
+	}
+	catch (const consumeError &)
+	{
+		error("Could not parse try statement");
+		throw consumeError();
+	}
+
+	return tryNode;
+}
+
+ParseTreeNode *Syntax_Analyzer::parseClassDef()
+{
+	ParseTreeNode *classNode = makeNode("class_def");
+	try
+	{
+		classNode->addChild(makeNode(consume(TokenType::ClassKeyword).lexeme));
+		classNode->addChild(makeNode(consume(TokenType::IDENTIFIER).lexeme));
+
+		if (current < tokens.size() && currentToken().type == TokenType::LeftParenthesis)
+		{
+
+			classNode->addChild(makeNode(consume(TokenType::LeftParenthesis).lexeme));
+			classNode->addChild(makeNode(consume(TokenType::IDENTIFIER).lexeme));
+			classNode->addChild(makeNode(consume(TokenType::RightParenthesis).lexeme));
+		}
+
+		classNode->addChild(makeNode(consume(TokenType::Colon).lexeme));
+		classNode->addChild(parseClassBlock());
+	}
+	catch (const consumeError &)
+	{
+		error("Could not parse class def");
+		throw consumeError();
+	}
+	return classNode;
+}
+
+ParseTreeNode *Syntax_Analyzer::parseConditionalStmt()
+{
+
+	auto *ifNode = makeNode("conditional_statement");
+	try
+	{
+		ifNode->addChild(makeNode(consume(TokenType::IfKeyword).lexeme));
+		ifNode->addChild(parseExpression());
+		ifNode->addChild(makeNode(consume(TokenType::Colon).lexeme));
+		ifNode->addChild(parseBlock());
+	}
+	catch (const consumeError &)
+	{
+		error("Could not parse conditional");
+		throw consumeError();
+	}
+
+	while (current < tokens.size() && currentToken().type == TokenType::ElifKeyword)
+	{
+		auto *elifNode = makeNode("elif_clause");
+		try
+		{
+			elifNode->addChild(makeNode(consume(TokenType::ElifKeyword).lexeme));
+			elifNode->addChild(parseExpression());
+			elifNode->addChild(makeNode(consume(TokenType::Colon).lexeme));
+			elifNode->addChild(parseBlock());
+			ifNode->addChild(elifNode);
+		}
+		catch (const consumeError &)
+		{
+			error("Could not parse elif");
+			throw consumeError();
+		}
+	}
+
+	if (current < tokens.size() && currentToken().type == TokenType::ElseKeyword)
+	{
+		auto *elseNode = makeNode("else_clause");
+		try
+		{
+			elseNode->addChild(makeNode(consume(TokenType::ElseKeyword).lexeme));
+			elseNode->addChild(makeNode(consume(TokenType::Colon).lexeme));
+			elseNode->addChild(parseBlock());
+			ifNode->addChild(elseNode);
+		}
+		catch (const consumeError &)
+		{
+			error("Could not parse else");
+			throw consumeError();
+		}
+	}
+
+	return ifNode;
+}
+
+ParseTreeNode *Syntax_Analyzer::parseAssignmentStmt()
+{
+	ParseTreeNode *assignNode = makeNode("assignment");
+	// Targets and values are collected on 'pending' above this mark
+	size_t mark = pending.size();
+	try
+	{
+		// Parse LHS identifiers or dotted names
+		ParseTreeNode *lhs = makeNode("lhs");
+
+		// Handle first identifier or dotted name
+		if (peekToken().type == TokenType::Dot)
+			pending.push_back(parseDottedName());
+		else
+			pending.push_back(makeNode(consume(TokenType::IDENTIFIER).lexeme));
+
+		// Support multiple identifiers: x, y = ...
+		while (current < tokens.size() && currentToken().type == TokenType::Comma)
+		{
+			lhs->addChild(makeNode(consume(TokenType::Comma).lexeme));
+			if (peekToken().type == TokenType::Dot)
+				pending.push_back(parseDottedName());
+			else
+				pending.push_back(makeNode(consume(TokenType::IDENTIFIER).lexeme));
+		}
+		// Add all LHS identifiers to lhs node
+		size_t lhsCount = pending.size() - mark;
+		for (size_t k = mark; k < pending.size(); k++)
+			lhs->addChild(pending[k]);
+		pending.resize(mark);
+		assignNode->addChild(lhs);
+
+		// Assign operator (=, +=, etc.)
+		assignNode->addChild(parseAssignOp());
+
+		// Parse RHS expressions
+		ParseTreeNode *rhs = makeNode("rhs");
+		pending.push_back(parseExpression());
+		while (current < tokens.size() && currentToken().type == TokenType::Comma)
+		{
+			rhs->addChild(makeNode(consume(TokenType::Comma).lexeme));
+			pending.push_back(parseExpression());
+		}
+		// Add all RHS expressions to rhs node
+		size_t rhsCount = pending.size() - mark;
+		for (size_t k = mark; k < pending.size(); k++)
+			rhs->addChild(pending[k]);
+		pending.resize(mark);
+		assignNode->addChild(rhs);
+
+		// Error if number of LHS identifiers != number of RHS expressions
+		if (lhsCount != rhsCount)
+		{
+			error("Assignment count mismatch: " + std::to_string(lhsCount) +
+				  " variable(s) on LHS, " + std::to_string(rhsCount) + " value(s) on RHS");
+			throw consumeError();
+		}
+	}
+	catch (const consumeError &)
+	{
+		pending.resize(mark);
+		error("Could not parse assignment");
+		throw consumeError();
+	}
+
+	return assignNode;
+}
+
+ParseTreeNode *Syntax_Analyzer::parseAssignOp()
+{
+	ParseTreeNode *assignOpNode = makeNode("Assign_OP");
+	try
+	{
+		if (current < tokens.size() && currentToken().type == TokenType::OPERATOR)
+		{
+			if (currentToken().lexeme == "=" ||
+				currentToken().lexeme == "+=" ||
+				currentToken().lexeme == "-=" ||
+				currentToken().lexeme == "*=" ||
+				currentToken().lexeme == "/=" ||
+				currentToken().lexeme == "%=" ||
+				currentToken().lexeme == "//=" ||
+				currentToken().lexeme == "**=")
+			{
+				assignOpNode->addChild(makeNode(consume(TokenType::OPERATOR).lexeme));
+			}
+		}
+		else
+			throw consumeError();
+	}
+	catch (const consumeError &)
+	{
+		error("Could not parse Assign OP");
+		throw consumeError();
+	}
+	return assignOpNode;
+}
+
+ParseTreeNode *Syntax_Analyzer::parseFunctionCall()
+{
+	ParseTreeNode *callNode = makeNode("function_call");
+	try
+	{
+		if (peekToken().type == TokenType::Dot)
+		{
+			callNode->addChild(parseDottedName());
+		}
+		else
+		{
+			callNode->addChild(makeNode(consume(TokenType::IDENTIFIER).lexeme));
+		}
+
+		callNode->addChild(makeNode(consume(TokenType::LeftParenthesis).lexeme));
+
+		if (currentToken().type != TokenType::RightParenthesis)
+		{
+			callNode->addChild(parseArguments());
+		}
+
+		callNode->addChild(makeNode(consume(TokenType::RightParenthesis).lexeme));
+	}
+	catch (const consumeError &)
+	{
+		error("Could not parse function call");
+		throw consumeError();
+	}
+	return callNode;
+}
+
+ParseTreeNode *Syntax_Analyzer::parseExpression()
+{
+	NestingScope nesting(*this);
+	ParseTreeNode *exprNode = makeNode("expression");
+	try
+	{
+		exprNode->addChild(parseOrExpr());
+	}
+	catch (const consumeError &)
+	{
+		error("Could not parse expression");
+		throw consumeError();
+	}
+	return exprNode;
+}
+
+ParseTreeNode *Syntax_Analyzer::parseOrExpr()
+{
+	ParseTreeNode *orNode = makeNode("or_expression");
+	try
+	{
+		orNode->addChild(parseAndExpr());
+		while (current < tokens.size() && currentToken().type == TokenType::OrKeyword)
+		{
+			orNode->addChild(makeNode(consume(TokenType::OrKeyword).lexeme));
+			orNode->addChild(parseAndExpr());
+		}
+	}
+	catch (const consumeError &)
+	{
+		error("Could not parse or expression");
+		throw consumeError();
+	}
+	return orNode;
+}
+
+ParseTreeNode *Syntax_Analyzer::parseAndExpr()
+{
+	ParseTreeNode *andNode = makeNode("and_expression");
+	try
+	{
+		andNode->addChild(parseNotExpr());
+		while (current < tokens.size() && currentToken().type == TokenType::AndKeyword)
+		{
+			andNode->addChild(makeNode(consume(TokenType::AndKeyword).lexeme));
+			andNode->addChild(parseNotExpr());
+		}
+	}
+	catch (const consumeError &)
+	{
+		error("Could not parse and expression");
+		throw consumeError();
+	}
+	return andNode;
+}
+
+ParseTreeNode *Syntax_Analyzer::parseNotExpr()
+{
+	ParseTreeNode *notNode = makeNode("not_expression");
+	try
+	{
+		if (current < tokens.size() && currentToken().type == TokenType::NotKeyword)
+		{
+			notNode->addChild(makeNode(consume(TokenType::NotKeyword).lexeme));
+			notNode->addChild(parseNotExpr());
+		}
+		else
+		{
+			notNode->addChild(parseComparison());
+		}
+	}
+	catch (const consumeError &)
+	{
+		error("Could not parse not expression");
+		throw consumeError();
+	}
+	return notNode;
+}
+
+ParseTreeNode *Syntax_Analyzer::parseComparison()
+{
+	ParseTreeNode *compNode = makeNode("comparison");
+	try
+	{
+		compNode->addChild(parseArithmetic());
+		while (current < tokens.size() &&
+			   (currentToken().type == TokenType::OPERATOR ||
+				currentToken().type == TokenType::InKeyword ||
+				currentToken().type == TokenType::IsKeyword ||
+				currentToken().type == TokenType::NotKeyword))
+		{
+			compNode->addChild(parseOp());
+			compNode->addChild(parseArithmetic());
+		}
+	}
+	catch (const consumeError &)
+	{
+		error("Could not parse comparison");
+		throw consumeError();
+	}
+	return compNode;
+}
+
+ParseTreeNode *Syntax_Analyzer::parseOp()
+{
+	ParseTreeNode *assignOpNode = makeNode("OP");
+	if (current >= tokens.size())
+	{
+		error("Could not parse OP");
+		throw consumeError();
+	}
+	if (currentToken().lexeme == "==" ||
+		currentToken().lexeme == "!=" ||
+		currentToken().lexeme == "<" ||
+		currentToken().lexeme == ">" ||
+		currentToken().lexeme == ">=" ||
+		currentToken().lexeme == "<=" ||
+		currentToken().lexeme == "&" ||
+		currentToken().lexeme == "^" ||
+		currentToken().lexeme == "|" ||
+		currentToken().lexeme == "<<" ||
+		currentToken().lexeme == ">>")
+	{
+		try
+		{
+			assignOpNode->addChild(makeNode(consume(TokenType::OPERATOR).lexeme));
+		}
+		catch (const consumeError &)
+		{
+			error("Could not parse OP");
+			throw consumeError();
+		}
+	}
+	else
+	{
+		if (currentToken().type == TokenType::IsKeyword)
+		{
+			assignOpNode->addChild(makeNode(consume(TokenType::IsKeyword).lexeme));
+			if (current < tokens.size() && currentToken().type == TokenType::NotKeyword)
+			{
+				assignOpNode->addChild(makeNode(consume(TokenType::NotKeyword).lexeme));
+			}
+		}
+		else if (currentToken().type == TokenType::InKeyword)
+		{
+			assignOpNode->addChild(makeNode(consume(TokenType::InKeyword).lexeme));
+		}
+		else if (currentToken().type == TokenType::NotKeyword && peekToken().type == TokenType::InKeyword)
+		{
+			assignOpNode->addChild(makeNode(consume(TokenType::NotKeyword).lexeme));
+			assignOpNode->addChild(makeNode(consume(TokenType::InKeyword).lexeme));
+		}
+	}
+	return assignOpNode;
+}
+
+ParseTreeNode *Syntax_Analyzer::parseArithmetic()
+{
+	ParseTreeNode *arithmNode = makeNode("arithmetic");
+	try
+	{
+		arithmNode->addChild(parseTerm());
+		while (current < tokens.size() && currentToken().type == TokenType::OPERATOR)
+		{
+			if (currentToken().lexeme == "+" || currentToken().lexeme == "-")
+			{
+				arithmNode->addChild(makeNode(consume(TokenType::OPERATOR).lexeme));
+				arithmNode->addChild(parseTerm());
+			}
+			else
+				break;
+		}
+	}
+	catch (const consumeError &)
+	{
+		error("Could not Arithmetic");
+		throw consumeError();
+	}
+	return arithmNode;
+}
+
+ParseTreeNode *Syntax_Analyzer::parseTerm()
+{
+	ParseTreeNode *termNode = makeNode("term");
+	try
+	{
+		termNode->addChild(parseFactor());
+		while (current < tokens.size() && currentToken().type == TokenType::OPERATOR)
+		{
+			if (currentToken().lexeme == "*" || currentToken().lexeme == "/" || currentToken().lexeme == "%")
+			{
+				termNode->addChild(makeNode(consume(TokenType::OPERATOR).lexeme));
+				termNode->addChild(parseFactor());
+			}
+			else
+				break;
+		}
+	}
+	catch (const consumeError &)
+	{
+		error("Could not parse Term");
+		throw consumeError();
+	}
+	return termNode;
+}
+
+ParseTreeNode *Syntax_Analyzer::parseArguments()
+{
+	ParseTreeNode *argNode = makeNode("arguments");
+	try
+	{
+		argNode->addChild(parseExpression());
+		while (current < tokens.size() && currentToken().type == TokenType::Comma)
+		{
+			argNode->addChild(makeNode(consume(TokenType::Comma).lexeme));
+			argNode->addChild(parseExpression());
+		}
+	}
+	catch (const consumeError &)
+	{
+		error("Could not arguments");
+		throw consumeError();
+	}
+	return argNode;
+}
+
+ParseTreeNode *Syntax_Analyzer::parseFactor()
+{
+	ParseTreeNode *factorNode = makeNode("factor");
+	try
+	{
+		if (current < tokens.size() && currentToken().type == TokenType::NUMBER)
+		{
+			factorNode->addChild(makeNode(consume(TokenType::NUMBER).lexeme));
+		}
+		else if (current < tokens.size() && currentToken().type == TokenType::IDENTIFIER)
+		{
+			if (peekToken().type == TokenType::Dot)
+			{
+				// Handle dotted_name (e.g., car1.printname or car1.printname())
+				factorNode->addChild(parseDottedName());
+
+				// Check for method call
+				if (current < tokens.size() && currentToken().type == TokenType::LeftParenthesis)
+				{
+					factorNode->addChild(makeNode(consume(TokenType::LeftParenthesis).lexeme));
+					if (current < tokens.size() && currentToken().type != TokenType::RightParenthesis)
+						factorNode->addChild(parseArguments());
+					factorNode->addChild(makeNode(consume(TokenType::RightParenthesis).lexeme));
+				}
+			}
+			else
+			{
+				// Simple identifier or function call
+				factorNode->addChild(makeNode(consume(TokenType::IDENTIFIER).lexeme));
+
+				if (current < tokens.size() && currentToken().type == TokenType::LeftParenthesis)
+				{
+					factorNode->addChild(makeNode(consume(TokenType::LeftParenthesis).lexeme));
+					if (current < tokens.size() && currentToken().type != TokenType::RightParenthesis)
+						factorNode->addChild(parseArguments());
+					factorNode->addChild(makeNode(consume(TokenType::RightParenthesis).lexeme));
+				}
+			}
+		}
+		else if (current < tokens.size() && currentToken().type == TokenType::STRING_LITERAL)
+		{
+			// Handle string literal
+			factorNode->addChild(makeNode(consume(TokenType::STRING_LITERAL).lexeme));
+		}
+		else if (current < tokens.size() && currentToken().type == TokenType::LeftParenthesis)
+		{
+			ParseTreeNode *tupleOrParenNode = makeNode("tuple_or_group");
+			tupleOrParenNode->addChild(makeNode(consume(TokenType::LeftParenthesis).lexeme));
+
+			// check for empty tuple: ()
+			if (current < tokens.size() && currentToken().type == TokenType::RightParenthesis)
+			{
+				// empty tuple
+				tupleOrParenNode->addChild(makeNode(consume(TokenType::RightParenthesis).lexeme));
+				factorNode->addChild(tupleOrParenNode);
+			}
+			else
+			{
+				// parse first expression
+				tupleOrParenNode->addChild(parseExpression());
+
+				// check for comma (tuple)
+				if (current < tokens.size() && currentToken().type == TokenType::Comma)
+				{
+					// at least one comma, so it's a tuple
+					while (current < tokens.size() && currentToken().type == TokenType::Comma)
+					{
+						tupleOrParenNode->addChild(makeNode(consume(TokenType::Comma).lexeme));
+						// Allow for (2,) as a one-element tuple (comma with no second element)
+						if (current < tokens.size() && currentToken().type != TokenType::RightParenthesis)
+						{
+							tupleOrParenNode->addChild(parseExpression());
+						}
+					}
+				}
+
+				tupleOrParenNode->addChild(makeNode(consume(TokenType::RightParenthesis).lexeme));
+				factorNode->addChild(tupleOrParenNode);
+			}
+		}
+
+		else if (current < tokens.size() && currentToken().type == TokenType::FalseKeyword)
+		{
+			factorNode->addChild(makeNode(consume(TokenType::FalseKeyword).lexeme));
+		}
+		else if (current < tokens.size() && currentToken().type == TokenType::TrueKeyword)
+		{
+			factorNode->addChild(makeNode(consume(TokenType::TrueKeyword).lexeme));
+		}
+		else if (current < tokens.size() && currentToken().type == TokenType::NoneKeyword)
+		{
+			factorNode->addChild(makeNode(consume(TokenType::NoneKeyword).lexeme));
+		}
+		else if (current < tokens.size() && currentToken().type == TokenType::LeftBracket)
+		{
+			// list
+			ParseTreeNode *listNode = makeNode("list_literal");
+			listNode->addChild(makeNode(consume(TokenType::LeftBracket).lexeme));
+			if (current < tokens.size() && currentToken().type != TokenType::RightBracket)
+			{
+				listNode->addChild(parseExpression());
+				while (current < tokens.size() && currentToken().type == TokenType::Comma)
+				{
+					listNode->addChild(makeNode(consume(TokenType::Comma).lexeme));
+					listNode->addChild(parseExpression());
+				}
+			}
+			listNode->addChild(makeNode(consume(TokenType::RightBracket).lexeme));
+			factorNode->addChild(listNode);
+		}
+		else if (current < tokens.size() && currentToken().type == TokenType::LeftBrace)
+		{
+			// dict or set
+			size_t temp = current + 1;
+			bool isDict = false;
+
+			while (temp < tokens.size() && tokens[temp].type != TokenType::RightBrace)
+			{
+				if (tokens[temp].type == TokenType::Colon)
+				{
+					isDict = true;
+					break;
+				}
+				temp++;
+			}
+			if (isDict)
+			{
+				// dict
+				ParseTreeNode *dictNode = makeNode("dict_literal");
+				dictNode->addChild(makeNode(consume(TokenType::LeftBrace).lexeme));
+				if (current < tokens.size() && currentToken().type != TokenType::RightBrace)
+				{
+					dictNode->addChild(parseExpression());
+					dictNode->addChild(makeNode(consume(TokenType::Colon).lexeme));
+					dictNode->addChild(parseExpression());
+					while (current < tokens.size() && currentToken().type == TokenType::Comma)
+					{
+						dictNode->addChild(makeNode(consume(TokenType::Comma).lexeme));
+						dictNode->addChild(parseExpression());
+						dictNode->addChild(makeNode(consume(TokenType::Colon).lexeme));
+						dictNode->addChild(parseExpression());
+					}
+				}
+				dictNode->addChild(makeNode(consume(TokenType::RightBrace).lexeme));
+				factorNode->addChild(dictNode);
+			}
+			else
+			{
+				// set
+				ParseTreeNode *setNode = makeNode("set_literal");
+				setNode->addChild(makeNode(consume(TokenType::LeftBrace).lexeme));
+				if (current < tokens.size() && currentToken().type != TokenType::RightBrace)
+				{
+					setNode->addChild(parseExpression());
+					while (current < tokens.size() && currentToken().type == TokenType::Comma)
+					{
+						setNode->addChild(makeNode(consume(TokenType::Comma).lexeme));
+						setNode->addChild(parseExpression());
+					}
+				}
+				setNode->addChild(makeNode(consume(TokenType::RightBrace).lexeme));
+				factorNode->addChild(setNode);
+			}
+		}
+
+		else if (current < tokens.size() && (currentToken().lexeme == "+" || currentToken().lexeme == "-" || currentToken().lexeme == "~" || currentToken().type == TokenType::NotKeyword))
+		{
+			factorNode->addChild(makeNode(consume(currentToken().type).lexeme));
+			factorNode->addChild(parseFactor());
+		}
+
+		else
+		{
+			error("Could not parse Factor");
+			throw consumeError();
+		}
+	}
+	catch (const consumeError &)
+	{
+		error("Could not parse factor");
+		throw consumeError();
+	}
+	return factorNode;
+}
+
+// ----------------------------------------------
+// Constant folding and propagation
+// ----------------------------------------------
+// Leaf nodes of the parse tree only keep the lexeme, so literals are
+// recognized from their spelling.
+
+LeafKind classifyLeaf(const string &lexeme)
+{
+	if (lexeme.empty())
+		return LeafKind::Other;
+	char c = lexeme[0];
+	if (isdigit(static_cast<unsigned char>(c)))
+		return LeafKind::Number;
+	if (c == '"' || c == '\'')
+		return LeafKind::String;
+	if (lexeme == "True")
+		return LeafKind::True;
+	if (lexeme == "False")
+		return LeafKind::False;
+	if (lexeme == "None")
+		return LeafKind::None;
+	if (isalpha(static_cast<unsigned char>(c)) || c == '_')
+		return LeafKind::Name;
+	return LeafKind::Other;
+}
+
+// Strips the quotes of a STRING_LITERAL lexeme and resolves the common escapes.
+string decodeStringLiteral(const string &lexeme)
+{
+	size_t quote = 1;
+	if (lexeme.size() >= 6 && lexeme[1] == lexeme[0] && lexeme[2] == lexeme[0])
+		quote = 3;
+	if (lexeme.size() < 2 * quote)
+		return "";
+	string out;
+	size_t end = lexeme.size() - quote;
+	for (size_t i = quote; i < end; i++)
+	{
+		if (lexeme[i] != '\\' || i + 1 >= end)
+		{
+			out += lexeme[i];
+			continue;
+		}
+		char e = lexeme[++i];
+		switch (e)
+		{
+		case 'n':
+			out += '\n';
+			break;
+		case 't':
+			out += '\t';
+			break;
+		case 'r':
+			out += '\r';
+			break;
+		case '0':
+			out += '\0';
+			break;
+		case '\\':
+		case '\'':
+		case '"':
+			out += e;
+			break;
+		case '\n':
+			break;
+		default:
+			out += '\\';
+			out += e;
+		}
+	}
+	return out;
+}
+
+string formatFloat(double d)
+{
+	if (isinf(d))
+		return d > 0 ? "inf" : "-inf";
+	if (d != d)
+		return "nan";
+	char buf[40];
+	for (int precision = 0; precision <= 16; precision++)
+	{
+		snprintf(buf, sizeof(buf), "%.*e", precision, d);
+		if (strtod(buf, nullptr) == d)
+			break;
+	}
+	// buf is [-]D[.DDD]e(+|-)XX
+	string s = buf, digits;
+	size_t e = s.find('e');
+	bool negative = s[0] == '-';
+	for (size_t k = negative ? 1 : 0; k < e; k++)
+		if (s[k] != '.')
+			digits += s[k];
+	while (digits.size() > 1 && digits.back() == '0')
+		digits.pop_back();
+	int exponent = atoi(s.c_str() + e + 1);
+	int point = exponent + 1; // digits before the decimal point
+	string out = negative ? "-" : "";
+	int n = static_cast<int>(digits.size());
+	if (exponent >= -4 && exponent < 16)
+	{
+		if (point <= 0)
+			out += "0." + string(-point, '0') + digits;
+		else if (point >= n)
+			out += digits + string(point - n, '0') + ".0";
+		else
+			out += digits.substr(0, point) + "." + digits.substr(point);
+	}
+	else
+	{
+		out += digits[0];
+		if (n > 1)
+			out += "." + digits.substr(1);
+		snprintf(buf, sizeof(buf), "e%c%02d", exponent < 0 ? '-' : '+', abs(exponent));
+		out += buf;
+	}
+	return out;
+}
+
+bool parseLiteral(const string &lexeme, ConstValue &out)
+{
+	switch (classifyLeaf(lexeme))
+	{
+	case LeafKind::Number:
+		try
+		{
+			// Folded floats can come back in exponent form, e.g. "1e+16"
+			if (lexeme.find_first_of(".eE") != string::npos)
+				out = ConstValue::makeFloat(stod(lexeme));
+			else
+				out = ConstValue::makeInt(stoll(lexeme));
+			return true;
+		}
+		catch (const exception &)
+		{
+			return false; // too large for the folder, left to run time
+		}
+	case LeafKind::String:
+		out = ConstValue::makeStr(decodeStringLiteral(lexeme));
+		return true;
+	case LeafKind::True:
+		out = ConstValue::makeBool(true);
+		return true;
+	case LeafKind::False:
+		out = ConstValue::makeBool(false);
+		return true;
+	case LeafKind::None:
+		out = ConstValue();
+		return true;
+	default:
+		return false;
+	}
+}
+
+bool literalOf(const ParseTreeNode *node, ConstValue &out)
+{
+	while (true)
+	{
+		if (!node->folded.empty())
+			return parseLiteral(node->folded, out);
+		if (node->children.size() != 1)
+			return false;
+		const ParseTreeNode *child = node->children[0];
+		if (child->children.empty())
+			return node->label == "factor" && classifyLeaf(child->label) != LeafKind::Name && parseLiteral(child->label, out);
+		node = child;
+	}
+}
+
+bool foldedTruth(const ParseTreeNode *cond, bool &truth)
+{
+	ConstValue v;
+	if (!literalOf(cond, v))
+		return false;
+	truth = v.truthy();
+	return true;
+}
+
+string comparisonOperator(const ParseTreeNode *link)
+{
+	string text;
+	for (const ParseTreeNode *part : link->children)
+		text += (text.empty() ? "" : " ") + part->label;
+	return text;
+}
+
+bool isComparisonOperator(const string &op)
+{
+	return op == "==" || op == "!=" || op == "<" || op == "<=" || op == ">" || op == ">=" || op == "in" ||
+		   op == "not in" || op == "is" || op == "is not";
+}
+
+AssignmentParts splitAssignment(const ParseTreeNode *node)
+{
+	AssignmentParts parts;
+	for (ParseTreeNode *target : node->children[0]->children)
+		if (target->label != ",")
+			parts.targets.push_back(target);
+	for (ParseTreeNode *value : node->children[2]->children)
+		if (value->label == "expression")
+			parts.values.push_back(value);
+	parts.op = node->children[1]->children.empty() ? "=" : node->children[1]->children[0]->label;
+	return parts;
+}
+
+ImportParts splitImport(const ParseTreeNode *node)
+{
+	auto dottedText = [](const ParseTreeNode *dotted)
+	{
+		string text;
+		for (const ParseTreeNode *part : dotted->children)
+			text += part->label;
+		return text;
+	};
+	ImportParts parts;
+	const auto &c = node->children;
+	bool fromImport = !c.empty() && c[0]->label == "from";
+	if (fromImport)
+		parts.from = dottedText(c[1]);
+	for (size_t k = fromImport ? 3 : 1; k < c.size(); k++)
+	{
+		if (c[k]->label == "*")
+			parts.star = true;
+		if (c[k]->label == "," || c[k]->label == "as" || c[k]->label == "*" || (!fromImport && c[k]->label != "dotted_name"))
+			continue;
+		bool aliased = k + 2 < c.size() && c[k + 1]->label == "as";
+		string source = fromImport ? c[k]->label : aliased ? dottedText(c[k]) : c[k]->children[0]->label;
+		string bound = aliased ? c[k + 2]->label : fromImport ? c[k]->label : c[k]->children[0]->label;
+		parts.bindings.emplace_back(source, bound);
+		if (aliased)
+			k += 2;
+	}
+	return parts;
+}
+
+// Evaluates a binary operator the way Python would. Returns false whenever
+// the result is not representable here or the operation would raise, so
+// that the error is still reported at run time.
+bool evalBinaryOp(const string &op, const ConstValue &a, const ConstValue &b, ConstValue &out)
+{
+	using Kind = ConstValue::Kind;
+	const size_t maxFoldedString = 4096;
+
+	if (op == "==" || op == "!=")
+	{
+		bool eq = a.equals(b);
+		out = ConstValue::makeBool(op == "==" ? eq : !eq);
+		return true;
+	}
+	if (op == "<" || op == ">" || op == "<=" || op == ">=")
+	{
+		int cmp;
+		if (a.isNumber() && b.isNumber())
+		{
+			if (a.isIntLike() && b.isIntLike())
+				cmp = a.i < b.i ? -1 : (a.i > b.i ? 1 : 0);
+			else
+			{
+				double x = a.asDouble(), y = b.asDouble();
+				if (x != x || y != y)
+					return false;
+				cmp = x < y ? -1 : (x > y ? 1 : 0);
+			}
+		}
+		else if (a.kind == Kind::Str && b.kind == Kind::Str)
+			cmp = a.s.compare(b.s);
+		else if (a.kind == Kind::Tuple && b.kind == Kind::Tuple)
+		{
+			// Lexicographic: the first items that differ decide, else the lengths
+			size_t k = 0;
+			while (k < a.items.size() && k < b.items.size() && a.items[k].equals(b.items[k]))
+				k++;
+			if (k < a.items.size() && k < b.items.size())
+				return evalBinaryOp(op, a.items[k], b.items[k], out);
+			cmp = a.items.size() < b.items.size() ? -1 : (a.items.size() > b.items.size() ? 1 : 0);
+		}
+		else
+			return false;
+		bool r = op == "<" ? cmp < 0 : op == ">" ? cmp > 0 : op == "<=" ? cmp <= 0 : cmp >= 0;
+		out = ConstValue::makeBool(r);
+		return true;
+	}
+	if (op == "in" || op == "not in")
+	{
+		bool found;
+		if (b.kind == Kind::Tuple)
+		{
+			found = false;
+			for (const ConstValue &item : b.items)
+				found = found || item.equals(a);
+		}
+		else if (a.kind == Kind::Str && b.kind == Kind::Str)
+			found = b.s.find(a.s) != string::npos;
+		else
+			return false;
+		out = ConstValue::makeBool(op == "in" ? found : !found);
+		return true;
+	}
+	if (op == "is" || op == "is not")
+	{
+		if (a.kind != Kind::None && b.kind != Kind::None)
+			return false;
+		bool same = a.kind == b.kind;
+		out = ConstValue::makeBool(op == "is" ? same : !same);
+		return true;
+	}
+
+	if (op == "&" || op == "|" || op == "^" || op == "<<" || op == ">>")
+	{
+		if (!a.isIntLike() || !b.isIntLike())
+			return false;
+		long long r;
+		if (op == "&")
+			r = a.i & b.i;
+		else if (op == "|")
+			r = a.i | b.i;
+		else if (op == "^")
+			r = a.i ^ b.i;
+		else if (b.i < 0 || b.i >= 63)
+			return false;
+		else if (op == ">>")
+			r = a.i >> b.i;
+		else
+		{
+			r = static_cast<long long>(static_cast<unsigned long long>(a.i) << b.i);
+			if ((r >> b.i) != a.i)
+				return false;
+		}
+		// bool op bool stays bool for the logical operators
+		if (a.kind == Kind::Bool && b.kind == Kind::Bool && (op == "&" || op == "|" || op == "^"))
+			out = ConstValue::makeBool(r != 0);
+		else
+			out = ConstValue::makeInt(r);
+		return true;
+	}
+
+	if (op == "+" && a.kind == Kind::Str && b.kind == Kind::Str)
+	{
+		if (a.s.size() + b.s.size() > maxFoldedString)
+			return false;
+		out = ConstValue::makeStr(a.s + b.s);
+		return true;
+	}
+	if (op == "+" && a.kind == Kind::Tuple && b.kind == Kind::Tuple)
+	{
+		out = a;
+		out.items.insert(out.items.end(), b.items.begin(), b.items.end());
+		return true;
+	}
+	if (op == "*" && ((a.kind == Kind::Str && b.isIntLike()) || (a.isIntLike() && b.kind == Kind::Str)))
+	{
+		const ConstValue &str = a.kind == Kind::Str ? a : b;
+		long long count = a.kind == Kind::Str ? b.i : a.i;
+		if (count > 0 && str.s.size() * static_cast<unsigned long long>(count) > maxFoldedString)
+			return false;
+		string r;
+		for (long long k = 0; k < count; k++)
+			r += str.s;
+		out = ConstValue::makeStr(r);
+		return true;
+	}
+
+	if (!a.isNumber() || !b.isNumber())
+		return false;
+
+	if (op == "/")
+	{
+		double y = b.asDouble();
+		if (y == 0.0)
+			return false;
+		out = ConstValue::makeFloat(a.asDouble() / y);
+		return true;
+	}
+
+	if (a.isIntLike() && b.isIntLike())
+	{
+		long long r;
+		if (op == "+")
+		{
+			if (__builtin_add_overflow(a.i, b.i, &r))
+				return false;
+		}
+		else if (op == "-")
+		{
+			if (__builtin_sub_overflow(a.i, b.i, &r))
+				return false;
+		}
+		else if (op == "*")
+		{
+			if (__builtin_mul_overflow(a.i, b.i, &r))
+				return false;
+		}
+		else if (op == "%")
+		{
+			if (b.i == 0)
+				return false;
+			r = b.i == -1 ? 0 : a.i % b.i;
+			if (r != 0 && ((r < 0) != (b.i < 0)))
+				r += b.i;
+		}
+		else if (op == "//")
+		{
+			if (b.i == 0 || (a.i == LLONG_MIN && b.i == -1))
+				return false;
+			r = a.i / b.i;
+			if (a.i % b.i != 0 && ((a.i < 0) != (b.i < 0)))
+				r--;
+		}
+		else if (op == "**")
+		{
+			// A negative exponent gives a float, and 0 to one raises
+			if (b.i < 0)
+			{
+				double f = pow(static_cast<double>(a.i), static_cast<double>(b.i));
+				if (a.i == 0 || !isfinite(f))
+					return false;
+				out = ConstValue::makeFloat(f);
+				return true;
+			}
+			r = 1;
+			long long base = a.i;
+			for (long long e = b.i; e > 0; e >>= 1)
+			{
+				if ((e & 1) && __builtin_mul_overflow(r, base, &r))
+					return false;
+				if (e > 1 && __builtin_mul_overflow(base, base, &base))
+					return false;
+			}
+		}
+		else
+			return false;
+		out = ConstValue::makeInt(r);
+		return true;
+	}
+
+	double x = a.asDouble(), y = b.asDouble(), r;
+	if (op == "+")
+		r = x + y;
+	else if (op == "-")
+		r = x - y;
+	else if (op == "*")
+		r = x * y;
+	else if (op == "%")
+	{
+		if (y == 0.0)
+			return false;
+		r = fmod(x, y);
+		if (r != 0 && ((r < 0) != (y < 0)))
+			r += y;
+	}
+	else if (op == "//")
+	{
+		if (y == 0.0)
+			return false;
+		r = floor(x / y);
+	}
+	else if (op == "**")
+	{
+		// A negative base to a fractional power is complex in Python
+		if ((x == 0.0 && y < 0) || (x < 0 && y != floor(y)))
+			return false;
+		r = pow(x, y);
+	}
+	else
+		return false;
+	if (!isfinite(r))
+		return false;
+	out = ConstValue::makeFloat(r);
+	return true;
+}
+
+bool evalUnaryOp(const string &op, const ConstValue &a, ConstValue &out)
+{
+	if (op == "not")
+	{
+		out = ConstValue::makeBool(!a.truthy());
+		return true;
+	}
+	if (op == "-" && a.kind == ConstValue::Kind::Float)
+	{
+		out = ConstValue::makeFloat(-a.f);
+		return true;
+	}
+	if (!a.isIntLike())
+		return op == "+" && a.kind == ConstValue::Kind::Float && (out = a, true);
+	if (op == "-")
+	{
+		if (a.i == LLONG_MIN)
+			return false;
+		out = ConstValue::makeInt(-a.i);
+	}
+	else if (op == "+")
+		out = ConstValue::makeInt(a.i);
+	else if (op == "~")
+		out = ConstValue::makeInt(~a.i);
+	else
+		return false;
+	return true;
+}
+
+// Names an import statement binds in the current scope
+void collectImportNames(const ParseTreeNode *node, unordered_set<string> &names)
+{
+	for (const auto &binding : splitImport(node).bindings)
+		names.insert(binding.second);
+}
+
+void collectBoundNames(const ParseTreeNode *node, unordered_set<string> &names)
+{
+	const string &label = node->label;
+	if (node->children.empty())
+		return;
+	if (label == "assignment")
+	{
+		for (const ParseTreeNode *target : node->children[0]->children)
+			if (target->children.empty() && target->label != ",")
+				names.insert(target->label);
+		return;
+	}
+	if (label == "for_statement")
+		names.insert(node->children[1]->label);
+	if (label == "function" || label == "class_def")
+	{
+		names.insert(node->children[1]->label);
+		return;
+	}
+	if (label == "except_clause")
+	{
+		for (size_t k = 0; k + 1 < node->children.size(); k++)
+			if (node->children[k]->label == "as")
+				names.insert(node->children[k + 1]->label);
+	}
+	if (label == "import_statement")
+	{
+		unordered_set<string> imported;
+		collectImportNames(node, imported);
+		names.insert(imported.begin(), imported.end());
+		return;
+	}
+	for (const ParseTreeNode *child : node->children)
+		collectBoundNames(child, names);
+}
+
+void ConstantFolder::run(ParseTreeNode *program)
+{
+	Env env;
+	run(program, env);
+}
+
+void ConstantFolder::run(ParseTreeNode *program, Env &env)
+{
+	PYC_TRACE_SCOPE("constant folding");
+	foldStatements(program, env);
+
+	for (auto &[key, binding] : bindings)
+	{
+		bool single = binding.agree && binding.folded == binding.count;
+		if (!binding.stale && binding.count == 1 && !binding.known)
+			continue;
+		auto at = key.find('@');
+		string name = key.substr(0, at);
+		string scope = key.substr(at + 1);
+		if (!symbolTable.exist(name, scope))
+			continue;
+		if (binding.stale)
+		{
+			if (!symbolTable.getValue(name, scope).empty())
+			{
+				symbolTable.updateValue(name, scope, "");
+				symbolTable.updateType(name, scope, "unknown");
+			}
+			continue;
+		}
+		if (!single)
+		{
+			// Bound to different values, so none holds throughout
+			if (!symbolTable.getValue(name, scope).empty())
+				symbolTable.updateValue(name, scope, "");
+			if (binding.folded == binding.count && binding.sameType)
+				symbolTable.updateType(name, scope, binding.value.typeName());
+			else if (binding.folded > 0)
+				symbolTable.updateType(name, scope, "unknown");
+			continue;
+		}
+		// The folded type is exact, e.g. "7 / 2" is a float, not an int
+		if (binding.value.typeName() != "unknown")
+			symbolTable.updateType(name, scope, binding.value.typeName());
+		// Keep the Parser's spelling when it already holds this value
+		ConstValue existing;
+		string current = symbolTable.getValue(name, scope);
+		if (parseLiteral(current, existing) && existing.sameAs(binding.value))
+			continue;
+		string compact = current, folded = binding.value.repr();
+		compact.erase(remove(compact.begin(), compact.end(), ' '), compact.end());
+		folded.erase(remove(folded.begin(), folded.end(), ' '), folded.end());
+		if (compact == folded)
+			continue;
+		symbolTable.updateValue(name, scope, binding.value.repr());
+	}
+}
+
+string ConstantFolder::currentScope() const
+{
+	if (scopeNames.empty())
+		return "global";
+	string scope = scopeNames.back();
+	for (auto it = scopeNames.rbegin() + 1; it != scopeNames.rend(); ++it)
+		scope += "@" + *it;
+	return scope;
+}
+
+ConstantFolder::Binding &ConstantFolder::bind(const string &name, const ConstValue *value, Env &env)
+{
+	Binding &binding = bindings[name + "@" + currentScope()];
+	binding.count++;
+	binding.known = value != nullptr;
+	binding.stale = false;
+	if (value)
+	{
+		if (binding.folded > 0)
+		{
+			binding.agree = binding.agree && binding.value.sameAs(*value);
+			binding.sameType = binding.sameType && binding.value.typeName() == value->typeName();
+		}
+		binding.folded++;
+		binding.value = *value;
+		env[name] = *value;
+	}
+	else
+	{
+		env.erase(name);
+	}
+	return binding;
+}
+
+bool ConstantFolder::isPlainLiteral(const ParseTreeNode *node)
+{
+	while (node->children.size() == 1)
+		node = node->children[0];
+	return isLeaf(node) && classifyLeaf(node->label) != LeafKind::Name &&
+		   classifyLeaf(node->label) != LeafKind::Other;
+}
+
+bool ConstantFolder::isDisplay(const ParseTreeNode *node)
+{
+	while (node->children.size() == 1)
+		node = node->children[0];
+	return node->label == "list_literal" || node->label == "dict_literal" || node->label == "set_literal";
+}
+
+void ConstantFolder::killNames(const ParseTreeNode *node, Env &env)
+{
+	unordered_set<string> names;
+	collectBoundNames(node, names);
+	for (const string &name : names)
+		env.erase(name);
+}
+
+ConstantFolder::Env ConstantFolder::intersect(const vector<Env> &paths)
+{
+	Env result = paths.front();
+	for (size_t p = 1; p < paths.size(); p++)
+	{
+		for (auto it = result.begin(); it != result.end();)
+		{
+			auto other = paths[p].find(it->first);
+			if (other == paths[p].end() || !other->second.sameAs(it->second))
+				it = result.erase(it);
+			else
+				++it;
+		}
+	}
+	return result;
+}
+
+void ConstantFolder::foldStatements(ParseTreeNode *list, Env &env)
+{
+	for (ParseTreeNode *child : list->children)
+		foldStatement(child, env);
+}
+
+void ConstantFolder::foldStatement(ParseTreeNode *node, Env &env)
+{
+	const string &label = node->label;
+	if (isLeaf(node))
+		return; // INDENT / DEDENT markers
+	if (label == "statement")
+		foldStatement(node->children[0], env);
+	else if (label == "assignment")
+		foldAssignment(node, env);
+	else if (label == "conditional_statement")
+		foldConditional(node, env);
+	else if (label == "while_statement")
+	{
+		killNames(node->children[3], env);
+		foldExpr(node->children[1], env);
+		Env body = env;
+		foldStatements(node->children[3], body);
+	}
+	else if (label == "for_statement")
+	{
+		foldExpr(node->children[3], env);
+		killNames(node->children[5], env);
+		bind(node->children[1]->label, nullptr, env);
+		Env body = env;
+		foldStatements(node->children[5], body);
+	}
+	else if (label == "try_statement")
+		foldTry(node, env);
+	else if (label == "function")
+		foldFunction(node, env);
+	else if (label == "class_def")
+	{
+		bind(node->children[1]->label, nullptr, env);
+		scopeNames.push_back(node->children[1]->label);
+		Env classEnv;
+		foldStatements(node->children.back(), classEnv);
+		scopeNames.pop_back();
+	}
+	else if (label == "import_statement")
+	{
+		unordered_set<string> names;
+		collectImportNames(node, names);
+		for (const string &name : names)
+			bind(name, nullptr, env);
+	}
+	else
+	{
+		// return / raise / calls / docstrings: fold any expressions inside
+		for (ParseTreeNode *child : node->children)
+			foldExpr(child, env);
+	}
+}
+
+void ConstantFolder::foldAssignment(ParseTreeNode *node, Env &env)
+{
+	ParseTreeNode *lhs = node->children[0];
+	string op = node->children[1]->children.empty() ? "=" : node->children[1]->children[0]->label;
+	ParseTreeNode *rhs = node->children[2];
+
+	vector<bool> known;
+	vector<ConstValue> values;
+	vector<const ParseTreeNode *> exprs;
+	for (ParseTreeNode *expr : rhs->children)
+	{
+		if (expr->label != "expression")
+			continue;
+		ConstValue v;
+		known.push_back(foldExpr(expr, env, &v));
+		values.push_back(v);
+		exprs.push_back(expr);
+	}
+
+	size_t k = 0;
+	for (ParseTreeNode *target : lhs->children)
+	{
+		if (target->label == ",")
+			continue;
+		size_t idx = k++;
+		if (!isLeaf(target))
+			continue; // attribute store, does not rebind a name
+		const string &name = target->label;
+		bool ok = idx < known.size() && known[idx];
+		ConstValue result = ok ? values[idx] : ConstValue();
+		if (ok && op != "=")
+		{
+			auto prev = env.find(name);
+			string binop = op.substr(0, op.size() - 1);
+			ok = prev != env.end() && evalBinaryOp(binop, prev->second, values[idx], result);
+		}
+		Binding &binding = bind(name, ok ? &result : nullptr, env);
+		binding.stale = !ok && !(op == "=" && idx < exprs.size() && isDisplay(exprs[idx]));
+	}
+}
+
+void ConstantFolder::foldConditional(ParseTreeNode *node, Env &env)
+{
+	vector<Env> reachable;
+	bool decided = false;
+	bool hasElse = false;
+
+	auto foldClause = [&](ParseTreeNode *cond, ParseTreeNode *block)
+	{
+		ConstValue c;
+		bool known = cond && foldExpr(cond, env, &c);
+		Env branch = env;
+		foldStatements(block, branch);
+		if (decided || (known && !c.truthy()))
+			return;
+		reachable.push_back(move(branch));
+		decided = known || !cond;
+	};
+
+	foldClause(node->children[1], node->children[3]);
+	for (size_t k = 4; k < node->children.size(); k++)
+	{
+		ParseTreeNode *clause = node->children[k];
+		if (clause->label == "elif_clause")
+			foldClause(clause->children[1], clause->children[3]);
+		else if (clause->label == "else_clause")
+		{
+			hasElse = true;
+			foldClause(nullptr, clause->children[2]);
+		}
+	}
+	if (!hasElse && !decided)
+		reachable.push_back(env);
+	env = intersect(reachable);
+}
+
+void ConstantFolder::foldTry(ParseTreeNode *node, Env &env)
+{
+	// Any clause may be cut short by an exception, so nothing bound
+	// anywhere in the statement is trusted afterwards.
+	killNames(node, env);
+	for (ParseTreeNode *child : node->children)
+	{
+		if (child->label == "block")
+		{
+			Env body = env;
+			foldStatements(child, body);
+		}
+		else if (!isLeaf(child))
+		{
+			Env clauseEnv = env;
+			for (ParseTreeNode *part : child->children)
+			{
+				if (part->label == "block")
+					foldStatements(part, clauseEnv);
+			}
+			if (child->label == "except_clause")
+			{
+				for (size_t k = 0; k + 1 < child->children.size(); k++)
+					if (child->children[k]->label == "as")
+						bind(child->children[k + 1]->label, nullptr, clauseEnv);
+			}
+		}
+	}
+}
+
+void ConstantFolder::foldFunction(ParseTreeNode *node, Env &env)
+{
+	const string &name = node->children[1]->label;
+	ParseTreeNode *params = node->children[3];
+	// Defaults are evaluated where the def runs
+	for (ParseTreeNode *param : params->children)
+		if (param->label == "parameter" && param->children.size() == 3)
+			foldExpr(param->children[2], env);
+	bind(name, nullptr, env);
+
+	scopeNames.push_back(name);
+	Env local;
+	for (ParseTreeNode *param : params->children)
+		if (param->label == "parameter")
+			bind(param->children[0]->label, nullptr, local);
+	foldStatements(node->children.back(), local);
+	scopeNames.pop_back();
+}
+
+bool ConstantFolder::foldExpr(ParseTreeNode *node, Env &env, ConstValue *out)
+{
+	ConstValue scratch;
+	ConstValue &value = out ? *out : scratch;
+	const string &label = node->label;
+	const auto &c = node->children;
+
+	if (isLeaf(node))
+		return false;
+
+	if (label == "expression")
+	{
+		bool known = foldExpr(c[0], env, &value);
+		if (known && !isPlainLiteral(node))
+		{
+			node->folded = value.repr();
+			foldedExpressions++;
+		}
+		return known;
+	}
+	if (label == "or_expression" || label == "and_expression")
+	{
+		bool isOr = label == "or_expression";
+		bool known = foldExpr(c[0], env, &value);
+		bool settled = known && (isOr ? value.truthy() : !value.truthy());
+		for (size_t k = 2; k < c.size(); k += 2)
+		{
+			ConstValue next;
+			bool nextKnown = foldExpr(c[k], env, &next);
+			if (settled)
+				continue;
+			known = known && nextKnown;
+			if (known)
+			{
+				value = next;
+				settled = isOr ? value.truthy() : !value.truthy();
+			}
+		}
+		return known;
+	}
+	if (label == "not_expression")
+	{
+		if (c.size() == 2)
+		{
+			ConstValue inner;
+			return foldExpr(c[1], env, &inner) && evalUnaryOp("not", inner, value);
+		}
+		return foldExpr(c[0], env, &value);
+	}
+	if (label == "comparison")
+	{
+		ConstValue left;
+		bool known = foldExpr(c[0], env, &left);
+		if (c.size() == 1)
+		{
+			value = left;
+			return known;
+		}
+		// a < b < c is (a < b) and (b < c), with short-circuit
+		bool result = true, falsified = false;
+		for (size_t k = 1; k + 1 < c.size(); k += 2)
+		{
+			ConstValue right, cmp;
+			bool rightKnown = foldExpr(c[k + 1], env, &right);
+			string op;
+			for (const ParseTreeNode *part : c[k]->children)
+				op += (op.empty() ? "" : " ") + part->label;
+			if (falsified)
+				continue;
+			if (!known || !rightKnown || op.empty() || !evalBinaryOp(op, left, right, cmp))
+			{
+				known = false;
+				continue;
+			}
+			bool isCompare = op == "==" || op == "!=" || op == "<" || op == ">" || op == "<=" ||
+							 op == ">=" || op == "in" || op == "not in" || op == "is" || op == "is not";
+			if (!isCompare)
+			{
+				left = cmp; // bitwise operators chain like arithmetic
+				continue;
+			}
+			result = cmp.truthy();
+			if (!result)
+				falsified = true;
+			left = right;
+			value = cmp;
+		}
+		if (falsified)
+		{
+			value = ConstValue::makeBool(false);
+			return true;
+		}
+		if (known && value.kind != ConstValue::Kind::Bool)
+			value = left;
+		return known;
+	}
+	if (label == "arithmetic" || label == "term")
+	{
+		bool known = foldExpr(c[0], env, &value);
+		for (size_t k = 1; k + 1 < c.size(); k += 2)
+		{
+			ConstValue right, result;
+			bool rightKnown = foldExpr(c[k + 1], env, &right);
+			known = known && rightKnown && evalBinaryOp(c[k]->label, value, right, result);
+			if (known)
+				value = result;
+		}
+		return known;
+	}
+	if (label == "factor")
+		return foldFactor(node, env, value);
+	if (label == "tuple_or_group")
+	{
+		vector<ConstValue> items;
+		bool known = true;
+		bool hasComma = false;
+		for (ParseTreeNode *part : c)
+		{
+			if (part->label == ",")
+				hasComma = true;
+			if (part->label != "expression")
+				continue;
+			ConstValue item;
+			known = foldExpr(part, env, &item) && known;
+			items.push_back(item);
+		}
+		if (!known)
+			return false;
+		if (items.size() == 1 && !hasComma)
+		{
+			value = items[0];
+			return true;
+		}
+		value = ConstValue();
+		value.kind = ConstValue::Kind::Tuple;
+		value.items = move(items);
+		return true;
+	}
+
+	// Calls, containers, dotted names: not constant, but fold inside
+	for (ParseTreeNode *child : c)
+		foldExpr(child, env);
+	return false;
+}
+
+bool ConstantFolder::foldFactor(ParseTreeNode *node, Env &env, ConstValue &value)
+{
+	const auto &c = node->children;
+	if (c.size() == 1 && isLeaf(c[0]))
+	{
+		const string &lexeme = c[0]->label;
+		if (classifyLeaf(lexeme) == LeafKind::Name)
+		{
+			auto it = env.find(lexeme);
+			if (it == env.end())
+				return false;
+			value = it->second;
+			return true;
+		}
+		return parseLiteral(lexeme, value);
+	}
+	if (c.size() == 2 && isLeaf(c[0]) && c[1]->label == "factor")
+	{
+		ConstValue inner;
+		return foldExpr(c[1], env, &inner) && evalUnaryOp(c[0]->label, inner, value);
+	}
+	if (c.size() == 1 && c[0]->label == "tuple_or_group")
+		return foldExpr(c[0], env, &value);
+	for (ParseTreeNode *child : c)
+		foldExpr(child, env);
+	return false;
+}
+
+void printTokens(const vector<Token> &tokens, const SymbolTable &symTable, ostream &out)
+{
+	OutputBuffer buffer(out);
+	pmr::string key;
+	buffer << "\n\nTokens:\n";
+	for (const Token &tk : tokens)
+	{
+		buffer << "< " << tokenKindNames[size_t(tk.type)] << ", ";
+		if (tk.type == TokenType::IDENTIFIER)
+		{
+			key.assign(tk.lexeme).append(1, '@').append(tk.scope);
+			auto symbol = symTable.table.find(key);
+			if (symbol != symTable.table.end())
+				buffer << "symbol table entry : " << symbol->second.entry;
+			else
+				buffer << "symbol table entry: not found";
+		}
+		else
+		{
+			buffer << tk.lexeme;
+		}
+		buffer << " >  | LINE NUMBER: " << tk.lineNumber << '\n';
+	}
+	buffer << '\n';
+}
+
+void printParseTree(const ParseTreeNode *node, int depth, ostream &out, bool showFolded)
+{
+	if (node == nullptr)
+		return;
+	OutputBuffer buffer(out);
+	vector<pair<const ParseTreeNode *, int>> stack = {{node, depth}};
+	while (!stack.empty())
+	{
+		auto [current, level] = stack.back();
+		stack.pop_back();
+		buffer.spaces(size_t(level) * 2);
+		buffer << "|- " << current->label;
+		if (showFolded && !current->folded.empty())
+			buffer << " = " << current->folded;
+		buffer << '\n';
+		for (auto child = current->children.rbegin(); child != current->children.rend(); ++child)
+			if (*child)
+				stack.push_back({*child, level + 1});
+	}
+}
+
+void deleteTree(ParseTreeNode *root)
+{
+	vector<ParseTreeNode *> stack = {root};
+	while (!stack.empty())
+	{
+		ParseTreeNode *node = stack.back();
+		stack.pop_back();
+		if (!node)
+			continue;
+		stack.insert(stack.end(), node->children.begin(), node->children.end());
+		delete node;
+	}
+}
+
+size_t countNodes(const ParseTreeNode *root)
+{
+	size_t count = 0;
+	vector<const ParseTreeNode *> stack = {root};
+	while (!stack.empty())
+	{
+		const ParseTreeNode *node = stack.back();
+		stack.pop_back();
+		count++;
+		stack.insert(stack.end(), node->children.begin(), node->children.end());
+	}
+	return count;
+}
+
+// ----------------------------------------------
+// Tree passes
+// ----------------------------------------------
+
+NodeKind nodeKindOf(const ParseTreeNode *node)
+{
+	static const unordered_map<string_view, NodeKind> kinds = []
+	{
+		unordered_map<string_view, NodeKind> byLabel;
+		for (size_t k = 1; k < size_t(NodeKind::Count); k++)
+			byLabel.emplace(nodeKindNames[k], NodeKind(k));
+		return byLabel;
+	}();
+	if (node->children.empty())
+		return NodeKind::Leaf;
+	auto it = kinds.find(node->label);
+	return it == kinds.end() ? NodeKind::Leaf : it->second;
+}
+
+void printTreeStats(const ParseTreeNode *root, ostream &out)
+{
+	PYC_TRACE_SCOPE("tree passes");
+	TreeShapePass shape;
+	KindHistogramPass kinds;
+	DefinitionPass definitions;
+	CallSitePass calls;
+	LoopPass loops;
+	ConstantPass constants;
+	runTreePasses(root, shape, kinds, definitions, calls, loops, constants);
+	string text = "\nTree statistics\n";
+	shape.describe(text);
+	definitions.describe(text);
+	calls.describe(text);
+	loops.describe(text);
+	constants.describe(text);
+	kinds.describe(text);
+	out << text;
+}
+
+// ----------------------------------------------
+// Subtree sharing
+// ----------------------------------------------
+// shareSubtrees hash-conses a folded tree into a DAG. It keeps one node
+// for each distinct leaf, dotted name and pure expression, and frees the
+// others. A subtree qualifies when its kind is one of those below and all
+// of its children qualify. Calls and statements never qualify. Two nodes
+// are the same when their labels, folded values and (already shared)
+// children are, so the walk is bottom-up. The shared tree prints and
+// exports exactly like the original, because the printers and exporters
+// walk paths, not nodes. Nothing may change a node of the DAG afterwards,
+// and it is freed with deleteSharedTree. Trees owned by a ParseTreeArena
+// cannot be shared.
+
+bool shareableKind(NodeKind kind, const ParseTreeNode *node)
+{
+	switch (kind)
+	{
+	case NodeKind::Leaf:
+	case NodeKind::DottedName:
+	case NodeKind::Expression:
+	case NodeKind::OrExpression:
+	case NodeKind::AndExpression:
+	case NodeKind::NotExpression:
+	case NodeKind::Comparison:
+	case NodeKind::Arithmetic:
+	case NodeKind::Term:
+	case NodeKind::TupleOrGroup:
+	case NodeKind::ListLiteral:
+	case NodeKind::DictLiteral:
+	case NodeKind::SetLiteral:
+	case NodeKind::AssignOp:
+	case NodeKind::AugmentedOp:
+		return true;
+	case NodeKind::Factor: // unless it is a call
+		return !(node->children.size() >= 3 && node->children[1] && node->children[1]->label == "(");
+	default:
+		return false;
+	}
+}
+
+struct SharedNodeHash
+{
+	size_t operator()(const ParseTreeNode *node) const
+	{
+		size_t h = hash<string>()(node->label) * 31 + hash<string>()(node->folded);
+		for (const ParseTreeNode *child : node->children)
+			h = h * 1000003 ^ hash<const ParseTreeNode *>()(child);
+		return h;
+	}
+};
+
+struct SharedNodeEqual
+{
+	bool operator()(const ParseTreeNode *a, const ParseTreeNode *b) const
+	{
+		return a->label == b->label && a->folded == b->folded && a->children == b->children;
+	}
+};
+
+// Heap bytes of one node: the object and the out-of-line buffers of its
+// strings and child list
+uint64_t nodeFootprint(const ParseTreeNode *node)
+{
+	uint64_t bytes = sizeof(ParseTreeNode) + node->children.capacity() * sizeof(ParseTreeNode *);
+	string empty;
+	if (node->label.capacity() > empty.capacity())
+		bytes += node->label.capacity() + 1;
+	if (node->folded.capacity() > empty.capacity())
+		bytes += node->folded.capacity() + 1;
+	return bytes;
+}
+
+ParseTreeNode *shareSubtrees(ParseTreeNode *root, SharingReport *report)
+{
+	PYC_TRACE_SCOPE("subtree sharing");
+	struct Frame
+	{
+		ParseTreeNode *node;
+		size_t next;
+		bool shareable;
+	};
+	if (!root)
+		return root;
+	unordered_set<ParseTreeNode *, SharedNodeHash, SharedNodeEqual> canonical;
+	SharingReport counts;
+	vector<Frame> stack;
+	auto open = [&](ParseTreeNode *node)
+	{
+		counts.nodes++;
+		counts.bytesBefore += nodeFootprint(node);
+		stack.push_back({node, 0, shareableKind(nodeKindOf(node), node)});
+	};
+	open(root);
+	while (true)
+	{
+		Frame &top = stack.back();
+		if (top.next < top.node->children.size())
+		{
+			ParseTreeNode *child = top.node->children[top.next++];
+			if (child)
+				open(child);
+			else
+				top.shareable = false;
+			continue;
+		}
+
+		ParseTreeNode *result = top.node;
+		bool shared = top.shareable;
+		if (shared)
+		{
+			auto [it, inserted] = canonical.insert(top.node);
+			if (!inserted)
+			{
+				// The children are shared nodes, owned by *it as well
+				result = *it;
+				top.node->children.clear();
+				delete top.node;
+			}
+		}
+		stack.pop_back();
+		if (stack.empty())
+		{
+			root = result;
+			break;
+		}
+		Frame &parent = stack.back();
+		parent.node->children[parent.next - 1] = result;
+		parent.shareable = parent.shareable && shared;
+	}
+
+	if (report)
+	{
+		unordered_set<const ParseTreeNode *> seen;
+		vector<const ParseTreeNode *> pending = {root};
+		while (!pending.empty())
+		{
+			const ParseTreeNode *node = pending.back();
+			pending.pop_back();
+			if (!node || !seen.insert(node).second)
+				continue;
+			counts.bytesAfter += nodeFootprint(node);
+			pending.insert(pending.end(), node->children.begin(), node->children.end());
+		}
+		counts.unique = seen.size();
+		*report = counts;
+	}
+	return root;
+}
+
+void deleteSharedTree(ParseTreeNode *root)
+{
+	unordered_set<ParseTreeNode *> seen;
+	vector<ParseTreeNode *> stack = {root};
+	while (!stack.empty())
+	{
+		ParseTreeNode *node = stack.back();
+		stack.pop_back();
+		if (!node || !seen.insert(node).second)
+			continue;
+		stack.insert(stack.end(), node->children.begin(), node->children.end());
+	}
+	for (ParseTreeNode *node : seen)
+		delete node;
+}
+
+void printSharingReport(const SharingReport &report, ostream &out)
+{
+	out << "Subtree sharing: " << report.unique << " of " << report.nodes << " nodes kept, " << fixed
+		<< setprecision(1) << report.bytesBefore / 1024.0 << " KB -> " << report.bytesAfter / 1024.0 << " KB ("
+		<< 100.0 * (1 - double(report.bytesAfter) / max<uint64_t>(report.bytesBefore, 1)) << "% saved)\n"
+		<< defaultfloat << setprecision(6);
+}
+
+// ----------------------------------------------
+// 8. Utility function to read the entire file
+// ----------------------------------------------
+string readFile(const string &filename)
+{
+	PYC_TRACE_SCOPE("read source");
+	ifstream fileStream(filename);
+	if (!fileStream.is_open())
+	{
+		throw runtime_error("Could not open file: " + filename);
+	}
+	stringstream buffer;
+	buffer << fileStream.rdbuf();
+	return buffer.str();
+}
+
+// Appends 'label' with backslashes and double quotes escaped, in one pass
+void appendDotLabel(string &out, string_view label)
+{
+	for (char c : label)
+	{
+		if (c == '\\' || c == '"')
+			out += '\\';
+		out += c;
+	}
+}
+
+// Writes the node and edge lines of 'range'. Walks with an explicit stack,
+// so deep trees cannot overflow the call stack; returns the nodes written.
+size_t exportToDot(const ParseTreeNode *root, OutputBuffer &out, const DotRange &range = {})
+{
+	struct Pending
+	{
+		const ParseTreeNode *node;
+		size_t parent; // preorder number, SIZE_MAX for the root
+		int depth;
+	};
+	vector<Pending> stack = {{root, SIZE_MAX, 0}};
+	size_t written = 0;
+	int base = -1; // depth of the range's root once the walk reaches it
+	for (size_t id = 0; !stack.empty(); id++)
+	{
+		Pending at = stack.back();
+		stack.pop_back();
+		if (id == range.root)
+			base = at.depth;
+		else if (base >= 0 && at.depth <= base)
+			break; // past the end of the subtree
+		int depth = at.depth - base;
+		if (base >= 0 && depth >= range.minDepth && depth <= range.maxDepth)
+		{
+			out << "    node" << id << " [label=\"";
+			appendDotLabel(out.raw(), at.node->label);
+			out << "\"];\n";
+			if (depth > range.minDepth)
+				out << "    node" << at.parent << " -> node" << id << ";\n";
+			written++;
+		}
+		const vector<ParseTreeNode *> &children = at.node->children;
+		for (auto child = children.rbegin(); child != children.rend(); ++child)
+			stack.push_back({*child, id, at.depth + 1});
+	}
+	return written;
+}
+
+void saveTreeToDot(const ParseTreeNode *root, const string &filename, const DotRange &range)
+{
+	PYC_TRACE_SCOPE("DOT export");
+	string partial = filename + ".partial";
+	size_t written;
+	{
+		ofstream file(partial);
+		OutputBuffer out(file);
+		out << "digraph ParseTree {\n";
+		out << "    node [shape=box];\n";
+		written = exportToDot(root, out, range);
+		out << "}\n";
+	}
+	error_code ec;
+	if (written == 0)
+	{
+		filesystem::remove(partial, ec);
+		// Only the defaults select every node, so at least one flag was given
+		string flags;
+		if (range.root != 0)
+			flags = "--dot-root=" + to_string(range.root) + " ";
+		if (range.minDepth != 0 || range.maxDepth != INT_MAX)
+			flags += "--dot-depth=" + (range.minDepth ? to_string(range.minDepth) + ":" : "") + to_string(range.maxDepth) + " ";
+		throw runtime_error(flags + "selects no nodes (past the last node or below the deepest leaf)");
+	}
+	filesystem::rename(partial, filename, ec);
+	if (ec)
+	{
+		filesystem::remove(partial, ec);
+		throw runtime_error("could not write " + filename);
+	}
+}
+} // namespace pyc::detail
@@ -0,0 +1,2057 @@
+#ifndef PYC_FRONTEND_H
+#define PYC_FRONTEND_H
+
+// The front end: lexer, symbol pass, parser, constant folding, tree passes
+// and the session that runs them, everything libpyc.a is built from.
+// Internal to pyc; programs linking the library use Compiler.h.
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <condition_variable>
+#include <csetjmp>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <list>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "Compiler.h"
+
+namespace pyc::detail
+{
+using namespace std;
+
+// ----------------------------------------------
+// Allocation counting
+// ----------------------------------------------
+// Every operator new in the process bumps the calling thread's counters, so
+// the allocations made by a piece of work are the difference between two
+// snapshots taken around it on the same thread. That takes replacing the
+// global operator new and delete, which a library has no business doing
+// to the program it is linked into, so the replacements live on their own
+// in AllocationHooks.cpp: linked into pyc, and into libpyc.a only when
+// asked for. Without them every counter stays at zero; --alloc-stats and
+// --max-memory are refused, and the allocation columns of the benchmarks
+// read 0.
+struct AllocationCounters
+{
+	size_t allocations = 0;
+	size_t bytes = 0;
+};
+
+extern thread_local AllocationCounters allocationCounters;
+
+// Set before main() when AllocationHooks.cpp is linked in
+extern bool allocationHooks;
+
+// --alloc-stats also charges every allocation to the kind of data the
+// allocating code is building (set with PYC_ALLOC_SITE) and follows live
+// bytes, for the peak of each traced phase. Live bytes are usable block
+// sizes, slightly above the requested ones, and cost a malloc_usable_size
+// call per allocation and free, so all of this stays off unless asked for.
+// They count from the moment profiling starts: freeing an older block
+// lowers them but never produces a negative peak.
+enum class AllocationSite
+{
+	Other,
+	TokenText,	 // lexemes, scopes and token vectors written by Lexer::emit
+	TokenCopies, // token vectors copied into a Syntax_Analyzer
+	TreeNodes,	 // ParseTreeNode objects, labels and child lists
+	Symbols,	 // "name@scope" keys and SymbolInfo entries
+	Count
+};
+
+const char *const allocationSiteNames[] = {"other", "token text", "token copies", "tree nodes", "symbol table"};
+
+struct SiteCounters
+{
+	atomic<size_t> allocations{0}, bytes{0};
+};
+
+extern bool allocationProfiling;
+extern SiteCounters allocationSites[size_t(AllocationSite::Count)];
+extern atomic<int64_t> liveBytes;
+extern thread_local AllocationSite allocationSite;
+extern thread_local int64_t *allocationPeak; // high-water mark of this thread's innermost traced phase
+
+// ----------------------------------------------
+// Phase tracing
+// ----------------------------------------------
+// PYC_TRACE_SCOPE times the enclosing block as one phase and
+// PYC_TRACE_STATEMENT as one top-level statement within a phase. --stats
+// prints a summary per phase on exit and --trace=FILE writes the spans as
+// Chrome trace events, which Perfetto and chrome://tracing open directly.
+// Statement spans are only recorded with --trace-statements. With
+// --alloc-stats every span also carries the allocations made on its thread
+// and its live-bytes peak, and the summary adds tables per phase and per
+// allocation site. When tracing is off a scope costs one test of a global
+// flag; built with -DPYC_TRACE=0 the macros expand to nothing at all.
+#ifndef PYC_TRACE
+#define PYC_TRACE 1
+#endif
+
+struct TraceEvent
+{
+	const char *name; // a string literal
+	int line;		  // first source line of a statement span, 0 for phases
+	unsigned thread;
+	int64_t startNs, durationNs;
+	size_t allocations, bytes; // made on the span's thread, nested spans included
+	int64_t peakBytes;		   // live bytes high-water mark above the level at entry
+};
+
+class Tracer
+{
+public:
+	bool enabled = false;
+	bool statements = false;
+	const chrono::steady_clock::time_point origin = chrono::steady_clock::now();
+
+	void record(TraceEvent event, chrono::steady_clock::time_point start, chrono::steady_clock::time_point end)
+	{
+		thread_local unsigned thread = nextThread++;
+		event.thread = thread;
+		event.startNs = nanoseconds(start - origin);
+		event.durationNs = nanoseconds(end - start);
+		lock_guard<mutex> guard(lock);
+		events.push_back(event);
+	}
+
+	// One line per span name, in order of first appearance
+	void printStats(ostream &out)
+	{
+		lock_guard<mutex> guard(lock);
+		double wallMs = nanoseconds(chrono::steady_clock::now() - origin) / 1e6;
+		struct Total
+		{
+			size_t calls = 0, allocations = 0, bytes = 0;
+			double ms = 0, longest = 0;
+			int64_t peakBytes = 0;
+		};
+		vector<const char *> names;
+		unordered_map<string, Total> totals;
+		for (const TraceEvent &e : events)
+		{
+			auto [it, inserted] = totals.try_emplace(e.name);
+			if (inserted)
+				names.push_back(e.name);
+			it->second.calls++;
+			it->second.ms += e.durationNs / 1e6;
+			it->second.longest = max(it->second.longest, e.durationNs / 1e6);
+			it->second.allocations += e.allocations;
+			it->second.bytes += e.bytes;
+			it->second.peakBytes = max(it->second.peakBytes, e.peakBytes);
+		}
+		out << fixed << setprecision(3) << "Phase statistics (" << wallMs << " ms since start)\n"
+			<< "  " << left << setw(22) << "phase" << right << setw(10) << "calls" << setw(14) << "total ms"
+			<< setw(14) << "longest ms" << setw(9) << "share\n";
+		for (const char *name : names)
+		{
+			const Total &t = totals[name];
+			out << "  " << left << setw(22) << name << right << setw(10) << t.calls << setw(14) << t.ms
+				<< setw(14) << t.longest << setw(7) << setprecision(1) << 100 * t.ms / wallMs << "%\n"
+				<< setprecision(3);
+		}
+		if (allocationProfiling)
+		{
+			out << "Allocations by phase (peak: live bytes above the level at entry)\n"
+				<< "  " << left << setw(22) << "phase" << right << setw(14) << "allocations" << setw(14) << "MB"
+				<< setw(14) << "peak MB\n";
+			for (const char *name : names)
+			{
+				const Total &t = totals[name];
+				out << "  " << left << setw(22) << name << right << setw(14) << t.allocations << setw(14)
+					<< t.bytes / 1048576.0 << setw(13) << t.peakBytes / 1048576.0 << '\n';
+			}
+			out << "Allocations by site\n"
+				<< "  " << left << setw(22) << "site" << right << setw(14) << "allocations" << setw(14) << "MB\n";
+			for (size_t k = 0; k < size_t(AllocationSite::Count); k++)
+				out << "  " << left << setw(22) << allocationSiteNames[k] << right << setw(14)
+					<< allocationSites[k].allocations.load() << setw(14) << allocationSites[k].bytes.load() / 1048576.0 << '\n';
+		}
+		out << defaultfloat << setprecision(6);
+	}
+
+	// Complete ("X") events in microseconds; names never need escaping. With
+	// --alloc-stats the site totals go in an extra top-level "allocationSites"
+	// object, which trace viewers ignore.
+	bool writeChromeTrace(const string &path)
+	{
+		lock_guard<mutex> guard(lock);
+		ofstream out(path);
+		out << "{\"displayTimeUnit\":\"ms\",";
+		if (allocationProfiling)
+		{
+			out << "\"allocationSites\":{";
+			for (size_t k = 0; k < size_t(AllocationSite::Count); k++)
+				out << (k ? ",\"" : "\"") << allocationSiteNames[k] << "\":{\"allocations\":"
+					<< allocationSites[k].allocations.load() << ",\"bytes\":" << allocationSites[k].bytes.load() << '}';
+			out << "},";
+		}
+		out << "\"traceEvents\":[\n"
+			<< "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"pyc\"}}";
+		out << fixed << setprecision(3);
+		for (const TraceEvent &e : events)
+		{
+			out << ",\n{\"name\":\"" << e.name << "\",\"cat\":\"" << (e.line ? "statement" : "phase")
+				<< "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << e.thread << ",\"ts\":" << e.startNs / 1e3
+				<< ",\"dur\":" << e.durationNs / 1e3;
+			out << ",\"args\":{";
+			if (e.line)
+				out << "\"line\":" << e.line << (allocationProfiling ? "," : "");
+			if (allocationProfiling)
+				out << "\"allocations\":" << e.allocations << ",\"bytes\":" << e.bytes << ",\"peakBytes\":" << e.peakBytes;
+			out << "}}";
+		}
+		out << "\n]}\n";
+		return bool(out.flush());
+	}
+
+private:
+	mutex lock;
+	vector<TraceEvent> events;
+	atomic<unsigned> nextThread{1};
+
+	static int64_t nanoseconds(chrono::steady_clock::duration d)
+	{
+		return chrono::duration_cast<chrono::nanoseconds>(d).count();
+	}
+};
+
+extern Tracer tracer;
+
+class TraceScope
+{
+public:
+	explicit TraceScope(const char *name, int line = 0)
+		: name(name), line(line), active(tracer.enabled && (line == 0 || tracer.statements))
+	{
+		if (!active)
+			return;
+		if (allocationProfiling)
+		{
+			before = allocationCounters;
+			outerPeak = allocationPeak;
+			peak = entryBytes = liveBytes.load(memory_order_relaxed);
+			allocationPeak = &peak;
+		}
+		start = chrono::steady_clock::now();
+	}
+	TraceScope(const TraceScope &) = delete;
+	TraceScope &operator=(const TraceScope &) = delete;
+
+	~TraceScope()
+	{
+		if (!active)
+			return;
+		auto end = chrono::steady_clock::now();
+		TraceEvent event{name, line, 0, 0, 0, 0, 0, 0};
+		if (allocationProfiling)
+		{
+			allocationPeak = outerPeak;
+			if (outerPeak && peak > *outerPeak)
+				*outerPeak = peak;
+			event.allocations = allocationCounters.allocations - before.allocations;
+			event.bytes = allocationCounters.bytes - before.bytes;
+			event.peakBytes = peak - entryBytes;
+		}
+		tracer.record(event, start, end);
+	}
+
+private:
+	const char *name;
+	int line;
+	bool active;
+	chrono::steady_clock::time_point start;
+	AllocationCounters before;
+	int64_t *outerPeak = nullptr;
+	int64_t peak = 0, entryBytes = 0;
+};
+
+// Charges the allocations of the enclosing block to 'site' (see --alloc-stats)
+class AllocationSiteScope
+{
+public:
+	explicit AllocationSiteScope(AllocationSite site) : outer(allocationSite) { allocationSite = site; }
+	AllocationSiteScope(const AllocationSiteScope &) = delete;
+	AllocationSiteScope &operator=(const AllocationSiteScope &) = delete;
+	~AllocationSiteScope() { allocationSite = outer; }
+
+private:
+	AllocationSite outer;
+};
+
+#if PYC_TRACE
+#define PYC_TRACE_JOIN2(a, b) a##b
+#define PYC_TRACE_JOIN(a, b) PYC_TRACE_JOIN2(a, b)
+#define PYC_TRACE_SCOPE(name) TraceScope PYC_TRACE_JOIN(traceScope, __LINE__)(name)
+#define PYC_TRACE_STATEMENT(name, line) TraceScope PYC_TRACE_JOIN(traceScope, __LINE__)(name, max(1, int(line)))
+
+#define PYC_ALLOC_SITE(site) AllocationSiteScope PYC_TRACE_JOIN(allocationSite, __LINE__)(AllocationSite::site)
+#else
+#define PYC_TRACE_SCOPE(name) ((void)0)
+#define PYC_TRACE_STATEMENT(name, line) ((void)0)
+
+#define PYC_ALLOC_SITE(site) ((void)0)
+#endif
+
+// ----------------------------------------------
+// Buffered output
+// ----------------------------------------------
+// Listings are appended to one large string that goes to the stream only
+// when it passes 'chunk' bytes and when the buffer is destroyed, so a dump
+// of a million tokens is a few dozen writes instead of a formatted
+// operator<< per field. Nothing flushes in between: the stream is flushed
+// once, by flush() or the destructor.
+class OutputBuffer
+{
+public:
+	explicit OutputBuffer(ostream &out, size_t chunk = 1 << 20) : out(out), chunk(chunk)
+	{
+		text.reserve(chunk + 4096);
+	}
+	OutputBuffer(const OutputBuffer &) = delete;
+	OutputBuffer &operator=(const OutputBuffer &) = delete;
+	~OutputBuffer() { flush(); }
+
+	OutputBuffer &operator<<(string_view s)
+	{
+		text.append(s.data(), s.size());
+		if (text.size() >= chunk)
+			spill();
+		return *this;
+	}
+
+	OutputBuffer &operator<<(char c)
+	{
+		text += c;
+		return *this;
+	}
+
+	template <class T, enable_if_t<is_integral_v<T> && !is_same_v<T, char> && !is_same_v<T, bool>, int> = 0>
+	OutputBuffer &operator<<(T value)
+	{
+		char digits[24];
+		text.append(digits, to_chars(digits, digits + sizeof digits, value).ptr);
+		return *this;
+	}
+
+	void spaces(size_t count) { text.append(count, ' '); }
+
+	// For appenders such as appendJsonString; the next operator<< spills if needed
+	string &raw() { return text; }
+
+	void flush()
+	{
+		spill();
+		out.flush();
+	}
+
+private:
+	ostream &out;
+	size_t chunk;
+	string text;
+
+	void spill()
+	{
+		out.write(text.data(), text.size());
+		text.clear();
+	}
+};
+
+// ----------------------------------------------
+// 1. Token Types
+// ----------------------------------------------
+// Listed once: the enum and the kind names of token dumps are both generated from it
+#define TOKEN_TYPES(X)                                                      \
+	X(FalseKeyword)                                                         \
+	X(NoneKeyword)                                                          \
+	X(TrueKeyword)                                                          \
+	X(AndKeyword)                                                           \
+	X(AsKeyword)                                                            \
+	X(AssertKeyword)                                                        \
+	X(AsyncKeyword)                                                         \
+	X(AwaitKeyword)                                                         \
+	X(BreakKeyword)                                                         \
+	X(ClassKeyword)                                                         \
+	X(ContinueKeyword)                                                      \
+	X(DefKeyword)                                                           \
+	X(DelKeyword)                                                           \
+	X(ElifKeyword)                                                          \
+	X(ElseKeyword)                                                          \
+	X(ExceptKeyword)                                                        \
+	X(FinallyKeyword)                                                       \
+	X(ForKeyword)                                                           \
+	X(FromKeyword)                                                          \
+	X(GlobalKeyword)                                                        \
+	X(IfKeyword)                                                            \
+	X(ImportKeyword)                                                        \
+	X(InKeyword)                                                            \
+	X(IsKeyword)                                                            \
+	X(LambdaKeyword)                                                        \
+	X(NonlocalKeyword)                                                      \
+	X(NotKeyword)                                                           \
+	X(OrKeyword)                                                            \
+	X(PassKeyword)                                                          \
+	X(RaiseKeyword)                                                         \
+	X(ReturnKeyword)                                                        \
+	X(TryKeyword)                                                           \
+	X(WhileKeyword)                                                         \
+	X(WithKeyword)                                                          \
+	X(YieldKeyword)                                                         \
+	X(IDENTIFIER)                                                           \
+	X(NUMBER)                                                               \
+	X(OPERATOR)                                                             \
+	X(STRING_LITERAL)                                                       \
+	X(UNKNOWN)                                                              \
+	X(LeftParenthesis)                                                      \
+	X(RightParenthesis)                                                     \
+	X(LeftBracket)                                                          \
+	X(RightBracket)                                                         \
+	X(LeftBrace)                                                            \
+	X(RightBrace)                                                           \
+	X(Colon)                                                                \
+	X(Comma)                                                                \
+	X(Dot)                                                                  \
+	X(Semicolon)                                                            \
+	X(INDENT)                                                               \
+	X(DEDENT)
+
+enum class TokenType
+{
+#define TOKEN_TYPE_ENUM(name) name,
+	TOKEN_TYPES(TOKEN_TYPE_ENUM)
+#undef TOKEN_TYPE_ENUM
+};
+
+const string_view tokenKindNames[] = {
+#define TOKEN_TYPE_NAME(name) #name,
+	TOKEN_TYPES(TOKEN_TYPE_NAME)
+#undef TOKEN_TYPE_NAME
+};
+
+// ----------------------------------------------
+// 2. Token Structure
+// ----------------------------------------------
+struct Token
+{
+	TokenType type;
+	string lexeme;
+	int lineNumber;
+	string scope;
+
+	Token() {};
+
+	Token(TokenType t, const string &l, int line, const string &s = "")
+		: type(t), lexeme(l), lineNumber(line), scope(s) {}
+};
+
+// ----------------------------------------------
+// 3. Error Structure
+// ----------------------------------------------
+struct Error
+{
+	string message;
+	int line;
+	size_t position;
+
+	void print(ostream &out = cerr) const
+	{
+		out << "Error at line " << line << ", position " << position
+			<< ": " << message << endl;
+	}
+};
+
+// printing errors
+void printErrors(const vector<Error> &errors, ostream &out = cout, ostream &err = cerr);
+
+// ----------------------------------------------
+// 4. Scope Info Structure
+// ----------------------------------------------
+struct ScopeInfo
+{
+	std::string name;
+	int indentLevel; // Indentation level when the scope started
+};
+
+// ----------------------------------------------
+// 5. Symbol Table
+// ----------------------------------------------
+class SymbolTable
+{
+public:
+	// The strings of an entry, like its key, come from the table's memory
+	// resource, so a table on a pool reuses them once it is cleared
+	struct SymbolInfo
+	{
+		using allocator_type = pmr::polymorphic_allocator<char>;
+
+		int entry;					   // unique entry number
+		pmr::string type{"unknown"};  // e.g., "function", "class", "int", etc.
+		pmr::string scope{"unknown"}; // e.g., "global" or function name
+		int firstAppearance = -1;	   // line of first appearance
+		int usageCount = 0;			   // how many times it is referenced
+
+		// A new field to store a literal value if we know it (optional).
+		pmr::string value;
+
+		SymbolInfo() = default;
+		SymbolInfo(const SymbolInfo &) = default;
+		SymbolInfo(SymbolInfo &&) = default;
+		SymbolInfo &operator=(const SymbolInfo &) = default;
+		SymbolInfo &operator=(SymbolInfo &&) = default;
+
+		explicit SymbolInfo(const allocator_type &memory)
+			: type("unknown", memory), scope("unknown", memory), value(memory) {}
+		SymbolInfo(const SymbolInfo &other, const allocator_type &memory)
+			: entry(other.entry), type(other.type, memory), scope(other.scope, memory),
+			  firstAppearance(other.firstAppearance), usageCount(other.usageCount), value(other.value, memory) {}
+		SymbolInfo(SymbolInfo &&other, const allocator_type &memory)
+			: entry(other.entry), type(move(other.type), memory), scope(move(other.scope), memory),
+			  firstAppearance(other.firstAppearance), usageCount(other.usageCount), value(move(other.value), memory) {}
+	};
+
+	pmr::unordered_map<pmr::string, SymbolInfo> table;
+	int nextEntry = 1;
+
+	SymbolTable() = default;
+	// Table nodes and the strings in them come from 'memory', e.g. a pool
+	// kept across compilations
+	explicit SymbolTable(pmr::memory_resource *memory) : table(memory) {}
+
+	void clear()
+	{
+		table.clear();
+		nextEntry = 1;
+	}
+
+	// "name@scope", spelled in a buffer reused by every lookup; valid until the next call
+	const pmr::string &keyFor(string_view name, string_view scope)
+	{
+		PYC_ALLOC_SITE(Symbols);
+		lookupKey.assign(name).append(1, '@').append(scope);
+		return lookupKey;
+	}
+
+	void addSymbol(const string &name, const string &type,
+				   int lineNumber, const string &scope,
+				   const string &val = "")
+	{
+		PYC_ALLOC_SITE(Symbols);
+		const pmr::string &uniqueKey = keyFor(name, scope);
+
+		auto it = table.find(uniqueKey);
+		if (it == table.end())
+		{
+			SymbolInfo &info = table.try_emplace(uniqueKey).first->second;
+			info.entry = nextEntry++;
+			info.type = type;
+			info.scope = scope;
+			info.firstAppearance = lineNumber;
+			info.usageCount = 1;
+			info.value = val;
+		}
+		else
+		{
+			it->second.usageCount++;
+			if (it->second.type == "unknown" && type != "unknown")
+			{
+				it->second.type = type;
+			}
+			if (!val.empty())
+			{
+				it->second.value = val;
+			}
+		}
+	}
+
+	// Allows updating a symbol's type after creation.
+	void updateType(const string &name, const string &scope, const string &newType)
+	{
+		auto it = table.find(keyFor(name, scope));
+		if (it != table.end())
+		{
+			it->second.type = newType;
+		}
+	}
+
+	// Allows updating a symbol's literal value after creation.
+	void updateValue(const string &name, const string &scope, const string &newValue)
+	{
+		auto it = table.find(keyFor(name, scope));
+		if (it != table.end())
+		{
+			it->second.value = newValue;
+		}
+	}
+
+	// Retrieve the type of a symbol if it exists
+	bool exist(string_view name, string_view scope)
+	{
+		return table.find(keyFor(name, scope)) != table.end();
+	}
+
+	string getType(string_view name, string_view scope)
+	{
+		auto it = table.find(keyFor(name, scope));
+		return it != table.end() ? string(it->second.type) : "unknown";
+	}
+
+	string getValue(string_view name, string_view scope)
+	{
+		auto it = table.find(keyFor(name, scope));
+		return it != table.end() ? string(it->second.value) : "";
+	}
+
+	void printSymbols(ostream &out = cout) const
+	{
+		OutputBuffer buffer(out);
+		buffer << "Symbol Table:\n";
+
+		// Entries are unique, so sorting pointers to them gives the listing order
+		vector<const pair<const pmr::string, SymbolInfo> *> sortedSymbols;
+		sortedSymbols.reserve(table.size());
+		for (const auto &symbol : table)
+			sortedSymbols.push_back(&symbol);
+		sort(sortedSymbols.begin(), sortedSymbols.end(), [](const auto *a, const auto *b)
+			 { return a->second.entry < b->second.entry; });
+
+		for (const auto *symbol : sortedSymbols)
+		{
+			string_view key = symbol->first;
+			const SymbolInfo &info = symbol->second;
+			auto at = key.find('@');
+			buffer << "Entry: " << info.entry
+				   << ", Name: " << key.substr(0, at)
+				   << ", Scope: " << key.substr(at + 1)
+				   << ", Type: " << info.type
+				   << ", First Appearance: Line " << info.firstAppearance
+				   << ", Usage Count: " << info.usageCount;
+			if (!info.value.empty())
+				buffer << ", Value: " << info.value;
+			buffer << '\n';
+		}
+	}
+
+private:
+	pmr::string lookupKey;
+};
+
+// ----------------------------------------------
+// Resource budgets
+// ----------------------------------------------
+// Limits for compiling untrusted input; zero means no limit. Lexer,
+// Parser and Syntax_Analyzer take an optional BudgetMonitor (the parallel
+// symbol pass of --jobs has none, so budgeted compiles run the symbol pass
+// on one thread). The token, node and
+// depth limits are plain comparisons where tokens and nodes are made and
+// where blocks and expressions open. The clock, the memory counter and the
+// cancellation flag are polled every 1024 tokens or nodes and once per
+// top-level statement. Memory is not the live heap: it is every byte the
+// compiling thread allocated since start(), freed blocks included, so it
+// bounds the peak from above and may trip a compile whose peak is far
+// lower. When
+// a limit is hit, the lexer stops and records an Error and the analyzer
+// reports a syntax error. Each returns what it has so far; later phases
+// see exceeded() and stop at once.
+using ResourceBudget = pyc::Budget; // declared in Compiler.h for library users
+
+class BudgetExceeded : public runtime_error
+{
+public:
+	using runtime_error::runtime_error;
+};
+
+class BudgetMonitor
+{
+public:
+	// 'cancel' may be set from another thread to stop the compilation
+	void start(const ResourceBudget &limits, const atomic<bool> *cancel = nullptr)
+	{
+		maxTokens = limits.maxTokens ? limits.maxTokens : SIZE_MAX;
+		maxNodes = limits.maxNodes ? limits.maxNodes : SIZE_MAX;
+		maxDepth = limits.maxDepth ? limits.maxDepth : INT_MAX;
+		maxMemory = limits.maxMemory;
+		deadlineMs = limits.deadlineMs;
+		cancelFlag = cancel;
+		started = chrono::steady_clock::now();
+		deadline = deadlineMs ? started + chrono::milliseconds(deadlineMs) : chrono::steady_clock::time_point::max();
+		startBytes = allocationCounters.bytes;
+		reason.clear();
+	}
+
+	void onToken(size_t tokens)
+	{
+		if (tokens > maxTokens)
+			exceed("more than " + to_string(maxTokens) + " tokens");
+		if ((tokens & 1023) == 0)
+			poll();
+	}
+
+	void onNode(size_t nodes)
+	{
+		if (nodes > maxNodes)
+			exceed("more than " + to_string(maxNodes) + " tree nodes");
+		if ((nodes & 1023) == 0)
+			poll();
+	}
+
+	void onDepth(int depth)
+	{
+		if (depth > maxDepth)
+			exceed("nesting deeper than " + to_string(maxDepth));
+	}
+
+	void poll()
+	{
+		if (!reason.empty())
+			throw BudgetExceeded(reason);
+		if (cancelFlag && cancelFlag->load(memory_order_relaxed))
+			exceed("cancelled");
+		if (maxMemory && allocationCounters.bytes - startBytes > maxMemory)
+			exceed("more than " + to_string(maxMemory) + " bytes allocated");
+		if (chrono::steady_clock::now() > deadline)
+			exceed("deadline of " + to_string(deadlineMs) + " ms passed");
+	}
+
+	bool exceeded() const { return !reason.empty(); }
+	const string &why() const { return reason; }
+
+private:
+	size_t maxTokens = SIZE_MAX, maxNodes = SIZE_MAX;
+	int maxDepth = INT_MAX;
+	uint64_t maxMemory = 0, startBytes = 0;
+	int64_t deadlineMs = 0;
+	const atomic<bool> *cancelFlag = nullptr;
+	chrono::steady_clock::time_point started, deadline = chrono::steady_clock::time_point::max();
+	string reason;
+
+	[[noreturn]] void exceed(const string &what)
+	{
+		reason = "compilation aborted: " + what;
+		throw BudgetExceeded(reason);
+	}
+};
+
+// ----------------------------------------------
+// 6. Lexer (purely lexical analysis)
+// ----------------------------------------------
+class Lexer
+{
+public:
+	unordered_map<string, TokenType> pythonKeywords = {
+		{"False", TokenType::FalseKeyword},
+		{"None", TokenType::NoneKeyword},
+		{"True", TokenType::TrueKeyword},
+		{"and", TokenType::AndKeyword},
+		{"as", TokenType::AsKeyword},
+		{"assert", TokenType::AssertKeyword},
+		{"async", TokenType::AsyncKeyword},
+		{"await", TokenType::AwaitKeyword},
+		{"break", TokenType::BreakKeyword},
+		{"class", TokenType::ClassKeyword},
+		{"continue", TokenType::ContinueKeyword},
+		{"def", TokenType::DefKeyword},
+		{"del", TokenType::DelKeyword},
+		{"elif", TokenType::ElifKeyword},
+		{"else", TokenType::ElseKeyword},
+		{"except", TokenType::ExceptKeyword},
+		{"finally", TokenType::FinallyKeyword},
+		{"for", TokenType::ForKeyword},
+		{"from", TokenType::FromKeyword},
+		{"global", TokenType::GlobalKeyword},
+		{"if", TokenType::IfKeyword},
+		{"import", TokenType::ImportKeyword},
+		{"in", TokenType::InKeyword},
+		{"is", TokenType::IsKeyword},
+		{"lambda", TokenType::LambdaKeyword},
+		{"nonlocal", TokenType::NonlocalKeyword},
+		{"not", TokenType::NotKeyword},
+		{"or", TokenType::OrKeyword},
+		{"pass", TokenType::PassKeyword},
+		{"raise", TokenType::RaiseKeyword},
+		{"return", TokenType::ReturnKeyword},
+		{"try", TokenType::TryKeyword},
+		{"while", TokenType::WhileKeyword},
+		{"with", TokenType::WithKeyword},
+		{"yield", TokenType::YieldKeyword}};
+
+	// Some common single/multi/triple-character operators
+	unordered_set<string> operators = {
+		"+", "-", "*", "/", "%", "//", "**", "=", "==", "!=", "<", "<=", ">",
+		">=", "+=", "-=", "*=", "/=", "%=", "//=", "**=", "|", "&", "^", "~", "<<", ">>"};
+
+	// Common delimiters
+	unordered_map<char, TokenType> punctuationSymbols = {
+		{'(', TokenType::LeftParenthesis},
+		{')', TokenType::RightParenthesis},
+		{':', TokenType::Colon},
+		{',', TokenType::Comma},
+		{'.', TokenType::Dot},
+		{'[', TokenType::LeftBracket},
+		{']', TokenType::RightBracket},
+		{'{', TokenType::LeftBrace},
+		{'}', TokenType::RightBrace},
+		{';', TokenType::Semicolon}};
+
+	vector<ScopeInfo> scopeStack;
+	BudgetMonitor *budget = nullptr; // when set, limits the tokens and the time spent
+
+	// The tokenize() function produces tokens without modifying the symbol table.
+	vector<Token> tokenize(const string &source, vector<Error> &errors);
+
+	// Refills 'tokens' in place: elements already there are overwritten rather
+	// than destroyed, so a caller passing the same vector every time keeps its
+	// capacity and that of each lexeme and scope string.
+	void tokenize(const string &source, vector<Error> &errors, vector<Token> &tokens);
+
+	// Incremental lexing (the REPL): after resetState(), every tokenizeMore
+	// lexes further whole lines of the same program, numbered from
+	// 'firstLine', and appends their tokens. Indentation, def/class scopes
+	// and a trailing backslash carry over from one call to the next.
+	void resetState();
+
+	void tokenizeMore(const string &lines, int firstLine, vector<Error> &errors, vector<Token> &tokens);
+
+	// Closes the open blocks with DEDENTs, as the end of a file does
+	void closeBlocks(int lineNumber, vector<Token> &tokens);
+
+	size_t openBlocks() const { return indentStack.size() - 1; }
+
+private:
+	vector<int> indentStack = {0}; // Track indentation levels (e.g., [0, 4, 8])
+	bool atLineStart = true;	   // Flag for newline handling
+	bool lineContinuation = false; // Track line continuation via '\'
+	int openBrackets = 0;		   // lines inside brackets continue the logical line
+	size_t emitted = 0;			   // tokens written by the current tokenize()
+	string word;				   // scratch for identifiers and numbers
+	string currentScope;		   // scopeStack spelled "inner@outer", or "global"
+
+	// Lexes source[i, end), advancing 'i' and 'lineNumber'
+	void scan(const string &source, size_t &i, int &lineNumber, vector<Error> &errors, vector<Token> &tokens);
+
+	void emit(vector<Token> &tokens, TokenType type, const string &lexeme, int line, const string &scope = string());
+
+	// Writes source[start, start + length) as the next token, reusing the
+	// element (and its strings' storage) left there by an earlier call
+	void emit(vector<Token> &tokens, TokenType type, const string &source, size_t start, size_t length,
+			  int line, const string &scope = string());
+
+	void skipNonLeadingWhitespace(const string &source, size_t &idx);
+
+	// Advances 'idx' past a triple-quoted string starting there; false if none does
+	bool handleTripleQuotedString(const string &source, size_t &idx, int &lineNumber);
+
+	bool isOperatorStart(char c);
+
+	// Advances 'idx' past the string literal starting there
+	void handleDoubleQuotedString(const string &source, size_t &idx, int &lineNumber);
+
+	void processIndentation(const string &source, size_t &i, int lineNumber,
+							vector<Token> &tokens, vector<Error> &errors);
+
+	// Respells currentScope after scopeStack changes, innermost name first
+	void updateScope();
+};
+
+// ----------------------------------------------
+// 7. Parser for basic type inference
+// ----------------------------------------------
+class Parser
+{
+public:
+	Parser(const vector<Token> &tokens, SymbolTable &symTable)
+		: tokens(tokens), symbolTable(symTable) {}
+
+	BudgetMonitor *budget = nullptr; // when set, bounds the nesting of parenthesised operands
+
+	void parse();
+
+	// Runs the pass over tokens[begin, end). Lookahead may still read past
+	// 'end', exactly as it would in a whole-file run.
+	void parse(size_t begin, size_t end);
+
+private:
+private:
+	const vector<Token> &tokens;
+	SymbolTable &symbolTable;
+	string lastKeyword;
+	int depth = 0; // parseExpression calls in progress
+	// Scratch for multiple assignment, kept so a reused Parser stops allocating
+	vector<const Token *> lhsIdentifiers;
+	vector<pair<string, string>> rhsValues;
+	pmr::string fullName;
+
+	// ------------------------------------------------------
+	// parseExpression:
+	// Parses a simple expression with multiple operands, e.g.
+	//   y + 20 + z
+	// We unify the types of each operand as we go.
+	// We'll keep it very basic: no parentheses, no precedence.
+	// We'll return the final type and a single literal value only
+	// if the entire expression is a single literal. Otherwise, "".
+	// ------------------------------------------------------
+	pair<string, string> parseExpression(size_t &i);
+
+	// ------------------------------------------------------
+	// parseOperand:
+	// Returns (type, literalValue) for a single operand,
+	// advancing 'i' by one or more tokens.
+	// This re-uses the same logic from a simplified version
+	// of "inferTypeOfRHS" but for a single operand only.
+	// ------------------------------------------------------
+	pair<string, string> parseOperand(size_t &i);
+
+	// ------------------------------------------------------
+	// unifyTypes:
+	// A minimal "unify" function for numeric/string/bool/unknown.
+	// - if either is "float", result => "float"
+	// - if one is "int" and the other "int", => "int"
+	// - if one is "unknown", => the other (or "unknown" if both unknown)
+	// - if there's a conflict (e.g., "string" + "int"), => "unknown"
+	// Expand this if you want to handle more complex rules
+	// ------------------------------------------------------
+	string unifyTypes(const string &t1, const string &t2);
+};
+
+// ----------------------------------------------
+// Work-stealing thread pool
+// ----------------------------------------------
+class WorkStealingPool
+{
+public:
+	explicit WorkStealingPool(unsigned threadCount)
+	{
+		if (threadCount == 0)
+			threadCount = 1;
+		for (unsigned t = 0; t < threadCount; t++)
+			queues.push_back(make_unique<WorkerQueue>());
+		for (unsigned t = 0; t < threadCount; t++)
+			threads.emplace_back(&WorkStealingPool::run, this, t);
+	}
+
+	~WorkStealingPool()
+	{
+		{
+			lock_guard<mutex> guard(idleLock);
+			stopping = true;
+		}
+		idle.notify_all();
+		for (auto &t : threads)
+			t.join();
+	}
+
+	size_t size() const { return threads.size(); }
+
+	// Tasks submitted from a worker go to that worker's own deque so that
+	// follow-up work stays local; outside submissions are spread round-robin.
+	void submit(function<void()> task)
+	{
+		size_t target;
+		if (currentPool() == this)
+			target = currentWorker();
+		else
+			target = nextQueue.fetch_add(1) % queues.size();
+		{
+			lock_guard<mutex> guard(queues[target]->lock);
+			queues[target]->tasks.push_back(move(task));
+		}
+		{
+			lock_guard<mutex> guard(idleLock);
+			pending++;
+			queued++;
+		}
+		idle.notify_one();
+	}
+
+	// Blocks until every submitted task (including ones submitted by tasks) is done.
+	void wait()
+	{
+		unique_lock<mutex> guard(idleLock);
+		done.wait(guard, [this]
+				  { return pending == 0; });
+	}
+
+private:
+	struct WorkerQueue
+	{
+		deque<function<void()>> tasks;
+		mutex lock;
+	};
+
+	vector<unique_ptr<WorkerQueue>> queues;
+	vector<thread> threads;
+	mutex idleLock;
+	condition_variable idle, done;
+	size_t pending = 0;
+	atomic<size_t> queued{0};
+	atomic<size_t> nextQueue{0};
+	bool stopping = false;
+
+	static WorkStealingPool *&currentPool()
+	{
+		static thread_local WorkStealingPool *pool = nullptr;
+		return pool;
+	}
+
+	static size_t &currentWorker()
+	{
+		static thread_local size_t index = 0;
+		return index;
+	}
+
+	// Own work is taken LIFO (hot in cache), stolen work FIFO (oldest, usually biggest).
+	bool takeTask(size_t self, function<void()> &task)
+	{
+		{
+			WorkerQueue &own = *queues[self];
+			lock_guard<mutex> guard(own.lock);
+			if (!own.tasks.empty())
+			{
+				task = move(own.tasks.back());
+				own.tasks.pop_back();
+				return true;
+			}
+		}
+		for (size_t k = 1; k < queues.size(); k++)
+		{
+			WorkerQueue &victim = *queues[(self + k) % queues.size()];
+			lock_guard<mutex> guard(victim.lock);
+			if (!victim.tasks.empty())
+			{
+				task = move(victim.tasks.front());
+				victim.tasks.pop_front();
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void run(size_t self)
+	{
+		currentPool() = this;
+		currentWorker() = self;
+		while (true)
+		{
+			function<void()> task;
+			if (takeTask(self, task))
+			{
+				queued--;
+				task();
+				lock_guard<mutex> guard(idleLock);
+				if (--pending == 0)
+					done.notify_all();
+				continue;
+			}
+			unique_lock<mutex> guard(idleLock);
+			idle.wait(guard, [this]
+					  { return stopping || queued > 0; });
+			if (stopping && queued == 0)
+				return;
+		}
+	}
+};
+
+// ----------------------------------------------
+// Parallel semantic pass
+// ----------------------------------------------
+
+void parallelParse(const vector<Token> &tokens, SymbolTable &symTable, unsigned jobs);
+
+// ----------------------------------------------
+// Syntax_Analyzer
+// ----------------------------------------------
+
+std::string tokenTypeToString(TokenType type);
+
+class ParseTreeNode
+{
+public:
+	string label;
+	vector<ParseTreeNode *> children;
+	Token token; // For leaf nodes
+	string folded; // Constant value of an expression, set by ConstantFolder
+
+	ParseTreeNode(string lbl) : label(move(lbl)) {}
+	void addChild(ParseTreeNode *child)
+	{
+		PYC_ALLOC_SITE(TreeNodes);
+		children.push_back(child);
+	}
+};
+
+// Owns the nodes of the trees built through it. reset() hands the same
+// nodes out again instead of freeing them, so their labels and child lists
+// keep their storage from one compilation to the next.
+class ParseTreeArena
+{
+public:
+	ParseTreeArena() = default;
+	ParseTreeArena(const ParseTreeArena &) = delete;
+	ParseTreeArena &operator=(const ParseTreeArena &) = delete;
+
+	~ParseTreeArena()
+	{
+		for (ParseTreeNode *node : nodes)
+			delete node;
+	}
+
+	ParseTreeNode *make(string_view label)
+	{
+		if (used == nodes.size())
+			nodes.push_back(new ParseTreeNode(string(label)));
+		else
+		{
+			ParseTreeNode *node = nodes[used];
+			node->label.assign(label.data(), label.size());
+			node->children.clear();
+			node->folded.clear();
+		}
+		return nodes[used++];
+	}
+
+	void reset() { used = 0; }
+	size_t size() const { return used; }
+
+private:
+	vector<ParseTreeNode *> nodes;
+	size_t used = 0;
+};
+
+class Syntax_Analyzer
+{
+private:
+	size_t current = 0;
+
+	const Token &currentToken() const { return tokens[current]; }
+	vector<ParseTreeNode *> pending; // nodes parsed before their parent list is complete
+
+	ParseTreeNode *makeNode(string_view label);
+
+	size_t nodesMade = 0; // by the current parseProgram, for the budget
+	int depth = 0;		  // blocks and expressions being parsed
+
+	// Counts one level of nesting while a block or expression is parsed
+	struct NestingScope
+	{
+		Syntax_Analyzer &analyzer;
+		explicit NestingScope(Syntax_Analyzer &owner) : analyzer(owner)
+		{
+			analyzer.depth++;
+			if (analyzer.budget)
+				analyzer.budget->onDepth(analyzer.depth);
+		}
+		~NestingScope() { analyzer.depth--; }
+	};
+
+public:
+	vector<Token> tokens;
+	int errorCount = 0;
+	ostream *diagnostics = &cerr;
+	bool appendErrorLog = true; // also append errors to syntax_errors.txt
+	ParseTreeArena *arena = nullptr; // when set, nodes belong to the arena, not the caller
+	BudgetMonitor *budget = nullptr; // when set, parseProgram stops once it runs out
+
+	void error(const string &message);
+
+	const Token &consume(TokenType expected);
+
+	void synchronize(int lineNumber);
+
+	Token &peekToken();
+
+	ParseTreeNode *parseProgram();
+
+	ParseTreeNode *parseFunction();
+
+	ParseTreeNode *parseParameters();
+
+	ParseTreeNode *parseParameter();
+
+	ParseTreeNode *parseStatement();
+
+	ParseTreeNode *parseReturn();
+
+	ParseTreeNode *parsePass();
+
+	ParseTreeNode *parseBreak();
+
+	ParseTreeNode *parseContinue();
+
+	ParseTreeNode *parseClassBlock();
+
+	ParseTreeNode *parseBlock();
+
+	ParseTreeNode *parseWhileStmt();
+
+	ParseTreeNode *parseForStmt();
+
+	ParseTreeNode *parseImport();
+
+	ParseTreeNode *parseDottedName();
+
+	ParseTreeNode *parseRaise();
+
+	ParseTreeNode *parseTryStmt();
+
+	ParseTreeNode *parseClassDef();
+
+	ParseTreeNode *parseConditionalStmt();
+
+	ParseTreeNode *parseAssignmentStmt();
+
+	ParseTreeNode *parseAssignOp();
+
+	ParseTreeNode *parseFunctionCall();
+
+	ParseTreeNode *parseExpression();
+
+	ParseTreeNode *parseOrExpr();
+
+	ParseTreeNode *parseAndExpr();
+
+	ParseTreeNode *parseNotExpr();
+
+	ParseTreeNode *parseComparison();
+
+	ParseTreeNode *parseOp();
+
+	ParseTreeNode *parseArithmetic();
+
+	ParseTreeNode *parseTerm();
+
+	ParseTreeNode *parseArguments();
+
+	ParseTreeNode *parseFactor();
+};
+
+// ----------------------------------------------
+// Constant folding and propagation
+// ----------------------------------------------
+enum class LeafKind
+{
+	Number,
+	String,
+	True,
+	False,
+	None,
+	Name,
+	Other
+};
+
+LeafKind classifyLeaf(const string &lexeme);
+
+// Formats a float the way Python's repr() does: the shortest digits that
+// read back to the same value, in fixed notation unless the decimal exponent
+// is below -4 or at least 16 (20.0, 1234567890.0, 1e-05, 1e+16).
+string formatFloat(double d);
+
+struct ConstValue
+{
+	enum class Kind
+	{
+		None,
+		Bool,
+		Int,
+		Float,
+		Str,
+		Tuple
+	};
+
+	Kind kind = Kind::None;
+	long long i = 0; // Int and Bool
+	double f = 0;
+	string s;
+	vector<ConstValue> items;
+
+	static ConstValue makeBool(bool b)
+	{
+		ConstValue v;
+		v.kind = Kind::Bool;
+		v.i = b;
+		return v;
+	}
+	static ConstValue makeInt(long long n)
+	{
+		ConstValue v;
+		v.kind = Kind::Int;
+		v.i = n;
+		return v;
+	}
+	static ConstValue makeFloat(double d)
+	{
+		ConstValue v;
+		v.kind = Kind::Float;
+		v.f = d;
+		return v;
+	}
+	static ConstValue makeStr(string str)
+	{
+		ConstValue v;
+		v.kind = Kind::Str;
+		v.s = move(str);
+		return v;
+	}
+
+	bool isIntLike() const { return kind == Kind::Int || kind == Kind::Bool; }
+	bool isNumber() const { return isIntLike() || kind == Kind::Float; }
+	double asDouble() const { return kind == Kind::Float ? f : static_cast<double>(i); }
+
+	bool truthy() const
+	{
+		switch (kind)
+		{
+		case Kind::None:
+			return false;
+		case Kind::Bool:
+		case Kind::Int:
+			return i != 0;
+		case Kind::Float:
+			return f != 0.0;
+		case Kind::Str:
+			return !s.empty();
+		case Kind::Tuple:
+			return !items.empty();
+		}
+		return false;
+	}
+
+	// Same names the Parser uses for inferred types
+	string typeName() const
+	{
+		switch (kind)
+		{
+		case Kind::Bool:
+			return "bool";
+		case Kind::Int:
+			return "int";
+		case Kind::Float:
+			return "float";
+		case Kind::Str:
+			return "string";
+		case Kind::Tuple:
+			return "tuple";
+		default:
+			return "unknown";
+		}
+	}
+
+	string repr() const
+	{
+		switch (kind)
+		{
+		case Kind::None:
+			return "None";
+		case Kind::Bool:
+			return i ? "True" : "False";
+		case Kind::Int:
+			return to_string(i);
+		case Kind::Float:
+			return formatFloat(f);
+		case Kind::Str:
+		{
+			string out = "\"";
+			for (char c : s)
+			{
+				if (c == '"' || c == '\\')
+					out += '\\';
+				if (c == '\n')
+					out += "\\n";
+				else
+					out += c;
+			}
+			return out + "\"";
+		}
+		case Kind::Tuple:
+		{
+			string out = "(";
+			for (size_t k = 0; k < items.size(); k++)
+				out += (k ? ", " : "") + items[k].repr();
+			return out + (items.size() == 1 ? ",)" : ")");
+		}
+		}
+		return "";
+	}
+
+	// Python '==' between two constants
+	bool equals(const ConstValue &other) const
+	{
+		if (isNumber() && other.isNumber())
+		{
+			if (isIntLike() && other.isIntLike())
+				return i == other.i;
+			return asDouble() == other.asDouble();
+		}
+		if (kind != other.kind)
+			return false;
+		if (kind == Kind::Str)
+			return s == other.s;
+		if (kind == Kind::Tuple)
+		{
+			if (items.size() != other.items.size())
+				return false;
+			for (size_t k = 0; k < items.size(); k++)
+				if (!items[k].equals(other.items[k]))
+					return false;
+			return true;
+		}
+		return true; // None == None
+	}
+
+	// Exact identity used when merging control-flow paths (1 and 1.0 differ)
+	bool sameAs(const ConstValue &other) const
+	{
+		return kind == other.kind && repr() == other.repr();
+	}
+};
+
+bool parseLiteral(const string &lexeme, ConstValue &out);
+
+// Value of an expression that is a literal, or was folded to one
+bool literalOf(const ParseTreeNode *node, ConstValue &out);
+
+// Truth of a condition known before run time, so that a backend can drop a
+// branch that never runs or the test of a loop that never ends
+bool foldedTruth(const ParseTreeNode *cond, bool &truth);
+
+// Operator of one link of a comparison node, e.g. "<", "not in" or "is not";
+// empty when the link has none. In a chain a < b < c, b is evaluated once and
+// evaluation stops at the first false link; the bit operators that share the
+// node apply to the running left operand instead.
+string comparisonOperator(const ParseTreeNode *link);
+
+bool isComparisonOperator(const string &op);
+
+// An assignment split into its targets, its value expressions and its
+// operator ("=" or augmented, e.g. "+="). With several targets every value is
+// evaluated before any target is bound, so that x, y = y, x swaps.
+struct AssignmentParts
+{
+	vector<ParseTreeNode *> targets, values;
+	string op;
+};
+
+AssignmentParts splitAssignment(const ParseTreeNode *node);
+
+// What an import statement binds. For "import a.b" and "import a.b as m"
+// 'from' is empty and each source is a module path; without an alias
+// "import a.b" binds the top-level package "a". For "from a import b as c"
+// 'from' names the module and each source is an attribute of it.
+struct ImportParts
+{
+	string from;
+	vector<pair<string, string>> bindings; // (source, name bound)
+	bool star = false;					   // from ... import *
+};
+
+ImportParts splitImport(const ParseTreeNode *node);
+
+// Names bound by a statement list, without entering nested def/class bodies
+void collectBoundNames(const ParseTreeNode *node, unordered_set<string> &names);
+
+// Walks the tree in program order with an environment of variables whose
+// value is known at that point. Loops and try statements kill every name
+// they bind; if/elif/else keep only the names that agree on all paths.
+// Function and class bodies start from an empty environment. Every
+// "expression" node that evaluates to a constant gets ParseTreeNode::folded,
+// and names every binding of which folds to the same constant get
+// SymbolInfo::value. A name last bound to an expression that does not fold
+// loses the value and type the Parser took from its first operand, e.g. 5
+// for "5 % 0". A name bound to different values keeps no value, whatever
+// the Parser saw last, and keeps a type only if all its values share one.
+class ConstantFolder
+{
+public:
+	explicit ConstantFolder(SymbolTable &symTable) : symbolTable(symTable) {}
+
+	using Env = unordered_map<string, ConstValue>;
+
+	size_t foldedExpressions = 0;
+
+	void run(ParseTreeNode *program);
+
+	// Starts from the module-level values in 'env' and leaves there those
+	// known at the end, so that code compiled one piece at a time (the REPL)
+	// folds each piece as if it followed the ones before
+	void run(ParseTreeNode *program, Env &env);
+
+private:
+	struct Binding
+	{
+		int count = 0;
+		int folded = 0; // bindings to a constant
+		bool known = false;
+		bool stale = false;	   // last bound to an expression that does not fold
+		bool agree = true;	   // every constant so far is the same value
+		bool sameType = true; // every constant so far has the same type
+		ConstValue value;
+	};
+
+	SymbolTable &symbolTable;
+	vector<string> scopeNames; // innermost last
+	unordered_map<string, Binding> bindings;
+
+	// Same "inner@outer" spelling the Lexer gives token scopes
+	string currentScope() const;
+
+	Binding &bind(const string &name, const ConstValue *value, Env &env);
+
+	static bool isLeaf(const ParseTreeNode *node) { return node->children.empty(); }
+
+	// A lone literal needs no folding; only computed values are recorded
+	static bool isPlainLiteral(const ParseTreeNode *node);
+
+	// A lone list, dict or set display, which the Parser records in full
+	static bool isDisplay(const ParseTreeNode *node);
+
+	void killNames(const ParseTreeNode *node, Env &env);
+
+	static Env intersect(const vector<Env> &paths);
+
+	// program, block and class_block all hold a flat list of statements
+	void foldStatements(ParseTreeNode *list, Env &env);
+
+	void foldStatement(ParseTreeNode *node, Env &env);
+
+	void foldAssignment(ParseTreeNode *node, Env &env);
+
+	void foldConditional(ParseTreeNode *node, Env &env);
+
+	void foldTry(ParseTreeNode *node, Env &env);
+
+	void foldFunction(ParseTreeNode *node, Env &env);
+
+	// Returns true and fills *out when 'node' is a constant. Sub-expressions
+	// are always visited so nested constants get folded too.
+	bool foldExpr(ParseTreeNode *node, Env &env, ConstValue *out = nullptr);
+
+	bool foldFactor(ParseTreeNode *node, Env &env, ConstValue &value);
+};
+
+// Token listing of the default mode: type, symbol table entry or lexeme, line
+void printTokens(const vector<Token> &tokens, const SymbolTable &symTable, ostream &out = cout);
+
+// One "|- label" line per node, two spaces of indentation per level, with
+// " = value" after folded expressions when 'showFolded' is set (--show-folded).
+// Walks with an explicit stack, so deep trees cannot overflow the call stack.
+void printParseTree(const ParseTreeNode *node, int depth = 0, ostream &out = cout, bool showFolded = false);
+
+// Frees a tree built by Syntax_Analyzer, without recursing on deep trees
+void deleteTree(ParseTreeNode *root);
+
+// Nodes in a tree, without recursing on deep trees
+size_t countNodes(const ParseTreeNode *root);
+
+// ----------------------------------------------
+// Tree passes
+// ----------------------------------------------
+// Analyses of the parse tree derive from TreePass and overload enter and
+// leave for the node kinds they look at:
+//
+//   struct Returns : TreePass<Returns>
+//   {
+//       size_t returns = 0;
+//       void enter(KindTag<NodeKind::ReturnStatement>, const ParseTreeNode *, int) { returns++; }
+//   };
+//
+// runTreePasses(root, a, b, c) makes one walk with an explicit stack for
+// all of them: each label is classified once, and the handlers of every
+// pass for that kind are called from one switch, resolved at compile time.
+// Kinds that no pass handles cost only the switch. A handler templated on
+// the kind sees every node. pass.run(root) is the same walk for one pass.
+
+#define NODE_KINDS(X)                                \
+	X(Program, "program")                            \
+	X(Statement, "statement")                        \
+	X(Block, "block")                                \
+	X(Function, "function")                          \
+	X(Parameters, "parameters")                      \
+	X(Parameter, "parameter")                        \
+	X(ClassDef, "class_def")                         \
+	X(ClassBlock, "class_block")                     \
+	X(Assignment, "assignment")                      \
+	X(Lhs, "lhs")                                    \
+	X(Rhs, "rhs")                                    \
+	X(AssignOp, "Assign_OP")                         \
+	X(AugmentedOp, "OP")                             \
+	X(ConditionalStatement, "conditional_statement") \
+	X(ElifClause, "elif_clause")                     \
+	X(ElseClause, "else_clause")                     \
+	X(ForStatement, "for_statement")                 \
+	X(WhileStatement, "while_statement")             \
+	X(TryStatement, "try_statement")                 \
+	X(ExceptClause, "except_clause")                 \
+	X(FinallyClause, "finally_clause")               \
+	X(ReturnStatement, "return_statement")           \
+	X(BreakStatement, "break_statement")             \
+	X(ContinueStatement, "continue_statement")       \
+	X(PassStatement, "pass_statement")               \
+	X(RaiseStatement, "raise_statement")             \
+	X(ImportStatement, "import_statement")           \
+	X(Expression, "expression")                      \
+	X(OrExpression, "or_expression")                 \
+	X(AndExpression, "and_expression")               \
+	X(NotExpression, "not_expression")               \
+	X(Comparison, "comparison")                      \
+	X(Arithmetic, "arithmetic")                      \
+	X(Term, "term")                                  \
+	X(Factor, "factor")                              \
+	X(FunctionCall, "function_call")                 \
+	X(Arguments, "arguments")                        \
+	X(DottedName, "dotted_name")                     \
+	X(TupleOrGroup, "tuple_or_group")                \
+	X(ListLiteral, "list_literal")                   \
+	X(DictLiteral, "dict_literal")                   \
+	X(SetLiteral, "set_literal")
+
+enum class NodeKind : uint8_t
+{
+	Leaf,
+#define X(name, label) name,
+	NODE_KINDS(X)
+#undef X
+	Count
+};
+
+const string_view nodeKindNames[] = {
+	"leaf",
+#define X(name, label) label,
+	NODE_KINDS(X)
+#undef X
+};
+
+// Nodes without children are leaves whatever their label: a lexeme can
+// spell a rule name (a variable called 'term'). Rules the parser left
+// empty, such as the parameters of 'def f()', therefore count as leaves.
+NodeKind nodeKindOf(const ParseTreeNode *node);
+
+template <NodeKind K>
+using KindTag = integral_constant<NodeKind, K>;
+
+// Whether Pass has an enter/leave overload that accepts kind K
+template <class Pass, NodeKind K, class = void>
+struct EntersKind : false_type
+{
+};
+template <class Pass, NodeKind K>
+struct EntersKind<Pass, K, void_t<decltype(declval<Pass &>().enter(KindTag<K>{}, (const ParseTreeNode *)nullptr, 0))>> : true_type
+{
+};
+template <class Pass, NodeKind K, class = void>
+struct LeavesKind : false_type
+{
+};
+template <class Pass, NodeKind K>
+struct LeavesKind<Pass, K, void_t<decltype(declval<Pass &>().leave(KindTag<K>{}, (const ParseTreeNode *)nullptr, 0))>> : true_type
+{
+};
+
+template <NodeKind K, bool Leaving, class... Passes>
+inline void visitKind(const ParseTreeNode *node, int depth, Passes &...passes)
+{
+	auto one = [&](auto &pass)
+	{
+		using Pass = remove_reference_t<decltype(pass)>;
+		if constexpr (Leaving && LeavesKind<Pass, K>::value)
+			pass.leave(KindTag<K>{}, node, depth);
+		else if constexpr (!Leaving && EntersKind<Pass, K>::value)
+			pass.enter(KindTag<K>{}, node, depth);
+	};
+	(one(passes), ...);
+}
+
+template <bool Leaving, class... Passes>
+inline void visitNode(NodeKind kind, const ParseTreeNode *node, int depth, Passes &...passes)
+{
+	switch (kind)
+	{
+	case NodeKind::Leaf:
+		visitKind<NodeKind::Leaf, Leaving>(node, depth, passes...);
+		break;
+#define X(name, label)                                           \
+	case NodeKind::name:                                         \
+		visitKind<NodeKind::name, Leaving>(node, depth, passes...); \
+		break;
+		NODE_KINDS(X)
+#undef X
+	default:
+		break;
+	}
+}
+
+// One preorder walk: enter on the way down, leave once all children are done
+template <class... Passes>
+void runTreePasses(const ParseTreeNode *root, Passes &...passes)
+{
+	struct Frame
+	{
+		const ParseTreeNode *node;
+		NodeKind kind;
+		int depth;
+		size_t next; // child to visit next
+	};
+	if (!root)
+		return;
+	vector<Frame> stack;
+	auto open = [&](const ParseTreeNode *node, int depth)
+	{
+		NodeKind kind = nodeKindOf(node);
+		visitNode<false>(kind, node, depth, passes...);
+		stack.push_back({node, kind, depth, 0});
+	};
+	open(root, 0);
+	while (!stack.empty())
+	{
+		Frame &top = stack.back();
+		if (top.next < top.node->children.size())
+		{
+			const ParseTreeNode *child = top.node->children[top.next++];
+			if (child)
+				open(child, top.depth + 1);
+		}
+		else
+		{
+			visitNode<true>(top.kind, top.node, top.depth, passes...);
+			stack.pop_back();
+		}
+	}
+}
+
+template <class Derived>
+class TreePass
+{
+public:
+	void run(const ParseTreeNode *root) { runTreePasses(root, static_cast<Derived &>(*this)); }
+};
+
+// Node, leaf and depth counts
+struct TreeShapePass : TreePass<TreeShapePass>
+{
+	size_t nodes = 0, leaves = 0;
+	int maxDepth = 0;
+
+	template <NodeKind K>
+	void enter(KindTag<K>, const ParseTreeNode *, int depth)
+	{
+		nodes++;
+		leaves += K == NodeKind::Leaf;
+		maxDepth = max(maxDepth, depth);
+	}
+
+	void describe(string &out) const
+	{
+		out += "nodes: " + to_string(nodes) + " (" + to_string(leaves) + " leaves), depth " + to_string(maxDepth) + '\n';
+	}
+};
+
+// Occurrences of each node kind
+struct KindHistogramPass : TreePass<KindHistogramPass>
+{
+	size_t counts[size_t(NodeKind::Count)] = {};
+
+	template <NodeKind K>
+	void enter(KindTag<K>, const ParseTreeNode *, int) { counts[size_t(K)]++; }
+
+	void describe(string &out) const
+	{
+		out += "kinds:";
+		for (size_t k = 0; k < size(counts); k++)
+			if (counts[k])
+				out += ' ' + string(nodeKindNames[k]) + '=' + to_string(counts[k]);
+		out += '\n';
+	}
+};
+
+// Functions, classes and parameters; nesting counts a def or class
+// inside another one
+struct DefinitionPass : TreePass<DefinitionPass>
+{
+	size_t functions = 0, classes = 0, parameters = 0;
+	int open = 0, maxNesting = 0;
+
+	void enter(KindTag<NodeKind::Function>, const ParseTreeNode *, int)
+	{
+		functions++;
+		maxNesting = max(maxNesting, ++open);
+	}
+	void leave(KindTag<NodeKind::Function>, const ParseTreeNode *, int) { open--; }
+	void enter(KindTag<NodeKind::ClassDef>, const ParseTreeNode *, int)
+	{
+		classes++;
+		maxNesting = max(maxNesting, ++open);
+	}
+	void leave(KindTag<NodeKind::ClassDef>, const ParseTreeNode *, int) { open--; }
+	void enter(KindTag<NodeKind::Parameter>, const ParseTreeNode *, int) { parameters++; }
+
+	void describe(string &out) const
+	{
+		out += "definitions: " + to_string(functions) + " functions, " + to_string(classes) + " classes, " +
+			   to_string(parameters) + " parameters, nesting " + to_string(maxNesting) + '\n';
+	}
+};
+
+// Calls in expressions (a factor whose second child is '(') and call
+// statements, with the number of arguments passed
+struct CallSitePass : TreePass<CallSitePass>
+{
+	size_t calls = 0, arguments = 0;
+
+	void enter(KindTag<NodeKind::Factor>, const ParseTreeNode *node, int)
+	{
+		if (node->children.size() >= 3 && node->children[1]->label == "(")
+			calls++;
+	}
+	void enter(KindTag<NodeKind::FunctionCall>, const ParseTreeNode *, int) { calls++; }
+	void enter(KindTag<NodeKind::Arguments>, const ParseTreeNode *node, int)
+	{
+		for (const ParseTreeNode *child : node->children)
+			arguments += child->label == "expression";
+	}
+
+	void describe(string &out) const
+	{
+		out += "calls: " + to_string(calls) + " with " + to_string(arguments) + " arguments\n";
+	}
+};
+
+// Loop nesting, and break/continue with no enclosing loop in their own
+// function (the syntax analyzer accepts those)
+struct LoopPass : TreePass<LoopPass>
+{
+	size_t loops = 0, strayJumps = 0;
+	int maxNesting = 0;
+	vector<int> nesting = {0}; // loops open in each enclosing function
+
+	void enter(KindTag<NodeKind::ForStatement>, const ParseTreeNode *, int) { open(); }
+	void leave(KindTag<NodeKind::ForStatement>, const ParseTreeNode *, int) { nesting.back()--; }
+	void enter(KindTag<NodeKind::WhileStatement>, const ParseTreeNode *, int) { open(); }
+	void leave(KindTag<NodeKind::WhileStatement>, const ParseTreeNode *, int) { nesting.back()--; }
+	void enter(KindTag<NodeKind::Function>, const ParseTreeNode *, int) { nesting.push_back(0); }
+	void leave(KindTag<NodeKind::Function>, const ParseTreeNode *, int) { nesting.pop_back(); }
+	void enter(KindTag<NodeKind::BreakStatement>, const ParseTreeNode *, int) { strayJumps += nesting.back() == 0; }
+	void enter(KindTag<NodeKind::ContinueStatement>, const ParseTreeNode *, int) { strayJumps += nesting.back() == 0; }
+
+	void open()
+	{
+		loops++;
+		maxNesting = max(maxNesting, ++nesting.back());
+	}
+
+	void describe(string &out) const
+	{
+		out += "loops: " + to_string(loops) + ", nesting " + to_string(maxNesting) + ", " + to_string(strayJumps) +
+			   " break/continue outside a loop\n";
+	}
+};
+
+// Subtrees ConstantFolder gave a value, and literal leaves
+struct ConstantPass : TreePass<ConstantPass>
+{
+	size_t folded = 0, literals = 0;
+
+	template <NodeKind K>
+	void enter(KindTag<K>, const ParseTreeNode *node, int)
+	{
+		if constexpr (K == NodeKind::Leaf)
+		{
+			char first = node->label.empty() ? 0 : node->label[0];
+			literals += isdigit((unsigned char)first) || first == '"' || first == '\'';
+		}
+		folded += !node->folded.empty();
+	}
+
+	void describe(string &out) const
+	{
+		out += "constants: " + to_string(folded) + " folded subtrees, " + to_string(literals) + " literals\n";
+	}
+};
+
+// --tree-stats: all of the above in one walk
+void printTreeStats(const ParseTreeNode *root, ostream &out = cout);
+
+// ----------------------------------------------
+// Subtree sharing
+// ----------------------------------------------
+
+struct SharingReport
+{
+	size_t nodes = 0;  // in the tree as parsed
+	size_t unique = 0; // left in the DAG
+	uint64_t bytesBefore = 0, bytesAfter = 0;
+};
+
+// Returns the new root. The 'report' sizes count every node the DAG
+// still owns once.
+ParseTreeNode *shareSubtrees(ParseTreeNode *root, SharingReport *report = nullptr);
+
+// Frees a tree that went through shareSubtrees, each node once
+void deleteSharedTree(ParseTreeNode *root);
+
+void printSharingReport(const SharingReport &report, ostream &out);
+
+// ----------------------------------------------
+// 8. Utility function to read the entire file
+// ----------------------------------------------
+string readFile(const string &filename);
+
+// Part of a tree to export: the subtree under the node numbered 'root' in
+// preorder (the ids of --tree dumps), between 'minDepth' and 'maxDepth'
+// levels below it. Nodes keep their preorder numbers in every range.
+struct DotRange
+{
+	size_t root = 0;
+	int minDepth = 0;
+	int maxDepth = INT_MAX;
+};
+
+// Export the full tree, or 'range' of it, to a DOT file. A range that
+// selects no node is an error rather than an empty digraph. The file is
+// written next to 'filename' and renamed over it once complete, so an error
+// leaves the previous export in place.
+void saveTreeToDot(const ParseTreeNode *root, const string &filename, const DotRange &range = {});
+
+// ----------------------------------------------
+// Compiler sessions
+// ----------------------------------------------
+// CompilerSession runs the front end as a library call: compile() lexes,
+// builds the symbol table and parses one source without printing anything
+// or touching files. The session keeps every buffer it used - the source
+// copy, token strings, tree nodes, symbol table nodes - and reuses them on
+// the next call, so once it has seen inputs of a given size it allocates
+// almost nothing. Constant folding is optional because it copies its
+// environments per branch and still allocates on every call.
+
+// Views into the session; valid until the next compile() or reset()
+struct CompileResult
+{
+	const vector<Token> &tokens;
+	const vector<Error> &lexErrors;
+	const SymbolTable &symbols;
+	const ParseTreeNode *tree;
+	int syntaxErrors;
+	const string &diagnostics; // syntax error lines, as printed by the CLI
+	bool aborted = false;	   // a ResourceBudget ran out; the rest is partial
+};
+
+class CompilerSession
+{
+public:
+	explicit CompilerSession(bool foldConstants = false) : fold(foldConstants)
+	{
+		analyzer.diagnostics = &diagnosticsStream;
+		analyzer.appendErrorLog = false;
+		analyzer.arena = &arena;
+	}
+
+	CompilerSession(const CompilerSession &) = delete;
+	CompilerSession &operator=(const CompilerSession &) = delete;
+
+	// Rebuilds a result from a front-end cache image instead of compiling it
+	CompileResult restore(string_view image);
+
+	// Limits every later compile(); 'cancel' may stop one from another thread
+	void setBudget(const ResourceBudget &limits, const atomic<bool> *cancel = nullptr)
+	{
+		if (limits.maxMemory && !allocationHooks)
+			throw runtime_error("a memory limit needs the allocation hooks (libpyc.a built with ALLOCATION_HOOKS=1)");
+		budget = limits;
+		cancelFlag = cancel;
+		monitor = BudgetMonitor();
+		bool on = limits.maxTokens || limits.maxDepth || limits.maxNodes || limits.maxMemory || limits.deadlineMs || cancel;
+		lexer.budget = on ? &monitor : nullptr;
+		parser.budget = on ? &monitor : nullptr;
+		analyzer.budget = on ? &monitor : nullptr;
+	}
+
+	// Which limit the last compile() ran into; empty unless it was aborted
+	const string &abortReason() const { return monitor.why(); }
+
+	CompileResult compile(string_view text)
+	{
+		reset();
+		if (analyzer.budget)
+			monitor.start(budget, cancelFlag);
+		source.assign(text.data(), text.size());
+		lexer.tokenize(source, errors, analyzer.tokens);
+		// The symbol pass has no checks of its own, so it is skipped after an abort
+		if (!monitor.exceeded())
+			parser.parse();
+		root = analyzer.parseProgram();
+		if (fold && !monitor.exceeded())
+		{
+			ConstantFolder folder(symbols);
+			folder.run(root);
+		}
+		if (analyzer.errorCount > 0)
+			diagnosticsText = diagnosticsStream.str();
+		return {analyzer.tokens, errors, symbols, root, analyzer.errorCount, diagnosticsText, monitor.exceeded()};
+	}
+
+	// Drops the last result but keeps the storage behind it
+	void reset()
+	{
+		errors.clear();
+		symbols.clear();
+		arena.reset();
+		diagnosticsStream.str("");
+		diagnosticsText.clear();
+		root = nullptr;
+	}
+
+private:
+	bool fold;
+	string source;
+	Lexer lexer;
+	vector<Error> errors;
+	pmr::unsynchronized_pool_resource symbolMemory;
+	SymbolTable symbols{&symbolMemory};
+	Syntax_Analyzer analyzer; // owns the token buffer the Parser reads
+	Parser parser{analyzer.tokens, symbols};
+	ParseTreeArena arena;
+	ostringstream diagnosticsStream;
+	string diagnosticsText;
+	ParseTreeNode *root = nullptr;
+	ResourceBudget budget;
+	const atomic<bool> *cancelFlag = nullptr;
+	BudgetMonitor monitor;
+};
+
+// Calls a session needs to size its buffers for the sources it sees; after
+// them a session without folding allocates nothing
+const size_t sessionWarmUpCalls = 100;
+
+// ----------------------------------------------
+// JSON replies
+// ----------------------------------------------
+
+void appendJsonString(string &out, string_view s);
+
+// Writes the reply object for one compilation into 'out'
+void compileToJson(const CompileResult &result, string &out);
+} // namespace pyc::detail
+
+#endif
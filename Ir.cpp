@@ -0,0 +1,1893 @@
+#include "Engines.h"
+#include <map>
+
+namespace pyc::detail
+{
+// ----------------------------------------------
+// SSA IR
+// ----------------------------------------------
+// Functions lowered from the Syntax_Analyzer tree to basic blocks of SSA
+// values. Construction follows Braun et al., "Simple and Efficient
+// Construction of Static Single Assignment Form": a variable read looks
+// up its definition block by block and a phi is only created where the
+// read meets a join, so one walk over the tree builds pruned SSA in time
+// linear in its size. Names a def binds are its variables; every other
+// name, and every name at module level, is a global load or store.
+//
+// In a try body, each instruction that can raise ends its block. The
+// block then gets an extra edge to the handler, so phis in the handler
+// see the variables as they were when the exception left.
+
+enum class IrOp : uint8_t
+{
+	Undef,		  // a local read on a path that never assigned it
+	Param,		  // text is the parameter name
+	Const,		  // text is the literal
+	Copy,		  // text is the variable assigned, if any
+	Phi,		  // one argument per predecessor, in the same order
+	LoadGlobal,	  // text is the name
+	StoreGlobal,  // text is the name
+	Binary,		  // text is the operator
+	Unary,		  // text is the operator
+	Compare,	  // text is the operator
+	Not,
+	Call,		  // callee, arguments...
+	CallMethod,	  // text is the method; receiver, arguments...
+	GetAttr,	  // text is the attribute
+	SetAttr,	  // text is the attribute; object, value
+	BuildTuple,
+	BuildList,
+	BuildSet,
+	BuildDict,	  // key, value, key, value...
+	MakeFunction, // text is the IR function; default values...
+	MakeClass,	  // text is the class name; base, if any
+	Import,		  // text is the module path
+	Iter,
+	Caught,		  // the exception that entered this handler
+	ExcMatch,	  // exception, class
+	// Terminators: the last instruction of every block
+	Jump,		  // to succs[0]
+	Branch,		  // on the truth of args[0], to succs[0] or succs[1]
+	ForNext,	  // next item of args[0] to succs[0], or succs[1] when exhausted
+	Return,
+	Raise
+};
+
+static const char *const irOpNames[] = {
+	"undef", "param", "const", "copy", "phi", "loadglobal", "storeglobal", "binary", "unary", "compare",
+	"not", "call", "callmethod", "getattr", "setattr", "tuple", "list", "set", "dict", "function", "class",
+	"import", "iter", "caught", "excmatch", "jump", "branch", "fornext", "return", "raise"};
+
+struct IrInstr
+{
+	IrOp op;
+	int block = -1; // -1 once removed
+	string text;
+	vector<int> args;
+};
+
+struct IrBlock
+{
+	vector<int> phis, code;	  // the terminator is code.back()
+	vector<int> preds, succs; // successors of the terminator, then the handler
+	int handler = -1;		  // block an exception raised here goes to
+	bool sealed = false;	  // all predecessors known
+	bool live = true;
+};
+
+struct IrFunction
+{
+	string name;
+	vector<string> params;
+	vector<IrInstr> values; // indexed by value id
+	vector<IrBlock> blocks; // blocks[0] is the entry
+
+	size_t instructionCount() const
+	{
+		size_t n = 0;
+		for (const IrBlock &b : blocks)
+			if (b.live)
+				n += b.phis.size() + b.code.size();
+		return n;
+	}
+	size_t blockCount() const
+	{
+		return count_if(blocks.begin(), blocks.end(), [](const IrBlock &b)
+						{ return b.live; });
+	}
+};
+
+static bool isIrTerminator(IrOp op) { return op >= IrOp::Jump; }
+
+// Instructions that may raise; in a try body they end their block
+static bool irMayRaise(IrOp op)
+{
+	switch (op)
+	{
+	case IrOp::LoadGlobal:
+	case IrOp::Binary:
+	case IrOp::Unary:
+	case IrOp::Compare:
+	case IrOp::Call:
+	case IrOp::CallMethod:
+	case IrOp::GetAttr:
+	case IrOp::SetAttr:
+	case IrOp::BuildSet:
+	case IrOp::BuildDict:
+	case IrOp::MakeClass:
+	case IrOp::Import:
+	case IrOp::Iter:
+	case IrOp::ForNext:
+	case IrOp::Raise:
+		return true;
+	default:
+		return false;
+	}
+}
+
+void printIr(const IrFunction &f, ostream &out)
+{
+	out << "function " << f.name << "(";
+	for (size_t k = 0; k < f.params.size(); k++)
+		out << (k ? ", " : "") << f.params[k];
+	out << ")\n";
+	auto instruction = [&](int v)
+	{
+		const IrInstr &in = f.values[v];
+		out << "    ";
+		if (!isIrTerminator(in.op) || in.op == IrOp::ForNext)
+			out << "v" << v << " = ";
+		out << irOpNames[int(in.op)];
+		if (!in.text.empty())
+			out << " " << in.text;
+		const IrBlock &block = f.blocks[in.block];
+		for (size_t k = 0; k < in.args.size(); k++)
+		{
+			if (in.op == IrOp::Phi)
+				out << " [b" << block.preds[k] << " v" << in.args[k] << "]";
+			else
+				out << " v" << in.args[k];
+		}
+		if (isIrTerminator(in.op))
+		{
+			size_t normal = block.succs.size() - (block.handler >= 0 ? 1 : 0);
+			for (size_t k = 0; k < normal; k++)
+				out << (k ? ", b" : " -> b") << block.succs[k];
+			if (block.handler >= 0)
+				out << " unwind b" << block.handler;
+		}
+		out << "\n";
+	};
+	for (size_t b = 0; b < f.blocks.size(); b++)
+	{
+		const IrBlock &block = f.blocks[b];
+		if (!block.live)
+			continue;
+		out << "  b" << b << ":";
+		if (!block.preds.empty())
+		{
+			out << " preds";
+			for (int p : block.preds)
+				out << " b" << p;
+		}
+		out << "\n";
+		for (int v : block.phis)
+			instruction(v);
+		for (int v : block.code)
+			instruction(v);
+	}
+}
+
+// Lowers a module and every def and method in it. functions[0] is the
+// module body; defs are named by their dotted path ("Cls.method").
+class IrBuilder
+{
+public:
+	vector<IrFunction> functions;
+
+	void lowerModule(ParseTreeNode *root)
+	{
+		pending.push_back({"<module>", root});
+		for (size_t k = 0; k < pending.size(); k++)
+			lowerFunction(pending[k].first, pending[k].second);
+	}
+
+private:
+	struct Loop
+	{
+		int next, end;
+		size_t regionDepth;
+	};
+	struct Region
+	{
+		int handler;
+		ParseTreeNode *finallyBlock; // null for except handlers
+	};
+
+	vector<pair<string, ParseTreeNode *>> pending; // defs left to lower
+	IrFunction *f = nullptr;
+	int current = 0; // -1 after a jump, until the next reachable label
+	int undef = -1;
+	bool isModule = true;
+	string prefix; // qualified name of the function, for nested defs
+	unordered_map<string, int> variables;
+	int variableCount = 0;
+	unordered_map<uint64_t, int> currentDef; // block << 32 | variable
+	vector<vector<pair<int, int>>> incomplete; // per block: variable, phi
+	vector<vector<int>> phiUsers;
+	vector<int> forward; // replacement of a removed phi
+	vector<Loop> loops;
+	vector<Region> regions;
+
+	static bool isLeaf(const ParseTreeNode *node) { return node->children.empty(); }
+
+	void lowerFunction(const string &name, ParseTreeNode *node)
+	{
+		functions.emplace_back();
+		f = &functions.back();
+		f->name = name;
+		isModule = node->label != "function";
+		prefix = isModule ? "" : name + ".";
+		variables.clear();
+		variableCount = 0;
+		currentDef.clear();
+		incomplete.clear();
+		phiUsers.clear();
+		forward.clear();
+		undef = -1;
+		current = newBlock();
+		seal(current);
+
+		ParseTreeNode *body = node;
+		if (!isModule)
+		{
+			unordered_set<string> bound;
+			body = node->children.back();
+			collectBoundNames(body, bound);
+			for (ParseTreeNode *param : node->children[3]->children)
+				if (param->label == "parameter")
+				{
+					const string &p = param->children[0]->label;
+					f->params.push_back(p);
+					bound.insert(p);
+					writeVariable(variable(p), current, emit(IrOp::Param, {}, p));
+				}
+			for (const string &local : bound)
+				variable(local);
+		}
+		statements(body);
+		if (current >= 0)
+			terminate(IrOp::Return, {emit(IrOp::Const, {}, "None")}, {});
+		finish();
+	}
+
+	// Rewrites arguments past removed phis and drops the removed phis
+	void finish()
+	{
+		for (IrBlock &b : f->blocks)
+			b.phis.erase(remove_if(b.phis.begin(), b.phis.end(), [&](int v)
+								   { return f->values[v].block < 0; }),
+						 b.phis.end());
+		for (IrInstr &in : f->values)
+			if (in.block >= 0)
+				for (int &a : in.args)
+					a = resolve(a);
+	}
+
+	// --- blocks and instructions ---
+
+	int newBlock()
+	{
+		f->blocks.emplace_back();
+		incomplete.emplace_back();
+		return int(f->blocks.size() - 1);
+	}
+
+	int newValue(IrOp op, int block, vector<int> args, string text)
+	{
+		IrInstr in;
+		in.op = op;
+		in.block = block;
+		in.args = move(args);
+		in.text = move(text);
+		f->values.push_back(move(in));
+		phiUsers.emplace_back();
+		forward.push_back(-1);
+		return int(f->values.size() - 1);
+	}
+
+	void addEdge(int from, int to)
+	{
+		f->blocks[from].succs.push_back(to);
+		f->blocks[to].preds.push_back(from);
+	}
+
+	// Appends to the current block. In a try body an instruction that may
+	// raise closes the block, which continues in a fresh one.
+	int emit(IrOp op, vector<int> args = {}, string text = {})
+	{
+		int v = newValue(op, current, move(args), move(text));
+		f->blocks[current].code.push_back(v);
+		if (irMayRaise(op) && !regions.empty())
+		{
+			int next = newBlock();
+			terminate(IrOp::Jump, {}, {next});
+			unwind();
+			seal(next);
+			current = next;
+		}
+		return v;
+	}
+
+	// Ends the current block; code that follows in the same list is unreachable
+	int terminate(IrOp op, vector<int> args, const vector<int> &targets)
+	{
+		if (current < 0)
+			return -1;
+		int v = newValue(op, current, move(args), {});
+		IrBlock &block = f->blocks[current];
+		block.code.push_back(v);
+		for (int target : targets)
+			addEdge(current, target);
+		if (irMayRaise(op) && !regions.empty())
+			unwind();
+		return v;
+	}
+
+	// Adds the edge from the current block to the innermost handler
+	void unwind()
+	{
+		f->blocks[current].handler = regions.back().handler;
+		addEdge(current, regions.back().handler);
+	}
+
+	void jump(int target) { terminate(IrOp::Jump, {}, {target}); }
+
+	void startUnreachable() { current = -1; }
+
+	// --- SSA construction ---
+
+	int variable(const string &name)
+	{
+		auto [it, added] = variables.emplace(name, variableCount);
+		if (added)
+			variableCount++;
+		return it->second;
+	}
+
+	int hiddenVariable() { return variableCount++; }
+
+	int resolve(int v)
+	{
+		int root = v;
+		while (forward[root] >= 0)
+			root = forward[root];
+		while (forward[v] >= 0)
+		{
+			int next = forward[v];
+			forward[v] = root;
+			v = next;
+		}
+		return root;
+	}
+
+	static uint64_t defKey(int block, int var) { return uint64_t(block) << 32 | uint32_t(var); }
+
+	void writeVariable(int var, int block, int value) { currentDef[defKey(block, var)] = value; }
+
+	int readVariable(int var, int block)
+	{
+		// Single-predecessor chains are walked without recursion
+		vector<int> chain;
+		int value = -1;
+		while (true)
+		{
+			auto it = currentDef.find(defKey(block, var));
+			if (it != currentDef.end())
+			{
+				value = resolve(it->second);
+				break;
+			}
+			IrBlock &b = f->blocks[block];
+			if (b.sealed && b.preds.size() == 1)
+			{
+				chain.push_back(block);
+				block = b.preds[0];
+				continue;
+			}
+			value = readVariableAtJoin(var, block);
+			break;
+		}
+		for (int b : chain)
+			writeVariable(var, b, value);
+		return value;
+	}
+
+	int readVariableAtJoin(int var, int block)
+	{
+		IrBlock &b = f->blocks[block];
+		int value;
+		if (!b.sealed)
+		{
+			value = newPhi(block);
+			incomplete[block].push_back({var, value});
+		}
+		else if (b.preds.empty())
+			value = undefined();
+		else
+		{
+			int phi = newPhi(block);
+			writeVariable(var, block, phi);
+			value = addPhiOperands(var, phi);
+		}
+		writeVariable(var, block, value);
+		return value;
+	}
+
+	int newPhi(int block)
+	{
+		int v = newValue(IrOp::Phi, block, {}, {});
+		f->blocks[block].phis.push_back(v);
+		return v;
+	}
+
+	int undefined()
+	{
+		if (undef < 0)
+		{
+			undef = newValue(IrOp::Undef, 0, {}, {});
+			vector<int> &entry = f->blocks[0].code;
+			entry.insert(entry.begin(), undef);
+		}
+		return undef;
+	}
+
+	int addPhiOperands(int var, int phi)
+	{
+		for (size_t k = 0; k < f->blocks[f->values[phi].block].preds.size(); k++)
+		{
+			int operand = readVariable(var, f->blocks[f->values[phi].block].preds[k]);
+			f->values[phi].args.push_back(operand);
+			if (f->values[operand].op == IrOp::Phi)
+				phiUsers[operand].push_back(phi);
+		}
+		return tryRemoveTrivialPhi(phi);
+	}
+
+	// A phi whose operands are all one value (or itself) is that value
+	int tryRemoveTrivialPhi(int phi)
+	{
+		int same = -1;
+		for (int &operand : f->values[phi].args)
+		{
+			operand = resolve(operand);
+			if (operand == same || operand == phi)
+				continue;
+			if (same >= 0)
+				return phi;
+			same = operand;
+		}
+		if (same < 0)
+			same = undefined();
+		f->values[phi].block = -1;
+		forward[phi] = same;
+		vector<int> users = move(phiUsers[phi]);
+		if (f->values[same].op == IrOp::Phi)
+			phiUsers[same].insert(phiUsers[same].end(), users.begin(), users.end());
+		for (int user : users)
+			if (user != phi && f->values[user].block >= 0)
+				tryRemoveTrivialPhi(user);
+		return resolve(same);
+	}
+
+	void seal(int block)
+	{
+		vector<pair<int, int>> phis = move(incomplete[block]);
+		f->blocks[block].sealed = true;
+		for (auto [var, phi] : phis)
+			addPhiOperands(var, phi);
+	}
+
+	// --- names ---
+
+	bool isLocal(const string &name) const { return !isModule && variables.count(name); }
+
+	int loadName(const string &name)
+	{
+		if (isLocal(name))
+			return readVariable(variables.at(name), current);
+		return emit(IrOp::LoadGlobal, {}, name);
+	}
+
+	void storeName(const string &name, int value)
+	{
+		if (isLocal(name))
+			writeVariable(variables.at(name), current, emit(IrOp::Copy, {value}, name));
+		else
+			emit(IrOp::StoreGlobal, {value}, name);
+	}
+
+	// --- statements ---
+
+	void statements(ParseTreeNode *list)
+	{
+		for (ParseTreeNode *child : list->children)
+			if (current >= 0)
+				statement(child);
+	}
+
+	void statement(ParseTreeNode *node)
+	{
+		const string &label = node->label;
+		if (isLeaf(node) || label == "pass_statement")
+			return; // INDENT / DEDENT markers
+		if (label == "statement")
+			statement(node->children[0]);
+		else if (label == "assignment")
+			assignment(node);
+		else if (label == "conditional_statement")
+			conditional(node);
+		else if (label == "while_statement")
+			whileLoop(node);
+		else if (label == "for_statement")
+			forLoop(node);
+		else if (label == "try_statement")
+			tryStatement(node);
+		else if (label == "function")
+			storeName(node->children[1]->label, makeFunction(node, prefix + node->children[1]->label));
+		else if (label == "class_def")
+			classDef(node);
+		else if (label == "import_statement")
+			importStatement(node);
+		else if (label == "return_statement")
+		{
+			if (isModule)
+				throw CompileError("'return' outside function");
+			int value = node->children.size() > 1 ? expr(node->children[1]) : emit(IrOp::Const, {}, "None");
+			exitRegions(0);
+			terminate(IrOp::Return, {value}, {});
+			startUnreachable();
+		}
+		else if (label == "break_statement" || label == "continue_statement")
+		{
+			if (loops.empty())
+				throw CompileError("'" + node->children[0]->label + "' outside loop");
+			Loop loop = loops.back();
+			exitRegions(loop.regionDepth);
+			jump(label == "break_statement" ? loop.end : loop.next);
+			startUnreachable();
+		}
+		else if (label == "raise_statement")
+		{
+			terminate(IrOp::Raise, {expr(node->children[1])}, {});
+			startUnreachable();
+		}
+		else if (label == "function_call")
+		{
+			ParseTreeNode *arguments = nullptr;
+			for (ParseTreeNode *part : node->children)
+				if (part->label == "arguments")
+					arguments = part;
+			call(node->children[0], arguments);
+		}
+		else if (label == "factor")
+			expr(node); // docstring or bare literal
+		else
+			throw CompileError("unsupported statement '" + label + "'");
+	}
+
+	void assignment(ParseTreeNode *node)
+	{
+		auto [targets, values, op] = splitAssignment(node);
+
+		if (op != "=")
+		{
+			if (targets.size() != 1)
+				throw CompileError("augmented assignment needs exactly one target");
+			string binary = op.substr(0, op.size() - 1);
+			ParseTreeNode *target = targets[0];
+			if (isLeaf(target))
+			{
+				int old = loadName(target->label);
+				storeName(target->label, emit(IrOp::Binary, {old, expr(values[0])}, binary));
+			}
+			else
+			{
+				int object = attributeOwner(target);
+				const string &attr = target->children.back()->label;
+				int old = emit(IrOp::GetAttr, {object}, attr);
+				emit(IrOp::SetAttr, {object, emit(IrOp::Binary, {old, expr(values[0])}, binary)}, attr);
+			}
+			return;
+		}
+		vector<int> results;
+		for (ParseTreeNode *value : values)
+			results.push_back(expr(value));
+		for (size_t k = 0; k < targets.size() && k < results.size(); k++)
+		{
+			if (isLeaf(targets[k]))
+				storeName(targets[k]->label, results[k]);
+			else
+				emit(IrOp::SetAttr, {attributeOwner(targets[k]), results[k]}, targets[k]->children.back()->label);
+		}
+	}
+
+	void conditional(ParseTreeNode *node)
+	{
+		int end = newBlock();
+		auto clause = [&](ParseTreeNode *cond, ParseTreeNode *block) -> bool
+		{
+			bool truth;
+			if (cond && foldedTruth(cond, truth))
+			{
+				if (!truth)
+					return false; // branch can never run
+				statements(block);
+				return true; // later clauses are unreachable
+			}
+			if (!cond)
+			{
+				statements(block);
+				return true;
+			}
+			int then = newBlock(), next = newBlock();
+			terminate(IrOp::Branch, {expr(cond)}, {then, next});
+			seal(then);
+			seal(next);
+			current = then;
+			statements(block);
+			jump(end);
+			current = next;
+			return false;
+		};
+
+		bool done = clause(node->children[1], node->children[3]);
+		for (size_t k = 4; k < node->children.size() && !done; k++)
+		{
+			ParseTreeNode *part = node->children[k];
+			if (part->label == "elif_clause")
+				done = clause(part->children[1], part->children[3]);
+			else if (part->label == "else_clause")
+				done = clause(nullptr, part->children[2]);
+		}
+		jump(end);
+		seal(end);
+		current = end;
+	}
+
+	// The header is entered from a block that only jumps to it, which
+	// becomes the preheader for loop-invariant code motion
+	void whileLoop(ParseTreeNode *node)
+	{
+		bool truth;
+		bool constant = foldedTruth(node->children[1], truth);
+		if (constant && !truth)
+			return;
+		int header = newBlock(), body = newBlock(), end = newBlock();
+		jump(header);
+		current = header;
+		if (constant)
+			jump(body);
+		else
+			terminate(IrOp::Branch, {expr(node->children[1])}, {body, end});
+		seal(body);
+		loopBody(node->children[3], header, end, body);
+	}
+
+	void forLoop(ParseTreeNode *node)
+	{
+		int iterator = emit(IrOp::Iter, {expr(node->children[3])});
+		int header = newBlock(), body = newBlock(), end = newBlock();
+		jump(header);
+		current = header;
+		int item = terminate(IrOp::ForNext, {iterator}, {body, end});
+		seal(body);
+		current = body;
+		storeName(node->children[1]->label, item);
+		loopBody(node->children[5], header, end, current);
+	}
+
+	void loopBody(ParseTreeNode *block, int header, int end, int body)
+	{
+		current = body;
+		loops.push_back({header, end, regions.size()});
+		statements(block);
+		loops.pop_back();
+		jump(header);
+		seal(header);
+		seal(end);
+		current = end;
+	}
+
+	// Leaving regions [depth, top) by a jump: their finally blocks run
+	// first, each outside the protection of the regions being left
+	void exitRegions(size_t depth)
+	{
+		for (size_t k = regions.size(); k > depth; k--)
+		{
+			if (!regions[k - 1].finallyBlock)
+				continue;
+			vector<Region> saved = regions;
+			vector<Loop> savedLoops = loops;
+			regions.resize(k - 1);
+			statements(saved[k - 1].finallyBlock);
+			regions = move(saved);
+			loops = move(savedLoops);
+		}
+	}
+
+	void tryStatement(ParseTreeNode *node)
+	{
+		ParseTreeNode *body = node->children[2];
+		vector<ParseTreeNode *> excepts, elses;
+		ParseTreeNode *finallyBlock = nullptr;
+		for (size_t k = 3; k < node->children.size(); k++)
+		{
+			ParseTreeNode *part = node->children[k];
+			if (part->label == "except_clause")
+				excepts.push_back(part);
+			else if (part->label == "else_clause")
+				elses.push_back(part);
+			else if (part->label == "finally_clause")
+				finallyBlock = part->children[2];
+		}
+
+		int finallyHandler = -1;
+		if (finallyBlock)
+		{
+			finallyHandler = newBlock();
+			regions.push_back({finallyHandler, finallyBlock});
+		}
+		if (!excepts.empty())
+		{
+			int handler = newBlock(), done = newBlock();
+			regions.push_back({handler, nullptr});
+			statements(body);
+			regions.pop_back();
+			for (ParseTreeNode *clause : elses)
+				statements(clause->children[2]);
+			jump(done);
+			seal(handler);
+
+			current = handler;
+			int exception = emit(IrOp::Caught);
+			for (ParseTreeNode *clause : excepts)
+			{
+				const auto &c = clause->children;
+				if (c.size() > 3)
+				{
+					// except Name [as alias]:
+					int matched = emit(IrOp::ExcMatch, {exception, loadName(c[1]->label)});
+					int then = newBlock(), next = newBlock();
+					terminate(IrOp::Branch, {matched}, {then, next});
+					seal(then);
+					seal(next);
+					current = then;
+					if (c.size() > 4 && c[2]->label == "as")
+						storeName(c[3]->label, exception);
+					statements(c.back());
+					jump(done);
+					current = next;
+				}
+				else
+				{
+					statements(c.back());
+					jump(done);
+					startUnreachable();
+					break;
+				}
+			}
+			terminate(IrOp::Raise, {exception}, {});
+			seal(done);
+			current = done;
+		}
+		else
+		{
+			statements(body);
+		}
+
+		if (finallyBlock)
+		{
+			regions.pop_back();
+			seal(finallyHandler);
+			statements(finallyBlock);
+			int after = newBlock();
+			jump(after);
+			current = finallyHandler;
+			int exception = emit(IrOp::Caught);
+			statements(finallyBlock);
+			terminate(IrOp::Raise, {exception}, {});
+			seal(after);
+			current = after;
+		}
+	}
+
+	// --- definitions ---
+
+	int makeFunction(ParseTreeNode *node, const string &qualified)
+	{
+		vector<int> defaults;
+		for (ParseTreeNode *param : node->children[3]->children)
+			if (param->label == "parameter" && param->children.size() == 3)
+				defaults.push_back(expr(param->children[2]));
+		pending.push_back({qualified, node});
+		return emit(IrOp::MakeFunction, move(defaults), qualified);
+	}
+
+	void classDef(ParseTreeNode *node)
+	{
+		const auto &c = node->children;
+		const string &name = c[1]->label;
+		vector<int> base;
+		if (c.size() > 4 && c[2]->label == "(")
+			base.push_back(loadName(c[3]->label));
+		int cls = emit(IrOp::MakeClass, move(base), name);
+		for (ParseTreeNode *member : c.back()->children)
+		{
+			if (member->label == "function")
+			{
+				const string &method = member->children[1]->label;
+				emit(IrOp::SetAttr, {cls, makeFunction(member, prefix + name + "." + method)}, method);
+			}
+			else if (member->label == "assignment")
+			{
+				vector<ParseTreeNode *> targets, values;
+				for (ParseTreeNode *t : member->children[0]->children)
+					if (t->label != ",")
+						targets.push_back(t);
+				for (ParseTreeNode *v : member->children[2]->children)
+					if (v->label == "expression")
+						values.push_back(v);
+				for (size_t k = 0; k < targets.size() && k < values.size(); k++)
+					emit(IrOp::SetAttr, {cls, expr(values[k])}, targets[k]->label);
+			}
+		}
+		storeName(name, cls);
+	}
+
+	void importStatement(ParseTreeNode *node)
+	{
+		ImportParts imported = splitImport(node);
+		int module = imported.from.empty() ? -1 : emit(IrOp::Import, {}, imported.from);
+		for (const auto &[source, bound] : imported.bindings)
+			storeName(bound, module < 0 ? emit(IrOp::Import, {}, source) : emit(IrOp::GetAttr, {module}, source));
+	}
+
+	// --- expressions ---
+
+	// For a.b.c, the value of a.b
+	int attributeOwner(ParseTreeNode *dotted)
+	{
+		const auto &parts = dotted->children;
+		int value = loadName(parts[0]->label);
+		for (size_t k = 2; k + 2 < parts.size(); k += 2)
+			value = emit(IrOp::GetAttr, {value}, parts[k]->label);
+		return value;
+	}
+
+	int call(ParseTreeNode *callee, ParseTreeNode *arguments)
+	{
+		vector<int> args;
+		bool method = !isLeaf(callee);
+		args.push_back(method ? attributeOwner(callee) : loadName(callee->label));
+		if (arguments)
+			for (ParseTreeNode *arg : arguments->children)
+				if (arg->label == "expression")
+					args.push_back(expr(arg));
+		if (method)
+			return emit(IrOp::CallMethod, move(args), callee->children.back()->label);
+		return emit(IrOp::Call, move(args));
+	}
+
+	int expr(ParseTreeNode *node)
+	{
+		const string &label = node->label;
+		const auto &c = node->children;
+
+		if (label == "expression")
+		{
+			ConstValue folded;
+			if (!node->folded.empty() && parseLiteral(node->folded, folded))
+				return emit(IrOp::Const, {}, node->folded);
+			return expr(c[0]);
+		}
+		if ((label == "or_expression" || label == "and_expression") && c.size() > 1)
+		{
+			// The result is the operand that settled it
+			int result = hiddenVariable(), end = newBlock();
+			for (size_t k = 0; k < c.size(); k += 2)
+			{
+				int value = expr(c[k]);
+				writeVariable(result, current, value);
+				if (k + 1 >= c.size())
+					break;
+				int next = newBlock();
+				if (label == "or_expression")
+					terminate(IrOp::Branch, {value}, {end, next});
+				else
+					terminate(IrOp::Branch, {value}, {next, end});
+				seal(next);
+				current = next;
+			}
+			jump(end);
+			seal(end);
+			current = end;
+			return readVariable(result, current);
+		}
+		if (label == "not_expression" && c.size() == 2)
+			return emit(IrOp::Not, {expr(c[1])});
+		if (label == "comparison" && c.size() > 1)
+			return comparison(node);
+		if (label == "arithmetic" || label == "term")
+		{
+			int value = expr(c[0]);
+			for (size_t k = 1; k + 1 < c.size(); k += 2)
+				value = emit(IrOp::Binary, {value, expr(c[k + 1])}, c[k]->label);
+			return value;
+		}
+		if (label == "factor")
+			return factor(node);
+		if (c.size() == 1)
+			return expr(c[0]);
+		throw CompileError("unsupported expression '" + label + "'");
+	}
+
+	int comparison(ParseTreeNode *node)
+	{
+		const auto &c = node->children;
+		int left = expr(c[0]);
+		int result = -1, end = -1, variable = -1;
+		for (size_t k = 1; k + 1 < c.size(); k += 2)
+		{
+			string op = comparisonOperator(c[k]);
+			if (op.empty())
+				throw CompileError("unsupported operator in comparison");
+			if (!isComparisonOperator(op))
+			{
+				left = emit(IrOp::Binary, {left, expr(c[k + 1])}, op);
+				continue;
+			}
+			if (result >= 0)
+			{
+				// A later link only runs while the chain holds
+				if (end < 0)
+				{
+					end = newBlock();
+					variable = hiddenVariable();
+				}
+				writeVariable(variable, current, result);
+				int next = newBlock();
+				terminate(IrOp::Branch, {result}, {next, end});
+				seal(next);
+				current = next;
+			}
+			int right = expr(c[k + 1]);
+			result = emit(IrOp::Compare, {left, right}, op);
+			left = right;
+		}
+		if (end < 0)
+			return result < 0 ? left : result;
+		writeVariable(variable, current, result);
+		jump(end);
+		seal(end);
+		current = end;
+		return readVariable(variable, current);
+	}
+
+	int sequence(IrOp op, const vector<ParseTreeNode *> &items)
+	{
+		vector<int> values;
+		for (ParseTreeNode *item : items)
+			values.push_back(expr(item));
+		return emit(op, move(values));
+	}
+
+	int factor(ParseTreeNode *node)
+	{
+		const auto &c = node->children;
+		ParseTreeNode *first = c[0];
+
+		if (isLeaf(first) && c.size() == 1)
+		{
+			const string &lexeme = first->label;
+			if (classifyLeaf(lexeme) == LeafKind::Name)
+				return loadName(lexeme);
+			return emit(IrOp::Const, {}, lexeme);
+		}
+		if (isLeaf(first) && c.size() == 2 && c[1]->label == "factor")
+		{
+			int operand = expr(c[1]);
+			if (first->label == "not")
+				return emit(IrOp::Not, {operand});
+			return emit(IrOp::Unary, {operand}, first->label);
+		}
+		if (c.size() > 1 && c[1]->label == "(")
+			return call(first, c.size() > 3 ? c[2] : nullptr);
+		if (first->label == "dotted_name")
+			return emit(IrOp::GetAttr, {attributeOwner(first)}, first->children.back()->label);
+
+		vector<ParseTreeNode *> items;
+		bool hasComma = false;
+		for (ParseTreeNode *part : first->children)
+		{
+			if (part->label == "expression")
+				items.push_back(part);
+			hasComma = hasComma || part->label == ",";
+		}
+		if (first->label == "tuple_or_group")
+		{
+			if (items.size() == 1 && !hasComma)
+				return expr(items[0]);
+			return sequence(IrOp::BuildTuple, items);
+		}
+		if (first->label == "list_literal")
+			return sequence(IrOp::BuildList, items);
+		if (first->label == "set_literal")
+			return sequence(IrOp::BuildSet, items);
+		if (first->label == "dict_literal")
+			return sequence(IrOp::BuildDict, items);
+		throw CompileError("unsupported factor '" + first->label + "'");
+	}
+};
+
+// ----------------------------------------------
+// IR optimization passes
+// ----------------------------------------------
+// Without type feedback, an operation is only known to be free of side
+// effects when its operands are primitive values. inferIrTypes() finds
+// these operands. GVN merges operations whose results cannot differ.
+// LICM only moves operations that also cannot raise, because a hoisted
+// operation now runs even when the loop body would not have.
+
+enum class IrType : uint8_t
+{
+	Pending, // not reached yet by the inference
+	Unknown,
+	None,
+	Bool,
+	Int,
+	Float,
+	Str
+};
+
+static bool isPrimitive(IrType t) { return t >= IrType::None; }
+static bool isNumeric(IrType t) { return t == IrType::Bool || t == IrType::Int || t == IrType::Float; }
+
+// Live blocks reachable from the entry, in reverse postorder
+vector<int> irReversePostorder(const IrFunction &f)
+{
+	vector<int> order;
+	vector<char> seen(f.blocks.size(), 0);
+	vector<pair<int, size_t>> stack = {{0, 0}};
+	seen[0] = 1;
+	while (!stack.empty())
+	{
+		auto &[block, next] = stack.back();
+		const vector<int> &succs = f.blocks[block].succs;
+		if (next < succs.size())
+		{
+			int s = succs[next++];
+			if (!seen[s])
+			{
+				seen[s] = 1;
+				stack.push_back({s, 0});
+			}
+			continue;
+		}
+		order.push_back(block);
+		stack.pop_back();
+	}
+	reverse(order.begin(), order.end());
+	return order;
+}
+
+static IrType irResultType(const IrInstr &in, const vector<IrType> &types)
+{
+	auto arg = [&](size_t k)
+	{ return types[in.args[k]]; };
+	for (int a : in.args)
+		if (types[a] == IrType::Pending && in.op != IrOp::Phi)
+			return IrType::Pending;
+	switch (in.op)
+	{
+	case IrOp::Const:
+	{
+		ConstValue v;
+		if (!parseLiteral(in.text, v))
+			return IrType::Unknown;
+		switch (v.kind)
+		{
+		case ConstValue::Kind::None:
+			return IrType::None;
+		case ConstValue::Kind::Bool:
+			return IrType::Bool;
+		case ConstValue::Kind::Int:
+			return IrType::Int;
+		case ConstValue::Kind::Float:
+			return IrType::Float;
+		case ConstValue::Kind::Str:
+			return IrType::Str;
+		default:
+			return IrType::Unknown;
+		}
+	}
+	case IrOp::Copy:
+		return arg(0);
+	case IrOp::Phi:
+	{
+		IrType joined = IrType::Pending;
+		for (int a : in.args)
+		{
+			if (types[a] == IrType::Pending || types[a] == joined)
+				continue;
+			if (joined != IrType::Pending)
+				return IrType::Unknown;
+			joined = types[a];
+		}
+		return joined;
+	}
+	case IrOp::Not:
+		return IrType::Bool;
+	case IrOp::Compare:
+		return isPrimitive(arg(0)) && isPrimitive(arg(1)) ? IrType::Bool : IrType::Unknown;
+	case IrOp::Unary:
+		if (arg(0) == IrType::Float && in.text != "~")
+			return IrType::Float;
+		return arg(0) == IrType::Int || arg(0) == IrType::Bool ? IrType::Int : IrType::Unknown;
+	case IrOp::Binary:
+	{
+		IrType a = arg(0), b = arg(1);
+		const string &op = in.text;
+		bool ints = (a == IrType::Int || a == IrType::Bool) && (b == IrType::Int || b == IrType::Bool);
+		if (ints)
+		{
+			if (op == "/")
+				return IrType::Float;
+			if (op == "**")
+				return IrType::Unknown; // float for a negative exponent
+			if (a == IrType::Bool && b == IrType::Bool && (op == "&" || op == "|" || op == "^"))
+				return IrType::Bool;
+			return IrType::Int;
+		}
+		if (isNumeric(a) && isNumeric(b) && (op == "+" || op == "-" || op == "*" || op == "/" || op == "%" || op == "//"))
+			return IrType::Float;
+		if (a == IrType::Str && (op == "%" || (op == "+" && b == IrType::Str) || (op == "*" && (b == IrType::Int || b == IrType::Bool))))
+			return IrType::Str;
+		if (b == IrType::Str && op == "*" && (a == IrType::Int || a == IrType::Bool))
+			return IrType::Str;
+		return IrType::Unknown;
+	}
+	default:
+		return IrType::Unknown;
+	}
+}
+
+// Optimistic: phis start out Pending and settle as their operands do
+vector<IrType> inferIrTypes(const IrFunction &f)
+{
+	vector<IrType> types(f.values.size(), IrType::Pending);
+	vector<int> order = irReversePostorder(f);
+	for (bool changed = true; changed;)
+	{
+		changed = false;
+		for (int b : order)
+			for (const vector<int> *list : {&f.blocks[b].phis, &f.blocks[b].code})
+				for (int v : *list)
+				{
+					IrType t = irResultType(f.values[v], types);
+					if (t != types[v])
+					{
+						types[v] = t;
+						changed = true;
+					}
+				}
+	}
+	for (IrType &t : types)
+		if (t == IrType::Pending)
+			t = IrType::Unknown;
+	return types;
+}
+
+// Equal operands give an equal result (or the same error), with no other effect
+static bool irDeterministic(const IrInstr &in, const vector<IrType> &types)
+{
+	switch (in.op)
+	{
+	case IrOp::Const:
+	case IrOp::Copy:
+		return true;
+	case IrOp::Not:
+	case IrOp::Unary:
+	case IrOp::Binary:
+	case IrOp::Compare:
+		return all_of(in.args.begin(), in.args.end(), [&](int a)
+					  { return isPrimitive(types[a]); });
+	default:
+		return false;
+	}
+}
+
+// Deterministic and never raises, so it may run earlier or not at all
+static bool irSpeculatable(const IrInstr &in, const vector<IrType> &types)
+{
+	if (!irDeterministic(in, types))
+		return false;
+	const string &op = in.text;
+	switch (in.op)
+	{
+	case IrOp::Unary:
+	{
+		IrType a = types[in.args[0]];
+		return op == "+" ? isNumeric(a) : op == "-" ? a == IrType::Float
+												 : a != IrType::Float && isNumeric(a);
+	}
+	case IrOp::Binary:
+	{
+		IrType a = types[in.args[0]], b = types[in.args[1]];
+		// Int arithmetic can overflow; float arithmetic saturates
+		if ((a == IrType::Float || b == IrType::Float) && isNumeric(a) && isNumeric(b))
+			return op == "+" || op == "-" || op == "*";
+		if (isNumeric(a) && isNumeric(b) && a != IrType::Float && b != IrType::Float)
+			return op == "&" || op == "|" || op == "^";
+		return a == IrType::Str && b == IrType::Str && op == "+";
+	}
+	case IrOp::Compare:
+	{
+		IrType a = types[in.args[0]], b = types[in.args[1]];
+		if (op == "==" || op == "!=" || op == "is" || op == "is not")
+			return true;
+		if (isNumeric(a) && isNumeric(b))
+			return op == "<" || op == "<=" || op == ">" || op == ">=";
+		return a == IrType::Str && b == IrType::Str;
+	}
+	default:
+		return true;
+	}
+}
+
+// Instructions whose only effect is their value
+static bool irRemovable(const IrInstr &in, const vector<IrType> &types)
+{
+	switch (in.op)
+	{
+	case IrOp::Undef:
+	case IrOp::Phi:
+	case IrOp::BuildTuple:
+	case IrOp::BuildList:
+	case IrOp::MakeFunction:
+	case IrOp::Caught:
+		return true;
+	default:
+		return irSpeculatable(in, types);
+	}
+}
+
+// Drops removed instructions from the block lists
+static void compactIr(IrFunction &f)
+{
+	auto removed = [&](int v)
+	{ return f.values[v].block < 0; };
+	for (IrBlock &b : f.blocks)
+	{
+		b.phis.erase(remove_if(b.phis.begin(), b.phis.end(), removed), b.phis.end());
+		b.code.erase(remove_if(b.code.begin(), b.code.end(), removed), b.code.end());
+	}
+}
+
+// Immediate dominators (Cooper, Harvey and Kennedy) and a preorder and
+// postorder numbering of the dominator tree for constant-time queries
+struct IrDominators
+{
+	vector<int> order; // reverse postorder of the reachable blocks
+	vector<int> idom;  // -1 for the entry and unreachable blocks
+	vector<vector<int>> children;
+	vector<int> pre, post;
+
+	explicit IrDominators(const IrFunction &f) : order(irReversePostorder(f)), idom(f.blocks.size(), -1),
+												 children(f.blocks.size()), pre(f.blocks.size(), -1), post(f.blocks.size(), -1)
+	{
+		vector<int> index(f.blocks.size(), -1);
+		for (size_t k = 0; k < order.size(); k++)
+			index[order[k]] = int(k);
+		idom[0] = 0;
+		auto intersect = [&](int a, int b)
+		{
+			while (a != b)
+			{
+				while (index[a] > index[b])
+					a = idom[a];
+				while (index[b] > index[a])
+					b = idom[b];
+			}
+			return a;
+		};
+		for (bool changed = true; changed;)
+		{
+			changed = false;
+			for (size_t k = 1; k < order.size(); k++)
+			{
+				int b = order[k], dom = -1;
+				for (int p : f.blocks[b].preds)
+					if (index[p] >= 0 && idom[p] >= 0)
+						dom = dom < 0 ? p : intersect(p, dom);
+				if (dom != idom[b])
+				{
+					idom[b] = dom;
+					changed = true;
+				}
+			}
+		}
+		idom[0] = -1;
+		for (int b : order)
+			if (idom[b] >= 0)
+				children[idom[b]].push_back(b);
+
+		int clock = 0;
+		vector<pair<int, size_t>> stack = {{0, 0}};
+		pre[0] = clock++;
+		while (!stack.empty())
+		{
+			auto &[b, next] = stack.back();
+			if (next < children[b].size())
+			{
+				int c = children[b][next++];
+				pre[c] = clock++;
+				stack.push_back({c, 0});
+				continue;
+			}
+			post[b] = clock++;
+			stack.pop_back();
+		}
+	}
+
+	bool dominates(int a, int b) const { return pre[a] <= pre[b] && post[b] <= post[a]; }
+};
+
+// Throws unless the CFG edges agree, every block ends in its terminator,
+// phis have one argument per predecessor and every definition dominates
+// its uses (for a phi argument, the end of the matching predecessor)
+void verifyIr(const IrFunction &f)
+{
+	auto fail = [&](const string &what)
+	{ throw CompileError("malformed IR in '" + f.name + "': " + what); };
+	IrDominators dom(f);
+	vector<int> position(f.values.size(), -1);
+	for (size_t b = 0; b < f.blocks.size(); b++)
+	{
+		const IrBlock &block = f.blocks[b];
+		if (!block.live)
+			continue;
+		string name = "b" + to_string(b);
+		if (block.code.empty() || !isIrTerminator(f.values[block.code.back()].op))
+			fail(name + " has no terminator");
+		for (int s : block.succs)
+			if (count(block.succs.begin(), block.succs.end(), s) != count(f.blocks[s].preds.begin(), f.blocks[s].preds.end(), int(b)))
+				fail("edge " + name + " -> b" + to_string(s) + " is missing from the predecessors");
+		int k = 0;
+		for (const vector<int> *list : {&block.phis, &block.code})
+			for (int v : *list)
+			{
+				const IrInstr &in = f.values[v];
+				if (in.block != int(b))
+					fail("v" + to_string(v) + " is listed in " + name + " but belongs to b" + to_string(in.block));
+				if ((in.op == IrOp::Phi) != (list == &block.phis))
+					fail("v" + to_string(v) + " is out of place in " + name);
+				if (in.op == IrOp::Phi && in.args.size() != block.preds.size())
+					fail("phi v" + to_string(v) + " does not match the predecessors of " + name);
+				if (isIrTerminator(in.op) && v != block.code.back())
+					fail("terminator v" + to_string(v) + " in the middle of " + name);
+				position[v] = k++;
+			}
+	}
+	for (int b : dom.order)
+		for (const vector<int> *list : {&f.blocks[b].phis, &f.blocks[b].code})
+			for (int v : *list)
+			{
+				const IrInstr &in = f.values[v];
+				for (size_t k = 0; k < in.args.size(); k++)
+				{
+					const IrInstr &def = f.values[in.args[k]];
+					int use = in.op == IrOp::Phi ? f.blocks[b].preds[k] : b;
+					bool dominated = def.block >= 0 && dom.pre[use] >= 0 &&
+									 (def.block == use ? in.op == IrOp::Phi || position[in.args[k]] < position[v]
+													   : dom.dominates(def.block, use));
+					if (!dominated && (in.op != IrOp::Phi || dom.pre[use] >= 0))
+						fail("v" + to_string(in.args[k]) + " does not dominate its use in v" + to_string(v));
+				}
+			}
+}
+
+// Removes blocks the entry cannot reach, then every instruction that
+// nothing live uses and that has no effect of its own
+size_t eliminateDeadCode(IrFunction &f)
+{
+	size_t before = f.instructionCount();
+	vector<char> reachable(f.blocks.size(), 0);
+	for (int b : irReversePostorder(f))
+		reachable[b] = 1;
+	for (size_t b = 0; b < f.blocks.size(); b++)
+	{
+		IrBlock &block = f.blocks[b];
+		if (reachable[b] || !block.live)
+			continue;
+		for (int s : block.succs)
+		{
+			IrBlock &succ = f.blocks[s];
+			for (size_t k = succ.preds.size(); k-- > 0;)
+			{
+				if (succ.preds[k] != int(b))
+					continue;
+				succ.preds.erase(succ.preds.begin() + k);
+				for (int phi : succ.phis)
+					f.values[phi].args.erase(f.values[phi].args.begin() + k);
+			}
+		}
+		for (const vector<int> *list : {&block.phis, &block.code})
+			for (int v : *list)
+				f.values[v].block = -1;
+		block = IrBlock();
+		block.live = false;
+	}
+
+	vector<IrType> types = inferIrTypes(f);
+	vector<char> marked(f.values.size(), 0);
+	vector<int> work;
+	for (const IrBlock &block : f.blocks)
+		for (const vector<int> *list : {&block.phis, &block.code})
+			for (int v : *list)
+				if (!irRemovable(f.values[v], types))
+				{
+					marked[v] = 1;
+					work.push_back(v);
+				}
+	while (!work.empty())
+	{
+		int v = work.back();
+		work.pop_back();
+		for (int a : f.values[v].args)
+			if (!marked[a])
+			{
+				marked[a] = 1;
+				work.push_back(a);
+			}
+	}
+	for (IrInstr &in : f.values)
+		if (in.block >= 0 && !marked[&in - f.values.data()])
+			in.block = -1;
+	compactIr(f);
+	return before - f.instructionCount();
+}
+
+// Replaces copies, and phis whose operands are all one value, by their source
+size_t propagateCopies(IrFunction &f)
+{
+	size_t replaced = 0;
+	vector<int> source(f.values.size(), -1);
+	auto resolve = [&](int v)
+	{
+		while (source[v] >= 0)
+			v = source[v];
+		return v;
+	};
+	for (size_t v = 0; v < f.values.size(); v++)
+		if (f.values[v].block >= 0 && f.values[v].op == IrOp::Copy)
+			source[v] = f.values[v].args[0];
+	for (bool changed = true; changed;)
+	{
+		changed = false;
+		for (const IrBlock &block : f.blocks)
+			for (int phi : block.phis)
+			{
+				if (source[phi] >= 0)
+					continue;
+				int same = -1;
+				bool trivial = true;
+				for (int a : f.values[phi].args)
+				{
+					a = resolve(a);
+					if (a == phi || a == same)
+						continue;
+					trivial = same < 0;
+					same = a;
+					if (!trivial)
+						break;
+				}
+				if (trivial && same >= 0)
+				{
+					source[phi] = same;
+					changed = true;
+				}
+			}
+	}
+	for (IrInstr &in : f.values)
+	{
+		if (in.block < 0)
+			continue;
+		if (source[&in - f.values.data()] >= 0)
+		{
+			in.block = -1;
+			replaced++;
+		}
+		else
+			for (int &a : in.args)
+				a = resolve(a);
+	}
+	compactIr(f);
+	return replaced;
+}
+
+// Dominator-based value numbering: an operation equal to one in a
+// dominating position becomes a copy of it
+size_t numberValues(IrFunction &f)
+{
+	size_t redundant = 0;
+	struct Key
+	{
+		IrOp op;
+		string text;
+		vector<int> args;
+		bool operator==(const Key &o) const { return op == o.op && text == o.text && args == o.args; }
+	};
+	struct KeyHash
+	{
+		size_t operator()(const Key &k) const
+		{
+			size_t h = hash<string>()(k.text) * 31 + size_t(k.op);
+			for (int a : k.args)
+				h = h * 1000003 ^ size_t(a);
+			return h;
+		}
+	};
+	vector<IrType> types = inferIrTypes(f);
+	IrDominators dom(f);
+	auto source = [&](int v)
+	{
+		while (f.values[v].op == IrOp::Copy && f.values[v].block >= 0)
+			v = f.values[v].args[0];
+		return v;
+	};
+	auto keyOf = [&](int v, int block)
+	{
+		const IrInstr &in = f.values[v];
+		Key key{in.op, in.text, {}};
+		for (int a : in.args)
+			key.args.push_back(source(a));
+		if (in.op == IrOp::Phi)
+			key.text = to_string(block); // only phis of one block are alike
+		static const unordered_set<string> commutative = {"+", "*", "&", "|", "^", "==", "!="};
+		if (key.args.size() == 2 && commutative.count(in.text) && isNumeric(types[key.args[0]]) &&
+			isNumeric(types[key.args[1]]) && key.args[0] > key.args[1])
+			swap(key.args[0], key.args[1]);
+		return key;
+	};
+
+	unordered_map<Key, int, KeyHash> table;
+	vector<vector<const Key *>> scopes(f.blocks.size());
+	vector<pair<int, size_t>> stack = {{0, 0}};
+	auto enter = [&](int b)
+	{
+		auto visit = [&](int v)
+		{
+			const IrInstr &in = f.values[v];
+			if (in.op == IrOp::Copy || (in.op != IrOp::Phi && !irDeterministic(in, types)))
+				return;
+			auto [it, added] = table.emplace(keyOf(v, b), v);
+			if (added)
+				scopes[b].push_back(&it->first);
+			else
+			{
+				IrInstr &copy = f.values[v];
+				copy.op = IrOp::Copy;
+				copy.text.clear();
+				copy.args = {it->second};
+				redundant++;
+			}
+		};
+		for (int v : f.blocks[b].phis)
+			visit(v);
+		for (int v : f.blocks[b].code)
+			visit(v);
+	};
+	enter(0);
+	while (!stack.empty())
+	{
+		auto &[b, next] = stack.back();
+		if (next < dom.children[b].size())
+		{
+			int c = dom.children[b][next++];
+			enter(c);
+			stack.push_back({c, 0});
+			continue;
+		}
+		for (const Key *key : scopes[b])
+			table.erase(*key);
+		stack.pop_back();
+	}
+
+	// A phi turned into a copy moves to the front of its block's code
+	for (IrBlock &block : f.blocks)
+	{
+		auto copies = stable_partition(block.phis.begin(), block.phis.end(), [&](int v)
+									   { return f.values[v].op == IrOp::Phi; });
+		block.code.insert(block.code.begin(), copies, block.phis.end());
+		block.phis.erase(copies, block.phis.end());
+	}
+	return redundant;
+}
+
+// Moves speculatable instructions whose operands are defined outside a
+// natural loop into the loop's preheader, innermost loops first
+size_t hoistLoopInvariants(IrFunction &f)
+{
+	size_t hoisted = 0;
+	vector<IrType> types = inferIrTypes(f);
+	IrDominators dom(f);
+	map<int, vector<int>> latches; // header -> sources of its back edges
+	for (int b : dom.order)
+		for (int h : f.blocks[b].succs)
+			if (dom.dominates(h, b))
+				latches[h].push_back(b);
+
+	// A loop is the header and the blocks that reach a back edge without
+	// passing through the header
+	vector<pair<int, vector<int>>> loops;
+	vector<int> stamp(f.blocks.size(), -1);
+	for (auto &[header, sources] : latches)
+	{
+		vector<int> body = {header}, work = sources;
+		stamp[header] = header;
+		while (!work.empty())
+		{
+			int x = work.back();
+			work.pop_back();
+			if (stamp[x] == header)
+				continue;
+			stamp[x] = header;
+			body.push_back(x);
+			work.insert(work.end(), f.blocks[x].preds.begin(), f.blocks[x].preds.end());
+		}
+		loops.push_back({header, move(body)});
+	}
+	sort(loops.begin(), loops.end(), [](const auto &a, const auto &b)
+		 { return a.second.size() < b.second.size(); });
+	vector<int> index(f.blocks.size(), -1);
+	for (size_t k = 0; k < dom.order.size(); k++)
+		index[dom.order[k]] = int(k);
+	vector<char> inLoop(f.blocks.size(), 0);
+	for (auto &[header, body] : loops)
+	{
+		for (int b : body)
+			inLoop[b] = 1;
+		int preheader = -1;
+		size_t outside = 0;
+		for (int p : f.blocks[header].preds)
+			if (!inLoop[p])
+			{
+				preheader = p;
+				outside++;
+			}
+		if (outside != 1 || f.blocks[preheader].succs.size() != 1)
+		{
+			for (int b : body)
+				inLoop[b] = 0;
+			continue;
+		}
+		sort(body.begin(), body.end(), [&](int a, int b)
+			 { return index[a] < index[b]; });
+		vector<int> &target = f.blocks[preheader].code;
+		for (int b : body)
+		{
+			vector<int> &code = f.blocks[b].code;
+			size_t kept = 0;
+			for (int v : code)
+			{
+				const IrInstr &in = f.values[v];
+				bool invariant = !isIrTerminator(in.op) && irSpeculatable(in, types) &&
+								 none_of(in.args.begin(), in.args.end(), [&](int a)
+										 { return inLoop[f.values[a].block]; });
+				if (invariant)
+				{
+					target.insert(target.end() - 1, v);
+					f.values[v].block = preheader;
+					hoisted++;
+				}
+				else
+					code[kept++] = v;
+			}
+			code.resize(kept);
+		}
+		for (int b : body)
+			inLoop[b] = 0;
+	}
+	return hoisted;
+}
+
+// A pass returns how many instructions it removed, rewrote or moved
+struct IrPass
+{
+	const char *name;
+	size_t (*run)(IrFunction &f);
+};
+
+static const IrPass irPasses[] = {
+	{"dce", eliminateDeadCode},
+	{"gvn", numberValues},
+	{"copyprop", propagateCopies},
+	{"licm", hoistLoopInvariants},
+};
+
+struct IrPassStats
+{
+	string name;
+	double ms = 0;
+	size_t changed = 0;
+	size_t instructionsBefore = 0, instructionsAfter = 0;
+	size_t blocksBefore = 0, blocksAfter = 0;
+};
+
+// Runs a comma-separated pipeline of passes over every function, timing
+// each pass and the size of the IR around it
+class IrPassManager
+{
+public:
+	explicit IrPassManager(const string &pipeline = "dce,copyprop,gvn,copyprop,licm,dce")
+	{
+		stringstream names(pipeline);
+		for (string name; getline(names, name, ',');)
+		{
+			if (name.empty())
+				continue;
+			auto pass = find_if(begin(irPasses), end(irPasses), [&](const IrPass &p)
+								{ return name == p.name; });
+			if (pass == end(irPasses))
+				throw CompileError("unknown IR pass '" + name + "' (expected dce, gvn, copyprop or licm)");
+			passes.push_back(&*pass);
+		}
+	}
+
+	bool verify = false; // check the IR after every pass
+
+	vector<IrPassStats> run(vector<IrFunction> &functions) const
+	{
+		vector<IrPassStats> stats;
+		for (const IrPass *pass : passes)
+		{
+			IrPassStats s;
+			s.name = pass->name;
+			for (const IrFunction &f : functions)
+			{
+				s.instructionsBefore += f.instructionCount();
+				s.blocksBefore += f.blockCount();
+			}
+			auto start = chrono::steady_clock::now();
+			for (IrFunction &f : functions)
+				s.changed += pass->run(f);
+			s.ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+			for (const IrFunction &f : functions)
+			{
+				s.instructionsAfter += f.instructionCount();
+				s.blocksAfter += f.blockCount();
+				if (verify)
+					verifyIr(f);
+			}
+			stats.push_back(move(s));
+		}
+		return stats;
+	}
+
+private:
+	vector<const IrPass *> passes;
+};
+
+void printIrPassStats(const vector<IrPassStats> &stats, ostream &out)
+{
+	for (const IrPassStats &s : stats)
+		out << "  " << s.name << ": " << fixed << setprecision(3) << s.ms << " ms, " << s.changed << " changed, instructions "
+			<< s.instructionsBefore << " -> " << s.instructionsAfter << ", blocks " << s.blocksBefore
+			<< " -> " << s.blocksAfter << "\n"
+			<< defaultfloat;
+}
+
+int printIrFile(const string &path, const string &pipeline)
+{
+	SymbolTable symTable;
+	ParseTreeNode *root = parseForExecution(readFile(path), symTable);
+	if (!root)
+		return 1;
+	try
+	{
+		IrPassManager passes(pipeline);
+		passes.verify = true;
+		IrBuilder builder;
+		auto start = chrono::steady_clock::now();
+		builder.lowerModule(root);
+		double buildMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+		size_t instructions = 0, blocks = 0;
+		for (const IrFunction &f : builder.functions)
+		{
+			instructions += f.instructionCount();
+			blocks += f.blockCount();
+			verifyIr(f);
+		}
+		vector<IrPassStats> stats = passes.run(builder.functions);
+		for (const IrFunction &f : builder.functions)
+		{
+			printIr(f, cout);
+			cout << "\n";
+		}
+		cout << builder.functions.size() << " functions, SSA construction " << fixed << setprecision(3) << buildMs
+			 << " ms, " << instructions << " instructions, " << blocks << " blocks\n"
+			 << defaultfloat;
+		printIrPassStats(stats, cout);
+	}
+	catch (const CompileError &e)
+	{
+		cerr << "Compile error: " << e.what() << endl;
+		return 1;
+	}
+	return 0;
+}
+
+// One def of about 14 lines per group, with branches, loops, breaks and
+// a try statement in every group
+string generateIrBenchFunction(size_t groups)
+{
+	string out = "def big(a, b):\n    x = a\n    y = b\n    z = 0\n";
+	out.reserve(groups * 300);
+	for (size_t n = 0; n < groups; n++)
+	{
+		string id = to_string(n);
+		out += "    x = x + " + id + "\n";
+		out += "    if x > y:\n";
+		out += "        y = y + x * 2\n";
+		out += "    elif x == y:\n";
+		out += "        z = z - 1\n";
+		out += "    else:\n";
+		out += "        y = y - 1\n";
+		out += "    while y > 100:\n";
+		out += "        y = y - x * 2.5\n";
+		out += "        if y < " + id + ":\n";
+		out += "            break\n";
+		out += "    for k in range(3):\n";
+		out += "        z = z + k * 0.5\n";
+		out += "    try:\n";
+		out += "        z = x / y\n";
+		out += "    except ZeroDivisionError:\n";
+		out += "        z = 0\n";
+	}
+	out += "    return x + y + z\n";
+	return out;
+}
+
+void benchmarkIr(size_t maxGroups)
+{
+	cout << "SSA IR benchmark (one function, best of 3)\n";
+	for (size_t groups = max<size_t>(1, maxGroups / 16); groups <= maxGroups; groups *= 2)
+	{
+		SymbolTable symTable;
+		string source = generateIrBenchFunction(groups);
+		ParseTreeNode *root = parseForExecution(source, symTable);
+		if (!root)
+			return;
+		double best = 1e300, passMs = 0;
+		size_t built = 0, optimized = 0, blocks = 0;
+		for (int rep = 0; rep < 3; rep++)
+		{
+			IrBuilder builder;
+			auto start = chrono::steady_clock::now();
+			builder.lowerModule(root);
+			best = min(best, chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+			built = builder.functions.back().instructionCount();
+			blocks = builder.functions.back().blockCount();
+			passMs = 0;
+			for (const IrPassStats &s : IrPassManager().run(builder.functions))
+				passMs += s.ms;
+			optimized = builder.functions.back().instructionCount();
+		}
+		cout << "  " << groups * 17 + 5 << " lines: " << built << " instructions, " << blocks << " blocks, build "
+			 << best << " ms (" << best * 1e6 / built << " ns/instruction), passes " << passMs << " ms -> "
+			 << optimized << " instructions\n";
+		deleteTree(root);
+	}
+}
+} // namespace pyc::detail
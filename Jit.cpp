@@ -0,0 +1,1899 @@
+#include "Engines.h"
+#ifdef __unix__
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#endif
+
+namespace pyc::detail
+{
+// ----------------------------------------------
+// x86-64 JIT
+// ----------------------------------------------
+// --engine=jit runs the functions the C transpiler accepts as x86-64
+// machine code generated in process, without a C compiler. Each function
+// is lowered from its typed tree to a three-address IR over virtual
+// registers, registers are assigned by linear scan over live intervals, and
+// the code is written into mmap'd memory that is made executable once it
+// is complete. The result plugs into the VM exactly like transpiled C: a
+// NativeObject per function whose entry checks nothing itself, with the VM
+// falling back to bytecode when the argument tags do not match. Integer
+// overflow, division by zero and the recursion limit raise the same
+// exceptions as the VM; the machine code calls helpers that longjmp back
+// to the entry point, which turns them into a NativeStatus.
+#if defined(__x86_64__) && defined(__unix__)
+#define PYC_HAVE_JIT 1
+#endif
+
+#ifdef PYC_HAVE_JIT
+static jmp_buf *jitErrorTarget;
+static const char *jitMessage;
+static long long jitDepth;
+const long long jitMaxDepth = 2000; // the VM's limit
+
+[[noreturn]] static void jitRaise(long long status, const char *message)
+{
+	jitMessage = message;
+	longjmp(*jitErrorTarget, int(status));
+}
+
+// Out-of-line operations; same results and errors as the transpiler's prelude
+static long long jitFloorDiv(long long a, long long b)
+{
+	if (b == 0)
+		jitRaise(NativeZeroDivision, "integer division or modulo by zero");
+	if (a == LLONG_MIN && b == -1)
+		jitRaise(NativeOverflow, "integer result too large");
+	long long q = a / b;
+	if ((a % b != 0) && ((a < 0) != (b < 0)))
+		q--;
+	return q;
+}
+
+static double jitTrueDiv(long long a, long long b)
+{
+	if (b == 0)
+		jitRaise(NativeZeroDivision, "division by zero");
+	return double(a) / double(b);
+}
+
+static long long jitPow(long long base, long long exponent)
+{
+	long long result = 1;
+	for (; exponent > 0; exponent >>= 1)
+	{
+		if ((exponent & 1) && __builtin_mul_overflow(result, base, &result))
+			jitRaise(NativeOverflow, "integer result too large");
+		if (exponent > 1 && __builtin_mul_overflow(base, base, &base))
+			jitRaise(NativeOverflow, "integer result too large");
+	}
+	return result;
+}
+
+static long long jitShift(long long x, long long n, long long left)
+{
+	if (n < 0)
+		jitRaise(NativeValueError, "negative shift count");
+	if (!left)
+		return n >= 64 ? (x < 0 ? -1 : 0) : x >> n;
+	long long shifted = n >= 63 ? 0 : (long long)((unsigned long long)x << n); // x << n is undefined for negative x in C++17
+	if (n >= 63 || (shifted >> n) != x)
+		jitRaise(NativeOverflow, "integer result too large");
+	return shifted;
+}
+
+static long long jitAbs(long long a)
+{
+	if (a == LLONG_MIN)
+		jitRaise(NativeOverflow, "integer result too large");
+	return a < 0 ? -a : a;
+}
+
+static double jitFabs(double a) { return fabs(a); }
+
+static double jitFmod(double a, double b)
+{
+	if (b == 0.0)
+		jitRaise(NativeZeroDivision, "float modulo");
+	double r = fmod(a, b);
+	if (r != 0 && ((r < 0) != (b < 0)))
+		r += b;
+	return r;
+}
+
+static double jitFloorDivFloat(double a, double b)
+{
+	if (b == 0.0)
+		jitRaise(NativeZeroDivision, "float floor division by zero");
+	return floor(a / b);
+}
+
+static double jitPowFloat(double a, double b)
+{
+	if (a == 0.0 && b < 0)
+		jitRaise(NativeZeroDivision, "0.0 cannot be raised to a negative power");
+	return pow(a, b);
+}
+
+static long long jitTrunc(double d)
+{
+	if (!isfinite(d) || fabs(d) >= 9.2e18)
+		jitRaise(NativeOverflow, "cannot convert float to integer");
+	return (long long)d;
+}
+
+static long long jitMinInt(long long a, long long b) { return b < a ? b : a; }
+static long long jitMaxInt(long long a, long long b) { return b > a ? b : a; }
+static double jitMinFloat(double a, double b) { return b < a ? b : a; }
+static double jitMaxFloat(double a, double b) { return b > a ? b : a; }
+
+static long long jitRangeStep(long long step)
+{
+	if (step == 0)
+		jitRaise(NativeValueError, "range() arg 3 must not be zero");
+	return step;
+}
+
+// Calls 'adapter' (generated code that unpacks the slots and calls the
+// function) with errors turned into a NativeStatus
+struct JitEntryInfo
+{
+	void (*adapter)(const NativeSlot *args, NativeSlot *result);
+};
+
+static int jitInvoke(const JitEntryInfo *info, const NativeSlot *args, NativeSlot *result, const char **message)
+{
+	jmp_buf target;
+	jmp_buf *outer = jitErrorTarget;
+	long long depth = jitDepth;
+	jitErrorTarget = &target;
+	int status = setjmp(target);
+	if (status == 0)
+	{
+		jitDepth = 0;
+		info->adapter(args, result);
+	}
+	else
+		*message = jitMessage;
+	jitErrorTarget = outer;
+	jitDepth = depth;
+	return status;
+}
+
+// --- IR -------------------------------------------------------------------
+
+enum class JitOp : uint8_t
+{
+	Params,	   // defines the parameters (first instruction)
+	Label,	   // label
+	Jump,	   // goto label
+	Branch,	   // if ((x cond y) == sense) goto label
+	Const,	   // d = imm / fimm
+	Move,	   // d = x
+	Add,	   // d = x + y; overflow raises for ints
+	Sub,	   //
+	Mul,	   //
+	And,	   // ints only
+	Or,		   //
+	Xor,	   //
+	Neg,	   // d = -x; overflow raises for ints
+	Not,	   // d = ~x
+	Divide,	   // d = x / y for floats; zero raises
+	Mod,	   // d = x % y for ints, with the sign of y; zero raises
+	ToFloat,   // d = (double)x
+	RangeNext, // d = x + y, or z when that overflows
+	Call,	   // d = callee(args) or helper(args)
+	Return	   // return x
+};
+
+enum class JitCond : uint8_t
+{
+	Eq,
+	Ne,
+	Lt,
+	Le,
+	Gt,
+	Ge
+};
+
+struct JitInstr
+{
+	JitOp op;
+	JitCond cond = JitCond::Eq;
+	bool floats = false; // operands are doubles
+	bool hasImm = false; // y is 'imm' (an int32)
+	bool sense = true;
+	int d = -1, x = -1, y = -1, z = -1;
+	int label = -1;
+	long long imm = 0;
+	double fimm = 0;
+	int callee = -1;			 // JIT function index, or -1 for 'helper'
+	const void *helper = nullptr; //
+	vector<int> args = {};
+};
+
+struct JitFunctionIR
+{
+	string name;
+	vector<JitInstr> code;
+	vector<char> isFloat; // per virtual register
+	int params = 0;		  // registers 0..params-1 are the parameters
+	int labels = 0;
+	bool returnsFloat = false;
+};
+
+// --- lowering -------------------------------------------------------------
+
+// Lowers one typed function to IR. The transpiler has already checked that
+// the body only uses what it can translate and typed every variable; the
+// lowering follows the same tree shapes.
+class JitLowering
+{
+public:
+	JitLowering(const vector<TypedFunction> &all, const unordered_map<string, size_t> &callable)
+		: functions(all), index(callable) {}
+
+	JitFunctionIR lower(const TypedFunction &f)
+	{
+		fn = &f;
+		ir = JitFunctionIR();
+		ir.name = f.name;
+		ir.returnsFloat = f.result == CType::Float;
+		variables.clear();
+		loops.clear();
+		countRegisterArgs(f.params, f.types, "has");
+		for (const string &param : f.params)
+			variables[param] = newRegister(f.types.at(param));
+		ir.params = int(f.params.size());
+		for (const auto &[name, type] : f.types)
+			if (!variables.count(name))
+				variables[name] = newRegister(type);
+		emit({JitOp::Params});
+		lowerBlock(f.node->children.back());
+		// The transpiler only accepts bodies that always return, so this is never reached
+		JitInstr end{JitOp::Return};
+		end.x = ir.returnsFloat ? constantFloat(0.0).reg : constant(ConstValue::makeInt(0)).reg;
+		emit(end);
+		return move(ir);
+	}
+
+private:
+	struct Value
+	{
+		int reg;
+		CType type;
+	};
+
+	const vector<TypedFunction> &functions;
+	const unordered_map<string, size_t> &index;
+	const TypedFunction *fn = nullptr;
+	JitFunctionIR ir;
+	unordered_map<string, int> variables;
+	vector<pair<int, int>> loops; // break label, continue label
+
+	[[noreturn]] static void unsupported(const string &what) { throw CompileError(what); }
+
+	// The System V ABI passes 6 integer and 8 float arguments in registers
+	static void countRegisterArgs(const vector<string> &params, const unordered_map<string, CType> &types, const string &what)
+	{
+		size_t floats = count_if(params.begin(), params.end(), [&](const string &p)
+								 { return types.at(p) == CType::Float; });
+		if (params.size() - floats > 6 || floats > 8)
+			unsupported(what + " more parameters than fit in argument registers");
+	}
+
+	int newRegister(CType type)
+	{
+		ir.isFloat.push_back(type == CType::Float);
+		return int(ir.isFloat.size() - 1);
+	}
+
+	int newLabel() { return ir.labels++; }
+
+	void emit(JitInstr instr) { ir.code.push_back(move(instr)); }
+
+	void label(int l)
+	{
+		JitInstr i{JitOp::Label};
+		i.label = l;
+		emit(i);
+	}
+
+	void jump(int l)
+	{
+		JitInstr i{JitOp::Jump};
+		i.label = l;
+		emit(i);
+	}
+
+	Value constant(const ConstValue &v)
+	{
+		JitInstr i{JitOp::Const};
+		CType type = v.kind == ConstValue::Kind::Float ? CType::Float : v.kind == ConstValue::Kind::Bool ? CType::Bool
+																										: CType::Int;
+		i.d = newRegister(type);
+		i.imm = v.i;
+		i.fimm = v.f;
+		i.floats = type == CType::Float;
+		emit(i);
+		return {i.d, type};
+	}
+
+	Value constantFloat(double f)
+	{
+		ConstValue v;
+		v.kind = ConstValue::Kind::Float;
+		v.f = f;
+		return constant(v);
+	}
+
+	Value unary(JitOp op, Value x, CType type)
+	{
+		JitInstr i{op};
+		i.d = newRegister(type);
+		i.x = x.reg;
+		i.floats = type == CType::Float;
+		emit(i);
+		return {i.d, type};
+	}
+
+	Value binaryOp(JitOp op, Value x, Value y, CType type)
+	{
+		JitInstr i{op};
+		i.d = newRegister(type);
+		i.x = x.reg;
+		i.y = y.reg;
+		i.floats = x.type == CType::Float;
+		emit(i);
+		return {i.d, type};
+	}
+
+	Value call(const void *helper, int callee, const vector<Value> &args, CType result)
+	{
+		JitInstr i{JitOp::Call};
+		i.d = newRegister(result);
+		i.helper = helper;
+		i.callee = callee;
+		for (const Value &arg : args)
+			i.args.push_back(arg.reg);
+		emit(i);
+		return {i.d, result};
+	}
+
+	Value asFloat(Value v) { return v.type == CType::Float ? v : unary(JitOp::ToFloat, v, CType::Float); }
+
+	static bool smallInt(const ParseTreeNode *node, long long &out)
+	{
+		ConstValue v;
+		if (!node || !literalOf(node, v) || (v.kind != ConstValue::Kind::Int && v.kind != ConstValue::Kind::Bool))
+			return false;
+		out = v.i;
+		return v.i >= INT32_MIN && v.i <= INT32_MAX;
+	}
+
+	// --- statements ---
+
+	void lowerBlock(ParseTreeNode *block)
+	{
+		for (ParseTreeNode *child : block->children)
+			lowerStatement(child);
+	}
+
+	void lowerStatement(ParseTreeNode *node)
+	{
+		const string &kind = node->label;
+		if (CTranspiler::isLeaf(node) || kind == "pass_statement")
+			return;
+		if (kind == "statement")
+			lowerStatement(node->children[0]);
+		else if (kind == "assignment")
+			lowerAssignment(node);
+		else if (kind == "conditional_statement")
+		{
+			int end = newLabel();
+			ParseTreeNode *test = node->children[1], *body = node->children[3];
+			for (size_t k = 4;; k++)
+			{
+				int next = newLabel();
+				branch(test, false, next);
+				lowerBlock(body);
+				jump(end);
+				label(next);
+				if (k >= node->children.size())
+					break;
+				ParseTreeNode *part = node->children[k];
+				if (part->label == "elif_clause")
+					test = part->children[1], body = part->children[3];
+				else
+				{
+					lowerBlock(part->children[2]);
+					break;
+				}
+			}
+			label(end);
+		}
+		else if (kind == "while_statement")
+		{
+			// Rotated: the test sits at the bottom, one branch per iteration
+			int body = newLabel(), test = newLabel(), end = newLabel();
+			jump(test);
+			label(body);
+			loops.push_back({end, test});
+			lowerBlock(node->children[3]);
+			loops.pop_back();
+			label(test);
+			branch(node->children[1], true, body);
+			label(end);
+		}
+		else if (kind == "for_statement")
+			lowerFor(node);
+		else if (kind == "return_statement")
+		{
+			JitInstr i{JitOp::Return};
+			i.x = expr(node->children[1]).reg;
+			emit(i);
+		}
+		else if (kind == "break_statement")
+			jump(loops.back().first);
+		else if (kind == "continue_statement")
+			jump(loops.back().second);
+		else if (kind == "factor" && node->children.size() == 1 && classifyLeaf(node->children[0]->label) == LeafKind::String)
+			return; // docstring
+		else if (kind == "function_call")
+			lowerCall(node->children[0], CTranspiler::argumentsOf(node));
+		else if (kind == "factor")
+			expr(node);
+		else
+			unsupported("uses " + kind);
+	}
+
+	// Stores 'value' into 'name', retargeting the instruction that computed it when it can
+	void assign(const string &name, Value value)
+	{
+		int target = variables.at(name);
+		if (value.reg == target)
+			return;
+		JitInstr &last = ir.code.back();
+		if (last.d == value.reg && value.reg >= int(variables.size()) && last.op != JitOp::Label)
+		{
+			last.d = target;
+			return;
+		}
+		JitInstr i{JitOp::Move};
+		i.d = target;
+		i.x = value.reg;
+		i.floats = ir.isFloat[target];
+		emit(i);
+	}
+
+	void lowerAssignment(ParseTreeNode *node)
+	{
+		auto [targets, values, op] = splitAssignment(node);
+		if (op != "=")
+		{
+			const string &name = targets[0]->label;
+			assign(name, binary(op.substr(0, op.size() - 1), load(name), values[0]));
+			return;
+		}
+		if (targets.size() == 1)
+		{
+			assign(targets[0]->label, expr(values[0]));
+			return;
+		}
+		// Every value is computed before any target is bound
+		vector<Value> computed;
+		for (ParseTreeNode *value : values)
+		{
+			Value v = expr(value);
+			if (v.reg < int(variables.size()))
+				v = unary(JitOp::Move, v, v.type); // a, b = b, a
+			computed.push_back(v);
+		}
+		for (size_t k = 0; k < targets.size(); k++)
+		{
+			JitInstr i{JitOp::Move};
+			i.d = variables.at(targets[k]->label);
+			i.x = computed[k].reg;
+			i.floats = ir.isFloat[i.d];
+			emit(i);
+		}
+	}
+
+	void lowerFor(ParseTreeNode *node)
+	{
+		ParseTreeNode *iterable = node->children[3];
+		while (iterable->children.size() == 1 && iterable->folded.empty())
+			iterable = iterable->children[0];
+		vector<ParseTreeNode *> argNodes;
+		for (ParseTreeNode *arg : iterable->children[2]->children)
+			if (arg->label == "expression")
+				argNodes.push_back(arg);
+
+		// start, stop and step are evaluated once, before the loop
+		Value start = argNodes.size() > 1 ? expr(argNodes[0]) : constant(ConstValue::makeInt(0));
+		Value stop = expr(argNodes.size() > 1 ? argNodes[1] : argNodes[0]);
+		if (stop.reg < int(variables.size()))
+			stop = unary(JitOp::Move, stop, CType::Int); // the body may rebind it
+		long long constantStep = 1;
+		bool knownStep = argNodes.size() < 3 || (smallInt(argNodes[2], constantStep) && constantStep != 0);
+		Value step{-1, CType::Int};
+		if (!knownStep)
+			step = call(reinterpret_cast<const void *>(&jitRangeStep), -1, {expr(argNodes[2])}, CType::Int);
+		Value counter = unary(JitOp::Move, start, CType::Int);
+
+		int body = newLabel(), next = newLabel(), test = newLabel(), end = newLabel();
+		jump(test);
+		label(body);
+		assign(node->children[1]->label, unary(JitOp::Move, counter, CType::Int));
+		loops.push_back({end, next});
+		lowerBlock(node->children[5]);
+		loops.pop_back();
+		label(next);
+		JitInstr advance{JitOp::RangeNext};
+		advance.d = counter.reg;
+		advance.x = counter.reg;
+		advance.z = stop.reg;
+		if (knownStep)
+			advance.hasImm = true, advance.imm = constantStep;
+		else
+			advance.y = step.reg;
+		emit(advance);
+		label(test);
+		auto loopIf = [&](JitCond cond)
+		{
+			JitInstr i{JitOp::Branch};
+			i.cond = cond;
+			i.x = counter.reg;
+			i.y = stop.reg;
+			i.label = body;
+			emit(i);
+		};
+		if (knownStep)
+			loopIf(constantStep > 0 ? JitCond::Lt : JitCond::Gt);
+		else
+		{
+			int down = newLabel();
+			JitInstr sign{JitOp::Branch};
+			sign.cond = JitCond::Lt;
+			sign.x = step.reg;
+			sign.hasImm = true;
+			sign.label = down;
+			emit(sign);
+			loopIf(JitCond::Lt);
+			jump(end);
+			label(down);
+			loopIf(JitCond::Gt);
+		}
+		label(end);
+	}
+
+	// --- conditions ---
+
+	static JitCond comparisonCond(const string &op)
+	{
+		static const unordered_map<string, JitCond> conds = {
+			{"==", JitCond::Eq}, {"!=", JitCond::Ne}, {"<", JitCond::Lt}, {"<=", JitCond::Le}, {">", JitCond::Gt}, {">=", JitCond::Ge}};
+		return conds.at(op);
+	}
+
+	static bool isComparisonOp(const string &text)
+	{
+		return text == "<" || text == "<=" || text == ">" || text == ">=" || text == "==" || text == "!=";
+	}
+
+	void compareBranch(Value x, Value y, JitCond cond, bool sense, int target)
+	{
+		bool floats = x.type == CType::Float || y.type == CType::Float;
+		if (floats)
+			x = asFloat(x), y = asFloat(y);
+		JitInstr i{JitOp::Branch};
+		i.cond = cond;
+		i.floats = floats;
+		i.sense = sense;
+		i.x = x.reg;
+		i.y = y.reg;
+		i.label = target;
+		emit(i);
+	}
+
+	// Jumps to 'target' when the truth of 'node' equals 'sense'
+	void branch(ParseTreeNode *node, bool sense, int target)
+	{
+		ConstValue v;
+		if (literalOf(node, v))
+		{
+			bool truth = v.kind == ConstValue::Kind::Float ? v.f != 0.0 : v.i != 0;
+			if (truth == sense)
+				jump(target);
+			return;
+		}
+		while (node->children.size() == 1 && node->label != "factor")
+			node = node->children[0];
+		const auto &c = node->children;
+		if (node->label == "or_expression" || node->label == "and_expression")
+		{
+			// 'or' jumps on the first true operand, 'and' on the first false one
+			bool shortCircuit = node->label == "or_expression";
+			int skip = newLabel();
+			for (size_t k = 0; k < c.size(); k += 2)
+			{
+				if (k + 1 == c.size())
+					branch(c[k], sense, target);
+				else if (shortCircuit == sense)
+					branch(c[k], sense, target);
+				else
+					branch(c[k], !sense, skip);
+			}
+			label(skip);
+			return;
+		}
+		if (node->label == "not_expression" || (node->label == "factor" && c.size() == 2 && c[0]->label == "not"))
+		{
+			branch(c[1], !sense, target);
+			return;
+		}
+		Value value;
+		if (node->label == "comparison" && c.size() > 1)
+		{
+			// Operators like '|' that the grammar places at this level fold into their operands
+			vector<Value> operands = {expr(c[0])};
+			vector<JitCond> conds;
+			for (size_t k = 1; k + 1 < c.size(); k += 2)
+			{
+				string text = comparisonOperator(c[k]);
+				if (isComparisonOp(text))
+				{
+					conds.push_back(comparisonCond(text));
+					operands.push_back(expr(c[k + 1]));
+				}
+				else
+					operands.back() = binary(text, operands.back(), c[k + 1]);
+			}
+			if (!conds.empty())
+			{
+				// A chain holds when every link does
+				int skip = newLabel();
+				for (size_t k = 0; k < conds.size(); k++)
+				{
+					if (k + 1 == conds.size())
+						compareBranch(operands[k], operands[k + 1], conds[k], sense, target);
+					else
+						compareBranch(operands[k], operands[k + 1], conds[k], false, sense ? skip : target);
+				}
+				label(skip);
+				return;
+			}
+			value = operands[0];
+		}
+		else
+			value = expr(node);
+		if (value.type == CType::Float)
+		{
+			compareBranch(value, constantFloat(0.0), JitCond::Ne, sense, target);
+			return;
+		}
+		JitInstr i{JitOp::Branch};
+		i.cond = JitCond::Ne;
+		i.sense = sense;
+		i.x = value.reg;
+		i.hasImm = true;
+		i.label = target;
+		emit(i);
+	}
+
+	// 0 or 1 from a condition
+	Value truthValue(ParseTreeNode *node)
+	{
+		Value result = constant(ConstValue::makeBool(false));
+		int done = newLabel();
+		branch(node, false, done);
+		JitInstr one{JitOp::Const};
+		one.d = result.reg;
+		one.imm = 1;
+		emit(one);
+		label(done);
+		return {result.reg, CType::Bool};
+	}
+
+	// --- expressions ---
+
+	Value load(const string &name)
+	{
+		auto it = variables.find(name);
+		if (it == variables.end())
+			unsupported("reads global '" + name + "'");
+		return {it->second, fn->types.at(name)};
+	}
+
+	Value expr(ParseTreeNode *node)
+	{
+		ConstValue v;
+		if (literalOf(node, v))
+			return constant(v);
+		const string &kind = node->label;
+		const auto &c = node->children;
+		if (c.size() == 1 && kind != "factor")
+			return expr(c[0]);
+		if (kind == "or_expression" || kind == "and_expression" || kind == "not_expression")
+			return truthValue(node);
+		if (kind == "comparison")
+			return comparison(node);
+		if (kind == "arithmetic" || kind == "term")
+		{
+			Value acc = expr(c[0]);
+			for (size_t k = 1; k + 1 < c.size(); k += 2)
+				acc = binary(c[k]->label, acc, c[k + 1]);
+			return acc;
+		}
+		if (kind == "factor")
+			return factor(node);
+		unsupported("uses " + kind);
+	}
+
+	Value comparison(ParseTreeNode *node)
+	{
+		const auto &c = node->children;
+		for (size_t k = 1; k + 1 < c.size(); k += 2)
+			if (isComparisonOp(comparisonOperator(c[k])))
+				return truthValue(node);
+		// Only operators like '|' that the grammar places at this level
+		Value acc = expr(c[0]);
+		for (size_t k = 1; k + 1 < c.size(); k += 2)
+			acc = binary(comparisonOperator(c[k]), acc, c[k + 1]);
+		return acc;
+	}
+
+	Value binary(const string &op, Value a, ParseTreeNode *rightNode)
+	{
+		long long small = 0;
+		bool immediate = a.type != CType::Float && smallInt(rightNode, small) &&
+						 (op == "+" || op == "-" || op == "*" || op == "&" || op == "|" || op == "^" || (op == "%" && small != 0));
+		if (immediate)
+		{
+			static const unordered_map<string, JitOp> ops = {
+				{"+", JitOp::Add}, {"-", JitOp::Sub}, {"*", JitOp::Mul}, {"&", JitOp::And}, {"|", JitOp::Or}, {"^", JitOp::Xor}, {"%", JitOp::Mod}};
+			ConstValue literal;
+			literalOf(rightNode, literal);
+			bool bools = a.type == CType::Bool && literal.kind == ConstValue::Kind::Bool && (op == "&" || op == "|" || op == "^");
+			JitInstr i{ops.at(op)};
+			i.d = newRegister(bools ? CType::Bool : CType::Int);
+			i.x = a.reg;
+			i.hasImm = true;
+			i.imm = small;
+			emit(i);
+			return {i.d, bools ? CType::Bool : CType::Int};
+		}
+		Value b = expr(rightNode);
+		bool floats = a.type == CType::Float || b.type == CType::Float;
+		if (op == "&" || op == "|" || op == "^")
+		{
+			CType type = a.type == CType::Bool && b.type == CType::Bool ? CType::Bool : CType::Int;
+			return binaryOp(op == "&" ? JitOp::And : op == "|" ? JitOp::Or : JitOp::Xor, a, b, type);
+		}
+		if (op == "<<" || op == ">>")
+			return call(reinterpret_cast<const void *>(&jitShift), -1, {a, b, constant(ConstValue::makeInt(op == "<<"))}, CType::Int);
+		if (op == "/")
+		{
+			if (!floats)
+				return call(reinterpret_cast<const void *>(&jitTrueDiv), -1, {a, b}, CType::Float);
+			return binaryOp(JitOp::Divide, asFloat(a), asFloat(b), CType::Float);
+		}
+		if (floats)
+		{
+			Value x = asFloat(a), y = asFloat(b);
+			if (op == "+" || op == "-" || op == "*")
+				return binaryOp(op == "+" ? JitOp::Add : op == "-" ? JitOp::Sub : JitOp::Mul, x, y, CType::Float);
+			const void *helper = op == "%" ? reinterpret_cast<const void *>(&jitFmod) : op == "//" ? reinterpret_cast<const void *>(&jitFloorDivFloat)
+																								   : reinterpret_cast<const void *>(&jitPowFloat);
+			return call(helper, -1, {x, y}, CType::Float);
+		}
+		if (op == "+" || op == "-" || op == "*" || op == "%")
+			return binaryOp(op == "+" ? JitOp::Add : op == "-" ? JitOp::Sub : op == "*" ? JitOp::Mul : JitOp::Mod, a, b, CType::Int);
+		const void *helper = op == "//" ? reinterpret_cast<const void *>(&jitFloorDiv) : reinterpret_cast<const void *>(&jitPow);
+		return call(helper, -1, {a, b}, CType::Int);
+	}
+
+	Value factor(ParseTreeNode *node)
+	{
+		const auto &c = node->children;
+		ParseTreeNode *first = c[0];
+		if (CTranspiler::isLeaf(first) && c.size() == 1)
+			return load(first->label);
+		if (CTranspiler::isLeaf(first) && c.size() == 2 && c[1]->label == "factor")
+		{
+			if (first->label == "not")
+				return truthValue(node);
+			Value operand = expr(c[1]);
+			if (first->label == "+")
+				return operand.type == CType::Float ? operand : Value{operand.reg, CType::Int};
+			if (first->label == "~")
+				return unary(JitOp::Not, operand, CType::Int);
+			return unary(JitOp::Neg, operand, operand.type == CType::Float ? CType::Float : CType::Int);
+		}
+		if (c.size() > 1 && c[1]->label == "(")
+			return lowerCall(first, c.size() > 3 ? c[2] : nullptr);
+		for (ParseTreeNode *part : first->children)
+			if (part->label == "expression")
+				return expr(part); // parenthesized
+		unsupported("uses " + first->label);
+	}
+
+	Value lowerCall(ParseTreeNode *callee, ParseTreeNode *arguments)
+	{
+		const string &name = callee->label;
+		vector<Value> args;
+		if (arguments)
+			for (ParseTreeNode *arg : arguments->children)
+				if (arg->label == "expression")
+					args.push_back(expr(arg));
+		auto target = index.find(name);
+		if (target != index.end() && !variables.count(name))
+		{
+			const TypedFunction &g = functions[target->second];
+			return call(nullptr, int(target->second), args, g.result);
+		}
+		if (!functions.empty() && find_if(functions.begin(), functions.end(), [&](const TypedFunction &g)
+										  { return g.name == name; }) != functions.end())
+			unsupported("calls '" + name + "', which the JIT could not compile");
+		auto helper = [](auto *function)
+		{ return reinterpret_cast<const void *>(function); };
+		bool floats = !args.empty() && args[0].type == CType::Float;
+		if (name == "abs")
+			return floats ? call(helper(&jitFabs), -1, args, CType::Float) : call(helper(&jitAbs), -1, args, CType::Int);
+		if (name == "int")
+			return floats ? call(helper(&jitTrunc), -1, args, CType::Int) : Value{args[0].reg, CType::Int};
+		if (name == "float")
+			return asFloat(args[0]);
+		if (name == "bool")
+		{
+			Value result = constant(ConstValue::makeBool(false));
+			int done = newLabel();
+			if (floats)
+				compareBranch(args[0], constantFloat(0.0), JitCond::Eq, true, done);
+			else
+			{
+				JitInstr zero{JitOp::Branch};
+				zero.cond = JitCond::Eq;
+				zero.x = args[0].reg;
+				zero.hasImm = true;
+				zero.label = done;
+				emit(zero);
+			}
+			JitInstr one{JitOp::Const};
+			one.d = result.reg;
+			one.imm = 1;
+			emit(one);
+			label(done);
+			return {result.reg, CType::Bool};
+		}
+		if (name == "min" || name == "max")
+		{
+			if (floats)
+				return call(helper(name == "min" ? &jitMinFloat : &jitMaxFloat), -1, args, CType::Float);
+			return call(helper(name == "min" ? &jitMinInt : &jitMaxInt), -1, args, CType::Int);
+		}
+		unsupported("calls '" + name + "'");
+	}
+};
+
+// --- register allocation --------------------------------------------------
+
+enum JitRegister
+{
+	RAX,
+	RCX,
+	RDX,
+	RBX,
+	RSP,
+	RBP,
+	RSI,
+	RDI,
+	R8,
+	R9,
+	R10,
+	R11,
+	R12,
+	R13,
+	R14,
+	R15
+};
+
+// rax, rcx, rdx, r11, xmm14 and xmm15 are scratch for the code generator;
+// rdx and rcx double as argument registers and are never allocated
+const int jitCallerSaved[] = {RSI, RDI, R8, R9, R10};
+const int jitCalleeSaved[] = {RBX, R12, R13, R14, R15};
+const int jitIntArgs[] = {RDI, RSI, RDX, RCX, R8, R9};
+const int jitAllocatableXmm = 14;
+const int XMM14 = 14, XMM15 = 15;
+
+// A machine register (GPR or XMM by the register's type) or a frame slot
+struct JitLocation
+{
+	bool inRegister = false;
+	int reg = 0;
+	int slot = -1;
+};
+
+struct JitAllocation
+{
+	vector<JitLocation> locations; // per virtual register
+	vector<int> zeroAtEntry;	   // locals that may be read before any assignment
+	vector<int> calleeSaved;	   // used callee-saved registers, to push and pop
+	int slots = 0;
+};
+
+template <typename F>
+static void forEachUse(const JitInstr &i, F f)
+{
+	for (int v : {i.x, i.y, i.z})
+		if (v >= 0)
+			f(v);
+	for (int v : i.args)
+		f(v);
+}
+
+// Live intervals from block-level liveness, then linear scan (Poletto and
+// Sarkar): intervals in order of start, each taking a free register or the
+// one of the active interval that ends last, which is spilled instead.
+// Values live across a call only get callee-saved registers, or a slot.
+JitAllocation allocateRegisters(const JitFunctionIR &ir)
+{
+	size_t n = ir.code.size(), vregs = ir.isFloat.size(), words = (vregs + 63) / 64;
+	struct Block
+	{
+		size_t begin, end;
+		vector<int> successors;
+		vector<uint64_t> use, def, in, out;
+	};
+	vector<Block> blocks;
+	vector<int> blockOfLabel(ir.labels, -1);
+	for (size_t k = 0; k < n; k++)
+	{
+		JitOp previous = k ? ir.code[k - 1].op : JitOp::Jump;
+		if (ir.code[k].op == JitOp::Label || previous == JitOp::Jump || previous == JitOp::Branch || previous == JitOp::Return)
+		{
+			if (!blocks.empty())
+				blocks.back().end = k;
+			blocks.push_back({k, n, {}, vector<uint64_t>(words), vector<uint64_t>(words), vector<uint64_t>(words), vector<uint64_t>(words)});
+		}
+		if (ir.code[k].op == JitOp::Label)
+			blockOfLabel[ir.code[k].label] = int(blocks.size() - 1);
+	}
+	auto test = [](const vector<uint64_t> &set, int v)
+	{ return (set[v >> 6] >> (v & 63)) & 1; };
+	auto add = [](vector<uint64_t> &set, int v)
+	{ set[v >> 6] |= uint64_t(1) << (v & 63); };
+	for (size_t b = 0; b < blocks.size(); b++)
+	{
+		Block &block = blocks[b];
+		for (size_t k = block.begin; k < block.end; k++)
+		{
+			const JitInstr &i = ir.code[k];
+			forEachUse(i, [&](int v)
+					   { if (!test(block.def, v)) add(block.use, v); });
+			if (i.op == JitOp::Params)
+				for (int v = 0; v < ir.params; v++)
+					add(block.def, v);
+			if (i.d >= 0)
+				add(block.def, i.d);
+		}
+		const JitInstr &last = ir.code[block.end - 1];
+		if (last.op == JitOp::Jump || last.op == JitOp::Branch)
+			block.successors.push_back(blockOfLabel[last.label]);
+		if (last.op != JitOp::Jump && last.op != JitOp::Return && b + 1 < blocks.size())
+			block.successors.push_back(int(b + 1));
+	}
+	for (bool changed = true; changed;)
+	{
+		changed = false;
+		for (size_t b = blocks.size(); b-- > 0;)
+		{
+			Block &block = blocks[b];
+			for (int s : block.successors)
+				for (size_t w = 0; w < words; w++)
+					block.out[w] |= blocks[s].in[w];
+			for (size_t w = 0; w < words; w++)
+			{
+				uint64_t in = block.use[w] | (block.out[w] & ~block.def[w]);
+				changed = changed || in != block.in[w];
+				block.in[w] = in;
+			}
+		}
+	}
+
+	vector<int> first(vregs, INT_MAX), last(vregs, -1);
+	auto extend = [&](int v, int position)
+	{
+		first[v] = min(first[v], position);
+		last[v] = max(last[v], position);
+	};
+	vector<int> calls;
+	for (size_t k = 0; k < n; k++)
+	{
+		const JitInstr &i = ir.code[k];
+		forEachUse(i, [&](int v)
+				   { extend(v, int(k)); });
+		if (i.d >= 0)
+			extend(i.d, int(k));
+		if (i.op == JitOp::Params)
+			for (int v = 0; v < ir.params; v++)
+				extend(v, 0);
+		if (i.op == JitOp::Call)
+			calls.push_back(int(k));
+	}
+	JitAllocation allocation;
+	for (const Block &block : blocks)
+		for (size_t v = 0; v < vregs; v++)
+		{
+			if (test(block.in, int(v)))
+				extend(int(v), int(block.begin));
+			if (test(block.out, int(v)))
+				extend(int(v), int(block.end - 1));
+		}
+	for (size_t v = ir.params; v < vregs; v++)
+		if (test(blocks[0].in, int(v)))
+			allocation.zeroAtEntry.push_back(int(v));
+
+	vector<int> order;
+	for (size_t v = 0; v < vregs; v++)
+		if (last[v] >= 0)
+			order.push_back(int(v));
+	sort(order.begin(), order.end(), [&](int a, int b)
+		 { return first[a] != first[b] ? first[a] < first[b] : a < b; });
+
+	allocation.locations.resize(vregs);
+	auto spill = [&](int v)
+	{
+		allocation.locations[v].inRegister = false;
+		allocation.locations[v].slot = allocation.slots++;
+	};
+	bool gprFree[16], xmmFree[16], calleeUsed[16] = {};
+	fill(begin(gprFree), end(gprFree), true);
+	fill(begin(xmmFree), end(xmmFree), true);
+	vector<int> active;
+	for (int v : order)
+	{
+		for (size_t k = 0; k < active.size();)
+		{
+			int a = active[k];
+			if (last[a] >= first[v])
+			{
+				k++;
+				continue;
+			}
+			(ir.isFloat[a] ? xmmFree : gprFree)[allocation.locations[a].reg] = true;
+			active.erase(active.begin() + k);
+		}
+		auto call = upper_bound(calls.begin(), calls.end(), first[v]);
+		bool crossesCall = call != calls.end() && *call < last[v];
+		bool isFloat = ir.isFloat[v];
+		if (isFloat && crossesCall)
+		{
+			spill(v);
+			continue;
+		}
+		vector<int> candidates;
+		if (isFloat)
+			for (int r = 0; r < jitAllocatableXmm; r++)
+				candidates.push_back(r);
+		else
+		{
+			if (!crossesCall)
+				candidates.assign(begin(jitCallerSaved), end(jitCallerSaved));
+			candidates.insert(candidates.end(), begin(jitCalleeSaved), end(jitCalleeSaved));
+		}
+		bool *freeSet = isFloat ? xmmFree : gprFree;
+		auto available = find_if(candidates.begin(), candidates.end(), [&](int r)
+							{ return freeSet[r]; });
+		int reg = -1;
+		if (available != candidates.end())
+			reg = *available;
+		else
+		{
+			int victim = -1;
+			for (int a : active)
+				if (ir.isFloat[a] == isFloat && find(candidates.begin(), candidates.end(), allocation.locations[a].reg) != candidates.end() &&
+					(victim < 0 || last[a] > last[victim]))
+					victim = a;
+			if (victim < 0 || last[victim] <= last[v])
+			{
+				spill(v);
+				continue;
+			}
+			reg = allocation.locations[victim].reg;
+			spill(victim);
+			active.erase(find(active.begin(), active.end(), victim));
+		}
+		freeSet[reg] = false;
+		allocation.locations[v] = {true, reg, -1};
+		active.push_back(v);
+		if (!isFloat && find(begin(jitCalleeSaved), end(jitCalleeSaved), reg) != end(jitCalleeSaved))
+			calleeUsed[reg] = true;
+	}
+	for (int r : jitCalleeSaved)
+		if (calleeUsed[r])
+			allocation.calleeSaved.push_back(r);
+	return allocation;
+}
+
+// --- x86-64 encoding ------------------------------------------------------
+
+// A register, or memory at [base + disp]
+struct JitOperand
+{
+	bool memory;
+	int reg;
+	int32_t disp;
+};
+
+static JitOperand jitReg(int r) { return {false, r, 0}; }
+static JitOperand jitMem(int base, int32_t disp) { return {true, base, disp}; }
+
+// Condition codes, the low nibble of jcc/setcc/cmovcc
+enum JitCC : uint8_t
+{
+	CC_O = 0x0,
+	CC_B = 0x2,
+	CC_AE = 0x3,
+	CC_E = 0x4,
+	CC_NE = 0x5,
+	CC_BE = 0x6,
+	CC_A = 0x7,
+	CC_P = 0xA,
+	CC_L = 0xC,
+	CC_GE = 0xD,
+	CC_LE = 0xE,
+	CC_G = 0xF
+};
+
+// ALU operations by their /digit in the 0x81 group; the register form is 8 * digit + 3
+enum JitAlu : uint8_t
+{
+	ALU_ADD = 0,
+	ALU_OR = 1,
+	ALU_AND = 4,
+	ALU_SUB = 5,
+	ALU_XOR = 6,
+	ALU_CMP = 7
+};
+
+class JitAssembler
+{
+public:
+	vector<uint8_t> code;
+
+	size_t size() const { return code.size(); }
+
+	void imm32(int32_t v)
+	{
+		for (int k = 0; k < 4; k++)
+			code.push_back(uint8_t(uint32_t(v) >> (8 * k)));
+	}
+
+	void imm64(uint64_t v)
+	{
+		for (int k = 0; k < 8; k++)
+			code.push_back(uint8_t(v >> (8 * k)));
+	}
+
+	// [prefix] [REX] opcode ModRM [SIB] [disp32]
+	void instr(uint8_t prefix, bool wide, initializer_list<uint8_t> opcode, int reg, JitOperand rm)
+	{
+		if (prefix)
+			code.push_back(prefix);
+		uint8_t rex = 0x40 | (wide ? 8 : 0) | (reg & 8 ? 4 : 0) | (rm.reg & 8 ? 1 : 0);
+		if (rex != 0x40)
+			code.push_back(rex);
+		code.insert(code.end(), opcode);
+		if (!rm.memory)
+		{
+			code.push_back(uint8_t(0xC0 | (reg & 7) << 3 | (rm.reg & 7)));
+			return;
+		}
+		code.push_back(uint8_t(0x80 | (reg & 7) << 3 | (rm.reg & 7)));
+		if ((rm.reg & 7) == RSP)
+			code.push_back(0x24);
+		imm32(rm.disp);
+	}
+
+	void load(int dst, JitOperand src) { instr(0, true, {0x8B}, dst, src); }
+	void store(JitOperand dst, int src) { instr(0, true, {0x89}, src, dst); }
+
+	void move(int dst, int src)
+	{
+		if (dst != src)
+			load(dst, jitReg(src));
+	}
+
+	void loadImmediate(int dst, long long v)
+	{
+		if (v == 0)
+			instr(0, false, {0x33}, dst, jitReg(dst)); // xor r32, r32
+		else if (v >= INT32_MIN && v <= INT32_MAX)
+		{
+			instr(0, true, {0xC7}, 0, jitReg(dst));
+			imm32(int32_t(v));
+		}
+		else
+		{
+			code.push_back(uint8_t(0x48 | (dst & 8 ? 1 : 0)));
+			code.push_back(uint8_t(0xB8 + (dst & 7)));
+			imm64(uint64_t(v));
+		}
+	}
+
+	void storeImmediate(JitOperand dst, int32_t v)
+	{
+		instr(0, true, {0xC7}, 0, dst);
+		imm32(v);
+	}
+
+	void alu(JitAlu op, int dst, JitOperand src) { instr(0, true, {uint8_t(8 * op + 3)}, dst, src); }
+
+	void aluImmediate(JitAlu op, JitOperand dst, int32_t v)
+	{
+		instr(0, true, {0x81}, op, dst);
+		imm32(v);
+	}
+
+	void imul(int dst, JitOperand src) { instr(0, true, {0x0F, 0xAF}, dst, src); }
+
+	void imulImmediate(int dst, JitOperand src, int32_t v)
+	{
+		instr(0, true, {0x69}, dst, src);
+		imm32(v);
+	}
+
+	void neg(int r) { instr(0, true, {0xF7}, 3, jitReg(r)); }
+	void idiv(int r) { instr(0, true, {0xF7}, 7, jitReg(r)); }
+	void cqo() { code.insert(code.end(), {0x48, 0x99}); }
+	void testRegisters(int x, int y) { instr(0, true, {0x85}, y, jitReg(x)); }
+	void bitNot(int r) { instr(0, true, {0xF7}, 2, jitReg(r)); }
+	void cmovo(int dst, JitOperand src) { instr(0, true, {0x0F, 0x40}, dst, src); }
+
+	void sse(uint8_t prefix, uint8_t op, int xmm, JitOperand rm) { instr(prefix, false, {0x0F, op}, xmm, rm); }
+	void loadFloat(int xmm, JitOperand src) { sse(0xF2, 0x10, xmm, src); } // movsd
+	void storeFloat(JitOperand dst, int xmm) { sse(0xF2, 0x11, xmm, dst); }
+	void moveFloat(int dst, int src)
+	{
+		if (dst != src)
+			sse(0x66, 0x28, dst, jitReg(src)); // movapd
+	}
+	void cvtsi2sd(int xmm, JitOperand src) { instr(0xF2, true, {0x0F, 0x2A}, xmm, src); }
+	void movqToXmm(int xmm, int gpr) { instr(0x66, true, {0x0F, 0x6E}, xmm, jitReg(gpr)); }
+	void movqFromXmm(int gpr, int xmm) { instr(0x66, true, {0x0F, 0x7E}, xmm, jitReg(gpr)); }
+
+	void push(int r)
+	{
+		if (r & 8)
+			code.push_back(0x41);
+		code.push_back(uint8_t(0x50 + (r & 7)));
+	}
+
+	void pop(int r)
+	{
+		if (r & 8)
+			code.push_back(0x41);
+		code.push_back(uint8_t(0x58 + (r & 7)));
+	}
+
+	void callRegister(int r) { instr(0, false, {0xFF}, 2, jitReg(r)); }
+	void jumpRegister(int r) { instr(0, false, {0xFF}, 4, jitReg(r)); }
+	void ret() { code.push_back(0xC3); }
+
+	// rel32 branches; return where the displacement goes
+	size_t jump()
+	{
+		code.push_back(0xE9);
+		imm32(0);
+		return code.size() - 4;
+	}
+
+	size_t jumpIf(JitCC cc)
+	{
+		code.push_back(0x0F);
+		code.push_back(uint8_t(0x80 | cc));
+		imm32(0);
+		return code.size() - 4;
+	}
+
+	size_t call()
+	{
+		code.push_back(0xE8);
+		imm32(0);
+		return code.size() - 4;
+	}
+
+	void patch(size_t at, size_t target)
+	{
+		int32_t rel = int32_t(int64_t(target) - int64_t(at + 4));
+		memcpy(&code[at], &rel, 4);
+	}
+};
+
+// --- code generation ------------------------------------------------------
+
+// Emits functions into one buffer. Calls between them are rel32 and are
+// patched by resolveCalls() once every function has been placed.
+class JitCodegen
+{
+public:
+	explicit JitCodegen(JitAssembler &assembler) : a(assembler) {}
+
+	vector<pair<size_t, int>> callFixups; // displacement, callee
+
+	void emitFunction(const JitFunctionIR &function)
+	{
+		ir = &function;
+		alloc = allocateRegisters(function);
+		labelAt.assign(function.labels, SIZE_MAX);
+		fixups.clear();
+		stubs.clear();
+
+		// Frame: saved registers, incoming parameters, spill slots, outgoing arguments
+		int outgoing = 0;
+		for (const JitInstr &i : function.code)
+			if (i.op == JitOp::Call)
+				outgoing = max(outgoing, int(i.args.size()));
+		savedBytes = 8 * int(alloc.calleeSaved.size());
+		int slots = function.params + alloc.slots + outgoing;
+		frameBytes = 8 * slots + ((savedBytes + 8 * slots) % 16 ? 8 : 0);
+		outgoingBase = function.params + alloc.slots;
+
+		a.push(RBP);
+		a.store(jitReg(RBP), RSP);
+		for (int r : alloc.calleeSaved)
+			a.push(r);
+		if (frameBytes)
+			a.aluImmediate(ALU_SUB, jitReg(RSP), frameBytes);
+		forEachParam([&](int v, bool isFloat, int argReg)
+					 {
+			if (isFloat)
+				a.storeFloat(slot(v), argReg);
+			else
+				a.store(slot(v), argReg); });
+
+		// Same depth limit as the VM; jitInvoke resets the depth on entry from the VM
+		a.loadImmediate(RCX, reinterpret_cast<long long>(&jitDepth));
+		a.load(RAX, jitMem(RCX, 0));
+		a.aluImmediate(ALU_ADD, jitReg(RAX), 1);
+		a.store(jitMem(RCX, 0), RAX);
+		a.aluImmediate(ALU_CMP, jitReg(RAX), int32_t(jitMaxDepth));
+		jumpIf(CC_G, raiseLabel(NativeRecursion, "maximum recursion depth exceeded"));
+
+		for (int v = 0; v < function.params; v++)
+			if (live(v))
+				isFloat(v) ? storeFloat(v, loadFloat(slot(v), XMM14)) : storeInt(v, loadInt(slot(v), RAX));
+		for (int v : alloc.zeroAtEntry)
+		{
+			const JitLocation &l = alloc.locations[v];
+			if (!l.inRegister)
+				a.storeImmediate(at(v), 0);
+			else if (isFloat(v))
+				a.sse(0x66, 0x57, l.reg, jitReg(l.reg)); // xorpd
+			else
+				a.loadImmediate(l.reg, 0);
+		}
+
+		epilogueLabel = newLabel();
+		for (const JitInstr &i : function.code)
+			emit(i);
+
+		bind(epilogueLabel);
+		a.loadImmediate(RCX, reinterpret_cast<long long>(&jitDepth));
+		a.load(RDX, jitMem(RCX, 0));
+		a.aluImmediate(ALU_SUB, jitReg(RDX), 1);
+		a.store(jitMem(RCX, 0), RDX);
+		if (frameBytes)
+			a.aluImmediate(ALU_ADD, jitReg(RSP), frameBytes);
+		for (size_t k = alloc.calleeSaved.size(); k-- > 0;)
+			a.pop(alloc.calleeSaved[k]);
+		a.pop(RBP);
+		a.ret();
+
+		for (const Stub &stub : stubs)
+		{
+			bind(stub.label);
+			a.loadImmediate(RDI, stub.status);
+			a.loadImmediate(RSI, reinterpret_cast<long long>(stub.message));
+			a.loadImmediate(RAX, reinterpret_cast<long long>(&jitRaise));
+			a.callRegister(RAX);
+		}
+		for (auto &[displacement, label] : fixups)
+			a.patch(displacement, labelAt[label]);
+	}
+
+	void resolveCalls(const vector<size_t> &entries)
+	{
+		for (auto &[displacement, callee] : callFixups)
+			a.patch(displacement, entries[callee]);
+	}
+
+private:
+	JitAssembler &a;
+	const JitFunctionIR *ir = nullptr;
+	JitAllocation alloc;
+	vector<size_t> labelAt;
+	vector<pair<size_t, int>> fixups;
+	int savedBytes = 0, frameBytes = 0, outgoingBase = 0;
+	int epilogueLabel = -1;
+
+	// Out-of-line calls to jitRaise, one per distinct error
+	struct Stub
+	{
+		int label;
+		NativeStatus status;
+		const char *message;
+	};
+	vector<Stub> stubs;
+
+	bool isFloat(int v) const { return ir->isFloat[v]; }
+	bool live(int v) const { return alloc.locations[v].inRegister || alloc.locations[v].slot >= 0; }
+	JitOperand frameSlot(int k) const { return jitMem(RBP, -(savedBytes + 8 * (k + 1))); }
+	JitOperand slot(int param) const { return frameSlot(param); }
+
+	JitOperand at(int v) const
+	{
+		const JitLocation &l = alloc.locations[v];
+		return l.inRegister ? jitReg(l.reg) : frameSlot(ir->params + l.slot);
+	}
+
+	bool inRegister(int v, int reg) const { return alloc.locations[v].inRegister && alloc.locations[v].reg == reg; }
+
+	int newLabel()
+	{
+		labelAt.push_back(SIZE_MAX);
+		return int(labelAt.size() - 1);
+	}
+
+	void bind(int label) { labelAt[label] = a.size(); }
+	void jump(int label) { fixups.push_back({a.jump(), label}); }
+	void jumpIf(JitCC cc, int label) { fixups.push_back({a.jumpIf(cc), label}); }
+
+	int raiseLabel(NativeStatus status, const char *message)
+	{
+		for (const Stub &stub : stubs)
+			if (stub.message == message)
+				return stub.label;
+		stubs.push_back({newLabel(), status, message});
+		return stubs.back().label;
+	}
+
+	int overflow() { return raiseLabel(NativeOverflow, "integer result too large"); }
+
+	// Calls f(vreg, isFloat, register) for each parameter in ABI order
+	template <typename F>
+	void forEachParam(F f)
+	{
+		int ints = 0, floats = 0;
+		for (int v = 0; v < ir->params; v++)
+			f(v, isFloat(v), isFloat(v) ? floats++ : jitIntArgs[ints++]);
+	}
+
+	// Register holding 'src': its own, or 'scratch' after loading it
+	int loadInt(JitOperand src, int scratch)
+	{
+		if (!src.memory)
+			return src.reg;
+		a.load(scratch, src);
+		return scratch;
+	}
+
+	int loadFloat(JitOperand src, int scratch)
+	{
+		if (!src.memory)
+			return src.reg;
+		a.loadFloat(scratch, src);
+		return scratch;
+	}
+
+	int loadInt(int v, int scratch) { return loadInt(at(v), scratch); }
+	int loadFloat(int v, int scratch) { return loadFloat(at(v), scratch); }
+
+	void storeInt(int v, int reg)
+	{
+		JitOperand d = at(v);
+		if (d.memory)
+			a.store(d, reg);
+		else
+			a.move(d.reg, reg);
+	}
+
+	void storeFloat(int v, int xmm)
+	{
+		JitOperand d = at(v);
+		if (d.memory)
+			a.storeFloat(d, xmm);
+		else
+			a.moveFloat(d.reg, xmm);
+	}
+
+	// Register to compute d = x op y in: d's own unless that would overwrite y first
+	int target(const JitInstr &i, int scratch)
+	{
+		const JitLocation &d = alloc.locations[i.d];
+		if (d.inRegister && !(i.y >= 0 && inRegister(i.y, d.reg)))
+			return d.reg;
+		return scratch;
+	}
+
+	static JitCC intCondition(JitCond cond, bool sense)
+	{
+		static const JitCC taken[] = {CC_E, CC_NE, CC_L, CC_LE, CC_G, CC_GE};
+		static const JitCC notTaken[] = {CC_NE, CC_E, CC_GE, CC_G, CC_LE, CC_L};
+		return (sense ? taken : notTaken)[int(cond)];
+	}
+
+	void emit(const JitInstr &i)
+	{
+		switch (i.op)
+		{
+		case JitOp::Params:
+			break;
+		case JitOp::Label:
+			bind(i.label);
+			break;
+		case JitOp::Jump:
+			jump(i.label);
+			break;
+		case JitOp::Branch:
+			emitBranch(i);
+			break;
+		case JitOp::Const:
+		{
+			long long bits = i.imm;
+			if (isFloat(i.d))
+				memcpy(&bits, &i.fimm, sizeof bits);
+			JitOperand d = at(i.d);
+			if (d.memory && bits >= INT32_MIN && bits <= INT32_MAX)
+				a.storeImmediate(d, int32_t(bits));
+			else if (d.memory)
+			{
+				a.loadImmediate(RAX, bits);
+				a.store(d, RAX);
+			}
+			else if (!isFloat(i.d))
+				a.loadImmediate(d.reg, bits);
+			else if (bits == 0)
+				a.sse(0x66, 0x57, d.reg, jitReg(d.reg)); // xorpd
+			else
+			{
+				a.loadImmediate(RAX, bits);
+				a.movqToXmm(d.reg, RAX);
+			}
+			break;
+		}
+		case JitOp::Move:
+			if (isFloat(i.d))
+				storeFloat(i.d, loadFloat(i.x, XMM14));
+			else
+				storeInt(i.d, loadInt(i.x, RAX));
+			break;
+		case JitOp::Add:
+		case JitOp::Sub:
+		case JitOp::Mul:
+		case JitOp::Divide:
+			if (isFloat(i.d))
+			{
+				emitFloatArithmetic(i);
+				break;
+			}
+			// fall through
+		case JitOp::And:
+		case JitOp::Or:
+		case JitOp::Xor:
+		{
+			int r = target(i, RAX);
+			a.move(r, loadInt(i.x, r));
+			if (i.op == JitOp::Mul)
+				i.hasImm ? a.imulImmediate(r, jitReg(r), int32_t(i.imm)) : a.imul(r, at(i.y));
+			else
+			{
+				JitAlu op = i.op == JitOp::Add ? ALU_ADD : i.op == JitOp::Sub ? ALU_SUB
+													: i.op == JitOp::And   ? ALU_AND
+													: i.op == JitOp::Or	   ? ALU_OR
+																		   : ALU_XOR;
+				i.hasImm ? a.aluImmediate(op, jitReg(r), int32_t(i.imm)) : a.alu(op, r, at(i.y));
+			}
+			if (i.op == JitOp::Add || i.op == JitOp::Sub || i.op == JitOp::Mul)
+				jumpIf(CC_O, overflow());
+			storeInt(i.d, r);
+			break;
+		}
+		case JitOp::Mod:
+			emitModulo(i);
+			break;
+		case JitOp::Neg:
+			if (isFloat(i.d))
+			{
+				a.moveFloat(XMM14, loadFloat(i.x, XMM14));
+				a.loadImmediate(RAX, LLONG_MIN); // the sign bit
+				a.movqToXmm(XMM15, RAX);
+				a.sse(0x66, 0x57, XMM14, jitReg(XMM15)); // xorpd
+				storeFloat(i.d, XMM14);
+				break;
+			}
+			// fall through
+		case JitOp::Not:
+		{
+			int r = target(i, RAX);
+			a.move(r, loadInt(i.x, r));
+			if (i.op == JitOp::Neg)
+			{
+				a.neg(r);
+				jumpIf(CC_O, overflow());
+			}
+			else
+				a.bitNot(r);
+			storeInt(i.d, r);
+			break;
+		}
+		case JitOp::ToFloat:
+		{
+			int r = target(i, XMM14);
+			a.sse(0x66, 0x57, r, jitReg(r)); // xorpd: no dependency on the old value
+			a.cvtsi2sd(r, at(i.x));
+			storeFloat(i.d, r);
+			break;
+		}
+		case JitOp::RangeNext:
+			a.move(RAX, loadInt(i.x, RAX));
+			i.hasImm ? a.aluImmediate(ALU_ADD, jitReg(RAX), int32_t(i.imm)) : a.alu(ALU_ADD, RAX, at(i.y));
+			a.cmovo(RAX, at(i.z));
+			storeInt(i.d, RAX);
+			break;
+		case JitOp::Call:
+			emitCall(i);
+			break;
+		case JitOp::Return:
+			if (ir->returnsFloat)
+				a.moveFloat(0, loadFloat(i.x, 0));
+			else
+				a.move(RAX, loadInt(i.x, RAX));
+			jump(epilogueLabel);
+			break;
+		}
+	}
+
+	void emitFloatArithmetic(const JitInstr &i)
+	{
+		if (i.op == JitOp::Divide)
+		{
+			// Both zeros have every bit but the sign clear
+			if (alloc.locations[i.y].inRegister)
+				a.movqFromXmm(RAX, alloc.locations[i.y].reg);
+			else
+				a.load(RAX, at(i.y));
+			a.alu(ALU_ADD, RAX, jitReg(RAX));
+			jumpIf(CC_E, raiseLabel(NativeZeroDivision, "float division by zero"));
+		}
+		static const unordered_map<int, uint8_t> opcodes = {
+			{int(JitOp::Add), 0x58}, {int(JitOp::Mul), 0x59}, {int(JitOp::Sub), 0x5C}, {int(JitOp::Divide), 0x5E}};
+		int r = target(i, XMM14);
+		a.moveFloat(r, loadFloat(i.x, r));
+		a.sse(0xF2, opcodes.at(int(i.op)), r, at(i.y));
+		storeFloat(i.d, r);
+	}
+
+	// idiv truncates; Python's remainder takes the sign of the divisor.
+	// x % -1 is 0 without dividing, which would fault for LLONG_MIN.
+	void emitModulo(const JitInstr &i)
+	{
+		int divide = newLabel(), done = newLabel();
+		a.move(RAX, loadInt(i.x, RAX));
+		if (i.hasImm)
+			a.loadImmediate(RCX, i.imm);
+		else
+		{
+			a.move(RCX, loadInt(i.y, RCX));
+			a.testRegisters(RCX, RCX);
+			jumpIf(CC_E, raiseLabel(NativeZeroDivision, "integer modulo by zero"));
+		}
+		if (!i.hasImm || i.imm == -1)
+		{
+			a.aluImmediate(ALU_CMP, jitReg(RCX), -1);
+			jumpIf(CC_NE, divide);
+			a.loadImmediate(RDX, 0);
+			jump(done);
+		}
+		bind(divide);
+		a.cqo();
+		a.idiv(RCX);
+		a.testRegisters(RDX, RDX);
+		jumpIf(CC_E, done);
+		a.move(RAX, RDX);
+		a.alu(ALU_XOR, RAX, jitReg(RCX));
+		jumpIf(CC_GE, done); // same signs
+		a.alu(ALU_ADD, RDX, jitReg(RCX));
+		bind(done);
+		storeInt(i.d, RDX);
+	}
+
+	void emitBranch(const JitInstr &i)
+	{
+		if (!i.floats)
+		{
+			int x = loadInt(i.x, RAX);
+			i.hasImm ? a.aluImmediate(ALU_CMP, jitReg(x), int32_t(i.imm)) : a.alu(ALU_CMP, x, at(i.y));
+			jumpIf(intCondition(i.cond, i.sense), i.label);
+			return;
+		}
+		// ucomisd reports NaN as unordered (ZF, PF and CF set): every
+		// comparison but != is false. a < b is tested as b > a.
+		int x = i.x, y = i.y;
+		JitCond cond = i.cond;
+		if (cond == JitCond::Lt || cond == JitCond::Le)
+		{
+			swap(x, y);
+			cond = cond == JitCond::Lt ? JitCond::Gt : JitCond::Ge;
+		}
+		a.sse(0x66, 0x2E, loadFloat(x, XMM14), at(y)); // ucomisd
+		if (cond == JitCond::Gt)
+			jumpIf(i.sense ? CC_A : CC_BE, i.label);
+		else if (cond == JitCond::Ge)
+			jumpIf(i.sense ? CC_AE : CC_B, i.label);
+		else if ((cond == JitCond::Eq) == i.sense)
+		{
+			int skip = newLabel();
+			jumpIf(CC_P, skip);
+			jumpIf(CC_E, i.label);
+			bind(skip);
+		}
+		else
+		{
+			jumpIf(CC_P, i.label);
+			jumpIf(CC_NE, i.label);
+		}
+	}
+
+	// Arguments go through the outgoing slots so that loading one argument
+	// register cannot overwrite a value another argument still needs
+	void emitCall(const JitInstr &i)
+	{
+		for (size_t k = 0; k < i.args.size(); k++)
+		{
+			int v = i.args[k];
+			if (isFloat(v))
+				a.storeFloat(frameSlot(outgoingBase + int(k)), loadFloat(v, XMM14));
+			else
+				a.store(frameSlot(outgoingBase + int(k)), loadInt(v, RAX));
+		}
+		int ints = 0, floats = 0;
+		for (size_t k = 0; k < i.args.size(); k++)
+		{
+			if (isFloat(i.args[k]))
+				a.loadFloat(floats++, frameSlot(outgoingBase + int(k)));
+			else
+				a.load(jitIntArgs[ints++], frameSlot(outgoingBase + int(k)));
+		}
+		if (i.callee >= 0)
+			callFixups.push_back({a.call(), i.callee});
+		else
+		{
+			a.loadImmediate(RAX, reinterpret_cast<long long>(i.helper));
+			a.callRegister(RAX);
+		}
+		if (isFloat(i.d))
+			storeFloat(i.d, 0);
+		else
+			storeInt(i.d, RAX);
+	}
+};
+#endif
+
+JitModule buildJitModule(const TranspileResult &module)
+{
+	JitModule jit;
+	jit.skipped = module.skipped;
+	if (module.typed.empty())
+		return jit;
+#ifdef PYC_HAVE_JIT
+	auto start = chrono::steady_clock::now();
+	size_t count = module.typed.size();
+
+	// Rejecting a function rejects its callers, so lower until nothing changes
+	vector<char> accepted(count, 1);
+	vector<JitFunctionIR> lowered(count);
+	for (bool changed = true; changed;)
+	{
+		changed = false;
+		unordered_map<string, size_t> callable;
+		for (size_t k = 0; k < count; k++)
+			if (accepted[k])
+				callable[module.typed[k].name] = k;
+		JitLowering lowering(module.typed, callable);
+		for (size_t k = 0; k < count; k++)
+		{
+			if (!accepted[k])
+				continue;
+			try
+			{
+				lowered[k] = lowering.lower(module.typed[k]);
+			}
+			catch (const CompileError &e)
+			{
+				accepted[k] = 0;
+				jit.skipped.push_back({module.typed[k].name, e.what()});
+				changed = true;
+			}
+		}
+	}
+
+	JitAssembler assembler;
+	JitCodegen codegen(assembler);
+	vector<size_t> entries(count), adapters(count), thunks(count);
+	for (size_t k = 0; k < count; k++)
+		if (accepted[k])
+		{
+			entries[k] = assembler.size();
+			codegen.emitFunction(lowered[k]);
+		}
+
+	// The VM calls a thunk with the NativeEntry signature; it tail-calls
+	// jitInvoke, which calls the adapter that unpacks the argument slots
+	static deque<JitEntryInfo> entryInfo; // referenced by the code, never freed
+	vector<JitEntryInfo *> infos(count);
+	for (size_t k = 0; k < count; k++)
+	{
+		if (!accepted[k])
+			continue;
+		const JitFunctionIR &f = lowered[k];
+		adapters[k] = assembler.size();
+		assembler.push(RBX);
+		assembler.move(RBX, RSI);
+		assembler.move(RAX, RDI);
+		int ints = 0, floats = 0;
+		for (int p = 0; p < f.params; p++)
+		{
+			if (f.isFloat[p])
+				assembler.loadFloat(floats++, jitMem(RAX, 8 * p));
+			else
+				assembler.load(jitIntArgs[ints++], jitMem(RAX, 8 * p));
+		}
+		codegen.callFixups.push_back({assembler.call(), int(k)});
+		if (f.returnsFloat)
+			assembler.storeFloat(jitMem(RBX, 0), 0);
+		else
+			assembler.store(jitMem(RBX, 0), RAX);
+		assembler.pop(RBX);
+		assembler.ret();
+
+		infos[k] = &entryInfo.emplace_back();
+		thunks[k] = assembler.size();
+		assembler.move(RCX, RDX);
+		assembler.move(RDX, RSI);
+		assembler.move(RSI, RDI);
+		assembler.loadImmediate(RDI, reinterpret_cast<long long>(infos[k]));
+		assembler.loadImmediate(RAX, reinterpret_cast<long long>(&jitInvoke));
+		assembler.jumpRegister(RAX);
+	}
+	codegen.resolveCalls(entries);
+
+	size_t page = size_t(sysconf(_SC_PAGESIZE));
+	size_t length = (assembler.size() + page - 1) / page * page;
+	void *memory = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (memory == MAP_FAILED)
+		throw CompileError(string("cannot map memory for the JIT: ") + strerror(errno));
+	memcpy(memory, assembler.code.data(), assembler.size());
+	if (mprotect(memory, length, PROT_READ | PROT_EXEC) != 0)
+		throw CompileError(string("cannot make JIT code executable: ") + strerror(errno));
+	auto *base = static_cast<uint8_t *>(memory);
+
+	for (size_t k = 0; k < count; k++)
+	{
+		if (!accepted[k])
+			continue;
+		const TypedFunction &f = module.typed[k];
+		infos[k]->adapter = reinterpret_cast<void (*)(const NativeSlot *, NativeSlot *)>(base + adapters[k]);
+		NativeEntry entry = reinterpret_cast<NativeEntry>(base + thunks[k]);
+		jit.natives[f.name] = Value(new NativeObject(f.name, CTranspiler::signatureOf(f.params, f.types, f.result), entry, Value()));
+		jit.compiled.push_back(f.name);
+	}
+	jit.codeBytes = assembler.size();
+	jit.compileMicros = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+	return jit;
+#else
+	throw CompileError("the JIT needs an x86-64 POSIX system");
+#endif
+}
+} // namespace pyc::detail
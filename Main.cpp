@@ -0,0 +1,581 @@
+#include "Tools.h"
+
+namespace pyc::detail
+{
+// ----------------------------------------------
+// 9. Main
+// ----------------------------------------------
+// Reads the decimal value after the first 'prefix' characters of a numeric
+// flag, printing a usage error unless it is a whole number in [low, high]
+template <typename T>
+bool parseFlagNumber(const string &arg, size_t prefix, T &value, uint64_t low = 0,
+					 uint64_t high = numeric_limits<T>::max())
+{
+	const char *begin = arg.data() + prefix, *end = arg.data() + arg.size();
+	uint64_t parsed = 0;
+	auto [stop, error] = from_chars(begin, end, parsed);
+	if (begin == end || error != errc() || stop != end || parsed < low || parsed > high)
+	{
+		cerr << "Invalid value in '" << arg << "' (expected a whole number from " << low << " to " << high << ")" << endl;
+		return false;
+	}
+	value = T(parsed);
+	return true;
+}
+} // namespace pyc::detail
+
+int main(int argc, char *argv[])
+{
+	using namespace pyc::detail;
+	unsigned semanticJobs = 1;
+	bool jobsGiven = false;
+	string engine = "vm", runFile, batchSpec, outputDir = "batch_out", serveSocket, importEntry, buildRoot, watchRoot;
+	string aotFile, aotOutput;
+	string irFile, irPasses = "dce,copyprop,gvn,copyprop,licm,dce";
+	string corpusSpec, corpusOutput, stageSpecs, benchJson;
+	string dumpPath, dumpFormat = "tsv";
+	bool dumpTreeRows = false;
+	string treeImagePath, loadTreePath;
+	DotRange dotRange;
+	bool benchStages = false, benchPasses = false, treeStats = false, showFolded = false;
+	bool benchSharing = false, shareTree = false, benchBudget = false, repl = false;
+	string astDiffPaths, astDiffCsv;
+	ResourceBudget budget;
+	// Reports on every return from main once --stats or --trace turned tracing on
+	struct TraceReport
+	{
+		bool stats = false;
+		string path;
+		~TraceReport()
+		{
+#if !PYC_TRACE
+			if (stats || !path.empty())
+				cerr << "Tracing was compiled out (PYC_TRACE=0)" << endl;
+#endif
+			if (stats)
+				tracer.printStats(cerr);
+			if (!path.empty() && !tracer.writeChromeTrace(path))
+				cerr << "Error: could not write " << path << endl;
+		}
+	} traceReport;
+	[[maybe_unused]] int debounceMs = 2; // --debounce, read by --watch on Linux only
+	string cacheDir;
+	uintmax_t cacheMegabytes = 512;
+	vector<string> searchPaths;
+	for (int a = 1; a < argc; a++)
+	{
+		string arg = argv[a];
+		if (arg == "--stats")
+		{
+			traceReport.stats = tracer.enabled = true;
+		}
+		else if (arg.rfind("--trace=", 0) == 0)
+		{
+			traceReport.path = arg.substr(8);
+			tracer.enabled = true;
+		}
+		else if (arg == "--alloc-stats")
+		{
+			if (!allocationHooks)
+			{
+				cerr << "Error: allocation counting is not linked in (AllocationHooks.cpp)" << endl;
+				return 1;
+			}
+			traceReport.stats = tracer.enabled = allocationProfiling = true;
+		}
+		else if (arg == "--trace-statements")
+		{
+			tracer.statements = true;
+		}
+		else if (arg.rfind("--jobs=", 0) == 0)
+		{
+			if (!parseFlagNumber(arg, 7, semanticJobs, 1, 1024))
+				return 1;
+			jobsGiven = true;
+		}
+		else if (arg.rfind("--batch=", 0) == 0)
+		{
+			batchSpec = arg.substr(8);
+		}
+		else if (arg.rfind("--out=", 0) == 0)
+		{
+			outputDir = arg.substr(6);
+		}
+		else if (arg.rfind("--cache=", 0) == 0)
+		{
+			cacheDir = arg.substr(8);
+		}
+		else if (arg.rfind("--cache-size=", 0) == 0)
+		{
+			if (!parseFlagNumber(arg, 13, cacheMegabytes))
+				return 1;
+		}
+		else if (arg.rfind("--bench-cache", 0) == 0)
+		{
+			unsigned cores = jobsGiven ? semanticJobs : max(1u, thread::hardware_concurrency());
+			benchmarkCache(arg.size() > 14 ? arg.substr(14) : "", cores);
+			return 0;
+		}
+		else if (arg.rfind("--build=", 0) == 0)
+		{
+			buildRoot = arg.substr(8);
+		}
+		else if (arg.rfind("--bench-build", 0) == 0)
+		{
+			unsigned cores = jobsGiven ? semanticJobs : max(1u, thread::hardware_concurrency());
+			size_t files = 10000;
+			if (arg.size() > 14 && !parseFlagNumber(arg, 14, files, 1))
+				return 1;
+			benchmarkBuild(files, cores);
+			return 0;
+		}
+		else if (arg.rfind("--imports=", 0) == 0)
+		{
+			importEntry = arg.substr(10);
+		}
+		else if (arg.rfind("--path=", 0) == 0)
+		{
+			searchPaths.push_back(arg.substr(7));
+		}
+		else if (arg.rfind("--bench-imports", 0) == 0)
+		{
+			unsigned cores = jobsGiven ? semanticJobs : max(1u, thread::hardware_concurrency());
+			benchmarkImports(arg.size() > 16 ? arg.substr(16) : "", cores);
+			return 0;
+		}
+		else if (arg.rfind("--bench-batch", 0) == 0)
+		{
+			unsigned cores = jobsGiven ? semanticJobs : max(1u, thread::hardware_concurrency());
+			benchmarkBatch(arg.size() > 14 ? arg.substr(14) : "", cores);
+			return 0;
+		}
+#ifdef __unix__
+		else if (arg.rfind("--serve=", 0) == 0)
+		{
+			serveSocket = arg.substr(8);
+		}
+		else if (arg.rfind("--client=", 0) == 0)
+		{
+			return runClient(arg.substr(9), vector<string>(argv + a + 1, argv + argc));
+		}
+		else if (arg.rfind("--bench-server", 0) == 0)
+		{
+			unsigned workers = jobsGiven ? semanticJobs : max(1u, thread::hardware_concurrency());
+			size_t requests = 2000;
+			if (arg.size() > 15 && !parseFlagNumber(arg, 15, requests, 1))
+				return 1;
+			benchmarkServer(workers, requests);
+			return 0;
+		}
+#endif
+#ifdef __linux__
+		else if (arg.rfind("--watch=", 0) == 0)
+		{
+			watchRoot = arg.substr(8);
+		}
+		else if (arg.rfind("--debounce=", 0) == 0)
+		{
+			if (!parseFlagNumber(arg, 11, debounceMs))
+				return 1;
+		}
+		else if (arg.rfind("--bench-watch", 0) == 0)
+		{
+			unsigned cores = jobsGiven ? semanticJobs : max(1u, thread::hardware_concurrency());
+			size_t edits = 2000;
+			if (arg.size() > 14 && !parseFlagNumber(arg, 14, edits, 1))
+				return 1;
+			benchmarkWatch(edits, cores, debounceMs);
+			return 0;
+		}
+#endif
+		else if (arg.rfind("--bench-session", 0) == 0)
+		{
+			size_t calls = 10000;
+			if (arg.size() > 16 && !parseFlagNumber(arg, 16, calls, 1))
+				return 1;
+			return benchmarkSession(calls);
+		}
+		else if (arg.rfind("--bench-semantic", 0) == 0)
+		{
+			size_t lines = 1000000;
+			if (arg.size() > 17 && !parseFlagNumber(arg, 17, lines, 1))
+				return 1;
+			benchmarkSemanticPass(lines);
+			return 0;
+		}
+		else if (arg.rfind("--engine=", 0) == 0)
+		{
+			engine = arg.substr(9);
+			if (engine != "vm" && engine != "native" && engine != "jit" && engine != "closures" && engine != "tree")
+			{
+				cerr << "Unknown engine '" << engine << "' (expected vm, native, jit, closures or tree)" << endl;
+				return 1;
+			}
+		}
+		else if (arg.rfind("--run=", 0) == 0)
+		{
+			runFile = arg.substr(6);
+		}
+		else if (arg.rfind("--tokens=", 0) == 0)
+		{
+			dumpPath = arg.substr(9);
+			dumpTreeRows = false;
+		}
+		else if (arg.rfind("--tree=", 0) == 0)
+		{
+			dumpPath = arg.substr(7);
+			dumpTreeRows = true;
+		}
+		else if (arg.rfind("--format=", 0) == 0)
+		{
+			dumpFormat = arg.substr(9);
+		}
+		else if (arg.rfind("--dot-root=", 0) == 0)
+		{
+			if (!parseFlagNumber(arg, 11, dotRange.root))
+				return 1;
+		}
+		else if (arg.rfind("--dot-depth=", 0) == 0)
+		{
+			// MAX, or MIN:MAX
+			size_t colon = arg.find(':', 12);
+			if (colon != string::npos && !parseFlagNumber(arg.substr(0, colon), 12, dotRange.minDepth))
+				return 1;
+			if (!parseFlagNumber(arg, colon == string::npos ? 12 : colon + 1, dotRange.maxDepth))
+				return 1;
+			if (dotRange.minDepth > dotRange.maxDepth)
+			{
+				cerr << "Invalid value in '" << arg << "' (MIN must not exceed MAX)" << endl;
+				return 1;
+			}
+		}
+		else if (arg.rfind("--save-tree=", 0) == 0)
+		{
+			treeImagePath = arg.substr(12);
+		}
+		else if (arg.rfind("--load-tree=", 0) == 0)
+		{
+			loadTreePath = arg.substr(12);
+		}
+		else if (arg.rfind("--dis=", 0) == 0)
+		{
+			return runBytecodeFile(arg.substr(6), true);
+		}
+		else if (arg.rfind("--emit-c=", 0) == 0)
+		{
+			return emitCFile(arg.substr(9));
+		}
+		else if (arg.rfind("--emit-asm=", 0) == 0)
+		{
+			return emitAsmFile(arg.substr(11));
+		}
+		else if (arg.rfind("--aot=", 0) == 0)
+		{
+			aotFile = arg.substr(6);
+		}
+		else if (arg.rfind("--aot-out=", 0) == 0)
+		{
+			aotOutput = arg.substr(10);
+		}
+		else if (arg.rfind("--bench-aot", 0) == 0)
+		{
+			benchmarkAot(arg.size() > 12 ? arg.substr(12) : "benchmarks");
+			return 0;
+		}
+		else if (arg.rfind("--ir=", 0) == 0)
+		{
+			irFile = arg.substr(5);
+		}
+		else if (arg.rfind("--passes=", 0) == 0)
+		{
+			irPasses = arg.substr(9);
+		}
+		else if (arg.rfind("--bench-ir", 0) == 0)
+		{
+			size_t groups = 4000;
+			if (arg.size() > 11 && !parseFlagNumber(arg, 11, groups, 1))
+				return 1;
+			benchmarkIr(groups);
+			return 0;
+		}
+		else if (arg.rfind("--corpus-out=", 0) == 0)
+		{
+			corpusOutput = arg.substr(13);
+		}
+		else if (arg.rfind("--gen-corpus=", 0) == 0)
+		{
+			corpusSpec = arg.substr(13);
+		}
+		else if (arg.rfind("--bench-json=", 0) == 0)
+		{
+			benchJson = arg.substr(13);
+		}
+		else if (arg.rfind("--bench-stages", 0) == 0)
+		{
+			benchStages = true;
+			stageSpecs = arg.size() > 15 ? arg.substr(15) : "";
+		}
+		else if (arg.rfind("--bench-passes", 0) == 0)
+		{
+			benchPasses = true;
+			stageSpecs = arg.size() > 15 ? arg.substr(15) : "";
+		}
+		else if (arg == "--tree-stats")
+		{
+			treeStats = true;
+		}
+		else if (arg == "--show-folded")
+		{
+			showFolded = true;
+		}
+		else if (arg.rfind("--bench-sharing", 0) == 0)
+		{
+			benchSharing = true;
+			stageSpecs = arg.size() > 16 ? arg.substr(16) : "";
+		}
+		else if (arg == "--share-subtrees")
+		{
+			shareTree = true;
+		}
+		else if (arg.rfind("--diff-ast=", 0) == 0)
+		{
+			astDiffPaths = arg.substr(11);
+		}
+		else if (arg.rfind("--diff-csv=", 0) == 0)
+		{
+			astDiffCsv = arg.substr(11);
+		}
+		else if (arg == "--repl")
+		{
+			repl = true;
+		}
+		else if (arg == "--self-check")
+		{
+			int engines = runSelfCheck();
+			return runFrontEndChecks() | engines;
+		}
+		else if (arg.rfind("--bench-budget", 0) == 0)
+		{
+			benchBudget = true;
+			stageSpecs = arg.size() > 15 ? arg.substr(15) : "";
+		}
+		else if (arg.rfind("--max-tokens=", 0) == 0)
+		{
+			if (!parseFlagNumber(arg, 13, budget.maxTokens))
+				return 1;
+		}
+		else if (arg.rfind("--max-depth=", 0) == 0)
+		{
+			if (!parseFlagNumber(arg, 12, budget.maxDepth))
+				return 1;
+		}
+		else if (arg.rfind("--max-nodes=", 0) == 0)
+		{
+			if (!parseFlagNumber(arg, 12, budget.maxNodes))
+				return 1;
+		}
+		else if (arg.rfind("--max-memory=", 0) == 0)
+		{
+			if (!allocationHooks)
+			{
+				cerr << "Error: --max-memory needs allocation counting, which is not linked in (AllocationHooks.cpp)" << endl;
+				return 1;
+			}
+			try
+			{
+				budget.maxMemory = parseByteSize(arg.substr(13));
+			}
+			catch (const logic_error &)
+			{
+				cerr << "Invalid value in '" << arg << "' (expected a size such as 4096, 64K, 16M or 1G)" << endl;
+				return 1;
+			}
+		}
+		else if (arg.rfind("--deadline-ms=", 0) == 0)
+		{
+			if (!parseFlagNumber(arg, 14, budget.deadlineMs))
+				return 1;
+		}
+		else if (arg.rfind("--bench-native", 0) == 0)
+		{
+			benchmarkNative(arg.size() > 15 ? arg.substr(15) : "benchmarks");
+			return 0;
+		}
+		else if (arg.rfind("--bench-jit", 0) == 0)
+		{
+			benchmarkJit(arg.size() > 12 ? arg.substr(12) : "benchmarks");
+			return 0;
+		}
+		else if (arg.rfind("--bench-vm", 0) == 0)
+		{
+			benchmarkBytecode(arg.size() > 11 ? arg.substr(11) : "benchmarks");
+			return 0;
+		}
+		else if (arg.rfind("--bench-engines", 0) == 0)
+		{
+			benchmarkEngines(arg.size() > 16 ? arg.substr(16) : "benchmarks");
+			return 0;
+		}
+	}
+	if (!corpusSpec.empty())
+		return writeCorpus(corpusSpec, corpusOutput);
+	if (benchStages)
+		return benchmarkStages(stageSpecs, benchJson);
+	if (benchPasses)
+		return benchmarkPasses(stageSpecs, benchJson);
+	if (benchSharing)
+		return benchmarkSharing(stageSpecs);
+	if (benchBudget)
+		return benchmarkBudget(stageSpecs);
+	if (!astDiffPaths.empty())
+		return diffAgainstCPython(astDiffPaths, astDiffCsv);
+	// Only --serve, --imports, --batch and the default mode compile under the
+	// limits. --build and --watch would record a cut-off module in their
+	// build graph as if it were complete, so they refuse them like the rest.
+	bool budgeted = budget.maxTokens || budget.maxDepth || budget.maxNodes || budget.maxMemory || budget.deadlineMs;
+	const char *unbudgeted = !serveSocket.empty() ? nullptr
+							 : !watchRoot.empty() ? "--watch"
+							 : !buildRoot.empty() ? "--build"
+							 : !importEntry.empty() || !batchSpec.empty() ? nullptr
+							 : !aotFile.empty() ? "--aot"
+							 : !irFile.empty() ? "--ir"
+							 : !dumpPath.empty() ? "--tokens and --tree"
+							 : !loadTreePath.empty() ? "--load-tree"
+							 : repl ? "--repl"
+							 : !runFile.empty() ? "--run"
+												: nullptr;
+	if (budgeted && unbudgeted)
+	{
+		cerr << "Error: --max-tokens, --max-depth, --max-nodes, --max-memory and --deadline-ms do not apply to "
+			 << unbudgeted << endl;
+		return 1;
+	}
+#ifdef __unix__
+	if (!serveSocket.empty())
+		return serveCompiler(serveSocket, jobsGiven ? semanticJobs : max(1u, thread::hardware_concurrency()), budget);
+#endif
+#ifdef __linux__
+	if (!watchRoot.empty())
+		return watchSources(watchRoot, outputDir, jobsGiven ? semanticJobs : max(1u, thread::hardware_concurrency()), debounceMs);
+#endif
+	unique_ptr<FrontEndCache> cache;
+	if (!cacheDir.empty())
+	{
+		try
+		{
+			cache = make_unique<FrontEndCache>(cacheDir, cacheMegabytes << 20);
+		}
+		catch (const exception &e)
+		{
+			cerr << "Error: " << e.what() << endl;
+			return 1;
+		}
+	}
+	if (!buildRoot.empty())
+		return runBuild(buildRoot, outputDir, jobsGiven ? semanticJobs : max(1u, thread::hardware_concurrency()), cache.get());
+	if (!importEntry.empty())
+		return printImportGraph(importEntry, searchPaths, jobsGiven ? semanticJobs : max(1u, thread::hardware_concurrency()),
+								budget);
+	if (!batchSpec.empty())
+		return batchCompile(batchSpec, outputDir, jobsGiven ? semanticJobs : max(1u, thread::hardware_concurrency()), cache.get(),
+							budget);
+	if (!aotFile.empty())
+		return compileAotFile(aotFile, aotOutput);
+	if (!irFile.empty())
+		return printIrFile(irFile, irPasses);
+	if (!dumpPath.empty())
+		return dumpFile(dumpPath, dumpTreeRows, dumpFormat);
+	if (!loadTreePath.empty())
+		return printTreeImage(loadTreePath, showFolded);
+	if (repl)
+		return runRepl();
+	if (!runFile.empty())
+	{
+		if (engine == "vm" || engine == "native" || engine == "jit")
+			return runBytecodeFile(runFile, false, engine);
+		return runTreeFile(runFile, engine == "closures");
+	}
+
+	try
+	{
+		string sourceCode = readFile("script.py");
+
+		vector<Error> errors;
+		// 2. Lexical analysis: produce tokens
+		Lexer lexer;
+		BudgetMonitor monitor;
+		if (budgeted)
+		{
+			monitor.start(budget);
+			lexer.budget = &monitor;
+		}
+		vector<Token> tokens = lexer.tokenize(sourceCode, errors);
+		SymbolTable symTable;
+
+		// 4. Parse/semantic pass: build the symbol table with type inference,
+		// unless a budget already ran out. The parallel pass has no budget.
+		if (!monitor.exceeded() && semanticJobs > 1 && !budgeted)
+		{
+			parallelParse(tokens, symTable, semanticJobs);
+		}
+		else if (!monitor.exceeded())
+		{
+			Parser parser(tokens, symTable);
+			parser.budget = lexer.budget;
+			parser.parse();
+		}
+
+		// Syntax analysis, then constant folding/propagation over the tree
+		Syntax_Analyzer sa = Syntax_Analyzer();
+		{
+			PYC_ALLOC_SITE(TokenCopies);
+			sa.tokens = tokens;
+		}
+		if (budgeted)
+			sa.budget = &monitor;
+		ParseTreeNode *root = sa.parseProgram();
+		ConstantFolder folder(symTable);
+		if (!monitor.exceeded())
+			folder.run(root);
+		if (shareTree)
+		{
+			SharingReport report;
+			root = shareSubtrees(root, &report);
+			printSharingReport(report, cerr);
+		}
+
+		{
+			PYC_TRACE_SCOPE("report printing");
+			// 5. Print final symbol table
+			symTable.printSymbols();
+
+			// 3. Print out tokens (for demonstration)
+			printTokens(tokens, symTable);
+
+			// print errors
+			printErrors(errors);
+		}
+
+		cout << "\n\n\n\n";
+		{
+			PYC_TRACE_SCOPE("tree printing");
+			printParseTree(root, 0, cout, showFolded);
+		}
+		if (treeStats)
+			printTreeStats(root);
+		saveTreeToDot(root, "tree.dot", dotRange);
+		if (!treeImagePath.empty() && !saveTreeImage(root, treeImagePath))
+		{
+			cerr << "Error: could not write " << treeImagePath << endl;
+			return 1;
+		}
+	}
+	catch (const exception &ex)
+	{
+		cerr << "Error: " << ex.what() << endl;
+		return 1;
+		
+	}
+
+	return 0;
+}
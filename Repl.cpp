@@ -0,0 +1,254 @@
+#include "Tools.h"
+#ifdef __unix__
+#include <unistd.h>
+#endif
+
+namespace pyc::detail
+{
+// ----------------------------------------------
+// Interactive mode
+// ----------------------------------------------
+// --repl compiles standard input one input at a time. An input is a simple
+// statement, or a block header with its indented body ended by an empty
+// line or by the next line in column 0. Only the lines of the new input
+// are lexed, because the Lexer keeps its indentation and scopes between
+// inputs. Only its statements are parsed, folded and run through the symbol
+// pass. The SymbolTable lasts the whole session, so types inferred earlier
+// stay known, and so do the module-level constants the folder tracks. A
+// rejected input leaves both as they were. Each input costs the same
+// however long the session has run. After each input the symbols it added
+// or changed are listed. Commands start with ':' — :symbols, :tree
+// (toggles printing each input's tree with its folded values), :stats and
+// :quit. Prompts are only shown when standard input is a terminal, or
+// always where that cannot be told. As in Python, a line with a (, [ or {
+// still open continues on the next one.
+
+ReplSession::ReplSession(ostream &output) : out(output)
+{
+	lexer.resetState();
+	analyzer.appendErrorLog = false;
+}
+
+void ReplSession::run(istream &in)
+{
+#ifdef __unix__
+	bool prompts = isatty(STDIN_FILENO);
+#else
+	bool prompts = true;
+#endif
+	string line;
+	while (true)
+	{
+		if (prompts)
+			out << (waiting() ? "... " : ">>> ") << flush;
+		if (!getline(in, line))
+			break;
+		if (!waiting() && !line.empty() && line[0] == ':')
+		{
+			if (!command(line))
+				break;
+			continue;
+		}
+		feed(line);
+	}
+	// End of input closes whatever is still open
+	atEnd = true;
+	if (!logical.empty())
+		feed("");
+	if (!analyzer.tokens.empty())
+		feed("");
+	if (prompts)
+		out << '\n';
+}
+
+void ReplSession::feed(const string &line)
+{
+	if (logical.empty())
+		logicalStart = nextLine;
+	logical += line;
+	logical += '\n';
+	nextLine++;
+	// An empty line ends an open string, but not an open bracket
+	int depth;
+	bool open = continues(logical, depth);
+	if ((open && !line.empty()) || (depth > 0 && !atEnd))
+		return;
+
+	size_t text = logical.find_first_not_of(" \t\r\n");
+	if (text == string::npos)
+	{
+		// An empty line ends the input, and with it any open blocks
+		logical.clear();
+		if (analyzer.tokens.empty())
+			return;
+		lexer.closeBlocks(logicalStart, analyzer.tokens);
+		compileInput();
+		return;
+	}
+	if (logical[text] == '#')
+	{
+		logical.clear();
+		return;
+	}
+	auto start = chrono::steady_clock::now();
+	lexer.tokenizeMore(logical, logicalStart, errors, analyzer.tokens);
+	lexUs += chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+	logical.clear();
+	if (analyzer.tokens.empty() || lexer.openBlocks() > 0 || analyzer.tokens.back().type == TokenType::Colon)
+		return;
+	compileInput();
+}
+
+bool ReplSession::continues(const string &text, int &depth)
+{
+	char quote = 0;
+	bool triple = false;
+	depth = 0;
+	for (size_t i = 0; i < text.size(); i++)
+	{
+		char c = text[i];
+		if (!quote)
+		{
+			if (c == '#')
+				i = text.find('\n', i);
+			else if (c == '"' || c == '\'')
+			{
+				quote = c;
+				triple = text.compare(i, 3, string(3, c)) == 0;
+				if (triple)
+					i += 2;
+			}
+			else if (c == '(' || c == '[' || c == '{')
+				depth++;
+			else if ((c == ')' || c == ']' || c == '}') && depth > 0)
+				depth--;
+			if (i == string::npos)
+				break;
+		}
+		else if (c == '\\')
+			i++;
+		else if (triple && text.compare(i, 3, string(3, quote)) == 0)
+		{
+			quote = 0;
+			i += 2;
+		}
+		else if (!triple && (c == quote || c == '\n'))
+			quote = 0;
+	}
+	return (quote && triple) || (text.size() >= 2 && text[text.size() - 2] == '\\');
+}
+
+void ReplSession::compileInput()
+{
+	auto start = chrono::steady_clock::now();
+	for (const Error &e : errors)
+		e.print(out);
+	bool ok = errors.empty();
+	errors.clear();
+	analyzer.diagnostics = &out;
+	ParseTreeNode *root = analyzer.parseProgram();
+	ok = ok && analyzer.errorCount == 0;
+
+	// Symbols named by this input, as they were before it. A rejected
+	// input puts them back, so it leaves no trace in the session.
+	struct Before
+	{
+		bool existed;
+		SymbolTable::SymbolInfo info;
+	};
+	vector<pair<pmr::string, Before>> named;
+	unordered_set<pmr::string> seen;
+	int nextEntry = symbols.nextEntry;
+	for (const Token &tk : analyzer.tokens)
+	{
+		if (tk.type != TokenType::IDENTIFIER)
+			continue;
+		const pmr::string &key = symbols.keyFor(tk.lexeme, tk.scope);
+		if (!seen.insert(key).second)
+			continue;
+		auto it = symbols.table.find(key);
+		named.push_back({key, it == symbols.table.end() ? Before{false, {}} : Before{true, it->second}});
+	}
+	if (ok)
+	{
+		parser.parse(0, analyzer.tokens.size());
+		ConstantFolder(symbols).run(root, constants);
+	}
+	else
+	{
+		for (const auto &[key, before] : named)
+		{
+			if (before.existed)
+				symbols.table[key] = before.info;
+			else
+				symbols.table.erase(key);
+		}
+		symbols.nextEntry = nextEntry;
+	}
+
+	string report;
+	for (const auto &[key, before] : named)
+	{
+		auto it = symbols.table.find(key);
+		if (it == symbols.table.end())
+			continue;
+		const SymbolTable::SymbolInfo &info = it->second;
+		if (before.existed && before.info.type == info.type && before.info.value == info.value)
+			continue;
+		size_t at = key.find('@');
+		report.append(key, 0, at);
+		if (key.compare(at + 1, string::npos, "global") != 0)
+			report.append(" (").append(key, at + 1, string::npos).append(")");
+		report += ": " + info.type;
+		if (!info.value.empty())
+			report += " = " + info.value;
+		report += '\n';
+	}
+	out << report;
+	if (showTree)
+		printParseTree(root, 0, out, true);
+	deleteTree(root);
+	analyzer.tokens.clear();
+
+	lastUs = lexUs + chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+	lexUs = 0;
+	totalUs += lastUs;
+	maxUs = max(maxUs, lastUs);
+	inputs++;
+}
+
+bool ReplSession::command(const string &line)
+{
+	if (line == ":quit" || line == ":q")
+		return false;
+	if (line == ":symbols")
+		symbols.printSymbols(out);
+	else if (line == ":tree")
+	{
+		showTree = !showTree;
+		out << "tree printing " << (showTree ? "on" : "off") << '\n';
+	}
+	else if (line == ":stats")
+		out << inputs << " inputs, " << symbols.table.size() << " symbols; compile time per input " << fixed
+			<< setprecision(1) << (inputs ? totalUs / inputs : 0) << " us on average, " << lastUs << " us last, "
+			<< maxUs << " us at most\n"
+			<< defaultfloat << setprecision(6);
+	else
+		out << "unknown command " << line << " (:symbols, :tree, :stats, :quit)\n";
+	return true;
+}
+
+int runRepl()
+{
+	try
+	{
+		ReplSession(cout).run(cin);
+	}
+	catch (const exception &e)
+	{
+		cerr << "Error: " << e.what() << endl;
+		return 1;
+	}
+	return 0;
+}
+} // namespace pyc::detail
@@ -0,0 +1,842 @@
+#include "Engines.h"
+
+namespace pyc::detail
+{
+// ----------------------------------------------
+// Bytecode runtime values
+// ----------------------------------------------
+
+size_t ValueHash::operator()(const Value &v) const
+{
+	switch (v.tag)
+	{
+	case Value::Tag::Bool:
+	case Value::Tag::Int:
+		return std::hash<long long>()(v.i);
+	case Value::Tag::Float:
+		if (v.f == static_cast<double>(static_cast<long long>(v.f)))
+			return std::hash<long long>()(static_cast<long long>(v.f));
+		return std::hash<double>()(v.f);
+	case Value::Tag::Object:
+		if (v.obj->kind == ObjKind::Str)
+			return std::hash<string>()(static_cast<StrObject *>(v.obj)->s);
+		if (v.obj->kind == ObjKind::Tuple)
+		{
+			size_t h = 0x345678;
+			for (const Value &item : static_cast<ListObject *>(v.obj)->items)
+				h = h * 1000003 ^ (*this)(item);
+			return h;
+		}
+		return std::hash<const void *>()(v.obj);
+	default:
+		return 0;
+	}
+}
+
+bool valuesEqual(const Value &a, const Value &b)
+{
+	if (a.isNumber() && b.isNumber())
+	{
+		if (a.isIntLike() && b.isIntLike())
+			return a.i == b.i;
+		return a.asDouble() == b.asDouble();
+	}
+	if (a.tag != b.tag)
+		return false;
+	if (a.tag != Value::Tag::Object)
+		return true; // None == None
+	if (a.obj == b.obj)
+		return true;
+	if (a.obj->kind != b.obj->kind)
+		return false;
+	switch (a.obj->kind)
+	{
+	case ObjKind::Str:
+		return static_cast<StrObject *>(a.obj)->s == static_cast<StrObject *>(b.obj)->s;
+	case ObjKind::List:
+	case ObjKind::Tuple:
+	{
+		auto &x = static_cast<ListObject *>(a.obj)->items;
+		auto &y = static_cast<ListObject *>(b.obj)->items;
+		if (x.size() != y.size())
+			return false;
+		for (size_t k = 0; k < x.size(); k++)
+			if (!valuesEqual(x[k], y[k]))
+				return false;
+		return true;
+	}
+	case ObjKind::Dict:
+	case ObjKind::Set:
+	{
+		auto *x = static_cast<DictObject *>(a.obj);
+		auto *y = static_cast<DictObject *>(b.obj);
+		if (x->entries.size() != y->entries.size())
+			return false;
+		for (auto &[key, value] : x->entries)
+		{
+			const Value *other = y->get(key);
+			if (!other || (a.obj->kind == ObjKind::Dict && !valuesEqual(value, *other)))
+				return false;
+		}
+		return true;
+	}
+	default:
+		return false;
+	}
+}
+
+bool ValueEqual::operator()(const Value &a, const Value &b) const
+{
+	return valuesEqual(a, b);
+}
+
+Value makeString(string s)
+{
+	return Value(new StrObject(move(s)));
+}
+
+bool isTruthy(const Value &v)
+{
+	switch (v.tag)
+	{
+	case Value::Tag::Bool:
+	case Value::Tag::Int:
+		return v.i != 0;
+	case Value::Tag::Float:
+		return v.f != 0.0;
+	case Value::Tag::Object:
+		switch (v.obj->kind)
+		{
+		case ObjKind::Str:
+			return !static_cast<StrObject *>(v.obj)->s.empty();
+		case ObjKind::List:
+		case ObjKind::Tuple:
+			return !static_cast<ListObject *>(v.obj)->items.empty();
+		case ObjKind::Dict:
+		case ObjKind::Set:
+			return !static_cast<DictObject *>(v.obj)->entries.empty();
+		default:
+			return true;
+		}
+	default:
+		return false;
+	}
+}
+
+string typeNameOf(const Value &v)
+{
+	switch (v.tag)
+	{
+	case Value::Tag::Undefined:
+		return "undefined";
+	case Value::Tag::None:
+		return "NoneType";
+	case Value::Tag::Bool:
+		return "bool";
+	case Value::Tag::Int:
+		return "int";
+	case Value::Tag::Float:
+		return "float";
+	default:
+		break;
+	}
+	switch (v.obj->kind)
+	{
+	case ObjKind::Str:
+		return "str";
+	case ObjKind::List:
+		return "list";
+	case ObjKind::Tuple:
+		return "tuple";
+	case ObjKind::Dict:
+		return "dict";
+	case ObjKind::Set:
+		return "set";
+	case ObjKind::Function:
+	case ObjKind::BoundMethod:
+		return "function";
+	case ObjKind::Builtin:
+	case ObjKind::Native:
+		return "builtin_function_or_method";
+	case ObjKind::Class:
+		return "type";
+	case ObjKind::Instance:
+		return static_cast<InstanceObject *>(v.obj)->classObject()->name;
+	case ObjKind::Module:
+		return "module";
+	default:
+		return "iterator";
+	}
+}
+
+string quoteString(const string &s)
+{
+	char quote = s.find('\'') != string::npos && s.find('"') == string::npos ? '"' : '\'';
+	string out(1, quote);
+	for (char c : s)
+	{
+		if (c == quote || c == '\\')
+			out += '\\';
+		if (c == '\n')
+			out += "\\n";
+		else if (c == '\t')
+			out += "\\t";
+		else
+			out += c;
+	}
+	return out + quote;
+}
+
+string valueToString(const Value &v, bool quoteStrings)
+{
+	switch (v.tag)
+	{
+	case Value::Tag::Undefined:
+		return "<undefined>";
+	case Value::Tag::None:
+		return "None";
+	case Value::Tag::Bool:
+		return v.i ? "True" : "False";
+	case Value::Tag::Int:
+		return to_string(v.i);
+	case Value::Tag::Float:
+		if (isinf(v.f))
+			return v.f > 0 ? "inf" : "-inf";
+		if (v.f != v.f)
+			return "nan";
+		return formatFloat(v.f);
+	default:
+		break;
+	}
+	switch (v.obj->kind)
+	{
+	case ObjKind::Str:
+		return quoteStrings ? quoteString(static_cast<StrObject *>(v.obj)->s) : static_cast<StrObject *>(v.obj)->s;
+	case ObjKind::List:
+	case ObjKind::Tuple:
+	{
+		bool isList = v.obj->kind == ObjKind::List;
+		auto &items = static_cast<ListObject *>(v.obj)->items;
+		string out = isList ? "[" : "(";
+		for (size_t k = 0; k < items.size(); k++)
+			out += (k ? ", " : "") + valueToString(items[k], true);
+		if (!isList && items.size() == 1)
+			out += ",";
+		return out + (isList ? "]" : ")");
+	}
+	case ObjKind::Dict:
+	case ObjKind::Set:
+	{
+		auto *dict = static_cast<DictObject *>(v.obj);
+		if (v.obj->kind == ObjKind::Set && dict->entries.empty())
+			return "set()";
+		string out = "{";
+		for (size_t k = 0; k < dict->entries.size(); k++)
+		{
+			out += (k ? ", " : "") + valueToString(dict->entries[k].first, true);
+			if (v.obj->kind == ObjKind::Dict)
+				out += ": " + valueToString(dict->entries[k].second, true);
+		}
+		return out + "}";
+	}
+	case ObjKind::Class:
+		return "<class '" + static_cast<ClassObject *>(v.obj)->name + "'>";
+	case ObjKind::Module:
+		return "<module '" + static_cast<ModuleObject *>(v.obj)->name + "'>";
+	case ObjKind::Builtin:
+		return "<built-in function " + static_cast<BuiltinObject *>(v.obj)->name + ">";
+	case ObjKind::Native:
+		return "<native function " + static_cast<NativeObject *>(v.obj)->name + ">";
+	default:
+		return "<" + typeNameOf(v) + " object>";
+	}
+}
+
+// ----------------------------------------------
+// Builtins
+// ----------------------------------------------
+static void expectArgs(Runtime &rt, const char *name, int argc, int minArgs, int maxArgs)
+{
+	if (argc < minArgs || argc > maxArgs)
+		rt.raise("TypeError", string(name) + "() takes " + (minArgs == maxArgs ? to_string(minArgs) : to_string(minArgs) + " to " + to_string(maxArgs)) +
+								  " argument(s), got " + to_string(argc));
+}
+
+static long long expectInt(Runtime &rt, const Value &v, const char *what)
+{
+	if (!v.isIntLike())
+		rt.raise("TypeError", string(what) + " must be an integer, not '" + typeNameOf(v) + "'");
+	return v.i;
+}
+
+Value builtinPrint(Runtime &rt, Value *args, int argc)
+{
+	for (int k = 0; k < argc; k++)
+	{
+		if (k)
+			rt.output += ' ';
+		rt.output += rt.str(args[k]);
+	}
+	rt.output += '\n';
+	if (!rt.captureOutput && rt.output.size() > (1 << 16))
+		rt.flushOutput();
+	return Value();
+}
+
+Value builtinRange(Runtime &rt, Value *args, int argc)
+{
+	expectArgs(rt, "range", argc, 1, 3);
+	long long start = 0, stop, step = 1;
+	if (argc == 1)
+		stop = expectInt(rt, args[0], "range() argument");
+	else
+	{
+		start = expectInt(rt, args[0], "range() argument");
+		stop = expectInt(rt, args[1], "range() argument");
+		if (argc == 3)
+			step = expectInt(rt, args[2], "range() argument");
+	}
+	if (step == 0)
+		rt.raise("ValueError", "range() arg 3 must not be zero");
+	return Value(new RangeIterObject(start, stop, step));
+}
+
+Value builtinLen(Runtime &rt, Value *args, int argc)
+{
+	expectArgs(rt, "len", argc, 1, 1);
+	const Value &v = args[0];
+	if (v.tag == Value::Tag::Object)
+	{
+		switch (v.obj->kind)
+		{
+		case ObjKind::Str:
+			return Value::integer(static_cast<long long>(static_cast<StrObject *>(v.obj)->s.size()));
+		case ObjKind::List:
+		case ObjKind::Tuple:
+			return Value::integer(static_cast<long long>(static_cast<ListObject *>(v.obj)->items.size()));
+		case ObjKind::Dict:
+		case ObjKind::Set:
+			return Value::integer(static_cast<long long>(static_cast<DictObject *>(v.obj)->entries.size()));
+		case ObjKind::RangeIter:
+		{
+			auto *r = static_cast<RangeIterObject *>(v.obj);
+			long long n = r->step > 0 ? (r->stop - r->next + r->step - 1) / r->step : (r->next - r->stop - r->step - 1) / -r->step;
+			return Value::integer(max(0LL, n));
+		}
+		default:
+			break;
+		}
+	}
+	rt.raise("TypeError", "object of type '" + typeNameOf(v) + "' has no len()");
+}
+
+Value builtinStr(Runtime &rt, Value *args, int argc)
+{
+	expectArgs(rt, "str", argc, 0, 1);
+	return makeString(argc ? rt.str(args[0]) : "");
+}
+
+Value builtinRepr(Runtime &rt, Value *args, int argc)
+{
+	expectArgs(rt, "repr", argc, 1, 1);
+	return makeString(valueToString(args[0], true));
+}
+
+Value builtinInt(Runtime &rt, Value *args, int argc)
+{
+	expectArgs(rt, "int", argc, 0, 1);
+	if (argc == 0)
+		return Value::integer(0);
+	const Value &v = args[0];
+	if (v.isIntLike())
+		return Value::integer(v.i);
+	if (v.tag == Value::Tag::Float)
+	{
+		if (!isfinite(v.f) || fabs(v.f) >= 9.2e18)
+			rt.raise("OverflowError", "cannot convert float to integer");
+		return Value::integer(static_cast<long long>(v.f));
+	}
+	if (v.isObject(ObjKind::Str))
+	{
+		const string &s = static_cast<StrObject *>(v.obj)->s;
+		try
+		{
+			size_t used;
+			long long n = stoll(s, &used);
+			while (used < s.size() && isspace(static_cast<unsigned char>(s[used])))
+				used++;
+			if (used == s.size())
+				return Value::integer(n);
+		}
+		catch (const exception &)
+		{
+		}
+		rt.raise("ValueError", "invalid literal for int() with base 10: " + quoteString(s));
+	}
+	rt.raise("TypeError", "int() argument must be a string or a number, not '" + typeNameOf(v) + "'");
+}
+
+Value builtinFloat(Runtime &rt, Value *args, int argc)
+{
+	expectArgs(rt, "float", argc, 0, 1);
+	if (argc == 0)
+		return Value::number(0.0);
+	const Value &v = args[0];
+	if (v.isNumber())
+		return Value::number(v.asDouble());
+	if (v.isObject(ObjKind::Str))
+	{
+		const string &s = static_cast<StrObject *>(v.obj)->s;
+		char *end = nullptr;
+		double d = strtod(s.c_str(), &end);
+		if (!s.empty() && end == s.c_str() + s.size())
+			return Value::number(d);
+		rt.raise("ValueError", "could not convert string to float: " + quoteString(s));
+	}
+	rt.raise("TypeError", "float() argument must be a string or a number, not '" + typeNameOf(v) + "'");
+}
+
+Value builtinBool(Runtime &rt, Value *args, int argc)
+{
+	expectArgs(rt, "bool", argc, 0, 1);
+	return Value::boolean(argc && isTruthy(args[0]));
+}
+
+Value builtinAbs(Runtime &rt, Value *args, int argc)
+{
+	expectArgs(rt, "abs", argc, 1, 1);
+	const Value &v = args[0];
+	if (v.isIntLike())
+	{
+		if (v.i == LLONG_MIN)
+			rt.raise("OverflowError", "integer result too large");
+		return Value::integer(v.i < 0 ? -v.i : v.i);
+	}
+	if (v.tag == Value::Tag::Float)
+		return Value::number(fabs(v.f));
+	rt.raise("TypeError", "bad operand type for abs(): '" + typeNameOf(v) + "'");
+}
+
+static Value minMax(Runtime &rt, Value *args, int argc, bool wantMax)
+{
+	vector<Value> items = argc == 1 ? rt.iterate(args[0]) : vector<Value>(args, args + argc);
+	if (items.empty())
+		rt.raise("ValueError", string(wantMax ? "max" : "min") + "() arg is an empty sequence");
+	Value best = items[0];
+	for (size_t k = 1; k < items.size(); k++)
+	{
+		const Value &v = items[k];
+		bool better;
+		if (v.isNumber() && best.isNumber())
+			better = wantMax ? v.asDouble() > best.asDouble() : v.asDouble() < best.asDouble();
+		else if (v.isObject(ObjKind::Str) && best.isObject(ObjKind::Str))
+		{
+			int cmp = static_cast<StrObject *>(v.obj)->s.compare(static_cast<StrObject *>(best.obj)->s);
+			better = wantMax ? cmp > 0 : cmp < 0;
+		}
+		else
+			rt.raise("TypeError", "'<' not supported between '" + typeNameOf(v) + "' and '" + typeNameOf(best) + "'");
+		if (better)
+			best = v;
+	}
+	return best;
+}
+
+Value builtinMin(Runtime &rt, Value *args, int argc)
+{
+	expectArgs(rt, "min", argc, 1, 1 << 15);
+	return minMax(rt, args, argc, false);
+}
+
+Value builtinMax(Runtime &rt, Value *args, int argc)
+{
+	expectArgs(rt, "max", argc, 1, 1 << 15);
+	return minMax(rt, args, argc, true);
+}
+
+Value builtinSum(Runtime &rt, Value *args, int argc)
+{
+	expectArgs(rt, "sum", argc, 1, 2);
+	long long intTotal = argc == 2 ? expectInt(rt, args[1], "sum() start") : 0;
+	double floatTotal = 0;
+	bool isFloat = false;
+	for (const Value &v : rt.iterate(args[0]))
+	{
+		if (v.isIntLike() && !isFloat)
+		{
+			if (__builtin_add_overflow(intTotal, v.i, &intTotal))
+				rt.raise("OverflowError", "integer result too large");
+		}
+		else if (v.isNumber())
+		{
+			if (!isFloat)
+				floatTotal = static_cast<double>(intTotal);
+			isFloat = true;
+			floatTotal += v.asDouble();
+		}
+		else
+			rt.raise("TypeError", "unsupported operand type(s) for +: 'int' and '" + typeNameOf(v) + "'");
+	}
+	return isFloat ? Value::number(floatTotal) : Value::integer(intTotal);
+}
+
+Value builtinList(Runtime &rt, Value *args, int argc)
+{
+	expectArgs(rt, "list", argc, 0, 1);
+	auto *list = new ListObject();
+	Value v(list);
+	if (argc)
+		list->items = rt.iterate(args[0]);
+	return v;
+}
+
+Value builtinTuple(Runtime &rt, Value *args, int argc)
+{
+	expectArgs(rt, "tuple", argc, 0, 1);
+	auto *tuple = new ListObject(ObjKind::Tuple);
+	Value v(tuple);
+	if (argc)
+		tuple->items = rt.iterate(args[0]);
+	return v;
+}
+
+Value builtinIsinstance(Runtime &rt, Value *args, int argc)
+{
+	expectArgs(rt, "isinstance", argc, 2, 2);
+	if (!args[1].isObject(ObjKind::Class))
+		rt.raise("TypeError", "isinstance() arg 2 must be a class");
+	return Value::boolean(args[0].isObject(ObjKind::Instance) &&
+						  static_cast<InstanceObject *>(args[0].obj)->classObject()->derivesFrom(static_cast<ClassObject *>(args[1].obj)));
+}
+
+Value mathSqrt(Runtime &rt, Value *args, int argc)
+{
+	expectArgs(rt, "sqrt", argc, 1, 1);
+	if (!args[0].isNumber())
+		rt.raise("TypeError", "must be real number, not " + typeNameOf(args[0]));
+	if (args[0].asDouble() < 0)
+		rt.raise("ValueError", "math domain error");
+	return Value::number(sqrt(args[0].asDouble()));
+}
+
+Value mathFloor(Runtime &rt, Value *args, int argc)
+{
+	expectArgs(rt, "floor", argc, 1, 1);
+	if (args[0].isIntLike())
+		return Value::integer(args[0].i);
+	if (!args[0].isNumber())
+		rt.raise("TypeError", "must be real number, not " + typeNameOf(args[0]));
+	return Value::integer(static_cast<long long>(floor(args[0].f)));
+}
+
+Value mathCeil(Runtime &rt, Value *args, int argc)
+{
+	expectArgs(rt, "ceil", argc, 1, 1);
+	if (args[0].isIntLike())
+		return Value::integer(args[0].i);
+	if (!args[0].isNumber())
+		rt.raise("TypeError", "must be real number, not " + typeNameOf(args[0]));
+	return Value::integer(static_cast<long long>(ceil(args[0].f)));
+}
+
+Value timePerfCounter(Runtime &rt, Value *, int argc)
+{
+	expectArgs(rt, "perf_counter", argc, 0, 0);
+	return Value::number(chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+void Runtime::initBuiltins()
+{
+	argsId = names.attrId("args");
+	initId = names.attrId("__init__");
+
+	auto setGlobal = [&](const string &name, const Value &v)
+	{
+		auto it = names.globalSlots.find(name);
+		if (it != names.globalSlots.end())
+			globals[it->second] = v;
+	};
+
+	static const pair<const char *, BuiltinFn> functions[] = {
+		{"print", builtinPrint}, {"range", builtinRange}, {"len", builtinLen}, {"str", builtinStr}, {"repr", builtinRepr}, {"int", builtinInt}, {"float", builtinFloat}, {"bool", builtinBool}, {"abs", builtinAbs}, {"min", builtinMin}, {"max", builtinMax}, {"sum", builtinSum}, {"list", builtinList}, {"tuple", builtinTuple}, {"isinstance", builtinIsinstance}};
+	for (auto &[name, fn] : functions)
+		setGlobal(name, Value(new BuiltinObject(name, fn)));
+	setGlobal("__name__", makeString("__main__"));
+
+	// Exception hierarchy, each class derived from the one named second
+	static const pair<const char *, const char *> hierarchy[] = {
+		{"BaseException", nullptr}, {"Exception", "BaseException"}, {"ArithmeticError", "Exception"}, {"ZeroDivisionError", "ArithmeticError"}, {"OverflowError", "ArithmeticError"}, {"LookupError", "Exception"}, {"IndexError", "LookupError"}, {"KeyError", "LookupError"}, {"ValueError", "Exception"}, {"TypeError", "Exception"}, {"NameError", "Exception"}, {"AttributeError", "Exception"}, {"ImportError", "Exception"}, {"RuntimeError", "Exception"}, {"RecursionError", "RuntimeError"}, {"NotImplementedError", "RuntimeError"}, {"AssertionError", "Exception"}, {"StopIteration", "Exception"}};
+	for (auto &[name, base] : hierarchy)
+	{
+		auto *cls = new ClassObject(name);
+		Value v(cls);
+		if (base)
+			cls->base = exceptionClasses.at(base);
+		exceptionClasses[name] = v;
+		setGlobal(name, v);
+	}
+
+	auto *math = new ModuleObject("math");
+	modules["math"] = Value(math);
+	math->attrs[names.attrId("sqrt")] = Value(new BuiltinObject("sqrt", mathSqrt));
+	math->attrs[names.attrId("floor")] = Value(new BuiltinObject("floor", mathFloor));
+	math->attrs[names.attrId("ceil")] = Value(new BuiltinObject("ceil", mathCeil));
+	math->attrs[names.attrId("pi")] = Value::number(3.141592653589793);
+	math->attrs[names.attrId("e")] = Value::number(2.718281828459045);
+	auto *time = new ModuleObject("time");
+	modules["time"] = Value(time);
+	time->attrs[names.attrId("perf_counter")] = Value(new BuiltinObject("perf_counter", timePerfCounter));
+
+	static const pair<const char *, Method> methods[] = {
+		{"append", Method::Append}, {"pop", Method::Pop}, {"extend", Method::Extend}, {"insert", Method::Insert}, {"index", Method::Index}, {"count", Method::Count}, {"upper", Method::Upper}, {"lower", Method::Lower}, {"strip", Method::Strip}, {"split", Method::Split}, {"join", Method::Join}, {"replace", Method::Replace}, {"startswith", Method::StartsWith}, {"endswith", Method::EndsWith}, {"find", Method::Find}, {"get", Method::Get}, {"keys", Method::Keys}, {"values", Method::Values}, {"items", Method::Items}, {"add", Method::Add}};
+	for (auto &[name, method] : methods)
+		builtinMethods[names.attrId(name)] = method;
+}
+
+// Methods of str, list, dict and set, dispatched by interned name
+Value Runtime::callBuiltinMethod(const Value &receiver, uint32_t name, Value *args, int argc)
+{
+	auto it = builtinMethods.find(name);
+	auto fail = [&]() -> Value
+	{
+		raise("AttributeError", "'" + typeNameOf(receiver) + "' object has no attribute '" + names.attrNames[name] + "'");
+	};
+	if (it == builtinMethods.end() || receiver.tag != Value::Tag::Object)
+		return fail();
+	const char *methodName = names.attrNames[name].c_str();
+	Method method = it->second;
+
+	if (receiver.obj->kind == ObjKind::Str)
+	{
+		const string &s = static_cast<StrObject *>(receiver.obj)->s;
+		auto argString = [&](int k) -> const string &
+		{
+			if (!args[k].isObject(ObjKind::Str))
+				raise("TypeError", string(methodName) + "() argument must be str, not " + typeNameOf(args[k]));
+			return static_cast<StrObject *>(args[k].obj)->s;
+		};
+		switch (method)
+		{
+		case Method::Upper:
+		case Method::Lower:
+		{
+			expectArgs(*this, methodName, argc, 0, 0);
+			string out = s;
+			for (char &ch : out)
+				ch = static_cast<char>(method == Method::Upper ? toupper(static_cast<unsigned char>(ch)) : tolower(static_cast<unsigned char>(ch)));
+			return makeString(out);
+		}
+		case Method::Strip:
+		{
+			expectArgs(*this, methodName, argc, 0, 0);
+			size_t b = s.find_first_not_of(" \t\n\r");
+			size_t e = s.find_last_not_of(" \t\n\r");
+			return makeString(b == string::npos ? "" : s.substr(b, e - b + 1));
+		}
+		case Method::Split:
+		{
+			expectArgs(*this, methodName, argc, 0, 1);
+			auto *list = new ListObject();
+			Value result(list);
+			if (argc == 0)
+			{
+				istringstream words(s);
+				string word;
+				while (words >> word)
+					list->items.push_back(makeString(word));
+				return result;
+			}
+			const string &sep = argString(0);
+			if (sep.empty())
+				raise("ValueError", "empty separator");
+			size_t start = 0, at;
+			while ((at = s.find(sep, start)) != string::npos)
+			{
+				list->items.push_back(makeString(s.substr(start, at - start)));
+				start = at + sep.size();
+			}
+			list->items.push_back(makeString(s.substr(start)));
+			return result;
+		}
+		case Method::Join:
+		{
+			expectArgs(*this, methodName, argc, 1, 1);
+			string out;
+			bool first = true;
+			for (const Value &item : iterate(args[0]))
+			{
+				if (!item.isObject(ObjKind::Str))
+					raise("TypeError", "sequence item: expected str instance, " + typeNameOf(item) + " found");
+				if (!first)
+					out += s;
+				out += static_cast<StrObject *>(item.obj)->s;
+				first = false;
+			}
+			return makeString(out);
+		}
+		case Method::Replace:
+		{
+			expectArgs(*this, methodName, argc, 2, 2);
+			const string &from = argString(0), &to = argString(1);
+			if (from.empty())
+				return makeString(s);
+			string out;
+			size_t start = 0, at;
+			while ((at = s.find(from, start)) != string::npos)
+			{
+				out += s.substr(start, at - start) + to;
+				start = at + from.size();
+			}
+			return makeString(out + s.substr(start));
+		}
+		case Method::StartsWith:
+		case Method::EndsWith:
+		{
+			expectArgs(*this, methodName, argc, 1, 1);
+			const string &x = argString(0);
+			bool ok = x.size() <= s.size() &&
+					  (method == Method::StartsWith ? s.compare(0, x.size(), x) == 0 : s.compare(s.size() - x.size(), x.size(), x) == 0);
+			return Value::boolean(ok);
+		}
+		case Method::Find:
+		{
+			expectArgs(*this, methodName, argc, 1, 1);
+			size_t at = s.find(argString(0));
+			return Value::integer(at == string::npos ? -1 : static_cast<long long>(at));
+		}
+		case Method::Count:
+		{
+			expectArgs(*this, methodName, argc, 1, 1);
+			const string &x = argString(0);
+			long long n = 0;
+			if (x.empty())
+				return Value::integer(static_cast<long long>(s.size()) + 1);
+			for (size_t at = s.find(x); at != string::npos; at = s.find(x, at + x.size()))
+				n++;
+			return Value::integer(n);
+		}
+		default:
+			return fail();
+		}
+	}
+
+	if (receiver.obj->kind == ObjKind::List || receiver.obj->kind == ObjKind::Tuple)
+	{
+		auto &items = static_cast<ListObject *>(receiver.obj)->items;
+		bool mutableList = receiver.obj->kind == ObjKind::List;
+		switch (method)
+		{
+		case Method::Append:
+			if (!mutableList)
+				return fail();
+			expectArgs(*this, methodName, argc, 1, 1);
+			items.push_back(args[0]);
+			return Value();
+		case Method::Extend:
+			if (!mutableList)
+				return fail();
+			expectArgs(*this, methodName, argc, 1, 1);
+			for (const Value &v : iterate(args[0]))
+				items.push_back(v);
+			return Value();
+		case Method::Insert:
+		{
+			if (!mutableList)
+				return fail();
+			expectArgs(*this, methodName, argc, 2, 2);
+			long long at = expectInt(*this, args[0], "index");
+			long long n = static_cast<long long>(items.size());
+			at = at < 0 ? max(0LL, at + n) : min(at, n);
+			items.insert(items.begin() + at, args[1]);
+			return Value();
+		}
+		case Method::Pop:
+		{
+			if (!mutableList)
+				return fail();
+			expectArgs(*this, methodName, argc, 0, 1);
+			if (items.empty())
+				raise("IndexError", "pop from empty list");
+			long long n = static_cast<long long>(items.size());
+			long long at = argc ? expectInt(*this, args[0], "index") : n - 1;
+			if (at < 0)
+				at += n;
+			if (at < 0 || at >= n)
+				raise("IndexError", "pop index out of range");
+			Value v = items[at];
+			items.erase(items.begin() + at);
+			return v;
+		}
+		case Method::Index:
+		case Method::Count:
+		{
+			expectArgs(*this, methodName, argc, 1, 1);
+			long long n = 0;
+			for (size_t k = 0; k < items.size(); k++)
+			{
+				if (!valuesEqual(items[k], args[0]))
+					continue;
+				if (method == Method::Index)
+					return Value::integer(static_cast<long long>(k));
+				n++;
+			}
+			if (method == Method::Index)
+				raise("ValueError", valueToString(args[0], true) + " is not in list");
+			return Value::integer(n);
+		}
+		default:
+			return fail();
+		}
+	}
+
+	if (receiver.obj->kind == ObjKind::Dict || receiver.obj->kind == ObjKind::Set)
+	{
+		auto *dict = static_cast<DictObject *>(receiver.obj);
+		bool isSet = receiver.obj->kind == ObjKind::Set;
+		switch (method)
+		{
+		case Method::Add:
+			if (!isSet)
+				return fail();
+			expectArgs(*this, methodName, argc, 1, 1);
+			dict->set(args[0], Value());
+			return Value();
+		case Method::Get:
+		{
+			if (isSet)
+				return fail();
+			expectArgs(*this, methodName, argc, 1, 2);
+			const Value *v = dict->get(args[0]);
+			return v ? *v : (argc == 2 ? args[1] : Value());
+		}
+		case Method::Keys:
+		case Method::Values:
+		case Method::Items:
+		{
+			if (isSet)
+				return fail();
+			expectArgs(*this, methodName, argc, 0, 0);
+			auto *list = new ListObject();
+			Value result(list);
+			for (auto &[key, value] : dict->entries)
+			{
+				if (method == Method::Keys)
+					list->items.push_back(key);
+				else if (method == Method::Values)
+					list->items.push_back(value);
+				else
+				{
+					auto *pair = new ListObject(ObjKind::Tuple);
+					list->items.push_back(Value(pair));
+					pair->items = {key, value};
+				}
+			}
+			return result;
+		}
+		default:
+			return fail();
+		}
+	}
+	return fail();
+}
+} // namespace pyc::detail
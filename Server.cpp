@@ -0,0 +1,419 @@
+#include "Tools.h"
+#ifdef __unix__
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <poll.h>
+#endif
+
+namespace pyc::detail
+{
+// ----------------------------------------------
+// Compile server
+// ----------------------------------------------
+// --serve=SOCKET keeps a process alive on a Unix domain socket so that
+// repeated invocations skip start-up. Every message in either direction is
+// a 4-byte little-endian length followed by the body. A request body is 'P'
+// and a file path, 'S' and source text, or 'Q' to stop the server; a request
+// over maxRequestFrame bytes closes the connection unanswered. The reply
+// is one JSON object with the tokens, the symbol table, the folded tree and
+// the diagnostics. One thread polls the listener and every connection, and
+// each complete request becomes one task on the work-stealing pool, so a
+// connected but idle client holds no worker. A connection has at most one
+// request in flight, which keeps its replies in order. Each worker keeps its
+// own CompilerSession between requests, and replies are cached by source
+// hash. Without --max-depth, requests may nest 200 deep, as in CPython;
+// deeper input would overflow a worker's stack and take the server down,
+// so it gets an aborted reply instead.
+
+#ifdef __unix__
+bool writeAll(int fd, const char *data, size_t size)
+{
+	while (size > 0)
+	{
+		ssize_t n = send(fd, data, size, MSG_NOSIGNAL);
+		if (n <= 0)
+		{
+			if (n < 0 && errno == EINTR)
+				continue;
+			return false;
+		}
+		data += n;
+		size -= static_cast<size_t>(n);
+	}
+	return true;
+}
+
+bool readAll(int fd, char *data, size_t size)
+{
+	while (size > 0)
+	{
+		ssize_t n = recv(fd, data, size, 0);
+		if (n <= 0)
+		{
+			if (n < 0 && errno == EINTR)
+				continue;
+			return false;
+		}
+		data += n;
+		size -= static_cast<size_t>(n);
+	}
+	return true;
+}
+
+bool writeFrame(int fd, const string &body)
+{
+	uint32_t size = static_cast<uint32_t>(body.size());
+	unsigned char header[4] = {static_cast<unsigned char>(size), static_cast<unsigned char>(size >> 8),
+							   static_cast<unsigned char>(size >> 16), static_cast<unsigned char>(size >> 24)};
+	return writeAll(fd, reinterpret_cast<char *>(header), 4) && writeAll(fd, body.data(), body.size());
+}
+
+const uint32_t maxRequestFrame = 64u << 20;
+
+bool readFrame(int fd, string &body, uint32_t limit)
+{
+	unsigned char header[4];
+	if (!readAll(fd, reinterpret_cast<char *>(header), 4))
+		return false;
+	uint32_t size = header[0] | header[1] << 8 | header[2] << 16 | static_cast<uint32_t>(header[3]) << 24;
+	if (size > limit)
+		return false;
+	body.resize(size);
+	return readAll(fd, &body[0], size);
+}
+
+sockaddr_un socketAddress(const string &path)
+{
+	sockaddr_un address{};
+	address.sun_family = AF_UNIX;
+	if (path.size() >= sizeof(address.sun_path))
+		throw runtime_error("socket path too long: " + path);
+	strcpy(address.sun_path, path.c_str());
+	return address;
+}
+
+CompileServer::CompileServer(const string &socketPath, unsigned jobs, const ResourceBudget &limits, size_t cacheBytes)
+	: path(socketPath), cache(cacheBytes), budget(limits), pool(jobs)
+{
+	if (!budget.maxDepth)
+		budget.maxDepth = defaultMaxDepth;
+	sockaddr_un address = socketAddress(path);
+	// Only a stale socket may be replaced, never a file or a live server
+	struct stat existing;
+	if (lstat(path.c_str(), &existing) == 0)
+	{
+		if (!S_ISSOCK(existing.st_mode))
+			throw runtime_error(path + " exists and is not a socket");
+		int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+		bool live = probe >= 0 && connect(probe, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0;
+		if (probe >= 0)
+			close(probe);
+		if (live)
+			throw runtime_error("a server is already listening on " + path);
+		unlink(path.c_str());
+	}
+	listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listener < 0)
+		throw runtime_error("cannot create socket");
+	if (bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 || listen(listener, 128) != 0 ||
+		pipe(wakePipe) != 0)
+	{
+		string reason = strerror(errno);
+		close(listener);
+		throw runtime_error("cannot listen on " + path + ": " + reason);
+	}
+	fcntl(wakePipe[1], F_SETFL, O_NONBLOCK);
+}
+
+CompileServer::~CompileServer()
+{
+	stopping = true;
+	pool.wait();
+	for (const unique_ptr<Connection> &connection : connections)
+		close(connection->fd);
+	close(wakePipe[0]);
+	close(wakePipe[1]);
+	close(listener);
+	unlink(path.c_str());
+}
+
+void CompileServer::run()
+{
+	vector<pollfd> watched;
+	while (!stopping)
+	{
+		watched.assign({{listener, POLLIN, 0}, {wakePipe[0], POLLIN, 0}});
+		for (const unique_ptr<Connection> &connection : connections)
+			if (!connection->busy)
+				watched.push_back({connection->fd, POLLIN, 0});
+		if (::poll(watched.data(), watched.size(), -1) < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		if (watched[1].revents)
+		{
+			char drained[64];
+			while (read(wakePipe[0], drained, sizeof drained) == sizeof drained)
+				;
+		}
+		if (watched[0].revents & POLLIN)
+			acceptClient();
+		unordered_set<int> readable;
+		for (size_t k = 2; k < watched.size(); k++)
+			if (watched[k].revents)
+				readable.insert(watched[k].fd);
+		for (size_t k = 0; k < connections.size() && !stopping;)
+		{
+			Connection &connection = *connections[k];
+			if (!connection.busy && readable.count(connection.fd) && !receive(connection))
+				connection.ended = true;
+			// Requests sent before the peer closed its end are still answered
+			if (connection.busy || (dispatch(connection) && (connection.busy || !connection.ended)))
+			{
+				k++;
+				continue;
+			}
+			close(connection.fd);
+			connections.erase(connections.begin() + k);
+		}
+	}
+	stopping = true;
+	// In-flight requests see 'stopping' through their budget and end soon
+	pool.wait();
+}
+
+void CompileServer::acceptClient()
+{
+	int client = accept(listener, nullptr, nullptr);
+	if (client < 0)
+		return;
+	// A client that stops reading its replies cannot hold a worker for long
+	timeval timeout{10, 0};
+	setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof timeout);
+	connections.push_back(make_unique<Connection>());
+	connections.back()->fd = client;
+}
+
+bool CompileServer::receive(Connection &connection)
+{
+	char buffer[65536];
+	ssize_t n;
+	do
+		n = recv(connection.fd, buffer, sizeof buffer, MSG_DONTWAIT);
+	while (n < 0 && errno == EINTR);
+	if (n > 0)
+		connection.received.append(buffer, size_t(n));
+	return n > 0 || (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK));
+}
+
+bool CompileServer::dispatch(Connection &connection)
+{
+	if (connection.broken)
+		return false;
+	string &in = connection.received;
+	if (in.size() < 4)
+		return true;
+	uint32_t size = uint8_t(in[0]) | uint8_t(in[1]) << 8 | uint8_t(in[2]) << 16 | uint32_t(uint8_t(in[3])) << 24;
+	if (size > maxRequestFrame)
+		return false;
+	if (in.size() - 4 < size)
+		return true;
+	string request = in.substr(4, size);
+	in.erase(0, 4 + size_t(size));
+	if (!request.empty() && request[0] == 'Q')
+	{
+		stopping = true;
+		writeFrame(connection.fd, "{\"ok\":true}");
+		return false;
+	}
+	requests++;
+	connection.busy = true;
+	pool.submit([this, &connection, request = move(request)]() mutable
+				{
+		static thread_local Worker worker;
+		worker.request = move(request);
+		handle(worker);
+		if (!writeFrame(connection.fd, worker.reply))
+			connection.broken = true;
+		connection.busy = false;
+		char wake = 0;
+		(void)!write(wakePipe[1], &wake, 1); });
+	return true;
+}
+
+void CompileServer::handle(Worker &worker)
+{
+	string source;
+	char kind = worker.request.empty() ? 0 : worker.request[0];
+	if (kind == 'P')
+	{
+		try
+		{
+			source = readFile(worker.request.substr(1));
+		}
+		catch (const exception &e)
+		{
+			worker.reply = "{\"ok\":false,\"error\":";
+			appendJsonString(worker.reply, e.what());
+			worker.reply += '}';
+			return;
+		}
+	}
+	else if (kind == 'S')
+		source.assign(worker.request, 1, string::npos);
+	else
+	{
+		worker.reply = "{\"ok\":false,\"error\":\"unknown request kind\"}";
+		return;
+	}
+	uint64_t hash = contentHash(source);
+	if (cache.find(hash, source, worker.reply))
+		return;
+	bool aborted;
+	try
+	{
+		worker.session.setBudget(budget, &stopping);
+		CompileResult result = worker.session.compile(source);
+		compileToJson(result, worker.reply);
+		aborted = result.aborted;
+	}
+	catch (const exception &e)
+	{
+		worker.reply = "{\"ok\":false,\"error\":";
+		appendJsonString(worker.reply, e.what());
+		worker.reply += '}';
+		return;
+	}
+	// An aborted reply depends on the load, not only on the source
+	if (!aborted)
+		cache.insert(hash, source, worker.reply);
+}
+
+int connectToServer(const string &socketPath)
+{
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	sockaddr_un address = socketAddress(socketPath);
+	if (fd < 0 || connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0)
+	{
+		if (fd >= 0)
+			close(fd);
+		throw runtime_error("cannot connect to " + socketPath + ": " + strerror(errno));
+	}
+	return fd;
+}
+
+int serveCompiler(const string &socketPath, unsigned jobs, const ResourceBudget &budget)
+{
+	try
+	{
+		CompileServer server(socketPath, jobs, budget);
+		cerr << "Serving on " << socketPath << " with " << jobs << " workers" << endl;
+		server.run();
+		cerr << "Stopped after " << server.requestCount() << " requests (" << server.cacheHits() << " cached)" << endl;
+	}
+	catch (const exception &e)
+	{
+		cerr << "Error: " << e.what() << endl;
+		return 1;
+	}
+	return 0;
+}
+
+int runClient(const string &socketPath, const vector<string> &requests)
+{
+	try
+	{
+		int fd = connectToServer(socketPath);
+		string reply;
+		for (const string &request : requests)
+		{
+			string body;
+			if (request == "--stop")
+				body = "Q";
+			else if (request == "-")
+			{
+				stringstream in;
+				in << cin.rdbuf();
+				body = "S" + in.str();
+			}
+			else
+				body = "P" + filesystem::absolute(request).string();
+			if (!writeFrame(fd, body) || !readFrame(fd, reply))
+				throw runtime_error("connection closed by server");
+			cout << reply << "\n";
+		}
+		close(fd);
+	}
+	catch (const exception &e)
+	{
+		cerr << "Error: " << e.what() << endl;
+		return 1;
+	}
+	return 0;
+}
+
+void benchmarkServer(unsigned jobs, size_t requests)
+{
+	TempDirectory scratch("pyc_bench_");
+	string socketPath = scratch.path + "/server.sock";
+	vector<string> sources;
+	for (size_t k = 0; k < requests; k++)
+		sources.push_back("# request " + to_string(k) + "\n" + generateSemanticBenchModule(40 + k % 80));
+
+	auto percentiles = [](const char *what, vector<double> &us)
+	{
+		sort(us.begin(), us.end());
+		double sum = 0;
+		for (double v : us)
+			sum += v;
+		cout << "  " << left << setw(24) << what << right << " p50 " << us[us.size() / 2] << " us, p99 "
+			 << us[min(us.size() - 1, us.size() * 99 / 100)] << " us, mean " << sum / us.size() << " us\n";
+	};
+
+	CompileServer server(socketPath, jobs);
+	thread acceptor([&]
+					{ server.run(); });
+	cout << fixed << setprecision(1);
+	cout << "Compile server latency (" << requests << " requests, " << jobs << " workers)\n";
+	{
+		int fd = connectToServer(socketPath);
+		string reply;
+		auto roundTrip = [&](const string &body)
+		{
+			auto start = chrono::steady_clock::now();
+			if (!writeFrame(fd, body) || !readFrame(fd, reply))
+				throw runtime_error("connection closed by server");
+			return chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+		};
+		vector<double> misses, hits;
+		for (const string &source : sources)
+			misses.push_back(roundTrip("S" + source));
+		for (size_t k = 0; k < requests; k++)
+			hits.push_back(roundTrip("S" + sources[0]));
+		percentiles("server, unique source", misses);
+		percentiles("server, cached source", hits);
+		writeFrame(fd, "Q");
+		readFrame(fd, reply);
+		close(fd);
+	}
+	acceptor.join();
+
+	vector<double> cold;
+	string reply;
+	for (const string &source : sources)
+	{
+		auto start = chrono::steady_clock::now();
+		CompilerSession session(true);
+		compileToJson(session.compile(source), reply);
+		cold.push_back(chrono::duration<double, micro>(chrono::steady_clock::now() - start).count());
+	}
+	percentiles("in-process, cold", cold);
+	cout << defaultfloat << setprecision(6);
+}
+#endif
+} // namespace pyc::detail
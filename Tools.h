@@ -0,0 +1,540 @@
+#ifndef PYC_TOOLS_H
+#define PYC_TOOLS_H
+
+// The driver's front-end tools: the cache, tree images, batch and
+// incremental builds, the module loader, the compile server, watch mode,
+// dumps, the REPL, benchmarks and the checks --self-check runs.
+
+#include "Engines.h"
+
+namespace pyc::detail
+{
+// ----------------------------------------------
+// Semantic pass benchmark
+// ----------------------------------------------
+
+// Produces a module of roughly 'lines' lines made of many independent
+// functions and classes, for timing the semantic pass.
+string generateSemanticBenchModule(size_t lines);
+
+void benchmarkSemanticPass(size_t lines);
+
+// ----------------------------------------------
+// Session benchmark
+// ----------------------------------------------
+
+// Allocations per call of one session over a stream of varying sources,
+// next to the same front end built from scratch on every call. Fails when
+// the session still allocates after its warm-up calls.
+int benchmarkSession(size_t calls);
+
+// ----------------------------------------------
+// Front-end cache
+// ----------------------------------------------
+
+// 64-bit FNV-1a over the bytes of 's'
+uint64_t contentHash(const string &s);
+
+// Image layout: a fixed header, then the string table, tokens, lexer
+// errors, symbols and tree nodes (preorder, each with its child count),
+// then the diagnostics text. Records are LEB128 varints; strings are
+// written once in the table and referred to by index. The checksum covers
+// everything after the header, so that a restore can tell a damaged image.
+struct CacheImageHeader
+{
+	char magic[8];
+	uint64_t version; // contentHash(frontEndVersion)
+	uint64_t sourceHash;
+	uint64_t sourceSize;
+	uint64_t imageSize;
+	uint32_t tokens;
+	uint32_t lexErrors;
+	uint32_t symbols;
+	uint32_t nodes;
+	uint32_t syntaxErrors;
+	uint32_t strings;
+	uint64_t diagnosticsSize;
+	uint64_t checksum; // imageChecksum of the payload
+};
+
+// The header of 'image' if it is a complete image for this front end
+const CacheImageHeader *cacheImageHeader(string_view image);
+
+// Read-only view of a whole file; mapped where mmap is available
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	MappedFile(const MappedFile &) = delete;
+	MappedFile &operator=(const MappedFile &) = delete;
+	~MappedFile() { unmap(); }
+
+	bool open(const string &path);
+
+	string_view view() const { return string_view(mapped, length); }
+
+private:
+	void unmap();
+
+	const char *mapped = nullptr;
+	size_t length = 0;
+#ifndef __unix__
+	string copy;
+#endif
+};
+
+class FrontEndCache
+{
+public:
+	FrontEndCache(const string &directory, uintmax_t capacityBytes);
+
+	FrontEndCache(const FrontEndCache &) = delete;
+	FrontEndCache &operator=(const FrontEndCache &) = delete;
+
+	// Maps the image for a source with this hash and size; false on a miss
+	bool find(uint64_t sourceHash, size_t sourceSize, MappedFile &image);
+
+	void store(uint64_t sourceHash, size_t sourceSize, const CompileResult &result);
+
+	void printStats(ostream &out = cout) const;
+
+	size_t hitCount() const { return hits; }
+	size_t missCount() const { return misses; }
+
+	// Deletes the image find() just returned for this hash when it turns
+	// out not to restore; the lookup then counts as a miss
+	void discard(uint64_t sourceHash);
+
+private:
+	static uint64_t keyOf(uint64_t sourceHash);
+
+	string pathOf(uint64_t key) const;
+
+	void insertEntry(uint64_t key, uintmax_t size);
+
+	void removeEntry(uint64_t key);
+
+	// Deletes least recently used images until the directory fits
+	void evict();
+
+	struct Entry
+	{
+		uint64_t key;
+		uintmax_t size;
+	};
+	string dir;
+	uintmax_t capacity;
+	mutex lock;
+	list<Entry> order; // most recently used first
+	unordered_map<uint64_t, list<Entry>::iterator> entries;
+	uintmax_t used = 0;
+	atomic<size_t> hits{0}, misses{0}, stores{0}, evictions{0};
+};
+
+// Compiles 'source' in 'session', or restores it from 'cache' when the
+// cache has it; new results are stored in the cache
+CompileResult compileCached(CompilerSession &session, const string &source, uint64_t hash, FrontEndCache *cache);
+
+// ----------------------------------------------
+// Tree images
+// ----------------------------------------------
+
+bool saveTreeImage(const ParseTreeNode *root, const string &path);
+
+ParseTreeNode *loadTreeImage(const string &path);
+
+// --load-tree=FILE prints a saved tree the way the default mode prints trees
+int printTreeImage(const string &path, bool showFolded);
+
+// ----------------------------------------------
+// Batch compilation
+// ----------------------------------------------
+struct BatchFileResult
+{
+	string path;
+	uintmax_t bytes = 0;
+	size_t tokens = 0;
+	size_t symbols = 0;
+	size_t nodes = 0;
+	size_t lexErrors = 0;
+	int syntaxErrors = 0;
+	double ms = 0;
+	string failure; // I/O error; the file was not compiled
+};
+
+struct BatchInput
+{
+	string path;
+	string relative; // output name under the output directory
+};
+
+// A directory is searched recursively for .py files; any other file that is
+// not a .py file is read as a list of paths, one per line ('#' comments).
+// Listed paths are normalised and an absolute one loses its root, so that
+// every report lands under the output directory. A path that climbs out
+// with "..", or two paths that would share a report, are errors.
+vector<BatchInput> collectBatchInputs(const string &spec);
+
+// Writes the single-file report for 'result' to 'outputPath'; false if it cannot be created
+bool writeCompileReport(const CompileResult &result, const string &outputPath);
+
+// Compiles every input on 'jobs' workers; results come back in input order.
+// Largest files are started first so that no big file begins last and
+// leaves one worker busy after the others have finished.
+vector<BatchFileResult> runBatch(const vector<BatchInput> &inputs, const string &outputDir, unsigned jobs,
+								 FrontEndCache *cache = nullptr, const ResourceBudget &budget = {});
+
+int batchCompile(const string &spec, const string &outputDir, unsigned jobs, FrontEndCache *cache = nullptr,
+				 const ResourceBudget &budget = {});
+
+// Files/sec of the batch front end from 1 to 'maxJobs' workers, without
+// per-file outputs. Without a directory a corpus of 'files' modules with
+// skewed sizes is generated in a temporary directory.
+void benchmarkBatch(const string &dir, unsigned maxJobs, size_t files = 2000);
+
+// A batch without the cache, with a cold cache and with a warm one, next to
+// just reading and hashing the same files; then the same with reports, and
+// a warm run through a cache too small for the corpus.
+void benchmarkCache(const string &dir, unsigned jobs, size_t files = 2000);
+
+// ----------------------------------------------
+// Module loader
+// ----------------------------------------------
+
+struct LoadedModule
+{
+	string name; // dotted name; the entry file is __main__
+	string path;
+	bool package = false;	  // loaded from an __init__.py
+	vector<string> imports;	  // resolved modules, in first-seen order
+	vector<string> unresolved; // imported names found on no search path
+	size_t tokens = 0;
+	size_t nodes = 0;
+	int syntaxErrors = 0;
+	string failure; // I/O error or exhausted budget; its imports were not followed
+};
+
+class ModuleLoader
+{
+public:
+	ModuleLoader(vector<string> paths, unsigned jobs, const ResourceBudget &limits = {})
+		: searchPaths(move(paths)), budget(limits), pool(jobs) {}
+
+	// Loads 'entryPath' and everything it imports; results are sorted by name
+	vector<LoadedModule> load(const string &entryPath);
+
+	size_t parseCount() const { return parses; }
+
+private:
+	static constexpr size_t notFound = SIZE_MAX;
+
+	vector<string> searchPaths;
+	ResourceBudget budget; // per module
+	mutex lock;
+	deque<LoadedModule> modules;			// element references survive growth
+	unordered_map<string, size_t> known; // module name -> index, or notFound
+	atomic<size_t> parses{0};
+	WorkStealingPool pool; // last, so its workers stop before the state they use goes away
+
+	// Package directory first, then module file, as Python's path finder does
+	pair<string, bool> resolve(const string &name) const;
+
+	// Registers a module and returns its index; the caller holds 'lock'
+	// and submits the module's task
+	size_t addModule(const string &name, const string &path, bool package);
+
+	void loadModule(size_t index);
+
+	// Whether 'name' is a module on the search paths; starts loading it the first time
+	bool follow(const string &name);
+};
+
+// Prints the module graph reachable from 'entryPath'. Like "python FILE",
+// the script's own directory is searched before 'searchPaths'.
+int printImportGraph(const string &entryPath, vector<string> searchPaths, unsigned jobs, const ResourceBudget &budget = {});
+
+// Wall-clock time to load a package tree from 1 to 'maxJobs' workers. With a
+// directory, the entry imports every top-level module and package in it;
+// otherwise a tree of packages with cross-imports (plenty of diamonds) is
+// generated in a temporary directory.
+void benchmarkImports(const string &dir, unsigned maxJobs);
+
+// ----------------------------------------------
+// Incremental builds
+// ----------------------------------------------
+
+struct BuildStats
+{
+	size_t modules = 0;
+	size_t hashed = 0;	 // size or mtime changed, so the content was hashed
+	size_t parsed = 0;	 // content changed
+	size_t relinked = 0; // link step redone
+	size_t removed = 0;
+	vector<string> linkErrors; // "path: message" for every module
+	double ms = 0;
+};
+
+BuildStats buildProject(const string &root, const string &outputDir, unsigned jobs, bool writeReports = true,
+						FrontEndCache *cache = nullptr);
+
+int runBuild(const string &root, const string &outputDir, unsigned jobs, FrontEndCache *cache = nullptr);
+
+// Full build, no-op rebuild, a touched file, an edit that keeps a module's
+// exports, and an edit that changes them, on a generated tree of 'files'
+// modules. Reports are not written so that only the build itself is timed.
+void benchmarkBuild(size_t files, unsigned jobs);
+
+// ----------------------------------------------
+// Compile server
+// ----------------------------------------------
+
+// Replies keyed by source hash, evicting the least recently used beyond 'capacity' bytes
+class ReplyCache
+{
+public:
+	explicit ReplyCache(size_t capacityBytes) : capacity(capacityBytes) {}
+
+	bool find(uint64_t hash, const string &source, string &reply)
+	{
+		lock_guard<mutex> guard(lock);
+		auto it = entries.find(hash);
+		if (it == entries.end() || it->second->source != source)
+			return false;
+		order.splice(order.begin(), order, it->second);
+		reply = it->second->reply;
+		hits++;
+		return true;
+	}
+
+	void insert(uint64_t hash, const string &source, const string &reply)
+	{
+		lock_guard<mutex> guard(lock);
+		if (source.size() + reply.size() > capacity || entries.count(hash))
+			return;
+		order.push_front({hash, source, reply});
+		entries[hash] = order.begin();
+		used += source.size() + reply.size();
+		while (used > capacity)
+		{
+			Entry &last = order.back();
+			used -= last.source.size() + last.reply.size();
+			entries.erase(last.hash);
+			order.pop_back();
+		}
+	}
+
+	size_t hitCount() const { return hits; }
+
+private:
+	struct Entry
+	{
+		uint64_t hash;
+		string source;
+		string reply;
+	};
+	mutex lock;
+	list<Entry> order; // most recently used first
+	unordered_map<uint64_t, list<Entry>::iterator> entries;
+	size_t capacity;
+	size_t used = 0;
+	atomic<size_t> hits{0};
+};
+
+#ifdef __unix__
+// Whole-buffer socket I/O; false when the peer went away
+bool writeAll(int fd, const char *data, size_t size);
+
+bool writeFrame(int fd, const string &body);
+
+// False when the peer went away or announced more than 'limit' bytes
+bool readFrame(int fd, string &body, uint32_t limit = UINT32_MAX);
+
+class CompileServer
+{
+public:
+	CompileServer(const string &socketPath, unsigned jobs, const ResourceBudget &limits = {}, size_t cacheBytes = 64 << 20);
+
+	~CompileServer();
+
+	// Serves connections until a 'Q' request arrives. Requests still being
+	// compiled are cancelled and answered; idle connections are closed.
+	void run();
+
+	size_t requestCount() const { return requests; }
+	size_t cacheHits() const { return cache.hitCount(); }
+
+private:
+	// Per-worker state that survives across requests
+	struct Worker
+	{
+		CompilerSession session{true};
+		string request;
+		string reply;
+	};
+
+	struct Connection
+	{
+		int fd;
+		string received; // bytes of requests not yet dispatched
+		bool ended = false; // the peer will send nothing more
+		atomic<bool> busy{false};
+		atomic<bool> broken{false}; // the reply could not be sent
+	};
+
+	static constexpr int defaultMaxDepth = 200;
+
+	string path;
+	int listener = -1;
+	int wakePipe[2] = {-1, -1}; // workers wake the poll loop after replying
+	vector<unique_ptr<Connection>> connections;
+	ReplyCache cache;
+	ResourceBudget budget; // per request; stopping the server cancels requests in flight
+	atomic<bool> stopping{false};
+	atomic<size_t> requests{0};
+	WorkStealingPool pool; // last, so it is drained before the rest is destroyed
+
+	void acceptClient();
+
+	// Reads what has arrived, one buffer per wake-up so that an oversized
+	// frame is refused early; false once the peer closed its end
+	bool receive(Connection &connection);
+
+	// Starts the next complete request of an idle connection; false when the
+	// connection should be closed
+	bool dispatch(Connection &connection);
+
+	void handle(Worker &worker);
+};
+
+int connectToServer(const string &socketPath);
+
+int serveCompiler(const string &socketPath, unsigned jobs, const ResourceBudget &budget = {});
+
+// Sends each file (or standard input for "-") and prints one reply per line;
+// "--stop" asks the server to exit
+int runClient(const string &socketPath, const vector<string> &requests);
+
+// Request latency through the socket: unique sources (warm workers, cache
+// misses), a repeated source (cache hits), and for reference the same
+// unique sources compiled in-process with a fresh session each time.
+void benchmarkServer(unsigned jobs, size_t requests = 2000);
+#endif
+
+#ifdef __linux__
+// ----------------------------------------------
+// Watch mode
+// ----------------------------------------------
+
+// Prints diagnostics for every file, then for each batch of edits until interrupted
+int watchSources(const string &root, const string &outputDir, unsigned jobs, int debounceMs);
+
+// Event-to-diagnostics latency under an edit storm: a writer thread
+// rewrites files of a generated tree in bursts (the same file several
+// times in a row, or several files at once) while the watcher runs. Each
+// write carries a unique marker, so a compiled result is matched to the
+// write that produced its contents.
+void benchmarkWatch(size_t edits, unsigned jobs, int debounceMs);
+#endif
+
+// ----------------------------------------------
+// Token and tree dumps
+// ----------------------------------------------
+
+int dumpFile(const string &path, bool tree, const string &format);
+
+// ----------------------------------------------
+// Interactive mode
+// ----------------------------------------------
+
+class ReplSession
+{
+public:
+	explicit ReplSession(ostream &output);
+
+	// Reads and compiles inputs until end of file or :quit
+	void run(istream &in);
+
+	// One physical line, without its '\n'
+	void feed(const string &line);
+
+private:
+	ostream &out;
+	Lexer lexer;
+	Syntax_Analyzer analyzer; // its tokens are those of the input being read
+	SymbolTable symbols;
+	Parser parser{analyzer.tokens, symbols};
+	ConstantFolder::Env constants; // module-level values known after the inputs so far
+	vector<Error> errors;
+	string logical; // lines of a logical line still waiting for its end
+	int logicalStart = 1, nextLine = 1;
+	bool showTree = false, atEnd = false;
+	size_t inputs = 0;
+	double lexUs = 0; // spent lexing the lines of the input being read
+	double totalUs = 0, lastUs = 0, maxUs = 0;
+
+	bool waiting() const { return !logical.empty() || !analyzer.tokens.empty(); }
+
+	// Whether 'text' ends inside a triple-quoted string or after a backslash;
+	// 'depth' is set to the number of brackets still open outside strings
+	static bool continues(const string &text, int &depth);
+
+	void compileInput();
+
+	// False on :quit
+	bool command(const string &line);
+};
+
+int runRepl();
+
+// ----------------------------------------------
+// Synthetic corpus
+// ----------------------------------------------
+
+// "4096", "64K", "16M" or "1G" (powers of 1024)
+uint64_t parseByteSize(const string &text);
+
+// --gen-corpus=SHAPE:SIZE[:SEED] writes one corpus to stdout or to 'path'
+int writeCorpus(const string &spec, const string &path);
+
+// ----------------------------------------------
+// Front-end stage benchmark
+// ----------------------------------------------
+
+// With a 'jsonPath' the results are also written there as
+// {"corpora":[...]} for comparison between builds.
+int benchmarkStages(const string &specs, const string &jsonPath);
+
+// ----------------------------------------------
+// Subtree sharing benchmark
+// ----------------------------------------------
+
+int benchmarkSharing(const string &specs);
+
+// ----------------------------------------------
+// Budget overhead benchmark
+// ----------------------------------------------
+
+int benchmarkBudget(const string &specs);
+
+// ----------------------------------------------
+// Tree pass benchmark
+// ----------------------------------------------
+
+// Takes the same corpus specs as --bench-stages; --bench-json writes
+// {"corpora":[...]} with both timings per corpus
+int benchmarkPasses(const string &specs, const string &jsonPath);
+
+// ----------------------------------------------
+// Differential check against CPython
+// ----------------------------------------------
+
+int diffAgainstCPython(const string &paths, const string &csvPath);
+
+// ----------------------------------------------
+// Front-end checks
+// ----------------------------------------------
+
+int runFrontEndChecks();
+} // namespace pyc::detail
+
+#endif
@@ -0,0 +1,943 @@
+#include "Engines.h"
+
+namespace pyc::detail
+{
+// ----------------------------------------------
+// C transpiler
+// ----------------------------------------------
+// Translates module-level functions whose parameters, locals and result are
+// statically int, float or bool into C over unboxed long long, double and
+// int variables. Types come from the SymbolTable, literal arguments at call
+// sites and the expressions assigned, refined until nothing changes. Any
+// other function stays on the VM, which also serves as the runtime for the
+// generated code: each translated def becomes a NativeObject that checks its
+// argument tags on every call and falls back to the bytecode version when
+// they differ. Integer overflow, floor division, modulo and the exceptions
+// they raise follow the VM.
+
+const char *cTypeName(CType t)
+{
+	return t == CType::Float ? "double" : t == CType::Bool ? "int" : "long long";
+}
+
+const char *pythonTypeName(CType t)
+{
+	return t == CType::Float ? "float" : t == CType::Bool ? "bool" : "int";
+}
+
+// Checked helpers shared by every generated module, from
+// TranspilerPrelude.c. The status codes must match NativeStatus.
+static const char *const transpilerPrelude =
+#include "TranspilerPrelude.c.inc"
+	;
+
+TranspileResult CTranspiler::transpile(ParseTreeNode *root)
+{
+	functions.clear();
+	index.clear();
+	collectCandidates(root);
+
+	// Every pass regenerates all eligible functions. Types only ever go
+	// from Unknown to known and functions only ever lose eligibility, so
+	// this terminates; functions still waiting for a type when nothing
+	// moves any more are given up on.
+	while (true)
+	{
+		changed = false;
+		for (Function &f : functions)
+			if (f.eligible)
+				generate(f);
+		if (changed)
+			continue;
+		for (Function &f : functions)
+		{
+			if (!f.eligible || !f.pending)
+				continue;
+			auto untyped = find_if(f.params.begin(), f.params.end(), [&](const string &p)
+								   { return f.types[p] == CType::Unknown; });
+			reject(f, untyped != f.params.end() ? "has no inferred type for parameter '" + *untyped + "'"
+												: "could not infer the type of every variable");
+		}
+		if (!changed)
+			break;
+	}
+	return emitModule();
+}
+
+ParseTreeNode *CTranspiler::unwrapStatement(ParseTreeNode *node)
+{
+	while (node->label == "statement" && node->children.size() == 1)
+		node = node->children[0];
+	return node;
+}
+
+ParseTreeNode *CTranspiler::argumentsOf(ParseTreeNode *call)
+{
+	for (ParseTreeNode *part : call->children)
+		if (part->label == "arguments")
+			return part;
+	return nullptr;
+}
+
+string CTranspiler::signatureOf(const vector<string> &params, const unordered_map<string, CType> &types, CType result)
+{
+	string signature;
+	for (const string &param : params)
+		signature += "ifb"[static_cast<int>(types.at(param)) - 1];
+	return signature + ">" + "ifb"[static_cast<int>(result) - 1];
+}
+
+void CTranspiler::reject(Function &f, const string &reason)
+{
+	f.eligible = false;
+	f.reason = reason;
+	changed = true;
+}
+
+void CTranspiler::line(const string &text)
+{
+	out.append(depth, '\t');
+	out += text;
+	out += '\n';
+}
+
+void CTranspiler::collectCandidates(ParseTreeNode *root)
+{
+	moduleBindings.clear();
+	vector<ParseTreeNode *> defs;
+	for (ParseTreeNode *child : root->children)
+	{
+		ParseTreeNode *statement = unwrapStatement(child);
+		if (isLeaf(statement))
+			continue;
+		unordered_set<string> names;
+		collectBoundNames(statement, names);
+		for (const string &name : names)
+			moduleBindings[name]++;
+		if (statement->label == "function")
+			defs.push_back(statement);
+	}
+
+	for (ParseTreeNode *def : defs)
+	{
+		Function f;
+		f.node = def;
+		f.name = def->children[1]->label;
+		bool hasDefaults = false;
+		for (ParseTreeNode *param : def->children[3]->children)
+		{
+			if (param->label != "parameter")
+				continue;
+			f.params.push_back(param->children[0]->label);
+			hasDefaults = hasDefaults || param->children.size() == 3;
+		}
+		collectBoundNames(def->children.back(), f.bound);
+		for (const string &param : f.params)
+		{
+			f.bound.erase(param);
+			auto symbol = symTable.table.find(symTable.keyFor(param, f.name));
+			f.types[param] = symbol == symTable.table.end() ? CType::Unknown : typeFromSymbol(symbol->second.type);
+		}
+		if (hasDefaults)
+			f.eligible = false, f.reason = "has default arguments";
+		else if (f.params.size() > NativeObject::maxParams)
+			f.eligible = false, f.reason = "has more than " + to_string(NativeObject::maxParams) + " parameters";
+		else if (moduleBindings[f.name] > 1)
+			f.eligible = false, f.reason = "is rebound at module level";
+		if (index.count(f.name))
+			continue;
+		index[f.name] = functions.size();
+		functions.push_back(move(f));
+	}
+
+	// Literal arguments at module-level call sites type parameters the
+	// symbol pass left unknown
+	for (ParseTreeNode *child : root->children)
+		if (unwrapStatement(child)->label != "function")
+			seedFromCalls(child);
+}
+
+CType CTranspiler::typeFromSymbol(string_view type)
+{
+	if (type == "int")
+		return CType::Int;
+	if (type == "float")
+		return CType::Float;
+	if (type == "bool")
+		return CType::Bool;
+	return CType::Unknown;
+}
+
+CType CTranspiler::typeOfLiteral(const ConstValue &v)
+{
+	switch (v.kind)
+	{
+	case ConstValue::Kind::Int:
+		return CType::Int;
+	case ConstValue::Kind::Float:
+		return CType::Float;
+	case ConstValue::Kind::Bool:
+		return CType::Bool;
+	default:
+		return CType::Unknown;
+	}
+}
+
+void CTranspiler::seedFromCalls(ParseTreeNode *node)
+{
+	ParseTreeNode *callee = nullptr, *arguments = nullptr;
+	if (node->label == "function_call")
+		callee = node->children[0], arguments = argumentsOf(node);
+	else if (node->label == "factor" && node->children.size() > 1 && node->children[1]->label == "(")
+		callee = node->children[0], arguments = node->children.size() > 3 ? node->children[2] : nullptr;
+	if (callee && arguments && isLeaf(callee))
+	{
+		auto it = index.find(callee->label);
+		if (it != index.end())
+		{
+			Function &f = functions[it->second];
+			size_t k = 0;
+			for (ParseTreeNode *arg : arguments->children)
+			{
+				if (arg->label != "expression")
+					continue;
+				ConstValue v;
+				if (k < f.params.size() && f.types[f.params[k]] == CType::Unknown && literalOf(arg, v))
+					f.types[f.params[k]] = typeOfLiteral(v);
+				k++;
+			}
+		}
+	}
+	for (ParseTreeNode *child : node->children)
+		seedFromCalls(child);
+}
+
+void CTranspiler::generate(Function &f)
+{
+	fn = &f;
+	out.clear();
+	depth = 1;
+	temps = 0;
+	f.pending = false;
+	f.sequenced.clear();
+	assigned = unordered_set<string>(f.params.begin(), f.params.end());
+	try
+	{
+		for (const string &param : f.params)
+			if (f.types[param] == CType::Unknown)
+				f.pending = true;
+		if (!f.pending)
+		{
+			compileBlock(f.node->children.back());
+			if (!alwaysReturns(f.node->children.back()))
+				unsupported("can reach the end of the body and return None");
+		}
+		f.code = out;
+	}
+	catch (const CompileError &e)
+	{
+		reject(f, e.what());
+	}
+	fn = nullptr;
+}
+
+void CTranspiler::assignType(const string &name, CType type)
+{
+	if (!fn->bound.count(name) && !fn->types.count(name))
+		unsupported("assigns global '" + name + "'");
+	if (type == CType::Unknown)
+	{
+		fn->pending = true;
+		return;
+	}
+	CType &current = fn->types[name];
+	if (current == CType::Unknown)
+	{
+		current = type;
+		if (find(fn->localOrder.begin(), fn->localOrder.end(), name) == fn->localOrder.end() &&
+			find(fn->params.begin(), fn->params.end(), name) == fn->params.end())
+			fn->localOrder.push_back(name);
+		changed = true;
+	}
+	else if (current != type)
+		unsupported("'" + name + "' holds both " + pythonTypeName(current) + " and " + pythonTypeName(type));
+}
+
+bool CTranspiler::blockReturns(ParseTreeNode *block)
+{
+	for (ParseTreeNode *child : block->children)
+		if (!isLeaf(child) && alwaysReturns(unwrapStatement(child)))
+			return true;
+	return false;
+}
+
+bool CTranspiler::alwaysReturns(ParseTreeNode *node)
+{
+	if (node->label == "block")
+		return blockReturns(node);
+	if (node->label == "return_statement")
+		return true;
+	if (node->label != "conditional_statement")
+		return false;
+	bool hasElse = false;
+	if (!blockReturns(node->children[3]))
+		return false;
+	for (size_t k = 4; k < node->children.size(); k++)
+	{
+		ParseTreeNode *part = node->children[k];
+		if (part->label == "elif_clause" && !blockReturns(part->children[3]))
+			return false;
+		if (part->label == "else_clause")
+		{
+			hasElse = true;
+			if (!blockReturns(part->children[2]))
+				return false;
+		}
+	}
+	return hasElse;
+}
+
+void CTranspiler::compileBlock(ParseTreeNode *block)
+{
+	for (ParseTreeNode *child : block->children)
+		compileStatement(child);
+}
+
+void CTranspiler::compileStatement(ParseTreeNode *node)
+{
+	const string &label = node->label;
+	if (isLeaf(node) || label == "pass_statement")
+		return;
+	if (label == "statement")
+	{
+		compileStatement(node->children[0]);
+		return;
+	}
+	if (label == "assignment")
+		compileAssignment(node);
+	else if (label == "conditional_statement")
+		compileConditional(node);
+	else if (label == "while_statement")
+	{
+		line("while (" + condition(node->children[1]) + ")");
+		compileBody(node->children[3]);
+	}
+	else if (label == "for_statement")
+		compileFor(node);
+	else if (label == "return_statement")
+	{
+		if (node->children.size() < 2)
+			unsupported("returns None");
+		CExpr value = expr(node->children[1]);
+		if (value.type != CType::Unknown)
+		{
+			if (fn->result == CType::Unknown)
+			{
+				fn->result = value.type;
+				changed = true;
+			}
+			else if (fn->result != value.type)
+				unsupported(string("returns both ") + pythonTypeName(fn->result) + " and " + pythonTypeName(value.type));
+		}
+		line("return " + value.code + ";");
+	}
+	else if (label == "break_statement")
+		line("break;");
+	else if (label == "continue_statement")
+		line("continue;");
+	else if (label == "factor" && node->children.size() == 1 && classifyLeaf(node->children[0]->label) == LeafKind::String)
+		return; // docstring
+	else if (label == "function_call" || label == "factor")
+	{
+		CExpr value = label == "function_call" ? compileCall(node->children[0], argumentsOf(node)) : expr(node);
+		line("(void)(" + value.code + ");");
+	}
+	else
+		unsupported("uses " + label);
+}
+
+void CTranspiler::compileBody(ParseTreeNode *block)
+{
+	unordered_set<string> before = assigned;
+	line("{");
+	depth++;
+	compileBlock(block);
+	depth--;
+	line("}");
+	assigned = move(before);
+}
+
+void CTranspiler::compileAssignment(ParseTreeNode *node)
+{
+	vector<ParseTreeNode *> targets, values;
+	for (ParseTreeNode *target : node->children[0]->children)
+	{
+		if (target->label == ",")
+			continue;
+		if (!isLeaf(target))
+			unsupported("assigns an attribute");
+		targets.push_back(target);
+	}
+	for (ParseTreeNode *value : node->children[2]->children)
+		if (value->label == "expression")
+			values.push_back(value);
+	string op = node->children[1]->children.empty() ? "=" : node->children[1]->children[0]->label;
+
+	if (op != "=")
+	{
+		if (targets.size() != 1 || values.size() != 1)
+			unsupported("uses augmented assignment with several targets");
+		const string &name = targets[0]->label;
+		CExpr updated = binary(op.substr(0, op.size() - 1), load(name), expr(values[0]), values[0]);
+		assignType(name, updated.type);
+		line("v_" + name + " = " + updated.code + ";");
+		assigned.insert(name);
+		return;
+	}
+	if (targets.size() != values.size())
+		unsupported("unpacks a sequence");
+	if (targets.size() == 1)
+	{
+		CExpr value = expr(values[0]);
+		assignType(targets[0]->label, value.type);
+		line("v_" + targets[0]->label + " = " + value.code + ";");
+		assigned.insert(targets[0]->label);
+		return;
+	}
+	// a, b = b, a: every value is computed before any target is bound
+	line("{");
+	depth++;
+	vector<string> names;
+	for (size_t k = 0; k < values.size(); k++)
+	{
+		CExpr value = expr(values[k]);
+		assignType(targets[k]->label, value.type);
+		names.push_back("t" + to_string(temps++));
+		line(string(cTypeName(value.type)) + " " + names.back() + " = " + value.code + ";");
+	}
+	for (size_t k = 0; k < targets.size(); k++)
+	{
+		line("v_" + targets[k]->label + " = " + names[k] + ";");
+		assigned.insert(targets[k]->label);
+	}
+	depth--;
+	line("}");
+}
+
+void CTranspiler::compileConditional(ParseTreeNode *node)
+{
+	line("if (" + condition(node->children[1]) + ")");
+	compileBody(node->children[3]);
+	for (size_t k = 4; k < node->children.size(); k++)
+	{
+		ParseTreeNode *part = node->children[k];
+		if (part->label == "elif_clause")
+		{
+			line("else if (" + condition(part->children[1]) + ")");
+			compileBody(part->children[3]);
+		}
+		else if (part->label == "else_clause")
+		{
+			line("else");
+			compileBody(part->children[2]);
+		}
+	}
+}
+
+void CTranspiler::compileFor(ParseTreeNode *node)
+{
+	const string &name = node->children[1]->label;
+	ParseTreeNode *iterable = node->children[3];
+	while (iterable->children.size() == 1 && iterable->folded.empty())
+		iterable = iterable->children[0];
+	const auto &c = iterable->children;
+	if (iterable->label != "factor" || c.size() < 3 || !isLeaf(c[0]) || c[0]->label != "range" ||
+		c[1]->label != "(" || !isBuiltin("range"))
+		unsupported("iterates over something other than range()");
+	vector<CExpr> args;
+	if (c.size() > 3)
+		for (ParseTreeNode *arg : c[2]->children)
+			if (arg->label == "expression")
+				args.push_back(expr(arg));
+	if (args.empty() || args.size() > 3)
+		unsupported("calls range() with " + to_string(args.size()) + " arguments");
+	for (const CExpr &arg : args)
+		if (arg.type == CType::Float)
+			unsupported("calls range() with a float");
+	assignType(name, CType::Int);
+
+	string k = to_string(temps++);
+	string start = args.size() > 1 ? args[0].code : "0";
+	string stop = args.size() > 1 ? args[1].code : args[0].code;
+	string step = args.size() > 2 ? "pyc_range_step(" + args[2].code + ")" : "1";
+	line("{");
+	depth++;
+	line("long long start" + k + " = " + start + ", stop" + k + " = " + stop + ", step" + k + " = " + step + ";");
+	line("for (long long i" + k + " = start" + k + "; step" + k + " > 0 ? i" + k + " < stop" + k + " : i" + k + " > stop" + k +
+		 "; i" + k + " = pyc_range_next(i" + k + ", step" + k + ", stop" + k + "))");
+	line("{");
+	depth++;
+	line("v_" + name + " = i" + k + ";");
+	unordered_set<string> before = assigned;
+	assigned.insert(name);
+	compileBlock(node->children[5]);
+	assigned = move(before);
+	depth--;
+	line("}");
+	depth--;
+	line("}");
+}
+
+bool CTranspiler::isBuiltin(const string &name) const
+{
+	return !fn->bound.count(name) && !fn->types.count(name) && !moduleBindings.count(name);
+}
+
+CTranspiler::CExpr CTranspiler::load(const string &name)
+{
+	auto it = fn->types.find(name);
+	if (it == fn->types.end() && !fn->bound.count(name))
+		unsupported("reads global '" + name + "'");
+	// C locals start out as 0 where Python raises NameError
+	if (!assigned.count(name))
+		unsupported("may read '" + name + "' before it is assigned");
+	CExpr e;
+	e.type = it == fn->types.end() ? CType::Unknown : it->second;
+	if (e.type == CType::Unknown)
+		fn->pending = true;
+	e.code = "v_" + name;
+	return e;
+}
+
+CTranspiler::CExpr CTranspiler::literal(const ConstValue &v)
+{
+	CExpr e;
+	e.type = typeOfLiteral(v);
+	if (e.type == CType::Int)
+		e.code = v.i == LLONG_MIN ? "LLONG_MIN" : to_string(v.i) + "LL";
+	else if (e.type == CType::Bool)
+		e.code = v.i ? "1" : "0";
+	else if (e.type == CType::Float)
+	{
+		if (isinf(v.f))
+			e.code = v.f > 0 ? "HUGE_VAL" : "(-HUGE_VAL)";
+		else
+		{
+			char buf[40];
+			snprintf(buf, sizeof(buf), "%.17g", v.f);
+			e.code = buf;
+			if (e.code.find_first_of(".e") == string::npos)
+				e.code += ".0";
+			if (v.f < 0)
+				e.code = "(" + e.code + ")";
+		}
+	}
+	else
+		unsupported("uses a value that is not an int, float or bool");
+	return e;
+}
+
+string CTranspiler::asDouble(const CExpr &e)
+{
+	return e.type == CType::Float ? e.code : "(double)(" + e.code + ")";
+}
+
+string CTranspiler::truth(const CExpr &e)
+{
+	if (e.type == CType::Float)
+		return "(" + e.code + " != 0.0)";
+	if (e.type == CType::Int)
+		return "(" + e.code + " != 0)";
+	return e.code;
+}
+
+string CTranspiler::condition(ParseTreeNode *node)
+{
+	ConstValue v;
+	if (literalOf(node, v))
+		return truth(literal(v));
+	while (node->children.size() == 1 && node->label != "factor")
+		node = node->children[0];
+	const auto &c = node->children;
+	if (node->label == "or_expression" || node->label == "and_expression")
+	{
+		string joined;
+		for (size_t k = 0; k < c.size(); k += 2)
+			joined += (k ? (node->label == "or_expression" ? " || " : " && ") : "") + condition(c[k]);
+		return "(" + joined + ")";
+	}
+	if (node->label == "not_expression")
+		return "!" + condition(c[1]);
+	return truth(expr(node));
+}
+
+CTranspiler::CExpr CTranspiler::expr(ParseTreeNode *node)
+{
+	ConstValue v;
+	if (literalOf(node, v))
+		return literal(v);
+	const string &label = node->label;
+	const auto &c = node->children;
+	if (c.size() == 1 && label != "factor")
+		return expr(c[0]);
+	if (label == "or_expression" || label == "and_expression")
+	{
+		// Python returns an operand, not a bool; that only matches C for bools
+		for (size_t k = 0; k < c.size(); k += 2)
+		{
+			CExpr part = expr(c[k]);
+			if (part.type != CType::Bool && part.type != CType::Unknown)
+				unsupported("uses '" + c[1]->label + "' on a value that is not a bool");
+		}
+		return {CType::Bool, condition(node)};
+	}
+	if (label == "not_expression")
+		return {CType::Bool, "!" + condition(c[1])};
+	if (label == "comparison")
+		return compileComparison(node);
+	if (label == "arithmetic" || label == "term")
+	{
+		CExpr acc = expr(c[0]);
+		for (size_t k = 1; k + 1 < c.size(); k += 2)
+			acc = binary(c[k]->label, acc, expr(c[k + 1]), c[k + 1]);
+		return acc;
+	}
+	if (label == "factor")
+		return compileFactor(node);
+	unsupported("uses " + label);
+}
+
+CTranspiler::CExpr CTranspiler::compileComparison(ParseTreeNode *node)
+{
+	const auto &c = node->children;
+	vector<CExpr> operands = {expr(c[0])};
+	vector<ParseTreeNode *> operandNodes = {c[0]};
+	vector<string> comparisons;
+	for (size_t k = 1; k + 1 < c.size(); k += 2)
+	{
+		string opText = comparisonOperator(c[k]);
+		CExpr right = expr(c[k + 1]);
+		if (opText == "<" || opText == "<=" || opText == ">" || opText == ">=" || opText == "==" || opText == "!=")
+		{
+			comparisons.push_back(opText);
+			operands.push_back(right);
+			operandNodes.push_back(c[k + 1]);
+		}
+		else
+		{
+			operands.back() = binary(opText, operands.back(), right, c[k + 1]);
+			operandNodes.back() = nullptr;
+		}
+	}
+	if (comparisons.empty())
+		return operands[0];
+	// Middle operands of a chain are evaluated twice, so they must be plain values
+	for (size_t k = 1; k + 1 < operands.size(); k++)
+	{
+		ConstValue v;
+		if (!operandNodes[k] || (!variableName(operandNodes[k]) && !literalOf(operandNodes[k], v)))
+			unsupported("chains comparisons over a computed value");
+	}
+	// Later links only run once the earlier ones held, so only the first
+	// link's operands can race
+	string joined, stores = sequence({&operands[0], &operands[1]});
+	bool unknown = false;
+	for (size_t k = 0; k < comparisons.size(); k++)
+	{
+		const CExpr &a = operands[k], &b = operands[k + 1];
+		unknown = unknown || a.type == CType::Unknown || b.type == CType::Unknown;
+		bool mixed = (a.type == CType::Float) != (b.type == CType::Float);
+		string link = mixed ? asDouble(a) + " " + comparisons[k] + " " + asDouble(b)
+							: a.code + " " + comparisons[k] + " " + b.code;
+		joined += (k ? " && " : "") + ("(" + link + ")");
+	}
+	if (!stores.empty())
+		joined = "(" + stores + joined + ")";
+	else if (comparisons.size() > 1)
+		joined = "(" + joined + ")";
+	return {unknown ? CType::Unknown : CType::Bool, joined};
+}
+
+bool CTranspiler::mayRaise(const string &code)
+{
+	for (size_t at = 0; at < code.size(); at++)
+	{
+		bool start = at == 0 || !(isalnum(static_cast<unsigned char>(code[at - 1])) || code[at - 1] == '_');
+		if (start && (code.compare(at, 4, "pyc_") == 0 || code.compare(at, 2, "f_") == 0))
+			return true;
+	}
+	return false;
+}
+
+string CTranspiler::sequence(const vector<CExpr *> &operands)
+{
+	size_t last = 0;
+	for (size_t k = 0; k < operands.size(); k++)
+	{
+		if (operands[k]->type == CType::Unknown)
+			return "";
+		if (mayRaise(operands[k]->code))
+			last = k;
+	}
+	string stores;
+	for (size_t k = 0; k < last; k++)
+	{
+		if (!mayRaise(operands[k]->code))
+			continue;
+		string name = "s" + to_string(fn->sequenced.size());
+		fn->sequenced.push_back(operands[k]->type);
+		stores += name + " = " + operands[k]->code + ", ";
+		operands[k]->code = name;
+	}
+	return stores;
+}
+
+CTranspiler::CExpr CTranspiler::binary(const string &op, CExpr a, CExpr b, ParseTreeNode *rightNode)
+{
+	string stores = sequence({&a, &b});
+	CExpr e = combine(op, a, b, rightNode);
+	if (!stores.empty())
+		e.code = "(" + stores + e.code + ")";
+	return e;
+}
+
+CTranspiler::CExpr CTranspiler::combine(const string &op, const CExpr &a, const CExpr &b, ParseTreeNode *rightNode)
+{
+	if (a.type == CType::Unknown || b.type == CType::Unknown)
+		return {CType::Unknown, "0"};
+	bool floats = a.type == CType::Float || b.type == CType::Float;
+	if (op == "&" || op == "|" || op == "^")
+	{
+		if (floats)
+			unsupported("applies '" + op + "' to a float");
+		CType type = a.type == CType::Bool && b.type == CType::Bool ? CType::Bool : CType::Int;
+		return {type, "(" + a.code + " " + op + " " + b.code + ")"};
+	}
+	if (op == "<<" || op == ">>")
+	{
+		if (floats)
+			unsupported("applies '" + op + "' to a float");
+		return {CType::Int, "pyc_shift(" + a.code + ", " + b.code + ", " + (op == "<<" ? "1" : "0") + ")"};
+	}
+	if (op == "/")
+		return {CType::Float, floats ? "pyc_fdiv(" + asDouble(a) + ", " + asDouble(b) + ")" : "pyc_div(" + a.code + ", " + b.code + ")"};
+	if (floats)
+	{
+		string x = asDouble(a), y = asDouble(b);
+		if (op == "+" || op == "-" || op == "*")
+			return {CType::Float, "(" + x + " " + op + " " + y + ")"};
+		if (op == "%")
+			return {CType::Float, "pyc_fmod(" + x + ", " + y + ")"};
+		if (op == "//")
+			return {CType::Float, "pyc_ffloordiv(" + x + ", " + y + ")"};
+		if (op == "**")
+			return {CType::Float, "pyc_fpow(" + x + ", " + y + ")"};
+	}
+	else
+	{
+		static const unordered_map<string, string> helpers = {
+			{"+", "pyc_add"}, {"-", "pyc_sub"}, {"*", "pyc_mul"}, {"%", "pyc_mod"}, {"//", "pyc_floordiv"}};
+		auto helper = helpers.find(op);
+		if (helper != helpers.end())
+			return {CType::Int, helper->second + "(" + a.code + ", " + b.code + ")"};
+		if (op == "**")
+		{
+			// A negative exponent makes the result a float, so its sign must be known
+			ConstValue exponent;
+			if (!rightNode || !literalOf(rightNode, exponent) || exponent.kind != ConstValue::Kind::Int || exponent.i < 0)
+				unsupported("raises an int to a power that is not a non-negative literal");
+			return {CType::Int, "pyc_pow(" + a.code + ", " + b.code + ")"};
+		}
+	}
+	unsupported("uses operator '" + op + "'");
+}
+
+CTranspiler::CExpr CTranspiler::compileFactor(ParseTreeNode *node)
+{
+	const auto &c = node->children;
+	ParseTreeNode *first = c[0];
+	if (isLeaf(first) && c.size() == 1)
+	{
+		if (classifyLeaf(first->label) == LeafKind::Name)
+			return load(first->label);
+		ConstValue v;
+		if (!parseLiteral(first->label, v))
+			unsupported("uses an integer literal that does not fit in 64 bits");
+		return literal(v);
+	}
+	if (isLeaf(first) && c.size() == 2 && c[1]->label == "factor")
+	{
+		if (first->label == "not")
+			return {CType::Bool, "!" + condition(c[1])};
+		CExpr operand = expr(c[1]);
+		if (operand.type == CType::Unknown)
+			return operand;
+		if (first->label == "~")
+		{
+			if (operand.type == CType::Float)
+				unsupported("applies '~' to a float");
+			return {CType::Int, "(~" + operand.code + ")"};
+		}
+		if (operand.type == CType::Float)
+			return {CType::Float, first->label == "-" ? "(-" + operand.code + ")" : operand.code};
+		if (first->label == "+")
+			return {CType::Int, operand.code};
+		// -True cannot overflow
+		return {CType::Int, operand.type == CType::Bool ? "(-" + operand.code + ")" : "pyc_neg(" + operand.code + ")"};
+	}
+	if (c.size() > 1 && c[1]->label == "(")
+		return compileCall(first, c.size() > 3 ? c[2] : nullptr);
+	if (first->label == "tuple_or_group")
+	{
+		vector<ParseTreeNode *> items;
+		for (ParseTreeNode *part : first->children)
+		{
+			if (part->label == ",")
+				unsupported("builds a tuple");
+			if (part->label == "expression")
+				items.push_back(part);
+		}
+		if (items.size() == 1)
+		{
+			CExpr inner = expr(items[0]);
+			return {inner.type, "(" + inner.code + ")"};
+		}
+	}
+	unsupported("uses " + first->label);
+}
+
+CTranspiler::CExpr CTranspiler::compileCall(ParseTreeNode *callee, ParseTreeNode *arguments)
+{
+	if (!isLeaf(callee))
+		unsupported("calls a method");
+	const string &name = callee->label;
+	vector<CExpr> args;
+	bool unknown = false;
+	if (arguments)
+		for (ParseTreeNode *arg : arguments->children)
+			if (arg->label == "expression")
+			{
+				args.push_back(expr(arg));
+				unknown = unknown || args.back().type == CType::Unknown;
+			}
+	vector<CExpr *> operands;
+	for (CExpr &arg : args)
+		operands.push_back(&arg);
+	string stores = sequence(operands);
+	auto sequenced = [&](CExpr e)
+	{
+		if (!stores.empty())
+			e.code = "(" + stores + e.code + ")";
+		return e;
+	};
+
+	auto target = index.find(name);
+	if (target != index.end() && !fn->bound.count(name) && !fn->types.count(name))
+	{
+		Function &g = functions[target->second];
+		if (!g.eligible)
+			unsupported("calls '" + name + "', which " + g.reason);
+		if (args.size() != g.params.size())
+			unsupported("calls '" + name + "' with " + to_string(args.size()) + " arguments");
+		string code = "f_" + name + "(";
+		for (size_t k = 0; k < args.size(); k++)
+		{
+			CType &param = g.types[g.params[k]];
+			if (param == CType::Unknown && args[k].type != CType::Unknown)
+			{
+				param = args[k].type;
+				changed = true;
+			}
+			else if (args[k].type != CType::Unknown && param != args[k].type)
+				unsupported("passes " + string(pythonTypeName(args[k].type)) + " to parameter '" + g.params[k] + "' of '" + name + "'");
+			code += (k ? ", " : "") + args[k].code;
+		}
+		if (g.result == CType::Unknown)
+			fn->pending = true;
+		return sequenced({unknown ? CType::Unknown : g.result, code + ")"});
+	}
+
+	if (!isBuiltin(name))
+		unsupported("calls '" + name + "'");
+	if (unknown)
+		return {CType::Unknown, "0"};
+	if (name == "abs" && args.size() == 1)
+	{
+		if (args[0].type == CType::Float)
+			return {CType::Float, "fabs(" + args[0].code + ")"};
+		return {CType::Int, "pyc_abs(" + args[0].code + ")"};
+	}
+	if (name == "int" && args.size() == 1)
+		return {CType::Int, args[0].type == CType::Float ? "pyc_trunc(" + args[0].code + ")" : "(long long)(" + args[0].code + ")"};
+	if (name == "float" && args.size() == 1)
+		return {CType::Float, asDouble(args[0])};
+	if (name == "bool" && args.size() == 1)
+		return {CType::Bool, truth(args[0])};
+	if ((name == "min" || name == "max") && args.size() == 2 && args[0].type == args[1].type && args[0].type != CType::Bool)
+	{
+		string helper = string(args[0].type == CType::Float ? "pyc_f" : "pyc_i") + name;
+		return sequenced({args[0].type, helper + "(" + args[0].code + ", " + args[1].code + ")"});
+	}
+	unsupported("calls '" + name + "' with arguments it cannot translate");
+}
+
+string CTranspiler::parameterList(Function &f)
+{
+	string list;
+	for (const string &param : f.params)
+		list += (list.empty() ? "" : ", ") + string(cTypeName(f.types[param])) + " v_" + param;
+	return list.empty() ? "void" : list;
+}
+
+TranspileResult CTranspiler::emitModule()
+{
+	TranspileResult result;
+	// Same call depth limit as the VM
+	out = "/* Generated by the Python compiler. Do not edit. */\n#define PYC_MAX_DEPTH 2000\n";
+	out += transpilerPrelude;
+
+	vector<Function *> native;
+	for (Function &f : functions)
+	{
+		if (f.eligible)
+			native.push_back(&f);
+		else
+			result.skipped.push_back({f.name, f.reason});
+	}
+	out += "\n";
+	for (Function *f : native)
+		out += "static " + string(cTypeName(f->result)) + " f_" + f->name + "(" + parameterList(*f) + ");\n";
+	for (Function *f : native)
+	{
+		out += "\nstatic " + string(cTypeName(f->result)) + " b_" + f->name + "(" + parameterList(*f) + ")\n{\n";
+		for (const string &local : f->localOrder)
+			out += "\t" + string(cTypeName(f->types[local])) + " v_" + local + " = 0;\n";
+		for (size_t k = 0; k < f->sequenced.size(); k++)
+			out += "\t" + string(cTypeName(f->sequenced[k])) + " s" + to_string(k) + ";\n";
+		out += f->code + "}\n";
+
+		out += "\nstatic " + string(cTypeName(f->result)) + " f_" + f->name + "(" + parameterList(*f) + ")\n{\n";
+		out += "\tpyc_enter();\n\t" + string(cTypeName(f->result)) + " r = b_" + f->name + "(";
+		for (size_t k = 0; k < f->params.size(); k++)
+			out += (k ? ", v_" : "v_") + f->params[k];
+		out += ");\n\tpyc_depth--;\n\treturn r;\n}\n";
+
+		// Entry point called by the VM, with C-level errors turned into a status
+		out += "\nstatic int e_" + f->name + "(const pyc_slot *args, pyc_slot *result, const char **message)\n{\n";
+		out += "\tint status = setjmp(pyc_error);\n\tif (status)\n\t{\n\t\t*message = pyc_message;\n\t\treturn status;\n\t}\n";
+		out += "\tpyc_depth = 0;\n\tresult->" + string(f->result == CType::Float ? "f" : "i") + " = f_" + f->name + "(";
+		for (size_t k = 0; k < f->params.size(); k++)
+			out += string(k ? ", " : "") + "args[" + to_string(k) + "]." + (f->types[f->params[k]] == CType::Float ? "f" : "i");
+		out += ");\n\treturn PYC_OK;\n}\n";
+		result.functions.push_back({f->name, signatureOf(f->params, f->types, f->result)});
+		result.typed.push_back({f->name, f->node, f->params, f->types, f->result});
+	}
+
+	out += "\nconst pyc_export pyc_exports[] = {\n";
+	for (auto &[name, signature] : result.functions)
+		out += "\t{\"" + name + "\", \"" + signature + "\", e_" + name + "},\n";
+	out += "\t{0, 0, 0}};\n";
+	result.source = move(out);
+	return result;
+}
+} // namespace pyc::detail
@@ -0,0 +1,171 @@
+#include <math.h>
+#include <limits.h>
+#include <setjmp.h>
+
+typedef union { long long i; double f; } pyc_slot;
+typedef int (*pyc_entry)(const pyc_slot *, pyc_slot *, const char **);
+typedef struct { const char *name; const char *signature; pyc_entry entry; } pyc_export;
+
+enum { PYC_OK, PYC_ZERO_DIVISION, PYC_OVERFLOW, PYC_VALUE_ERROR, PYC_RECURSION };
+
+static jmp_buf pyc_error;
+static const char *pyc_message;
+static int pyc_depth;
+
+static void pyc_raise(int status, const char *message)
+{
+	pyc_message = message;
+	longjmp(pyc_error, status);
+}
+
+static inline long long pyc_add(long long a, long long b)
+{
+	long long r;
+	if (__builtin_add_overflow(a, b, &r))
+		pyc_raise(PYC_OVERFLOW, "integer result too large");
+	return r;
+}
+
+static inline long long pyc_sub(long long a, long long b)
+{
+	long long r;
+	if (__builtin_sub_overflow(a, b, &r))
+		pyc_raise(PYC_OVERFLOW, "integer result too large");
+	return r;
+}
+
+static inline long long pyc_mul(long long a, long long b)
+{
+	long long r;
+	if (__builtin_mul_overflow(a, b, &r))
+		pyc_raise(PYC_OVERFLOW, "integer result too large");
+	return r;
+}
+
+static inline long long pyc_neg(long long a)
+{
+	if (a == LLONG_MIN)
+		pyc_raise(PYC_OVERFLOW, "integer result too large");
+	return -a;
+}
+
+static inline double pyc_div(long long a, long long b)
+{
+	if (b == 0)
+		pyc_raise(PYC_ZERO_DIVISION, "division by zero");
+	return (double)a / (double)b;
+}
+
+static inline long long pyc_mod(long long a, long long b)
+{
+	if (b == 0)
+		pyc_raise(PYC_ZERO_DIVISION, "integer modulo by zero");
+	long long r = b == -1 ? 0 : a % b;
+	if (r != 0 && ((r < 0) != (b < 0)))
+		r += b;
+	return r;
+}
+
+static inline long long pyc_floordiv(long long a, long long b)
+{
+	if (b == 0)
+		pyc_raise(PYC_ZERO_DIVISION, "integer division or modulo by zero");
+	if (a == LLONG_MIN && b == -1)
+		pyc_raise(PYC_OVERFLOW, "integer result too large");
+	long long q = a / b;
+	if ((a % b != 0) && ((a < 0) != (b < 0)))
+		q--;
+	return q;
+}
+
+static inline long long pyc_pow(long long base, long long exponent)
+{
+	long long result = 1;
+	for (; exponent > 0; exponent >>= 1)
+	{
+		if ((exponent & 1) && __builtin_mul_overflow(result, base, &result))
+			pyc_raise(PYC_OVERFLOW, "integer result too large");
+		if (exponent > 1 && __builtin_mul_overflow(base, base, &base))
+			pyc_raise(PYC_OVERFLOW, "integer result too large");
+	}
+	return result;
+}
+
+static inline long long pyc_shift(long long x, long long n, int left)
+{
+	if (n < 0)
+		pyc_raise(PYC_VALUE_ERROR, "negative shift count");
+	if (!left)
+		return n >= 64 ? (x < 0 ? -1 : 0) : x >> n;
+	if (n >= 63 || (x != 0 && ((x << n) >> n) != x))
+		pyc_raise(PYC_OVERFLOW, "integer result too large");
+	return x << n;
+}
+
+static inline long long pyc_abs(long long a)
+{
+	return a < 0 ? pyc_neg(a) : a;
+}
+
+static inline double pyc_fdiv(double a, double b)
+{
+	if (b == 0.0)
+		pyc_raise(PYC_ZERO_DIVISION, "float division by zero");
+	return a / b;
+}
+
+static inline double pyc_fmod(double a, double b)
+{
+	if (b == 0.0)
+		pyc_raise(PYC_ZERO_DIVISION, "float modulo");
+	double r = fmod(a, b);
+	if (r != 0 && ((r < 0) != (b < 0)))
+		r += b;
+	return r;
+}
+
+static inline double pyc_ffloordiv(double a, double b)
+{
+	if (b == 0.0)
+		pyc_raise(PYC_ZERO_DIVISION, "float floor division by zero");
+	return floor(a / b);
+}
+
+static inline double pyc_fpow(double a, double b)
+{
+	if (a == 0.0 && b < 0)
+		pyc_raise(PYC_ZERO_DIVISION, "0.0 cannot be raised to a negative power");
+	return pow(a, b);
+}
+
+static inline long long pyc_trunc(double d)
+{
+	if (!isfinite(d) || fabs(d) >= 9.2e18)
+		pyc_raise(PYC_OVERFLOW, "cannot convert float to integer");
+	return (long long)d;
+}
+
+static inline long long pyc_imin(long long a, long long b) { return b < a ? b : a; }
+static inline long long pyc_imax(long long a, long long b) { return b > a ? b : a; }
+static inline double pyc_fmin(double a, double b) { return b < a ? b : a; }
+static inline double pyc_fmax(double a, double b) { return b > a ? b : a; }
+
+static inline long long pyc_range_step(long long step)
+{
+	if (step == 0)
+		pyc_raise(PYC_VALUE_ERROR, "range() arg 3 must not be zero");
+	return step;
+}
+
+// Next loop value, or 'stop' when adding the step would overflow
+static inline long long pyc_range_next(long long i, long long step, long long stop)
+{
+	long long r;
+	return __builtin_add_overflow(i, step, &r) ? stop : r;
+}
+
+static inline void pyc_enter(void)
+{
+	if (++pyc_depth > PYC_MAX_DEPTH)
+		pyc_raise(PYC_RECURSION, "maximum recursion depth exceeded");
+}
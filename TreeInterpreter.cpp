@@ -0,0 +1,437 @@
+#include "Engines.h"
+
+namespace pyc::detail
+{
+// ----------------------------------------------
+// Tree interpreter
+// ----------------------------------------------
+// Executes the parse tree directly: node labels are compared on every
+// visit, literals are re-parsed and variables are looked up by name. Kept
+// as the baseline the closure engine is measured against.
+
+TreeInterpreter::TreeInterpreter(ParseTreeNode *programRoot) : root(programRoot)
+{
+	internNames(root);
+}
+
+void TreeInterpreter::run(ClosureRuntime &rt)
+{
+	// Each Python call nests several large eval() frames on the C++ stack
+	rt.recursionLimit = 1000;
+	ClosureEnv env{&rt, nullptr};
+	execBlock(root, env);
+	rt.flushOutput();
+}
+
+void TreeInterpreter::internNames(const ParseTreeNode *node)
+{
+	if (node->children.empty() && classifyLeaf(node->label) == LeafKind::Name)
+		names.globalSlot(node->label);
+	for (const ParseTreeNode *child : node->children)
+		internNames(child);
+}
+
+Value TreeInterpreter::load(ClosureEnv &e, const string &name)
+{
+	if (e.locals)
+	{
+		auto it = e.locals->find(name);
+		if (it != e.locals->end())
+			return it->second;
+	}
+	return e.rt->loadGlobal(names.globalSlots.at(name));
+}
+
+void TreeInterpreter::store(ClosureEnv &e, const string &name, const Value &v)
+{
+	if (e.locals)
+		(*e.locals)[name] = v;
+	else
+		e.rt->storeGlobal(names.globalSlots.at(name), v);
+}
+
+Value TreeInterpreter::owner(ClosureEnv &e, const ParseTreeNode *dotted)
+{
+	Value v = load(e, dotted->children[0]->label);
+	for (size_t k = 2; k + 2 < dotted->children.size(); k += 2)
+		v = e.rt->getAttr(v, names.attrId(dotted->children[k]->label));
+	return v;
+}
+
+void TreeInterpreter::assign(ClosureEnv &e, const ParseTreeNode *target, const Value &v)
+{
+	if (target->children.empty())
+		store(e, target->label, v);
+	else
+		e.rt->setAttr(owner(e, target), names.attrId(target->children.back()->label), v);
+}
+
+Flow TreeInterpreter::execBlock(const ParseTreeNode *list, ClosureEnv &e)
+{
+	for (const ParseTreeNode *child : list->children)
+	{
+		Flow flow = exec(child, e);
+		if (flow != Flow::Normal)
+			return flow;
+	}
+	return Flow::Normal;
+}
+
+Flow TreeInterpreter::exec(const ParseTreeNode *node, ClosureEnv &e)
+{
+	const string &label = node->label;
+	const auto &c = node->children;
+	if (c.empty() || label == "pass_statement")
+		return Flow::Normal;
+	if (label == "statement")
+		return exec(c[0], e);
+	if (label == "assignment")
+	{
+		vector<const ParseTreeNode *> targets, values;
+		for (const ParseTreeNode *t : c[0]->children)
+			if (t->label != ",")
+				targets.push_back(t);
+		for (const ParseTreeNode *v : c[2]->children)
+			if (v->label == "expression")
+				values.push_back(v);
+		string op = c[1]->children.empty() ? "=" : c[1]->children[0]->label;
+		if (op != "=")
+		{
+			const ParseTreeNode *target = targets[0];
+			Value current = target->children.empty() ? load(e, target->label)
+													 : e.rt->getAttr(owner(e, target), names.attrId(target->children.back()->label));
+			assign(e, target, e.rt->binarySlow(binaryOpFor(op.substr(0, op.size() - 1)), current, eval(values[0], e)));
+			return Flow::Normal;
+		}
+		vector<Value> results;
+		for (const ParseTreeNode *v : values)
+			results.push_back(eval(v, e));
+		for (size_t k = 0; k < targets.size() && k < results.size(); k++)
+			assign(e, targets[k], results[k]);
+		return Flow::Normal;
+	}
+	if (label == "conditional_statement")
+	{
+		if (isTruthy(eval(c[1], e)))
+			return execBlock(c[3], e);
+		for (size_t k = 4; k < c.size(); k++)
+		{
+			if (c[k]->label == "elif_clause" && isTruthy(eval(c[k]->children[1], e)))
+				return execBlock(c[k]->children[3], e);
+			if (c[k]->label == "else_clause")
+				return execBlock(c[k]->children[2], e);
+		}
+		return Flow::Normal;
+	}
+	if (label == "while_statement")
+	{
+		while (isTruthy(eval(c[1], e)))
+		{
+			Flow flow = execBlock(c[3], e);
+			if (flow == Flow::Break)
+				break;
+			if (flow == Flow::Return)
+				return flow;
+		}
+		return Flow::Normal;
+	}
+	if (label == "for_statement")
+	{
+		Value it = e.rt->makeIterator(eval(c[3], e));
+		Value item;
+		while (e.rt->iteratorNext(it, item))
+		{
+			store(e, c[1]->label, item);
+			Flow flow = execBlock(c[5], e);
+			if (flow == Flow::Break)
+				break;
+			if (flow == Flow::Return)
+				return flow;
+		}
+		return Flow::Normal;
+	}
+	if (label == "try_statement")
+		return execTry(node, e);
+	if (label == "function")
+	{
+		store(e, c[1]->label, makeFunction(node, e));
+		return Flow::Normal;
+	}
+	if (label == "class_def")
+	{
+		auto *cls = new ClassObject(c[1]->label);
+		Value v(cls);
+		if (c.size() > 4 && c[2]->label == "(")
+			cls->base = load(e, c[3]->label);
+		for (const ParseTreeNode *member : c.back()->children)
+		{
+			if (member->label == "function")
+				cls->attrs[names.attrId(member->children[1]->label)] = makeFunction(member, e);
+			else if (member->label == "assignment")
+				cls->attrs[names.attrId(member->children[0]->children[0]->label)] = eval(member->children[2]->children.back(), e);
+		}
+		store(e, c[1]->label, v);
+		return Flow::Normal;
+	}
+	if (label == "import_statement")
+	{
+		if (c[0]->label == "import")
+		{
+			for (size_t k = 1; k < c.size(); k++)
+				if (c[k]->label == "dotted_name")
+				{
+					bool aliased = k + 2 < c.size() && c[k + 1]->label == "as";
+					string path;
+					for (const ParseTreeNode *part : c[k]->children)
+						path += part->label;
+					store(e, aliased ? c[k + 2]->label : c[k]->children[0]->label,
+						  e.rt->importModule(aliased ? path : c[k]->children[0]->label));
+				}
+			return Flow::Normal;
+		}
+		string path;
+		for (const ParseTreeNode *part : c[1]->children)
+			path += part->label;
+		Value module = e.rt->importModule(path);
+		for (size_t k = 3; k < c.size(); k++)
+		{
+			if (c[k]->label == "," || c[k]->label == "as" || c[k]->label == "*")
+				continue;
+			bool aliased = k + 2 < c.size() && c[k + 1]->label == "as";
+			store(e, aliased ? c[k + 2]->label : c[k]->label, e.rt->getAttr(module, names.attrId(c[k]->label)));
+			if (aliased)
+				k += 2;
+		}
+		return Flow::Normal;
+	}
+	if (label == "return_statement")
+	{
+		e.result = eval(c[1], e);
+		return Flow::Return;
+	}
+	if (label == "break_statement")
+		return Flow::Break;
+	if (label == "continue_statement")
+		return Flow::Continue;
+	if (label == "raise_statement")
+		e.rt->raiseValue(eval(c[1], e));
+	eval(node, e);
+	return Flow::Normal;
+}
+
+Flow TreeInterpreter::execTry(const ParseTreeNode *node, ClosureEnv &e)
+{
+	const auto &c = node->children;
+	const ParseTreeNode *finallyClause = nullptr;
+	for (const ParseTreeNode *part : c)
+		if (part->label == "finally_clause")
+			finallyClause = part;
+	Flow flow = Flow::Normal;
+	try
+	{
+		Value exc;
+		bool raised = false;
+		try
+		{
+			flow = execBlock(c[2], e);
+		}
+		catch (PyException &error)
+		{
+			exc = error.exc;
+			raised = true;
+		}
+		bool handled = !raised;
+		for (size_t k = 3; k < c.size() && !handled; k++)
+		{
+			const auto &clause = c[k]->children;
+			if (c[k]->label != "except_clause" ||
+				(clause.size() > 3 && !e.rt->exceptionMatches(exc, load(e, clause[1]->label))))
+				continue;
+			if (clause.size() > 4 && clause[2]->label == "as")
+				store(e, clause[3]->label, exc);
+			flow = execBlock(clause.back(), e);
+			handled = true;
+		}
+		if (!handled)
+			throw PyException{exc};
+		if (!raised && flow == Flow::Normal)
+			for (size_t k = 3; k < c.size(); k++)
+				if (c[k]->label == "else_clause")
+					flow = execBlock(c[k]->children[2], e);
+	}
+	catch (PyException &)
+	{
+		if (!finallyClause)
+			throw;
+		Flow override = execBlock(finallyClause->children[2], e);
+		if (override != Flow::Normal)
+			return override;
+		throw;
+	}
+	if (finallyClause)
+	{
+		Value result = move(e.result);
+		Flow override = execBlock(finallyClause->children[2], e);
+		if (override != Flow::Normal)
+			return override;
+		e.result = move(result);
+	}
+	return flow;
+}
+
+Value TreeInterpreter::makeFunction(const ParseTreeNode *node, ClosureEnv &e)
+{
+	auto &f = functions[node];
+	vector<Value> defaults;
+	vector<string> params;
+	for (const ParseTreeNode *param : node->children[3]->children)
+	{
+		if (param->label != "parameter")
+			continue;
+		params.push_back(param->children[0]->label);
+		if (param->children.size() == 3)
+			defaults.push_back(eval(param->children[2], e));
+	}
+	if (!f)
+	{
+		f = make_unique<ClosureFunction>();
+		f->name = node->children[1]->label;
+		f->numParams = f->numSlots = static_cast<uint16_t>(params.size());
+		f->numDefaults = static_cast<uint16_t>(defaults.size());
+		const ParseTreeNode *body = node->children.back();
+		f->body = [this, params, body](ClosureEnv &env)
+		{
+			unordered_map<string, Value> locals;
+			for (size_t k = 0; k < params.size(); k++)
+				locals[params[k]] = env.slots[k];
+			env.locals = &locals;
+			return execBlock(body, env);
+		};
+	}
+	auto *function = new FunctionObject(f.get());
+	Value v(function);
+	function->defaults = move(defaults);
+	return v;
+}
+
+Value TreeInterpreter::eval(const ParseTreeNode *node, ClosureEnv &e)
+{
+	const string &label = node->label;
+	const auto &c = node->children;
+	if (c.size() == 1 && label != "factor")
+		return eval(c[0], e);
+	if (label == "or_expression" || label == "and_expression")
+	{
+		Value v;
+		for (size_t k = 0; k < c.size(); k += 2)
+		{
+			v = eval(c[k], e);
+			if (isTruthy(v) == (label == "or_expression"))
+				break;
+		}
+		return v;
+	}
+	if (label == "not_expression")
+		return Value::boolean(!isTruthy(eval(c[1], e)));
+	if (label == "comparison" || label == "arithmetic" || label == "term")
+	{
+		Value left = eval(c[0], e);
+		Value result = left;
+		for (size_t k = 1; k + 1 < c.size(); k += 2)
+		{
+			string opText;
+			if (c[k]->children.empty())
+				opText = c[k]->label;
+			for (const ParseTreeNode *part : c[k]->children)
+				opText += (opText.empty() ? "" : " ") + part->label;
+			Op op = binaryOpFor(opText);
+			Value right = eval(c[k + 1], e);
+			if (label != "comparison" || !isComparisonOp(op))
+			{
+				result = left = e.rt->binarySlow(op, left, right);
+				continue;
+			}
+			result = e.rt->binarySlow(op, left, right);
+			if (!isTruthy(result))
+				return result;
+			left = right;
+		}
+		return result;
+	}
+	if (label == "function_call")
+	{
+		const ParseTreeNode *arguments = nullptr;
+		for (const ParseTreeNode *part : c)
+			if (part->label == "arguments")
+				arguments = part;
+		return call(c[0], arguments, e);
+	}
+	if (label == "factor")
+	{
+		const ParseTreeNode *first = c[0];
+		if (first->children.empty() && c.size() == 1)
+		{
+			if (classifyLeaf(first->label) == LeafKind::Name)
+				return load(e, first->label);
+			ConstValue literal;
+			if (!parseLiteral(first->label, literal))
+				e.rt->raise("OverflowError", "integer literal too large");
+			return constToValue(literal);
+		}
+		if (first->children.empty() && c.size() == 2)
+		{
+			static const unordered_map<string, Op> unary = {
+				{"-", Op::NEG}, {"+", Op::POS}, {"~", Op::INVERT}, {"not", Op::NOT}};
+			return e.rt->unarySlow(unary.at(first->label), eval(c[1], e));
+		}
+		if (c.size() > 1 && c[1]->label == "(")
+			return call(first, c.size() > 3 ? c[2] : nullptr, e);
+		if (first->label == "dotted_name")
+			return e.rt->getAttr(owner(e, first), names.attrId(first->children.back()->label));
+		vector<Value> items;
+		bool hasComma = false;
+		for (const ParseTreeNode *part : first->children)
+		{
+			if (part->label == "expression")
+				items.push_back(eval(part, e));
+			hasComma = hasComma || part->label == ",";
+		}
+		if (first->label == "tuple_or_group" && items.size() == 1 && !hasComma)
+			return items[0];
+		if (first->label == "tuple_or_group" || first->label == "list_literal")
+		{
+			auto *list = new ListObject(first->label == "list_literal" ? ObjKind::List : ObjKind::Tuple);
+			Value v(list);
+			list->items = move(items);
+			return v;
+		}
+		bool isDict = first->label == "dict_literal";
+		auto *dict = new DictObject(isDict ? ObjKind::Dict : ObjKind::Set);
+		Value v(dict);
+		for (size_t k = 0; k < items.size(); k += isDict ? 2 : 1)
+			dict->set(items[k], isDict ? items[k + 1] : Value());
+		return v;
+	}
+	e.rt->raise("RuntimeError", "cannot evaluate '" + label + "'");
+}
+
+Value TreeInterpreter::call(const ParseTreeNode *callee, const ParseTreeNode *arguments, ClosureEnv &e)
+{
+	vector<Value> args;
+	if (arguments)
+		for (const ParseTreeNode *arg : arguments->children)
+			if (arg->label == "expression")
+				args.push_back(eval(arg, e));
+	bool method = !callee->children.empty();
+	Value target = method ? owner(e, callee) : load(e, callee->label);
+	ClosureRuntime &rt = *e.rt;
+	Value *base = rt.reserve(args.size());
+	ClosureRuntime::StackMark mark{rt, base};
+	for (size_t k = 0; k < args.size(); k++)
+		base[k] = args[k];
+	int argc = static_cast<int>(args.size());
+	if (method)
+		return rt.callMethod(target, names.attrId(callee->children.back()->label), base, argc);
+	return rt.call(target, base, argc);
+}
+} // namespace pyc::detail
@@ -0,0 +1,477 @@
+#include "Engines.h"
+
+namespace pyc::detail
+{
+// ----------------------------------------------
+// Virtual machine
+// ----------------------------------------------
+// GCC and Clang dispatch through a table of label addresses (one indirect
+// jump per instruction); other compilers fall back to a switch.
+#if defined(__GNUC__)
+#define VM_COMPUTED_GOTO 1
+#else
+#define VM_COMPUTED_GOTO 0
+#endif
+
+void VirtualMachine::execute(FunctionObject *entry)
+{
+	size_t baseDepth = frames.size();
+	Value *firstFree = frames.empty() ? registers.get() : frames.back().regs + frames.back().code->numRegisters;
+	pushFrame(entry, firstFree, 0, 0);
+
+	const CodeObject *code = frames.back().code;
+	const Instr *codeBase = code->code.data();
+	const Instr *pc = codeBase;
+	const Instr *ip = pc;
+	Value *R = frames.back().regs;
+	const Value *K = code->constants.data();
+
+#define RK(x) ((x) & RK_CONSTANT ? K[(x) & ~RK_CONSTANT] : R[x])
+#define LOAD_FRAME()                         \
+	do                                       \
+	{                                        \
+		code = frames.back().code;           \
+		codeBase = code->code.data();        \
+		R = frames.back().regs;              \
+		K = code->constants.data();          \
+	} while (0)
+
+#if VM_COMPUTED_GOTO
+	static void *dispatchTable[] = {
+#define BYTECODE_LABEL(name) &&op_##name,
+		BYTECODE_OPS(BYTECODE_LABEL)
+#undef BYTECODE_LABEL
+	};
+#define VM_CASE(name) op_##name:
+#define VM_NEXT()                                                 \
+	do                                                            \
+	{                                                             \
+		ip = pc++;                                                \
+		if (countInstructions)                                    \
+			instructionCount++;                                   \
+		goto *dispatchTable[static_cast<size_t>(ip->op)];        \
+	} while (0)
+#else
+#define VM_CASE(name) case Op::name:
+#define VM_NEXT() goto dispatch
+#endif
+
+	for (;;)
+	{
+		try
+		{
+#if VM_COMPUTED_GOTO
+			VM_NEXT();
+#else
+		dispatch:
+			ip = pc++;
+			if (countInstructions)
+				instructionCount++;
+			switch (ip->op)
+			{
+#endif
+			VM_CASE(LOADK)
+			{
+				R[ip->a] = K[ip->bx()];
+				VM_NEXT();
+			}
+			VM_CASE(LOADNONE)
+			{
+				R[ip->a] = Value();
+				VM_NEXT();
+			}
+			VM_CASE(MOVE)
+			{
+				R[ip->a] = R[ip->b];
+				VM_NEXT();
+			}
+			VM_CASE(LOADGLOBAL)
+			{
+				R[ip->a] = loadGlobal(ip->bx());
+				VM_NEXT();
+			}
+			VM_CASE(STOREGLOBAL)
+			{
+				globals[ip->bx()] = R[ip->a];
+				VM_NEXT();
+			}
+			VM_CASE(CHECKLOCAL)
+			{
+				if (R[ip->a].tag == Value::Tag::Undefined)
+					raise("NameError", "local variable '" + static_cast<StrObject *>(K[ip->bx()].obj)->s +
+										   "' referenced before assignment");
+				VM_NEXT();
+			}
+			VM_CASE(ADD)
+			{
+				const Value &x = RK(ip->b);
+				const Value &y = RK(ip->c);
+				long long r;
+				if (x.tag == Value::Tag::Int && y.tag == Value::Tag::Int && !__builtin_add_overflow(x.i, y.i, &r))
+				{
+					R[ip->a].setInt(r);
+					VM_NEXT();
+				}
+				if (x.tag == Value::Tag::Float && y.tag == Value::Tag::Float)
+				{
+					R[ip->a] = Value::number(x.f + y.f);
+					VM_NEXT();
+				}
+				// s = s + t appends in place when s holds the only reference
+				if (ip->a == ip->b && x.isObject(ObjKind::Str) && y.isObject(ObjKind::Str) && x.obj->refs == 1)
+				{
+					static_cast<StrObject *>(x.obj)->s += static_cast<StrObject *>(y.obj)->s;
+					VM_NEXT();
+				}
+				R[ip->a] = binarySlow(Op::ADD, x, y);
+				VM_NEXT();
+			}
+			VM_CASE(SUB)
+			{
+				const Value &x = RK(ip->b);
+				const Value &y = RK(ip->c);
+				long long r;
+				if (x.tag == Value::Tag::Int && y.tag == Value::Tag::Int && !__builtin_sub_overflow(x.i, y.i, &r))
+				{
+					R[ip->a].setInt(r);
+					VM_NEXT();
+				}
+				R[ip->a] = binarySlow(Op::SUB, x, y);
+				VM_NEXT();
+			}
+			VM_CASE(MUL)
+			{
+				const Value &x = RK(ip->b);
+				const Value &y = RK(ip->c);
+				long long r;
+				if (x.tag == Value::Tag::Int && y.tag == Value::Tag::Int && !__builtin_mul_overflow(x.i, y.i, &r))
+				{
+					R[ip->a].setInt(r);
+					VM_NEXT();
+				}
+				R[ip->a] = binarySlow(Op::MUL, x, y);
+				VM_NEXT();
+			}
+			VM_CASE(MOD)
+			{
+				const Value &x = RK(ip->b);
+				const Value &y = RK(ip->c);
+				if (x.tag == Value::Tag::Int && y.tag == Value::Tag::Int && y.i > 0)
+				{
+					long long r = x.i % y.i;
+					R[ip->a].setInt(r < 0 ? r + y.i : r);
+					VM_NEXT();
+				}
+				R[ip->a] = binarySlow(Op::MOD, x, y);
+				VM_NEXT();
+			}
+			VM_CASE(DIV)
+			VM_CASE(FLOORDIV)
+			VM_CASE(POW)
+			VM_CASE(BITAND)
+			VM_CASE(BITOR)
+			VM_CASE(BITXOR)
+			VM_CASE(SHL)
+			VM_CASE(SHR)
+			VM_CASE(EQ)
+			VM_CASE(NE)
+			VM_CASE(IN)
+			VM_CASE(NOTIN)
+			VM_CASE(IS)
+			VM_CASE(ISNOT)
+			{
+				R[ip->a] = binarySlow(ip->op, RK(ip->b), RK(ip->c));
+				VM_NEXT();
+			}
+			VM_CASE(LT)
+			VM_CASE(LE)
+			VM_CASE(GT)
+			VM_CASE(GE)
+			{
+				const Value &x = RK(ip->b);
+				const Value &y = RK(ip->c);
+				if (x.tag == Value::Tag::Int && y.tag == Value::Tag::Int)
+				{
+					bool r = ip->op == Op::LT ? x.i < y.i : ip->op == Op::LE ? x.i <= y.i : ip->op == Op::GT ? x.i > y.i : x.i >= y.i;
+					R[ip->a] = Value::boolean(r);
+					VM_NEXT();
+				}
+				R[ip->a] = binarySlow(ip->op, x, y);
+				VM_NEXT();
+			}
+			VM_CASE(NEG)
+			VM_CASE(POS)
+			VM_CASE(INVERT)
+			VM_CASE(NOT)
+			{
+				R[ip->a] = unarySlow(ip->op, RK(ip->b));
+				VM_NEXT();
+			}
+			VM_CASE(JMP)
+			{
+				pc = codeBase + ip->bx();
+				VM_NEXT();
+			}
+			VM_CASE(JMPIF)
+			{
+				if (isTruthy(R[ip->a]))
+					pc = codeBase + ip->bx();
+				VM_NEXT();
+			}
+			VM_CASE(JMPIFNOT)
+			{
+				if (!isTruthy(R[ip->a]))
+					pc = codeBase + ip->bx();
+				VM_NEXT();
+			}
+			VM_CASE(LTJMPIFNOT)
+			{
+				const Value &x = RK(ip->b);
+				const Value &y = RK(ip->c);
+				bool less = x.tag == Value::Tag::Int && y.tag == Value::Tag::Int
+								? x.i < y.i
+								: isTruthy(binarySlow(Op::LT, x, y));
+				pc = less ? pc + 1 : codeBase + pc->bx();
+				VM_NEXT();
+			}
+			VM_CASE(CALL)
+			{
+				Value callee = R[ip->b];
+				Value result;
+				frames.back().pc = pc;
+				if (beginCall(callee, &R[ip->b + 1], ip->c, ip->a, result))
+				{
+					LOAD_FRAME();
+					pc = codeBase;
+					VM_NEXT();
+				}
+				R[ip->a] = move(result);
+				VM_NEXT();
+			}
+			VM_CASE(CALLMETHOD)
+			{
+				uint32_t name = pc->bx();
+				pc++;
+				Value receiver = R[ip->b];
+				Value result;
+				frames.back().pc = pc;
+				if (receiver.isObject(ObjKind::Instance))
+				{
+					auto *inst = static_cast<InstanceObject *>(receiver.obj);
+					Value *own = inst->find(name);
+					const Value *method = own ? nullptr : inst->classObject()->lookup(name);
+					if (method && method->isObject(ObjKind::Function))
+					{
+						// self is already in place right before the arguments
+						pushFrame(static_cast<FunctionObject *>(method->obj), &R[ip->b], ip->c + 1, ip->a);
+						LOAD_FRAME();
+						pc = codeBase;
+						VM_NEXT();
+					}
+					if (!own && !method)
+						raise("AttributeError", "'" + typeNameOf(receiver) + "' object has no attribute '" + program.attrNames[name] + "'");
+					Value callee = own ? *own : *method;
+					if (beginCall(callee, &R[ip->b + 1], ip->c, ip->a, result))
+					{
+						LOAD_FRAME();
+						pc = codeBase;
+						VM_NEXT();
+					}
+				}
+				else if (receiver.isObject(ObjKind::Class) || receiver.isObject(ObjKind::Module))
+				{
+					Value callee = getAttr(receiver, name);
+					if (beginCall(callee, &R[ip->b + 1], ip->c, ip->a, result))
+					{
+						LOAD_FRAME();
+						pc = codeBase;
+						VM_NEXT();
+					}
+				}
+				else
+				{
+					result = callBuiltinMethod(receiver, name, &R[ip->b + 1], ip->c);
+				}
+				R[ip->a] = move(result);
+				VM_NEXT();
+			}
+			VM_CASE(GETATTR)
+			{
+				R[ip->a] = getAttr(R[ip->b], ip->c);
+				VM_NEXT();
+			}
+			VM_CASE(SETATTR)
+			{
+				setAttr(R[ip->a], ip->b, RK(ip->c));
+				VM_NEXT();
+			}
+			VM_CASE(BUILDLIST)
+			VM_CASE(BUILDTUPLE)
+			{
+				auto *list = new ListObject(ip->op == Op::BUILDLIST ? ObjKind::List : ObjKind::Tuple);
+				Value v(list);
+				list->items.assign(&R[ip->b], &R[ip->b] + ip->c);
+				R[ip->a] = move(v);
+				VM_NEXT();
+			}
+			VM_CASE(BUILDSET)
+			VM_CASE(BUILDDICT)
+			{
+				bool isSet = ip->op == Op::BUILDSET;
+				auto *dict = new DictObject(isSet ? ObjKind::Set : ObjKind::Dict);
+				Value v(dict);
+				for (uint16_t k = 0; k < ip->c; k++)
+				{
+					if (isSet)
+						dict->set(R[ip->b + k], Value());
+					else
+						dict->set(R[ip->b + 2 * k], R[ip->b + 2 * k + 1]);
+				}
+				R[ip->a] = move(v);
+				VM_NEXT();
+			}
+			VM_CASE(ITER)
+			{
+				R[ip->a] = makeIterator(R[ip->b]);
+				VM_NEXT();
+			}
+			VM_CASE(FORITER)
+			{
+				Value &it = R[ip->b];
+				if (it.isObject(ObjKind::RangeIter))
+				{
+					auto *r = static_cast<RangeIterObject *>(it.obj);
+					if (r->step > 0 ? r->next < r->stop : r->next > r->stop)
+					{
+						R[ip->a].setInt(r->next);
+						r->next += r->step;
+						pc++;
+					}
+					else
+						pc = codeBase + pc->bx();
+					VM_NEXT();
+				}
+				Value item;
+				if (iteratorNext(it, item))
+				{
+					R[ip->a] = move(item);
+					pc++;
+				}
+				else
+					pc = codeBase + pc->bx();
+				VM_NEXT();
+			}
+			VM_CASE(MAKEFUNC)
+			{
+				auto *f = new FunctionObject(program.codes[ip->b].get());
+				Value v(f);
+				if (ip->c != NO_REG)
+					f->defaults.assign(&R[ip->c], &R[ip->c] + f->code->numDefaults);
+				R[ip->a] = move(v);
+				VM_NEXT();
+			}
+			VM_CASE(MAKENATIVE)
+			{
+				auto *prototype = static_cast<NativeObject *>(K[ip->b].obj);
+				R[ip->a] = Value(new NativeObject(prototype->name, prototype->signature, prototype->entry, R[ip->a]));
+				VM_NEXT();
+			}
+			VM_CASE(MAKECLASS)
+			{
+				auto *cls = new ClassObject(static_cast<StrObject *>(K[ip->b].obj)->s);
+				Value v(cls);
+				if (ip->c != NO_REG)
+				{
+					if (!R[ip->c].isObject(ObjKind::Class))
+						raise("TypeError", "base of class '" + cls->name + "' is not a class");
+					cls->base = R[ip->c];
+				}
+				R[ip->a] = move(v);
+				VM_NEXT();
+			}
+			VM_CASE(RETURN)
+			{
+				Value result = RK(ip->a);
+				Frame &frame = frames.back();
+				if (frame.constructed.tag == Value::Tag::Object)
+					result = move(frame.constructed);
+				uint16_t dest = frame.resultReg;
+				for (uint16_t k = 0; k < frame.code->numRegisters; k++)
+					frame.regs[k] = Value();
+				frames.pop_back();
+				if (frames.size() == baseDepth)
+					goto finished;
+				LOAD_FRAME();
+				pc = frames.back().pc;
+				R[dest] = move(result);
+				VM_NEXT();
+			}
+			VM_CASE(RAISE)
+			{
+				raiseValue(R[ip->a]);
+			}
+			VM_CASE(RERAISE)
+			{
+				throw PyException{R[ip->a]};
+			}
+			VM_CASE(EXCMATCH)
+			{
+				R[ip->a] = Value::boolean(exceptionMatches(R[ip->b], R[ip->c]));
+				VM_NEXT();
+			}
+			VM_CASE(IMPORT)
+			{
+				R[ip->a] = importModule(static_cast<StrObject *>(K[ip->bx()].obj)->s);
+				VM_NEXT();
+			}
+			VM_CASE(EXTRA)
+			{
+				VM_NEXT();
+			}
+#if !VM_COMPUTED_GOTO
+			}
+#endif
+		}
+		catch (PyException &e)
+		{
+			// Unwind to the innermost handler covering the faulting instruction
+			uint32_t at = static_cast<uint32_t>(ip - codeBase);
+			while (true)
+			{
+				const ExceptionHandler *handler = nullptr;
+				for (const ExceptionHandler &h : code->handlers)
+				{
+					if (at >= h.start && at < h.end)
+					{
+						handler = &h;
+						break;
+					}
+				}
+				if (handler)
+				{
+					R[handler->reg] = e.exc;
+					pc = codeBase + handler->target;
+					break;
+				}
+				Frame &frame = frames.back();
+				for (uint16_t k = 0; k < frame.code->numRegisters; k++)
+					frame.regs[k] = Value();
+				frames.pop_back();
+				if (frames.size() == baseDepth)
+					throw;
+				LOAD_FRAME();
+				// The caller's pc already points past its call instruction
+				at = static_cast<uint32_t>(frames.back().pc - codeBase) - 1;
+				if (codeBase[at].op == Op::EXTRA)
+					at--;
+			}
+		}
+	}
+finished:
+	return;
+#undef RK
+#undef LOAD_FRAME
+#undef VM_CASE
+#undef VM_NEXT
+}
+} // namespace pyc::detail
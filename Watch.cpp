@@ -0,0 +1,398 @@
+#include "Tools.h"
+#ifdef __unix__
+#include <unistd.h>
+#include <poll.h>
+#endif
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+namespace pyc::detail
+{
+#ifdef __linux__
+// ----------------------------------------------
+// Watch mode
+// ----------------------------------------------
+// --watch=ROOT compiles every module under ROOT, then follows inotify
+// events and recompiles only the files that were written. Every file keeps
+// its own CompilerSession, so the tokens, tree and symbols of files that
+// did not change stay in memory between edits. A burst of events is
+// debounced: once something arrives, events are collected until none has
+// come for 'debounceMs' (or 'maxDelayMs' has passed), and each touched file
+// is compiled once with its last contents.
+struct WatchUpdate
+{
+	string path; // relative to the root
+	uint64_t hash = 0;
+	bool removed = false;
+	size_t lexErrors = 0;
+	int syntaxErrors = 0;
+	string messages; // lexer errors and the first syntax error, one per line
+};
+
+class SourceWatcher
+{
+public:
+	SourceWatcher(const string &rootDir, const string &outputDir, unsigned jobs, int debounce = 2)
+		: root(rootDir), output(outputDir), debounceMs(debounce), pool(jobs)
+	{
+		notify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (notify < 0)
+			throw runtime_error(string("cannot initialize inotify: ") + strerror(errno));
+	}
+
+	~SourceWatcher()
+	{
+		pool.wait();
+		close(notify);
+	}
+
+	SourceWatcher(const SourceWatcher &) = delete;
+	SourceWatcher &operator=(const SourceWatcher &) = delete;
+
+	// Watches every directory under the root and compiles every module
+	vector<WatchUpdate> start()
+	{
+		addDirectory("");
+		return compileDirty();
+	}
+
+	// Waits up to 'timeoutMs' for an event; false when none came. Otherwise
+	// 'updates' holds the files whose contents changed, and 'firstEvent'
+	// when the batch began.
+	bool poll(int timeoutMs, vector<WatchUpdate> &updates, chrono::steady_clock::time_point &firstEvent)
+	{
+		updates.clear();
+		if (!waitReadable(timeoutMs))
+			return false;
+		firstEvent = chrono::steady_clock::now();
+		readEvents();
+		while (waitReadable(debounceMs) &&
+			   chrono::steady_clock::now() - firstEvent < chrono::milliseconds(maxDelayMs))
+			readEvents();
+		updates = compileDirty();
+		return true;
+	}
+
+	size_t fileCount() const { return files.size(); }
+
+private:
+	struct WatchedFile
+	{
+		unique_ptr<CompilerSession> session = make_unique<CompilerSession>(true);
+		uint64_t hash = 0;
+		bool compiled = false;
+	};
+
+	bool waitReadable(int timeoutMs)
+	{
+		pollfd entry{notify, POLLIN, 0};
+		int ready;
+		do
+			ready = ::poll(&entry, 1, timeoutMs);
+		while (ready < 0 && errno == EINTR);
+		return ready > 0;
+	}
+
+	string absolute(const string &relative) const
+	{
+		return relative.empty() ? root : (filesystem::path(root) / relative).string();
+	}
+
+	static string join(const string &directory, const char *name)
+	{
+		return directory.empty() ? string(name) : directory + "/" + name;
+	}
+
+	// Starts watching 'relative' and everything below it. Files found there
+	// are marked dirty, since they may have been written before the watch existed.
+	void addDirectory(const string &relative)
+	{
+		const uint32_t mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE | IN_ONLYDIR;
+		int wd = inotify_add_watch(notify, absolute(relative).c_str(), mask);
+		if (wd < 0)
+			return;
+		directories[wd] = relative;
+		error_code ec;
+		for (filesystem::directory_iterator it(absolute(relative), filesystem::directory_options::skip_permission_denied, ec), end;
+			 it != end; it.increment(ec))
+		{
+			string name = it->path().filename().string();
+			if (it->is_directory(ec) && !it->is_symlink(ec))
+				addDirectory(join(relative, name.c_str()));
+			else if (it->path().extension() == ".py")
+				dirty.insert(join(relative, name.c_str()));
+		}
+	}
+
+	// The directory was deleted or moved away: stop watching it and recheck its files
+	void dropDirectory(const string &relative)
+	{
+		string prefix = relative + "/";
+		for (auto it = directories.begin(); it != directories.end();)
+			if (it->second == relative || it->second.compare(0, prefix.size(), prefix) == 0)
+			{
+				inotify_rm_watch(notify, it->first);
+				it = directories.erase(it);
+			}
+			else
+				++it;
+		for (const auto &[path, file] : files)
+			if (path.compare(0, prefix.size(), prefix) == 0)
+				dirty.insert(path);
+	}
+
+	void readEvents()
+	{
+		alignas(inotify_event) char buffer[64 * 1024];
+		for (;;)
+		{
+			ssize_t length = read(notify, buffer, sizeof(buffer));
+			if (length <= 0)
+				return; // EAGAIN: drained
+			for (char *p = buffer; p < buffer + length;)
+			{
+				const inotify_event *event = reinterpret_cast<const inotify_event *>(p);
+				p += sizeof(inotify_event) + event->len;
+				if (event->mask & IN_Q_OVERFLOW)
+				{
+					// Events were lost; rescan everything
+					for (const auto &[path, file] : files)
+						dirty.insert(path);
+					addDirectory("");
+					continue;
+				}
+				if (event->mask & IN_IGNORED)
+				{
+					directories.erase(event->wd);
+					continue;
+				}
+				auto directory = directories.find(event->wd);
+				if (directory == directories.end() || event->len == 0)
+					continue;
+				string path = join(directory->second, event->name);
+				if (event->mask & IN_ISDIR)
+				{
+					if (event->mask & (IN_CREATE | IN_MOVED_TO))
+						addDirectory(path);
+					else if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+						dropDirectory(path);
+				}
+				else if (filesystem::path(path).extension() == ".py" && !(event->mask & IN_CREATE))
+					dirty.insert(path); // creation is followed by IN_CLOSE_WRITE
+			}
+		}
+	}
+
+	// Compiles the dirty files, each with its own session and its latest
+	// contents; files that can no longer be read are dropped
+	vector<WatchUpdate> compileDirty()
+	{
+		vector<string> paths(dirty.begin(), dirty.end());
+		dirty.clear();
+		sort(paths.begin(), paths.end());
+		vector<WatchUpdate> results(paths.size());
+		vector<WatchedFile *> targets;
+		for (const string &path : paths)
+			targets.push_back(&files[path]); // the map is not touched by the workers
+		for (size_t k = 0; k < paths.size(); k++)
+			pool.submit([this, &paths, &results, &targets, k]
+						{ compileFile(paths[k], *targets[k], results[k]); });
+		pool.wait();
+
+		vector<WatchUpdate> updates;
+		for (size_t k = 0; k < paths.size(); k++)
+		{
+			if (results[k].removed)
+			{
+				error_code ec;
+				filesystem::remove(filesystem::path(output) / (paths[k] + ".txt"), ec);
+				bool known = targets[k]->compiled;
+				files.erase(paths[k]);
+				if (!known)
+					continue;
+			}
+			else if (results[k].path.empty())
+				continue; // contents unchanged
+			results[k].path = paths[k];
+			updates.push_back(move(results[k]));
+		}
+		return updates;
+	}
+
+	void compileFile(const string &path, WatchedFile &file, WatchUpdate &update)
+	{
+		string source;
+		try
+		{
+			source = readFile(absolute(path));
+		}
+		catch (const exception &)
+		{
+			update.removed = true;
+			return;
+		}
+		uint64_t hash = contentHash(source);
+		if (file.compiled && hash == file.hash)
+			return;
+		file.hash = hash;
+		file.compiled = true;
+		CompileResult result = file.session->compile(source);
+		if (!output.empty())
+			writeCompileReport(result, (filesystem::path(output) / (path + ".txt")).string());
+		update.path = path;
+		update.hash = hash;
+		update.lexErrors = result.lexErrors.size();
+		update.syntaxErrors = result.syntaxErrors;
+		for (const Error &error : result.lexErrors)
+			update.messages += "line " + to_string(error.line) + ": " + error.message + "\n";
+		if (result.syntaxErrors > 0)
+			update.messages += result.diagnostics.substr(0, result.diagnostics.find('\n') + 1);
+	}
+
+	string root, output;
+	int debounceMs;
+	const int maxDelayMs = 50;
+	int notify = -1;
+	unordered_map<int, string> directories; // watch descriptor -> relative path
+	unordered_map<string, WatchedFile> files;
+	unordered_set<string> dirty;
+	WorkStealingPool pool;
+};
+
+void printWatchUpdates(const vector<WatchUpdate> &updates)
+{
+	for (const WatchUpdate &u : updates)
+	{
+		if (u.removed)
+			cout << u.path << ": removed\n";
+		else if (u.lexErrors == 0 && u.syntaxErrors == 0)
+			cout << u.path << ": ok\n";
+		else
+		{
+			cout << u.path << ": " << u.lexErrors << " lexical, " << u.syntaxErrors << " syntax errors\n";
+			istringstream lines(u.messages);
+			string line;
+			while (getline(lines, line))
+				cout << "  " << line << "\n";
+		}
+	}
+}
+
+int watchSources(const string &root, const string &outputDir, unsigned jobs, int debounceMs)
+{
+	if (!filesystem::is_directory(root))
+	{
+		cerr << "Error: not a directory: " << root << endl;
+		return 1;
+	}
+	try
+	{
+		SourceWatcher watcher(root, outputDir, jobs, debounceMs);
+		auto start = chrono::steady_clock::now();
+		vector<WatchUpdate> updates = watcher.start();
+		size_t failing = 0;
+		for (const WatchUpdate &u : updates)
+			failing += u.lexErrors > 0 || u.syntaxErrors > 0;
+		cout << fixed << setprecision(1);
+		cout << "Watching " << watcher.fileCount() << " modules under " << root << " (" << failing << " with errors, "
+			 << chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() << " ms)" << endl;
+		chrono::steady_clock::time_point firstEvent;
+		for (;;)
+		{
+			if (!watcher.poll(-1, updates, firstEvent) || updates.empty())
+				continue;
+			printWatchUpdates(updates);
+			cout << "  [" << updates.size() << " recompiled, "
+				 << chrono::duration<double, milli>(chrono::steady_clock::now() - firstEvent).count() << " ms]" << endl;
+		}
+	}
+	catch (const exception &e)
+	{
+		cerr << "Error: " << e.what() << endl;
+		return 1;
+	}
+}
+
+void benchmarkWatch(size_t edits, unsigned jobs, int debounceMs)
+{
+	TempDirectory tree("pyc_watch_");
+	filesystem::path scratch = tree.path;
+	const size_t fileCount = 200;
+	vector<string> bodies;
+	for (size_t k = 0; k < fileCount; k++)
+	{
+		filesystem::path directory = scratch / ("pkg_" + to_string(k / 20));
+		filesystem::create_directories(directory);
+		bodies.push_back(generateSemanticBenchModule(40 + k % 160));
+		ofstream(directory / ("mod_" + to_string(k) + ".py")) << bodies.back();
+	}
+
+	SourceWatcher watcher(scratch.string(), "", jobs, debounceMs);
+	watcher.start();
+	mutex writesLock;
+	unordered_map<uint64_t, chrono::steady_clock::time_point> writes; // content hash -> written at
+	atomic<bool> done{false};
+	thread writer([&]
+				  {
+		size_t seed = 12345;
+		auto next = [&seed](size_t range)
+		{
+			seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+			return (seed >> 33) % range;
+		};
+		for (size_t edit = 0; edit < edits;)
+		{
+			// One file written 1-4 times in a row, or 2-5 files written together
+			bool sameFile = next(2) == 0;
+			size_t file = next(fileCount), count = 1 + next(4);
+			for (size_t n = 0; n < count + !sameFile && edit < edits; n++, edit++)
+			{
+				size_t k = sameFile ? file : (file + n * 7) % fileCount;
+				string source = bodies[k] + "edit_marker = " + to_string(edit) + "\n";
+				filesystem::path target = scratch / ("pkg_" + to_string(k / 20)) / ("mod_" + to_string(k) + ".py");
+				{
+					lock_guard<mutex> guard(writesLock);
+					writes[contentHash(source)] = chrono::steady_clock::now();
+				}
+				ofstream(target) << source;
+			}
+			this_thread::sleep_for(chrono::microseconds(4000 + next(8000)));
+		}
+		done = true; });
+
+	vector<double> latencies;
+	vector<WatchUpdate> updates;
+	chrono::steady_clock::time_point firstEvent;
+	size_t batches = 0, compiled = 0;
+	for (;;)
+	{
+		bool finished = done;
+		if (!watcher.poll(finished ? 200 : 20, updates, firstEvent) && finished)
+			break;
+		auto now = chrono::steady_clock::now();
+		batches += !updates.empty();
+		compiled += updates.size();
+		lock_guard<mutex> guard(writesLock);
+		for (const WatchUpdate &u : updates)
+		{
+			auto written = writes.find(u.hash);
+			if (written != writes.end())
+				latencies.push_back(chrono::duration<double, milli>(now - written->second).count());
+		}
+	}
+	writer.join();
+
+	sort(latencies.begin(), latencies.end());
+	auto at = [&](double fraction)
+	{ return latencies.empty() ? 0.0 : latencies[min(latencies.size() - 1, size_t(latencies.size() * fraction))]; };
+	cout << fixed << setprecision(2);
+	cout << "Watch latency: " << edits << " writes to " << fileCount << " files, debounce " << debounceMs << " ms, "
+		 << jobs << " jobs\n";
+	cout << "  " << batches << " batches, " << compiled << " recompiles, " << latencies.size() << " matched to a write\n";
+	cout << "  event to diagnostics: p50 " << at(0.5) << " ms, p90 " << at(0.9) << " ms, p99 " << at(0.99)
+		 << " ms, max " << at(1.0) << " ms\n";
+	cout << defaultfloat << setprecision(6);
+}
+#endif
+} // namespace pyc::detail
@@ -0,0 +1,11 @@
+# Float accumulation with mixed int and float operands
+def series(n):
+    total = 0.0
+    sign = 1.0
+    for k in range(n):
+        total = total + sign / (2 * k + 1)
+        sign = -sign
+    return 4.0 * total
+
+result = series(1000000)
+OPS = 1000000
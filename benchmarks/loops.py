@@ -0,0 +1,11 @@
+# Integer arithmetic in a while loop
+def count(n):
+    i = 0
+    total = 0
+    while i < n:
+        total = total + i % 7
+        i = i + 1
+    return total
+
+result = count(1000000)
+OPS = 1000000
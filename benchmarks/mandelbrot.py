@@ -0,0 +1,19 @@
+# Float arithmetic in nested loops: escape times on a 60x30 grid
+def escape(cr, ci, limit):
+    zr = 0.0
+    zi = 0.0
+    n = 0
+    while n < limit and zr * zr + zi * zi <= 4.0:
+        zr, zi = zr * zr - zi * zi + cr, 2.0 * zr * zi + ci
+        n = n + 1
+    return n
+
+def render(width, height, limit):
+    total = 0
+    for y in range(height):
+        for x in range(width):
+            total = total + escape(-2.0 + 3.0 * x / width, -1.0 + 2.0 * y / height, limit)
+    return total
+
+result = render(60, 30, 200)
+OPS = 1800
@@ -0,0 +1,16 @@
+# Method calls and attribute updates on an instance
+class Counter:
+    def __init__(self):
+        self.value = 0
+
+    def add(self, amount):
+        self.value = self.value + amount
+
+def run(n):
+    counter = Counter()
+    for i in range(n):
+        counter.add(i)
+    return counter.value
+
+result = run(300000)
+OPS = 300000
@@ -0,0 +1,20 @@
+# Integer division and comparisons: trial division up to 60000
+def is_prime(n):
+    if n < 2:
+        return False
+    d = 2
+    while d * d <= n:
+        if n % d == 0:
+            return False
+        d = d + 1
+    return True
+
+def count_primes(limit):
+    count = 0
+    for n in range(limit):
+        if is_prime(n):
+            count = count + 1
+    return count
+
+result = count_primes(60000)
+OPS = 60000
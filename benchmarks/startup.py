@@ -0,0 +1,18 @@
+# A short script: the time to its first result is dominated by start-up
+class Point:
+    def __init__(self, x, y):
+        self.x = x
+        self.y = y
+
+    def norm2(self):
+        return self.x * self.x + self.y * self.y
+
+def describe(p):
+    if p.norm2() > 10:
+        return "far"
+    return "near"
+
+points = [Point(1, 2), Point(3, 4), Point(0, 1)]
+for p in points:
+    print(describe(p), p.norm2())
+OPS = 3
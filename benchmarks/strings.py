@@ -0,0 +1,9 @@
+# Repeated string concatenation
+def build(n):
+    s = ""
+    for i in range(n):
+        s = s + "x"
+    return len(s)
+
+result = build(200000)
+OPS = 200000